@@ -0,0 +1,74 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "CameraPathFile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool LoadCameraPath(const char *pFileName, std::vector<CameraPathFrame> *pFrames)
+{
+	pFrames->clear();
+
+	FILE *pFile = fopen(pFileName, "r");
+	if (!pFile)
+		return false;
+
+	bool good = true;
+	char line[256];
+
+	while (good && fgets(line, sizeof line, pFile))
+	{
+		const char *pText = line + strspn(line, " \t\r\n");
+
+		if (*pText == 0 || *pText == '#')
+			continue;
+
+		CameraPathFrame frame;
+		good = sscanf(pText, "%f %f %f %f %f %f", &frame.camera[0], &frame.camera[1], &frame.camera[2], &frame.lookat[0], &frame.lookat[1], &frame.lookat[2]) == 6;
+
+		if (good)
+			pFrames->push_back(frame);
+	}
+
+	if (ferror(pFile))
+		good = false;
+
+	fclose(pFile);
+	pFile = NULL;
+
+	if (!good)
+		pFrames->clear();
+
+	return good;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool SaveCameraPath(const char *pFileName, const std::vector<CameraPathFrame> &frames)
+{
+	FILE *pFile = fopen(pFileName, "w");
+	if (!pFile)
+		return false;
+
+	bool good = fprintf(pFile, "# camera x y z, lookat x y z\n") > 0;
+
+	for (size_t i = 0; i < frames.size() && good; ++i)
+	{
+		const CameraPathFrame *pFrame = &frames[i];
+
+		// Enough digits to read back exactly the same floats.
+		good = fprintf(pFile, "%.9g %.9g %.9g %.9g %.9g %.9g\n", pFrame->camera[0], pFrame->camera[1], pFrame->camera[2], pFrame->lookat[0], pFrame->lookat[1], pFrame->lookat[2]) > 0;
+	}
+
+	if (fclose(pFile) != 0)
+		good = false;
+
+	return good;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,39 @@
+#ifndef HEADER_F9AFD911F8AB4A849C0D848CF7213B68
+#define HEADER_F9AFD911F8AB4A849C0D848CF7213B68
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Camera paths in text files, for recording where the camera went in
+// the app, frame by frame, and replaying it later without a window.
+//
+// Each line is one frame: the camera's position, then the point it's
+// looking at, as 6 numbers. Blank lines, and lines starting with #,
+// are skipped.
+//
+// There's no D3D in here, and no Windows either.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct CameraPathFrame
+{
+	float camera[3];
+	float lookat[3];
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool LoadCameraPath(const char *pFileName, std::vector<CameraPathFrame> *pFrames);
+bool SaveCameraPath(const char *pFileName, const std::vector<CameraPathFrame> &frames);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_F9AFD911F8AB4A849C0D848CF7213B68
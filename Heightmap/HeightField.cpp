@@ -0,0 +1,399 @@
+#include "HeightField.h"
+#include "TerrainGrid.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HEIGHT_FIELD_SSE2 1
+#include <emmintrin.h>
+#else
+#define HEIGHT_FIELD_SSE2 0
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+HeightField::HeightField():
+m_width(0),
+m_length(0),
+m_originX(0.f),
+m_originZ(0.f),
+m_stepX(1.f),
+m_stepZ(1.f),
+m_invStepX(1.f),
+m_invStepZ(1.f)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+HeightField::~HeightField()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool HeightField::Create(const TerrainGrid *pGrid)
+{
+	this->Destroy();
+
+	int width = pGrid->GetWidth();
+	int length = pGrid->GetLength();
+
+	if (width < 2 || length < 2)
+		return false;
+
+	m_width = width;
+	m_length = length;
+
+	m_originX = pGrid->GetOriginX();
+	m_originZ = pGrid->GetOriginZ();
+	m_stepX = pGrid->GetColumnStepX();
+	m_stepZ = pGrid->GetRowStepZ();
+	m_invStepX = 1.f / m_stepX;
+	m_invStepZ = 1.f / m_stepZ;
+
+	// Without the grid's padding.
+	m_heights.resize(size_t(width) * length);
+
+	for (int row = 0; row < length; ++row)
+	{
+		const float *pRow = pGrid->GetHeights() + row * pGrid->GetPitch();
+		std::copy(pRow, pRow + width, &m_heights[size_t(row) * width]);
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void HeightField::Destroy()
+{
+	m_heights.clear();
+	m_width = 0;
+	m_length = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int HeightField::GetWidth() const
+{
+	return m_width;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int HeightField::GetLength() const
+{
+	return m_length;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float HeightField::GetHeight(float x, float z, HeightFieldFilter filter) const
+{
+	if (m_heights.empty())
+		return 0.f;
+
+	float col, row;
+	this->GetGridPos(x, z, &col, &row);
+
+	float height, dhdcol, dhdrow;
+
+	if (filter == HEIGHT_FIELD_FILTER_BICUBIC)
+		this->SampleBicubic(col, row, &height, &dhdcol, &dhdrow);
+	else
+		this->SampleBilinear(col, row, &height, &dhdcol, &dhdrow);
+
+	return height;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void HeightField::GetNormal(float x, float z, HeightFieldFilter filter, float *pNormal) const
+{
+	pNormal[0] = 0.f;
+	pNormal[1] = 1.f;
+	pNormal[2] = 0.f;
+
+	if (m_heights.empty())
+		return;
+
+	float col, row;
+	this->GetGridPos(x, z, &col, &row);
+
+	float height, dhdcol, dhdrow;
+
+	if (filter == HEIGHT_FIELD_FILTER_BICUBIC)
+		this->SampleBicubic(col, row, &height, &dhdcol, &dhdrow);
+	else
+		this->SampleBilinear(col, row, &height, &dhdcol, &dhdrow);
+
+	// The surface is y=h(x,z), so the normal is (-dh/dx, 1, -dh/dz).
+	float nx = -dhdcol * m_invStepX;
+	float nz = -dhdrow * m_invStepZ;
+
+	float scale = 1.f / sqrtf(nx * nx + 1.f + nz * nz);
+
+	pNormal[0] = nx * scale;
+	pNormal[1] = scale;
+	pNormal[2] = nz * scale;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void HeightField::GetHeights(const float *pXs, const float *pZs, size_t numPositions, float *pHeights) const
+{
+	if (m_heights.empty())
+	{
+		std::fill(pHeights, pHeights + numPositions, 0.f);
+		return;
+	}
+
+	size_t i = 0;
+
+#if HEIGHT_FIELD_SSE2
+
+	const float *pGrid = &m_heights[0];
+	const size_t width = size_t(m_width);
+
+	const __m128 originX = _mm_set1_ps(m_originX);
+	const __m128 originZ = _mm_set1_ps(m_originZ);
+	const __m128 invStepX = _mm_set1_ps(m_invStepX);
+	const __m128 invStepZ = _mm_set1_ps(m_invStepZ);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 maxCol = _mm_set1_ps(float(m_width - 1));
+	const __m128 maxRow = _mm_set1_ps(float(m_length - 1));
+
+	// Positions on the far edge use the last quad, with a fraction of 1.
+	const __m128 maxQuadCol = _mm_set1_ps(float(m_width - 2));
+	const __m128 maxQuadRow = _mm_set1_ps(float(m_length - 2));
+
+	for (; i + 4 <= numPositions; i += 4)
+	{
+		__m128 col = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pXs + i), originX), invStepX);
+		__m128 row = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pZs + i), originZ), invStepZ);
+
+		col = _mm_min_ps(_mm_max_ps(col, zero), maxCol);
+		row = _mm_min_ps(_mm_max_ps(row, zero), maxRow);
+
+		// Values are >=0 by now, so truncating is the same as floor.
+		__m128 quadCol = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(col)), maxQuadCol);
+		__m128 quadRow = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(row)), maxQuadRow);
+
+		__m128 s = _mm_sub_ps(col, quadCol);
+		__m128 t = _mm_sub_ps(row, quadRow);
+
+		// No gather in SSE2, so the corners are fetched one by one.
+		int32_t quadCols[4], quadRows[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(quadCols), _mm_cvttps_epi32(quadCol));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(quadRows), _mm_cvttps_epi32(quadRow));
+
+		float h00[4], h10[4], h01[4], h11[4];
+
+		for (int j = 0; j < 4; ++j)
+		{
+			const float *p = pGrid + size_t(quadRows[j]) * width + size_t(quadCols[j]);
+
+			h00[j] = p[0];
+			h10[j] = p[1];
+			h01[j] = p[width];
+			h11[j] = p[width + 1];
+		}
+
+		__m128 v00 = _mm_loadu_ps(h00);
+		__m128 v10 = _mm_loadu_ps(h10);
+		__m128 v01 = _mm_loadu_ps(h01);
+		__m128 v11 = _mm_loadu_ps(h11);
+
+		__m128 top = _mm_add_ps(v00, _mm_mul_ps(_mm_sub_ps(v10, v00), s));
+		__m128 bottom = _mm_add_ps(v01, _mm_mul_ps(_mm_sub_ps(v11, v01), s));
+
+		_mm_storeu_ps(pHeights + i, _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), t)));
+	}
+
+#endif
+
+	for (; i < numPositions; ++i)
+		pHeights[i] = this->GetHeight(pXs[i], pZs[i], HEIGHT_FIELD_FILTER_BILINEAR);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const float *HeightField::GetGridHeights() const
+{
+	return m_heights.empty() ? NULL : &m_heights[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void HeightField::SetGridHeights(int minCol, int minRow, int maxCol, int maxRow, const float *pHeights)
+{
+	assert(minCol >= 0 && maxCol < m_width && minCol <= maxCol);
+	assert(minRow >= 0 && maxRow < m_length && minRow <= maxRow);
+
+	size_t numCols = size_t(maxCol - minCol + 1);
+
+	for (int row = minRow; row <= maxRow; ++row)
+	{
+		std::copy(pHeights, pHeights + numCols, &m_heights[size_t(row) * m_width + minCol]);
+		pHeights += numCols;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float HeightField::GetOriginX() const
+{
+	return m_originX;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float HeightField::GetOriginZ() const
+{
+	return m_originZ;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float HeightField::GetColumnStepX() const
+{
+	return m_stepX;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float HeightField::GetRowStepZ() const
+{
+	return m_stepZ;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void HeightField::GetGridPos(float x, float z, float *pCol, float *pRow) const
+{
+	float col = (x - m_originX) * m_invStepX;
+	float row = (z - m_originZ) * m_invStepZ;
+
+	*pCol = std::min(std::max(col, 0.f), float(m_width - 1));
+	*pRow = std::min(std::max(row, 0.f), float(m_length - 1));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float HeightField::GetClampedHeight(int col, int row) const
+{
+	col = std::min(std::max(col, 0), m_width - 1);
+	row = std::min(std::max(row, 0), m_length - 1);
+
+	return m_heights[size_t(row) * m_width + col];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void HeightField::SampleBilinear(float col, float row, float *pHeight, float *pDHDCol, float *pDHDRow) const
+{
+	int quadCol = std::min(int(col), m_width - 2);
+	int quadRow = std::min(int(row), m_length - 2);
+
+	float s = col - quadCol;
+	float t = row - quadRow;
+
+	const float *p = &m_heights[size_t(quadRow) * m_width + quadCol];
+
+	float h00 = p[0];
+	float h10 = p[1];
+	float h01 = p[m_width];
+	float h11 = p[m_width + 1];
+
+	float top = h00 + (h10 - h00) * s;
+	float bottom = h01 + (h11 - h01) * s;
+
+	*pHeight = top + (bottom - top) * t;
+	*pDHDCol = (h10 - h00) * (1.f - t) + (h11 - h01) * t;
+	*pDHDRow = bottom - top;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Catmull-Rom weights for the 4 points around t, and their
+// derivatives.
+static void GetCatmullRomWeights(float t, float *pWeights, float *pDWeights)
+{
+	float t2 = t * t;
+	float t3 = t2 * t;
+
+	pWeights[0] = .5f * (-t3 + 2.f * t2 - t);
+	pWeights[1] = .5f * (3.f * t3 - 5.f * t2 + 2.f);
+	pWeights[2] = .5f * (-3.f * t3 + 4.f * t2 + t);
+	pWeights[3] = .5f * (t3 - t2);
+
+	pDWeights[0] = .5f * (-3.f * t2 + 4.f * t - 1.f);
+	pDWeights[1] = .5f * (9.f * t2 - 10.f * t);
+	pDWeights[2] = .5f * (-9.f * t2 + 8.f * t + 1.f);
+	pDWeights[3] = .5f * (3.f * t2 - 2.f * t);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void HeightField::SampleBicubic(float col, float row, float *pHeight, float *pDHDCol, float *pDHDRow) const
+{
+	int quadCol = std::min(int(col), m_width - 2);
+	int quadRow = std::min(int(row), m_length - 2);
+
+	float ws[4], dws[4], wt[4], dwt[4];
+	GetCatmullRomWeights(col - quadCol, ws, dws);
+	GetCatmullRomWeights(row - quadRow, wt, dwt);
+
+	float height = 0.f, dhdcol = 0.f, dhdrow = 0.f;
+
+	for (int j = 0; j < 4; ++j)
+	{
+		// Filter along the row first.
+		float h = 0.f, dh = 0.f;
+
+		for (int i = 0; i < 4; ++i)
+		{
+			float gridHeight = this->GetClampedHeight(quadCol + i - 1, quadRow + j - 1);
+
+			h += ws[i] * gridHeight;
+			dh += dws[i] * gridHeight;
+		}
+
+		height += wt[j] * h;
+		dhdcol += wt[j] * dh;
+		dhdrow += dwt[j] * h;
+	}
+
+	*pHeight = height;
+	*pDHDCol = dhdcol;
+	*pDHDRow = dhdrow;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
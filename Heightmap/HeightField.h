@@ -0,0 +1,111 @@
+#ifndef HEADER_FAB46AF1BD184974BC40095F56593E9E
+#define HEADER_FAB46AF1BD184974BC40095F56593E9E
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Height and normal queries over a height map grid, at any world
+// (x, z) position.
+//
+// The grid is copied when the HeightField is made. Any number of
+// threads can query it at once, as long as nothing is changing it
+// with SetGridHeights at the same time.
+//
+// Positions off the edge of the grid are clamped to it.
+//
+// Bilinear filtering treats each quad as a bilinear patch. Bicubic is
+// Catmull-Rom over the 4x4 grid points around the position; it goes
+// through the grid points like bilinear does, but the slope is
+// continuous across grid lines too, so normals don't jump from one
+// quad to the next.
+//
+// GetHeights does a whole array of bilinear queries, 4 at a time
+// with SSE2 where it's available.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include <vector>
+
+class TerrainGrid;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+enum HeightFieldFilter
+{
+	HEIGHT_FIELD_FILTER_BILINEAR,
+	HEIGHT_FIELD_FILTER_BICUBIC,
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class HeightField
+{
+public:
+	HeightField();
+	~HeightField();
+
+	// Copies pGrid's heights, and where its grid points are.
+	bool Create(const TerrainGrid *pGrid);
+	void Destroy();
+
+	int GetWidth() const;
+	int GetLength() const;
+
+	float GetHeight(float x, float z, HeightFieldFilter filter) const;
+
+	// The normal is unit length, pointing up.
+	void GetNormal(float x, float z, HeightFieldFilter filter, float *pNormal) const;
+
+	// pHeights[i] is the bilinear height at (pXs[i], pZs[i]).
+	void GetHeights(const float *pXs, const float *pZs, size_t numPositions, float *pHeights) const;
+
+	// Grid point heights, row by row. The pointer stays the same until
+	// the HeightField is destroyed or recreated.
+	const float *GetGridHeights() const;
+
+	// Replace the heights of the grid points from (minCol, minRow) to
+	// (maxCol, maxRow) inclusive. pHeights is the rectangle's heights,
+	// row by row. The rectangle must be on the grid.
+	void SetGridHeights(int minCol, int minRow, int maxCol, int maxRow, const float *pHeights);
+
+	// World position of grid column 0, row 0, and the step from one
+	// column, or row, to the next. The steps may be negative.
+	float GetOriginX() const;
+	float GetOriginZ() const;
+	float GetColumnStepX() const;
+	float GetRowStepZ() const;
+protected:
+private:
+	std::vector<float> m_heights;
+	int m_width;
+	int m_length;
+
+	float m_originX;
+	float m_originZ;
+	float m_stepX;
+	float m_stepZ;
+	float m_invStepX;
+	float m_invStepZ;
+
+	void GetGridPos(float x, float z, float *pCol, float *pRow) const;
+	float GetClampedHeight(int col, int row) const;
+
+	// Height and its derivatives along the grid columns and rows.
+	void SampleBilinear(float col, float row, float *pHeight, float *pDHDCol, float *pDHDRow) const;
+	void SampleBicubic(float col, float row, float *pHeight, float *pDHDCol, float *pDHDRow) const;
+
+	HeightField(const HeightField &);
+	HeightField &operator=(const HeightField &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_FAB46AF1BD184974BC40095F56593E9E
@@ -0,0 +1,177 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "HeightMapFile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// BITMAPFILEHEADER and BITMAPINFOHEADER, read field by field so
+// there's no need for windows.h or packing pragmas.
+static const size_t FILE_HEADER_SIZE = 14;
+static const size_t INFO_HEADER_SIZE = 40;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static uint32_t ReadU32(const uint8_t *p)
+{
+	return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static uint16_t ReadU16(const uint8_t *p)
+{
+	return uint16_t(p[0] | p[1] << 8);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void WriteU32(uint8_t *p, uint32_t value)
+{
+	p[0] = uint8_t(value);
+	p[1] = uint8_t(value >> 8);
+	p[2] = uint8_t(value >> 16);
+	p[3] = uint8_t(value >> 24);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void WriteU16(uint8_t *p, uint16_t value)
+{
+	p[0] = uint8_t(value);
+	p[1] = uint8_t(value >> 8);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool LoadHeightMapBMP(const char *pFileName, std::vector<uint8_t> *pValues, int *pWidth, int *pLength)
+{
+	pValues->clear();
+
+	FILE *pFile = fopen(pFileName, "rb");
+	if (!pFile)
+		return false;
+
+	std::vector<uint8_t> data;
+
+	if (fseek(pFile, 0, SEEK_END) == 0)
+	{
+		long size = ftell(pFile);
+
+		if (size > 0 && fseek(pFile, 0, SEEK_SET) == 0)
+		{
+			data.resize(size_t(size));
+
+			if (fread(&data[0], 1, data.size(), pFile) != data.size())
+				data.clear();
+		}
+	}
+
+	fclose(pFile);
+	pFile = NULL;
+
+	if (data.size() < FILE_HEADER_SIZE + INFO_HEADER_SIZE || data[0] != 'B' || data[1] != 'M')
+		return false;
+
+	const uint8_t *pInfo = &data[FILE_HEADER_SIZE];
+
+	uint32_t pixelsOffset = ReadU32(&data[10]);
+	int32_t width = int32_t(ReadU32(pInfo + 4));
+	int32_t height = int32_t(ReadU32(pInfo + 8));
+	uint16_t bitsPerPixel = ReadU16(pInfo + 14);
+	uint32_t compression = ReadU32(pInfo + 16);
+
+	if (compression != 0 || (bitsPerPixel != 24 && bitsPerPixel != 32))
+		return false;
+
+	// A negative height means the rows are top down.
+	bool topDown = height < 0;
+	if (topDown)
+		height = -height;
+
+	if (width < 1 || height < 1)
+		return false;
+
+	// Each row is padded to a multiple of 4 bytes.
+	size_t bytesPerPixel = bitsPerPixel / 8;
+	size_t rowSize = (size_t(width) * bytesPerPixel + 3) & ~size_t(3);
+
+	if (pixelsOffset > data.size() || (data.size() - pixelsOffset) / rowSize < size_t(height))
+		return false;
+
+	pValues->resize(size_t(width) * height);
+
+	for (int32_t row = 0; row < height; ++row)
+	{
+		const uint8_t *pSrc = &data[pixelsOffset + size_t(topDown ? row : height - 1 - row) * rowSize];
+		uint8_t *pDest = &(*pValues)[size_t(row) * width];
+
+		for (int32_t col = 0; col < width; ++col)
+			pDest[col] = pSrc[col * bytesPerPixel];
+	}
+
+	*pWidth = width;
+	*pLength = height;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool SaveHeightMapBMP(const char *pFileName, const uint8_t *pValues, int width, int length)
+{
+	if (width < 1 || length < 1)
+		return false;
+
+	size_t rowSize = (size_t(width) * 3 + 3) & ~size_t(3);
+	size_t pixelsOffset = FILE_HEADER_SIZE + INFO_HEADER_SIZE;
+
+	std::vector<uint8_t> data(pixelsOffset + rowSize * length, 0);
+
+	data[0] = 'B';
+	data[1] = 'M';
+	WriteU32(&data[2], uint32_t(data.size()));
+	WriteU32(&data[10], uint32_t(pixelsOffset));
+
+	uint8_t *pInfo = &data[FILE_HEADER_SIZE];
+
+	WriteU32(pInfo + 0, uint32_t(INFO_HEADER_SIZE));
+	WriteU32(pInfo + 4, uint32_t(width));
+	WriteU32(pInfo + 8, uint32_t(length));
+	WriteU16(pInfo + 12, 1);// planes
+	WriteU16(pInfo + 14, 24);
+	WriteU32(pInfo + 20, uint32_t(rowSize * length));
+
+	// Bottom up, as usual.
+	for (int row = 0; row < length; ++row)
+	{
+		const uint8_t *pSrc = &pValues[size_t(row) * width];
+		uint8_t *pDest = &data[pixelsOffset + size_t(length - 1 - row) * rowSize];
+
+		for (int col = 0; col < width; ++col)
+			memset(pDest + col * 3, pSrc[col], 3);
+	}
+
+	FILE *pFile = fopen(pFileName, "wb");
+	if (!pFile)
+		return false;
+
+	bool good = fwrite(&data[0], 1, data.size(), pFile) == data.size();
+
+	if (fclose(pFile) != 0)
+		good = false;
+
+	return good;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
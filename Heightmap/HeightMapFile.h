@@ -0,0 +1,35 @@
+#ifndef HEADER_8D709F46644A4309835CE82F7DA3A1DC
+#define HEADER_8D709F46644A4309835CE82F7DA3A1DC
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Height maps in BMP files.
+//
+// Only uncompressed 24 and 32 bit BMPs are read. The height is the
+// first (blue) channel of each pixel; the others are ignored. Values
+// come back row by row from the top of the image, which is the order
+// HeightMapApplication lays its grid out in.
+//
+// Saving writes a 24 bit BMP with the height in all 3 channels, so it
+// loads back the same.
+//
+// There's no D3D in here, and no Windows either.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool LoadHeightMapBMP(const char *pFileName, std::vector<uint8_t> *pValues, int *pWidth, int *pLength);
+bool SaveHeightMapBMP(const char *pFileName, const uint8_t *pValues, int width, int length);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_8D709F46644A4309835CE82F7DA3A1DC
@@ -1,9 +1,35 @@
 #define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
 #include <windows.h>
 #include <d3d11.h>
 
 #include "CommonApp.h"
+#include "TerrainGrid.h"
+#include "TerrainMesh.h"
+#include "UploadRing.h"
+#include "HeightField.h"
+#include "TerrainRayCaster.h"
+#include "TerrainPathfinder.h"
+#include "TerrainBrush.h"
+#include "TerrainUndoHistory.h"
+#include "TerrainErosion.h"
+#include "TerrainNoise.h"
+#include "TerrainWorld.h"
+#include "TerrainPrefetcher.h"
+#include "TerrainTileFile.h"
+#include "HeightMapFile.h"
+#include "CommonMesh.h"
+#include "OcclusionBuffer.h"
+#include "TerrainOccluders.h"
+#include "CameraPathFile.h"
+#include "TerrainRenderBatch.h"
+#include "LineOfSight.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
 #include <vector>
 #include <DirectXMath.h>
 using namespace DirectX;
@@ -19,124 +45,948 @@ class HeightMapApplication : public CommonApp
 	void HandleUpdate();
 	void HandleRender();
 	bool LoadHeightMap(char* filename, float gridSize);
+	bool GenerateHeightMap(const TerrainNoiseParams &params, int width, int length, float gridSize);
+	bool PickTerrain(const XMMATRIX &viewMtx, const XMMATRIX &projMtx, XMFLOAT3 *pPickedPos);
+	void SculptTerrain(const XMFLOAT3 &pos);
+	void UndoOrRedo(bool redo);
+	void OnHeightsChanged(int minCol, int minRow, int maxCol, int maxRow);
+	void FindPickPath(const XMFLOAT3 &from, const XMFLOAT3 &to);
+	bool StartWorld();
+	void StopWorld();
+	void RenderWorld();
+	bool LoadWorldTile(int tileX, int tileZ, int numPoints, float *pHeights);
+	bool UpdateWorldMeshes();
+	void RecordCameraPath(const XMFLOAT3 &camera, const XMFLOAT3 &lookat);
+	void ReportOcclusion();
 
   private:
-	ID3D11Buffer* m_pHeightMapBuffer;
+	// A loaded tile of the world.
+	struct WorldTile
+	{
+		TerrainGrid *pGrid;
+		TerrainMesh *pMesh;
+		TerrainOccluders *pOccluders;
+		bool dirty;
+	};
+
+	// A height map the world's tiles are made from.
+	struct WorldMap
+	{
+		std::vector<uint8_t> values;
+		int width;
+		int length;
+	};
+
+	TerrainGrid m_grid;
+	TerrainMesh m_terrain;
+	TerrainMeshPool m_meshPool;
+	UploadRing m_uploadRing;
+	HeightField m_heightField;
+	TerrainRayCaster m_rayCaster;
+	CommonMesh *m_pPickMarker;
+	bool m_havePickedPos;
+	XMFLOAT3 m_pickedPos;
+	bool m_pickKeyWasDown;
+	TerrainPathfinder m_pathfinder;
+	TerrainPathSearch m_pathSearch;
+	std::vector<int> m_path;
+	TerrainBrush m_brush;
+	bool m_sculpting;
+	TerrainUndoHistory m_undoHistory;
+	bool m_undoKeyWasDown;
+	bool m_redoKeyWasDown;
 	float m_rotationAngle;
 	int m_HeightMapWidth;
 	int m_HeightMapLength;
-	int m_HeightMapVtxCount;
-	int m_HeightMapQuadCountWidth;
-	int m_HeightMapQuadCountLength;
-	XMFLOAT3* m_pHeightMap;
-	vector<XMFLOAT3> verticesInWindingOrder;
-	Vertex_Pos3fColour4ubNormal3f* m_pMapVtxs;
 	float m_cameraZ;
-	void cubeVertices(VertexColour);
-	void mapTiles(VertexColour);
-	void oddRow(vector<XMFLOAT3>&, int);
-	void evenRow(vector<XMFLOAT3>&, int);
-	void calcFaceNormal(vector<XMFLOAT3>&, int, XMFLOAT3&, bool&);
-	XMFLOAT3 calcNormalToPlane(XMFLOAT3, XMFLOAT3, XMFLOAT3);
-	void normaliseVector(XMFLOAT3&);
-	XMFLOAT3 calcXProduct(XMFLOAT3,XMFLOAT3);
-	XMFLOAT3 calcVectorA_minus_B(XMFLOAT3, XMFLOAT3);
-	XMFLOAT3 calcAvgOf2Normals(XMFLOAT3, XMFLOAT3);
+	bool m_worldMode;
+	TerrainWorld m_world;
+	TerrainPrefetcher m_prefetcher;
+	TerrainTileFile m_worldTileFile;
+	std::vector<WorldTile> m_worldTiles;
+	std::vector<WorldMap> m_worldMaps;
+	XMFLOAT3 m_worldLookat;
+	XMFLOAT3 m_worldCamera;
+	XMFLOAT3 m_worldCameraVelocity;
+	TerrainOccluders m_occluders;
+	OcclusionBuffer m_occlusionBuffer;
+	bool m_occlusionCulling;
+	bool m_occlusionKeyWasDown;
+	std::vector<CameraPathFrame> m_cameraPath;
+	bool m_recordingCameraPath;
+	bool m_recordKeyWasDown;
 	
 };
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
+// Room for the vertices of 70 or so mesh chunks a frame, for
+// sculpting and for stitching the world's tiles together. Any more,
+// and they go straight to the chunks' buffers.
+static const UINT UPLOAD_RING_SIZE = 8 * 1024 * 1024;
+
+// The world's tiles' chunks all share the one pool. Its buffers are
+// only made as they're needed, so this is just a limit.
+static const int MAX_WORLD_CHUNKS = 4096;
+
+// Slots moved per frame, to give back the buffers the tiles that have
+// gone have left behind.
+static const size_t MESH_POOL_MOVES_PER_FRAME = 4;
+
+// Plenty for telling whether a chunk's behind a hill, and the same
+// shape as the projection. It's drawn on every core.
+static const int OCCLUSION_BUFFER_WIDTH = 256;
+static const int OCCLUSION_BUFFER_HEIGHT = 128;
+
+// How often the window title shows how much occlusion culling hid.
+static const size_t OCCLUSION_REPORT_FRAMES = 60;
+
+// R starts recording the camera's path, and stops and saves it here,
+// for Heightmap -occlusion to replay.
+static const char CAMERA_PATH_FILE_NAME[] = "CameraPath.txt";
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 bool HeightMapApplication::HandleStart()
 {
 	this->SetWindowTitle("HeightMap");
-	LoadHeightMap("Heightmap.bmp", 1.0f);
+	m_pPickMarker = NULL;
+	m_havePickedPos = false;
+	m_pickKeyWasDown = false;
+	m_sculpting = false;
+	m_undoKeyWasDown = false;
+	m_redoKeyWasDown = false;
+	m_worldLookat = XMFLOAT3(0.f, 0.f, 0.f);
+	m_worldCamera = XMFLOAT3(0.f, 0.f, 0.f);
+	m_worldCameraVelocity = XMFLOAT3(0.f, 0.f, 0.f);
+	m_occlusionCulling = true;
+	m_occlusionKeyWasDown = false;
+	m_recordingCameraPath = false;
+	m_recordKeyWasDown = false;
+
+	if (!m_occlusionBuffer.Create(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT, 0))
+		return false;
+
+	m_brush.mode = TERRAIN_BRUSH_RAISE;
+	m_brush.radius = 8.f;
+	m_brush.strength = .25f;
+	m_brush.targetHeight = 0.f;
+
+	// -world shows lots of height maps, streamed in around the camera,
+	// instead of just the one.
+	m_worldMode = __argc > 1 && strcmp(__argv[1], "-world") == 0;
+	if (m_worldMode)
+		return this->StartWorld();
+
+	// -generate <seed> makes up a height map instead.
+	if (__argc > 2 && strcmp(__argv[1], "-generate") == 0)
+	{
+		TerrainNoiseParams noiseParams;
+		noiseParams.type = TERRAIN_NOISE_RIDGED;
+		noiseParams.seed = uint32_t(strtoul(__argv[2], NULL, 0));
+		noiseParams.warpDistance = 32.f;
+
+		if (!GenerateHeightMap(noiseParams, 256, 256, 1.0f))
+			return false;
+	}
+	else
+	{
+		if (!LoadHeightMap("Heightmap.bmp", 1.0f))
+			return false;
+	}
 	m_cameraZ = 50.0f;
-	m_pHeightMapBuffer = NULL;
 	m_rotationAngle = 0.f;
 
 	if(!this->CommonApp::HandleStart())
 		return false;
 
+	if (!m_uploadRing.Create(m_pD3DDevice, UPLOAD_RING_SIZE, D3D11_BIND_VERTEX_BUFFER))
+		return false;
+
+	int numChunksWide = (m_HeightMapWidth - 1 + TerrainMesh::CHUNK_QUADS - 1) / TerrainMesh::CHUNK_QUADS;
+	int numChunksLong = (m_HeightMapLength - 1 + TerrainMesh::CHUNK_QUADS - 1) / TerrainMesh::CHUNK_QUADS;
+	if (!m_meshPool.Create(m_pD3DDevice, numChunksWide * numChunksLong))
+		return false;
+
 	static const VertexColour MAP_COLOUR(200, 255, 255, 255);
-	/////////////////////////////////////////////////////////////////
-	// Clearly this code will need changing to render the heightmap
-	/////////////////////////////////////////////////////////////////
 
-	//m_HeightMapVtxCount = 6 * 6;
-	m_HeightMapVtxCount = (m_HeightMapLength - 1) * m_HeightMapWidth * 2;
-	m_pMapVtxs = new Vertex_Pos3fColour4ubNormal3f[m_HeightMapVtxCount];
-	//XMFLOAT3 v0, v1, v2, v3, v4, v5;// = 1 quad
-	XMFLOAT3 normal = XMFLOAT3(0.0f, 1.0f, 0.0f);//+Y normal
+	// Indexed triangle list in chunks, with smooth normals and the
+	// triangles in vertex cache order.
+	if (!m_terrain.Create(&m_meshPool, this->GetDeviceContext(), &m_uploadRing, this->GetScratchArena(), &m_grid, MAP_COLOUR))
+		return false;
+
+	// A simpler terrain, under the real one, for hiding what's behind
+	// the hills.
+	if (!m_occluders.Create(&m_grid))
+		return false;
+
+	if (!m_heightField.Create(&m_grid))
+		return false;
+
+	if (!m_rayCaster.Create(&m_heightField))
+		return false;
+
+	// Paths between the places picked, going round what's too steep to
+	// climb.
+	static const TerrainPathCosts PATH_COSTS = {1.f, 4.f};
+	static const int PATH_CLUSTER_SIZE = 32;
+	if (!m_pathfinder.Create(&m_heightField, PATH_COSTS, PATH_CLUSTER_SIZE, 0))
+		return false;
+
+	// Undo tiles the same size as the mesh chunks, so undoing a tile
+	// rebuilds as few chunks as possible.
+	static const size_t MAX_UNDO_STEPS = 100;
+	static const size_t MAX_UNDO_BYTES = 64 * 1024 * 1024;
+	if (!m_undoHistory.Create(&m_heightField, TerrainMesh::CHUNK_QUADS, MAX_UNDO_STEPS, MAX_UNDO_BYTES))
+		return false;
 
-	mapTiles(MAP_COLOUR);//get heightmap vertices in order for trianglestrip
-	bool clckWise = true;
-	int numTrianglesPerRow = (m_HeightMapWidth - 1) * 2;//don't forget degenerate triangle at end of each row!!
+	// Shows where the mouse last picked the terrain.
+	m_pPickMarker = CommonMesh::NewSphereMesh(this, 1.f, 12, 12);
+	if (!m_pPickMarker)
+		return false;
 
-	for (size_t vIndex = 0; vIndex < m_HeightMapVtxCount; vIndex++)
+	return true;
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+void HeightMapApplication::HandleStop()
+{
+	this->StopWorld();
+
+	if (m_recordingCameraPath && !SaveCameraPath(CAMERA_PATH_FILE_NAME, m_cameraPath))
+		dprintf("%s: failed to save %s.\n", __FUNCTION__, CAMERA_PATH_FILE_NAME);
+
+	delete m_pPickMarker;
+	m_pPickMarker = NULL;
+
+	m_terrain.Destroy();
+	m_occluders.Destroy();
+	m_occlusionBuffer.Destroy();
+	m_meshPool.Destroy();
+	m_uploadRing.Destroy();
+	m_undoHistory.Destroy();
+	m_pathfinder.Destroy();
+	m_rayCaster.Destroy();
+	m_heightField.Destroy();
+	m_grid.Destroy();
+
+	this->CommonApp::HandleStop();
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+void HeightMapApplication::HandleUpdate()
+{
+	m_rotationAngle += .01f;
+
+	if(this->IsKeyPressed('Q'))
+	{
+		if(m_cameraZ > 20.0f)
+			m_cameraZ -= 2.0f;
+	}
+
+	if(this->IsKeyPressed('A'))
 	{
-		if ((vIndex % 3 == 0) && (vIndex < m_HeightMapVtxCount - 3)) {
-			calcFaceNormal(verticesInWindingOrder, vIndex, normal, clckWise);
+		m_cameraZ += 2.0f;
+	}
+
+	// Brush for sculpting with the right mouse button.
+	if (this->IsKeyPressed('1'))
+	{
+		m_brush.mode = TERRAIN_BRUSH_RAISE;
+		m_brush.strength = .25f;
+	}
+	else if (this->IsKeyPressed('2'))
+	{
+		m_brush.mode = TERRAIN_BRUSH_LOWER;
+		m_brush.strength = .25f;
+	}
+	else if (this->IsKeyPressed('3'))
+	{
+		m_brush.mode = TERRAIN_BRUSH_SMOOTH;
+		m_brush.strength = .5f;
+	}
+	else if (this->IsKeyPressed('4'))
+	{
+		m_brush.mode = TERRAIN_BRUSH_FLATTEN;
+		m_brush.strength = .2f;
+	}
+
+	// Once per press, not every frame it's held.
+	bool undoKeyDown = this->IsKeyPressed('Z');
+	if (undoKeyDown && !m_undoKeyWasDown)
+		this->UndoOrRedo(false);
+	m_undoKeyWasDown = undoKeyDown;
+
+	bool redoKeyDown = this->IsKeyPressed('Y');
+	if (redoKeyDown && !m_redoKeyWasDown)
+		this->UndoOrRedo(true);
+	m_redoKeyWasDown = redoKeyDown;
+
+	// O turns occlusion culling on and off.
+	bool occlusionKeyDown = this->IsKeyPressed('O');
+	if (occlusionKeyDown && !m_occlusionKeyWasDown)
+	{
+		m_occlusionCulling = !m_occlusionCulling;
+		m_occlusionBuffer.ResetStats();
+		this->SetWindowTitle(m_occlusionCulling ? "HeightMap" : "HeightMap - no occlusion culling");
+	}
+	m_occlusionKeyWasDown = occlusionKeyDown;
+
+	bool recordKeyDown = this->IsKeyPressed('R');
+	if (recordKeyDown && !m_recordKeyWasDown)
+	{
+		if (m_recordingCameraPath)
+		{
+			if (SaveCameraPath(CAMERA_PATH_FILE_NAME, m_cameraPath))
+				dprintf("%s: saved %u frames to %s.\n", __FUNCTION__, unsigned(m_cameraPath.size()), CAMERA_PATH_FILE_NAME);
+			else
+				dprintf("%s: failed to save %s.\n", __FUNCTION__, CAMERA_PATH_FILE_NAME);
 		}
 
-		m_pMapVtxs[vIndex] = Vertex_Pos3fColour4ubNormal3f(verticesInWindingOrder.at(vIndex), MAP_COLOUR, normal);
+		m_recordingCameraPath = !m_recordingCameraPath;
+		m_cameraPath.clear();
 	}
-	for (size_t vtxIndex = 0; vtxIndex < m_HeightMapVtxCount; vtxIndex++)
+	m_recordKeyWasDown = recordKeyDown;
+
+	// Move around the world with the cursor keys.
+	static const float WORLD_MOVE_SPEED = 2.f;
+	if (this->IsKeyPressed(VK_LEFT))
+		m_worldLookat.x -= WORLD_MOVE_SPEED;
+	if (this->IsKeyPressed(VK_RIGHT))
+		m_worldLookat.x += WORLD_MOVE_SPEED;
+	if (this->IsKeyPressed(VK_UP))
+		m_worldLookat.z += WORLD_MOVE_SPEED;
+	if (this->IsKeyPressed(VK_DOWN))
+		m_worldLookat.z -= WORLD_MOVE_SPEED;
+
+	// The prefetcher needs to know where the camera's heading. There are
+	// 60 updates a second.
+	static const float UPDATES_PER_SECOND = 60.f;
+	XMFLOAT3 vCamera(m_worldLookat.x + sin(m_rotationAngle) * m_cameraZ, m_cameraZ / 2, m_worldLookat.z + cos(m_rotationAngle) * m_cameraZ);
+
+	m_worldCameraVelocity = XMFLOAT3((vCamera.x - m_worldCamera.x) * UPDATES_PER_SECOND, (vCamera.y - m_worldCamera.y) * UPDATES_PER_SECOND, (vCamera.z - m_worldCamera.z) * UPDATES_PER_SECOND);
+	m_worldCamera = vCamera;
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+void HeightMapApplication::HandleRender()
+{
+	// Frees the upload space of the frames the GPU's done with.
+	m_uploadRing.BeginFrame(this->GetDeviceContext());
+
+	if (m_worldMode)
+	{
+		this->RenderWorld();
+		m_meshPool.Defragment(this->GetDeviceContext(), MESH_POOL_MOVES_PER_FRAME);
+		m_uploadRing.EndFrame(this->GetDeviceContext());
+		return;
+	}
+
+	XMFLOAT3 vCamera(sin(m_rotationAngle) * m_cameraZ, m_cameraZ / 2, cos(m_rotationAngle) * m_cameraZ);
+
+	// Don't let the camera go into the hills.
+	static const float MIN_CAMERA_HEIGHT_ABOVE_GROUND = 2.f;
+	float groundHeight = m_heightField.GetHeight(vCamera.x, vCamera.z, HEIGHT_FIELD_FILTER_BICUBIC);
+	if (vCamera.y < groundHeight + MIN_CAMERA_HEIGHT_ABOVE_GROUND)
+		vCamera.y = groundHeight + MIN_CAMERA_HEIGHT_ABOVE_GROUND;
+	XMFLOAT3 vLookat(0.0f, 0.0f, 0.0f);
+	XMFLOAT3 vUpVector(0.0f, 1.0f, 0.0f);
+
+	XMMATRIX matView;
+	matView = XMMatrixLookAtLH(XMLoadFloat3(&vCamera), XMLoadFloat3(&vLookat), XMLoadFloat3(&vUpVector));
+
+	XMMATRIX matProj;
+	matProj = XMMatrixPerspectiveFovLH(float(XM_PI / 4), 2, 1.5f, 5000.0f);
+
+	this->SetViewMatrix(matView);
+	this->SetProjectionMatrix(matProj);
+
+	this->EnablePointLight(0, XMFLOAT3(100.0f, 100.f, -100.f), XMFLOAT3(1.f, 1.f, 1.f));
+
+	this->Clear(XMFLOAT4(.2f, .2f, .6f, 1.f));
+
+	XMFLOAT3 brushPos;
+	if (this->IsKeyPressed(VK_RBUTTON) && this->PickTerrain(matView, matProj, &brushPos))
 	{
-		if (vtxIndex % 2 == 0)
+		// Flattening levels everything off at the height the stroke
+		// started at.
+		if (!m_sculpting)
 		{
-			calcAvgOf2Normals(m_pMapVtxs[vtxIndex].normal, m_pMapVtxs[vtxIndex].normal);
-			// getting there. need to calc normals of bottom of one row with next.
+			m_brush.targetHeight = brushPos.y;
+
+			// The whole stroke is one undo step.
+			m_undoHistory.BeginStep();
 		}
+
+		m_sculpting = true;
+		this->SculptTerrain(brushPos);
+	}
+	else if (!this->IsKeyPressed(VK_RBUTTON) && m_sculpting)
+	{
+		m_undoHistory.EndStep();
+		m_sculpting = false;
+	}
+
+	// Sends all the sculpting since last frame at once.
+	m_terrain.UpdateDirtyChunks(this->GetDeviceContext(), &m_uploadRing, this->GetFrameArena(), &m_grid);
+
+	// Find out what's behind the hills before drawing any of it.
+	OcclusionBuffer *pOcclusionBuffer = NULL;
+	if (m_occlusionCulling)
+	{
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, matView * matProj);
+
+		m_occlusionBuffer.Begin(&viewProj.m[0][0]);
+		m_occluders.AddTo(&m_occlusionBuffer);
+		m_occlusionBuffer.Rasterize();
+
+		pOcclusionBuffer = &m_occlusionBuffer;
 	}
-	/////////////////////////////////////////////////////////////////
-	// Down to here
-	/////////////////////////////////////////////////////////////////
-	m_pHeightMapBuffer = CreateImmutableVertexBuffer(m_pD3DDevice, sizeof Vertex_Pos3fColour4ubNormal3f * m_HeightMapVtxCount, m_pMapVtxs);
-	delete m_pMapVtxs;
+
+	m_terrain.Draw(this, pOcclusionBuffer);
+
+	// Each click also finds a path from the last place picked.
+	bool pickKeyDown = this->IsKeyPressed(VK_LBUTTON);
+	XMFLOAT3 pickedPos;
+	if (pickKeyDown && this->PickTerrain(matView, matProj, &pickedPos))
+	{
+		if (!m_pickKeyWasDown && m_havePickedPos)
+			this->FindPickPath(m_pickedPos, pickedPos);
+
+		m_pickedPos = pickedPos;
+		m_havePickedPos = true;
+	}
+	m_pickKeyWasDown = pickKeyDown;
+
+	if (m_havePickedPos)
+	{
+		this->SetWorldMatrix(XMMatrixTranslation(m_pickedPos.x, m_pickedPos.y, m_pickedPos.z));
+		if (!pOcclusionBuffer || !m_pPickMarker->IsOccluded(pOcclusionBuffer))
+			m_pPickMarker->Draw();
+		this->SetWorldMatrix(XMMatrixIdentity());
+	}
+
+	// Small markers along the path, a few grid points apart.
+	static const size_t PATH_MARKER_SPACING = 4;
+	static const float PATH_MARKER_SCALE = .3f;
+	const float *pHeights = m_heightField.GetGridHeights();
+
+	for (size_t i = 0; i < m_path.size(); i += PATH_MARKER_SPACING)
+	{
+		int col = m_path[i] % m_HeightMapWidth;
+		int row = m_path[i] / m_HeightMapWidth;
+
+		float x = m_grid.GetOriginX() + col * m_grid.GetColumnStepX();
+		float z = m_grid.GetOriginZ() + row * m_grid.GetRowStepZ();
+
+		this->SetWorldMatrix(XMMatrixScaling(PATH_MARKER_SCALE, PATH_MARKER_SCALE, PATH_MARKER_SCALE) * XMMatrixTranslation(x, pHeights[m_path[i]], z));
+		if (!pOcclusionBuffer || !m_pPickMarker->IsOccluded(pOcclusionBuffer))
+			m_pPickMarker->Draw();
+	}
+	this->SetWorldMatrix(XMMatrixIdentity());
+
+	this->RecordCameraPath(vCamera, vLookat);
+	this->ReportOcclusion();
+
+	m_meshPool.Defragment(this->GetDeviceContext(), MESH_POOL_MOVES_PER_FRAME);
+	m_uploadRing.EndFrame(this->GetDeviceContext());
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+bool HeightMapApplication::PickTerrain(const XMMATRIX &viewMtx, const XMMATRIX &projMtx, XMFLOAT3 *pPickedPos)
+{
+	POINT cursor;
+	RECT clientRect;
+
+	if (!GetCursorPos(&cursor) || !ScreenToClient(m_hWnd, &cursor) || !GetClientRect(m_hWnd, &clientRect))
+		return false;
+
+	if (!PtInRect(&clientRect, cursor))
+		return false;
+
+	// The viewport is the whole client area. Unproject the cursor at
+	// the near and far planes to get the ray.
+	float viewportWidth = float(clientRect.right - clientRect.left);
+	float viewportHeight = float(clientRect.bottom - clientRect.top);
+
+	XMVECTOR vNear = XMVector3Unproject(XMVectorSet(float(cursor.x), float(cursor.y), 0.f, 0.f),
+		0.f, 0.f, viewportWidth, viewportHeight, 0.f, 1.f, projMtx, viewMtx, XMMatrixIdentity());
+	XMVECTOR vFar = XMVector3Unproject(XMVectorSet(float(cursor.x), float(cursor.y), 1.f, 0.f),
+		0.f, 0.f, viewportWidth, viewportHeight, 0.f, 1.f, projMtx, viewMtx, XMMatrixIdentity());
+
+	XMFLOAT3 origin, dir;
+	XMStoreFloat3(&origin, vNear);
+	XMStoreFloat3(&dir, vFar - vNear);
+
+	TerrainRay ray = {
+		{origin.x, origin.y, origin.z},
+		{dir.x, dir.y, dir.z},
+		1.f,
+	};
+
+	TerrainRayHit hit;
+	if (!m_rayCaster.CastRay(ray, &hit))
+		return false;
+
+	*pPickedPos = XMFLOAT3(hit.pos[0], hit.pos[1], hit.pos[2]);
 	return true;
 }
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
-void HeightMapApplication::HandleStop(){Release(m_pHeightMapBuffer);this->CommonApp::HandleStop();}
+void HeightMapApplication::SculptTerrain(const XMFLOAT3 &pos)
+{
+	int minCol, minRow, maxCol, maxRow;
+	if (!GetTerrainBrushRegion(m_heightField, m_brush, pos.x, pos.z, &minCol, &minRow, &maxCol, &maxRow))
+		return;
+
+	m_undoHistory.SaveRegion(minCol, minRow, maxCol, maxRow);
+
+	if (ApplyTerrainBrush(&m_heightField, m_brush, pos.x, pos.z, &minCol, &minRow, &maxCol, &maxRow))
+		this->OnHeightsChanged(minCol, minRow, maxCol, maxRow);
+}
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
-void HeightMapApplication::HandleUpdate()
+void HeightMapApplication::UndoOrRedo(bool redo)
 {
-	m_rotationAngle += .01f;
+	// Not in the middle of a stroke.
+	if (m_sculpting)
+		return;
 
-	if(this->IsKeyPressed('Q'))
+	if (!(redo ? m_undoHistory.Redo() : m_undoHistory.Undo()))
+		return;
+
+	for (size_t i = 0; i < m_undoHistory.GetNumChangedRects(); ++i)
+	{
+		int minCol, minRow, maxCol, maxRow;
+		m_undoHistory.GetChangedRect(i, &minCol, &minRow, &maxCol, &maxRow);
+
+		this->OnHeightsChanged(minCol, minRow, maxCol, maxRow);
+	}
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+void HeightMapApplication::OnHeightsChanged(int minCol, int minRow, int maxCol, int maxRow)
+{
+	// The HeightField has the new heights. Copy them to the grid the
+	// mesh is built from, then bring everything else up to date, doing
+	// only the part that changed.
+	const float *pHeights = m_heightField.GetGridHeights();
+
+	m_grid.SetHeights(minCol, minRow, maxCol, maxRow, pHeights + minRow * m_HeightMapWidth + minCol, m_HeightMapWidth);
+	m_grid.CalculateNormals(minCol, minRow, maxCol, maxRow);
+
+	m_rayCaster.UpdateRegion(minCol, minRow, maxCol, maxRow);
+	m_pathfinder.UpdateRegion(minCol, minRow, maxCol, maxRow, 0);
+	m_terrain.MarkDirty(minCol, minRow, maxCol, maxRow);
+	m_occluders.Update(&m_grid, minCol, minRow, maxCol, maxRow);
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+void HeightMapApplication::FindPickPath(const XMFLOAT3 &from, const XMFLOAT3 &to)
+{
+	// The nearest grid points.
+	int fromCol = std::min(std::max(int(floorf((from.x - m_grid.GetOriginX()) / m_grid.GetColumnStepX() + .5f)), 0), m_HeightMapWidth - 1);
+	int fromRow = std::min(std::max(int(floorf((from.z - m_grid.GetOriginZ()) / m_grid.GetRowStepZ() + .5f)), 0), m_HeightMapLength - 1);
+	int toCol = std::min(std::max(int(floorf((to.x - m_grid.GetOriginX()) / m_grid.GetColumnStepX() + .5f)), 0), m_HeightMapWidth - 1);
+	int toRow = std::min(std::max(int(floorf((to.z - m_grid.GetOriginZ()) / m_grid.GetRowStepZ() + .5f)), 0), m_HeightMapLength - 1);
+
+	float cost;
+	if (m_pathfinder.FindPath(fromRow * m_HeightMapWidth + fromCol, toRow * m_HeightMapWidth + toCol, &m_pathSearch, &m_path, &cost))
+	{
+		dprintf("%s: %u grid points from (%d, %d) to (%d, %d), cost %.1f.\n", __FUNCTION__, unsigned(m_path.size()), fromCol, fromRow, toCol, toRow, cost);
+	}
+	else
+	{
+		dprintf("%s: no way from (%d, %d) to (%d, %d).\n", __FUNCTION__, fromCol, fromRow, toCol, toRow);
+		m_path.clear();
+	}
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// The world is WORLD_TILES_WIDE x WORLD_TILES_LONG tiles, each made
+// from one of these maps, squashed or stretched to fit.
+static const char *const WORLD_MAP_FILE_NAMES[] = {
+	"Heightmap.bmp",
+	"Heightmap2.bmp",
+	"hMapTiny.bmp",
+	"HillMap.bmp",
+};
+
+static const int WORLD_TILES_WIDE = 8;
+static const int WORLD_TILES_LONG = 8;
+static const int WORLD_TILE_QUADS = 128;
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+bool HeightMapApplication::StartWorld()
+{
+	m_cameraZ = 100.0f;
+	m_rotationAngle = 0.f;
+
+	// Where HandleUpdate will first put the camera, so it doesn't seem
+	// to jump there.
+	m_worldCamera = XMFLOAT3(0.f, m_cameraZ / 2, m_cameraZ);
+
+	TerrainWorldParams params;
+	params.loadRadius = 300.f;
+	params.unloadRadius = 380.f;
+	params.maxNumBytes = 8 * 1024 * 1024;
+
+	TerrainWorldLoadFn loadFn;
+
+	// -world <file> streams the tiles of a tile file, rather than
+	// making them from the BMPs.
+	if (__argc > 2)
+	{
+		if (!m_worldTileFile.Open(__argv[2]))
+		{
+			dprintf("%s: %s isn't a tile file.\n", __FUNCTION__, __argv[2]);
+			return false;
+		}
+
+		params.numTilesX = m_worldTileFile.GetNumTilesX();
+		params.numTilesZ = m_worldTileFile.GetNumTilesZ();
+		params.tileQuads = m_worldTileFile.GetTileQuads();
+
+		loadFn = [this](int tileX, int tileZ, int numPoints, float *pHeights) {
+			return numPoints == m_worldTileFile.GetNumLevelPoints(0) && m_worldTileFile.ReadTile(tileX, tileZ, 0, pHeights);
+		};
+	}
+	else
+	{
+		for (size_t i = 0; i < sizeof WORLD_MAP_FILE_NAMES / sizeof WORLD_MAP_FILE_NAMES[0]; ++i)
+		{
+			WorldMap map;
+
+			// Not every map is a BMP, whatever its name says.
+			if (!LoadHeightMapBMP(WORLD_MAP_FILE_NAMES[i], &map.values, &map.width, &map.length))
+			{
+				dprintf("%s: skipping %s, it isn't a BMP height map.\n", __FUNCTION__, WORLD_MAP_FILE_NAMES[i]);
+				continue;
+			}
+
+			m_worldMaps.push_back(map);
+		}
+
+		if (m_worldMaps.empty())
+			return false;
+
+		params.numTilesX = WORLD_TILES_WIDE;
+		params.numTilesZ = WORLD_TILES_LONG;
+		params.tileQuads = WORLD_TILE_QUADS;
+
+		loadFn = [this](int tileX, int tileZ, int numPoints, float *pHeights) {
+			return this->LoadWorldTile(tileX, tileZ, numPoints, pHeights);
+		};
+	}
+
+	if (!this->CommonApp::HandleStart())
+		return false;
+
+	if (!m_uploadRing.Create(m_pD3DDevice, UPLOAD_RING_SIZE, D3D11_BIND_VERTEX_BUFFER))
+		return false;
+
+	if (!m_meshPool.Create(m_pD3DDevice, MAX_WORLD_CHUNKS))
+		return false;
+
+	// The tiles are read ahead of the camera on the prefetcher's thread,
+	// and the world takes them from there.
+
+	if (!m_prefetcher.Create(params, TerrainPrefetcherParams(), loadFn))
+		return false;
+
+	TerrainWorldLoadFn prefetchedLoadFn = [this](int tileX, int tileZ, int numPoints, float *pHeights) {
+		return m_prefetcher.LoadTile(tileX, tileZ, numPoints, pHeights);
+	};
+
+	if (!m_world.Create(params, prefetchedLoadFn))
+		return false;
+
+	WorldTile emptyTile;
+	emptyTile.pGrid = NULL;
+	emptyTile.pMesh = NULL;
+	emptyTile.pOccluders = NULL;
+	emptyTile.dirty = false;
+
+	m_worldTiles.assign(size_t(params.numTilesX) * params.numTilesZ, emptyTile);
+
+	return true;
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+void HeightMapApplication::StopWorld()
+{
+	for (size_t i = 0; i < m_worldTiles.size(); ++i)
+	{
+		delete m_worldTiles[i].pOccluders;
+		delete m_worldTiles[i].pMesh;
+		delete m_worldTiles[i].pGrid;
+	}
+
+	m_worldTiles.clear();
+
+	TerrainPrefetcherStats stats = m_prefetcher.GetStats();
+
+	if (stats.numRequested > 0)
+	{
+		dprintf("%s: prefetched %u tiles (%u cancelled), world used %u, waited for %u, read %u itself; %u (%u KB) wasted.\n", __FUNCTION__,
+			unsigned(stats.numRead), unsigned(stats.numCancelled), unsigned(stats.numHits), unsigned(stats.numWaits), unsigned(stats.numMisses),
+			unsigned(stats.numWasted), unsigned(stats.numBytesWasted / 1024));
+	}
+
+	m_world.Destroy();
+	m_prefetcher.Destroy();
+	m_worldTileFile.Close();
+	m_worldMaps.clear();
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// Resamples the tile's map to the tile size, bilinearly, with the
+// heights scaled as LoadHeightMap does. This is called on the
+// prefetcher's thread too, so it mustn't change anything.
+bool HeightMapApplication::LoadWorldTile(int tileX, int tileZ, int numPoints, float *pHeights)
+{
+	const WorldMap *pMap = &m_worldMaps[(tileX + 2 * tileZ) % m_worldMaps.size()];
+	const uint8_t *pValues = &pMap->values[0];
+
+	float scaleX = float(pMap->width - 1) / float(numPoints - 1);
+	float scaleZ = float(pMap->length - 1) / float(numPoints - 1);
+
+	for (int row = 0; row < numPoints; ++row)
+	{
+		float mapRow = row * scaleZ;
+		int row0 = std::min(int(mapRow), std::max(pMap->length - 2, 0));
+		int row1 = std::min(row0 + 1, pMap->length - 1);
+		float t = mapRow - row0;
+
+		for (int col = 0; col < numPoints; ++col)
+		{
+			float mapCol = col * scaleX;
+			int col0 = std::min(int(mapCol), std::max(pMap->width - 2, 0));
+			int col1 = std::min(col0 + 1, pMap->width - 1);
+			float s = mapCol - col0;
+
+			float top = pValues[row0 * pMap->width + col0] + (pValues[row0 * pMap->width + col1] - pValues[row0 * pMap->width + col0]) * s;
+			float bottom = pValues[row1 * pMap->width + col0] + (pValues[row1 * pMap->width + col1] - pValues[row1 * pMap->width + col0]) * s;
+
+			pHeights[row * numPoints + col] = (top + (bottom - top) * t) / 16;
+		}
+	}
+
+	return true;
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// Brings the meshes into line with what the world loaded, unloaded
+// and changed in the last Update.
+bool HeightMapApplication::UpdateWorldMeshes()
+{
+	static const VertexColour MAP_COLOUR(200, 255, 255, 255);
+
+	const TerrainWorldParams &params = m_world.GetParams();
+	int numPoints = m_world.GetNumTilePoints();
+	size_t numTilePoints = size_t(numPoints) * numPoints;
+	int last = numPoints - 1;
+
+	// Centred on the origin, like LoadHeightMap's grid.
+	int halfWorldWide = params.numTilesX * params.tileQuads / 2;
+	int halfWorldLong = params.numTilesZ * params.tileQuads / 2;
+
+	for (size_t i = 0; i < m_world.GetNumJustUnloadedTiles(); ++i)
+	{
+		int tileX, tileZ;
+		m_world.GetJustUnloadedTile(i, &tileX, &tileZ);
+
+		WorldTile *pTile = &m_worldTiles[tileZ * params.numTilesX + tileX];
+
+		delete pTile->pOccluders;
+		pTile->pOccluders = NULL;
+
+		delete pTile->pMesh;
+		pTile->pMesh = NULL;
+
+		delete pTile->pGrid;
+		pTile->pGrid = NULL;
+	}
+
+	bool ok = true;
+
+	for (size_t i = 0; i < m_world.GetNumJustLoadedTiles(); ++i)
+	{
+		int tileX, tileZ;
+		m_world.GetJustLoadedTile(i, &tileX, &tileZ);
+
+		WorldTile *pTile = &m_worldTiles[tileZ * params.numTilesX + tileX];
+
+		const float *pHeights = m_world.GetTileHeights(tileX, tileZ);
+		const float *pNormals = m_world.GetTileNormals(tileX, tileZ);
+
+		float originX = float(tileX * params.tileQuads - halfWorldWide) * params.gridSize;
+		float originZ = float(halfWorldLong - tileZ * params.tileQuads) * params.gridSize;
+
+		pTile->pGrid = new TerrainGrid;
+		pTile->pMesh = new TerrainMesh;
+		pTile->pOccluders = new TerrainOccluders;
+
+		bool created = pTile->pGrid->Create(numPoints, numPoints, originX, originZ, params.gridSize, -params.gridSize);
+
+		if (created)
+		{
+			pTile->pGrid->SetHeights(0, 0, last, last, pHeights, numPoints);
+			pTile->pGrid->SetNormals(0, 0, last, last, pNormals, pNormals + numTilePoints, pNormals + 2 * numTilePoints, numPoints);
+
+			created = pTile->pMesh->Create(&m_meshPool, this->GetDeviceContext(), &m_uploadRing, this->GetFrameArena(), pTile->pGrid, MAP_COLOUR);
+
+			// The tiles' heights never change, only their edge normals,
+			// so the occluders are made once. Each tile's are only
+			// under its own heights, so there may be cracks along the
+			// edges between tiles, which just means less is hidden.
+			if (created)
+				created = pTile->pOccluders->Create(pTile->pGrid);
+		}
+
+		if (!created)
+		{
+			delete pTile->pOccluders;
+			pTile->pOccluders = NULL;
+			delete pTile->pMesh;
+			pTile->pMesh = NULL;
+			delete pTile->pGrid;
+			pTile->pGrid = NULL;
+			ok = false;
+		}
+	}
+
+	// Edges whose normals now take the tiles next door into account.
+	for (size_t i = 0; i < m_world.GetNumChangedTiles(); ++i)
+	{
+		int tileX, tileZ, minCol, minRow, maxCol, maxRow;
+		m_world.GetChangedTile(i, &tileX, &tileZ, &minCol, &minRow, &maxCol, &maxRow);
+
+		WorldTile *pTile = &m_worldTiles[tileZ * params.numTilesX + tileX];
+		if (!pTile->pMesh)
+			continue;
+
+		const float *pNormals = m_world.GetTileNormals(tileX, tileZ) + minRow * numPoints + minCol;
+
+		pTile->pGrid->SetNormals(minCol, minRow, maxCol, maxRow, pNormals, pNormals + numTilePoints, pNormals + 2 * numTilePoints, numPoints);
+
+		pTile->pMesh->MarkDirty(minCol, minRow, maxCol, maxRow);
+		pTile->dirty = true;
+	}
+
+	for (size_t i = 0; i < m_worldTiles.size(); ++i)
+	{
+		WorldTile *pTile = &m_worldTiles[i];
+
+		if (pTile->dirty && pTile->pMesh)
+			pTile->pMesh->UpdateDirtyChunks(this->GetDeviceContext(), &m_uploadRing, this->GetFrameArena(), pTile->pGrid);
+
+		pTile->dirty = false;
+	}
+
+	return ok;
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+void HeightMapApplication::RenderWorld()
+{
+	const TerrainWorldParams &params = m_world.GetParams();
+
+	float halfWorldWide = params.numTilesX * params.tileQuads * .5f;
+	float halfWorldLong = params.numTilesZ * params.tileQuads * .5f;
+
+	XMFLOAT3 vCamera = m_worldCamera;
+
+	// Stream the tiles in and out around the camera, reading ahead of
+	// it. Rows go down as z goes up.
+	float cameraCol = vCamera.x / params.gridSize + halfWorldWide;
+	float cameraRow = halfWorldLong - vCamera.z / params.gridSize;
+
+	m_prefetcher.Update(m_world, cameraCol, cameraRow, m_worldCameraVelocity.x / params.gridSize, -m_worldCameraVelocity.z / params.gridSize);
+	m_world.Update(cameraCol, cameraRow);
+	this->UpdateWorldMeshes();
+
+	// Don't let the camera go into the hills.
+	static const float MIN_CAMERA_HEIGHT_ABOVE_GROUND = 2.f;
+	float groundHeight;
+	if (m_world.GetHeight(cameraCol, cameraRow, &groundHeight) && vCamera.y < groundHeight + MIN_CAMERA_HEIGHT_ABOVE_GROUND)
+		vCamera.y = groundHeight + MIN_CAMERA_HEIGHT_ABOVE_GROUND;
+
+	XMFLOAT3 vUpVector(0.0f, 1.0f, 0.0f);
+
+	XMMATRIX matView;
+	matView = XMMatrixLookAtLH(XMLoadFloat3(&vCamera), XMLoadFloat3(&m_worldLookat), XMLoadFloat3(&vUpVector));
+
+	XMMATRIX matProj;
+	matProj = XMMatrixPerspectiveFovLH(float(XM_PI / 4), 2, 1.5f, 5000.0f);
+
+	this->SetViewMatrix(matView);
+	this->SetProjectionMatrix(matProj);
+
+	this->EnablePointLight(0, XMFLOAT3(100.0f, 100.f, -100.f), XMFLOAT3(1.f, 1.f, 1.f));
+
+	this->Clear(XMFLOAT4(.2f, .2f, .6f, 1.f));
+
+	// Every tile's occluders go in before any tile's drawn, as a tile
+	// can be behind the hills of any other.
+	OcclusionBuffer *pOcclusionBuffer = NULL;
+	if (m_occlusionCulling)
 	{
-		if(m_cameraZ > 20.0f)
-			m_cameraZ -= 2.0f;
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, matView * matProj);
+
+		m_occlusionBuffer.Begin(&viewProj.m[0][0]);
+
+		for (size_t i = 0; i < m_worldTiles.size(); ++i)
+		{
+			if (m_worldTiles[i].pOccluders)
+				m_worldTiles[i].pOccluders->AddTo(&m_occlusionBuffer);
+		}
+
+		m_occlusionBuffer.Rasterize();
+
+		pOcclusionBuffer = &m_occlusionBuffer;
 	}
 
-	if(this->IsKeyPressed('A'))
+	for (size_t i = 0; i < m_worldTiles.size(); ++i)
 	{
-		m_cameraZ += 2.0f;
+		if (m_worldTiles[i].pMesh)
+			m_worldTiles[i].pMesh->Draw(this, pOcclusionBuffer);
 	}
+
+	this->RecordCameraPath(vCamera, m_worldLookat);
+	this->ReportOcclusion();
 }
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
-void HeightMapApplication::HandleRender()
+void HeightMapApplication::RecordCameraPath(const XMFLOAT3 &camera, const XMFLOAT3 &lookat)
 {
-	XMFLOAT3 vCamera(sin(m_rotationAngle) * m_cameraZ, m_cameraZ / 2, cos(m_rotationAngle) * m_cameraZ);
-	XMFLOAT3 vLookat(0.0f, 0.0f, 0.0f);
-	XMFLOAT3 vUpVector(0.0f, 1.0f, 0.0f);
+	if (!m_recordingCameraPath)
+		return;
 
-	XMMATRIX matView;
-	matView = XMMatrixLookAtLH(XMLoadFloat3(&vCamera), XMLoadFloat3(&vLookat), XMLoadFloat3(&vUpVector));
+	CameraPathFrame frame;
+	memcpy(frame.camera, &camera.x, sizeof frame.camera);
+	memcpy(frame.lookat, &lookat.x, sizeof frame.lookat);
 
-	XMMATRIX matProj;
-	matProj = XMMatrixPerspectiveFovLH(float(XM_PI / 4), 2, 1.5f, 5000.0f);
+	m_cameraPath.push_back(frame);
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// Shows how much occlusion culling hid, and what it cost, in the
+// window title, every so often.
+void HeightMapApplication::ReportOcclusion()
+{
+	const OcclusionBufferStats &stats = m_occlusionBuffer.GetStats();
 
-	this->SetViewMatrix(matView);
-	this->SetProjectionMatrix(matProj);
+	if (!m_occlusionCulling || stats.numFrames < OCCLUSION_REPORT_FRAMES)
+		return;
 
-	this->EnablePointLight(0, XMFLOAT3(100.0f, 100.f, -100.f), XMFLOAT3(1.f, 1.f, 1.f));
+	double seconds = stats.setupSeconds + stats.rasterSeconds + stats.testSeconds;
 
-	this->Clear(XMFLOAT4(.2f, .2f, .6f, 1.f));
+	this->SetWindowTitle("HeightMap - occlusion culling hid %u%% of %u boxes a frame, in %.2f ms%s",
+		stats.numBoxesTested > 0 ? unsigned(stats.numBoxesOccluded * 100 / stats.numBoxesTested) : 0u, unsigned(stats.numBoxesTested / stats.numFrames),
+		seconds * 1000. / stats.numFrames, m_recordingCameraPath ? " (recording)" : "");
 
-	this->DrawUntexturedLit(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP, m_pHeightMapBuffer, NULL, m_HeightMapVtxCount);
+	m_occlusionBuffer.ResetStats();
 }
 //////////////////////////////////////////////////////////////////////
 // LoadHeightMap
@@ -149,7 +999,7 @@ bool HeightMapApplication::LoadHeightMap(char* filename, float gridSize)
 	unsigned int count;
 	BITMAPFILEHEADER bitmapFileHeader;
 	BITMAPINFOHEADER bitmapInfoHeader;
-	int imageSize, i, j, k, index;
+	int imageSize, i, j, k;
 	unsigned char* bitmapImage;
 	unsigned char height;
 	// Open the height map file in binary.
@@ -175,8 +1025,11 @@ bool HeightMapApplication::LoadHeightMap(char* filename, float gridSize)
 	m_HeightMapLength = bitmapInfoHeader.biHeight;
 	// Calculate the size of the bitmap image data.
 	imageSize = m_HeightMapWidth * m_HeightMapLength * 3;
-	// Allocate memory for the bitmap image data.
-	bitmapImage = new unsigned char[imageSize];
+	// Allocate memory for the bitmap image data. It's only needed until
+	// the heights are out of it.
+	LinearArena *pScratch = this->GetScratchArena();
+	LinearArenaMarker scratchMarker = pScratch->GetMarker();
+	bitmapImage = pScratch->AllocateArray<unsigned char>(imageSize);
 	if(!bitmapImage)
 	{
 		return false;
@@ -187,200 +1040,626 @@ bool HeightMapApplication::LoadHeightMap(char* filename, float gridSize)
 	count = fread(bitmapImage, 1, imageSize, filePtr);
 	if(count != imageSize)
 	{
+		pScratch->ResetToMarker(scratchMarker);
 		return false;
 	}
 	// Close the file.
 	error = fclose(filePtr);
 	if(error != 0)
 	{
+		pScratch->ResetToMarker(scratchMarker);
 		return false;
 	}
-	// Create the structure to hold the height map data.
-	m_pHeightMap = new XMFLOAT3[m_HeightMapWidth * m_HeightMapLength];
-	if(!m_pHeightMap)
+	// Create the structure to hold the height map data. Columns go
+	// along x, and rows down z, centred on the origin.
+	float* rowHeights = pScratch->AllocateArray<float>(m_HeightMapWidth);
+	if(!rowHeights || !m_grid.Create(m_HeightMapWidth, m_HeightMapLength, (float)(-(m_HeightMapWidth / 2)) * gridSize, (float)(m_HeightMapLength / 2) * gridSize, gridSize, -gridSize))
 	{
+		pScratch->ResetToMarker(scratchMarker);
 		return false;
 	}
 	// Initialize the position in the image data buffer.
 	k = 0;
-	for (j = m_HeightMapLength - 1; j >= 0; j--)
+	for (j = m_HeightMapLength - 1; j >= 0; j--) {
 		for (i = 0; i < m_HeightMapWidth; i++) {
 			height = bitmapImage[k];
-			index = (m_HeightMapLength * j) + i;
-			m_pHeightMap[index].x = (float)(i - (m_HeightMapWidth / 2)) * gridSize;
-			m_pHeightMap[index].y = (float)height / 16 * gridSize;
-			m_pHeightMap[index].z = (float)((m_HeightMapLength / 2) - j) * gridSize;
+			rowHeights[i] = (float)height / 16 * gridSize;
 			k += 3;
 		}
+		m_grid.SetHeights(0, j, m_HeightMapWidth - 1, j, rowHeights, m_HeightMapWidth);
+	}
+	m_grid.CalculateNormals(0, 0, m_HeightMapWidth - 1, m_HeightMapLength - 1);
 	// Release the bitmap image data.
-	delete[] bitmapImage;
 	bitmapImage = 0;
+	pScratch->ResetToMarker(scratchMarker);
 
 	return true;
 }
 
-void HeightMapApplication::cubeVertices(VertexColour MAP_COLOUR)
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// Lays the grid out the same as LoadHeightMap does.
+bool HeightMapApplication::GenerateHeightMap(const TerrainNoiseParams &params, int width, int length, float gridSize)
 {
+	std::vector<float> heights(size_t(width) * length);
+	GenerateTerrainNoise(params, 0, 0, width, length, &heights[0], 0);
 
-	// Side 1 - Front face
-	m_pMapVtxs[0] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 0.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, -1.0f));
-	m_pMapVtxs[1] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 10.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, -1.0f));
-	m_pMapVtxs[2] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 0.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, -1.0f));
-	m_pMapVtxs[3] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 0.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, -1.0f));
-	m_pMapVtxs[4] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 10.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, -1.0f));
-	m_pMapVtxs[5] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 10.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, -1.0f));
-	// Side 2 - Right face
-	m_pMapVtxs[6] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 0.0f, 0.0f), MAP_COLOUR, XMFLOAT3(1.0f, 0.0f, 0.0f));
-	m_pMapVtxs[7] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 10.0f, 0.0f), MAP_COLOUR, XMFLOAT3(1.0f, 0.0f, 0.0f));
-	m_pMapVtxs[8] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 0.0f, 10.0f), MAP_COLOUR, XMFLOAT3(1.0f, 0.0f, 0.0f));
-	m_pMapVtxs[9] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 0.0f, 10.0f), MAP_COLOUR, XMFLOAT3(1.0f, 0.0f, 0.0f));
-	m_pMapVtxs[10] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 10.0f, 0.0f), MAP_COLOUR, XMFLOAT3(1.0f, 0.0f, 0.0f));
-	m_pMapVtxs[11] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 10.0f, 10.0f), MAP_COLOUR, XMFLOAT3(1.0f, 0.0f, 0.0f));
-	// Side 3 - Rear face
-	m_pMapVtxs[12] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 0.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, 1.0f));
-	m_pMapVtxs[13] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 10.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, 1.0f));
-	m_pMapVtxs[14] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 0.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, 1.0f));
-	m_pMapVtxs[15] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 0.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, 1.0f));
-	m_pMapVtxs[16] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 10.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, 1.0f));
-	m_pMapVtxs[17] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 10.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, 0.0f, 1.0f));
-	// Side 4 - Left face
-	m_pMapVtxs[18] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 0.0f, 0.0f), MAP_COLOUR, XMFLOAT3(-1.0f, 0.0f, 0.0f));
-	m_pMapVtxs[19] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 10.0f, 10.0f), MAP_COLOUR, XMFLOAT3(-1.0f, 0.0f, 0.0f));
-	m_pMapVtxs[20] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 10.0f, 0.0f), MAP_COLOUR, XMFLOAT3(-1.0f, 0.0f, 0.0f));
-	m_pMapVtxs[21] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 0.0f, 0.0f), MAP_COLOUR, XMFLOAT3(-1.0f, 0.0f, 0.0f));
-	m_pMapVtxs[22] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 0.0f, 10.0f), MAP_COLOUR, XMFLOAT3(-1.0f, 0.0f, 0.0f));
-	m_pMapVtxs[23] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 10.0f, 10.0f), MAP_COLOUR, XMFLOAT3(-1.0f, 0.0f, 0.0f));
-	// Side 5 - Top face
-	m_pMapVtxs[24] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 10.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, 1.0f, 0.0f));
-	m_pMapVtxs[25] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 10.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, 1.0f, 0.0f));
-	m_pMapVtxs[26] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 10.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, 1.0f, 0.0f));
-	m_pMapVtxs[27] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 10.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, 1.0f, 0.0f));
-	m_pMapVtxs[28] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 10.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, 1.0f, 0.0f));
-	m_pMapVtxs[29] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 10.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, 1.0f, 0.0f));
-	// Side 6 - Bottom face
-	m_pMapVtxs[30] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 0.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, -1.0f, 0.0f));
-	m_pMapVtxs[31] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 0.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, -1.0f, 0.0f));
-	m_pMapVtxs[32] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 0.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, -1.0f, 0.0f));
-	m_pMapVtxs[33] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 0.0f, 0.0f), MAP_COLOUR, XMFLOAT3(0.0f, -1.0f, 0.0f));
-	m_pMapVtxs[34] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(10.0f, 0.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, -1.0f, 0.0f));
-	m_pMapVtxs[35] = Vertex_Pos3fColour4ubNormal3f(XMFLOAT3(0.0f, 0.0f, 10.0f), MAP_COLOUR, XMFLOAT3(0.0f, -1.0f, 0.0f));
-}
+	m_HeightMapWidth = width;
+	m_HeightMapLength = length;
 
-void HeightMapApplication::mapTiles(VertexColour MAP_COLOUR)
-{
-	XMFLOAT3 normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-	for (size_t rowNum = 1; rowNum < m_HeightMapLength; rowNum++)
-	{
-		//if (rowNum == m_HeightMapLength - 1)//last row
-		//{
-		//	lastRow(vertexList4Triangles, rowNum);
-		//}
-		//else
-		//{
-			if (rowNum % 2 != 0)
-			{
-				oddRow(verticesInWindingOrder, rowNum);
-			}
-			else
-			{
-				evenRow(verticesInWindingOrder, rowNum);
-			}
-			
-		//}
-	}
-}
+	if (!m_grid.Create(width, length, (float)(-(width / 2)) * gridSize, (float)(length / 2) * gridSize, gridSize, -gridSize))
+		return false;
 
+	for (size_t i = 0; i < heights.size(); ++i)
+		heights[i] *= gridSize;
 
+	m_grid.SetHeights(0, 0, width - 1, length - 1, &heights[0], width);
+	m_grid.CalculateNormals(0, 0, width - 1, length - 1);
 
-void HeightMapApplication::oddRow(vector<XMFLOAT3>& vertices, int rowNum)
+	return true;
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// Being a windows app, there's no console unless there's one to
+// borrow.
+static void AttachParentConsole()
 {
-	//rowNum cannot be 0.
-	for (size_t vSelector = 0; vSelector < m_HeightMapWidth; vSelector++)
+	if (AttachConsole(ATTACH_PARENT_PROCESS))
 	{
-		//push bottom -> 1st
-		vertices.push_back(m_pHeightMap[((rowNum * m_HeightMapWidth))+(vSelector)]);
-		//push top -> 2nd
-		vertices.push_back(m_pHeightMap[((rowNum - 1) * m_HeightMapWidth) + (vSelector)]);
+		FILE *pFile;
+		freopen_s(&pFile, "CONOUT$", "w", stdout);
+		freopen_s(&pFile, "CONOUT$", "w", stderr);
 	}
 }
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// Converts heights, scaled as LoadHeightMap does with a grid size of
+// 1, back to a BMP.
+static bool SaveHeights(const char *pFileName, const float *pHeights, int width, int length)
+{
+	std::vector<uint8_t> values(size_t(width) * length);
+
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		float value = floorf(pHeights[i] * 16.f + .5f);
+		values[i] = uint8_t(value < 0.f ? 0.f : value > 255.f ? 255.f : value);
+	}
 
-void HeightMapApplication::evenRow(vector<XMFLOAT3>& vertices, int rowNum)
+	return SaveHeightMapBMP(pFileName, &values[0], width, length);
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// Generates a height map without opening a window, and reports how
+// long it took:
+//
+//     Heightmap -noise <out.bmp> <width> <length> [seed] [fbm|ridged] [threads]
+static int RunNoiseBatch(int argc, char **argv)
 {
-	for (size_t vSelector = 0; vSelector < m_HeightMapWidth; vSelector++)
+	AttachParentConsole();
+
+	if (argc < 5)
 	{
-			//push top
-			vertices.push_back(m_pHeightMap[(((rowNum - 1) * m_HeightMapWidth) + (m_HeightMapWidth - 1)) - vSelector]);//vertex at end of row to start
+		fprintf(stderr, "Usage: %s -noise <out.bmp> <width> <length> [seed] [fbm|ridged] [threads]\n", argv[0]);
+		return 1;
+	}
 
-			//push bottom
-			vertices.push_back(m_pHeightMap[(((rowNum)* m_HeightMapWidth) + (m_HeightMapWidth - 1)) - vSelector]);
+	int width = atoi(argv[3]);
+	int length = atoi(argv[4]);
+	if (width < 1 || length < 1)
+	{
+		fprintf(stderr, "Bad size: %sx%s\n", argv[3], argv[4]);
+		return 1;
+	}
+
+	TerrainNoiseParams params;
+	params.seed = argc > 5 ? uint32_t(strtoul(argv[5], NULL, 0)) : 0;
+	params.type = argc > 6 && strcmp(argv[6], "ridged") == 0 ? TERRAIN_NOISE_RIDGED : TERRAIN_NOISE_FBM;
+
+	unsigned maxNumThreads = argc > 7 ? unsigned(atoi(argv[7])) : 0;
+
+	std::vector<float> heights(size_t(width) * length);
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	GenerateTerrainNoise(params, 0, 0, width, length, &heights[0], maxNumThreads);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	printf("%dx%d: %.3f seconds, %.1f million samples/second\n", width, length, seconds, seconds > 0. ? heights.size() / seconds / 1e6 : 0.);
+
+	if (!SaveHeights(argv[2], &heights[0], width, length))
+	{
+		fprintf(stderr, "Failed to save %s\n", argv[2]);
+		return 1;
 	}
-}
 
-void HeightMapApplication::calcFaceNormal(vector<XMFLOAT3>& verticesInFace, int vIndex, XMFLOAT3& normal, bool& clckWise)
+	return 0;
+}
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// Erodes a height map without opening a window:
+//
+//     Heightmap -erode <in.bmp> <out.bmp> [iterations] [threads]
+//
+// Heights are scaled as LoadHeightMap does, with a grid size of 1.
+static int RunErosionBatch(int argc, char **argv)
 {
+	AttachParentConsole();
 
-	//calc face normal
-	//vertexList4Triangles.at(vIndex) = 1st vertex in triangle
-	//vertexList4Triangles.at(vIndex + 1) = 2nd vertex in triangle
-	//vertexList4Triangles.at(vIndex + 2) = 3rd vertex in triangle
-	if (clckWise)
+	if (argc < 4)
 	{
-		normal = calcNormalToPlane(verticesInWindingOrder.at(vIndex), verticesInWindingOrder.at(vIndex + 1), verticesInWindingOrder.at(vIndex + 2));
-		clckWise = false;
+		fprintf(stderr, "Usage: %s -erode <in.bmp> <out.bmp> [iterations] [threads]\n", argv[0]);
+		return 1;
 	}
-	else
-	{	//to adjust for the winding order
-		normal = calcNormalToPlane(verticesInWindingOrder.at(vIndex + 2), verticesInWindingOrder.at(vIndex + 1), verticesInWindingOrder.at(vIndex));
-		clckWise = true;
+
+	int numIterations = argc > 4 ? atoi(argv[4]) : 1000;
+	unsigned maxNumThreads = argc > 5 ? unsigned(atoi(argv[5])) : 0;
+
+	std::vector<uint8_t> values;
+	int width, length;
+	if (!LoadHeightMapBMP(argv[2], &values, &width, &length))
+	{
+		fprintf(stderr, "Failed to load %s\n", argv[2]);
+		return 1;
+	}
+
+	std::vector<float> heights(values.size());
+	for (size_t i = 0; i < values.size(); ++i)
+		heights[i] = values[i] / 16.f;
+
+	TerrainErosion erosion;
+	if (!erosion.Create(&heights[0], width, length, TerrainErosionParams()))
+	{
+		fprintf(stderr, "%s is too small to erode\n", argv[2]);
+		return 1;
 	}
-	normaliseVector(normal);
 
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	erosion.Run(numIterations, maxNumThreads);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	printf("%dx%d: %d iterations in %.3f seconds, %.1f iterations/second\n", width, length, numIterations, seconds, seconds > 0. ? numIterations / seconds : 0.);
+
+	if (!SaveHeights(argv[3], erosion.GetHeights(), width, length))
+	{
+		fprintf(stderr, "Failed to save %s\n", argv[3]);
+		return 1;
+	}
+
+	return 0;
 }
 
-XMFLOAT3 HeightMapApplication::calcNormalToPlane(XMFLOAT3 vA, XMFLOAT3 vB, XMFLOAT3 vC)// didn't realise an equivalent was included in the framework
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Converts a BMP height map to a tile file, for -world. With maxError,
+// in height units, the file's lossy, and smaller:
+//
+//     Heightmap -pack <in.bmp> <out.ttf> [tileQuads] [threads] [maxError]
+static int RunPackBatch(int argc, char **argv)
 {
-	XMFLOAT3 XProd = calcXProduct(calcVectorA_minus_B(vA,vB),calcVectorA_minus_B(vB,vC));
-	return XProd;
+	AttachParentConsole();
+
+	if (argc < 4)
+	{
+		fprintf(stderr, "Usage: %s -pack <in.bmp> <out.ttf> [tileQuads] [threads] [maxError]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<uint8_t> values;
+	int width, length;
+	if (!LoadHeightMapBMP(argv[2], &values, &width, &length))
+	{
+		fprintf(stderr, "Failed to load %s\n", argv[2]);
+		return 1;
+	}
+
+	// The same heights as LoadHeightMap, which the default height step
+	// keeps exactly.
+	std::vector<float> heights(values.size());
+
+	for (size_t i = 0; i < values.size(); ++i)
+		heights[i] = values[i] / 16.f;
+
+	TerrainTileFileParams params;
+	params.tileQuads = argc > 4 ? atoi(argv[4]) : params.tileQuads;
+	params.maxNumThreads = argc > 5 ? unsigned(atoi(argv[5])) : 0;
+	params.maxError = argc > 6 ? float(atof(argv[6])) : 0.f;
+
+	if (!SaveTerrainTileFile(argv[3], &heights[0], width, length, params))
+	{
+		fprintf(stderr, "Failed to save %s (is %d a power of 2?)\n", argv[3], params.tileQuads);
+		return 1;
+	}
+
+	TerrainTileFile file;
+	if (!file.Open(argv[3]))
+	{
+		fprintf(stderr, "Failed to read %s back\n", argv[3]);
+		return 1;
+	}
+
+	printf("%dx%d: %dx%d tiles of %d quads, %d levels, %u bytes (%.2f bytes/height), max error %g\n", width, length, file.GetNumTilesX(), file.GetNumTilesZ(),
+		file.GetTileQuads(), file.GetNumLevels(), unsigned(file.GetNumBytes()), double(file.GetNumBytes()) / heights.size(), file.GetMaxError());
+
+	return 0;
 }
 
-void HeightMapApplication::normaliseVector(XMFLOAT3 &vIn)//suppose this is kind of proof I know the maths
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Decompresses a whole tile file, and reports how quickly:
+//
+//     Heightmap -unpack <in.ttf> [out.bmp] [threads]
+static int RunUnpackBatch(int argc, char **argv)
 {
-	double length = sqrt(vIn.x*vIn.x + vIn.y*vIn.y + vIn.z*vIn.z);
-	vIn.x = vIn.x / length;
-	vIn.y = vIn.y / length;
-	vIn.z = vIn.z / length;
+	AttachParentConsole();
+
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: %s -unpack <in.ttf> [out.bmp] [threads]\n", argv[0]);
+		return 1;
+	}
+
+	TerrainTileFile file;
+	if (!file.Open(argv[2]))
+	{
+		fprintf(stderr, "Failed to load %s\n", argv[2]);
+		return 1;
+	}
+
+	unsigned maxNumThreads = argc > 4 ? unsigned(atoi(argv[4])) : 0;
+
+	std::vector<float> heights(size_t(file.GetWidth()) * file.GetLength());
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	bool good = file.ReadLevel(0, &heights[0], maxNumThreads);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	if (!good)
+	{
+		fprintf(stderr, "%s is damaged\n", argv[2]);
+		return 1;
+	}
+
+	printf("%dx%d: %.3f seconds, %.2f GB/s of heights\n", file.GetWidth(), file.GetLength(), seconds, seconds > 0. ? heights.size() * sizeof(float) / seconds / 1e9 : 0.);
+
+	if (argc > 3 && !SaveHeights(argv[3], &heights[0], file.GetWidth(), file.GetLength()))
+	{
+		fprintf(stderr, "Failed to save %s\n", argv[3]);
+		return 1;
+	}
+
+	return 0;
 }
 
-XMFLOAT3 HeightMapApplication::calcXProduct(XMFLOAT3 v1, XMFLOAT3 v2)//just unfamiliar with the framework lol
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Draws a height map as the app first shows it, on the CPU, without
+// D3D, saves the picture as a .ppm or a .png, and reports how quickly
+// it drew it:
+//
+//     Heightmap -render <in.bmp> <out.ppm|out.png> [width] [height] [frames] [threads]
+//
+// It's drawn frames times, to get a steadier figure. The work's done in
+// TerrainRenderBatch, which the Linux RenderTerrain tool runs too.
+static int RunRenderBatch(int argc, char **argv)
 {
-	float x, y, z;
-	x = (v1.y*v2.z) - (v1.z*v2.y);
-	y = (v1.z*v2.x) - (v1.x*v2.z);
-	z = (v1.x*v2.y) - (v1.y*v2.x);
-	return XMFLOAT3(x, y, z);
+	AttachParentConsole();
+
+	// Skip the exe's name, leaving -render for the usage message.
+	return RunTerrainRenderBatch(argc - 1, argv + 1);
 }
-XMFLOAT3 HeightMapApplication::calcVectorA_minus_B(XMFLOAT3 vA, XMFLOAT3 vB)
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Replays a camera path over a height map without opening a window.
+// Each frame, the chunks a TerrainMesh would have are culled against
+// the frustum, then against the terrain's occluders, and at the end
+// it reports how many were hidden, and what that cost a frame:
+//
+//     Heightmap -occlusion <in.bmp> [camera path|-] [width] [height] [threads]
+//
+// Paths are as the app records them (press R). Without one, the camera
+// goes once round the app's orbit. The size is the occlusion buffer's.
+static int RunOcclusionBatch(int argc, char **argv)
 {
-	float x, y, z;
-	x = vA.x - vB.x;
-	y = vA.y - vB.y;
-	z = vA.z - vB.z;
-	return XMFLOAT3(x,y,z);
+	AttachParentConsole();
+
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: %s -occlusion <in.bmp> [camera path|-] [width] [height] [threads]\n", argv[0]);
+		return 1;
+	}
+
+	int bufferWidth = argc > 4 ? atoi(argv[4]) : OCCLUSION_BUFFER_WIDTH;
+	int bufferHeight = argc > 5 ? atoi(argv[5]) : OCCLUSION_BUFFER_HEIGHT;
+	unsigned maxNumThreads = argc > 6 ? unsigned(atoi(argv[6])) : 0;
+
+	std::vector<uint8_t> values;
+	int width, length;
+	if (!LoadHeightMapBMP(argv[2], &values, &width, &length))
+	{
+		fprintf(stderr, "Failed to load %s\n", argv[2]);
+		return 1;
+	}
+
+	// Laid out as LoadHeightMap does, with a grid size of 1.
+	std::vector<float> heights(values.size());
+	for (size_t i = 0; i < values.size(); ++i)
+		heights[i] = values[i] / 16.f;
+
+	TerrainGrid grid;
+	if (!grid.Create(width, length, (float)(-(width / 2)), (float)(length / 2), 1.f, -1.f))
+	{
+		fprintf(stderr, "%s is too big\n", argv[2]);
+		return 1;
+	}
+
+	grid.SetHeights(0, 0, width - 1, length - 1, &heights[0], width);
+
+	HeightField heightField;
+	TerrainOccluders occluders;
+	if (!heightField.Create(&grid) || !occluders.Create(&grid))
+	{
+		fprintf(stderr, "%s is too small\n", argv[2]);
+		return 1;
+	}
+
+	OcclusionBuffer occlusionBuffer;
+	if (!occlusionBuffer.Create(bufferWidth, bufferHeight, maxNumThreads))
+	{
+		fprintf(stderr, "Bad occlusion buffer size: %dx%d\n", bufferWidth, bufferHeight);
+		return 1;
+	}
+
+	std::vector<CameraPathFrame> path;
+
+	if (argc > 3 && strcmp(argv[3], "-") != 0)
+	{
+		if (!LoadCameraPath(argv[3], &path) || path.empty())
+		{
+			fprintf(stderr, "Failed to load a camera path from %s\n", argv[3]);
+			return 1;
+		}
+	}
+	else
+	{
+		// HandleUpdate's orbit, kept above the hills as HandleRender
+		// does.
+		static const float CAMERA_Z = 50.f;
+		static const float MIN_CAMERA_HEIGHT_ABOVE_GROUND = 2.f;
+		static const int NUM_ORBIT_FRAMES = int(2 * XM_PI / .01f) + 1;
+
+		for (int i = 0; i < NUM_ORBIT_FRAMES; ++i)
+		{
+			float angle = i * .01f;
+
+			CameraPathFrame frame;
+			frame.camera[0] = sin(angle) * CAMERA_Z;
+			frame.camera[1] = CAMERA_Z / 2;
+			frame.camera[2] = cos(angle) * CAMERA_Z;
+			frame.lookat[0] = frame.lookat[1] = frame.lookat[2] = 0.f;
+
+			float groundHeight = heightField.GetHeight(frame.camera[0], frame.camera[2], HEIGHT_FIELD_FILTER_BICUBIC);
+			if (frame.camera[1] < groundHeight + MIN_CAMERA_HEIGHT_ABOVE_GROUND)
+				frame.camera[1] = groundHeight + MIN_CAMERA_HEIGHT_ABOVE_GROUND;
+
+			path.push_back(frame);
+		}
+	}
+
+	// The chunks' boxes, as TerrainMesh has them.
+	std::vector<TerrainChunk> chunks;
+	GetTerrainChunks(width, length, TerrainMesh::CHUNK_QUADS, &chunks);
+
+	TerrainBounds chunkBounds;
+	GetTerrainChunkBounds(&grid, chunks, &chunkBounds);
+
+	std::vector<uint8_t> chunkVisible(chunkBounds.GetNumBoxes());
+
+	size_t numInFrustum = 0;
+	size_t numDrawn = 0;
+	double maxFrameSeconds = 0.;
+
+	for (size_t i = 0; i < path.size(); ++i)
+	{
+		XMFLOAT3 vCamera(path[i].camera[0], path[i].camera[1], path[i].camera[2]);
+		XMFLOAT3 vLookat(path[i].lookat[0], path[i].lookat[1], path[i].lookat[2]);
+		XMFLOAT3 vUpVector(0.0f, 1.0f, 0.0f);
+
+		XMMATRIX matView = XMMatrixLookAtLH(XMLoadFloat3(&vCamera), XMLoadFloat3(&vLookat), XMLoadFloat3(&vUpVector));
+		XMMATRIX matProj = XMMatrixPerspectiveFovLH(float(XM_PI / 4), float(bufferWidth) / bufferHeight, 1.5f, 5000.0f);
+
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, matView * matProj);
+
+		float planes[6][4];
+		GetFrustumPlanes(&viewProj.m[0][0], planes);
+
+		numInFrustum += chunkBounds.CullPlanes(planes, 6, &chunkVisible[0]);
+
+		std::chrono::steady_clock::time_point frameStartTime = std::chrono::steady_clock::now();
+
+		occlusionBuffer.Begin(&viewProj.m[0][0]);
+		occluders.AddTo(&occlusionBuffer);
+		occlusionBuffer.Rasterize();
+
+		numDrawn += chunkBounds.CullOccluded(&occlusionBuffer, &viewProj.m[0][0], &chunkVisible[0]);
+
+		maxFrameSeconds = std::max(maxFrameSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStartTime).count());
+	}
+
+	const OcclusionBufferStats &stats = occlusionBuffer.GetStats();
+	double numFrames = double(path.size());
+
+	printf("%u frames, %u chunks, %u occluder triangles, %dx%d: %.1f chunks a frame in the frustum, %.1f of them (%.1f%%) hidden\n",
+		unsigned(path.size()), unsigned(chunkBounds.GetNumBoxes()), unsigned(occluders.GetNumTriangles()), bufferWidth, bufferHeight,
+		numInFrustum / numFrames, (numInFrustum - numDrawn) / numFrames, numInFrustum > 0 ? (numInFrustum - numDrawn) * 100. / numInFrustum : 0.);
+
+	printf("%.3f ms a frame (%.3f setting up, %.3f rasterizing, %.3f testing), %.3f ms at most\n",
+		(stats.setupSeconds + stats.rasterSeconds + stats.testSeconds) * 1000. / numFrames, stats.setupSeconds * 1000. / numFrames,
+		stats.rasterSeconds * 1000. / numFrames, stats.testSeconds * 1000. / numFrames, maxFrameSeconds * 1000.);
+
+	return 0;
 }
 
-XMFLOAT3 HeightMapApplication::calcAvgOf2Normals(XMFLOAT3 normalA, XMFLOAT3 normalB) 
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Works out what an observer standing on a height map can see, without
+// opening a window, and writes it out as a mask - white for visible:
+//
+//     Heightmap -viewshed <in.bmp> <out.bmp> [col row] [eye height] [threads]
+//
+// The observer's at the middle unless told otherwise. The viewshed's
+// approximate, so each grid point's also checked exactly with
+// CanSeeBatch, and it reports how often the two agree.
+static int RunViewshedBatch(int argc, char **argv)
 {
-	float x, y, z;
-	x = (normalA.x + normalB.x)/2;
-	y = (normalA.y + normalB.y)/2;
-	z = (normalA.z + normalB.z)/2;
-	
-	return XMFLOAT3(x,y,z);
+	AttachParentConsole();
+
+	if (argc < 4)
+	{
+		fprintf(stderr, "Usage: %s -viewshed <in.bmp> <out.bmp> [col row] [eye height] [threads]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<uint8_t> values;
+	int width, length;
+	if (!LoadHeightMapBMP(argv[2], &values, &width, &length))
+	{
+		fprintf(stderr, "Failed to load %s\n", argv[2]);
+		return 1;
+	}
+
+	int observerCol = argc > 5 ? atoi(argv[4]) : width / 2;
+	int observerRow = argc > 5 ? atoi(argv[5]) : length / 2;
+	float eyeHeight = argc > 6 ? float(atof(argv[6])) : 2.f;
+	unsigned maxNumThreads = argc > 7 ? unsigned(atoi(argv[7])) : 0;
+
+	if (observerCol < 0 || observerCol >= width || observerRow < 0 || observerRow >= length)
+	{
+		fprintf(stderr, "(%d, %d) is off the %dx%d map\n", observerCol, observerRow, width, length);
+		return 1;
+	}
+
+	// Laid out as LoadHeightMap does, with a grid size of 1.
+	std::vector<float> heights(values.size());
+	for (size_t i = 0; i < values.size(); ++i)
+		heights[i] = values[i] / 16.f;
+
+	TerrainGrid grid;
+	if (!grid.Create(width, length, (float)(-(width / 2)), (float)(length / 2), 1.f, -1.f))
+	{
+		fprintf(stderr, "%s is too big\n", argv[2]);
+		return 1;
+	}
+
+	grid.SetHeights(0, 0, width - 1, length - 1, &heights[0], width);
+
+	HeightField heightField;
+	LineOfSight lineOfSight;
+	if (!heightField.Create(&grid) || !lineOfSight.Create(&heightField))
+	{
+		fprintf(stderr, "%s is too small\n", argv[2]);
+		return 1;
+	}
+
+	size_t numPoints = size_t(width) * length;
+
+	std::vector<uint32_t> viewshedBits;
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	lineOfSight.ComputeViewshed(observerCol, observerRow, eyeHeight, 0.f, &viewshedBits);
+	double viewshedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	// The same question, one sight line per grid point.
+	std::vector<float> eyes(numPoints * 3), targets(numPoints * 3);
+
+	float eye[3] = {
+		grid.GetOriginX() + observerCol * grid.GetColumnStepX(),
+		heights[size_t(observerRow) * width + observerCol] + eyeHeight,
+		grid.GetOriginZ() + observerRow * grid.GetRowStepZ(),
+	};
+
+	for (int row = 0; row < length; ++row)
+	{
+		for (int col = 0; col < width; ++col)
+		{
+			size_t index = size_t(row) * width + col;
+
+			memcpy(&eyes[index * 3], eye, sizeof eye);
+
+			targets[index * 3 + 0] = grid.GetOriginX() + col * grid.GetColumnStepX();
+			targets[index * 3 + 1] = heights[index];
+			targets[index * 3 + 2] = grid.GetOriginZ() + row * grid.GetRowStepZ();
+		}
+	}
+
+	std::vector<uint32_t> exactBits;
+
+	startTime = std::chrono::steady_clock::now();
+	size_t numExactVisible = lineOfSight.CanSeeBatch(&eyes[0], &targets[0], numPoints, &exactBits, maxNumThreads);
+	double exactSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	size_t numVisible = 0, numAgree = 0;
+
+	for (size_t i = 0; i < numPoints; ++i)
+	{
+		bool visible = ((viewshedBits[i / 32] >> (i % 32)) & 1) != 0;
+		bool exactVisible = ((exactBits[i / 32] >> (i % 32)) & 1) != 0;
+
+		values[i] = visible ? 255 : 0;
+
+		if (visible)
+			++numVisible;
+
+		if (visible == exactVisible)
+			++numAgree;
+	}
+
+	printf("%dx%d from (%d, %d): %u points visible (%u exactly), %.2f%% agree\n", width, length, observerCol, observerRow,
+		unsigned(numVisible), unsigned(numExactVisible), numAgree * 100. / numPoints);
+
+	printf("Viewshed %.3f ms, sight lines %.3f ms (%.1f million a second)\n", viewshedSeconds * 1000., exactSeconds * 1000.,
+		exactSeconds > 0. ? numPoints / exactSeconds / 1e6 : 0.);
+
+	if (!SaveHeightMapBMP(argv[3], &values[0], width, length))
+	{
+		fprintf(stderr, "Failed to save %s\n", argv[3]);
+		return 1;
+	}
+
+	return 0;
 }
+
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
+
 int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 {
+	if (__argc > 1 && strcmp(__argv[1], "-erode") == 0)
+		return RunErosionBatch(__argc, __argv);
+
+	if (__argc > 1 && strcmp(__argv[1], "-noise") == 0)
+		return RunNoiseBatch(__argc, __argv);
+
+	if (__argc > 1 && strcmp(__argv[1], "-pack") == 0)
+		return RunPackBatch(__argc, __argv);
+
+	if (__argc > 1 && strcmp(__argv[1], "-unpack") == 0)
+		return RunUnpackBatch(__argc, __argv);
+
+	if (__argc > 1 && strcmp(__argv[1], "-render") == 0)
+		return RunRenderBatch(__argc, __argv);
+
+	if (__argc > 1 && strcmp(__argv[1], "-occlusion") == 0)
+		return RunOcclusionBatch(__argc, __argv);
+
+	if (__argc > 1 && strcmp(__argv[1], "-viewshed") == 0)
+		return RunViewshedBatch(__argc, __argv);
+
 	HeightMapApplication application;
 
 	Run(&application);
@@ -0,0 +1,538 @@
+#include "LineOfSight.h"
+#include "HeightField.h"
+#include "ParallelJobs.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LINE_OF_SIGHT_SSE2 1
+#include <emmintrin.h>
+#else
+#define LINE_OF_SIGHT_SSE2 0
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Terrain has to be this much above the line (in height units) to
+// block it, so that rounding doesn't make the ground an observer is
+// standing on, or a target sitting right on the surface, block the
+// view.
+static const float HEIGHT_EPSILON = 1e-4f;
+
+// Pairs per job for CanSeeBatch. A multiple of 32, so that no 2 jobs
+// write to the same word of the bitset.
+static const size_t PAIRS_PER_JOB = 256;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+LineOfSight::LineOfSight():
+m_pHeightField(NULL)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+LineOfSight::~LineOfSight()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool LineOfSight::Create(const HeightField *pHeightField)
+{
+	this->Destroy();
+
+	if (pHeightField->GetWidth() < 2 || pHeightField->GetLength() < 2)
+		return false;
+
+	m_pHeightField = pHeightField;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void LineOfSight::Destroy()
+{
+	m_pHeightField = NULL;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool LineOfSight::CanSee(const float *pFrom, const float *pTo) const
+{
+	if (!m_pHeightField)
+		return true;
+
+	float from[3], to[3];
+	this->GetGridPos(pFrom, from);
+	this->GetGridPos(pTo, to);
+
+	return this->CanSeeGrid(from, to);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool LineOfSight::CanSeeReference(const float *pFrom, const float *pTo, float stepSize) const
+{
+	if (!m_pHeightField)
+		return true;
+
+	float from[3], to[3];
+	this->GetGridPos(pFrom, from);
+	this->GetGridPos(pTo, to);
+
+	float maxCol = float(m_pHeightField->GetWidth() - 1);
+	float maxRow = float(m_pHeightField->GetLength() - 1);
+
+	float dCol = to[0] - from[0];
+	float dRow = to[2] - from[2];
+
+	int numSteps = int(ceilf(sqrtf(dCol * dCol + dRow * dRow) / stepSize));
+
+	for (int i = 0; i <= numSteps; ++i)
+	{
+		float u = numSteps > 0 ? float(i) / float(numSteps) : 0.f;
+
+		float col = from[0] + dCol * u;
+		float row = from[2] + dRow * u;
+
+		if (col < 0.f || col > maxCol || row < 0.f || row > maxRow)
+			continue;
+
+		float y = from[1] + (to[1] - from[1]) * u;
+
+		if (this->GetTerrainHeight(col, row) > y + HEIGHT_EPSILON)
+			return false;
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t LineOfSight::CanSeeBatch(const float *pFroms, const float *pTos, size_t numPairs, std::vector<uint32_t> *pVisibleBits, unsigned maxNumThreads) const
+{
+	pVisibleBits->clear();
+	pVisibleBits->resize((numPairs + 31) / 32, 0);
+
+	if (numPairs == 0)
+		return 0;
+
+	uint32_t *pWords = &(*pVisibleBits)[0];
+
+	size_t numJobs = (numPairs + PAIRS_PER_JOB - 1) / PAIRS_PER_JOB;
+
+	RunParallelJobs(numJobs, maxNumThreads,
+		[&](size_t jobIndex, std::string *)
+		{
+			size_t begin = jobIndex * PAIRS_PER_JOB;
+			size_t end = std::min(begin + PAIRS_PER_JOB, numPairs);
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				if (this->CanSee(pFroms + i * 3, pTos + i * 3))
+					pWords[i / 32] |= 1u << (i % 32);
+			}
+
+			return true;
+		},
+		NULL);
+
+	size_t numVisible = 0;
+
+	for (size_t i = 0; i < pVisibleBits->size(); ++i)
+	{
+		for (uint32_t word = pWords[i]; word != 0; word &= word - 1)
+			++numVisible;
+	}
+
+	return numVisible;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void LineOfSight::ComputeViewshed(int observerCol, int observerRow, float eyeHeight, float targetHeight, std::vector<uint32_t> *pVisibleBits) const
+{
+	pVisibleBits->clear();
+
+	if (!m_pHeightField)
+		return;
+
+	int width = m_pHeightField->GetWidth();
+	int length = m_pHeightField->GetLength();
+	const float *pHeights = m_pHeightField->GetGridHeights();
+
+	pVisibleBits->resize((size_t(width) * length + 31) / 32, 0);
+
+	if (observerCol < 0 || observerCol >= width || observerRow < 0 || observerRow >= length)
+		return;
+
+	uint32_t *pWords = &(*pVisibleBits)[0];
+
+	// For each grid point done so far, the lowest height that the
+	// sight line from the observer out past it can be at: the higher of
+	// the terrain there and the horizon from everything nearer.
+	std::vector<float> horizons(size_t(width) * length);
+
+	size_t observerIndex = size_t(observerRow) * width + observerCol;
+
+	float eyeY = pHeights[observerIndex] + eyeHeight;
+
+	horizons[observerIndex] = eyeY;
+	pWords[observerIndex / 32] |= 1u << (observerIndex % 32);
+
+	int maxDistance = std::max(std::max(observerCol, width - 1 - observerCol), std::max(observerRow, length - 1 - observerRow));
+
+	for (int distance = 1; distance <= maxDistance; ++distance)
+	{
+		int rowBegin = std::max(observerRow - distance, 0);
+		int rowEnd = std::min(observerRow + distance, length - 1);
+
+		for (int row = rowBegin; row <= rowEnd; ++row)
+		{
+			int dRow = row - observerRow;
+
+			// Top and bottom rows of the ring are done all the way
+			// across; the others just have a point at each end.
+			int colStep = dRow == -distance || dRow == distance ? 1 : distance * 2;
+
+			for (int dCol = -distance; dCol <= distance; dCol += colStep)
+			{
+				int col = observerCol + dCol;
+
+				if (col < 0 || col >= width)
+					continue;
+
+				size_t index = size_t(row) * width + col;
+				float height = pHeights[index];
+
+				if (distance == 1)
+				{
+					// Nothing in between.
+					horizons[index] = height;
+					pWords[index / 32] |= 1u << (index % 32);
+					continue;
+				}
+
+				// Where the sight line crosses the previous ring. One
+				// coordinate is on the ring, and the other falls between
+				// 2 grid points.
+				float scale = float(distance - 1) / float(distance);
+				bool alongCol = abs(dCol) == distance;
+
+				float minor = float(alongCol ? dRow : dCol) * scale;
+				float minorFloor = floorf(minor);
+				float frac = minor - minorFloor;
+				int major = (alongCol ? dCol : dRow) > 0 ? distance - 1 : 1 - distance;
+
+				int col0, row0, col1, row1;
+				if (alongCol)
+				{
+					col0 = col1 = observerCol + major;
+					row0 = observerRow + int(minorFloor);
+					row1 = row0 + 1;
+				}
+				else
+				{
+					row0 = row1 = observerRow + major;
+					col0 = observerCol + int(minorFloor);
+					col1 = col0 + 1;
+				}
+
+				float nearHorizon = horizons[size_t(row0) * width + col0];
+				if (frac > 0.f)
+					nearHorizon += (horizons[size_t(row1) * width + col1] - nearHorizon) * frac;
+
+				// Carry the line from the eye over the near horizon out to
+				// this distance.
+				float horizon = eyeY + (nearHorizon - eyeY) / scale;
+
+				if (height + targetHeight >= horizon - HEIGHT_EPSILON)
+					pWords[index / 32] |= 1u << (index % 32);
+
+				horizons[index] = std::max(height, horizon);
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void LineOfSight::GetGridPos(const float *pWorldPos, float *pGridPos) const
+{
+	pGridPos[0] = (pWorldPos[0] - m_pHeightField->GetOriginX()) / m_pHeightField->GetColumnStepX();
+	pGridPos[1] = pWorldPos[1];
+	pGridPos[2] = (pWorldPos[2] - m_pHeightField->GetOriginZ()) / m_pHeightField->GetRowStepZ();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float LineOfSight::GetTerrainHeight(float col, float row) const
+{
+	int width = m_pHeightField->GetWidth();
+	int length = m_pHeightField->GetLength();
+
+	col = std::min(std::max(col, 0.f), float(width - 1));
+	row = std::min(std::max(row, 0.f), float(length - 1));
+
+	int quadCol = std::min(int(col), width - 2);
+	int quadRow = std::min(int(row), length - 2);
+
+	float s = col - float(quadCol);
+	float t = row - float(quadRow);
+
+	const float *p = m_pHeightField->GetGridHeights() + size_t(quadRow) * width + quadCol;
+
+	// (a, b, d) above the diagonal and (a, d, c) below it, as
+	// TerrainMesh.
+	if (s >= t)
+		return p[0] + (p[1] - p[0]) * s + (p[width + 1] - p[1]) * t;
+	else
+		return p[0] + (p[width] - p[0]) * t + (p[width + 1] - p[width]) * s;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Sight line in grid space, clipped to the grid. Points on it are
+// start + delta * u, for u from 0 to 1.
+struct GridSegment
+{
+	float start[3];
+	float delta[3];
+};
+
+// Tests the terrain under the segment where (v0 + dv * u) is each whole
+// number from kFirst to kLast. Returns false if the terrain is above
+// the segment at any of them.
+static bool IsClearAtCrossings(const GridSegment &seg, const float *pGrid, int width, int length, float v0, float dv, int kFirst, int kLast)
+{
+	if (kFirst > kLast)
+		return true;
+
+	float invDV = 1.f / dv;
+
+	int k = kFirst;
+
+#if LINE_OF_SIGHT_SSE2
+
+	const __m128 startCol = _mm_set1_ps(seg.start[0]);
+	const __m128 startY = _mm_set1_ps(seg.start[1]);
+	const __m128 startRow = _mm_set1_ps(seg.start[2]);
+	const __m128 deltaCol = _mm_set1_ps(seg.delta[0]);
+	const __m128 deltaY = _mm_set1_ps(seg.delta[1]);
+	const __m128 deltaRow = _mm_set1_ps(seg.delta[2]);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 maxCol = _mm_set1_ps(float(width - 1));
+	const __m128 maxRow = _mm_set1_ps(float(length - 1));
+	const __m128 maxQuadCol = _mm_set1_ps(float(width - 2));
+	const __m128 maxQuadRow = _mm_set1_ps(float(length - 2));
+	const __m128 epsilon = _mm_set1_ps(HEIGHT_EPSILON);
+	const __m128 invDV4 = _mm_set1_ps(invDV);
+
+	__m128 offsets = _mm_add_ps(_mm_set1_ps(float(kFirst) - v0), _mm_setr_ps(0.f, 1.f, 2.f, 3.f));
+	const __m128 four = _mm_set1_ps(4.f);
+
+	for (; k <= kLast; k += 4)
+	{
+		// Clamping u keeps rounding, and lanes past kLast, on the
+		// segment.
+		__m128 u = _mm_min_ps(_mm_max_ps(_mm_mul_ps(offsets, invDV4), zero), one);
+		offsets = _mm_add_ps(offsets, four);
+
+		__m128 col = _mm_add_ps(startCol, _mm_mul_ps(deltaCol, u));
+		__m128 row = _mm_add_ps(startRow, _mm_mul_ps(deltaRow, u));
+		__m128 y = _mm_add_ps(startY, _mm_mul_ps(deltaY, u));
+
+		col = _mm_min_ps(_mm_max_ps(col, zero), maxCol);
+		row = _mm_min_ps(_mm_max_ps(row, zero), maxRow);
+
+		__m128 quadCol = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(col)), maxQuadCol);
+		__m128 quadRow = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(row)), maxQuadRow);
+
+		__m128 s = _mm_sub_ps(col, quadCol);
+		__m128 t = _mm_sub_ps(row, quadRow);
+
+		int32_t quadCols[4], quadRows[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(quadCols), _mm_cvttps_epi32(quadCol));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(quadRows), _mm_cvttps_epi32(quadRow));
+
+		float ha[4], hb[4], hc[4], hd[4];
+
+		for (int j = 0; j < 4; ++j)
+		{
+			const float *p = pGrid + size_t(quadRows[j]) * width + size_t(quadCols[j]);
+
+			ha[j] = p[0];
+			hb[j] = p[1];
+			hc[j] = p[width];
+			hd[j] = p[width + 1];
+		}
+
+		__m128 a = _mm_loadu_ps(ha);
+		__m128 b = _mm_loadu_ps(hb);
+		__m128 c = _mm_loadu_ps(hc);
+		__m128 d = _mm_loadu_ps(hd);
+
+		// Both triangles' planes, then pick per lane.
+		__m128 upper = _mm_add_ps(a, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(b, a), s), _mm_mul_ps(_mm_sub_ps(d, b), t)));
+		__m128 lower = _mm_add_ps(a, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(c, a), t), _mm_mul_ps(_mm_sub_ps(d, c), s)));
+
+		__m128 isUpper = _mm_cmpge_ps(s, t);
+		__m128 terrain = _mm_or_ps(_mm_and_ps(isUpper, upper), _mm_andnot_ps(isUpper, lower));
+
+		int blocked = _mm_movemask_ps(_mm_cmpgt_ps(terrain, _mm_add_ps(y, epsilon)));
+
+		int numLanes = std::min(kLast - k + 1, 4);
+		if (blocked & ((1 << numLanes) - 1))
+			return false;
+	}
+
+#endif
+
+	for (; k <= kLast; ++k)
+	{
+		float u = std::min(std::max((float(k) - v0) * invDV, 0.f), 1.f);
+
+		float col = std::min(std::max(seg.start[0] + seg.delta[0] * u, 0.f), float(width - 1));
+		float row = std::min(std::max(seg.start[2] + seg.delta[2] * u, 0.f), float(length - 1));
+		float y = seg.start[1] + seg.delta[1] * u;
+
+		int quadCol = std::min(int(col), width - 2);
+		int quadRow = std::min(int(row), length - 2);
+
+		float s = col - float(quadCol);
+		float t = row - float(quadRow);
+
+		const float *p = pGrid + size_t(quadRow) * width + quadCol;
+
+		float terrain;
+		if (s >= t)
+			terrain = p[0] + (p[1] - p[0]) * s + (p[width + 1] - p[1]) * t;
+		else
+			terrain = p[0] + (p[width] - p[0]) * t + (p[width + 1] - p[width]) * s;
+
+		if (terrain > y + HEIGHT_EPSILON)
+			return false;
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Whole numbers from the smaller of a and b to the larger.
+static void GetCrossingRange(float a, float b, int *pFirst, int *pLast)
+{
+	*pFirst = int(ceilf(std::min(a, b)));
+	*pLast = int(floorf(std::max(a, b)));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool LineOfSight::CanSeeGrid(const float *pFrom, const float *pTo) const
+{
+	int width = m_pHeightField->GetWidth();
+	int length = m_pHeightField->GetLength();
+	const float *pGrid = m_pHeightField->GetGridHeights();
+
+	float delta[3] = {pTo[0] - pFrom[0], pTo[1] - pFrom[1], pTo[2] - pFrom[2]};
+
+	// Clip to the grid. Nothing off the edge can block anything.
+	float uMin = 0.f, uMax = 1.f;
+
+	for (int axis = 0; axis < 3; axis += 2)
+	{
+		float size = float(axis == 0 ? width - 1 : length - 1);
+
+		if (delta[axis] == 0.f)
+		{
+			if (pFrom[axis] < 0.f || pFrom[axis] > size)
+				return true;
+		}
+		else
+		{
+			float u0 = (0.f - pFrom[axis]) / delta[axis];
+			float u1 = (size - pFrom[axis]) / delta[axis];
+
+			uMin = std::max(uMin, std::min(u0, u1));
+			uMax = std::min(uMax, std::max(u0, u1));
+		}
+	}
+
+	if (uMin > uMax)
+		return true;
+
+	GridSegment seg;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		seg.start[i] = pFrom[i] + delta[i] * uMin;
+		seg.delta[i] = delta[i] * (uMax - uMin);
+	}
+
+	// The ends.
+	if (!IsClearAtCrossings(seg, pGrid, width, length, 0.f, 1.f, 0, 1))
+		return false;
+
+	// Between triangle edges, the terrain under the line is a straight
+	// line too, so the crossings are the only other places to look.
+	// Going by columns, rows and diagonals separately means plenty of
+	// crossings in a row for the SIMD version to work on.
+	float endCol = seg.start[0] + seg.delta[0];
+	float endRow = seg.start[2] + seg.delta[2];
+
+	int first, last;
+
+	if (seg.delta[0] != 0.f)
+	{
+		GetCrossingRange(seg.start[0], endCol, &first, &last);
+
+		if (!IsClearAtCrossings(seg, pGrid, width, length, seg.start[0], seg.delta[0], first, last))
+			return false;
+	}
+
+	if (seg.delta[2] != 0.f)
+	{
+		GetCrossingRange(seg.start[2], endRow, &first, &last);
+
+		if (!IsClearAtCrossings(seg, pGrid, width, length, seg.start[2], seg.delta[2], first, last))
+			return false;
+	}
+
+	// Diagonals are where col - row is a whole number.
+	float startDiagonal = seg.start[0] - seg.start[2];
+	float deltaDiagonal = seg.delta[0] - seg.delta[2];
+
+	if (deltaDiagonal != 0.f)
+	{
+		GetCrossingRange(startDiagonal, startDiagonal + deltaDiagonal, &first, &last);
+
+		if (!IsClearAtCrossings(seg, pGrid, width, length, startDiagonal, deltaDiagonal, first, last))
+			return false;
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,94 @@
+#ifndef HEADER_336CA83AEC27478387CC0D054E3F40A1
+#define HEADER_336CA83AEC27478387CC0D054E3F40A1
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Line of sight over a HeightField's terrain.
+//
+// The terrain is the triangles TerrainMesh draws. Along a straight
+// line, both the terrain and the sight line are linear between the
+// places where the line crosses a triangle edge - a grid row, a grid
+// column or a quad diagonal - so checking the terrain height at those
+// crossings gives an exact answer. CanSee works through the crossings
+// 4 at a time with SSE2 where it's available.
+//
+// CanSeeReference marches along the line in small fixed steps
+// instead. It's slow, and there to check against.
+//
+// ComputeViewshed finds every grid point visible from one observer,
+// using Franklin and Ray's XDraw: grid points are done in square rings
+// outwards from the observer, and each point's horizon height comes
+// from interpolating between the 2 points on the previous ring that
+// the sight line passes between. That's constant work per point, so
+// O(n) per ring, but it is an approximation, and not quite the same
+// as calling CanSee for each point.
+//
+// Results come back as bitsets: bit i is (words[i / 32] >> (i % 32))
+// & 1.
+//
+// The HeightField must outlast the LineOfSight object, and mustn't
+// change. Nothing here changes anything, so any number of threads can
+// use it at once.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+class HeightField;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class LineOfSight
+{
+public:
+	LineOfSight();
+	~LineOfSight();
+
+	bool Create(const HeightField *pHeightField);
+	void Destroy();
+
+	// pFrom and pTo are world xyz positions. Terrain exactly touching
+	// the line doesn't block it.
+	bool CanSee(const float *pFrom, const float *pTo) const;
+
+	// Same question, answered the slow way. stepSize is in grid units.
+	bool CanSeeReference(const float *pFrom, const float *pTo, float stepSize) const;
+
+	// pFroms and pTos are numPairs xyz positions each. Bit i of
+	// *pVisibleBits is set if pair i can see each other. The work is
+	// spread over up to maxNumThreads threads (0 means one per
+	// hardware thread).
+	//
+	// Returns the number of visible pairs.
+	size_t CanSeeBatch(const float *pFroms, const float *pTos, size_t numPairs, std::vector<uint32_t> *pVisibleBits, unsigned maxNumThreads) const;
+
+	// Bit (row * width + col) of *pVisibleBits is set if an observer
+	// eyeHeight above grid point (observerCol, observerRow) can see a
+	// point targetHeight above grid point (col, row).
+	void ComputeViewshed(int observerCol, int observerRow, float eyeHeight, float targetHeight, std::vector<uint32_t> *pVisibleBits) const;
+protected:
+private:
+	const HeightField *m_pHeightField;
+
+	// Grid space: x is the column, z the row. y is left alone.
+	void GetGridPos(const float *pWorldPos, float *pGridPos) const;
+
+	float GetTerrainHeight(float col, float row) const;
+	bool CanSeeGrid(const float *pFrom, const float *pTo) const;
+
+	LineOfSight(const LineOfSight &);
+	LineOfSight &operator=(const LineOfSight &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_336CA83AEC27478387CC0D054E3F40A1
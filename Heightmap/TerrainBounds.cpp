@@ -0,0 +1,230 @@
+#include "TerrainBounds.h"
+
+#include "OcclusionBuffer.h"
+
+#include <assert.h>
+#include <float.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_BOUNDS_SSE2 1
+#include <emmintrin.h>
+#else
+#define TERRAIN_BOUNDS_SSE2 0
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainBounds::TerrainBounds():
+m_numBoxes(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainBounds::~TerrainBounds()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainBounds::Resize(size_t numBoxes)
+{
+	size_t numPadded = (numBoxes + 3) & ~size_t(3);
+
+	// The padding's empty boxes too, so it's never visible.
+	for (int i = 0; i < NUM_ARRAYS; ++i)
+		m_arrays[i].resize(numPadded, i < MAX_X ? FLT_MAX : -FLT_MAX);
+
+	for (size_t i = numBoxes; i < m_numBoxes && i < numPadded; ++i)
+	{
+		for (int j = 0; j < NUM_ARRAYS; ++j)
+			m_arrays[j][i] = j < MAX_X ? FLT_MAX : -FLT_MAX;
+	}
+
+	m_numBoxes = numBoxes;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainBounds::Clear()
+{
+	for (int i = 0; i < NUM_ARRAYS; ++i)
+		m_arrays[i].clear();
+
+	m_numBoxes = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainBounds::GetNumBoxes() const
+{
+	return m_numBoxes;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainBounds::SetBox(size_t i, const float *pMin, const float *pMax)
+{
+	assert(i < m_numBoxes);
+
+	for (int j = 0; j < 3; ++j)
+	{
+		m_arrays[MIN_X + j][i] = pMin[j];
+		m_arrays[MAX_X + j][i] = pMax[j];
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainBounds::GetBox(size_t i, float *pMin, float *pMax) const
+{
+	assert(i < m_numBoxes);
+
+	for (int j = 0; j < 3; ++j)
+	{
+		pMin[j] = m_arrays[MIN_X + j][i];
+		pMax[j] = m_arrays[MAX_X + j][i];
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainBounds::CullPlanes(const float (*pPlanes)[4], int numPlanes, uint8_t *pVisible) const
+{
+	assert(numPlanes <= MAX_PLANES);
+
+	if (m_numBoxes == 0)
+		return 0;
+
+	size_t numVisible = 0;
+	size_t i = 0;
+
+#if TERRAIN_BOUNDS_SSE2
+
+	// Which arrays to use, and the plane itself, are only worked out
+	// once per plane.
+	const float *pXs[MAX_PLANES];
+	const float *pYs[MAX_PLANES];
+	const float *pZs[MAX_PLANES];
+	__m128 planes[MAX_PLANES][4];
+
+	for (int j = 0; j < numPlanes; ++j)
+	{
+		const float *pPlane = pPlanes[j];
+
+		// The corner furthest inside.
+		pXs[j] = &m_arrays[pPlane[0] >= 0.f ? MAX_X : MIN_X][0];
+		pYs[j] = &m_arrays[pPlane[1] >= 0.f ? MAX_Y : MIN_Y][0];
+		pZs[j] = &m_arrays[pPlane[2] >= 0.f ? MAX_Z : MIN_Z][0];
+
+		for (int k = 0; k < 4; ++k)
+			planes[j][k] = _mm_set1_ps(pPlane[k]);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+
+	// The padding means there's always a whole 4 to load.
+	for (; i < m_numBoxes; i += 4)
+	{
+		int mask = 15;
+
+		for (int j = 0; j < numPlanes && mask != 0; ++j)
+		{
+			__m128 distance = _mm_mul_ps(_mm_loadu_ps(pXs[j] + i), planes[j][0]);
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_loadu_ps(pYs[j] + i), planes[j][1]));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_loadu_ps(pZs[j] + i), planes[j][2]));
+			distance = _mm_add_ps(distance, planes[j][3]);
+
+			mask &= _mm_movemask_ps(_mm_cmpge_ps(distance, zero));
+		}
+
+		for (size_t k = 0; k < 4 && i + k < m_numBoxes; ++k)
+		{
+			pVisible[i + k] = uint8_t((mask >> k) & 1);
+			numVisible += pVisible[i + k];
+		}
+	}
+
+#endif
+
+	for (; i < m_numBoxes; ++i)
+	{
+		bool inside = true;
+
+		for (int j = 0; j < numPlanes && inside; ++j)
+		{
+			const float *pPlane = pPlanes[j];
+
+			float distance = pPlane[3];
+
+			for (int k = 0; k < 3; ++k)
+				distance += pPlane[k] * m_arrays[pPlane[k] >= 0.f ? MAX_X + k : MIN_X + k][i];
+
+			inside = distance >= 0.f;
+		}
+
+		pVisible[i] = inside ? 1 : 0;
+		numVisible += pVisible[i];
+	}
+
+	return numVisible;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainBounds::CullOccluded(OcclusionBuffer *pBuffer, const float *pViewProj, uint8_t *pVisible) const
+{
+	size_t numVisible = 0;
+
+	for (size_t i = 0; i < m_numBoxes; ++i)
+	{
+		if (!pVisible[i])
+			continue;
+
+		float boxMin[3], boxMax[3];
+		this->GetBox(i, boxMin, boxMax);
+
+		if (pBuffer->IsBoxOccluded(pViewProj, boxMin, boxMax))
+			pVisible[i] = 0;
+		else
+			++numVisible;
+	}
+
+	return numVisible;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// A point p is in clip space at p * M, so each clip coordinate is p
+// dotted with a column of M, and -w <= x <= w, -w <= y <= w and
+// 0 <= z <= w are planes made of sums of columns.
+void GetFrustumPlanes(const float *pViewProj, float (*pPlanes)[4])
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		float x = pViewProj[i * 4 + 0];
+		float y = pViewProj[i * 4 + 1];
+		float z = pViewProj[i * 4 + 2];
+		float w = pViewProj[i * 4 + 3];
+
+		pPlanes[0][i] = w + x;
+		pPlanes[1][i] = w - x;
+		pPlanes[2][i] = w + y;
+		pPlanes[3][i] = w - y;
+		pPlanes[4][i] = z;
+		pPlanes[5][i] = w - z;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,98 @@
+#ifndef HEADER_10A0DC19FBCE48068B725595F7CDE0A8
+#define HEADER_10A0DC19FBCE48068B725595F7CDE0A8
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// A list of axis aligned boxes (a TerrainMesh's chunks, say), kept as
+// 6 arrays of min x, min y, ... max z rather than an array of boxes,
+// so they can be tested against planes 4 at a time with SSE2.
+//
+// A box is outside a plane if its corner furthest along the plane's
+// normal is. Which corner that is depends only on the signs of the
+// plane's normal, so for each plane it's a matter of picking the right
+// 3 arrays, then a multiply-add per array for 4 boxes at once.
+//
+// The boxes left can then be tested against an OcclusionBuffer, one at
+// a time.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class OcclusionBuffer;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainBounds
+{
+public:
+	static const int MAX_PLANES = 8;
+
+	TerrainBounds();
+	~TerrainBounds();
+
+	// New boxes are empty: they're outside every plane.
+	void Resize(size_t numBoxes);
+	void Clear();
+
+	size_t GetNumBoxes() const;
+
+	void SetBox(size_t i, const float *pMin, const float *pMax);
+	void GetBox(size_t i, float *pMin, float *pMax) const;
+
+	// pVisible[i] is set to 1 if box i is at all inside every one of the
+	// planes (up to MAX_PLANES), and 0 if it isn't. A point p is inside
+	// plane (a, b, c, d) if a*px + b*py + c*pz + d >= 0. Returns the
+	// number visible.
+	size_t CullPlanes(const float (*pPlanes)[4], int numPlanes, uint8_t *pVisible) const;
+
+	// Of the boxes pVisible has as visible (after CullPlanes, say),
+	// sets those hidden behind pBuffer's occluders to 0. pBuffer has
+	// been rasterized, and pViewProj is as for GetFrustumPlanes.
+	// Returns the number still visible.
+	size_t CullOccluded(OcclusionBuffer *pBuffer, const float *pViewProj, uint8_t *pVisible) const;
+protected:
+private:
+	enum
+	{
+		MIN_X,
+		MIN_Y,
+		MIN_Z,
+		MAX_X,
+		MAX_Y,
+		MAX_Z,
+		NUM_ARRAYS,
+	};
+
+	// Each padded out to a multiple of 4 boxes.
+	std::vector<float> m_arrays[NUM_ARRAYS];
+	size_t m_numBoxes;
+
+	TerrainBounds(const TerrainBounds &);
+	TerrainBounds &operator=(const TerrainBounds &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The 6 planes of the frustum of a view * projection matrix, as D3D
+// has them (row vectors, z from 0 to 1), in the order left, right,
+// bottom, top, near, far. They point inwards, and aren't normalised.
+// pViewProj is the matrix's 16 floats, row by row.
+void GetFrustumPlanes(const float *pViewProj, float (*pPlanes)[4]);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_10A0DC19FBCE48068B725595F7CDE0A8
@@ -0,0 +1,130 @@
+#include "TerrainBrush.h"
+#include "HeightField.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool GetTerrainBrushRegion(const HeightField &heightField, const TerrainBrush &brush, float x, float z, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow)
+{
+	int width = heightField.GetWidth();
+	int length = heightField.GetLength();
+
+	if (width < 2 || length < 2 || !(brush.radius > 0.f))
+		return false;
+
+	float centreCol = (x - heightField.GetOriginX()) / heightField.GetColumnStepX();
+	float centreRow = (z - heightField.GetOriginZ()) / heightField.GetRowStepZ();
+
+	float colRadius = brush.radius / fabsf(heightField.GetColumnStepX());
+	float rowRadius = brush.radius / fabsf(heightField.GetRowStepZ());
+
+	// Clamp both ways before converting, so positions miles off the
+	// grid, on either side, don't overflow.
+	*pMinCol = int(ceilf(std::min(std::max(centreCol - colRadius, 0.f), float(width))));
+	*pMinRow = int(ceilf(std::min(std::max(centreRow - rowRadius, 0.f), float(length))));
+	*pMaxCol = int(floorf(std::max(std::min(centreCol + colRadius, float(width - 1)), -1.f)));
+	*pMaxRow = int(floorf(std::max(std::min(centreRow + rowRadius, float(length - 1)), -1.f)));
+
+	return *pMinCol <= *pMaxCol && *pMinRow <= *pMaxRow;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ApplyTerrainBrush(HeightField *pHeightField, const TerrainBrush &brush, float x, float z, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow)
+{
+	int minCol, minRow, maxCol, maxRow;
+	if (!GetTerrainBrushRegion(*pHeightField, brush, x, z, &minCol, &minRow, &maxCol, &maxRow))
+		return false;
+
+	int width = pHeightField->GetWidth();
+	int length = pHeightField->GetLength();
+
+	float stepX = pHeightField->GetColumnStepX();
+	float stepZ = pHeightField->GetRowStepZ();
+
+	float centreCol = (x - pHeightField->GetOriginX()) / stepX;
+	float centreRow = (z - pHeightField->GetOriginZ()) / stepZ;
+
+	const float *pGrid = pHeightField->GetGridHeights();
+
+	int numCols = maxCol - minCol + 1;
+	int numRows = maxRow - minRow + 1;
+
+	std::vector<float> heights(size_t(numCols) * numRows);
+
+	float invRadiusSq = 1.f / (brush.radius * brush.radius);
+	float fraction = std::min(std::max(brush.strength, 0.f), 1.f);
+
+	for (int row = minRow; row <= maxRow; ++row)
+	{
+		float dz = (float(row) - centreRow) * stepZ;
+
+		for (int col = minCol; col <= maxCol; ++col)
+		{
+			float dx = (float(col) - centreCol) * stepX;
+			float height = pGrid[size_t(row) * width + col];
+
+			// (1 - d^2/r^2)^2 is 1 at the centre, and 0, and flat, at the
+			// edge.
+			float falloff = std::max(1.f - (dx * dx + dz * dz) * invRadiusSq, 0.f);
+			falloff *= falloff;
+
+			switch (brush.mode)
+			{
+			case TERRAIN_BRUSH_RAISE:
+				height += brush.strength * falloff;
+				break;
+
+			case TERRAIN_BRUSH_LOWER:
+				height -= brush.strength * falloff;
+				break;
+
+			case TERRAIN_BRUSH_SMOOTH:
+				if (falloff > 0.f)
+				{
+					float sum = 0.f;
+					int numPoints = 0;
+
+					// The heights are read from the grid, which isn't
+					// written until the end, so every point sees its
+					// neighbours as they were.
+					for (int j = std::max(row - 1, 0); j <= std::min(row + 1, length - 1); ++j)
+					{
+						for (int i = std::max(col - 1, 0); i <= std::min(col + 1, width - 1); ++i)
+						{
+							sum += pGrid[size_t(j) * width + i];
+							++numPoints;
+						}
+					}
+
+					height += (sum / float(numPoints) - height) * fraction * falloff;
+				}
+				break;
+
+			case TERRAIN_BRUSH_FLATTEN:
+				height += (brush.targetHeight - height) * fraction * falloff;
+				break;
+			}
+
+			heights[size_t(row - minRow) * numCols + col - minCol] = height;
+		}
+	}
+
+	pHeightField->SetGridHeights(minCol, minRow, maxCol, maxRow, &heights[0]);
+
+	*pMinCol = minCol;
+	*pMinRow = minRow;
+	*pMaxCol = maxCol;
+	*pMaxRow = maxRow;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,72 @@
+#ifndef HEADER_74971E2A5FD64C3CB84BABAEF6B7D8A7
+#define HEADER_74971E2A5FD64C3CB84BABAEF6B7D8A7
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Brushes for sculpting a HeightField.
+//
+// A brush changes the grid points within its radius of a world (x, z)
+// position, by most at the centre and fading smoothly to nothing at
+// the edge. Each call is one dab; hold the brush down by calling it
+// every frame.
+//
+// The changed grid points are returned as a rectangle, ready to pass
+// on to whatever depends on the heights (TerrainMesh::MarkDirty,
+// TerrainRayCaster::UpdateRegion, and so on). The work done is
+// proportional to the brush's area, not the grid's.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class HeightField;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+enum TerrainBrushMode
+{
+	// Add, or subtract, strength at the centre.
+	TERRAIN_BRUSH_RAISE,
+	TERRAIN_BRUSH_LOWER,
+
+	// Move each point strength of the way towards the average of it and
+	// its 8 neighbours.
+	TERRAIN_BRUSH_SMOOTH,
+
+	// Move each point strength of the way towards targetHeight.
+	TERRAIN_BRUSH_FLATTEN,
+};
+
+struct TerrainBrush
+{
+	TerrainBrushMode mode;
+
+	// In world units.
+	float radius;
+
+	// For smoothing and flattening, 0 to 1.
+	float strength;
+
+	// For flattening only.
+	float targetHeight;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The grid points ApplyTerrainBrush would change, for saving them
+// first. Returns false if the brush would miss the grid.
+bool GetTerrainBrushRegion(const HeightField &heightField, const TerrainBrush &brush, float x, float z, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow);
+
+// Returns false if the brush missed the grid. Otherwise, the grid
+// points from (*pMinCol, *pMinRow) to (*pMaxCol, *pMaxRow) inclusive
+// might have changed.
+bool ApplyTerrainBrush(HeightField *pHeightField, const TerrainBrush &brush, float x, float z, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_74971E2A5FD64C3CB84BABAEF6B7D8A7
@@ -0,0 +1,98 @@
+#include "TerrainChunks.h"
+
+#include "TerrainBounds.h"
+#include "TerrainGrid.h"
+
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void GetTerrainChunks(int width, int length, int chunkQuads, std::vector<TerrainChunk> *pChunks)
+{
+	pChunks->clear();
+
+	int numQuadsWide = width - 1;
+	int numQuadsLong = length - 1;
+
+	for (int row0 = 0; row0 < numQuadsLong; row0 += chunkQuads)
+	{
+		for (int col0 = 0; col0 < numQuadsWide; col0 += chunkQuads)
+		{
+			TerrainChunk chunk;
+
+			chunk.col0 = col0;
+			chunk.row0 = row0;
+			chunk.width = std::min(chunkQuads, numQuadsWide - col0) + 1;
+			chunk.length = std::min(chunkQuads, numQuadsLong - row0) + 1;
+
+			pChunks->push_back(chunk);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void BuildTerrainChunkIndices(int width, int length, uint16_t *pIndices)
+{
+	for (int row = 0; row + 1 < length; ++row)
+	{
+		for (int col = 0; col + 1 < width; ++col)
+		{
+			uint16_t a = uint16_t(row * width + col);
+			uint16_t b = uint16_t(a + 1);
+			uint16_t c = uint16_t(a + width);
+			uint16_t d = uint16_t(c + 1);
+
+			*pIndices++ = a;
+			*pIndices++ = b;
+			*pIndices++ = d;
+
+			*pIndices++ = a;
+			*pIndices++ = d;
+			*pIndices++ = c;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void GetTerrainChunkBox(const TerrainGrid *pGrid, const TerrainChunk &chunk, float *pMin, float *pMax)
+{
+	int col1 = chunk.col0 + chunk.width - 1;
+	int row1 = chunk.row0 + chunk.length - 1;
+
+	// The steps may be negative.
+	float x0 = pGrid->GetOriginX() + chunk.col0 * pGrid->GetColumnStepX();
+	float x1 = pGrid->GetOriginX() + col1 * pGrid->GetColumnStepX();
+	float z0 = pGrid->GetOriginZ() + chunk.row0 * pGrid->GetRowStepZ();
+	float z1 = pGrid->GetOriginZ() + row1 * pGrid->GetRowStepZ();
+
+	pGrid->GetHeightRange(chunk.col0, chunk.row0, col1, row1, &pMin[1], &pMax[1]);
+
+	pMin[0] = std::min(x0, x1);
+	pMax[0] = std::max(x0, x1);
+	pMin[2] = std::min(z0, z1);
+	pMax[2] = std::max(z0, z1);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void GetTerrainChunkBounds(const TerrainGrid *pGrid, const std::vector<TerrainChunk> &chunks, TerrainBounds *pBounds)
+{
+	pBounds->Resize(chunks.size());
+
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		float boxMin[3], boxMax[3];
+		GetTerrainChunkBox(pGrid, chunks[i], boxMin, boxMax);
+
+		pBounds->SetBox(i, boxMin, boxMax);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
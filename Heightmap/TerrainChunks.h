@@ -0,0 +1,73 @@
+#ifndef HEADER_ADE15F9D38D743BE9C043BBACBE3F895
+#define HEADER_ADE15F9D38D743BE9C043BBACBE3F895
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// How a terrain grid is split into chunks, and each chunk into
+// triangles, for TerrainMesh and anything else that wants the same
+// triangles without going through D3D.
+//
+// The grid is split row by row into square chunks of up to chunkQuads
+// quads on a side, the last in each row and column being whatever's
+// left. Neighbouring chunks share their edge points. Each quad is split
+// along the diagonal from its top left (lower row index, lower column)
+// to its bottom right corner: corners
+//
+//     a b
+//     c d
+//
+// make triangles (a, b, d) and (a, d, c).
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainBounds;
+class TerrainGrid;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TerrainChunk
+{
+	// Grid point of the top left corner.
+	int col0;
+	int row0;
+
+	// Size in grid points, edges included.
+	int width;
+	int length;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The chunks of a grid width by length points in size.
+void GetTerrainChunks(int width, int length, int chunkQuads, std::vector<TerrainChunk> *pChunks);
+
+// The triangles of a chunk width by length points in size, 6 indices
+// per quad, numbering its points row by row from 0.
+void BuildTerrainChunkIndices(int width, int length, uint16_t *pIndices);
+
+// The chunk's bounding box: x and z from its corners, y from the
+// heights in between.
+void GetTerrainChunkBox(const TerrainGrid *pGrid, const TerrainChunk &chunk, float *pMin, float *pMax);
+
+// All the chunks' boxes, in the same order, replacing whatever pBounds
+// had.
+void GetTerrainChunkBounds(const TerrainGrid *pGrid, const std::vector<TerrainChunk> &chunks, TerrainBounds *pBounds);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_ADE15F9D38D743BE9C043BBACBE3F895
@@ -0,0 +1,168 @@
+#include "TerrainDirtyRegions.h"
+
+#include <assert.h>
+
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainDirtyRegions::TerrainDirtyRegions():
+m_width(0),
+m_length(0),
+m_chunkQuads(1),
+m_numChunksWide(0),
+m_numChunksLong(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainDirtyRegions::~TerrainDirtyRegions()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainDirtyRegions::Create(int width, int length, int chunkQuads)
+{
+	this->Destroy();
+
+	if (width < 2 || length < 2 || chunkQuads < 1)
+		return false;
+
+	m_width = width;
+	m_length = length;
+	m_chunkQuads = chunkQuads;
+	m_numChunksWide = (width - 1 + chunkQuads - 1) / chunkQuads;
+	m_numChunksLong = (length - 1 + chunkQuads - 1) / chunkQuads;
+
+	m_dirtyChunkIndices.assign(size_t(m_numChunksWide) * m_numChunksLong, -1);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainDirtyRegions::Destroy()
+{
+	m_dirtyChunkIndices.clear();
+	m_dirtyChunks.clear();
+
+	m_width = 0;
+	m_length = 0;
+	m_numChunksWide = 0;
+	m_numChunksLong = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainDirtyRegions::GetNumChunksWide() const
+{
+	return m_numChunksWide;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainDirtyRegions::GetNumChunksLong() const
+{
+	return m_numChunksLong;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainDirtyRegions::Add(int minCol, int minRow, int maxCol, int maxRow)
+{
+	minCol = std::max(minCol, 0);
+	minRow = std::max(minRow, 0);
+	maxCol = std::min(maxCol, m_width - 1);
+	maxRow = std::min(maxRow, m_length - 1);
+
+	if (minCol > maxCol || minRow > maxRow)
+		return;
+
+	// A point on a chunk edge is in the chunks both sides of it.
+	int minChunkCol = minCol > 0 ? (minCol - 1) / m_chunkQuads : 0;
+	int minChunkRow = minRow > 0 ? (minRow - 1) / m_chunkQuads : 0;
+	int maxChunkCol = std::min(maxCol / m_chunkQuads, m_numChunksWide - 1);
+	int maxChunkRow = std::min(maxRow / m_chunkQuads, m_numChunksLong - 1);
+
+	for (int chunkRow = minChunkRow; chunkRow <= maxChunkRow; ++chunkRow)
+	{
+		for (int chunkCol = minChunkCol; chunkCol <= maxChunkCol; ++chunkCol)
+		{
+			size_t chunkIndex = size_t(chunkRow) * m_numChunksWide + chunkCol;
+
+			int chunkMinCol = chunkCol * m_chunkQuads;
+			int chunkMinRow = chunkRow * m_chunkQuads;
+
+			DirtyChunk rect;
+			rect.chunkIndex = chunkIndex;
+			rect.minCol = std::max(minCol, chunkMinCol);
+			rect.minRow = std::max(minRow, chunkMinRow);
+			rect.maxCol = std::min(maxCol, chunkMinCol + m_chunkQuads);
+			rect.maxRow = std::min(maxRow, chunkMinRow + m_chunkQuads);
+
+			int *pIndex = &m_dirtyChunkIndices[chunkIndex];
+
+			if (*pIndex < 0)
+			{
+				*pIndex = int(m_dirtyChunks.size());
+				m_dirtyChunks.push_back(rect);
+			}
+			else
+			{
+				DirtyChunk *pDirtyChunk = &m_dirtyChunks[*pIndex];
+
+				pDirtyChunk->minCol = std::min(pDirtyChunk->minCol, rect.minCol);
+				pDirtyChunk->minRow = std::min(pDirtyChunk->minRow, rect.minRow);
+				pDirtyChunk->maxCol = std::max(pDirtyChunk->maxCol, rect.maxCol);
+				pDirtyChunk->maxRow = std::max(pDirtyChunk->maxRow, rect.maxRow);
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainDirtyRegions::GetNumDirtyChunks() const
+{
+	return m_dirtyChunks.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainDirtyRegions::GetDirtyChunk(size_t i, size_t *pChunkIndex, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow) const
+{
+	assert(i < m_dirtyChunks.size());
+
+	const DirtyChunk *pDirtyChunk = &m_dirtyChunks[i];
+
+	*pChunkIndex = pDirtyChunk->chunkIndex;
+	*pMinCol = pDirtyChunk->minCol;
+	*pMinRow = pDirtyChunk->minRow;
+	*pMaxCol = pDirtyChunk->maxCol;
+	*pMaxRow = pDirtyChunk->maxRow;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainDirtyRegions::Clear()
+{
+	for (size_t i = 0; i < m_dirtyChunks.size(); ++i)
+		m_dirtyChunkIndices[m_dirtyChunks[i].chunkIndex] = -1;
+
+	m_dirtyChunks.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
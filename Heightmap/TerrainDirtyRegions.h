@@ -0,0 +1,83 @@
+#ifndef HEADER_B1BC75EBBE3141B2BDDC4D69AEBB1166
+#define HEADER_B1BC75EBBE3141B2BDDC4D69AEBB1166
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Keeps track of which parts of a chunked height map grid need
+// redoing.
+//
+// The chunks are laid out like TerrainMesh's: chunk (i, j) covers grid
+// columns i*chunkQuads to (i+1)*chunkQuads inclusive, and the same for
+// rows, so neighbouring chunks share their edge points and a change
+// there dirties both. Chunks are numbered row by row.
+//
+// Each dirty chunk has a rectangle covering everything added to it
+// since the last Clear. Adding and clearing only touch the chunks
+// involved, so the cost doesn't depend on the size of the grid.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainDirtyRegions
+{
+public:
+	TerrainDirtyRegions();
+	~TerrainDirtyRegions();
+
+	// width and length are in grid points.
+	bool Create(int width, int length, int chunkQuads);
+	void Destroy();
+
+	int GetNumChunksWide() const;
+	int GetNumChunksLong() const;
+
+	// The grid points from (minCol, minRow) to (maxCol, maxRow)
+	// inclusive need redoing. The rectangle is clipped to the grid.
+	void Add(int minCol, int minRow, int maxCol, int maxRow);
+
+	// Dirty chunks, in the order they were first dirtied.
+	size_t GetNumDirtyChunks() const;
+
+	// The dirty rectangle is within the chunk, in grid points.
+	void GetDirtyChunk(size_t i, size_t *pChunkIndex, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow) const;
+
+	void Clear();
+protected:
+private:
+	struct DirtyChunk
+	{
+		size_t chunkIndex;
+		int minCol;
+		int minRow;
+		int maxCol;
+		int maxRow;
+	};
+
+	int m_width;
+	int m_length;
+	int m_chunkQuads;
+	int m_numChunksWide;
+	int m_numChunksLong;
+
+	// Index into m_dirtyChunks for each chunk, or -1 if it's clean.
+	std::vector<int> m_dirtyChunkIndices;
+	std::vector<DirtyChunk> m_dirtyChunks;
+
+	TerrainDirtyRegions(const TerrainDirtyRegions &);
+	TerrainDirtyRegions &operator=(const TerrainDirtyRegions &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_B1BC75EBBE3141B2BDDC4D69AEBB1166
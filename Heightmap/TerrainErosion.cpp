@@ -0,0 +1,768 @@
+#include "TerrainErosion.h"
+#include "ParallelJobs.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_EROSION_SSE2 1
+#include <emmintrin.h>
+#else
+#define TERRAIN_EROSION_SSE2 0
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Below this depth, water is too shallow to have a sensible speed.
+static const float MIN_WATER_DEPTH = 1e-4f;
+
+// Thermal erosion neighbours, in the order they're always summed in
+// so the SSE2 and plain versions give the same results.
+static const int NUM_NEIGHBOURS = 8;
+static const int NEIGHBOUR_COLS[NUM_NEIGHBOURS] = {-1, 0, 1, -1, 1, -1, 0, 1};
+static const int NEIGHBOUR_ROWS[NUM_NEIGHBOURS] = {-1, -1, -1, 0, 0, 1, 1, 1};
+static const float NEIGHBOUR_DISTANCES[NUM_NEIGHBOURS] = {1.41421356f, 1.f, 1.41421356f, 1.f, 1.f, 1.41421356f, 1.f, 1.41421356f};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// All the threads wait here until the last one arrives.
+class TerrainErosion::Barrier
+{
+public:
+	explicit Barrier(size_t numThreads):
+	m_numThreads(numThreads),
+	m_numWaiting(0),
+	m_generation(0)
+	{
+	}
+
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		size_t generation = m_generation;
+
+		if (++m_numWaiting == m_numThreads)
+		{
+			m_numWaiting = 0;
+			++m_generation;
+			m_condition.notify_all();
+		}
+		else
+		{
+			while (m_generation == generation)
+				m_condition.wait(lock);
+		}
+	}
+protected:
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	size_t m_numThreads;
+	size_t m_numWaiting;
+	size_t m_generation;
+
+	Barrier(const Barrier &);
+	Barrier &operator=(const Barrier &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainErosionParams::TerrainErosionParams():
+timeStep(.02f),
+rainRate(.01f),
+evaporationRate(.5f),
+pipeFactor(9.81f),
+sedimentCapacity(1.f),
+dissolveRate(.3f),
+depositRate(.3f),
+minTilt(.05f),
+talusSlope(.8f),
+thermalRate(.1f)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainErosion::TerrainErosion():
+m_width(0),
+m_length(0),
+m_useSSE2(true)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainErosion::~TerrainErosion()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainErosion::Create(const float *pHeights, int width, int length, const TerrainErosionParams &params)
+{
+	this->Destroy();
+
+	if (width < 2 || length < 2)
+		return false;
+
+	m_params = params;
+	m_width = width;
+	m_length = length;
+
+	size_t numCells = size_t(width) * length;
+
+	m_terrain.assign(pHeights, pHeights + numCells);
+	m_water.assign(numCells, 0.f);
+	m_sediment.assign(numCells, 0.f);
+
+	m_fluxL.assign(numCells, 0.f);
+	m_fluxR.assign(numCells, 0.f);
+	m_fluxT.assign(numCells, 0.f);
+	m_fluxB.assign(numCells, 0.f);
+
+	m_terrainTemp.assign(numCells, 0.f);
+	m_sedimentTemp.assign(numCells, 0.f);
+	m_sedimentScale.assign(numCells, 0.f);
+	m_slippage.assign(numCells, 0.f);
+	m_slideShares.assign(numCells, 0.f);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainErosion::Destroy()
+{
+	std::vector<float> *pGrids[] = {
+		&m_terrain, &m_water, &m_sediment,
+		&m_fluxL, &m_fluxR, &m_fluxT, &m_fluxB,
+		&m_terrainTemp, &m_sedimentTemp,
+		&m_sedimentScale, &m_slippage, &m_slideShares,
+	};
+
+	for (size_t i = 0; i < sizeof pGrids / sizeof pGrids[0]; ++i)
+		std::vector<float>().swap(*pGrids[i]);
+
+	m_width = 0;
+	m_length = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainErosion::Run(int numIterations, unsigned maxNumThreads)
+{
+	if (m_terrain.empty() || numIterations <= 0)
+		return;
+
+	if (maxNumThreads == 0)
+	{
+		maxNumThreads = std::thread::hardware_concurrency();
+
+		if (maxNumThreads == 0)
+			maxNumThreads = 1;// unknown
+	}
+
+	// Every band needs a thread of its own, as they all wait for each
+	// other between passes.
+	size_t numBands = std::min(size_t(maxNumThreads), size_t(m_length));
+
+	Barrier barrier(numBands);
+
+	RunParallelJobs(numBands, unsigned(numBands), [&](size_t band, std::string *) -> bool {
+		int minRow = int(band * m_length / numBands);
+		int maxRow = int((band + 1) * m_length / numBands);
+
+		for (int i = 0; i < numIterations; ++i)
+		{
+			this->UpdateFlux(minRow, maxRow);
+			barrier.Wait();
+
+			this->UpdateWater(minRow, maxRow);
+			barrier.Wait();
+
+			this->MoveSediment(minRow, maxRow);
+			this->FindSlippage(minRow, maxRow);
+			barrier.Wait();
+
+			this->ApplySlippage(minRow, maxRow);
+			barrier.Wait();
+		}
+
+		return true;
+	}, NULL);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainErosion::SetUseSSE2(bool useSSE2)
+{
+	m_useSSE2 = useSSE2;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainErosion::GetWidth() const
+{
+	return m_width;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainErosion::GetLength() const
+{
+	return m_length;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const float *TerrainErosion::GetHeights() const
+{
+	return m_terrain.empty() ? NULL : &m_terrain[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const float *TerrainErosion::GetWaterDepths() const
+{
+	return m_water.empty() ? NULL : &m_water[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const float *TerrainErosion::GetSediment() const
+{
+	return m_sediment.empty() ? NULL : &m_sediment[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Pass 1: the flow through each cell's pipes, from the difference in
+// water level either end.
+void TerrainErosion::UpdateFlux(int minRow, int maxRow)
+{
+	for (int row = minRow; row < maxRow; ++row)
+	{
+		int col = 0;
+
+		if (row > 0 && row < m_length - 1)
+		{
+			this->UpdateFluxCell(col++, row);
+
+#if TERRAIN_EROSION_SSE2
+
+			const size_t width = size_t(m_width);
+
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.f);
+			const __m128 timeStep = _mm_set1_ps(m_params.timeStep);
+			const __m128 pipeFactor = _mm_set1_ps(m_params.timeStep * m_params.pipeFactor);
+			const __m128 rain = _mm_set1_ps(m_params.timeStep * m_params.rainRate);
+
+			for (; m_useSSE2 && col + 4 <= m_width - 1; col += 4)
+			{
+				size_t i = size_t(row) * width + size_t(col);
+
+				const float *pTerrain = &m_terrain[i];
+				const float *pWater = &m_water[i];
+
+				__m128 level = _mm_add_ps(_mm_loadu_ps(pTerrain), _mm_loadu_ps(pWater));
+
+				__m128 levelL = _mm_add_ps(_mm_loadu_ps(pTerrain - 1), _mm_loadu_ps(pWater - 1));
+				__m128 levelR = _mm_add_ps(_mm_loadu_ps(pTerrain + 1), _mm_loadu_ps(pWater + 1));
+				__m128 levelT = _mm_add_ps(_mm_loadu_ps(pTerrain - width), _mm_loadu_ps(pWater - width));
+				__m128 levelB = _mm_add_ps(_mm_loadu_ps(pTerrain + width), _mm_loadu_ps(pWater + width));
+
+				__m128 fluxL = _mm_max_ps(_mm_add_ps(_mm_loadu_ps(&m_fluxL[i]), _mm_mul_ps(pipeFactor, _mm_sub_ps(level, levelL))), zero);
+				__m128 fluxR = _mm_max_ps(_mm_add_ps(_mm_loadu_ps(&m_fluxR[i]), _mm_mul_ps(pipeFactor, _mm_sub_ps(level, levelR))), zero);
+				__m128 fluxT = _mm_max_ps(_mm_add_ps(_mm_loadu_ps(&m_fluxT[i]), _mm_mul_ps(pipeFactor, _mm_sub_ps(level, levelT))), zero);
+				__m128 fluxB = _mm_max_ps(_mm_add_ps(_mm_loadu_ps(&m_fluxB[i]), _mm_mul_ps(pipeFactor, _mm_sub_ps(level, levelB))), zero);
+
+				__m128 water = _mm_add_ps(_mm_loadu_ps(pWater), rain);
+				__m128 outflow = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(fluxL, fluxR), fluxT), fluxB), timeStep);
+
+				__m128 tooMuch = _mm_cmpgt_ps(outflow, water);
+				__m128 scale = _mm_or_ps(_mm_and_ps(tooMuch, _mm_div_ps(water, outflow)), _mm_andnot_ps(tooMuch, one));
+
+				_mm_storeu_ps(&m_fluxL[i], _mm_mul_ps(fluxL, scale));
+				_mm_storeu_ps(&m_fluxR[i], _mm_mul_ps(fluxR, scale));
+				_mm_storeu_ps(&m_fluxT[i], _mm_mul_ps(fluxT, scale));
+				_mm_storeu_ps(&m_fluxB[i], _mm_mul_ps(fluxB, scale));
+			}
+
+#endif
+		}
+
+		for (; col < m_width; ++col)
+			this->UpdateFluxCell(col, row);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainErosion::UpdateFluxCell(int col, int row)
+{
+	size_t i = size_t(row) * m_width + col;
+
+	float pipeFactor = m_params.timeStep * m_params.pipeFactor;
+	float level = m_terrain[i] + m_water[i];
+
+	// No pipes off the edge of the grid.
+	float fluxL = 0.f, fluxR = 0.f, fluxT = 0.f, fluxB = 0.f;
+
+	if (col > 0)
+		fluxL = std::max(m_fluxL[i] + pipeFactor * (level - (m_terrain[i - 1] + m_water[i - 1])), 0.f);
+
+	if (col < m_width - 1)
+		fluxR = std::max(m_fluxR[i] + pipeFactor * (level - (m_terrain[i + 1] + m_water[i + 1])), 0.f);
+
+	if (row > 0)
+		fluxT = std::max(m_fluxT[i] + pipeFactor * (level - (m_terrain[i - m_width] + m_water[i - m_width])), 0.f);
+
+	if (row < m_length - 1)
+		fluxB = std::max(m_fluxB[i] + pipeFactor * (level - (m_terrain[i + m_width] + m_water[i + m_width])), 0.f);
+
+	// Don't let more flow out than there is.
+	float water = m_water[i] + m_params.timeStep * m_params.rainRate;
+	float outflow = (fluxL + fluxR + fluxT + fluxB) * m_params.timeStep;
+	float scale = outflow > water ? water / outflow : 1.f;
+
+	m_fluxL[i] = fluxL * scale;
+	m_fluxR[i] = fluxR * scale;
+	m_fluxT[i] = fluxT * scale;
+	m_fluxB[i] = fluxB * scale;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Pass 2: the new water depth and speed, then erosion and deposition,
+// then evaporation.
+void TerrainErosion::UpdateWater(int minRow, int maxRow)
+{
+	for (int row = minRow; row < maxRow; ++row)
+	{
+		int col = 0;
+
+		if (row > 0 && row < m_length - 1)
+		{
+			this->UpdateWaterCell(col++, row);
+
+#if TERRAIN_EROSION_SSE2
+
+			const size_t width = size_t(m_width);
+
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 half = _mm_set1_ps(.5f);
+			const __m128 one = _mm_set1_ps(1.f);
+			const __m128 timeStep = _mm_set1_ps(m_params.timeStep);
+			const __m128 rain = _mm_set1_ps(m_params.timeStep * m_params.rainRate);
+			const __m128 minWater = _mm_set1_ps(MIN_WATER_DEPTH);
+			const __m128 minTilt = _mm_set1_ps(m_params.minTilt);
+			const __m128 capacityScale = _mm_set1_ps(m_params.sedimentCapacity);
+			const __m128 dissolveRate = _mm_set1_ps(m_params.dissolveRate);
+			const __m128 depositRate = _mm_set1_ps(m_params.depositRate);
+			const __m128 evaporation = _mm_set1_ps(1.f - m_params.evaporationRate * m_params.timeStep);
+
+			for (; m_useSSE2 && col + 4 <= m_width - 1; col += 4)
+			{
+				size_t i = size_t(row) * width + size_t(col);
+
+				__m128 fluxL = _mm_loadu_ps(&m_fluxL[i]);
+				__m128 fluxR = _mm_loadu_ps(&m_fluxR[i]);
+				__m128 fluxT = _mm_loadu_ps(&m_fluxT[i]);
+				__m128 fluxB = _mm_loadu_ps(&m_fluxB[i]);
+
+				__m128 inL = _mm_loadu_ps(&m_fluxR[i - 1]);
+				__m128 inR = _mm_loadu_ps(&m_fluxL[i + 1]);
+				__m128 inT = _mm_loadu_ps(&m_fluxB[i - width]);
+				__m128 inB = _mm_loadu_ps(&m_fluxT[i + width]);
+
+				__m128 inflow = _mm_add_ps(_mm_add_ps(_mm_add_ps(inL, inR), inT), inB);
+				__m128 outflow = _mm_add_ps(_mm_add_ps(_mm_add_ps(fluxL, fluxR), fluxT), fluxB);
+
+				__m128 water = _mm_add_ps(_mm_loadu_ps(&m_water[i]), rain);
+				__m128 newWater = _mm_max_ps(_mm_add_ps(water, _mm_mul_ps(timeStep, _mm_sub_ps(inflow, outflow))), zero);
+				__m128 meanWater = _mm_mul_ps(half, _mm_add_ps(water, newWater));
+
+				__m128 flowX = _mm_mul_ps(half, _mm_add_ps(_mm_sub_ps(inL, fluxL), _mm_sub_ps(fluxR, inR)));
+				__m128 flowY = _mm_mul_ps(half, _mm_add_ps(_mm_sub_ps(inT, fluxT), _mm_sub_ps(fluxB, inB)));
+
+				__m128 deepEnough = _mm_cmpgt_ps(meanWater, minWater);
+				__m128 velocityX = _mm_and_ps(deepEnough, _mm_div_ps(flowX, meanWater));
+				__m128 velocityY = _mm_and_ps(deepEnough, _mm_div_ps(flowY, meanWater));
+
+				const float *pTerrain = &m_terrain[i];
+
+				__m128 slopeX = _mm_mul_ps(half, _mm_sub_ps(_mm_loadu_ps(pTerrain + 1), _mm_loadu_ps(pTerrain - 1)));
+				__m128 slopeY = _mm_mul_ps(half, _mm_sub_ps(_mm_loadu_ps(pTerrain + width), _mm_loadu_ps(pTerrain - width)));
+				__m128 slopeSq = _mm_add_ps(_mm_mul_ps(slopeX, slopeX), _mm_mul_ps(slopeY, slopeY));
+				__m128 tilt = _mm_max_ps(_mm_sqrt_ps(_mm_div_ps(slopeSq, _mm_add_ps(one, slopeSq))), minTilt);
+
+				__m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(velocityX, velocityX), _mm_mul_ps(velocityY, velocityY)));
+				__m128 capacity = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(capacityScale, tilt), speed), newWater);
+
+				__m128 sediment = _mm_loadu_ps(&m_sediment[i]);
+				__m128 dissolving = _mm_cmpgt_ps(capacity, sediment);
+				__m128 rate = _mm_or_ps(_mm_and_ps(dissolving, dissolveRate), _mm_andnot_ps(dissolving, depositRate));
+				__m128 amount = _mm_mul_ps(rate, _mm_sub_ps(capacity, sediment));
+
+				_mm_storeu_ps(&m_terrainTemp[i], _mm_sub_ps(_mm_loadu_ps(pTerrain), amount));
+				_mm_storeu_ps(&m_sedimentTemp[i], _mm_add_ps(sediment, amount));
+				_mm_storeu_ps(&m_sedimentScale[i], _mm_and_ps(_mm_cmpgt_ps(water, zero), _mm_div_ps(timeStep, water)));
+				_mm_storeu_ps(&m_water[i], _mm_mul_ps(newWater, evaporation));
+			}
+
+#endif
+		}
+
+		for (; col < m_width; ++col)
+			this->UpdateWaterCell(col, row);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainErosion::UpdateWaterCell(int col, int row)
+{
+	size_t i = size_t(row) * m_width + col;
+
+	float fluxL = m_fluxL[i];
+	float fluxR = m_fluxR[i];
+	float fluxT = m_fluxT[i];
+	float fluxB = m_fluxB[i];
+
+	// Flow in from each neighbour, through its pipe facing this way.
+	float inL = col > 0 ? m_fluxR[i - 1] : 0.f;
+	float inR = col < m_width - 1 ? m_fluxL[i + 1] : 0.f;
+	float inT = row > 0 ? m_fluxB[i - m_width] : 0.f;
+	float inB = row < m_length - 1 ? m_fluxT[i + m_width] : 0.f;
+
+	float inflow = inL + inR + inT + inB;
+	float outflow = fluxL + fluxR + fluxT + fluxB;
+
+	float water = m_water[i] + m_params.timeStep * m_params.rainRate;
+	float newWater = std::max(water + m_params.timeStep * (inflow - outflow), 0.f);
+	float meanWater = .5f * (water + newWater);
+
+	float flowX = .5f * ((inL - fluxL) + (fluxR - inR));
+	float flowY = .5f * ((inT - fluxT) + (fluxB - inB));
+
+	float velocityX = 0.f, velocityY = 0.f;
+
+	if (meanWater > MIN_WATER_DEPTH)
+	{
+		velocityX = flowX / meanWater;
+		velocityY = flowY / meanWater;
+	}
+
+	size_t left = col > 0 ? i - 1 : i;
+	size_t right = col < m_width - 1 ? i + 1 : i;
+	size_t top = row > 0 ? i - m_width : i;
+	size_t bottom = row < m_length - 1 ? i + m_width : i;
+
+	float slopeX = .5f * (m_terrain[right] - m_terrain[left]);
+	float slopeY = .5f * (m_terrain[bottom] - m_terrain[top]);
+	float slopeSq = slopeX * slopeX + slopeY * slopeY;
+	float tilt = std::max(sqrtf(slopeSq / (1.f + slopeSq)), m_params.minTilt);
+
+	float speed = sqrtf(velocityX * velocityX + velocityY * velocityY);
+	// Shallow water can't carry much, however fast it's going.
+	float capacity = m_params.sedimentCapacity * tilt * speed * newWater;
+
+	// Pick up sediment if there's room for more, drop it if not.
+	float sediment = m_sediment[i];
+	float rate = capacity > sediment ? m_params.dissolveRate : m_params.depositRate;
+	float amount = rate * (capacity - sediment);
+
+	m_terrainTemp[i] = m_terrain[i] - amount;
+	m_sedimentTemp[i] = sediment + amount;
+	m_sedimentScale[i] = water > 0.f ? m_params.timeStep / water : 0.f;
+	m_water[i] = newWater * (1.f - m_params.evaporationRate * m_params.timeStep);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Pass 3: the sediment goes through the pipes in proportion to the
+// water, so none is lost or made on the way.
+void TerrainErosion::MoveSediment(int minRow, int maxRow)
+{
+	for (int row = minRow; row < maxRow; ++row)
+	{
+		int col = 0;
+
+		if (row > 0 && row < m_length - 1)
+		{
+			this->MoveSedimentCell(col++, row);
+
+#if TERRAIN_EROSION_SSE2
+
+			const size_t width = size_t(m_width);
+
+			const __m128 one = _mm_set1_ps(1.f);
+
+			for (; m_useSSE2 && col + 4 <= m_width - 1; col += 4)
+			{
+				size_t i = size_t(row) * width + size_t(col);
+
+				__m128 outflow = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_loadu_ps(&m_fluxL[i]), _mm_loadu_ps(&m_fluxR[i])), _mm_loadu_ps(&m_fluxT[i])), _mm_loadu_ps(&m_fluxB[i]));
+				__m128 leaving = _mm_min_ps(_mm_mul_ps(outflow, _mm_loadu_ps(&m_sedimentScale[i])), one);
+
+				__m128 inL = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&m_sedimentTemp[i - 1]), _mm_loadu_ps(&m_fluxR[i - 1])), _mm_loadu_ps(&m_sedimentScale[i - 1]));
+				__m128 inR = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&m_sedimentTemp[i + 1]), _mm_loadu_ps(&m_fluxL[i + 1])), _mm_loadu_ps(&m_sedimentScale[i + 1]));
+				__m128 inT = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&m_sedimentTemp[i - width]), _mm_loadu_ps(&m_fluxB[i - width])), _mm_loadu_ps(&m_sedimentScale[i - width]));
+				__m128 inB = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&m_sedimentTemp[i + width]), _mm_loadu_ps(&m_fluxT[i + width])), _mm_loadu_ps(&m_sedimentScale[i + width]));
+
+				__m128 sediment = _mm_loadu_ps(&m_sedimentTemp[i]);
+				__m128 staying = _mm_sub_ps(sediment, _mm_mul_ps(sediment, leaving));
+
+				_mm_storeu_ps(&m_sediment[i], _mm_add_ps(staying, _mm_add_ps(_mm_add_ps(_mm_add_ps(inL, inR), inT), inB)));
+			}
+
+#endif
+		}
+
+		for (; col < m_width; ++col)
+			this->MoveSedimentCell(col, row);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainErosion::MoveSedimentCell(int col, int row)
+{
+	size_t i = size_t(row) * m_width + col;
+
+	float outflow = m_fluxL[i] + m_fluxR[i] + m_fluxT[i] + m_fluxB[i];
+
+	// UpdateFlux made sure it's at most 1, but there's rounding.
+	float leaving = std::min(outflow * m_sedimentScale[i], 1.f);
+
+	float inL = 0.f, inR = 0.f, inT = 0.f, inB = 0.f;
+
+	if (col > 0)
+		inL = m_sedimentTemp[i - 1] * m_fluxR[i - 1] * m_sedimentScale[i - 1];
+
+	if (col < m_width - 1)
+		inR = m_sedimentTemp[i + 1] * m_fluxL[i + 1] * m_sedimentScale[i + 1];
+
+	if (row > 0)
+		inT = m_sedimentTemp[i - m_width] * m_fluxB[i - m_width] * m_sedimentScale[i - m_width];
+
+	if (row < m_length - 1)
+		inB = m_sedimentTemp[i + m_width] * m_fluxT[i + m_width] * m_sedimentScale[i + m_width];
+
+	float sediment = m_sedimentTemp[i];
+
+	m_sediment[i] = (sediment - sediment * leaving) + (inL + inR + inT + inB);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Pass 4: how much material slides off each cell. Each neighbour gets
+// a share in proportion to how far over the talus slope it is.
+void TerrainErosion::FindSlippage(int minRow, int maxRow)
+{
+	for (int row = minRow; row < maxRow; ++row)
+	{
+		int col = 0;
+
+		if (row > 0 && row < m_length - 1)
+		{
+			this->FindSlippageCell(col++, row);
+
+#if TERRAIN_EROSION_SSE2
+
+			const size_t width = size_t(m_width);
+
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 halfRate = _mm_set1_ps(m_params.thermalRate * .5f);
+
+			__m128 talus[NUM_NEIGHBOURS];
+			ptrdiff_t offsets[NUM_NEIGHBOURS];
+
+			for (int j = 0; j < NUM_NEIGHBOURS; ++j)
+			{
+				talus[j] = _mm_set1_ps(m_params.talusSlope * NEIGHBOUR_DISTANCES[j]);
+				offsets[j] = ptrdiff_t(NEIGHBOUR_ROWS[j]) * ptrdiff_t(width) + NEIGHBOUR_COLS[j];
+			}
+
+			for (; m_useSSE2 && col + 4 <= m_width - 1; col += 4)
+			{
+				size_t i = size_t(row) * width + size_t(col);
+
+				const float *pTerrain = &m_terrainTemp[i];
+
+				__m128 height = _mm_loadu_ps(pTerrain);
+				__m128 totalExcess = zero;
+				__m128 maxExcess = zero;
+
+				for (int j = 0; j < NUM_NEIGHBOURS; ++j)
+				{
+					__m128 excess = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(height, _mm_loadu_ps(pTerrain + offsets[j])), talus[j]), zero);
+
+					totalExcess = _mm_add_ps(totalExcess, excess);
+					maxExcess = _mm_max_ps(maxExcess, excess);
+				}
+
+				__m128 slippage = _mm_mul_ps(halfRate, maxExcess);
+				__m128 sliding = _mm_cmpgt_ps(totalExcess, zero);
+
+				_mm_storeu_ps(&m_slideShares[i], _mm_and_ps(sliding, _mm_div_ps(slippage, totalExcess)));
+				_mm_storeu_ps(&m_slippage[i], slippage);
+			}
+
+#endif
+		}
+
+		for (; col < m_width; ++col)
+			this->FindSlippageCell(col, row);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainErosion::FindSlippageCell(int col, int row)
+{
+	size_t i = size_t(row) * m_width + col;
+
+	float height = m_terrainTemp[i];
+	float totalExcess = 0.f;
+	float maxExcess = 0.f;
+
+	for (int j = 0; j < NUM_NEIGHBOURS; ++j)
+	{
+		int neighbourCol = col + NEIGHBOUR_COLS[j];
+		int neighbourRow = row + NEIGHBOUR_ROWS[j];
+
+		if (neighbourCol < 0 || neighbourCol >= m_width || neighbourRow < 0 || neighbourRow >= m_length)
+			continue;
+
+		float neighbourHeight = m_terrainTemp[size_t(neighbourRow) * m_width + neighbourCol];
+		float excess = std::max(height - neighbourHeight - m_params.talusSlope * NEIGHBOUR_DISTANCES[j], 0.f);
+
+		totalExcess += excess;
+		maxExcess = std::max(maxExcess, excess);
+	}
+
+	// Moving half the biggest excess levels that slope off.
+	float slippage = m_params.thermalRate * .5f * maxExcess;
+
+	m_slideShares[i] = totalExcess > 0.f ? slippage / totalExcess : 0.f;
+	m_slippage[i] = slippage;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Pass 5: each cell loses what slid off it and gains what slid onto it
+// from its neighbours.
+void TerrainErosion::ApplySlippage(int minRow, int maxRow)
+{
+	for (int row = minRow; row < maxRow; ++row)
+	{
+		int col = 0;
+
+		if (row > 0 && row < m_length - 1)
+		{
+			this->ApplySlippageCell(col++, row);
+
+#if TERRAIN_EROSION_SSE2
+
+			const size_t width = size_t(m_width);
+
+			const __m128 zero = _mm_setzero_ps();
+
+			__m128 talus[NUM_NEIGHBOURS];
+			ptrdiff_t offsets[NUM_NEIGHBOURS];
+
+			for (int j = 0; j < NUM_NEIGHBOURS; ++j)
+			{
+				talus[j] = _mm_set1_ps(m_params.talusSlope * NEIGHBOUR_DISTANCES[j]);
+				offsets[j] = ptrdiff_t(NEIGHBOUR_ROWS[j]) * ptrdiff_t(width) + NEIGHBOUR_COLS[j];
+			}
+
+			for (; m_useSSE2 && col + 4 <= m_width - 1; col += 4)
+			{
+				size_t i = size_t(row) * width + size_t(col);
+
+				const float *pTerrain = &m_terrainTemp[i];
+				const float *pShares = &m_slideShares[i];
+
+				__m128 height = _mm_loadu_ps(pTerrain);
+				__m128 gained = zero;
+
+				for (int j = 0; j < NUM_NEIGHBOURS; ++j)
+				{
+					__m128 excess = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(pTerrain + offsets[j]), height), talus[j]), zero);
+
+					gained = _mm_add_ps(gained, _mm_mul_ps(_mm_loadu_ps(pShares + offsets[j]), excess));
+				}
+
+				_mm_storeu_ps(&m_terrain[i], _mm_add_ps(_mm_sub_ps(height, _mm_loadu_ps(&m_slippage[i])), gained));
+			}
+
+#endif
+		}
+
+		for (; col < m_width; ++col)
+			this->ApplySlippageCell(col, row);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainErosion::ApplySlippageCell(int col, int row)
+{
+	size_t i = size_t(row) * m_width + col;
+
+	float height = m_terrainTemp[i];
+	float gained = 0.f;
+
+	for (int j = 0; j < NUM_NEIGHBOURS; ++j)
+	{
+		int neighbourCol = col + NEIGHBOUR_COLS[j];
+		int neighbourRow = row + NEIGHBOUR_ROWS[j];
+
+		if (neighbourCol < 0 || neighbourCol >= m_width || neighbourRow < 0 || neighbourRow >= m_length)
+			continue;
+
+		size_t neighbour = size_t(neighbourRow) * m_width + neighbourCol;
+
+		// The neighbour's excess over this cell.
+		float excess = std::max(m_terrainTemp[neighbour] - height - m_params.talusSlope * NEIGHBOUR_DISTANCES[j], 0.f);
+
+		gained += m_slideShares[neighbour] * excess;
+	}
+
+	m_terrain[i] = (height - m_slippage[i]) + gained;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,156 @@
+#ifndef HEADER_C3CDC9FD35F046A6A4795AB534DC9D69
+#define HEADER_C3CDC9FD35F046A6A4795AB534DC9D69
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Hydraulic and thermal erosion of a height grid.
+//
+// Hydraulic erosion is the grid based "virtual pipes" model (Mei,
+// Decaudin and Hu, "Fast Hydraulic Erosion Simulation and
+// Visualization on GPU"). Rain falls on every cell; water flows to the
+// 4 neighbours through pipes, driven by the difference in water level;
+// running water picks up sediment in proportion to its speed and the
+// slope, drops it where it slows down, and carries it along the
+// pipes with the water. Thermal erosion then moves material down any slope steeper
+// than the talus slope, to the 8 neighbours.
+//
+// Each pass over the grid only reads what earlier passes wrote, so
+// the cells can be done in any order. Run splits the rows into one
+// band per thread, and the results are the same, bit for bit, however
+// many threads there are. The passes work along each row 4 cells at a
+// time with SSE2 where it's available; SetUseSSE2(false) does them one
+// at a time instead, for comparing the two.
+//
+// Heights and water depths are in the grid's own units, and the grid
+// spacing is 1.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TerrainErosionParams
+{
+	// Simulated time per iteration.
+	float timeStep;
+
+	// Water depth added per unit time.
+	float rainRate;
+
+	// Fraction of the water that evaporates per unit time.
+	float evaporationRate;
+
+	// Gravity times pipe cross section over pipe length.
+	float pipeFactor;
+
+	// Sediment a unit of water moving at unit speed down a vertical
+	// slope could carry.
+	float sedimentCapacity;
+
+	// Fractions of the difference between the capacity and the sediment
+	// carried that are picked up, or dropped, per iteration.
+	float dissolveRate;
+	float depositRate;
+
+	// Flat ground still erodes a little, as if it had this much slope.
+	// (It's the sine of the slope angle.)
+	float minTilt;
+
+	// Height difference per unit distance above which material slides.
+	float talusSlope;
+
+	// Fraction of the excess slope that slides per iteration, 0 to 1.
+	float thermalRate;
+
+	// Sets reasonable defaults for heights of up to a few tens of units.
+	TerrainErosionParams();
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainErosion
+{
+public:
+	TerrainErosion();
+	~TerrainErosion();
+
+	// pHeights is width*length heights, row by row.
+	bool Create(const float *pHeights, int width, int length, const TerrainErosionParams &params);
+	void Destroy();
+
+	// Runs numIterations iterations on up to maxNumThreads threads (0
+	// means one per hardware thread).
+	void Run(int numIterations, unsigned maxNumThreads);
+
+	// On by default. Does nothing where there's no SSE2.
+	void SetUseSSE2(bool useSSE2);
+
+	int GetWidth() const;
+	int GetLength() const;
+
+	// width*length values, row by row.
+	const float *GetHeights() const;
+	const float *GetWaterDepths() const;
+	const float *GetSediment() const;
+protected:
+private:
+	class Barrier;
+
+	TerrainErosionParams m_params;
+	int m_width;
+	int m_length;
+	bool m_useSSE2;
+
+	std::vector<float> m_terrain;
+	std::vector<float> m_water;
+	std::vector<float> m_sediment;
+
+	// Outflow through the left, right, top (row - 1) and bottom (row +
+	// 1) pipes.
+	std::vector<float> m_fluxL;
+	std::vector<float> m_fluxR;
+	std::vector<float> m_fluxT;
+	std::vector<float> m_fluxB;
+
+	// Between passes.
+	std::vector<float> m_terrainTemp;
+	std::vector<float> m_sedimentTemp;
+
+	// Fraction of a cell's sediment that goes with each unit of outflow.
+	std::vector<float> m_sedimentScale;
+
+	// Material sliding off each cell, in total and per unit of excess
+	// slope.
+	std::vector<float> m_slippage;
+	std::vector<float> m_slideShares;
+
+	// Each pass does rows minRow to maxRow - 1.
+	void UpdateFlux(int minRow, int maxRow);
+	void UpdateWater(int minRow, int maxRow);
+	void MoveSediment(int minRow, int maxRow);
+	void FindSlippage(int minRow, int maxRow);
+	void ApplySlippage(int minRow, int maxRow);
+
+	void UpdateFluxCell(int col, int row);
+	void UpdateWaterCell(int col, int row);
+	void MoveSedimentCell(int col, int row);
+	void FindSlippageCell(int col, int row);
+	void ApplySlippageCell(int col, int row);
+
+	TerrainErosion(const TerrainErosion &);
+	TerrainErosion &operator=(const TerrainErosion &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_C3CDC9FD35F046A6A4795AB534DC9D69
@@ -0,0 +1,444 @@
+#include "TerrainGrid.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_GRID_SSE2 1
+#include <emmintrin.h>
+#else
+#define TERRAIN_GRID_SSE2 0
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainGrid::TerrainGrid():
+m_width(0),
+m_length(0),
+m_pitch(0),
+m_originX(0.f),
+m_originZ(0.f),
+m_stepX(1.f),
+m_stepZ(1.f),
+m_pHeights(NULL),
+m_pNormalsX(NULL),
+m_pNormalsY(NULL),
+m_pNormalsZ(NULL)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainGrid::~TerrainGrid()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainGrid::Create(int width, int length, float originX, float originZ, float stepX, float stepZ)
+{
+	this->Destroy();
+
+	if (width < 2 || length < 2 || stepX == 0.f || stepZ == 0.f)
+		return false;
+
+	m_width = width;
+	m_length = length;
+	m_pitch = (size_t(width) + 3) & ~size_t(3);
+
+	m_originX = originX;
+	m_originZ = originZ;
+	m_stepX = stepX;
+	m_stepZ = stepZ;
+
+	// The 4 arrays are one after the other, with room to move the first
+	// up to a 16 byte boundary. Each is a whole number of rows long, so
+	// the rest end up on one too.
+	size_t planeSize = m_pitch * length;
+
+	m_storage.resize(planeSize * 4 + 3);
+
+	uintptr_t base = uintptr_t(&m_storage[0]);
+	size_t firstIndex = size_t(((base + 15) & ~uintptr_t(15)) - base) / sizeof(float);
+
+	m_pHeights = &m_storage[firstIndex];
+	m_pNormalsX = m_pHeights + planeSize;
+	m_pNormalsY = m_pNormalsX + planeSize;
+	m_pNormalsZ = m_pNormalsY + planeSize;
+
+	std::fill(m_pNormalsY, m_pNormalsY + planeSize, 1.f);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainGrid::Destroy()
+{
+	std::vector<float>().swap(m_storage);
+
+	m_width = 0;
+	m_length = 0;
+	m_pitch = 0;
+
+	m_pHeights = NULL;
+	m_pNormalsX = NULL;
+	m_pNormalsY = NULL;
+	m_pNormalsZ = NULL;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainGrid::GetWidth() const
+{
+	return m_width;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainGrid::GetLength() const
+{
+	return m_length;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainGrid::GetPitch() const
+{
+	return m_pitch;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float TerrainGrid::GetOriginX() const
+{
+	return m_originX;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float TerrainGrid::GetOriginZ() const
+{
+	return m_originZ;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float TerrainGrid::GetColumnStepX() const
+{
+	return m_stepX;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float TerrainGrid::GetRowStepZ() const
+{
+	return m_stepZ;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const float *TerrainGrid::GetHeights() const
+{
+	return m_pHeights;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const float *TerrainGrid::GetNormalsX() const
+{
+	return m_pNormalsX;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const float *TerrainGrid::GetNormalsY() const
+{
+	return m_pNormalsY;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const float *TerrainGrid::GetNormalsZ() const
+{
+	return m_pNormalsZ;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainGrid::SetHeights(int minCol, int minRow, int maxCol, int maxRow, const float *pHeights, size_t srcPitch)
+{
+	assert(minCol >= 0 && maxCol < m_width && minCol <= maxCol);
+	assert(minRow >= 0 && maxRow < m_length && minRow <= maxRow);
+
+	size_t numCols = size_t(maxCol - minCol + 1);
+
+	for (int row = minRow; row <= maxRow; ++row)
+	{
+		std::copy(pHeights, pHeights + numCols, m_pHeights + row * m_pitch + minCol);
+		pHeights += srcPitch;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainGrid::SetNormals(int minCol, int minRow, int maxCol, int maxRow, const float *pXs, const float *pYs, const float *pZs, size_t srcPitch)
+{
+	assert(minCol >= 0 && maxCol < m_width && minCol <= maxCol);
+	assert(minRow >= 0 && maxRow < m_length && minRow <= maxRow);
+
+	size_t numCols = size_t(maxCol - minCol + 1);
+
+	for (int row = minRow; row <= maxRow; ++row)
+	{
+		size_t dest = row * m_pitch + minCol;
+
+		std::copy(pXs, pXs + numCols, m_pNormalsX + dest);
+		std::copy(pYs, pYs + numCols, m_pNormalsY + dest);
+		std::copy(pZs, pZs + numCols, m_pNormalsZ + dest);
+
+		pXs += srcPitch;
+		pYs += srcPitch;
+		pZs += srcPitch;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Summing the 6 triangles around a point that isn't on the edge, the
+// height of the point itself cancels out, and what's left is the same
+// handful of neighbours for every point. So whole rows can be done 4
+// at a time; only the first and last rows and columns need the quads
+// looking at one by one.
+void TerrainGrid::CalculateNormals(int minCol, int minRow, int maxCol, int maxRow)
+{
+	if (m_storage.empty())
+		return;
+
+	minCol = std::max(minCol - 1, 0);
+	minRow = std::max(minRow - 1, 0);
+	maxCol = std::min(maxCol + 1, m_width - 1);
+	maxRow = std::min(maxRow + 1, m_length - 1);
+
+	const float sx = m_stepX;
+	const float sz = m_stepZ;
+	const float ny = -6.f * sx * sz;
+
+	for (int row = minRow; row <= maxRow; ++row)
+	{
+		if (row == 0 || row == m_length - 1)
+		{
+			for (int col = minCol; col <= maxCol; ++col)
+				this->CalculatePointNormal(col, row);
+
+			continue;
+		}
+
+		const float *pUp = m_pHeights + (row - 1) * m_pitch;
+		const float *pMid = pUp + m_pitch;
+		const float *pDown = pMid + m_pitch;
+
+		size_t rowStart = row * m_pitch;
+		float *pXs = m_pNormalsX + rowStart;
+		float *pYs = m_pNormalsY + rowStart;
+		float *pZs = m_pNormalsZ + rowStart;
+
+		int col = minCol;
+
+		if (col == 0)
+			this->CalculatePointNormal(col++, row);
+
+		int lastInteriorCol = std::min(maxCol, m_width - 2);
+
+#if TERRAIN_GRID_SSE2
+
+		// Up to a 16 byte boundary one by one, then 4 at a time.
+		for (; col <= lastInteriorCol && (col & 3) != 0; ++col)
+			this->CalculatePointNormal(col, row);
+
+		const __m128 vSX = _mm_set1_ps(sx);
+		const __m128 vSZ = _mm_set1_ps(sz);
+		const __m128 vNY = _mm_set1_ps(ny);
+		const __m128 vNYSquared = _mm_set1_ps(ny * ny);
+		const __m128 one = _mm_set1_ps(1.f);
+
+		for (; col + 3 <= lastInteriorCol; col += 4)
+		{
+			__m128 upLeft = _mm_loadu_ps(pUp + col - 1);
+			__m128 up = _mm_load_ps(pUp + col);
+			__m128 midLeft = _mm_loadu_ps(pMid + col - 1);
+			__m128 midRight = _mm_loadu_ps(pMid + col + 1);
+			__m128 down = _mm_load_ps(pDown + col);
+			__m128 downRight = _mm_loadu_ps(pDown + col + 1);
+
+			__m128 nx = _mm_sub_ps(up, upLeft);
+			nx = _mm_add_ps(nx, _mm_add_ps(_mm_sub_ps(midRight, midLeft), _mm_sub_ps(midRight, midLeft)));
+			nx = _mm_add_ps(nx, _mm_sub_ps(downRight, down));
+			nx = _mm_mul_ps(nx, vSZ);
+
+			__m128 nz = _mm_add_ps(_mm_sub_ps(down, up), _mm_sub_ps(down, up));
+			nz = _mm_add_ps(nz, _mm_sub_ps(midLeft, upLeft));
+			nz = _mm_add_ps(nz, _mm_sub_ps(downRight, midRight));
+			nz = _mm_mul_ps(nz, vSX);
+
+			// ny is never 0, so neither is the length.
+			__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(nz, nz)), vNYSquared);
+			__m128 scale = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+
+			_mm_store_ps(pXs + col, _mm_mul_ps(nx, scale));
+			_mm_store_ps(pYs + col, _mm_mul_ps(vNY, scale));
+			_mm_store_ps(pZs + col, _mm_mul_ps(nz, scale));
+		}
+
+#endif
+
+		for (; col <= lastInteriorCol; ++col)
+		{
+			float nx = sz * ((pUp[col] - pUp[col - 1]) + 2.f * (pMid[col + 1] - pMid[col - 1]) + (pDown[col + 1] - pDown[col]));
+			float nz = sx * (2.f * (pDown[col] - pUp[col]) + (pMid[col - 1] - pUp[col - 1]) + (pDown[col + 1] - pMid[col + 1]));
+
+			float scale = 1.f / sqrtf(nx * nx + ny * ny + nz * nz);
+
+			pXs[col] = nx * scale;
+			pYs[col] = ny * scale;
+			pZs[col] = nz * scale;
+		}
+
+		if (col == m_width - 1 && col <= maxCol)
+			this->CalculatePointNormal(col, row);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainGrid::GetHeightRange(int minCol, int minRow, int maxCol, int maxRow, float *pMinHeight, float *pMaxHeight) const
+{
+	assert(minCol >= 0 && maxCol < m_width && minCol <= maxCol);
+	assert(minRow >= 0 && maxRow < m_length && minRow <= maxRow);
+
+	float minHeight = FLT_MAX;
+	float maxHeight = -FLT_MAX;
+
+#if TERRAIN_GRID_SSE2
+	__m128 vMin = _mm_set1_ps(FLT_MAX);
+	__m128 vMax = _mm_set1_ps(-FLT_MAX);
+#endif
+
+	for (int row = minRow; row <= maxRow; ++row)
+	{
+		const float *pRow = m_pHeights + row * m_pitch;
+
+		int col = minCol;
+
+#if TERRAIN_GRID_SSE2
+		for (; col + 3 <= maxCol; col += 4)
+		{
+			__m128 heights = _mm_loadu_ps(pRow + col);
+
+			vMin = _mm_min_ps(vMin, heights);
+			vMax = _mm_max_ps(vMax, heights);
+		}
+#endif
+
+		for (; col <= maxCol; ++col)
+		{
+			minHeight = std::min(minHeight, pRow[col]);
+			maxHeight = std::max(maxHeight, pRow[col]);
+		}
+	}
+
+#if TERRAIN_GRID_SSE2
+	float mins[4], maxs[4];
+	_mm_storeu_ps(mins, vMin);
+	_mm_storeu_ps(maxs, vMax);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		minHeight = std::min(minHeight, mins[i]);
+		maxHeight = std::max(maxHeight, maxs[i]);
+	}
+#endif
+
+	*pMinHeight = minHeight;
+	*pMaxHeight = maxHeight;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The sum of the (area weighted) normals of the triangles around the
+// point, normalised. Each quad is triangles (a, b, d) and (a, d, c),
+// as TerrainMesh draws them.
+void TerrainGrid::CalculatePointNormal(int col, int row)
+{
+	const float sx = m_stepX;
+	const float sz = m_stepZ;
+
+	float sum[3] = {0.f, 0.f, 0.f};
+
+	// Quads to the top left, top right, bottom left and bottom right.
+	// The point is corner d, c, b and a respectively.
+	for (int quadRow = std::max(row - 1, 0); quadRow <= std::min(row, m_length - 2); ++quadRow)
+	{
+		for (int quadCol = std::max(col - 1, 0); quadCol <= std::min(col, m_width - 2); ++quadCol)
+		{
+			const float *pA = m_pHeights + quadRow * m_pitch + quadCol;
+
+			float ha = pA[0];
+			float hb = pA[1];
+			float hc = pA[m_pitch];
+			float hd = pA[m_pitch + 1];
+
+			bool isLeft = quadCol == col;
+			bool isTop = quadRow == row;
+
+			// Corner b is only in the first triangle, c only in the second.
+			if (!isLeft || isTop)
+			{
+				sum[0] += (hb - ha) * sz;
+				sum[1] -= sx * sz;
+				sum[2] += (hd - hb) * sx;
+			}
+
+			if (isLeft || !isTop)
+			{
+				sum[0] += (hd - hc) * sz;
+				sum[1] -= sx * sz;
+				sum[2] += (hc - ha) * sx;
+			}
+		}
+	}
+
+	float length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+	size_t point = row * m_pitch + col;
+
+	m_pNormalsX[point] = sum[0] / length;
+	m_pNormalsY[point] = sum[1] / length;
+	m_pNormalsZ[point] = sum[2] / length;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,110 @@
+#ifndef HEADER_E8A5DA338132417AA7022166AEBE55B8
+#define HEADER_E8A5DA338132417AA7022166AEBE55B8
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// The CPU side copy of a terrain grid, kept as separate arrays of
+// heights and of normal x, y and z, rather than as an array of
+// positions and one of normals. The positions aren't stored at all:
+// x and z go up by a fixed step from one column, or row, to the next,
+// so only the heights are needed.
+//
+// Each array is row by row, with every row starting on a 16 byte
+// boundary and padded out to a multiple of 4 floats (GetPitch), so 4
+// neighbouring grid points load straight into an SSE register. What's
+// in the padding is undefined.
+//
+// CalculateNormals works out the normals of a rectangle of points from
+// the heights, from the same two triangles per quad that TerrainMesh
+// draws. Away from the edges of the grid that's 4 points at a time
+// with SSE2, where it's available.
+//
+// The interleaved vertices are only made when they're uploaded, by
+// TerrainMesh.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainGrid
+{
+public:
+	TerrainGrid();
+	~TerrainGrid();
+
+	// (originX, originZ) is the position of column 0, row 0. The steps
+	// may be negative. The heights are 0 and the normals point up.
+	bool Create(int width, int length, float originX, float originZ, float stepX, float stepZ);
+	void Destroy();
+
+	int GetWidth() const;
+	int GetLength() const;
+
+	// Floats from the start of one row to the start of the next.
+	size_t GetPitch() const;
+
+	float GetOriginX() const;
+	float GetOriginZ() const;
+	float GetColumnStepX() const;
+	float GetRowStepZ() const;
+
+	const float *GetHeights() const;
+	const float *GetNormalsX() const;
+	const float *GetNormalsY() const;
+	const float *GetNormalsZ() const;
+
+	// Replace the heights of the grid points from (minCol, minRow) to
+	// (maxCol, maxRow) inclusive, from a grid whose rows start srcPitch
+	// floats apart. pHeights is the rectangle's top left point. The
+	// normals are left alone.
+	void SetHeights(int minCol, int minRow, int maxCol, int maxRow, const float *pHeights, size_t srcPitch);
+
+	// The same for the normals, for grids whose normals depend on
+	// something else (see TerrainWorld).
+	void SetNormals(int minCol, int minRow, int maxCol, int maxRow, const float *pXs, const float *pYs, const float *pZs, size_t srcPitch);
+
+	// Works out the normals of the points whose heights have changed
+	// from (minCol, minRow) to (maxCol, maxRow), and the points next to
+	// them, whose triangles have changed too.
+	void CalculateNormals(int minCol, int minRow, int maxCol, int maxRow);
+
+	// Lowest and highest heights in the rectangle.
+	void GetHeightRange(int minCol, int minRow, int maxCol, int maxRow, float *pMinHeight, float *pMaxHeight) const;
+protected:
+private:
+	std::vector<float> m_storage;
+	int m_width;
+	int m_length;
+	size_t m_pitch;
+
+	float m_originX;
+	float m_originZ;
+	float m_stepX;
+	float m_stepZ;
+
+	// Aligned, in m_storage.
+	float *m_pHeights;
+	float *m_pNormalsX;
+	float *m_pNormalsY;
+	float *m_pNormalsZ;
+
+	// The normal at one point, anywhere on the grid.
+	void CalculatePointNormal(int col, int row);
+
+	TerrainGrid(const TerrainGrid &);
+	TerrainGrid &operator=(const TerrainGrid &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_E8A5DA338132417AA7022166AEBE55B8
@@ -0,0 +1,438 @@
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <d3d11.h>
+
+#include "TerrainMesh.h"
+#include "VertexCacheOptimiser.h"
+
+#include <assert.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainMesh::TerrainMesh():
+m_pPool(NULL),
+m_width(0),
+m_length(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainMesh::~TerrainMesh()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainMesh::Create(TerrainMeshPool *pPool, ID3D11DeviceContext *pContext, UploadRing *pUploadRing, LinearArena *pArena, const TerrainGrid *pGrid, VertexColour colour)
+{
+	this->Destroy();
+
+	int width = pGrid->GetWidth();
+	int length = pGrid->GetLength();
+
+	if (width < 2 || length < 2)
+		return false;
+
+	m_pPool = pPool;
+	m_width = width;
+	m_length = length;
+	m_colour = colour;
+
+	if (!m_dirtyRegions.Create(width, length, CHUNK_QUADS))
+		return false;
+
+	// Each chunk's vertices only need to be kept until they've been
+	// uploaded.
+	LinearArenaMarker arenaMarker = pArena->GetMarker();
+
+	Vertex_Pos3fColour4ubNormal3f *pVtxs = pArena->AllocateArray<Vertex_Pos3fColour4ubNormal3f>(MAX_CHUNK_VTXS);
+	if (!pVtxs)
+	{
+		this->Destroy();
+		return false;
+	}
+
+	std::vector<TerrainChunk> areas;
+	GetTerrainChunks(width, length, CHUNK_QUADS, &areas);
+
+	for (size_t i = 0; i < areas.size(); ++i)
+	{
+		Chunk chunk;
+
+		chunk.vertexSlot = -1;
+		chunk.area = areas[i];
+
+		if (!this->FindShape(pContext, pUploadRing, pArena, chunk.area.width, chunk.area.length, &chunk.shapeIndex))
+		{
+			pArena->ResetToMarker(arenaMarker);
+			this->Destroy();
+			return false;
+		}
+
+		BufferSlotPool *pVertexPool = m_pPool->GetVertexPool();
+
+		if (!pVertexPool->Allocate(&chunk.vertexSlot))
+			chunk.vertexSlot = -1;
+
+		size_t chunkIndex = m_chunks.size();
+
+		m_chunks.push_back(chunk);
+		m_chunkBounds.Resize(m_chunks.size());
+
+		size_t numVtxs = this->BuildChunkVertices(chunkIndex, pGrid, pVtxs);
+
+		if (chunk.vertexSlot < 0 || !pVertexPool->Upload(pContext, pUploadRing, chunk.vertexSlot, pVtxs, UINT(numVtxs * sizeof *pVtxs)))
+		{
+			pArena->ResetToMarker(arenaMarker);
+			this->Destroy();
+			return false;
+		}
+	}
+
+	pArena->ResetToMarker(arenaMarker);
+
+	m_chunkVisible.resize(m_chunks.size());
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainMesh::Destroy()
+{
+	for (size_t i = 0; i < m_chunks.size(); ++i)
+	{
+		if (m_chunks[i].vertexSlot >= 0)
+			m_pPool->GetVertexPool()->Free(m_chunks[i].vertexSlot);
+	}
+
+	for (size_t i = 0; i < m_shapes.size(); ++i)
+	{
+		if (m_shapes[i].indexSlot >= 0)
+			m_pPool->GetIndexPool()->Free(m_shapes[i].indexSlot);
+	}
+
+	m_chunks.clear();
+	m_shapes.clear();
+	m_chunkBounds.Clear();
+	m_chunkVisible.clear();
+	m_dirtyRegions.Destroy();
+
+	m_pPool = NULL;
+	m_width = 0;
+	m_length = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainMesh::MarkDirty(int minCol, int minRow, int maxCol, int maxRow)
+{
+	// The normals of the points next to the changed ones change too.
+	m_dirtyRegions.Add(minCol - 1, minRow - 1, maxCol + 1, maxRow + 1);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainMesh::UpdateDirtyChunks(ID3D11DeviceContext *pContext, UploadRing *pUploadRing, LinearArena *pArena, const TerrainGrid *pGrid)
+{
+	size_t numUpdated = 0;
+
+	if (m_dirtyRegions.GetNumDirtyChunks() == 0)
+		return 0;
+
+	LinearArenaMarker arenaMarker = pArena->GetMarker();
+
+	// If there's no room, the chunks stay dirty for next time.
+	Vertex_Pos3fColour4ubNormal3f *pVtxs = pArena->AllocateArray<Vertex_Pos3fColour4ubNormal3f>(MAX_CHUNK_VTXS);
+	if (!pVtxs)
+		return 0;
+
+	for (size_t i = 0; i < m_dirtyRegions.GetNumDirtyChunks(); ++i)
+	{
+		size_t chunkIndex;
+		int minCol, minRow, maxCol, maxRow;
+		m_dirtyRegions.GetDirtyChunk(i, &chunkIndex, &minCol, &minRow, &maxCol, &maxRow);
+
+		// The vertices are in cache order, not grid order, so the dirty
+		// part of the chunk is spread all over the buffer. So the whole
+		// chunk is rebuilt, and the whole buffer replaced.
+		size_t numVtxs = this->BuildChunkVertices(chunkIndex, pGrid, pVtxs);
+
+		if (!m_pPool->GetVertexPool()->Upload(pContext, pUploadRing, m_chunks[chunkIndex].vertexSlot, pVtxs, UINT(numVtxs * sizeof *pVtxs)))
+			continue;
+
+		++numUpdated;
+	}
+
+	m_dirtyRegions.Clear();
+	pArena->ResetToMarker(arenaMarker);
+
+	return numUpdated;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainMesh::Draw(CommonApp *pApp, OcclusionBuffer *pOcclusionBuffer)
+{
+	if (m_chunks.empty())
+		return 0;
+
+	XMFLOAT4X4 wvp;
+	XMStoreFloat4x4(&wvp, pApp->GetWVP());
+
+	float planes[6][4];
+	GetFrustumPlanes(&wvp.m[0][0], planes);
+
+	size_t numVisible = m_chunkBounds.CullPlanes(planes, 6, &m_chunkVisible[0]);
+
+	if (pOcclusionBuffer && numVisible > 0)
+		numVisible = m_chunkBounds.CullOccluded(pOcclusionBuffer, &wvp.m[0][0], &m_chunkVisible[0]);
+
+	// The slots are looked up every time, as they move when the pool's
+	// defragmented.
+	for (size_t i = 0; i < m_chunks.size(); ++i)
+	{
+		if (!m_chunkVisible[i])
+			continue;
+
+		const Chunk *pChunk = &m_chunks[i];
+		const ChunkShape *pShape = &m_shapes[pChunk->shapeIndex];
+
+		ID3D11Buffer *pVertexBuffer, *pIndexBuffer;
+		UINT vertexOffset, indexOffset;
+		m_pPool->GetVertexPool()->GetSlot(pChunk->vertexSlot, &pVertexBuffer, &vertexOffset);
+		m_pPool->GetIndexPool()->GetSlot(pShape->indexSlot, &pIndexBuffer, &indexOffset);
+
+		pApp->DrawWithShader(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST, pVertexBuffer, sizeof(Vertex_Pos3fColour4ubNormal3f), pIndexBuffer, indexOffset / sizeof(uint16_t), pShape->numIndices,
+			NULL, NULL, pApp->GetUntexturedLitShader(), int(vertexOffset / sizeof(Vertex_Pos3fColour4ubNormal3f)));
+	}
+
+	return numVisible;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainMesh::GetNumChunks() const
+{
+	return m_chunks.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainMesh::GetChunkAABB(size_t chunkIndex, XMFLOAT3 *pAABBMin, XMFLOAT3 *pAABBMax) const
+{
+	assert(chunkIndex < m_chunks.size());
+
+	m_chunkBounds.GetBox(chunkIndex, &pAABBMin->x, &pAABBMax->x);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainMesh::BuildChunkGeometry(const TerrainGrid *pGrid, const TerrainChunk &chunk, VertexColour colour, const uint16_t *pVertexPoints, Vertex_Pos3fColour4ubNormal3f *pVtxs, uint16_t *pIndices)
+{
+	size_t numVtxs = size_t(chunk.width) * chunk.length;
+
+	const float *pHeights = pGrid->GetHeights();
+	const float *pNormalsX = pGrid->GetNormalsX();
+	const float *pNormalsY = pGrid->GetNormalsY();
+	const float *pNormalsZ = pGrid->GetNormalsZ();
+	size_t pitch = pGrid->GetPitch();
+
+	float originX = pGrid->GetOriginX();
+	float originZ = pGrid->GetOriginZ();
+	float stepX = pGrid->GetColumnStepX();
+	float stepZ = pGrid->GetRowStepZ();
+
+	for (size_t i = 0; i < numVtxs; ++i)
+	{
+		size_t vertexPoint = pVertexPoints ? pVertexPoints[i] : i;
+
+		int col = chunk.col0 + int(vertexPoint % chunk.width);
+		int row = chunk.row0 + int(vertexPoint / chunk.width);
+
+		size_t point = row * pitch + col;
+
+		XMFLOAT3 pos(originX + col * stepX, pHeights[point], originZ + row * stepZ);
+		XMFLOAT3 normal(pNormalsX[point], pNormalsY[point], pNormalsZ[point]);
+
+		pVtxs[i] = Vertex_Pos3fColour4ubNormal3f(pos, colour, normal);
+	}
+
+	if (pIndices)
+		BuildTerrainChunkIndices(chunk.width, chunk.length, pIndices);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainMesh::FindShape(ID3D11DeviceContext *pContext, UploadRing *pUploadRing, LinearArena *pArena, int width, int length, size_t *pShapeIndex)
+{
+	for (size_t i = 0; i < m_shapes.size(); ++i)
+	{
+		if (m_shapes[i].width == width && m_shapes[i].length == length)
+		{
+			*pShapeIndex = i;
+			return true;
+		}
+	}
+
+	ChunkShape shape;
+
+	shape.width = width;
+	shape.length = length;
+	shape.indexSlot = -1;
+
+	size_t numVtxs = size_t(width) * length;
+
+	shape.vertexPoints.resize(numVtxs);
+
+	for (size_t i = 0; i < numVtxs; ++i)
+		shape.vertexPoints[i] = uint16_t(i);
+
+	size_t numIndices = size_t(width - 1) * (length - 1) * 6;
+
+	// The indices are only needed until they've been uploaded.
+	LinearArenaMarker arenaMarker = pArena->GetMarker();
+
+	uint16_t *pIndices = pArena->AllocateArray<uint16_t>(numIndices);
+	if (!pIndices)
+		return false;
+
+	BuildTerrainChunkIndices(width, length, pIndices);
+
+	// Reordering the grid point numbers gives the order to put each
+	// chunk's vertices in.
+	OptimiseVertexCache(pIndices, numIndices, numVtxs);
+	OptimiseVertexFetch(&shape.vertexPoints[0], numVtxs, sizeof shape.vertexPoints[0], pIndices, numIndices);
+
+	shape.numIndices = unsigned(numIndices);
+
+	BufferSlotPool *pIndexPool = m_pPool->GetIndexPool();
+
+	bool good = false;
+
+	// In the list, so Destroy frees the slot whatever happens.
+	if (pIndexPool->Allocate(&shape.indexSlot))
+	{
+		*pShapeIndex = m_shapes.size();
+		m_shapes.push_back(shape);
+
+		good = pIndexPool->Upload(pContext, pUploadRing, shape.indexSlot, pIndices, UINT(numIndices * sizeof *pIndices));
+	}
+
+	pArena->ResetToMarker(arenaMarker);
+
+	return good;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainMesh::BuildChunkVertices(size_t chunkIndex, const TerrainGrid *pGrid, Vertex_Pos3fColour4ubNormal3f *pVtxs)
+{
+	const Chunk *pChunk = &m_chunks[chunkIndex];
+	const ChunkShape *pShape = &m_shapes[pChunk->shapeIndex];
+
+	this->BuildChunkGeometry(pGrid, pChunk->area, m_colour, &pShape->vertexPoints[0], pVtxs, NULL);
+
+	float aabbMin[3], aabbMax[3];
+	GetTerrainChunkBox(pGrid, pChunk->area, aabbMin, aabbMax);
+
+	m_chunkBounds.SetBox(chunkIndex, aabbMin, aabbMax);
+
+	return pShape->vertexPoints.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainMeshPool::TerrainMeshPool()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainMeshPool::~TerrainMeshPool()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainMeshPool::Create(ID3D11Device *pDevice, int maxNumChunks)
+{
+	this->Destroy();
+
+	// 32 full size chunks' vertices are about 4 MB.
+	static const int SLOTS_PER_PAGE = 32;
+
+	int maxNumPages = (maxNumChunks + SLOTS_PER_PAGE - 1) / SLOTS_PER_PAGE;
+
+	// Room for the biggest chunks, and their indices.
+	UINT vertexSlotNumBytes = UINT(TerrainMesh::MAX_CHUNK_VTXS * sizeof(Vertex_Pos3fColour4ubNormal3f));
+	UINT indexSlotNumBytes = UINT(TerrainMesh::CHUNK_QUADS * TerrainMesh::CHUNK_QUADS * 6 * sizeof(uint16_t));
+
+	if (!m_vertexPool.Create(pDevice, D3D11_BIND_VERTEX_BUFFER, vertexSlotNumBytes, SLOTS_PER_PAGE, maxNumPages))
+		return false;
+
+	if (!m_indexPool.Create(pDevice, D3D11_BIND_INDEX_BUFFER, indexSlotNumBytes, SLOTS_PER_PAGE, maxNumPages))
+	{
+		this->Destroy();
+		return false;
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainMeshPool::Destroy()
+{
+	m_vertexPool.Destroy();
+	m_indexPool.Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainMeshPool::Defragment(ID3D11DeviceContext *pContext, size_t maxNumMoves)
+{
+	size_t numMoves = m_vertexPool.Defragment(pContext, maxNumMoves);
+
+	return numMoves + m_indexPool.Defragment(pContext, maxNumMoves - numMoves);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+BufferSlotPool *TerrainMeshPool::GetVertexPool()
+{
+	return &m_vertexPool;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+BufferSlotPool *TerrainMeshPool::GetIndexPool()
+{
+	return &m_indexPool;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,197 @@
+#ifndef HEADER_0D7998BDDF214FB9AA5DDE59D8865215
+#define HEADER_0D7998BDDF214FB9AA5DDE59D8865215
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Renderable terrain built from a height map grid.
+//
+// The grid is split into square chunks of up to CHUNK_QUADS quads on
+// a side, each with its own indexed triangle list, so maps of any
+// size fit in 16-bit indices. Neighbouring chunks share their edge
+// vertices, and the normals are worked out over the whole grid first,
+// so there are no seams.
+//
+// Each quad is split along the diagonal from its top left (lower row
+// index, lower column) to its bottom right corner, the same split the
+// old triangle strip used. The chunks and their triangles are laid
+// out as TerrainChunks.h has them, and BuildChunkGeometry makes them
+// for anything else that draws the same triangles.
+//
+// Chunks the same shape share an index buffer, and their vertices are
+// in the same (vertex cache friendly) order. The terrain can be
+// edited: MarkDirty the grid points whose heights have changed, as
+// many times as needed, then UpdateDirtyChunks once before drawing.
+// Only the chunks whose vertices or normals are affected are rebuilt
+// and uploaded. The new vertices go through an UploadRing, and the
+// GPU copies them from there into the chunk's vertex buffer, which the
+// CPU never touches.
+//
+// The chunks' vertices, and the shapes' indices, are kept in slots of
+// a TerrainMeshPool's buffers, which can be shared by lots of meshes,
+// so making and destroying meshes (as TerrainWorld's tiles come and
+// go) doesn't make or release any buffers.
+//
+// The heights and normals come from a TerrainGrid, which keeps them
+// as separate arrays; the vertices are only interleaved as each chunk
+// is uploaded. Work out the grid's normals before creating or updating
+// the mesh, or pass in ones worked out elsewhere, for grids that are
+// part of something bigger (see TerrainWorld), whose edge normals
+// depend on their neighbours.
+//
+// The chunks' bounding boxes are kept in a TerrainBounds, and Draw
+// leaves out the chunks outside the view frustum, and, given an
+// OcclusionBuffer, those hidden behind its occluders.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include "BufferSlotPool.h"
+#include "CommonApp.h"
+#include "LinearArena.h"
+#include "TerrainBounds.h"
+#include "TerrainChunks.h"
+#include "TerrainDirtyRegions.h"
+#include "TerrainGrid.h"
+#include "UploadRing.h"
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class OcclusionBuffer;
+class TerrainMeshPool;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainMesh
+{
+public:
+	static const int CHUNK_QUADS = 64;
+	static const int MAX_CHUNK_VTXS = (CHUNK_QUADS + 1) * (CHUNK_QUADS + 1);
+
+	TerrainMesh();
+	~TerrainMesh();
+
+	// The mesh is the same size as pGrid, which needn't be kept. The
+	// pool must outlive the mesh. pUploadRing and pArena are as for
+	// UpdateDirtyChunks.
+	bool Create(TerrainMeshPool *pPool, ID3D11DeviceContext *pContext, UploadRing *pUploadRing, LinearArena *pArena, const TerrainGrid *pGrid, VertexColour colour);
+	void Destroy();
+
+	// The grid points from (minCol, minRow) to (maxCol, maxRow)
+	// inclusive have new heights.
+	void MarkDirty(int minCol, int minRow, int maxCol, int maxRow);
+
+	// Rebuild the chunks marked dirty since last time from pGrid, which
+	// must be the same size as the one the mesh was created from.
+	// Returns the number of chunks rebuilt.
+	//
+	// If pUploadRing is NULL, or full, the vertices are uploaded
+	// straight to each chunk's buffer instead. The vertices are built in
+	// pArena, which is left as it was.
+	size_t UpdateDirtyChunks(ID3D11DeviceContext *pContext, UploadRing *pUploadRing, LinearArena *pArena, const TerrainGrid *pGrid);
+
+	// Draws the chunks inside the frustum of the app's current world,
+	// view and projection matrices, and not hidden in
+	// pOcclusionBuffer, which has been rasterized with the same
+	// matrices, or is NULL. Returns the number drawn.
+	size_t Draw(CommonApp *pApp, OcclusionBuffer *pOcclusionBuffer);
+
+	size_t GetNumChunks() const;
+	void GetChunkAABB(size_t chunkIndex, XMFLOAT3 *pAABBMin, XMFLOAT3 *pAABBMax) const;
+
+	// The vertices of a chunk of pGrid, and, if pIndices isn't NULL, its
+	// triangles, (chunk.width - 1) * (chunk.length - 1) * 6 indices. The
+	// vertices are in the order pVertexPoints has their grid points, as
+	// row * chunk.width + col within the chunk, or row by row if it's
+	// NULL; the indices are for the row by row order.
+	static void BuildChunkGeometry(const TerrainGrid *pGrid, const TerrainChunk &chunk, VertexColour colour, const uint16_t *pVertexPoints, Vertex_Pos3fColour4ubNormal3f *pVtxs, uint16_t *pIndices);
+protected:
+private:
+	struct ChunkShape
+	{
+		int width;
+		int length;
+
+		// Handle in the pool's index slots, or -1.
+		int indexSlot;
+		unsigned numIndices;
+
+		// Grid point of each vertex, as row * width + col within the
+		// chunk.
+		std::vector<uint16_t> vertexPoints;
+	};
+
+	struct Chunk
+	{
+		// Handle in the pool's vertex slots, or -1.
+		int vertexSlot;
+		size_t shapeIndex;
+
+		// Which part of the grid it is.
+		TerrainChunk area;
+	};
+
+	TerrainMeshPool *m_pPool;
+	int m_width;
+	int m_length;
+	VertexColour m_colour;
+
+	std::vector<ChunkShape> m_shapes;
+	std::vector<Chunk> m_chunks;
+
+	// The chunks' boxes, in the same order.
+	TerrainBounds m_chunkBounds;
+	std::vector<uint8_t> m_chunkVisible;
+
+	TerrainDirtyRegions m_dirtyRegions;
+
+	// Finds the shape with the given size in vertices, making it if
+	// there isn't one yet.
+	bool FindShape(ID3D11DeviceContext *pContext, UploadRing *pUploadRing, LinearArena *pArena, int width, int length, size_t *pShapeIndex);
+
+	// Fills in pVtxs, which has room for MAX_CHUNK_VTXS, and returns how
+	// many there are. The chunk's box is brought up to date too.
+	size_t BuildChunkVertices(size_t chunkIndex, const TerrainGrid *pGrid, Vertex_Pos3fColour4ubNormal3f *pVtxs);
+
+	TerrainMesh(const TerrainMesh &);
+	TerrainMesh &operator=(const TerrainMesh &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Slots for up to maxNumChunks TerrainMesh chunks' vertices, and as
+// many chunk shapes' indices, each in pages of buffers made as they're
+// needed.
+class TerrainMeshPool
+{
+public:
+	TerrainMeshPool();
+	~TerrainMeshPool();
+
+	bool Create(ID3D11Device *pDevice, int maxNumChunks);
+	void Destroy();
+
+	// Call once a frame or so, to free up the buffers that meshes going
+	// away have left (nearly) empty. Returns the number of slots moved.
+	size_t Defragment(ID3D11DeviceContext *pContext, size_t maxNumMoves);
+
+	BufferSlotPool *GetVertexPool();
+	BufferSlotPool *GetIndexPool();
+protected:
+private:
+	BufferSlotPool m_vertexPool;
+	BufferSlotPool m_indexPool;
+
+	TerrainMeshPool(const TerrainMeshPool &);
+	TerrainMeshPool &operator=(const TerrainMeshPool &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_0D7998BDDF214FB9AA5DDE59D8865215
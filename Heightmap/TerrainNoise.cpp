@@ -0,0 +1,476 @@
+#include "TerrainNoise.h"
+#include "ParallelJobs.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_NOISE_SSE2 1
+#include <emmintrin.h>
+#else
+#define TERRAIN_NOISE_SSE2 0
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Brings the gradient noise into about -1 to 1.
+static const float NOISE_SCALE = .507f;
+
+// So the warping noise is different from the height noise, and in x
+// from in z.
+static const uint32_t WARP_X_SEED = 0x9E3779B9u;
+static const uint32_t WARP_Y_SEED = 0x7F4A7C15u;
+
+// Gradient noise is 0 at every lattice point. With a lacunarity of 2,
+// each octave's lattice points would be on top of the last one's, and
+// the grid would show through, so each octave is shifted along by a
+// different fraction of a lattice cell.
+static const float OCTAVE_OFFSET_X = .6180340f;
+static const float OCTAVE_OFFSET_Y = .3819660f;
+
+// Rows per job for GenerateTerrainNoise.
+static const int ROWS_PER_JOB = 16;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainNoiseParams::TerrainNoiseParams():
+type(TERRAIN_NOISE_FBM),
+seed(0),
+frequency(1.f / 128.f),
+numOctaves(6),
+lacunarity(2.f),
+gain(.5f),
+baseHeight(6.f),
+amplitude(6.f),
+warpDistance(0.f),
+warpFrequency(1.f / 256.f),
+numWarpOctaves(2)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The noise is written once, as templates, for either 1 grid point at
+// a time (float and uint32_t) or 4 (Float4 and Int4). The two only
+// differ in the handful of functions below, which do the same
+// operations in the same order, so the results are identical.
+
+static float Abs(float x)
+{
+	return fabsf(x);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float Min(float a, float b)
+{
+	return std::min(a, b);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float Max(float a, float b)
+{
+	return std::max(a, b);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Returns floor(x), and sets *pInt to it too.
+static float Floor(float x, uint32_t *pInt)
+{
+	int32_t i = int32_t(x);
+
+	// Truncating rounds negative numbers up.
+	if (float(i) > x)
+		--i;
+
+	*pInt = uint32_t(i);
+
+	return float(i);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Pseudo-random bits for a lattice point.
+static uint32_t Hash(uint32_t col, uint32_t row, uint32_t seed)
+{
+	uint32_t h = (col * 0x27D4EB2Du) ^ (row * 0x165667B1u) ^ seed;
+
+	h ^= h >> 15;
+	h *= 0x2C1B3C6Du;
+	h ^= h >> 12;
+	h *= 0x297A2D39u;
+	h ^= h >> 15;
+
+	return h;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Dot product of (x, y) and one of 8 gradients, picked by the bottom 3
+// bits of hash.
+static float Grad(uint32_t hash, float x, float y)
+{
+	float u = hash & 4 ? y : x;
+	float v = hash & 4 ? x : y;
+
+	v = v + v;
+
+	return (hash & 1 ? -u : u) + (hash & 2 ? -v : v);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#if TERRAIN_NOISE_SSE2
+
+struct Float4
+{
+	__m128 v;
+
+	explicit Float4(float x):
+	v(_mm_set1_ps(x))
+	{
+	}
+
+	explicit Float4(__m128 x):
+	v(x)
+	{
+	}
+};
+
+struct Int4
+{
+	__m128i v;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static Float4 operator+(const Float4 &a, const Float4 &b)
+{
+	return Float4(_mm_add_ps(a.v, b.v));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static Float4 operator-(const Float4 &a, const Float4 &b)
+{
+	return Float4(_mm_sub_ps(a.v, b.v));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static Float4 operator*(const Float4 &a, const Float4 &b)
+{
+	return Float4(_mm_mul_ps(a.v, b.v));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static Int4 operator+(const Int4 &a, uint32_t b)
+{
+	Int4 result = {_mm_add_epi32(a.v, _mm_set1_epi32(int(b)))};
+
+	return result;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static Float4 Abs(const Float4 &x)
+{
+	return Float4(_mm_andnot_ps(_mm_set1_ps(-0.f), x.v));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static Float4 Min(const Float4 &a, const Float4 &b)
+{
+	return Float4(_mm_min_ps(a.v, b.v));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static Float4 Max(const Float4 &a, const Float4 &b)
+{
+	return Float4(_mm_max_ps(a.v, b.v));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static Float4 Floor(const Float4 &x, Int4 *pInt)
+{
+	__m128i i = _mm_cvttps_epi32(x.v);
+
+	// The comparison gives -1 where truncating rounded up.
+	__m128 roundedUp = _mm_cmpgt_ps(_mm_cvtepi32_ps(i), x.v);
+	i = _mm_add_epi32(i, _mm_castps_si128(roundedUp));
+
+	pInt->v = i;
+
+	return Float4(_mm_cvtepi32_ps(i));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The bottom 32 bits of a * b, for each lane. (SSE2 only does 2
+// lanes at a time, and gives 64 bit results.)
+static __m128i MulLo(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static Int4 Hash(const Int4 &col, const Int4 &row, uint32_t seed)
+{
+	__m128i h = _mm_xor_si128(MulLo(col.v, _mm_set1_epi32(int(0x27D4EB2Du))), MulLo(row.v, _mm_set1_epi32(int(0x165667B1u))));
+	h = _mm_xor_si128(h, _mm_set1_epi32(int(seed)));
+
+	h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+	h = MulLo(h, _mm_set1_epi32(int(0x2C1B3C6Du)));
+	h = _mm_xor_si128(h, _mm_srli_epi32(h, 12));
+	h = MulLo(h, _mm_set1_epi32(int(0x297A2D39u)));
+	h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+
+	Int4 result = {h};
+
+	return result;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static Float4 Grad(const Int4 &hash, const Float4 &x, const Float4 &y)
+{
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(hash.v, _mm_set1_epi32(4)), _mm_set1_epi32(4)));
+
+	__m128 u = _mm_or_ps(_mm_and_ps(swap, y.v), _mm_andnot_ps(swap, x.v));
+	__m128 v = _mm_or_ps(_mm_and_ps(swap, x.v), _mm_andnot_ps(swap, y.v));
+
+	v = _mm_add_ps(v, v);
+
+	// Flip the sign bits.
+	__m128 uSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(hash.v, _mm_set1_epi32(1)), 31));
+	__m128 vSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(hash.v, _mm_set1_epi32(2)), 30));
+
+	return Float4(_mm_add_ps(_mm_xor_ps(u, uSign), _mm_xor_ps(v, vSign)));
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Smooth step from 0 to 1 with no jump in the second derivative.
+template <class Float>
+static Float Fade(const Float &t)
+{
+	return t * t * t * (t * (t * Float(6.f) - Float(15.f)) + Float(10.f));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+template <class Float, class Int>
+static Float Noise(const Float &x, const Float &y, uint32_t seed)
+{
+	Int col0, row0;
+	Float x0 = x - Floor(x, &col0);
+	Float y0 = y - Floor(y, &row0);
+
+	Float x1 = x0 - Float(1.f);
+	Float y1 = y0 - Float(1.f);
+
+	Int col1 = col0 + 1u;
+	Int row1 = row0 + 1u;
+
+	Float n00 = Grad(Hash(col0, row0, seed), x0, y0);
+	Float n10 = Grad(Hash(col1, row0, seed), x1, y0);
+	Float n01 = Grad(Hash(col0, row1, seed), x0, y1);
+	Float n11 = Grad(Hash(col1, row1, seed), x1, y1);
+
+	Float s = Fade(x0);
+	Float t = Fade(y0);
+
+	Float n0 = n00 + s * (n10 - n00);
+	Float n1 = n01 + s * (n11 - n01);
+
+	return Float(NOISE_SCALE) * (n0 + t * (n1 - n0));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float GetAmplitudeSum(float gain, int numOctaves)
+{
+	float sum = 0.f;
+	float amplitude = 1.f;
+
+	for (int i = 0; i < numOctaves; ++i)
+	{
+		sum += amplitude;
+		amplitude *= gain;
+	}
+
+	return sum;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Goes from about -GetAmplitudeSum to GetAmplitudeSum.
+template <class Float, class Int>
+static Float GetFBM(const TerrainNoiseParams &params, const Float &x, const Float &y, uint32_t seed, float frequency, int numOctaves)
+{
+	Float sum(0.f);
+	float amplitude = 1.f;
+
+	for (int i = 0; i < numOctaves; ++i)
+	{
+		Float noise = Noise<Float, Int>(x * Float(frequency) + Float(OCTAVE_OFFSET_X * i), y * Float(frequency) + Float(OCTAVE_OFFSET_Y * i), seed + uint32_t(i));
+
+		sum = sum + Float(amplitude) * noise;
+
+		frequency *= params.lacunarity;
+		amplitude *= params.gain;
+	}
+
+	return sum;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Goes from 0 to GetAmplitudeSum. Each octave is weighted by the last
+// one, so the valleys stay smooth.
+template <class Float, class Int>
+static Float GetRidged(const TerrainNoiseParams &params, const Float &x, const Float &y)
+{
+	Float sum(0.f);
+	Float weight(1.f);
+	float frequency = params.frequency;
+	float amplitude = 1.f;
+
+	for (int i = 0; i < params.numOctaves; ++i)
+	{
+		Float noise = Noise<Float, Int>(x * Float(frequency) + Float(OCTAVE_OFFSET_X * i), y * Float(frequency) + Float(OCTAVE_OFFSET_Y * i), params.seed + uint32_t(i));
+
+		Float ridge = Float(1.f) - Abs(noise);
+		ridge = ridge * ridge * weight;
+
+		weight = Min(Max(ridge * Float(2.f), Float(0.f)), Float(1.f));
+
+		sum = sum + Float(amplitude) * ridge;
+
+		frequency *= params.lacunarity;
+		amplitude *= params.gain;
+	}
+
+	return sum;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+template <class Float, class Int>
+static Float Sample(const TerrainNoiseParams &params, const Float &col, const Float &row)
+{
+	Float x = col;
+	Float y = row;
+
+	if (params.warpDistance != 0.f && params.numWarpOctaves > 0)
+	{
+		float warpScale = params.warpDistance / GetAmplitudeSum(params.gain, params.numWarpOctaves);
+
+		Float warpX = GetFBM<Float, Int>(params, x, y, params.seed ^ WARP_X_SEED, params.warpFrequency, params.numWarpOctaves);
+		Float warpY = GetFBM<Float, Int>(params, x, y, params.seed ^ WARP_Y_SEED, params.warpFrequency, params.numWarpOctaves);
+
+		x = x + Float(warpScale) * warpX;
+		y = y + Float(warpScale) * warpY;
+	}
+
+	float amplitudeSum = GetAmplitudeSum(params.gain, params.numOctaves);
+
+	Float value(0.f);
+
+	if (params.type == TERRAIN_NOISE_RIDGED)
+		value = GetRidged<Float, Int>(params, x, y) * Float(2.f / amplitudeSum) - Float(1.f);
+	else
+		value = GetFBM<Float, Int>(params, x, y, params.seed, params.frequency, params.numOctaves) * Float(1.f / amplitudeSum);
+
+	return Float(params.baseHeight) + Float(params.amplitude) * value;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float SampleTerrainNoise(const TerrainNoiseParams &params, int col, int row)
+{
+	return Sample<float, uint32_t>(params, float(col), float(row));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void GenerateTerrainNoise(const TerrainNoiseParams &params, int minCol, int minRow, int width, int length, float *pHeights, unsigned maxNumThreads)
+{
+	if (width <= 0 || length <= 0)
+		return;
+
+	size_t numJobs = size_t((length + ROWS_PER_JOB - 1) / ROWS_PER_JOB);
+
+	RunParallelJobs(numJobs, maxNumThreads, [&](size_t job, std::string *) -> bool {
+		int firstRow = int(job) * ROWS_PER_JOB;
+		int lastRow = std::min(firstRow + ROWS_PER_JOB, length);
+
+		for (int row = firstRow; row < lastRow; ++row)
+		{
+			float *pRow = pHeights + size_t(row) * width;
+			int col = 0;
+
+#if TERRAIN_NOISE_SSE2
+
+			Float4 y(float(minRow + row));
+
+			for (; col + 4 <= width; col += 4)
+			{
+				__m128i cols = _mm_add_epi32(_mm_set1_epi32(minCol + col), _mm_set_epi32(3, 2, 1, 0));
+
+				_mm_storeu_ps(pRow + col, Sample<Float4, Int4>(params, Float4(_mm_cvtepi32_ps(cols)), y).v);
+			}
+
+#endif
+
+			for (; col < width; ++col)
+				pRow[col] = SampleTerrainNoise(params, minCol + col, minRow + row);
+		}
+
+		return true;
+	}, NULL);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,91 @@
+#ifndef HEADER_E1934CA5CAD84331B8E9B000836D55AE
+#define HEADER_E1934CA5CAD84331B8E9B000836D55AE
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Procedural height grids from gradient noise.
+//
+// The noise is 2D Perlin gradient noise, summed over several octaves
+// either as plain fractal Brownian motion or as Musgrave's ridged
+// multifractal. Optionally, the sample position is first pushed
+// around by 2 more fBm sums (domain warping), which bends the ridges
+// and valleys about.
+//
+// A grid point's height only depends on the params (seed included)
+// and its absolute column and row. So a big grid can be generated in
+// tiles, in any order, and they'll match up exactly: pass each tile's
+// first column and row in. Tiles a long way from the origin are fine,
+// up to about 2^24 grid points, when the columns and rows stop fitting
+// in a float.
+//
+// GenerateTerrainNoise does 4 grid points at a time with SSE2 where
+// it's available, and splits the rows up over several threads. The
+// results are the same, bit for bit, as SampleTerrainNoise's.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+enum TerrainNoiseType
+{
+	// Rolling hills.
+	TERRAIN_NOISE_FBM,
+
+	// Sharp ridges, with the detail mostly on the high ground.
+	TERRAIN_NOISE_RIDGED,
+};
+
+struct TerrainNoiseParams
+{
+	TerrainNoiseType type;
+
+	uint32_t seed;
+
+	// Cycles per grid point, for the first octave.
+	float frequency;
+
+	// Each octave's frequency is the last one's times lacunarity, and
+	// its amplitude the last one's times gain.
+	int numOctaves;
+	float lacunarity;
+	float gain;
+
+	// The sum of the octaves goes from about -1 to 1, which is mapped
+	// to baseHeight - amplitude to baseHeight + amplitude.
+	float baseHeight;
+	float amplitude;
+
+	// How far, in grid points, domain warping moves a sample point at
+	// most (0 for no warping), and the frequency and number of octaves
+	// of the warping noise.
+	float warpDistance;
+	float warpFrequency;
+	int numWarpOctaves;
+
+	// Sets reasonable defaults for heights of 0 to 16, like
+	// HeightMapApplication's height maps.
+	TerrainNoiseParams();
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Height of one grid point.
+float SampleTerrainNoise(const TerrainNoiseParams &params, int col, int row);
+
+// Fills in width*length heights, row by row, for the grid points from
+// (minCol, minRow), on up to maxNumThreads threads (0 means one per
+// hardware thread).
+void GenerateTerrainNoise(const TerrainNoiseParams &params, int minCol, int minRow, int width, int length, float *pHeights, unsigned maxNumThreads);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_E1934CA5CAD84331B8E9B000836D55AE
@@ -0,0 +1,182 @@
+#include "TerrainOccluders.h"
+
+#include "OcclusionBuffer.h"
+
+#include <assert.h>
+#include <float.h>
+
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainOccluders::TerrainOccluders():
+m_width(0),
+m_length(0),
+m_numCellsX(0),
+m_numCellsZ(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainOccluders::~TerrainOccluders()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainOccluders::Create(const TerrainGrid *pGrid)
+{
+	this->Destroy();
+
+	if (pGrid->GetWidth() < 2 || pGrid->GetLength() < 2)
+		return false;
+
+	m_width = pGrid->GetWidth();
+	m_length = pGrid->GetLength();
+	m_numCellsX = (m_width - 1 + CELL_QUADS - 1) / CELL_QUADS;
+	m_numCellsZ = (m_length - 1 + CELL_QUADS - 1) / CELL_QUADS;
+
+	m_cellMinHeights.resize(size_t(m_numCellsX) * m_numCellsZ);
+
+	int numCornersX = m_numCellsX + 1;
+	int numCornersZ = m_numCellsZ + 1;
+
+	m_positions.resize(size_t(numCornersX) * numCornersZ * 3);
+
+	for (int z = 0; z < numCornersZ; ++z)
+	{
+		int row = std::min(z * CELL_QUADS, m_length - 1);
+
+		for (int x = 0; x < numCornersX; ++x)
+		{
+			int col = std::min(x * CELL_QUADS, m_width - 1);
+
+			float *pPosition = &m_positions[(size_t(z) * numCornersX + x) * 3];
+			pPosition[0] = pGrid->GetOriginX() + col * pGrid->GetColumnStepX();
+			pPosition[1] = 0.f;
+			pPosition[2] = pGrid->GetOriginZ() + row * pGrid->GetRowStepZ();
+		}
+	}
+
+	// The same split as TerrainMesh. a, b, d is clockwise from above if
+	// columns and rows go opposite ways, as they usually do.
+	bool clockwise = (pGrid->GetColumnStepX() < 0.f) != (pGrid->GetRowStepZ() < 0.f);
+
+	m_indices.reserve(size_t(m_numCellsX) * m_numCellsZ * 6);
+
+	for (int z = 0; z < m_numCellsZ; ++z)
+	{
+		for (int x = 0; x < m_numCellsX; ++x)
+		{
+			uint32_t a = uint32_t(z * numCornersX + x);
+			uint32_t b = a + 1;
+			uint32_t c = a + numCornersX;
+			uint32_t d = c + 1;
+
+			uint32_t quad[6] = {a, b, d, a, d, c};
+
+			if (!clockwise)
+			{
+				std::swap(quad[1], quad[2]);
+				std::swap(quad[4], quad[5]);
+			}
+
+			m_indices.insert(m_indices.end(), quad, quad + 6);
+		}
+	}
+
+	this->Update(pGrid, 0, 0, m_width - 1, m_length - 1);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainOccluders::Destroy()
+{
+	m_width = 0;
+	m_length = 0;
+	m_numCellsX = 0;
+	m_numCellsZ = 0;
+
+	m_cellMinHeights.clear();
+	m_positions.clear();
+	m_indices.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainOccluders::Update(const TerrainGrid *pGrid, int minCol, int minRow, int maxCol, int maxRow)
+{
+	assert(pGrid->GetWidth() == m_width && pGrid->GetLength() == m_length);
+
+	if (m_numCellsX == 0)
+		return;
+
+	// Points on a cell's edge are in the cell next door too.
+	int minCellX = std::max(minCol - 1, 0) / CELL_QUADS;
+	int maxCellX = std::min(maxCol / CELL_QUADS, m_numCellsX - 1);
+	int minCellZ = std::max(minRow - 1, 0) / CELL_QUADS;
+	int maxCellZ = std::min(maxRow / CELL_QUADS, m_numCellsZ - 1);
+
+	for (int z = minCellZ; z <= maxCellZ; ++z)
+	{
+		for (int x = minCellX; x <= maxCellX; ++x)
+		{
+			int col0 = x * CELL_QUADS;
+			int row0 = z * CELL_QUADS;
+
+			float maxHeight;
+			pGrid->GetHeightRange(col0, row0, std::min(col0 + CELL_QUADS, m_width - 1), std::min(row0 + CELL_QUADS, m_length - 1),
+				&m_cellMinHeights[size_t(z) * m_numCellsX + x], &maxHeight);
+		}
+	}
+
+	// Then the corners of those cells.
+	int numCornersX = m_numCellsX + 1;
+
+	for (int z = minCellZ; z <= maxCellZ + 1; ++z)
+	{
+		for (int x = minCellX; x <= maxCellX + 1; ++x)
+		{
+			float height = FLT_MAX;
+
+			for (int cellZ = std::max(z - 1, 0); cellZ <= std::min(z, m_numCellsZ - 1); ++cellZ)
+			{
+				for (int cellX = std::max(x - 1, 0); cellX <= std::min(x, m_numCellsX - 1); ++cellX)
+					height = std::min(height, m_cellMinHeights[size_t(cellZ) * m_numCellsX + cellX]);
+			}
+
+			m_positions[(size_t(z) * numCornersX + x) * 3 + 1] = height;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainOccluders::AddTo(OcclusionBuffer *pBuffer) const
+{
+	if (m_indices.empty())
+		return;
+
+	pBuffer->AddOccluders(&m_positions[0], m_positions.size() / 3, &m_indices[0], m_indices.size() / 3);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainOccluders::GetNumTriangles() const
+{
+	return m_indices.size() / 3;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
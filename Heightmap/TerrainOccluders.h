@@ -0,0 +1,82 @@
+#ifndef HEADER_F681D9079DE643D6837CEE43222E4A8D
+#define HEADER_F681D9079DE643D6837CEE43222E4A8D
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// A coarse mesh of a TerrainGrid that's everywhere on or below the
+// real thing, for hiding what's behind hills in an OcclusionBuffer.
+//
+// The grid is split into cells of CELL_QUADS quads on a side, 8x8 of
+// them to a TerrainMesh chunk, and each corner of a cell is as low as
+// the lowest point of any cell it's a corner of. So each cell's
+// triangles are below its lowest point, and anything they hide, the
+// real terrain hides too, from anywhere above it. The corners are
+// shared with the cells next door, so there are no gaps.
+//
+// The triangles are clockwise seen from above, like TerrainMesh's.
+// When the heights change, Update the points that did.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include "TerrainGrid.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class OcclusionBuffer;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainOccluders
+{
+public:
+	static const int CELL_QUADS = 8;
+
+	TerrainOccluders();
+	~TerrainOccluders();
+
+	// The occluders are the same size as pGrid, which needn't be kept.
+	bool Create(const TerrainGrid *pGrid);
+	void Destroy();
+
+	// The grid points from (minCol, minRow) to (maxCol, maxRow)
+	// inclusive have new heights. pGrid must be the same size as the
+	// one the occluders were created from.
+	void Update(const TerrainGrid *pGrid, int minCol, int minRow, int maxCol, int maxRow);
+
+	// Adds the triangles to pBuffer, which has been begun.
+	void AddTo(OcclusionBuffer *pBuffer) const;
+
+	size_t GetNumTriangles() const;
+protected:
+private:
+	int m_width;
+	int m_length;
+	int m_numCellsX;
+	int m_numCellsZ;
+
+	// Lowest point of each cell, row by row.
+	std::vector<float> m_cellMinHeights;
+
+	// x, y, z of each cell corner, row by row, and 2 triangles a cell.
+	std::vector<float> m_positions;
+	std::vector<uint32_t> m_indices;
+
+	TerrainOccluders(const TerrainOccluders &);
+	TerrainOccluders &operator=(const TerrainOccluders &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_F681D9079DE643D6837CEE43222E4A8D
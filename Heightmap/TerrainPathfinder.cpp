@@ -0,0 +1,1426 @@
+#include "TerrainPathfinder.h"
+#include "HeightField.h"
+#include "ParallelJobs.h"
+
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Move directions, going round from +col. Opposite directions are 4
+// apart.
+static const int DIR_COLS[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+static const int DIR_ROWS[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+// Runs of crossable border at least this long get a crossing point at
+// each end rather than one in the middle, so paths along the border
+// don't have to detour to the middle.
+static const int LONG_ENTRANCE_SIZE = 6;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static int GetOppositeDir(int dir)
+{
+	return (dir + 4) & 7;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Moves on to the next stamp, clearing the stamp arrays when it wraps
+// round so old entries can't match.
+static void NextStamp(uint32_t *pStamp, std::vector<uint32_t> *pStamps0, std::vector<uint32_t> *pStamps1, std::vector<uint32_t> *pStamps2)
+{
+	if (++*pStamp == 0)
+	{
+		std::fill(pStamps0->begin(), pStamps0->end(), 0);
+		std::fill(pStamps1->begin(), pStamps1->end(), 0);
+
+		if (pStamps2)
+			std::fill(pStamps2->begin(), pStamps2->end(), 0);
+
+		*pStamp = 1;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainPathSearch::ClusterSearch::ClusterSearch():
+minCol(0),
+minRow(0),
+shift(0),
+sourceLocal(0),
+stamp(0),
+buckets(NUM_BUCKETS)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainPathSearch::TerrainPathSearch():
+m_stamp(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainPathSearch::~TerrainPathSearch()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainPathfinder::TerrainPathfinder():
+m_pHeights(NULL),
+m_width(0),
+m_length(0),
+m_clusterSize(0),
+m_numClusterCols(0),
+m_numClusterRows(0),
+m_invBucketWidth(0.f)
+{
+	memset(&m_pathCosts, 0, sizeof m_pathCosts);
+
+	for (int dir = 0; dir < 8; ++dir)
+	{
+		m_dirOffsets[dir] = 0;
+		m_moveLengths[dir] = 0.f;
+		m_maxRises[dir] = 0.f;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainPathfinder::~TerrainPathfinder()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainPathfinder::Create(const HeightField *pHeightField, const TerrainPathCosts &costs, int clusterSize, unsigned maxNumThreads)
+{
+	this->Destroy();
+
+	if (pHeightField->GetWidth() < 2 || pHeightField->GetLength() < 2 || clusterSize < 2)
+		return false;
+
+	m_pHeights = pHeightField->GetGridHeights();
+	m_pathCosts = costs;
+	m_width = pHeightField->GetWidth();
+	m_length = pHeightField->GetLength();
+
+	float stepX = fabsf(pHeightField->GetColumnStepX());
+	float stepZ = fabsf(pHeightField->GetRowStepZ());
+
+	for (int dir = 0; dir < 8; ++dir)
+	{
+		m_dirOffsets[dir] = DIR_ROWS[dir] * m_width + DIR_COLS[dir];
+
+		float x = float(DIR_COLS[dir]) * stepX;
+		float z = float(DIR_ROWS[dir]) * stepZ;
+
+		m_moveLengths[dir] = sqrtf(x * x + z * z);
+		m_maxRises[dir] = m_moveLengths[dir] * costs.maxSlope;
+	}
+
+	// A little under the cheapest move, so rounding can't put the end
+	// of a move in the same bucket as its start.
+	m_invBucketWidth = 1.f / (std::min(stepX, stepZ) * 0.999f);
+
+	m_clusterSize = clusterSize;
+	m_numClusterCols = (m_width + clusterSize - 1) / clusterSize;
+	m_numClusterRows = (m_length + clusterSize - 1) / clusterSize;
+	m_clusters.resize(size_t(m_numClusterCols) * m_numClusterRows);
+
+	this->BuildClusters(0, 0, m_numClusterCols - 1, m_numClusterRows - 1, maxNumThreads);
+	this->BuildGraph();
+	this->BuildLandmarks(maxNumThreads);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::Destroy()
+{
+	m_pHeights = NULL;
+	m_width = 0;
+	m_length = 0;
+
+	m_clusterSize = 0;
+	m_numClusterCols = 0;
+	m_numClusterRows = 0;
+	m_clusters.clear();
+
+	m_firstNodes.clear();
+	m_nodeClusters.clear();
+	m_nodeIndices.clear();
+	m_firstCrossingEdges.clear();
+	m_crossingEdges.clear();
+
+	m_landmarkIndices.clear();
+	m_landmarkCosts.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::UpdateRegion(int minCol, int minRow, int maxCol, int maxRow, unsigned maxNumThreads)
+{
+	if (m_clusters.empty())
+		return;
+
+	// Moves to or from a changed point start up to one point outside
+	// the rectangle.
+	minCol = std::max(minCol - 1, 0);
+	minRow = std::max(minRow - 1, 0);
+	maxCol = std::min(maxCol + 1, m_width - 1);
+	maxRow = std::min(maxRow + 1, m_length - 1);
+
+	if (minCol > maxCol || minRow > maxRow)
+		return;
+
+	// The clusters containing those moves can have different crossing
+	// points, which changes the crossing points of their neighbours
+	// too.
+	int minClusterCol = std::max(minCol / m_clusterSize - 1, 0);
+	int minClusterRow = std::max(minRow / m_clusterSize - 1, 0);
+	int maxClusterCol = std::min(maxCol / m_clusterSize + 1, m_numClusterCols - 1);
+	int maxClusterRow = std::min(maxRow / m_clusterSize + 1, m_numClusterRows - 1);
+
+	this->BuildClusters(minClusterCol, minClusterRow, maxClusterCol, maxClusterRow, maxNumThreads);
+	this->BuildGraph();
+	this->BuildLandmarks(maxNumThreads);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainPathfinder::FindPath(int startIndex, int goalIndex, TerrainPathSearch *pSearch, std::vector<int> *pPath, float *pCost) const
+{
+	pPath->clear();
+
+	int numPoints = m_width * m_length;
+
+	if (m_clusters.empty() || startIndex < 0 || startIndex >= numPoints || goalIndex < 0 || goalIndex >= numPoints)
+		return false;
+
+	if (startIndex == goalIndex)
+	{
+		pPath->push_back(startIndex);
+		*pCost = 0.f;
+		return true;
+	}
+
+	this->PrepareSearch(pSearch, m_nodeClusters.size());
+
+	int startCluster = this->GetClusterOf(startIndex);
+	int goalCluster = this->GetClusterOf(goalIndex);
+
+	const Cluster *pStartCluster = &m_clusters[startCluster];
+	const Cluster *pGoalCluster = &m_clusters[goalCluster];
+
+	// Start to its cluster's crossing points, and the same from the
+	// goal's end.
+	this->SearchCluster(startCluster, startIndex, pStartCluster->nodes.empty() ? NULL : &pStartCluster->nodes[0], pStartCluster->nodes.size(), &pSearch->m_startSearch);
+
+	this->SearchCluster(goalCluster, goalIndex, pGoalCluster->nodes.empty() ? NULL : &pGoalCluster->nodes[0], pGoalCluster->nodes.size(), &pSearch->m_goalSearch);
+
+	// -1 for a path found by searching the grid directly.
+	int bestNode = -1;
+	float bestCost = FLT_MAX;
+	bool found = false;
+
+	// Going via crossing points can be a long way round when the start
+	// and goal are close, so search the grid around them too.
+	int startCol = startIndex % m_width, startRow = startIndex / m_width;
+	int goalCol = goalIndex % m_width, goalRow = goalIndex / m_width;
+
+	if (abs(goalCol - startCol) <= m_clusterSize && abs(goalRow - startRow) <= m_clusterSize)
+	{
+		int margin = m_clusterSize / 2;
+
+		int minCol = std::max(std::min(startCol, goalCol) - margin, 0);
+		int minRow = std::max(std::min(startRow, goalRow) - margin, 0);
+		int maxCol = std::min(std::max(startCol, goalCol) + margin, m_width - 1);
+		int maxRow = std::min(std::max(startRow, goalRow) + margin, m_length - 1);
+
+		this->SearchArea(minCol, minRow, maxCol, maxRow, startIndex, &goalIndex, 1, &pSearch->m_nearbySearch);
+
+		found = this->GetClusterSearchCost(pSearch->m_nearbySearch, goalIndex, &bestCost);
+	}
+
+	// Landmark bounds for the heuristic. The goal's cluster's crossing
+	// points are the only ways in to the goal, so the cost from a
+	// landmark to the goal is at least the lowest of its costs to each
+	// of them plus the cost from there to the goal. The cost from the
+	// goal back round to a landmark is limited the same way.
+	int firstGoalNode = m_firstNodes[goalCluster];
+
+	pSearch->m_landmarkBounds.resize(NUM_LANDMARKS * 2);
+
+	for (int i = 0; i < NUM_LANDMARKS; ++i)
+	{
+		pSearch->m_landmarkBounds[i * 2 + 0] = FLT_MAX;
+		pSearch->m_landmarkBounds[i * 2 + 1] = -FLT_MAX;
+	}
+
+	for (size_t i = 0; i < pGoalCluster->nodes.size(); ++i)
+	{
+		float goalCost;
+		if (!this->GetClusterSearchCost(pSearch->m_goalSearch, pGoalCluster->nodes[i], &goalCost))
+			continue;
+
+		const float *pLandmarkCosts = &m_landmarkCosts[(firstGoalNode + i) * NUM_LANDMARKS];
+
+		for (int j = 0; j < NUM_LANDMARKS; ++j)
+		{
+			if (pLandmarkCosts[j] == FLT_MAX)
+				continue;
+
+			pSearch->m_landmarkBounds[j * 2 + 0] = std::min(pSearch->m_landmarkBounds[j * 2 + 0], pLandmarkCosts[j] + goalCost);
+			pSearch->m_landmarkBounds[j * 2 + 1] = std::max(pSearch->m_landmarkBounds[j * 2 + 1], pLandmarkCosts[j] - goalCost);
+		}
+	}
+
+	// A* over the crossing points.
+	int firstStartNode = m_firstNodes[startCluster];
+
+	for (size_t i = 0; i < pStartCluster->nodes.size(); ++i)
+	{
+		float cost;
+		if (this->GetClusterSearchCost(pSearch->m_startSearch, pStartCluster->nodes[i], &cost))
+			this->AddToOpenList(pSearch, firstStartNode + int(i), cost, -1, 0, goalIndex);
+	}
+
+	while (!pSearch->m_heap.empty())
+	{
+		TerrainPathSearch::HeapEntry entry = pSearch->m_heap.front();
+		std::pop_heap(pSearch->m_heap.begin(), pSearch->m_heap.end(), std::greater<TerrainPathSearch::HeapEntry>());
+		pSearch->m_heap.pop_back();
+
+		// The heuristic never overestimates, so nothing left can beat
+		// the best so far.
+		if (entry.f >= bestCost)
+			break;
+
+		int node = entry.node;
+
+		if (pSearch->m_doneStamps[node] == pSearch->m_stamp)
+			continue;
+
+		pSearch->m_doneStamps[node] = pSearch->m_stamp;
+
+		float nodeCost = pSearch->m_costs[node];
+		int cluster = m_nodeClusters[node];
+		int firstNode = m_firstNodes[cluster];
+		const Cluster *pCluster = &m_clusters[cluster];
+		int localNode = node - firstNode;
+
+		if (cluster == goalCluster)
+		{
+			float goalCost;
+			if (this->GetClusterSearchCost(pSearch->m_goalSearch, m_nodeIndices[node], &goalCost) && nodeCost + goalCost < bestCost)
+			{
+				bestCost = nodeCost + goalCost;
+				bestNode = node;
+				found = true;
+			}
+		}
+
+		// Paths across the cluster, then crossings to the next ones.
+		for (int i = pCluster->firstEdges[localNode]; i < pCluster->firstEdges[localNode + 1]; ++i)
+		{
+			const ClusterEdge *pEdge = &pCluster->edges[i];
+
+			this->AddToOpenList(pSearch, firstNode + pEdge->toNode, nodeCost + pEdge->cost, node, i, goalIndex);
+		}
+
+		for (int i = m_firstCrossingEdges[node]; i < m_firstCrossingEdges[node + 1]; ++i)
+		{
+			const CrossingEdge *pEdge = &m_crossingEdges[i];
+
+			this->AddToOpenList(pSearch, pEdge->toNode, nodeCost + pEdge->cost, node, ~i, goalIndex);
+		}
+	}
+
+	pSearch->m_heap.clear();
+
+	if (!found)
+		return false;
+
+	pPath->push_back(startIndex);
+
+	if (bestNode < 0)
+	{
+		this->AppendClusterSearchPath(pSearch->m_nearbySearch, goalIndex, true, pPath);
+	}
+	else
+	{
+		pSearch->m_chain.clear();
+
+		for (int node = bestNode; node >= 0; node = pSearch->m_parents[node])
+			pSearch->m_chain.push_back(node);
+
+		std::reverse(pSearch->m_chain.begin(), pSearch->m_chain.end());
+
+		this->AppendClusterSearchPath(pSearch->m_startSearch, m_nodeIndices[pSearch->m_chain[0]], true, pPath);
+
+		for (size_t i = 1; i < pSearch->m_chain.size(); ++i)
+		{
+			int node = pSearch->m_chain[i];
+			int edge = pSearch->m_parentEdges[node];
+			int index = pPath->back();
+
+			if (edge >= 0)
+			{
+				const Cluster *pCluster = &m_clusters[m_nodeClusters[node]];
+				const ClusterEdge *pEdge = &pCluster->edges[edge];
+
+				for (uint32_t j = 0; j < pEdge->numMoves; ++j)
+				{
+					index += m_dirOffsets[pCluster->moves[pEdge->firstMove + j]];
+					pPath->push_back(index);
+				}
+			}
+			else
+			{
+				pPath->push_back(index + m_dirOffsets[m_crossingEdges[~edge].dir]);
+			}
+		}
+
+		this->AppendClusterSearchPath(pSearch->m_goalSearch, pPath->back(), false, pPath);
+	}
+
+	*pCost = bestCost;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainPathfinder::FindPathReference(int startIndex, int goalIndex, TerrainPathSearch *pSearch, std::vector<int> *pPath, float *pCost) const
+{
+	pPath->clear();
+
+	int numPoints = m_width * m_length;
+
+	if (m_clusters.empty() || startIndex < 0 || startIndex >= numPoints || goalIndex < 0 || goalIndex >= numPoints)
+		return false;
+
+	this->PrepareSearch(pSearch, size_t(numPoints));
+
+	pSearch->m_seenStamps[startIndex] = pSearch->m_stamp;
+	pSearch->m_costs[startIndex] = 0.f;
+	pSearch->m_parents[startIndex] = -1;
+
+	TerrainPathSearch::HeapEntry entry = {this->GetHeuristic(startIndex, goalIndex), startIndex};
+	pSearch->m_heap.push_back(entry);
+
+	bool found = false;
+
+	while (!pSearch->m_heap.empty())
+	{
+		entry = pSearch->m_heap.front();
+		std::pop_heap(pSearch->m_heap.begin(), pSearch->m_heap.end(), std::greater<TerrainPathSearch::HeapEntry>());
+		pSearch->m_heap.pop_back();
+
+		int index = entry.node;
+
+		if (pSearch->m_doneStamps[index] == pSearch->m_stamp)
+			continue;
+
+		pSearch->m_doneStamps[index] = pSearch->m_stamp;
+
+		if (index == goalIndex)
+		{
+			found = true;
+			break;
+		}
+
+		int col = index % m_width;
+		int row = index / m_width;
+
+		for (int dir = 0; dir < 8; ++dir)
+		{
+			int toCol = col + DIR_COLS[dir];
+			int toRow = row + DIR_ROWS[dir];
+
+			if (toCol < 0 || toCol >= m_width || toRow < 0 || toRow >= m_length)
+				continue;
+
+			float moveCost = this->GetMoveCost(index, dir);
+			if (moveCost < 0.f)
+				continue;
+
+			int toIndex = index + m_dirOffsets[dir];
+			float cost = pSearch->m_costs[index] + moveCost;
+
+			if (pSearch->m_doneStamps[toIndex] == pSearch->m_stamp)
+				continue;
+
+			if (pSearch->m_seenStamps[toIndex] == pSearch->m_stamp && pSearch->m_costs[toIndex] <= cost)
+				continue;
+
+			pSearch->m_seenStamps[toIndex] = pSearch->m_stamp;
+			pSearch->m_costs[toIndex] = cost;
+			pSearch->m_parents[toIndex] = index;
+
+			TerrainPathSearch::HeapEntry next = {cost + this->GetHeuristic(toIndex, goalIndex), toIndex};
+			pSearch->m_heap.push_back(next);
+			std::push_heap(pSearch->m_heap.begin(), pSearch->m_heap.end(), std::greater<TerrainPathSearch::HeapEntry>());
+		}
+	}
+
+	pSearch->m_heap.clear();
+
+	if (!found)
+		return false;
+
+	for (int index = goalIndex; index >= 0; index = pSearch->m_parents[index])
+		pPath->push_back(index);
+
+	std::reverse(pPath->begin(), pPath->end());
+
+	*pCost = pSearch->m_costs[goalIndex];
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainPathfinder::FindPaths(const int *pStartIndices, const int *pGoalIndices, size_t numPaths, std::vector<int> *pPaths, float *pCosts, bool *pFound, unsigned maxNumThreads) const
+{
+	if (maxNumThreads == 0)
+	{
+		maxNumThreads = std::thread::hardware_concurrency();
+
+		if (maxNumThreads == 0)
+			maxNumThreads = 1;// unknown
+	}
+
+	// One job per thread, each with its own search working space,
+	// taking paths from a shared counter.
+	size_t numJobs = std::min(size_t(maxNumThreads), numPaths);
+	std::atomic<size_t> nextPath(0);
+
+	RunParallelJobs(numJobs, maxNumThreads,
+		[&](size_t, std::string *)
+		{
+			TerrainPathSearch search;
+
+			for (;;)
+			{
+				size_t i = nextPath.fetch_add(1);
+				if (i >= numPaths)
+					break;
+
+				pFound[i] = this->FindPath(pStartIndices[i], pGoalIndices[i], &search, &pPaths[i], &pCosts[i]);
+			}
+
+			return true;
+		},
+		NULL);
+
+	size_t numFound = 0;
+
+	for (size_t i = 0; i < numPaths; ++i)
+	{
+		if (pFound[i])
+			++numFound;
+	}
+
+	return numFound;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainPathfinder::GetNumNodes() const
+{
+	return int(m_nodeClusters.size());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::GetClusterBounds(int cluster, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow) const
+{
+	int clusterCol = cluster % m_numClusterCols;
+	int clusterRow = cluster / m_numClusterCols;
+
+	*pMinCol = clusterCol * m_clusterSize;
+	*pMinRow = clusterRow * m_clusterSize;
+	*pMaxCol = std::min(*pMinCol + m_clusterSize, m_width) - 1;
+	*pMaxRow = std::min(*pMinRow + m_clusterSize, m_length) - 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainPathfinder::GetClusterOf(int index) const
+{
+	int col = index % m_width;
+	int row = index / m_width;
+
+	return row / m_clusterSize * m_numClusterCols + col / m_clusterSize;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainPathfinder::FindNode(int cluster, int index) const
+{
+	const std::vector<int> *pNodes = &m_clusters[cluster].nodes;
+
+	std::vector<int>::const_iterator it = std::lower_bound(pNodes->begin(), pNodes->end(), index);
+
+	if (it == pNodes->end() || *it != index)
+		return -1;
+
+	return int(it - pNodes->begin());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float TerrainPathfinder::GetMoveCost(int index, int dir) const
+{
+	float rise = fabsf(m_pHeights[index + m_dirOffsets[dir]] - m_pHeights[index]);
+
+	if (rise > m_maxRises[dir])
+		return -1.f;
+
+	return m_moveLengths[dir] + rise * m_pathCosts.climbPenalty;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float TerrainPathfinder::GetHeuristic(int index, int goalIndex) const
+{
+	// Shortest 8-way path length, ignoring height. No move costs less
+	// than its length, so this never overestimates.
+	int cols = abs(index % m_width - goalIndex % m_width);
+	int rows = abs(index / m_width - goalIndex / m_width);
+
+	// Directions 1 and 0 are diagonal and along a row, 2 down a column.
+	if (cols >= rows)
+		return float(rows) * m_moveLengths[1] + float(cols - rows) * m_moveLengths[0];
+	else
+		return float(cols) * m_moveLengths[1] + float(rows - cols) * m_moveLengths[2];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::BuildTransitions(int cluster, bool right, std::vector<Transition> *pTransitions) const
+{
+	pTransitions->clear();
+
+	int minCol, minRow, maxCol, maxRow;
+	this->GetClusterBounds(cluster, &minCol, &minRow, &maxCol, &maxRow);
+
+	// Border points on this side, and the direction across.
+	int dir, firstIndex, step, numPoints;
+
+	if (right)
+	{
+		if (maxCol == m_width - 1)
+			return;
+
+		dir = 0;
+		firstIndex = minRow * m_width + maxCol;
+		step = m_width;
+		numPoints = maxRow - minRow + 1;
+	}
+	else
+	{
+		if (maxRow == m_length - 1)
+			return;
+
+		dir = 2;
+		firstIndex = maxRow * m_width + minCol;
+		step = 1;
+		numPoints = maxCol - minCol + 1;
+	}
+
+	// Runs of points that can cross.
+	int runStart = -1;
+
+	for (int i = 0; i <= numPoints; ++i)
+	{
+		bool open = i < numPoints && this->GetMoveCost(firstIndex + i * step, dir) >= 0.f;
+
+		if (open)
+		{
+			if (runStart < 0)
+				runStart = i;
+
+			continue;
+		}
+
+		if (runStart < 0)
+			continue;
+
+		int runLength = i - runStart;
+		int crossings[2];
+		int numCrossings;
+
+		if (runLength >= LONG_ENTRANCE_SIZE)
+		{
+			crossings[0] = runStart;
+			crossings[1] = i - 1;
+			numCrossings = 2;
+		}
+		else
+		{
+			crossings[0] = runStart + runLength / 2;
+			numCrossings = 1;
+		}
+
+		for (int j = 0; j < numCrossings; ++j)
+		{
+			Transition transition;
+			transition.fromIndex = firstIndex + crossings[j] * step;
+			transition.toIndex = transition.fromIndex + m_dirOffsets[dir];
+			transition.cost = this->GetMoveCost(transition.fromIndex, dir);
+
+			pTransitions->push_back(transition);
+		}
+
+		runStart = -1;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::BuildClusterEdges(int cluster, TerrainPathSearch::ClusterSearch *pSearch)
+{
+	Cluster *pCluster = &m_clusters[cluster];
+
+	int clusterCol = cluster % m_numClusterCols;
+	int clusterRow = cluster / m_numClusterCols;
+
+	// Crossing points are this cluster's ends of its own transitions,
+	// and the far ends of the transitions from the left and above.
+	pCluster->nodes.clear();
+
+	for (size_t i = 0; i < pCluster->rightTransitions.size(); ++i)
+		pCluster->nodes.push_back(pCluster->rightTransitions[i].fromIndex);
+
+	for (size_t i = 0; i < pCluster->downTransitions.size(); ++i)
+		pCluster->nodes.push_back(pCluster->downTransitions[i].fromIndex);
+
+	if (clusterCol > 0)
+	{
+		const std::vector<Transition> *pLeft = &m_clusters[cluster - 1].rightTransitions;
+
+		for (size_t i = 0; i < pLeft->size(); ++i)
+			pCluster->nodes.push_back((*pLeft)[i].toIndex);
+	}
+
+	if (clusterRow > 0)
+	{
+		const std::vector<Transition> *pAbove = &m_clusters[cluster - m_numClusterCols].downTransitions;
+
+		for (size_t i = 0; i < pAbove->size(); ++i)
+			pCluster->nodes.push_back((*pAbove)[i].toIndex);
+	}
+
+	std::sort(pCluster->nodes.begin(), pCluster->nodes.end());
+	pCluster->nodes.erase(std::unique(pCluster->nodes.begin(), pCluster->nodes.end()), pCluster->nodes.end());
+
+	// Paths between each pair. Costs are the same both ways, so each
+	// search only needs to go to the nodes after its own, and the path
+	// back is the same one reversed.
+	int numNodes = int(pCluster->nodes.size());
+
+	std::vector<std::vector<ClusterEdge> > nodeEdges(numNodes);
+	pCluster->moves.clear();
+
+	std::vector<uint8_t> moves;
+
+	for (int i = 0; i < numNodes; ++i)
+	{
+		if (i + 1 == numNodes)
+			break;
+
+		this->SearchCluster(cluster, pCluster->nodes[i], &pCluster->nodes[i + 1], numNodes - i - 1, pSearch);
+
+		for (int j = i + 1; j < numNodes; ++j)
+		{
+			float cost;
+			if (!this->GetClusterSearchCost(*pSearch, pCluster->nodes[j], &cost))
+				continue;
+
+			// Walk back from j, which gives the moves from i to j in
+			// reverse.
+			moves.clear();
+
+			for (int local = this->GetSearchLocal(*pSearch, pCluster->nodes[j]); local != pSearch->sourceLocal;)
+			{
+				int dir = pSearch->arrivalDirs[local];
+				moves.push_back(uint8_t(dir));
+
+				local -= pSearch->localOffsets[dir];
+			}
+
+			ClusterEdge edge;
+			edge.cost = cost;
+			edge.numMoves = uint32_t(moves.size());
+
+			edge.toNode = j;
+			edge.firstMove = uint32_t(pCluster->moves.size());
+			nodeEdges[i].push_back(edge);
+
+			for (size_t k = moves.size(); k > 0; --k)
+				pCluster->moves.push_back(moves[k - 1]);
+
+			edge.toNode = i;
+			edge.firstMove = uint32_t(pCluster->moves.size());
+			nodeEdges[j].push_back(edge);
+
+			for (size_t k = 0; k < moves.size(); ++k)
+				pCluster->moves.push_back(uint8_t(GetOppositeDir(moves[k])));
+		}
+	}
+
+	pCluster->firstEdges.resize(numNodes + 1);
+	pCluster->edges.clear();
+
+	for (int i = 0; i < numNodes; ++i)
+	{
+		pCluster->firstEdges[i] = int(pCluster->edges.size());
+		pCluster->edges.insert(pCluster->edges.end(), nodeEdges[i].begin(), nodeEdges[i].end());
+	}
+
+	pCluster->firstEdges[numNodes] = int(pCluster->edges.size());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::BuildClusters(int minClusterCol, int minClusterRow, int maxClusterCol, int maxClusterRow, unsigned maxNumThreads)
+{
+	int numCols = maxClusterCol - minClusterCol + 1;
+	int numRows = maxClusterRow - minClusterRow + 1;
+
+	// Transitions first, as each cluster's crossing points come from
+	// its neighbours' transitions as well as its own.
+	RunParallelJobs(size_t(numCols) * numRows, maxNumThreads,
+		[&](size_t jobIndex, std::string *)
+		{
+			int cluster = (minClusterRow + int(jobIndex) / numCols) * m_numClusterCols + minClusterCol + int(jobIndex) % numCols;
+
+			this->BuildTransitions(cluster, true, &m_clusters[cluster].rightTransitions);
+			this->BuildTransitions(cluster, false, &m_clusters[cluster].downTransitions);
+
+			return true;
+		},
+		NULL);
+
+	// The transitions into the top and left clusters of the range may
+	// have changed too.
+	if (minClusterCol > 0)
+	{
+		for (int row = minClusterRow; row <= maxClusterRow; ++row)
+		{
+			int cluster = row * m_numClusterCols + minClusterCol - 1;
+			this->BuildTransitions(cluster, true, &m_clusters[cluster].rightTransitions);
+		}
+	}
+
+	if (minClusterRow > 0)
+	{
+		for (int col = minClusterCol; col <= maxClusterCol; ++col)
+		{
+			int cluster = (minClusterRow - 1) * m_numClusterCols + col;
+			this->BuildTransitions(cluster, false, &m_clusters[cluster].downTransitions);
+		}
+	}
+
+	RunParallelJobs(size_t(numCols) * numRows, maxNumThreads,
+		[&](size_t jobIndex, std::string *)
+		{
+			int cluster = (minClusterRow + int(jobIndex) / numCols) * m_numClusterCols + minClusterCol + int(jobIndex) % numCols;
+
+			TerrainPathSearch::ClusterSearch search;
+			this->BuildClusterEdges(cluster, &search);
+
+			return true;
+		},
+		NULL);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::BuildGraph()
+{
+	size_t numClusters = m_clusters.size();
+
+	m_firstNodes.resize(numClusters + 1);
+	m_nodeClusters.clear();
+	m_nodeIndices.clear();
+
+	for (size_t i = 0; i < numClusters; ++i)
+	{
+		m_firstNodes[i] = int(m_nodeClusters.size());
+		m_nodeClusters.insert(m_nodeClusters.end(), m_clusters[i].nodes.size(), int(i));
+		m_nodeIndices.insert(m_nodeIndices.end(), m_clusters[i].nodes.begin(), m_clusters[i].nodes.end());
+	}
+
+	m_firstNodes[numClusters] = int(m_nodeClusters.size());
+
+	// Each transition is a crossing edge each way. Count them up per
+	// node, then fill them in.
+	size_t numNodes = m_nodeClusters.size();
+
+	std::vector<int> numEdges(numNodes, 0);
+
+	struct Crossing
+	{
+		int fromNode, toNode;
+		float cost;
+		int dir;
+	};
+
+	std::vector<Crossing> crossings;
+
+	for (size_t i = 0; i < numClusters; ++i)
+	{
+		for (int side = 0; side < 2; ++side)
+		{
+			const std::vector<Transition> *pTransitions = side == 0 ? &m_clusters[i].rightTransitions : &m_clusters[i].downTransitions;
+			int toCluster = side == 0 ? int(i) + 1 : int(i) + m_numClusterCols;
+			int dir = side == 0 ? 0 : 2;
+
+			for (size_t j = 0; j < pTransitions->size(); ++j)
+			{
+				const Transition *pTransition = &(*pTransitions)[j];
+
+				Crossing crossing;
+				crossing.fromNode = m_firstNodes[i] + this->FindNode(int(i), pTransition->fromIndex);
+				crossing.toNode = m_firstNodes[toCluster] + this->FindNode(toCluster, pTransition->toIndex);
+				crossing.cost = pTransition->cost;
+				crossing.dir = dir;
+
+				crossings.push_back(crossing);
+
+				++numEdges[crossing.fromNode];
+				++numEdges[crossing.toNode];
+			}
+		}
+	}
+
+	m_firstCrossingEdges.resize(numNodes + 1);
+	m_firstCrossingEdges[0] = 0;
+
+	for (size_t i = 0; i < numNodes; ++i)
+		m_firstCrossingEdges[i + 1] = m_firstCrossingEdges[i] + numEdges[i];
+
+	m_crossingEdges.resize(crossings.size() * 2);
+
+	std::fill(numEdges.begin(), numEdges.end(), 0);
+
+	for (size_t i = 0; i < crossings.size(); ++i)
+	{
+		const Crossing *pCrossing = &crossings[i];
+
+		CrossingEdge *pEdge = &m_crossingEdges[m_firstCrossingEdges[pCrossing->fromNode] + numEdges[pCrossing->fromNode]++];
+		pEdge->toNode = pCrossing->toNode;
+		pEdge->cost = pCrossing->cost;
+		pEdge->dir = pCrossing->dir;
+
+		pEdge = &m_crossingEdges[m_firstCrossingEdges[pCrossing->toNode] + numEdges[pCrossing->toNode]++];
+		pEdge->toNode = pCrossing->fromNode;
+		pEdge->cost = pCrossing->cost;
+		pEdge->dir = GetOppositeDir(pCrossing->dir);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::BuildLandmarks(unsigned maxNumThreads)
+{
+	size_t numNodes = m_nodeClusters.size();
+
+	m_landmarkCosts.clear();
+	m_landmarkCosts.resize(numNodes * NUM_LANDMARKS, FLT_MAX);
+
+	if (numNodes == 0)
+	{
+		m_landmarkIndices.clear();
+		return;
+	}
+
+	// Keep the same landmarks if they're all still crossing points. It
+	// doesn't matter much where they are, and finding them is the one
+	// part that can't be done in parallel.
+	bool keepLandmarks = m_landmarkIndices.size() == NUM_LANDMARKS;
+
+	for (size_t i = 0; i < m_landmarkIndices.size() && keepLandmarks; ++i)
+	{
+		if (this->FindNode(this->GetClusterOf(m_landmarkIndices[i]), m_landmarkIndices[i]) < 0)
+			keepLandmarks = false;
+	}
+
+	if (keepLandmarks)
+	{
+		RunParallelJobs(NUM_LANDMARKS, maxNumThreads,
+			[&](size_t jobIndex, std::string *)
+			{
+				int index = m_landmarkIndices[jobIndex];
+				int node = m_firstNodes[this->GetClusterOf(index)] + this->FindNode(this->GetClusterOf(index), index);
+
+				TerrainPathSearch search;
+				this->SearchGraph(node, &search);
+
+				for (size_t i = 0; i < numNodes; ++i)
+					m_landmarkCosts[i * NUM_LANDMARKS + jobIndex] = search.m_doneStamps[i] == search.m_stamp ? search.m_costs[i] : FLT_MAX;
+
+				return true;
+			},
+			NULL);
+
+		return;
+	}
+
+	// Each new landmark is the node furthest from the ones so far, so
+	// they end up spread round the edges of the map. Nodes that can't be
+	// reached at all count as furthest, so that every separate region
+	// gets a landmark, as far as there are enough to go round.
+	m_landmarkIndices.clear();
+
+	TerrainPathSearch search;
+	std::vector<float> nearestCosts(numNodes);
+
+	this->SearchGraph(0, &search);
+
+	for (size_t i = 0; i < numNodes; ++i)
+		nearestCosts[i] = search.m_doneStamps[i] == search.m_stamp ? search.m_costs[i] : FLT_MAX;
+
+	for (int i = 0; i < NUM_LANDMARKS; ++i)
+	{
+		size_t furthest = std::max_element(nearestCosts.begin(), nearestCosts.end()) - nearestCosts.begin();
+
+		m_landmarkIndices.push_back(m_nodeIndices[furthest]);
+
+		this->SearchGraph(int(furthest), &search);
+
+		for (size_t j = 0; j < numNodes; ++j)
+		{
+			float cost = search.m_doneStamps[j] == search.m_stamp ? search.m_costs[j] : FLT_MAX;
+
+			m_landmarkCosts[j * NUM_LANDMARKS + i] = cost;
+			nearestCosts[j] = std::min(nearestCosts[j], cost);
+		}
+
+		// Don't pick the same one twice.
+		nearestCosts[furthest] = -1.f;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::SearchGraph(int sourceNode, TerrainPathSearch *pSearch) const
+{
+	this->PrepareSearch(pSearch, m_nodeClusters.size());
+
+	pSearch->m_seenStamps[sourceNode] = pSearch->m_stamp;
+	pSearch->m_costs[sourceNode] = 0.f;
+
+	TerrainPathSearch::HeapEntry entry = {0.f, sourceNode};
+	pSearch->m_heap.push_back(entry);
+
+	while (!pSearch->m_heap.empty())
+	{
+		entry = pSearch->m_heap.front();
+		std::pop_heap(pSearch->m_heap.begin(), pSearch->m_heap.end(), std::greater<TerrainPathSearch::HeapEntry>());
+		pSearch->m_heap.pop_back();
+
+		int node = entry.node;
+
+		if (pSearch->m_doneStamps[node] == pSearch->m_stamp)
+			continue;
+
+		pSearch->m_doneStamps[node] = pSearch->m_stamp;
+
+		float nodeCost = pSearch->m_costs[node];
+		int cluster = m_nodeClusters[node];
+		int firstNode = m_firstNodes[cluster];
+		const Cluster *pCluster = &m_clusters[cluster];
+		int localNode = node - firstNode;
+
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			int begin = pass == 0 ? pCluster->firstEdges[localNode] : m_firstCrossingEdges[node];
+			int end = pass == 0 ? pCluster->firstEdges[localNode + 1] : m_firstCrossingEdges[node + 1];
+
+			for (int i = begin; i < end; ++i)
+			{
+				int toNode = pass == 0 ? firstNode + pCluster->edges[i].toNode : m_crossingEdges[i].toNode;
+				float cost = nodeCost + (pass == 0 ? pCluster->edges[i].cost : m_crossingEdges[i].cost);
+
+				if (pSearch->m_seenStamps[toNode] == pSearch->m_stamp && pSearch->m_costs[toNode] <= cost)
+					continue;
+
+				pSearch->m_seenStamps[toNode] = pSearch->m_stamp;
+				pSearch->m_costs[toNode] = cost;
+
+				TerrainPathSearch::HeapEntry next = {cost, toNode};
+				pSearch->m_heap.push_back(next);
+				std::push_heap(pSearch->m_heap.begin(), pSearch->m_heap.end(), std::greater<TerrainPathSearch::HeapEntry>());
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::AddToOpenList(TerrainPathSearch *pSearch, int node, float cost, int parent, int parentEdge, int goalIndex) const
+{
+	uint32_t stamp = pSearch->m_stamp;
+
+	if (pSearch->m_seenStamps[node] == stamp)
+	{
+		if (pSearch->m_doneStamps[node] == stamp || pSearch->m_costs[node] <= cost)
+			return;
+	}
+	else
+	{
+		pSearch->m_seenStamps[node] = stamp;
+		pSearch->m_heuristics[node] = this->GetNodeHeuristic(node, goalIndex, *pSearch);
+	}
+
+	pSearch->m_costs[node] = cost;
+	pSearch->m_parents[node] = parent;
+	pSearch->m_parentEdges[node] = parentEdge;
+
+	// No way to the goal from here.
+	if (pSearch->m_heuristics[node] == FLT_MAX)
+		return;
+
+	TerrainPathSearch::HeapEntry entry = {cost + pSearch->m_heuristics[node], node};
+	pSearch->m_heap.push_back(entry);
+	std::push_heap(pSearch->m_heap.begin(), pSearch->m_heap.end(), std::greater<TerrainPathSearch::HeapEntry>());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float TerrainPathfinder::GetNodeHeuristic(int node, int goalIndex, const TerrainPathSearch &search) const
+{
+	float h = this->GetHeuristic(m_nodeIndices[node], goalIndex);
+
+	// Triangle inequality: the cost from a node to the goal is at least
+	// the difference between the landmark's costs to each.
+	const float *pLandmarkCosts = &m_landmarkCosts[size_t(node) * NUM_LANDMARKS];
+	const float *pBounds = &search.m_landmarkBounds[0];
+
+	for (int i = 0; i < NUM_LANDMARKS; ++i)
+	{
+		float cost = pLandmarkCosts[i];
+		float minToGoal = pBounds[i * 2 + 0];
+		float maxToGoal = pBounds[i * 2 + 1];
+
+		// If the landmark can get to one and not the other, they're not
+		// connected.
+		if (cost == FLT_MAX || minToGoal == FLT_MAX)
+		{
+			if (cost != minToGoal)
+				return FLT_MAX;
+
+			continue;
+		}
+
+		h = std::max(h, std::max(minToGoal - cost, cost - maxToGoal));
+	}
+
+	return h;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::SearchCluster(int cluster, int sourceIndex, const int *pTargets, size_t numTargets, TerrainPathSearch::ClusterSearch *pSearch) const
+{
+	int minCol, minRow, maxCol, maxRow;
+	this->GetClusterBounds(cluster, &minCol, &minRow, &maxCol, &maxRow);
+
+	this->SearchArea(minCol, minRow, maxCol, maxRow, sourceIndex, pTargets, numTargets, pSearch);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::SearchArea(int minCol, int minRow, int maxCol, int maxRow, int sourceIndex, const int *pTargets, size_t numTargets, TerrainPathSearch::ClusterSearch *pSearch) const
+{
+	pSearch->minCol = minCol;
+	pSearch->minRow = minRow;
+
+	// There's a border of points round the edge, marked as done, so
+	// there's no need to check each move stays inside. Rows are a power
+	// of 2 apart, so the row and column are quick to get back.
+	int numCols = maxCol - minCol + 1;
+	int numRows = maxRow - minRow + 1;
+
+	pSearch->shift = 0;
+
+	while ((1 << pSearch->shift) < numCols + 2)
+		++pSearch->shift;
+
+	for (int dir = 0; dir < 8; ++dir)
+		pSearch->localOffsets[dir] = DIR_ROWS[dir] * (1 << pSearch->shift) + DIR_COLS[dir];
+
+	size_t numPoints = size_t(numRows + 2) << pSearch->shift;
+
+	if (pSearch->costs.size() < numPoints)
+	{
+		pSearch->seenStamps.resize(numPoints, 0);
+		pSearch->doneStamps.resize(numPoints, 0);
+		pSearch->targetStamps.resize(numPoints, 0);
+		pSearch->costs.resize(numPoints);
+		pSearch->arrivalDirs.resize(numPoints);
+	}
+
+	NextStamp(&pSearch->stamp, &pSearch->seenStamps, &pSearch->doneStamps, &pSearch->targetStamps);
+
+	uint32_t stamp = pSearch->stamp;
+
+	for (int col = 0; col < numCols + 2; ++col)
+	{
+		pSearch->doneStamps[col] = stamp;
+		pSearch->doneStamps[(size_t(numRows + 1) << pSearch->shift) + col] = stamp;
+	}
+
+	for (int row = 1; row <= numRows; ++row)
+	{
+		pSearch->doneStamps[size_t(row) << pSearch->shift] = stamp;
+		pSearch->doneStamps[(size_t(row) << pSearch->shift) + numCols + 1] = stamp;
+	}
+
+	// Distinct targets still to reach.
+	size_t numLeft = 0;
+
+	for (size_t i = 0; i < numTargets; ++i)
+	{
+		int local = this->GetSearchLocal(*pSearch, pTargets[i]);
+
+		if (pSearch->targetStamps[local] != stamp)
+		{
+			pSearch->targetStamps[local] = stamp;
+			++numLeft;
+		}
+	}
+
+	int sourceLocal = this->GetSearchLocal(*pSearch, sourceIndex);
+
+	pSearch->sourceLocal = sourceLocal;
+	pSearch->seenStamps[sourceLocal] = stamp;
+	pSearch->costs[sourceLocal] = 0.f;
+
+	// Dial's algorithm. Every move costs at least a bucket's width, so
+	// nothing can improve anything else in the same bucket, and the
+	// points in a bucket can be done in any order. The buckets are a
+	// ring; anything too far ahead to fit waits in a heap.
+	std::vector<int> *pBuckets = &pSearch->buckets[0];
+	std::vector<TerrainPathSearch::HeapEntry> *pOverflow = &pSearch->overflow;
+
+	for (size_t i = 0; i < TerrainPathSearch::NUM_BUCKETS; ++i)
+		pBuckets[i].clear();
+
+	pOverflow->clear();
+
+	size_t currentBucket = 0;
+	size_t numInBuckets = 0;
+
+	auto queue = [&](int local, float cost)
+	{
+		size_t bucket = size_t(cost * m_invBucketWidth);
+
+		if (bucket < currentBucket + TerrainPathSearch::NUM_BUCKETS)
+		{
+			pBuckets[bucket % TerrainPathSearch::NUM_BUCKETS].push_back(local);
+			++numInBuckets;
+		}
+		else
+		{
+			TerrainPathSearch::HeapEntry entry = {cost, local};
+			pOverflow->push_back(entry);
+			std::push_heap(pOverflow->begin(), pOverflow->end(), std::greater<TerrainPathSearch::HeapEntry>());
+		}
+	};
+
+	queue(sourceLocal, 0.f);
+
+	while (numLeft > 0)
+	{
+		if (numInBuckets == 0)
+		{
+			if (pOverflow->empty())
+				break;
+
+			currentBucket = size_t(pOverflow->front().f * m_invBucketWidth);
+		}
+
+		std::vector<int> *pBucket = &pBuckets[currentBucket % TerrainPathSearch::NUM_BUCKETS];
+
+		if (pBucket->empty())
+		{
+			++currentBucket;
+
+			// Bring in whatever now fits.
+			while (!pOverflow->empty() && size_t(pOverflow->front().f * m_invBucketWidth) < currentBucket + TerrainPathSearch::NUM_BUCKETS)
+			{
+				TerrainPathSearch::HeapEntry entry = pOverflow->front();
+				std::pop_heap(pOverflow->begin(), pOverflow->end(), std::greater<TerrainPathSearch::HeapEntry>());
+				pOverflow->pop_back();
+
+				queue(entry.node, entry.f);
+			}
+
+			continue;
+		}
+
+		int local = pBucket->back();
+		pBucket->pop_back();
+		--numInBuckets;
+
+		// A point is queued again each time its cost improves. The
+		// cheapest comes out first.
+		if (pSearch->doneStamps[local] == stamp)
+			continue;
+
+		pSearch->doneStamps[local] = stamp;
+
+		if (pSearch->targetStamps[local] == stamp)
+			--numLeft;
+
+		int col = (local & ((1 << pSearch->shift) - 1)) - 1;
+		int row = (local >> pSearch->shift) - 1;
+		int index = (minRow + row) * m_width + minCol + col;
+		float localCost = pSearch->costs[local];
+
+		for (int dir = 0; dir < 8; ++dir)
+		{
+			int toLocal = local + pSearch->localOffsets[dir];
+
+			if (pSearch->doneStamps[toLocal] == stamp)
+				continue;
+
+			float moveCost = this->GetMoveCost(index, dir);
+			if (moveCost < 0.f)
+				continue;
+
+			float cost = localCost + moveCost;
+
+			if (pSearch->seenStamps[toLocal] == stamp && pSearch->costs[toLocal] <= cost)
+				continue;
+
+			pSearch->seenStamps[toLocal] = stamp;
+			pSearch->costs[toLocal] = cost;
+			pSearch->arrivalDirs[toLocal] = uint8_t(dir);
+
+			queue(toLocal, cost);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainPathfinder::GetSearchLocal(const TerrainPathSearch::ClusterSearch &search, int index) const
+{
+	return ((index / m_width - search.minRow + 1) << search.shift) + index % m_width - search.minCol + 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainPathfinder::GetClusterSearchCost(const TerrainPathSearch::ClusterSearch &search, int index, float *pCost) const
+{
+	int local = this->GetSearchLocal(search, index);
+
+	if (search.doneStamps[local] != search.stamp)
+		return false;
+
+	*pCost = search.costs[local];
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::AppendClusterSearchPath(const TerrainPathSearch::ClusterSearch &search, int index, bool fromSource, std::vector<int> *pPath) const
+{
+	// Walking back from index towards the search's source gives the
+	// path from the source backwards. If fromSource, it's wanted the
+	// right way round, ending at index; otherwise it's wanted as it
+	// comes, after index and ending at the source.
+	size_t oldSize = pPath->size();
+
+	for (int local = this->GetSearchLocal(search, index); local != search.sourceLocal;)
+	{
+		if (fromSource)
+			pPath->push_back(index);
+
+		int dir = search.arrivalDirs[local];
+
+		local -= search.localOffsets[dir];
+		index -= m_dirOffsets[dir];
+
+		if (!fromSource)
+			pPath->push_back(index);
+	}
+
+	if (fromSource)
+		std::reverse(pPath->begin() + oldSize, pPath->end());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPathfinder::PrepareSearch(TerrainPathSearch *pSearch, size_t numNodes) const
+{
+	if (pSearch->m_costs.size() < numNodes)
+	{
+		pSearch->m_seenStamps.resize(numNodes, 0);
+		pSearch->m_doneStamps.resize(numNodes, 0);
+		pSearch->m_costs.resize(numNodes);
+		pSearch->m_parents.resize(numNodes);
+		pSearch->m_parentEdges.resize(numNodes);
+		pSearch->m_heuristics.resize(numNodes);
+	}
+
+	NextStamp(&pSearch->m_stamp, &pSearch->m_seenStamps, &pSearch->m_doneStamps, NULL);
+
+	pSearch->m_heap.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
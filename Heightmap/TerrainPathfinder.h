@@ -0,0 +1,289 @@
+#ifndef HEADER_53639DFD557949208548F41B15B0C093
+#define HEADER_53639DFD557949208548F41B15B0C093
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Paths over a HeightField's grid points that take the slope into
+// account.
+//
+// Each grid point connects to its 8 neighbours. A move costs its
+// horizontal length plus a penalty for the height climbed or dropped,
+// and moves steeper than a limit can't be made at all. Costs are the
+// same both ways.
+//
+// Searching the whole grid is too slow on big maps, so this does
+// HPA* (Botea, Muller and Schaeffer). The grid is split into square
+// clusters. Where a cluster meets its neighbour, each run of
+// crossable border gets 1 or 2 crossing points. Within each cluster,
+// the cheapest path between every pair of crossing points is worked
+// out in advance, moves and all. A query searches the small graph of
+// crossing points instead of the grid, then pastes the stored moves
+// together. Paths come out slightly more expensive than the best one,
+// typically by a few percent. (When the start and goal are close,
+// the grid round them is searched directly as well, as the detour via
+// crossing points can be much more than that.)
+//
+// The crossing points graph is searched with A*, using landmarks
+// (Goldberg and Harrelson's ALT) for the heuristic. Straight line
+// distance is a poor guess at the cost on hilly maps.
+//
+// UpdateRegion redoes just the clusters around a changed rectangle.
+//
+// The HeightField must outlast the pathfinder.
+//
+// FindPath doesn't change the pathfinder, so any number of threads
+// can search at once, as long as each has its own TerrainPathSearch.
+// UpdateRegion mustn't run at the same time as anything else.
+//
+// FindPathReference does plain A* over every grid point. It gives
+// the best path, slowly, and is there to check against.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+class HeightField;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TerrainPathCosts
+{
+	// Slope is height change over horizontal distance. Moves steeper
+	// than this can't be made.
+	float maxSlope;
+
+	// Each move costs its horizontal length, plus this much per unit
+	// of height change.
+	float climbPenalty;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Working space for a search. Keep one per thread and reuse it; it
+// only ever grows.
+class TerrainPathSearch
+{
+public:
+	TerrainPathSearch();
+	~TerrainPathSearch();
+protected:
+private:
+	friend class TerrainPathfinder;
+
+	// Cluster searches keep this many buckets on the go.
+	static const size_t NUM_BUCKETS = 64;
+
+	struct HeapEntry
+	{
+		float f;
+		int node;
+
+		// For a min-heap, with std::greater.
+		bool operator>(const HeapEntry &rhs) const {return f > rhs.f;}
+	};
+
+	// Dijkstra over a rectangle of grid points, usually a cluster.
+	// Arrays are indexed by position within the rectangle, as
+	// TerrainPathfinder::GetSearchLocal.
+	struct ClusterSearch
+	{
+		int minCol, minRow;
+		int shift;
+		int localOffsets[8];
+		int sourceLocal;
+
+		uint32_t stamp;
+		std::vector<uint32_t> seenStamps;
+		std::vector<uint32_t> doneStamps;
+		std::vector<uint32_t> targetStamps;
+		std::vector<float> costs;
+		std::vector<uint8_t> arrivalDirs;
+		std::vector<std::vector<int> > buckets;
+		std::vector<HeapEntry> overflow;
+
+		ClusterSearch();
+	};
+
+	ClusterSearch m_startSearch;
+	ClusterSearch m_goalSearch;
+	ClusterSearch m_nearbySearch;
+
+	// A* over the crossing points graph, or over every grid point for
+	// FindPathReference.
+	uint32_t m_stamp;
+	std::vector<uint32_t> m_seenStamps;
+	std::vector<uint32_t> m_doneStamps;
+	std::vector<float> m_costs;
+	std::vector<int> m_parents;
+	std::vector<int> m_parentEdges;
+	std::vector<float> m_heuristics;
+	std::vector<HeapEntry> m_heap;
+
+	// For each landmark, the lowest and highest its cost to the goal
+	// could be.
+	std::vector<float> m_landmarkBounds;
+
+	std::vector<int> m_chain;
+
+	TerrainPathSearch(const TerrainPathSearch &);
+	TerrainPathSearch &operator=(const TerrainPathSearch &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainPathfinder
+{
+public:
+	TerrainPathfinder();
+	~TerrainPathfinder();
+
+	// clusterSize is in grid points. 32-64 is about right; bigger makes
+	// for a smaller graph to search, but slower building and updating.
+	// Building is spread over up to maxNumThreads threads (0 means one
+	// per hardware thread).
+	bool Create(const HeightField *pHeightField, const TerrainPathCosts &costs, int clusterSize, unsigned maxNumThreads);
+	void Destroy();
+
+	// Call after the heights of the grid points from (minCol, minRow)
+	// to (maxCol, maxRow) inclusive have changed.
+	void UpdateRegion(int minCol, int minRow, int maxCol, int maxRow, unsigned maxNumThreads);
+
+	// Grid points are given as indices, row * width + col. *pPath gets
+	// the grid points along the path, start and goal included.
+	//
+	// Returns false if there's no way from one to the other.
+	bool FindPath(int startIndex, int goalIndex, TerrainPathSearch *pSearch, std::vector<int> *pPath, float *pCost) const;
+
+	// Best path over the full grid.
+	bool FindPathReference(int startIndex, int goalIndex, TerrainPathSearch *pSearch, std::vector<int> *pPath, float *pCost) const;
+
+	// Lots of FindPath calls, spread over up to maxNumThreads threads (0
+	// means one per hardware thread). pPaths[i] and pCosts[i] are only
+	// valid if pFound[i] is true. Returns the number of paths found.
+	size_t FindPaths(const int *pStartIndices, const int *pGoalIndices, size_t numPaths, std::vector<int> *pPaths, float *pCosts, bool *pFound, unsigned maxNumThreads) const;
+
+	// Size of the crossing points graph.
+	int GetNumNodes() const;
+protected:
+private:
+	// Crossing from a point in one cluster to the neighbouring point in
+	// the next cluster along, or down.
+	struct Transition
+	{
+		int fromIndex;
+		int toIndex;
+		float cost;
+	};
+
+	// Path between 2 crossing points in the same cluster. The moves are
+	// directions, as m_dirOffsets.
+	struct ClusterEdge
+	{
+		int toNode;// within the cluster
+		float cost;
+		uint32_t firstMove;
+		uint32_t numMoves;
+	};
+
+	struct Cluster
+	{
+		// To the cluster to the right, and the one below.
+		std::vector<Transition> rightTransitions;
+		std::vector<Transition> downTransitions;
+
+		// Grid indices of the crossing points, sorted.
+		std::vector<int> nodes;
+
+		// Edges from node i are firstEdges[i] to firstEdges[i + 1].
+		std::vector<int> firstEdges;
+		std::vector<ClusterEdge> edges;
+		std::vector<uint8_t> moves;
+	};
+
+	struct CrossingEdge
+	{
+		int toNode;
+		float cost;
+		int dir;
+	};
+
+	// The HeightField's grid heights.
+	const float *m_pHeights;
+	TerrainPathCosts m_pathCosts;
+	int m_width;
+	int m_length;
+
+	int m_clusterSize;
+	int m_numClusterCols;
+	int m_numClusterRows;
+	std::vector<Cluster> m_clusters;
+
+	// Crossing points graph. Node numbers are cluster by cluster, so
+	// the nodes of cluster i are m_firstNodes[i] to m_firstNodes[i + 1].
+	std::vector<int> m_firstNodes;
+	std::vector<int> m_nodeClusters;
+	std::vector<int> m_nodeIndices;
+	std::vector<int> m_firstCrossingEdges;
+	std::vector<CrossingEdge> m_crossingEdges;
+
+	// Cost from each landmark to every node, node by node. The cost
+	// between 2 nodes is at least the difference between their costs
+	// from any landmark.
+	static const int NUM_LANDMARKS = 8;
+	std::vector<int> m_landmarkIndices;
+	std::vector<float> m_landmarkCosts;
+
+	int m_dirOffsets[8];
+	float m_moveLengths[8];
+	float m_maxRises[8];
+	float m_invBucketWidth;
+
+	void GetClusterBounds(int cluster, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow) const;
+	int GetClusterOf(int index) const;
+	int FindNode(int cluster, int index) const;
+
+	// Returns a negative number if the move can't be made. The move
+	// must stay on the grid.
+	float GetMoveCost(int index, int dir) const;
+	float GetHeuristic(int index, int goalIndex) const;
+
+	void BuildTransitions(int cluster, bool right, std::vector<Transition> *pTransitions) const;
+	void BuildClusterEdges(int cluster, TerrainPathSearch::ClusterSearch *pSearch);
+	void BuildClusters(int minClusterCol, int minClusterRow, int maxClusterCol, int maxClusterRow, unsigned maxNumThreads);
+	void BuildGraph();
+	void BuildLandmarks(unsigned maxNumThreads);
+
+	// Dijkstra over the whole crossing points graph.
+	void SearchGraph(int sourceNode, TerrainPathSearch *pSearch) const;
+
+	void AddToOpenList(TerrainPathSearch *pSearch, int node, float cost, int parent, int parentEdge, int goalIndex) const;
+	float GetNodeHeuristic(int node, int goalIndex, const TerrainPathSearch &search) const;
+
+	// Dijkstra from sourceIndex, within the cluster or rectangle, until
+	// all the targets are done or there's nowhere left to go.
+	void SearchCluster(int cluster, int sourceIndex, const int *pTargets, size_t numTargets, TerrainPathSearch::ClusterSearch *pSearch) const;
+	void SearchArea(int minCol, int minRow, int maxCol, int maxRow, int sourceIndex, const int *pTargets, size_t numTargets, TerrainPathSearch::ClusterSearch *pSearch) const;
+	int GetSearchLocal(const TerrainPathSearch::ClusterSearch &search, int index) const;
+	bool GetClusterSearchCost(const TerrainPathSearch::ClusterSearch &search, int index, float *pCost) const;
+	void AppendClusterSearchPath(const TerrainPathSearch::ClusterSearch &search, int index, bool fromSource, std::vector<int> *pPath) const;
+
+	void PrepareSearch(TerrainPathSearch *pSearch, size_t numNodes) const;
+
+	TerrainPathfinder(const TerrainPathfinder &);
+	TerrainPathfinder &operator=(const TerrainPathfinder &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_53639DFD557949208548F41B15B0C093
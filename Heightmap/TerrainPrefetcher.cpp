@@ -0,0 +1,487 @@
+#include "TerrainPrefetcher.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+#include <algorithm>
+#include <tuple>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The predicted path is checked every quarter tile, up to this many
+// times.
+static const int MAX_NUM_PATH_STEPS = 64;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainPrefetcherParams::TerrainPrefetcherParams():
+lookAheadTime(2.f),
+maxNumBytes(16 * 1024 * 1024)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainPrefetcherStats::TerrainPrefetcherStats():
+numRequested(0),
+numCancelled(0),
+numRead(0),
+numBytesRead(0),
+numHits(0),
+numWaits(0),
+numMisses(0),
+numWasted(0),
+numBytesWasted(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainPrefetcher::TerrainPrefetcher():
+m_quit(false)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainPrefetcher::~TerrainPrefetcher()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainPrefetcher::Create(const TerrainWorldParams &worldParams, const TerrainPrefetcherParams &params, const TerrainWorldLoadFn &loadFn)
+{
+	this->Destroy();
+
+	if (worldParams.numTilesX < 1 || worldParams.numTilesZ < 1 || worldParams.tileQuads < 1 || !loadFn)
+		return false;
+
+	m_worldParams = worldParams;
+	m_params = params;
+	m_loadFn = loadFn;
+
+	size_t numTiles = size_t(worldParams.numTilesX) * worldParams.numTilesZ;
+
+	m_requests.resize(numTiles);
+
+	for (size_t i = 0; i < numTiles; ++i)
+		m_requests[i].state = REQUEST_STATE_NONE;
+
+	m_stats = TerrainPrefetcherStats();
+	m_quit = false;
+
+	m_thread = std::thread(&TerrainPrefetcher::RunWorker, this);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPrefetcher::Destroy()
+{
+	if (m_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+
+		m_queueCondition.notify_all();
+		m_thread.join();
+	}
+
+	// Whatever's left over was read for nothing.
+	for (size_t i = 0; i < m_requests.size(); ++i)
+	{
+		if (m_requests[i].state == REQUEST_STATE_READ || m_requests[i].state == REQUEST_STATE_MISSING)
+			this->DiscardRead(int(i));
+	}
+
+	m_loadFn = TerrainWorldLoadFn();
+
+	std::vector<Request>().swap(m_requests);
+	m_queue.clear();
+
+	m_wantedTimes.clear();
+	m_wantedTiles.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPrefetcher::Update(const TerrainWorld &world, float cameraCol, float cameraRow, float velocityCol, float velocityRow)
+{
+	assert(world.GetParams().numTilesX == m_worldParams.numTilesX && world.GetParams().numTilesZ == m_worldParams.numTilesZ);
+
+	if (m_requests.empty())
+		return;
+
+	this->FindWantedTiles(world, cameraCol, cameraRow, velocityCol, velocityRow);
+
+	size_t tileNumBytes = this->GetTileNumBytes();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	// Heights already read that aren't wanted now make room for those
+	// that are, if need be. The ones the camera's furthest from go
+	// first.
+	std::vector<std::pair<float, int> > unwanted;
+	size_t numBytes = 0;
+
+	for (size_t i = 0; i < m_requests.size(); ++i)
+	{
+		RequestState state = m_requests[i].state;
+
+		if (state == REQUEST_STATE_READING)
+			numBytes += tileNumBytes;
+		else if (state == REQUEST_STATE_READ)
+			numBytes += m_requests[i].heights.size() * sizeof(float);
+
+		if (state == REQUEST_STATE_READ && m_wantedTimes[i] == FLT_MAX)
+			unwanted.push_back(std::make_pair(this->GetTileDistance(int(i), cameraCol, cameraRow), int(i)));
+	}
+
+	std::sort(unwanted.begin(), unwanted.end());
+
+	// The queue's rebuilt from scratch, soonest first; anything queued
+	// that doesn't make it back in is cancelled.
+	std::vector<int> oldQueue;
+	oldQueue.swap(m_queue);
+
+	for (size_t i = 0; i < m_wantedTiles.size(); ++i)
+	{
+		int tileIndex = m_wantedTiles[i];
+		Request *pRequest = &m_requests[tileIndex];
+
+		if (pRequest->state != REQUEST_STATE_NONE && pRequest->state != REQUEST_STATE_QUEUED)
+			continue;
+
+		while (numBytes + tileNumBytes > m_params.maxNumBytes && !unwanted.empty())
+		{
+			numBytes -= m_requests[unwanted.back().second].heights.size() * sizeof(float);
+
+			this->DiscardRead(unwanted.back().second);
+			unwanted.pop_back();
+		}
+
+		if (numBytes + tileNumBytes > m_params.maxNumBytes)
+			break;
+
+		if (pRequest->state == REQUEST_STATE_NONE)
+		{
+			pRequest->state = REQUEST_STATE_QUEUED;
+			++m_stats.numRequested;
+		}
+
+		m_queue.push_back(tileIndex);
+
+		// Reserved for when it's read.
+		numBytes += tileNumBytes;
+	}
+
+	for (size_t i = 0; i < oldQueue.size(); ++i)
+	{
+		if (std::find(m_queue.begin(), m_queue.end(), oldQueue[i]) == m_queue.end())
+		{
+			m_requests[oldQueue[i]].state = REQUEST_STATE_NONE;
+			++m_stats.numCancelled;
+		}
+	}
+
+	std::reverse(m_queue.begin(), m_queue.end());
+
+	bool haveQueue = !m_queue.empty();
+
+	lock.unlock();
+
+	if (haveQueue)
+		m_queueCondition.notify_one();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainPrefetcher::LoadTile(int tileX, int tileZ, int numPoints, float *pHeights)
+{
+	assert(numPoints == m_worldParams.tileQuads + 1);
+	assert(tileX >= 0 && tileX < m_worldParams.numTilesX && tileZ >= 0 && tileZ < m_worldParams.numTilesZ);
+
+	int tileIndex = tileZ * m_worldParams.numTilesX + tileX;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	Request *pRequest = &m_requests[tileIndex];
+
+	if (pRequest->state == REQUEST_STATE_QUEUED)
+	{
+		// Read it now, rather than wait for everything ahead of it.
+		m_queue.erase(std::find(m_queue.begin(), m_queue.end(), tileIndex));
+		pRequest->state = REQUEST_STATE_NONE;
+	}
+	else if (pRequest->state == REQUEST_STATE_READING)
+	{
+		++m_stats.numWaits;
+
+		while (pRequest->state == REQUEST_STATE_READING)
+			m_readCondition.wait(lock);
+	}
+	else if (pRequest->state == REQUEST_STATE_READ || pRequest->state == REQUEST_STATE_MISSING)
+	{
+		++m_stats.numHits;
+	}
+
+	if (pRequest->state == REQUEST_STATE_READ)
+	{
+		std::copy(pRequest->heights.begin(), pRequest->heights.end(), pHeights);
+
+		std::vector<float>().swap(pRequest->heights);
+		pRequest->state = REQUEST_STATE_NONE;
+
+		return true;
+	}
+	else if (pRequest->state == REQUEST_STATE_MISSING)
+	{
+		pRequest->state = REQUEST_STATE_NONE;
+
+		return false;
+	}
+
+	++m_stats.numMisses;
+
+	lock.unlock();
+
+	return m_loadFn(tileX, tileZ, numPoints, pHeights);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainPrefetcherStats TerrainPrefetcher::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_stats;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainPrefetcher::GetNumPendingReads() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	size_t numPending = m_queue.size();
+
+	for (size_t i = 0; i < m_requests.size(); ++i)
+	{
+		if (m_requests[i].state == REQUEST_STATE_READING)
+			++numPending;
+	}
+
+	return numPending;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainPrefetcher::GetTileNumBytes() const
+{
+	size_t numPoints = size_t(m_worldParams.tileQuads + 1);
+
+	return numPoints * numPoints * sizeof(float);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The same as TerrainWorld's, from a point to the nearest point of
+// the tile.
+float TerrainPrefetcher::GetTileDistance(int tileIndex, float col, float row) const
+{
+	int numQuads = m_worldParams.tileQuads;
+
+	float minCol = float(tileIndex % m_worldParams.numTilesX * numQuads);
+	float minRow = float(tileIndex / m_worldParams.numTilesX * numQuads);
+
+	float dx = std::max(std::max(minCol - col, col - (minCol + numQuads)), 0.f);
+	float dz = std::max(std::max(minRow - row, row - (minRow + numQuads)), 0.f);
+
+	return sqrtf(dx * dx + dz * dz);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Fills in m_wantedTimes, the soonest time each tile's wanted (FLT_MAX
+// if it isn't), and m_wantedTiles, the wanted tiles, soonest first.
+void TerrainPrefetcher::FindWantedTiles(const TerrainWorld &world, float cameraCol, float cameraRow, float velocityCol, float velocityRow)
+{
+	int numTilesX = m_worldParams.numTilesX;
+	int numTilesZ = m_worldParams.numTilesZ;
+	int numQuads = m_worldParams.tileQuads;
+	float loadRadius = m_worldParams.loadRadius;
+
+	m_wantedTimes.assign(m_requests.size(), FLT_MAX);
+	m_wantedTiles.clear();
+
+	float pathLength = sqrtf(velocityCol * velocityCol + velocityRow * velocityRow) * m_params.lookAheadTime;
+	int numSteps = int(std::min(ceilf(pathLength / (numQuads * .25f)), float(MAX_NUM_PATH_STEPS)));
+
+	for (int step = 0; step <= numSteps; ++step)
+	{
+		float time = numSteps > 0 ? m_params.lookAheadTime * step / numSteps : 0.f;
+		float col = cameraCol + velocityCol * time;
+		float row = cameraRow + velocityRow * time;
+
+		// A tile whose far edge is exactly loadRadius away counts.
+		int minTileX = std::max(int(ceilf((col - loadRadius) / numQuads)) - 1, 0);
+		int minTileZ = std::max(int(ceilf((row - loadRadius) / numQuads)) - 1, 0);
+		int maxTileX = std::min(int(floorf((col + loadRadius) / numQuads)), numTilesX - 1);
+		int maxTileZ = std::min(int(floorf((row + loadRadius) / numQuads)), numTilesZ - 1);
+
+		for (int tileZ = minTileZ; tileZ <= maxTileZ; ++tileZ)
+		{
+			for (int tileX = minTileX; tileX <= maxTileX; ++tileX)
+			{
+				int tileIndex = tileZ * numTilesX + tileX;
+
+				if (m_wantedTimes[tileIndex] != FLT_MAX)
+					continue;
+
+				if (world.IsTileLoaded(tileX, tileZ) || world.IsTileMissing(tileX, tileZ))
+					continue;
+
+				if (this->GetTileDistance(tileIndex, col, row) <= loadRadius)
+				{
+					m_wantedTimes[tileIndex] = time;
+					m_wantedTiles.push_back(tileIndex);
+				}
+			}
+		}
+	}
+
+	// The world will need the edges of unknown neighbours at the same
+	// time, the diagonal ones too, for the corners.
+	size_t numWantedOnPath = m_wantedTiles.size();
+
+	for (size_t i = 0; i < numWantedOnPath; ++i)
+	{
+		static const int NEIGHBOUR_OFFSETS[8][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}, {-1, -1}, {1, -1}, {-1, 1}, {1, 1}};
+
+		int tileIndex = m_wantedTiles[i];
+		int tileX = tileIndex % numTilesX;
+		int tileZ = tileIndex / numTilesX;
+
+		for (int j = 0; j < 8; ++j)
+		{
+			int neighbourX = tileX + NEIGHBOUR_OFFSETS[j][0];
+			int neighbourZ = tileZ + NEIGHBOUR_OFFSETS[j][1];
+
+			if (neighbourX < 0 || neighbourX >= numTilesX || neighbourZ < 0 || neighbourZ >= numTilesZ)
+				continue;
+
+			if (world.IsTileKnown(neighbourX, neighbourZ))
+				continue;
+
+			int neighbourIndex = neighbourZ * numTilesX + neighbourX;
+
+			if (m_wantedTimes[neighbourIndex] == FLT_MAX)
+				m_wantedTiles.push_back(neighbourIndex);
+
+			m_wantedTimes[neighbourIndex] = std::min(m_wantedTimes[neighbourIndex], m_wantedTimes[tileIndex]);
+		}
+	}
+
+	// Soonest first, then nearest first, as the world would load them.
+	std::vector<std::tuple<float, float, int> > order(m_wantedTiles.size());
+
+	for (size_t i = 0; i < m_wantedTiles.size(); ++i)
+	{
+		int tileIndex = m_wantedTiles[i];
+
+		order[i] = std::make_tuple(m_wantedTimes[tileIndex], this->GetTileDistance(tileIndex, cameraCol, cameraRow), tileIndex);
+	}
+
+	std::sort(order.begin(), order.end());
+
+	for (size_t i = 0; i < order.size(); ++i)
+		m_wantedTiles[i] = std::get<2>(order[i]);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// With m_mutex locked, or the worker gone.
+void TerrainPrefetcher::DiscardRead(int tileIndex)
+{
+	Request *pRequest = &m_requests[tileIndex];
+	assert(pRequest->state == REQUEST_STATE_READ || pRequest->state == REQUEST_STATE_MISSING);
+
+	++m_stats.numWasted;
+	m_stats.numBytesWasted += pRequest->heights.size() * sizeof(float);
+
+	std::vector<float>().swap(pRequest->heights);
+	pRequest->state = REQUEST_STATE_NONE;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainPrefetcher::RunWorker()
+{
+	int numPoints = m_worldParams.tileQuads + 1;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for (;;)
+	{
+		while (!m_quit && m_queue.empty())
+			m_queueCondition.wait(lock);
+
+		if (m_quit)
+			break;
+
+		int tileIndex = m_queue.back();
+		m_queue.pop_back();
+
+		m_requests[tileIndex].state = REQUEST_STATE_READING;
+
+		lock.unlock();
+
+		std::vector<float> heights(size_t(numPoints) * numPoints);
+		bool found = m_loadFn(tileIndex % m_worldParams.numTilesX, tileIndex / m_worldParams.numTilesX, numPoints, &heights[0]);
+
+		lock.lock();
+
+		Request *pRequest = &m_requests[tileIndex];
+
+		++m_stats.numRead;
+
+		if (found)
+		{
+			m_stats.numBytesRead += heights.size() * sizeof(float);
+
+			pRequest->heights.swap(heights);
+			pRequest->state = REQUEST_STATE_READ;
+		}
+		else
+		{
+			pRequest->state = REQUEST_STATE_MISSING;
+		}
+
+		m_readCondition.notify_all();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
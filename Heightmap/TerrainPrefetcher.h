@@ -0,0 +1,166 @@
+#ifndef HEADER_E8CFA63D9180428F9CD837B5D3083A97
+#define HEADER_E8CFA63D9180428F9CD837B5D3083A97
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Reads TerrainWorld tiles ahead of time, on a worker thread, so that
+// moving quickly across the world doesn't stall while tiles load.
+//
+// Every Update, the camera's position is extrapolated along its
+// velocity for lookAheadTime seconds. Each tile that comes within the
+// world's loadRadius somewhere along that path, and isn't loaded, is
+// wanted; the sooner the camera gets there, the sooner it's read. So
+// are the unknown tiles next to those, diagonally too, since the world
+// loads them as well, for their edges. Reads that are still queued when their tile stops
+// being wanted (say the camera turns round) are cancelled. Reads
+// already under way carry on, and their heights are kept if there's
+// room, or thrown away if something that's wanted needs the space.
+//
+// The world gets its heights through LoadTile, which hands over the
+// prefetched heights if they're there, waits for them if they're
+// being read, or reads them there and then if they were never asked
+// for. The stats say how often each of those happened, and how much
+// reading was wasted.
+//
+// The load callback is called from the worker thread as well as from
+// LoadTile, so it must be safe to call from 2 threads at once.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include "TerrainWorld.h"
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TerrainPrefetcherParams
+{
+	// How far ahead, in seconds, to predict the camera's path.
+	float lookAheadTime;
+
+	// For the heights read but not yet taken by the world, and those
+	// being read.
+	size_t maxNumBytes;
+
+	TerrainPrefetcherParams();
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TerrainPrefetcherStats
+{
+	// Reads asked for, and cancelled before they started.
+	size_t numRequested;
+	size_t numCancelled;
+
+	// Reads done by the worker thread.
+	size_t numRead;
+	size_t numBytesRead;
+
+	// Tiles the world loaded whose heights had been read already, whose
+	// heights it had to wait for, and whose heights it had to read
+	// itself.
+	size_t numHits;
+	size_t numWaits;
+	size_t numMisses;
+
+	// Reads done by the worker thread that the world never used.
+	size_t numWasted;
+	size_t numBytesWasted;
+
+	TerrainPrefetcherStats();
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainPrefetcher
+{
+public:
+	TerrainPrefetcher();
+	~TerrainPrefetcher();
+
+	// worldParams are the params the world will be created with.
+	bool Create(const TerrainWorldParams &worldParams, const TerrainPrefetcherParams &params, const TerrainWorldLoadFn &loadFn);
+	void Destroy();
+
+	// Call before world.Update, with the camera position in world grid
+	// points, and its velocity in grid points per second.
+	void Update(const TerrainWorld &world, float cameraCol, float cameraRow, float velocityCol, float velocityRow);
+
+	// Use as the world's load callback.
+	bool LoadTile(int tileX, int tileZ, int numPoints, float *pHeights);
+
+	TerrainPrefetcherStats GetStats() const;
+
+	// Tiles queued or being read.
+	size_t GetNumPendingReads() const;
+protected:
+private:
+	enum RequestState
+	{
+		REQUEST_STATE_NONE,
+		REQUEST_STATE_QUEUED,
+		REQUEST_STATE_READING,
+
+		// The heights are in.
+		REQUEST_STATE_READ,
+
+		// The load callback said there's no tile there.
+		REQUEST_STATE_MISSING,
+	};
+
+	struct Request
+	{
+		RequestState state;
+		std::vector<float> heights;
+	};
+
+	TerrainWorldParams m_worldParams;
+	TerrainPrefetcherParams m_params;
+	TerrainWorldLoadFn m_loadFn;
+
+	// Everything from here to m_stats is shared with the worker thread,
+	// and only touched with m_mutex locked.
+	std::vector<Request> m_requests;
+
+	// Tile indices, soonest wanted last.
+	std::vector<int> m_queue;
+
+	bool m_quit;
+	TerrainPrefetcherStats m_stats;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_queueCondition;
+	std::condition_variable m_readCondition;
+	std::thread m_thread;
+
+	// Scratch space for Update.
+	std::vector<float> m_wantedTimes;
+	std::vector<int> m_wantedTiles;
+
+	size_t GetTileNumBytes() const;
+	float GetTileDistance(int tileIndex, float col, float row) const;
+	void FindWantedTiles(const TerrainWorld &world, float cameraCol, float cameraRow, float velocityCol, float velocityRow);
+	void DiscardRead(int tileIndex);
+	void RunWorker();
+
+	TerrainPrefetcher(const TerrainPrefetcher &);
+	TerrainPrefetcher &operator=(const TerrainPrefetcher &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_E8CFA63D9180428F9CD837B5D3083A97
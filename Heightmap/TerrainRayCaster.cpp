@@ -0,0 +1,590 @@
+#include "TerrainRayCaster.h"
+#include "HeightField.h"
+#include "ParallelJobs.h"
+
+#include <math.h>
+#include <float.h>
+#include <assert.h>
+
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Cell boxes are made this much bigger all round (in grid units), so
+// rounding can't let a ray slip between two boxes and miss a triangle
+// right on the edge.
+static const float BOX_EPSILON = 1e-3f;
+
+// Barycentric tolerance, for the same reason: a ray that hits exactly
+// on an edge shared by 2 triangles should hit at least one of them.
+static const float TRIANGLE_EPSILON = 1e-5f;
+
+// Rays per job for CastRays. Each job ought to be a good deal more
+// work than handing it out.
+static const size_t RAYS_PER_JOB = 256;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainRayCaster::TerrainRayCaster():
+m_pHeightField(NULL)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainRayCaster::~TerrainRayCaster()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainRayCaster::Create(const HeightField *pHeightField)
+{
+	this->Destroy();
+
+	int width = pHeightField->GetWidth();
+	int length = pHeightField->GetLength();
+
+	if (width < 2 || length < 2)
+		return false;
+
+	m_pHeightField = pHeightField;
+
+	// Each level up is half the size, rounding up, until there's 1
+	// cell covering everything.
+	m_levels.push_back(Level());
+	m_levels.back().width = width - 1;
+	m_levels.back().length = length - 1;
+
+	while (m_levels.back().width > 1 || m_levels.back().length > 1)
+	{
+		Level level;
+		level.width = (m_levels.back().width + 1) / 2;
+		level.length = (m_levels.back().length + 1) / 2;
+
+		m_levels.push_back(level);
+	}
+
+	for (size_t i = 0; i < m_levels.size(); ++i)
+		m_levels[i].maxHeights.resize(size_t(m_levels[i].width) * m_levels[i].length);
+
+	this->UpdateLevels(0, 0, width - 2, length - 2);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainRayCaster::Destroy()
+{
+	m_pHeightField = NULL;
+	m_levels.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainRayCaster::UpdateRegion(int minCol, int minRow, int maxCol, int maxRow)
+{
+	if (m_levels.empty())
+		return;
+
+	// Grid points are corners of the quads either side of them.
+	minCol = std::max(minCol - 1, 0);
+	minRow = std::max(minRow - 1, 0);
+	maxCol = std::min(maxCol, m_levels[0].width - 1);
+	maxRow = std::min(maxRow, m_levels[0].length - 1);
+
+	if (minCol > maxCol || minRow > maxRow)
+		return;
+
+	this->UpdateLevels(minCol, minRow, maxCol, maxRow);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainRayCaster::UpdateLevels(int minQuadCol, int minQuadRow, int maxQuadCol, int maxQuadRow)
+{
+	int width = m_pHeightField->GetWidth();
+	const float *pHeights = m_pHeightField->GetGridHeights();
+
+	// Level 0: highest corner of each quad.
+	Level *pLevel = &m_levels[0];
+
+	for (int row = minQuadRow; row <= maxQuadRow; ++row)
+	{
+		for (int col = minQuadCol; col <= maxQuadCol; ++col)
+		{
+			const float *p = &pHeights[size_t(row) * width + col];
+
+			pLevel->maxHeights[size_t(row) * pLevel->width + col] = std::max(std::max(p[0], p[1]), std::max(p[width], p[width + 1]));
+		}
+	}
+
+	// Then the cells above those, level by level.
+	for (size_t level = 1; level < m_levels.size(); ++level)
+	{
+		const Level *pBelow = &m_levels[level - 1];
+		pLevel = &m_levels[level];
+
+		minQuadCol /= 2;
+		minQuadRow /= 2;
+		maxQuadCol /= 2;
+		maxQuadRow /= 2;
+
+		for (int row = minQuadRow; row <= maxQuadRow; ++row)
+		{
+			for (int col = minQuadCol; col <= maxQuadCol; ++col)
+			{
+				float maxHeight = -FLT_MAX;
+
+				for (int j = row * 2; j < std::min(row * 2 + 2, pBelow->length); ++j)
+				{
+					for (int i = col * 2; i < std::min(col * 2 + 2, pBelow->width); ++i)
+						maxHeight = std::max(maxHeight, pBelow->maxHeights[size_t(j) * pBelow->width + i]);
+				}
+
+				pLevel->maxHeights[size_t(row) * pLevel->width + col] = maxHeight;
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainRayCaster::CastRay(const TerrainRay &ray, TerrainRayHit *pHit) const
+{
+	if (m_levels.empty())
+		return false;
+
+	GridRay gridRay;
+	this->GetGridRay(ray, &gridRay);
+
+	int topLevel = int(m_levels.size() - 1);
+
+	float tEnter, tExit;
+	if (!this->IntersectCellBox(gridRay, topLevel, 0, 0, 0.f, ray.maxT, &tEnter, &tExit))
+		return false;
+
+	float t;
+	int col, row;
+	if (!this->CastRayInCell(gridRay, topLevel, 0, 0, tEnter, tExit, &t, &col, &row))
+		return false;
+
+	this->FillHit(ray, t, col, row, pHit);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainRayCaster::CastRayDDA(const TerrainRay &ray, TerrainRayHit *pHit) const
+{
+	if (m_levels.empty())
+		return false;
+
+	GridRay gridRay;
+	this->GetGridRay(ray, &gridRay);
+
+	const Level *pQuads = &m_levels[0];
+
+	// Clip the ray to the grid. The level 0 box test is no good for
+	// this, as that also clips against the height.
+	float tMin = 0.f, tMax = ray.maxT;
+
+	for (int axis = 0; axis < 3; axis += 2)
+	{
+		float size = float(axis == 0 ? pQuads->width : pQuads->length);
+
+		if (gridRay.dir[axis] == 0.f)
+		{
+			if (gridRay.origin[axis] < 0.f || gridRay.origin[axis] > size)
+				return false;
+		}
+		else
+		{
+			float t0 = (0.f - gridRay.origin[axis]) * gridRay.invDir[axis];
+			float t1 = (size - gridRay.origin[axis]) * gridRay.invDir[axis];
+
+			tMin = std::max(tMin, std::min(t0, t1));
+			tMax = std::min(tMax, std::max(t0, t1));
+		}
+	}
+
+	if (tMin > tMax)
+		return false;
+
+	// Amanatides & Woo grid walk.
+	float startX = gridRay.origin[0] + gridRay.dir[0] * tMin;
+	float startZ = gridRay.origin[2] + gridRay.dir[2] * tMin;
+
+	int col = std::min(std::max(int(floorf(startX)), 0), pQuads->width - 1);
+	int row = std::min(std::max(int(floorf(startZ)), 0), pQuads->length - 1);
+
+	int stepCol = gridRay.dir[0] > 0.f ? 1 : -1;
+	int stepRow = gridRay.dir[2] > 0.f ? 1 : -1;
+
+	float tNextCol = FLT_MAX, tDeltaCol = FLT_MAX;
+	if (gridRay.dir[0] != 0.f)
+	{
+		tNextCol = (float(col + (stepCol > 0 ? 1 : 0)) - gridRay.origin[0]) * gridRay.invDir[0];
+		tDeltaCol = fabsf(gridRay.invDir[0]);
+	}
+
+	float tNextRow = FLT_MAX, tDeltaRow = FLT_MAX;
+	if (gridRay.dir[2] != 0.f)
+	{
+		tNextRow = (float(row + (stepRow > 0 ? 1 : 0)) - gridRay.origin[2]) * gridRay.invDir[2];
+		tDeltaRow = fabsf(gridRay.invDir[2]);
+	}
+
+	float bestT = FLT_MAX;
+	int bestCol = -1, bestRow = -1;
+	float tCellEnter = tMin;
+
+	for (;;)
+	{
+		float tCellExit = std::min(std::min(tNextCol, tNextRow), tMax);
+
+		// A hit further on may still be in an earlier quad, if it's
+		// right on the edge, so keep going until past the best so far.
+		if (tCellEnter > bestT)
+			break;
+
+		float t;
+		if (this->IntersectQuad(gridRay, col, row, tMin, std::min(tMax, bestT), &t))
+		{
+			if (t < bestT)
+			{
+				bestT = t;
+				bestCol = col;
+				bestRow = row;
+			}
+		}
+
+		if (tCellExit >= tMax)
+			break;
+
+		if (tNextCol < tNextRow)
+		{
+			col += stepCol;
+			tNextCol += tDeltaCol;
+		}
+		else
+		{
+			row += stepRow;
+			tNextRow += tDeltaRow;
+		}
+
+		if (col < 0 || col >= pQuads->width || row < 0 || row >= pQuads->length)
+			break;
+
+		tCellEnter = tCellExit;
+	}
+
+	if (bestCol < 0)
+		return false;
+
+	this->FillHit(ray, bestT, bestCol, bestRow, pHit);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainRayCaster::CastRays(const TerrainRay *pRays, size_t numRays, TerrainRayHit *pHits, bool *pDidHit, unsigned maxNumThreads) const
+{
+	size_t numJobs = (numRays + RAYS_PER_JOB - 1) / RAYS_PER_JOB;
+
+	RunParallelJobs(numJobs, maxNumThreads,
+		[&](size_t jobIndex, std::string *)
+		{
+			size_t begin = jobIndex * RAYS_PER_JOB;
+			size_t end = std::min(begin + RAYS_PER_JOB, numRays);
+
+			for (size_t i = begin; i < end; ++i)
+				pDidHit[i] = this->CastRay(pRays[i], &pHits[i]);
+
+			return true;
+		},
+		NULL);
+
+	size_t numHits = 0;
+
+	for (size_t i = 0; i < numRays; ++i)
+	{
+		if (pDidHit[i])
+			++numHits;
+	}
+
+	return numHits;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainRayCaster::GetGridRay(const TerrainRay &ray, GridRay *pGridRay) const
+{
+	// Scaling each axis doesn't change the t of any hit, so t values
+	// are the same in grid space as in world space.
+	float invStepX = 1.f / m_pHeightField->GetColumnStepX();
+	float invStepZ = 1.f / m_pHeightField->GetRowStepZ();
+
+	pGridRay->origin[0] = (ray.origin[0] - m_pHeightField->GetOriginX()) * invStepX;
+	pGridRay->origin[1] = ray.origin[1];
+	pGridRay->origin[2] = (ray.origin[2] - m_pHeightField->GetOriginZ()) * invStepZ;
+
+	pGridRay->dir[0] = ray.dir[0] * invStepX;
+	pGridRay->dir[1] = ray.dir[1];
+	pGridRay->dir[2] = ray.dir[2] * invStepZ;
+
+	for (int i = 0; i < 3; ++i)
+		pGridRay->invDir[i] = pGridRay->dir[i] != 0.f ? 1.f / pGridRay->dir[i] : 0.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainRayCaster::IntersectCellBox(const GridRay &ray, int level, int col, int row, float tMin, float tMax, float *pTEnter, float *pTExit) const
+{
+	const Level *pLevel = &m_levels[level];
+	const Level *pQuads = &m_levels[0];
+
+	// Quads covered by this cell.
+	float lo[3], hi[3];
+
+	lo[0] = float(col << level) - BOX_EPSILON;
+	hi[0] = float(std::min((col + 1) << level, pQuads->width)) + BOX_EPSILON;
+
+	lo[2] = float(row << level) - BOX_EPSILON;
+	hi[2] = float(std::min((row + 1) << level, pQuads->length)) + BOX_EPSILON;
+
+	for (int axis = 0; axis < 3; axis += 2)
+	{
+		if (ray.dir[axis] == 0.f)
+		{
+			if (ray.origin[axis] < lo[axis] || ray.origin[axis] > hi[axis])
+				return false;
+		}
+		else
+		{
+			float t0 = (lo[axis] - ray.origin[axis]) * ray.invDir[axis];
+			float t1 = (hi[axis] - ray.origin[axis]) * ray.invDir[axis];
+
+			tMin = std::max(tMin, std::min(t0, t1));
+			tMax = std::min(tMax, std::max(t0, t1));
+		}
+	}
+
+	// Nothing to hit above the highest point.
+	float maxHeight = pLevel->maxHeights[size_t(row) * pLevel->width + col] + BOX_EPSILON;
+
+	if (ray.dir[1] == 0.f)
+	{
+		if (ray.origin[1] > maxHeight)
+			return false;
+	}
+	else
+	{
+		float t = (maxHeight - ray.origin[1]) * ray.invDir[1];
+
+		if (ray.dir[1] > 0.f)
+			tMax = std::min(tMax, t);
+		else
+			tMin = std::max(tMin, t);
+	}
+
+	if (tMin > tMax)
+		return false;
+
+	*pTEnter = tMin;
+	*pTExit = tMax;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainRayCaster::CastRayInCell(const GridRay &ray, int level, int col, int row, float tMin, float tMax, float *pT, int *pCol, int *pRow) const
+{
+	if (level == 0)
+	{
+		if (!this->IntersectQuad(ray, col, row, tMin, tMax, pT))
+			return false;
+
+		*pCol = col;
+		*pRow = row;
+
+		return true;
+	}
+
+	const Level *pBelow = &m_levels[level - 1];
+
+	struct Child
+	{
+		int col, row;
+		float tEnter, tExit;
+	};
+
+	Child children[4];
+	int numChildren = 0;
+
+	for (int j = row * 2; j < std::min(row * 2 + 2, pBelow->length); ++j)
+	{
+		for (int i = col * 2; i < std::min(col * 2 + 2, pBelow->width); ++i)
+		{
+			Child child;
+			child.col = i;
+			child.row = j;
+
+			if (!this->IntersectCellBox(ray, level - 1, i, j, tMin, tMax, &child.tEnter, &child.tExit))
+				continue;
+
+			// Insertion sort, nearest first.
+			int k = numChildren++;
+
+			while (k > 0 && children[k - 1].tEnter > child.tEnter)
+			{
+				children[k] = children[k - 1];
+				--k;
+			}
+
+			children[k] = child;
+		}
+	}
+
+	bool hit = false;
+
+	for (int k = 0; k < numChildren; ++k)
+	{
+		const Child *pChild = &children[k];
+
+		// Front to back, so once a hit is closer than where the next
+		// child starts, that's it. (The boxes overlap very slightly,
+		// so it isn't quite enough to stop at the first hit.)
+		if (pChild->tEnter > tMax)
+			break;
+
+		float t;
+		int hitCol, hitRow;
+		if (this->CastRayInCell(ray, level - 1, pChild->col, pChild->row, pChild->tEnter, std::min(pChild->tExit, tMax), &t, &hitCol, &hitRow))
+		{
+			hit = true;
+			tMax = t;
+
+			*pT = t;
+			*pCol = hitCol;
+			*pRow = hitRow;
+		}
+	}
+
+	return hit;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Moller-Trumbore, either side.
+static bool IntersectTriangle(const float *pOrigin, const float *pDir, const float *p0, const float *p1, const float *p2, float *pT)
+{
+	float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+	float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+	float p[3] = {
+		pDir[1] * e2[2] - pDir[2] * e2[1],
+		pDir[2] * e2[0] - pDir[0] * e2[2],
+		pDir[0] * e2[1] - pDir[1] * e2[0],
+	};
+
+	float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	if (det == 0.f)
+		return false;// parallel
+
+	float invDet = 1.f / det;
+
+	float s[3] = {pOrigin[0] - p0[0], pOrigin[1] - p0[1], pOrigin[2] - p0[2]};
+
+	float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+	if (u < -TRIANGLE_EPSILON || u > 1.f + TRIANGLE_EPSILON)
+		return false;
+
+	float q[3] = {
+		s[1] * e1[2] - s[2] * e1[1],
+		s[2] * e1[0] - s[0] * e1[2],
+		s[0] * e1[1] - s[1] * e1[0],
+	};
+
+	float v = (pDir[0] * q[0] + pDir[1] * q[1] + pDir[2] * q[2]) * invDet;
+	if (v < -TRIANGLE_EPSILON || u + v > 1.f + TRIANGLE_EPSILON)
+		return false;
+
+	*pT = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainRayCaster::IntersectQuad(const GridRay &ray, int col, int row, float tMin, float tMax, float *pT) const
+{
+	const float *pHeights = m_pHeightField->GetGridHeights();
+	int width = m_pHeightField->GetWidth();
+
+	const float *p = &pHeights[size_t(row) * width + col];
+
+	// Grid space corners: a is (col, row), b is one column on, c one
+	// row on, and d is diagonally opposite a.
+	float a[3] = {float(col), p[0], float(row)};
+	float b[3] = {float(col + 1), p[1], float(row)};
+	float c[3] = {float(col), p[width], float(row + 1)};
+	float d[3] = {float(col + 1), p[width + 1], float(row + 1)};
+
+	bool hit = false;
+	float t;
+
+	// (a, b, d) and (a, d, c), as TerrainMesh.
+	if (IntersectTriangle(ray.origin, ray.dir, a, b, d, &t) && t >= tMin && t <= tMax)
+	{
+		hit = true;
+		tMax = t;
+	}
+
+	if (IntersectTriangle(ray.origin, ray.dir, a, d, c, &t) && t >= tMin && t <= tMax)
+	{
+		hit = true;
+		tMax = t;
+	}
+
+	if (hit)
+		*pT = tMax;
+
+	return hit;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainRayCaster::FillHit(const TerrainRay &ray, float t, int col, int row, TerrainRayHit *pHit) const
+{
+	pHit->t = t;
+
+	for (int i = 0; i < 3; ++i)
+		pHit->pos[i] = ray.origin[i] + ray.dir[i] * t;
+
+	pHit->col = col;
+	pHit->row = row;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,126 @@
+#ifndef HEADER_7E562FBAAE8F4CEB8DC5DEF58E60BB91
+#define HEADER_7E562FBAAE8F4CEB8DC5DEF58E60BB91
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Ray casts against a HeightField's terrain.
+//
+// The terrain is the triangles TerrainMesh draws: each grid quad
+// split along its top left to bottom right diagonal. Hits are exact
+// against those triangles, from either side.
+//
+// To avoid testing every quad along the ray, there's a pyramid of
+// maximum heights over the grid quads, each level covering 2x2 cells
+// of the one below. Casting goes top-down, front to back: any cell the
+// ray passes entirely above is skipped in one go, whatever its size.
+//
+// CastRayDDA walks the ray quad by quad instead, testing each one. It
+// gives the same answers more slowly, and is there to check against.
+//
+// The HeightField must outlast the ray caster. After changing its
+// heights, call UpdateRegion before casting again. Casting doesn't
+// change anything, so any number of threads can cast at once, but not
+// while an update is going on.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include <vector>
+
+class HeightField;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TerrainRay
+{
+	float origin[3];
+
+	// Needn't be unit length. Hit distances are in multiples of it.
+	float dir[3];
+
+	// Hits further than this are ignored.
+	float maxT;
+};
+
+struct TerrainRayHit
+{
+	float t;
+	float pos[3];
+
+	// Grid quad that was hit.
+	int col;
+	int row;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainRayCaster
+{
+public:
+	TerrainRayCaster();
+	~TerrainRayCaster();
+
+	bool Create(const HeightField *pHeightField);
+	void Destroy();
+
+	// Call after the heights of the grid points from (minCol, minRow)
+	// to (maxCol, maxRow) inclusive have changed. Only the cells over
+	// them are redone, so this is quick for small changes.
+	void UpdateRegion(int minCol, int minRow, int maxCol, int maxRow);
+
+	// Returns true, and fills in *pHit, if the ray hits the terrain.
+	bool CastRay(const TerrainRay &ray, TerrainRayHit *pHit) const;
+
+	// Same result as CastRay, the slow way.
+	bool CastRayDDA(const TerrainRay &ray, TerrainRayHit *pHit) const;
+
+	// Cast lots of rays, spread over up to maxNumThreads threads (0
+	// means one per hardware thread). pHits[i] is only valid if
+	// pDidHit[i] is true. Returns the number of rays that hit.
+	size_t CastRays(const TerrainRay *pRays, size_t numRays, TerrainRayHit *pHits, bool *pDidHit, unsigned maxNumThreads) const;
+protected:
+private:
+	struct Level
+	{
+		int width;
+		int length;
+		std::vector<float> maxHeights;
+	};
+
+	// Ray in grid space: x is the column, z the row.
+	struct GridRay
+	{
+		float origin[3];
+		float dir[3];
+		float invDir[3];
+	};
+
+	const HeightField *m_pHeightField;
+
+	// m_levels[0] has one entry per grid quad. The last level is 1x1.
+	std::vector<Level> m_levels;
+
+	// Redo the maximum heights over the given quads, and up.
+	void UpdateLevels(int minQuadCol, int minQuadRow, int maxQuadCol, int maxQuadRow);
+
+	void GetGridRay(const TerrainRay &ray, GridRay *pGridRay) const;
+	bool IntersectCellBox(const GridRay &ray, int level, int col, int row, float tMin, float tMax, float *pTEnter, float *pTExit) const;
+	bool CastRayInCell(const GridRay &ray, int level, int col, int row, float tMin, float tMax, float *pT, int *pCol, int *pRow) const;
+	bool IntersectQuad(const GridRay &ray, int col, int row, float tMin, float tMax, float *pT) const;
+	void FillHit(const TerrainRay &ray, float t, int col, int row, TerrainRayHit *pHit) const;
+
+	TerrainRayCaster(const TerrainRayCaster &);
+	TerrainRayCaster &operator=(const TerrainRayCaster &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_7E562FBAAE8F4CEB8DC5DEF58E60BB91
@@ -0,0 +1,292 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "TerrainRenderBatch.h"
+
+#include "HeightField.h"
+#include "HeightMapFile.h"
+#include "SoftwareRasterizer.h"
+#include "TerrainChunks.h"
+#include "TerrainGrid.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static_assert(sizeof(TerrainRenderVertex) == 28, "SoftwareRasterizer expects this layout");
+
+// TerrainMesh::CHUNK_QUADS, which can't be included from here.
+static const int RENDER_CHUNK_QUADS = 64;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void Cross(const float *pA, const float *pB, float *pResult)
+{
+	pResult[0] = pA[1] * pB[2] - pA[2] * pB[1];
+	pResult[1] = pA[2] * pB[0] - pA[0] * pB[2];
+	pResult[2] = pA[0] * pB[1] - pA[1] * pB[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void Normalise(float *pV)
+{
+	float length = sqrtf(pV[0] * pV[0] + pV[1] * pV[1] + pV[2] * pV[2]);
+
+	for (int i = 0; i < 3; ++i)
+		pV[i] /= length;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// As XMMatrixLookAtLH, with y up.
+static void GetLookAtMatrix(const float *pEye, const float *pAt, float *pMtx)
+{
+	const float up[3] = {0.f, 1.f, 0.f};
+
+	float zAxis[3] = {pAt[0] - pEye[0], pAt[1] - pEye[1], pAt[2] - pEye[2]};
+	Normalise(zAxis);
+
+	float xAxis[3];
+	Cross(up, zAxis, xAxis);
+	Normalise(xAxis);
+
+	float yAxis[3];
+	Cross(zAxis, xAxis, yAxis);
+
+	const float *axes[3] = {xAxis, yAxis, zAxis};
+
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+			pMtx[j * 4 + i] = axes[i][j];
+
+		pMtx[i * 4 + 3] = 0.f;
+		pMtx[12 + i] = -(axes[i][0] * pEye[0] + axes[i][1] * pEye[1] + axes[i][2] * pEye[2]);
+	}
+
+	pMtx[15] = 1.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// As XMMatrixPerspectiveFovLH.
+static void GetPerspectiveMatrix(float fovY, float aspect, float nearZ, float farZ, float *pMtx)
+{
+	float height = 1.f / tanf(fovY * .5f);
+
+	for (int i = 0; i < 16; ++i)
+		pMtx[i] = 0.f;
+
+	pMtx[0] = height / aspect;
+	pMtx[5] = height;
+	pMtx[10] = farZ / (farZ - nearZ);
+	pMtx[11] = 1.f;
+	pMtx[14] = -nearZ * farZ / (farZ - nearZ);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool HasExtension(const char *pFileName, const char *pExtension)
+{
+	size_t nameLength = strlen(pFileName);
+	size_t extensionLength = strlen(pExtension);
+
+	if (nameLength < extensionLength)
+		return false;
+
+	for (size_t i = 0; i < extensionLength; ++i)
+	{
+		if (tolower((unsigned char)pFileName[nameLength - extensionLength + i]) != tolower((unsigned char)pExtension[i]))
+			return false;
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void BuildTerrainRenderChunks(const TerrainGrid *pGrid, int chunkQuads, std::vector<TerrainRenderChunk> *pChunks)
+{
+	// HeightMapApplication's MAP_COLOUR.
+	static const uint8_t MAP_COLOUR[4] = {200, 255, 255, 255};
+
+	std::vector<TerrainChunk> areas;
+	GetTerrainChunks(pGrid->GetWidth(), pGrid->GetLength(), chunkQuads, &areas);
+
+	pChunks->clear();
+	pChunks->resize(areas.size());
+
+	const float *pHeights = pGrid->GetHeights();
+	const float *pNormalsX = pGrid->GetNormalsX();
+	const float *pNormalsY = pGrid->GetNormalsY();
+	const float *pNormalsZ = pGrid->GetNormalsZ();
+	size_t pitch = pGrid->GetPitch();
+
+	for (size_t i = 0; i < areas.size(); ++i)
+	{
+		const TerrainChunk *pArea = &areas[i];
+		TerrainRenderChunk *pChunk = &(*pChunks)[i];
+
+		pChunk->vtxs.resize(size_t(pArea->width) * pArea->length);
+		pChunk->indices.resize(size_t(pArea->width - 1) * (pArea->length - 1) * 6);
+
+		for (int row = 0; row < pArea->length; ++row)
+		{
+			for (int col = 0; col < pArea->width; ++col)
+			{
+				int gridCol = pArea->col0 + col;
+				int gridRow = pArea->row0 + row;
+				size_t point = gridRow * pitch + gridCol;
+
+				TerrainRenderVertex *pVtx = &pChunk->vtxs[size_t(row) * pArea->width + col];
+
+				pVtx->pos[0] = pGrid->GetOriginX() + gridCol * pGrid->GetColumnStepX();
+				pVtx->pos[1] = pHeights[point];
+				pVtx->pos[2] = pGrid->GetOriginZ() + gridRow * pGrid->GetRowStepZ();
+				memcpy(pVtx->colour, MAP_COLOUR, sizeof pVtx->colour);
+				pVtx->normal[0] = pNormalsX[point];
+				pVtx->normal[1] = pNormalsY[point];
+				pVtx->normal[2] = pNormalsZ[point];
+			}
+		}
+
+		BuildTerrainChunkIndices(pArea->width, pArea->length, &pChunk->indices[0]);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void RenderTerrainImage(const TerrainGrid *pGrid, const std::vector<TerrainRenderChunk> &chunks, int numFrames, SoftwareRasterizer *pRasterizer)
+{
+	static const float CAMERA_Z = 50.f;
+	static const float MIN_CAMERA_HEIGHT_ABOVE_GROUND = 2.f;
+
+	float camera[3] = {0.f, CAMERA_Z / 2, CAMERA_Z};
+
+	HeightField heightField;
+	if (heightField.Create(pGrid))
+	{
+		float groundHeight = heightField.GetHeight(camera[0], camera[2], HEIGHT_FIELD_FILTER_BICUBIC);
+		if (camera[1] < groundHeight + MIN_CAMERA_HEIGHT_ABOVE_GROUND)
+			camera[1] = groundHeight + MIN_CAMERA_HEIGHT_ABOVE_GROUND;
+	}
+
+	const float lookat[3] = {0.f, 0.f, 0.f};
+
+	float viewMtx[16], projMtx[16];
+	GetLookAtMatrix(camera, lookat, viewMtx);
+	GetPerspectiveMatrix(3.14159265f / 4, float(pRasterizer->GetWidth()) / pRasterizer->GetHeight(), 1.5f, 5000.f, projMtx);
+
+	pRasterizer->SetViewMatrix(viewMtx);
+	pRasterizer->SetProjectionMatrix(projMtx);
+
+	const float lightPos[3] = {100.f, 100.f, -100.f}, lightColour[3] = {1.f, 1.f, 1.f};
+	pRasterizer->EnablePointLight(0, lightPos, lightColour);
+
+	const float clearColour[4] = {.2f, .2f, .6f, 1.f};
+
+	for (int i = 0; i < numFrames; ++i)
+	{
+		pRasterizer->Clear(clearColour);
+
+		for (size_t j = 0; j < chunks.size(); ++j)
+			pRasterizer->DrawUntexturedLit(SoftwareRasterizer::Topology_TriangleList, &chunks[j].vtxs[0], &chunks[j].indices[0], unsigned(chunks[j].indices.size()));
+
+		pRasterizer->Flush();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int RunTerrainRenderBatch(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: %s <in.bmp> <out.ppm|out.png> [width] [height] [frames] [threads]\n", argv[0]);
+		return 1;
+	}
+
+	int imageWidth = argc > 3 ? atoi(argv[3]) : 1280;
+	int imageHeight = argc > 4 ? atoi(argv[4]) : 640;
+	int numFrames = argc > 5 ? atoi(argv[5]) : 1;
+	unsigned maxNumThreads = argc > 6 ? unsigned(atoi(argv[6])) : 0;
+
+	if (imageWidth < 1 || imageHeight < 1 || numFrames < 1)
+	{
+		fprintf(stderr, "Bad size: %dx%d, %d frames\n", imageWidth, imageHeight, numFrames);
+		return 1;
+	}
+
+	std::vector<uint8_t> values;
+	int width, length;
+	if (!LoadHeightMapBMP(argv[1], &values, &width, &length))
+	{
+		fprintf(stderr, "Failed to load %s\n", argv[1]);
+		return 1;
+	}
+
+	// Laid out as LoadHeightMap does, with a grid size of 1.
+	std::vector<float> heights(values.size());
+	for (size_t i = 0; i < values.size(); ++i)
+		heights[i] = values[i] / 16.f;
+
+	TerrainGrid grid;
+	if (!grid.Create(width, length, (float)(-(width / 2)), (float)(length / 2), 1.f, -1.f))
+	{
+		fprintf(stderr, "%s is too big\n", argv[1]);
+		return 1;
+	}
+
+	grid.SetHeights(0, 0, width - 1, length - 1, &heights[0], width);
+	grid.CalculateNormals(0, 0, width - 1, length - 1);
+
+	std::vector<TerrainRenderChunk> chunks;
+	BuildTerrainRenderChunks(&grid, RENDER_CHUNK_QUADS, &chunks);
+
+	SoftwareRasterizer rasterizer;
+	if (!rasterizer.Create(imageWidth, imageHeight, maxNumThreads))
+	{
+		fprintf(stderr, "Failed to create a %dx%d image\n", imageWidth, imageHeight);
+		return 1;
+	}
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	RenderTerrainImage(&grid, chunks, numFrames, &rasterizer);
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	const SoftwareRasterizerStats &stats = rasterizer.GetStats();
+
+	printf("%dx%d: %d frames of %u triangles (%u on screen) in %.3f seconds, %.1f million triangles/second (%.2f ms setup, %.2f ms drawing a frame)\n", imageWidth, imageHeight, numFrames,
+		unsigned(stats.numTrianglesSubmitted / numFrames), unsigned(stats.numTrianglesDrawn / numFrames), seconds, seconds > 0. ? stats.numTrianglesSubmitted / seconds / 1e6 : 0.,
+		stats.setupSeconds * 1000. / numFrames, stats.rasterSeconds * 1000. / numFrames);
+
+	bool png = HasExtension(argv[2], ".png");
+
+	if (!(png ? rasterizer.WritePNG(argv[2]) : rasterizer.WritePPM(argv[2])))
+	{
+		fprintf(stderr, "Failed to save %s\n", argv[2]);
+		return 1;
+	}
+
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,72 @@
+#ifndef HEADER_94DE0A6ADA0B451295717E8BC07F9DBA
+#define HEADER_94DE0A6ADA0B451295717E8BC07F9DBA
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Renders a height map to an image with SoftwareRasterizer, without a
+// window or D3D, as Heightmap's -render batch mode does. The Windows
+// exe and the Linux RenderTerrain tool (see Tests/Makefile) both run
+// it from here.
+//
+// The chunks and triangles are TerrainMesh's (see TerrainChunks), in
+// its colour, seen from HandleRender's starting camera and lit by its
+// point light.
+//
+// There's no D3D in here, and no Windows either.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class SoftwareRasterizer;
+class TerrainGrid;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Laid out as Vertex_Pos3fColour4ubNormal3f, for DrawUntexturedLit.
+struct TerrainRenderVertex
+{
+	float pos[3];
+	uint8_t colour[4];
+	float normal[3];
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TerrainRenderChunk
+{
+	std::vector<TerrainRenderVertex> vtxs;
+	std::vector<uint16_t> indices;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The grid's chunks, chunkQuads quads on a side, with the same vertices
+// and triangles TerrainMesh::BuildChunkGeometry makes. The grid's
+// normals must be calculated.
+void BuildTerrainRenderChunks(const TerrainGrid *pGrid, int chunkQuads, std::vector<TerrainRenderChunk> *pChunks);
+
+// Sets the rasterizer's camera and light as HandleRender has them to
+// start with, keeping the camera above the grid, then clears the image
+// and draws the chunks numFrames times.
+void RenderTerrainImage(const TerrainGrid *pGrid, const std::vector<TerrainRenderChunk> &chunks, int numFrames, SoftwareRasterizer *pRasterizer);
+
+// Runs -render: argv[0] is the name to show in the usage message, then
+// <in.bmp> <out.ppm|out.png> [width] [height] [frames] [threads].
+// Prints the timings, and returns the exit code.
+int RunTerrainRenderBatch(int argc, char **argv);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_94DE0A6ADA0B451295717E8BC07F9DBA
@@ -0,0 +1,938 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "TerrainTileFile.h"
+
+#include "ParallelJobs.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_TILE_FILE_SSE2 1
+#include <emmintrin.h>
+#else
+#define TERRAIN_TILE_FILE_SSE2 0
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static const char FILE_MAGIC[4] = {'T', 'T', 'F', '1'};
+static const uint32_t FILE_VERSION = 2;
+
+// Version 1 files, from before the lossy mode, have no maxError.
+static const size_t VERSION_1_HEADER_SIZE = 32;
+static const size_t HEADER_SIZE = 36;
+static const size_t TILE_INDEX_SIZE = 4;
+static const size_t LEVEL_INDEX_SIZE = 12;
+
+// Differences are packed in groups of this many.
+static const int GROUP_SIZE = 16;
+
+// Each compressed level ends with this many zero bytes, so unpacking
+// can always read 4 bytes at a time.
+static const size_t PADDING_SIZE = 4;
+
+static const int MAX_TILE_QUADS = 32768;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainTileFileParams::TerrainTileFileParams():
+tileQuads(128),
+heightOffset(0.f),
+heightStep(1.f / 16),
+maxError(0.f),
+maxNumThreads(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static uint16_t ReadU16(const uint8_t *p)
+{
+	return uint16_t(p[0] | p[1] << 8);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static uint32_t ReadU32(const uint8_t *p)
+{
+	return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static uint64_t ReadU64(const uint8_t *p)
+{
+	return uint64_t(ReadU32(p)) | uint64_t(ReadU32(p + 4)) << 32;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float ReadF32(const uint8_t *p)
+{
+	uint32_t bits = ReadU32(p);
+
+	float value;
+	memcpy(&value, &bits, sizeof value);
+
+	return value;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void AppendU16(std::vector<uint8_t> *pData, uint16_t value)
+{
+	pData->push_back(uint8_t(value));
+	pData->push_back(uint8_t(value >> 8));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void AppendU32(std::vector<uint8_t> *pData, uint32_t value)
+{
+	for (int i = 0; i < 4; ++i)
+		pData->push_back(uint8_t(value >> i * 8));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void AppendU64(std::vector<uint8_t> *pData, uint64_t value)
+{
+	AppendU32(pData, uint32_t(value));
+	AppendU32(pData, uint32_t(value >> 32));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void AppendF32(std::vector<uint8_t> *pData, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof bits);
+
+	AppendU32(pData, bits);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The stdio seek and tell only go up to 2GB on Windows.
+static bool SeekFile(FILE *pFile, uint64_t offset, int origin)
+{
+#ifdef _MSC_VER
+	return _fseeki64(pFile, int64_t(offset), origin) == 0;
+#else
+	return fseeko(pFile, off_t(offset), origin) == 0;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static uint64_t TellFile(FILE *pFile)
+{
+#ifdef _MSC_VER
+	return uint64_t(_ftelli64(pFile));
+#else
+	return uint64_t(ftello(pFile));
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool IsPowerOf2(int x)
+{
+	return x > 0 && (x & (x - 1)) == 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static int GetNumTileLevels(int tileQuads)
+{
+	int numLevels = 1;
+
+	while ((1 << (numLevels - 1)) < tileQuads)
+		++numLevels;
+
+	return numLevels;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static int GetNumTiles(int numPoints, int tileQuads)
+{
+	return std::max((numPoints - 1 + tileQuads - 1) / tileQuads, 1);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Small differences either way become small unsigned numbers. The
+// differences wrap round at 16 bits, so they always fit.
+static uint16_t ZigZag(uint16_t x)
+{
+	return uint16_t(x << 1 ^ -(x >> 15));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static uint16_t UnZigZag(uint16_t x)
+{
+	return uint16_t(x >> 1 ^ -(x & 1));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Appends the compressed numPoints*numPoints values.
+static void CompressLevel(const uint16_t *pValues, int numPoints, std::vector<uint8_t> *pData)
+{
+	size_t numValues = size_t(numPoints) * numPoints;
+
+	std::vector<uint16_t> differences(numValues);
+
+	for (int row = 0; row < numPoints; ++row)
+	{
+		const uint16_t *pRow = &pValues[size_t(row) * numPoints];
+		const uint16_t *pAbove = row > 0 ? pRow - numPoints : NULL;
+		uint16_t *pDifferences = &differences[size_t(row) * numPoints];
+
+		for (int col = 0; col < numPoints; ++col)
+		{
+			int prediction;
+
+			if (row == 0)
+				prediction = col == 0 ? 0 : pRow[col - 1];
+			else if (col == 0)
+				prediction = pAbove[0];
+			else
+				prediction = pRow[col - 1] + pAbove[col] - pAbove[col - 1];
+
+			pDifferences[col] = ZigZag(uint16_t(pRow[col] - prediction));
+		}
+	}
+
+	for (size_t i = 0; i < numValues; i += GROUP_SIZE)
+	{
+		uint16_t group[GROUP_SIZE] = {};
+		uint32_t bits = 0;
+
+		for (size_t j = 0; j < GROUP_SIZE && i + j < numValues; ++j)
+		{
+			group[j] = differences[i + j];
+			bits |= group[j];
+		}
+
+		int width = 0;
+		while (bits >> width)
+			++width;
+
+		pData->push_back(uint8_t(width));
+
+		// GROUP_SIZE * width bits is always a whole number of bytes.
+		uint64_t buffer = 0;
+		int numBufferBits = 0;
+
+		for (size_t j = 0; j < GROUP_SIZE; ++j)
+		{
+			buffer |= uint64_t(group[j]) << numBufferBits;
+			numBufferBits += width;
+
+			while (numBufferBits >= 8)
+			{
+				pData->push_back(uint8_t(buffer));
+				buffer >>= 8;
+				numBufferBits -= 8;
+			}
+		}
+	}
+
+	pData->insert(pData->end(), PADDING_SIZE, 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Unpacks a group of GROUP_SIZE differences, WIDTH bits each. With
+// the width known at compile time, the shifts and masks are all
+// constants.
+template <int WIDTH>
+static void UnpackGroup(const uint8_t *pData, uint16_t *pGroup)
+{
+	// A value never starts more than 7 bits into a byte, and is at most
+	// 16 bits, so 4 bytes always hold all of it.
+	for (int j = 0; j < GROUP_SIZE; ++j)
+	{
+		int bit = j * WIDTH;
+
+		pGroup[j] = uint16_t(ReadU32(pData + (bit >> 3)) >> (bit & 7) & ((1u << WIDTH) - 1));
+	}
+}
+
+typedef void (*UnpackGroupFn)(const uint8_t *pData, uint16_t *pGroup);
+
+static const UnpackGroupFn UNPACK_GROUP_FNS[] = {
+	&UnpackGroup<0>, &UnpackGroup<1>, &UnpackGroup<2>, &UnpackGroup<3>,
+	&UnpackGroup<4>, &UnpackGroup<5>, &UnpackGroup<6>, &UnpackGroup<7>,
+	&UnpackGroup<8>, &UnpackGroup<9>, &UnpackGroup<10>, &UnpackGroup<11>,
+	&UnpackGroup<12>, &UnpackGroup<13>, &UnpackGroup<14>, &UnpackGroup<15>,
+	&UnpackGroup<16>,
+};
+
+static const int MAX_GROUP_WIDTH = sizeof UNPACK_GROUP_FNS / sizeof UNPACK_GROUP_FNS[0] - 1;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Undoes the plane prediction for a row. Each value is
+//
+//     left + above - aboveLeft + difference
+//
+// (with 0 for anything off the edge), which is the same as the value
+// above plus the sum of this row's differences so far. So 8 columns at
+// a time are done with a prefix sum, the same, bit for bit, as one at
+// a time. pAbove is NULL for the first row.
+static void UnpredictRow(const uint16_t *pDifferences, const uint16_t *pAbove, int numPoints, uint16_t *pRow)
+{
+	uint16_t sum = 0;
+	int col = 0;
+
+#if TERRAIN_TILE_FILE_SSE2
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+
+	__m128i sums = zero;
+
+	for (; col + 8 <= numPoints; col += 8)
+	{
+		__m128i differences = _mm_loadu_si128((const __m128i *)&pDifferences[col]);
+
+		// UnZigZag.
+		differences = _mm_xor_si128(_mm_srli_epi16(differences, 1), _mm_sub_epi16(zero, _mm_and_si128(differences, one)));
+
+		differences = _mm_add_epi16(differences, _mm_slli_si128(differences, 2));
+		differences = _mm_add_epi16(differences, _mm_slli_si128(differences, 4));
+		differences = _mm_add_epi16(differences, _mm_slli_si128(differences, 8));
+
+		// The running sum, and the last lane of it in every lane for the
+		// next 8.
+		sums = _mm_add_epi16(differences, sums);
+
+		__m128i above = pAbove ? _mm_loadu_si128((const __m128i *)&pAbove[col]) : zero;
+		_mm_storeu_si128((__m128i *)&pRow[col], _mm_add_epi16(above, sums));
+
+		sums = _mm_shufflehi_epi16(sums, _MM_SHUFFLE(3, 3, 3, 3));
+		sums = _mm_unpackhi_epi64(sums, sums);
+	}
+
+	sum = uint16_t(_mm_cvtsi128_si32(sums));
+
+#endif
+
+	for (; col < numPoints; ++col)
+	{
+		sum = uint16_t(sum + UnZigZag(pDifferences[col]));
+		pRow[col] = uint16_t((pAbove ? pAbove[col] : 0) + sum);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// heightOffset + value * heightStep, for each value.
+static void ValuesToHeights(const uint16_t *pValues, size_t numValues, float heightOffset, float heightStep, float *pHeights)
+{
+	size_t i = 0;
+
+#if TERRAIN_TILE_FILE_SSE2
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 offset = _mm_set1_ps(heightOffset);
+	const __m128 step = _mm_set1_ps(heightStep);
+
+	for (; i + 8 <= numValues; i += 8)
+	{
+		__m128i values = _mm_loadu_si128((const __m128i *)&pValues[i]);
+
+		__m128 low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero));
+		__m128 high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero));
+
+		_mm_storeu_ps(&pHeights[i], _mm_add_ps(offset, _mm_mul_ps(low, step)));
+		_mm_storeu_ps(&pHeights[i + 4], _mm_add_ps(offset, _mm_mul_ps(high, step)));
+	}
+
+#endif
+
+	for (; i < numValues; ++i)
+		pHeights[i] = heightOffset + float(pValues[i]) * heightStep;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Returns false if the data's the wrong size for numPoints*numPoints
+// values.
+static bool DecompressLevel(const uint8_t *pData, size_t size, int numPoints, uint16_t *pValues)
+{
+	size_t numValues = size_t(numPoints) * numPoints;
+	size_t numGroups = (numValues + GROUP_SIZE - 1) / GROUP_SIZE;
+
+	if (size < PADDING_SIZE)
+		return false;
+
+	const uint8_t *pEnd = pData + size - PADDING_SIZE;
+
+	std::vector<uint16_t> differences(numGroups * GROUP_SIZE);
+
+	for (size_t i = 0; i < numGroups; ++i)
+	{
+		if (pData >= pEnd)
+			return false;
+
+		int width = *pData++;
+		if (width > MAX_GROUP_WIDTH || pEnd - pData < 2 * width)
+			return false;
+
+		UNPACK_GROUP_FNS[width](pData, &differences[i * GROUP_SIZE]);
+
+		pData += 2 * width;
+	}
+
+	if (pData != pEnd)
+		return false;
+
+	for (int row = 0; row < numPoints; ++row)
+	{
+		uint16_t *pRow = &pValues[size_t(row) * numPoints];
+
+		UnpredictRow(&differences[size_t(row) * numPoints], row > 0 ? pRow - numPoints : NULL, numPoints, pRow);
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool SaveTerrainTileFile(const char *pFileName, const float *pHeights, int width, int length, const TerrainTileFileParams &params)
+{
+	if (width < 1 || length < 1 || !IsPowerOf2(params.tileQuads) || params.tileQuads > MAX_TILE_QUADS)
+		return false;
+
+	float heightOffset = params.heightOffset;
+	float heightStep = params.heightStep;
+
+	if (params.maxError > 0.f)
+	{
+		float minHeight = pHeights[0];
+		float maxHeight = pHeights[0];
+
+		for (size_t i = 1; i < size_t(width) * length; ++i)
+		{
+			minHeight = std::min(minHeight, pHeights[i]);
+			maxHeight = std::max(maxHeight, pHeights[i]);
+		}
+
+		// A whisker under twice the error, so that rounding to the
+		// nearest step is always within it, even after the rounding in
+		// working the height back out, which gets worse the further the
+		// heights are from 0.
+		float maxAbsHeight = std::max(fabsf(minHeight), fabsf(maxHeight));
+
+		heightOffset = minHeight;
+		heightStep = params.maxError * 1.999f - maxAbsHeight * FLT_EPSILON * 8;
+
+		if (!(heightStep > 0.f) || !((maxHeight - heightOffset) / heightStep <= 65535.f))
+			return false;
+	}
+
+	if (!(heightStep > 0.f))
+		return false;
+
+	int tileQuads = params.tileQuads;
+	int numLevels = GetNumTileLevels(tileQuads);
+	int numTilesX = GetNumTiles(width, tileQuads);
+	int numTilesZ = GetNumTiles(length, tileQuads);
+	size_t numTiles = size_t(numTilesX) * numTilesZ;
+
+	std::vector<uint16_t> values(size_t(width) * length);
+
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		float step = floorf((pHeights[i] - heightOffset) / heightStep + .5f);
+
+		values[i] = uint16_t(std::max(std::min(step, 65535.f), 0.f));
+
+		// Check the height comes back within the error, exactly as
+		// ReadTile works it out. If the division above rounded the wrong
+		// way, the next step along will do.
+		if (params.maxError > 0.f)
+		{
+			float height;
+			ValuesToHeights(&values[i], 1, heightOffset, heightStep, &height);
+
+			if (!(fabsf(height - pHeights[i]) <= params.maxError))
+			{
+				uint16_t nextValue = uint16_t(height < pHeights[i] ? std::min(values[i] + 1, 65535) : std::max(values[i] - 1, 0));
+				ValuesToHeights(&nextValue, 1, heightOffset, heightStep, &height);
+
+				if (!(fabsf(height - pHeights[i]) <= params.maxError))
+					return false;
+
+				values[i] = nextValue;
+			}
+		}
+	}
+
+	std::vector<std::vector<uint8_t> > tileData(numTiles);
+	std::vector<uint32_t> levelSizes(numTiles * numLevels);
+	std::vector<uint16_t> tileMins(numTiles);
+	std::vector<uint16_t> tileMaxes(numTiles);
+
+	RunParallelJobs(numTiles, params.maxNumThreads, [&](size_t tileIndex, std::string *) {
+		int minCol = int(tileIndex % numTilesX) * tileQuads;
+		int minRow = int(tileIndex / numTilesX) * tileQuads;
+		int numPoints = tileQuads + 1;
+
+		// Past the edge of the map, the edge repeats.
+		std::vector<uint16_t> tileValues(size_t(numPoints) * numPoints);
+
+		for (int row = 0; row < numPoints; ++row)
+		{
+			const uint16_t *pSrc = &values[size_t(std::min(minRow + row, length - 1)) * width];
+
+			for (int col = 0; col < numPoints; ++col)
+				tileValues[size_t(row) * numPoints + col] = pSrc[std::min(minCol + col, width - 1)];
+		}
+
+		tileMins[tileIndex] = *std::min_element(tileValues.begin(), tileValues.end());
+		tileMaxes[tileIndex] = *std::max_element(tileValues.begin(), tileValues.end());
+
+		std::vector<uint16_t> levelValues;
+
+		for (int level = 0; level < numLevels; ++level)
+		{
+			int levelNumPoints = (tileQuads >> level) + 1;
+
+			levelValues.resize(size_t(levelNumPoints) * levelNumPoints);
+
+			for (int row = 0; row < levelNumPoints; ++row)
+			{
+				for (int col = 0; col < levelNumPoints; ++col)
+					levelValues[size_t(row) * levelNumPoints + col] = tileValues[size_t(row << level) * numPoints + (col << level)];
+			}
+
+			size_t oldSize = tileData[tileIndex].size();
+			CompressLevel(&levelValues[0], levelNumPoints, &tileData[tileIndex]);
+
+			levelSizes[tileIndex * numLevels + level] = uint32_t(tileData[tileIndex].size() - oldSize);
+		}
+
+		return true;
+	}, NULL);
+
+	std::vector<uint8_t> header;
+
+	header.insert(header.end(), FILE_MAGIC, FILE_MAGIC + sizeof FILE_MAGIC);
+	AppendU32(&header, FILE_VERSION);
+	AppendU32(&header, uint32_t(width));
+	AppendU32(&header, uint32_t(length));
+	AppendU32(&header, uint32_t(tileQuads));
+	AppendU32(&header, uint32_t(numLevels));
+	AppendF32(&header, heightOffset);
+	AppendF32(&header, heightStep);
+	AppendF32(&header, params.maxError > 0.f ? params.maxError : 0.f);
+	assert(header.size() == HEADER_SIZE);
+
+	uint64_t offset = HEADER_SIZE + numTiles * (TILE_INDEX_SIZE + numLevels * LEVEL_INDEX_SIZE);
+
+	for (size_t i = 0; i < numTiles; ++i)
+	{
+		AppendU16(&header, tileMins[i]);
+		AppendU16(&header, tileMaxes[i]);
+
+		for (int level = 0; level < numLevels; ++level)
+		{
+			uint32_t size = levelSizes[i * numLevels + level];
+
+			AppendU64(&header, offset);
+			AppendU32(&header, size);
+
+			offset += size;
+		}
+	}
+
+	FILE *pFile = fopen(pFileName, "wb");
+	if (!pFile)
+		return false;
+
+	bool good = fwrite(&header[0], 1, header.size(), pFile) == header.size();
+
+	for (size_t i = 0; i < numTiles && good; ++i)
+		good = fwrite(&tileData[i][0], 1, tileData[i].size(), pFile) == tileData[i].size();
+
+	if (fclose(pFile) != 0)
+		good = false;
+
+	return good;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainTileFile::TerrainTileFile():
+m_pFile(NULL),
+m_width(0),
+m_length(0),
+m_tileQuads(0),
+m_numLevels(0),
+m_numTilesX(0),
+m_numTilesZ(0),
+m_heightOffset(0.f),
+m_heightStep(0.f),
+m_maxError(0.f),
+m_numBytes(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainTileFile::~TerrainTileFile()
+{
+	this->Close();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainTileFile::Open(const char *pFileName)
+{
+	this->Close();
+
+	m_pFile = fopen(pFileName, "rb");
+	if (!m_pFile)
+		return false;
+
+	uint8_t header[HEADER_SIZE];
+	uint64_t fileSize = 0;
+
+	if (SeekFile(m_pFile, 0, SEEK_END))
+		fileSize = TellFile(m_pFile);
+
+	if (!SeekFile(m_pFile, 0, SEEK_SET) || fread(header, 1, VERSION_1_HEADER_SIZE, m_pFile) != VERSION_1_HEADER_SIZE || memcmp(header, FILE_MAGIC, sizeof FILE_MAGIC) != 0)
+	{
+		this->Close();
+		return false;
+	}
+
+	uint32_t version = ReadU32(header + 4);
+
+	if ((version != 1 && version != FILE_VERSION) || (version == FILE_VERSION && fread(header + VERSION_1_HEADER_SIZE, 1, HEADER_SIZE - VERSION_1_HEADER_SIZE, m_pFile) != HEADER_SIZE - VERSION_1_HEADER_SIZE))
+	{
+		this->Close();
+		return false;
+	}
+
+	uint32_t width = ReadU32(header + 8);
+	uint32_t length = ReadU32(header + 12);
+	uint32_t tileQuads = ReadU32(header + 16);
+	uint32_t numLevels = ReadU32(header + 20);
+
+	if (width < 1 || width > 0x7fffffff || length < 1 || length > 0x7fffffff || tileQuads > MAX_TILE_QUADS || !IsPowerOf2(int(tileQuads)) || numLevels != uint32_t(GetNumTileLevels(int(tileQuads))))
+	{
+		this->Close();
+		return false;
+	}
+
+	m_width = int(width);
+	m_length = int(length);
+	m_tileQuads = int(tileQuads);
+	m_numLevels = int(numLevels);
+	m_numTilesX = GetNumTiles(m_width, m_tileQuads);
+	m_numTilesZ = GetNumTiles(m_length, m_tileQuads);
+	m_heightOffset = ReadF32(header + 24);
+	m_heightStep = ReadF32(header + 28);
+	m_maxError = version == 1 ? 0.f : ReadF32(header + 32);
+	m_numBytes = size_t(fileSize);
+
+	size_t numTiles = size_t(m_numTilesX) * m_numTilesZ;
+	size_t tileIndexSize = TILE_INDEX_SIZE + m_numLevels * LEVEL_INDEX_SIZE;
+
+	std::vector<uint8_t> index(numTiles * tileIndexSize);
+
+	if (fread(&index[0], 1, index.size(), m_pFile) != index.size())
+	{
+		this->Close();
+		return false;
+	}
+
+	m_tileMins.resize(numTiles);
+	m_tileMaxes.resize(numTiles);
+	m_levelEntries.resize(numTiles * m_numLevels);
+
+	for (size_t i = 0; i < numTiles; ++i)
+	{
+		const uint8_t *pTileIndex = &index[i * tileIndexSize];
+
+		m_tileMins[i] = ReadU16(pTileIndex);
+		m_tileMaxes[i] = ReadU16(pTileIndex + 2);
+
+		for (int level = 0; level < m_numLevels; ++level)
+		{
+			LevelEntry *pEntry = &m_levelEntries[i * m_numLevels + level];
+
+			pEntry->offset = ReadU64(pTileIndex + TILE_INDEX_SIZE + level * LEVEL_INDEX_SIZE);
+			pEntry->size = ReadU32(pTileIndex + TILE_INDEX_SIZE + level * LEVEL_INDEX_SIZE + 8);
+
+			if (pEntry->offset > fileSize || pEntry->size > fileSize - pEntry->offset)
+			{
+				this->Close();
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainTileFile::Close()
+{
+	if (m_pFile)
+	{
+		fclose(m_pFile);
+		m_pFile = NULL;
+	}
+
+	m_width = 0;
+	m_length = 0;
+	m_tileQuads = 0;
+	m_numLevels = 0;
+	m_numTilesX = 0;
+	m_numTilesZ = 0;
+	m_numBytes = 0;
+
+	std::vector<uint16_t>().swap(m_tileMins);
+	std::vector<uint16_t>().swap(m_tileMaxes);
+	std::vector<LevelEntry>().swap(m_levelEntries);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainTileFile::GetWidth() const
+{
+	return m_width;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainTileFile::GetLength() const
+{
+	return m_length;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainTileFile::GetTileQuads() const
+{
+	return m_tileQuads;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainTileFile::GetNumTilesX() const
+{
+	return m_numTilesX;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainTileFile::GetNumTilesZ() const
+{
+	return m_numTilesZ;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainTileFile::GetNumLevels() const
+{
+	return m_numLevels;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainTileFile::GetNumLevelPoints(int level) const
+{
+	return (m_tileQuads >> level) + 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainTileFile::GetLevelWidth(int level) const
+{
+	return ((m_width - 1) >> level) + 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainTileFile::GetLevelLength(int level) const
+{
+	return ((m_length - 1) >> level) + 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainTileFile::GetTileBounds(int tileX, int tileZ, float *pMinHeight, float *pMaxHeight) const
+{
+	assert(tileX >= 0 && tileX < m_numTilesX && tileZ >= 0 && tileZ < m_numTilesZ);
+
+	size_t tileIndex = size_t(tileZ) * m_numTilesX + tileX;
+
+	ValuesToHeights(&m_tileMins[tileIndex], 1, m_heightOffset, m_heightStep, pMinHeight);
+	ValuesToHeights(&m_tileMaxes[tileIndex], 1, m_heightOffset, m_heightStep, pMaxHeight);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainTileFile::GetTileNumBytes(int tileX, int tileZ, int level) const
+{
+	assert(tileX >= 0 && tileX < m_numTilesX && tileZ >= 0 && tileZ < m_numTilesZ && level >= 0 && level < m_numLevels);
+
+	return m_levelEntries[(size_t(tileZ) * m_numTilesX + tileX) * m_numLevels + level].size;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainTileFile::GetNumBytes() const
+{
+	return m_numBytes;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float TerrainTileFile::GetMaxError() const
+{
+	return m_maxError;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainTileFile::ReadTile(int tileX, int tileZ, int level, float *pHeights) const
+{
+	std::vector<uint8_t> data;
+
+	if (!this->ReadCompressedTile(tileX, tileZ, level, &data))
+		return false;
+
+	int numPoints = this->GetNumLevelPoints(level);
+	std::vector<uint16_t> values(size_t(numPoints) * numPoints);
+
+	if (!DecompressLevel(&data[0], data.size(), numPoints, &values[0]))
+		return false;
+
+	ValuesToHeights(&values[0], values.size(), m_heightOffset, m_heightStep, pHeights);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainTileFile::ReadLevel(int level, float *pHeights, unsigned maxNumThreads) const
+{
+	if (!m_pFile || level < 0 || level >= m_numLevels)
+		return false;
+
+	int levelWidth = this->GetLevelWidth(level);
+	int levelLength = this->GetLevelLength(level);
+	int numPoints = this->GetNumLevelPoints(level);
+	int levelTileQuads = numPoints - 1;
+
+	size_t numTiles = size_t(m_numTilesX) * m_numTilesZ;
+
+	size_t numFailed = RunParallelJobs(numTiles, maxNumThreads, [&](size_t tileIndex, std::string *) {
+		int tileX = int(tileIndex % m_numTilesX);
+		int tileZ = int(tileIndex / m_numTilesX);
+
+		std::vector<float> tileHeights(size_t(numPoints) * numPoints);
+
+		if (!this->ReadTile(tileX, tileZ, level, &tileHeights[0]))
+			return false;
+
+		// Each tile leaves its far edges to its neighbours, except at the
+		// edge of the map, so no point's written twice.
+		int minCol = tileX * levelTileQuads;
+		int minRow = tileZ * levelTileQuads;
+		int maxCol = std::min(minCol + levelTileQuads - (tileX < m_numTilesX - 1 ? 1 : 0), levelWidth - 1);
+		int maxRow = std::min(minRow + levelTileQuads - (tileZ < m_numTilesZ - 1 ? 1 : 0), levelLength - 1);
+
+		for (int row = minRow; row <= maxRow; ++row)
+		{
+			const float *pSrc = &tileHeights[size_t(row - minRow) * numPoints];
+
+			std::copy(pSrc, pSrc + (maxCol - minCol + 1), &pHeights[size_t(row) * levelWidth + minCol]);
+		}
+
+		return true;
+	}, NULL);
+
+	return numFailed == 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainTileFile::ReadCompressedTile(int tileX, int tileZ, int level, std::vector<uint8_t> *pData) const
+{
+	if (!m_pFile || tileX < 0 || tileX >= m_numTilesX || tileZ < 0 || tileZ >= m_numTilesZ || level < 0 || level >= m_numLevels)
+		return false;
+
+	const LevelEntry &entry = m_levelEntries[(size_t(tileZ) * m_numTilesX + tileX) * m_numLevels + level];
+
+	pData->resize(entry.size);
+
+	if (pData->empty())
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_fileMutex);
+
+	return SeekFile(m_pFile, entry.offset, SEEK_SET) && fread(&(*pData)[0], 1, pData->size(), m_pFile) == pData->size();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
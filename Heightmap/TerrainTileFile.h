@@ -0,0 +1,177 @@
+#ifndef HEADER_05D0EF5F48C443DC8AA7F16EC6B7B231
+#define HEADER_05D0EF5F48C443DC8AA7F16EC6B7B231
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Height maps in compressed, tiled files, so that part of a big map
+// can be read without reading (or decompressing) the rest.
+//
+// The map is split into square tiles of tileQuads quads, which share
+// their edge points with their neighbours, the same as TerrainWorld's
+// tiles. Points past the edge of the map, in the last column and row
+// of tiles, repeat the edge.
+//
+// Each tile is kept at several resolutions. Level 0 has every point,
+// level 1 every other point, and so on down to just the 4 corners.
+// Since the levels are made by picking points, not averaging them,
+// neighbouring tiles still match along their edges at every level.
+//
+// Heights are stored as 16-bit steps of heightStep up from
+// heightOffset. Each level of each tile is compressed on its own: each
+// point is predicted from the plane through the 3 before it (left +
+// above - above left), and the differences are packed into groups of
+// 16, each using as many bits as its biggest difference needs.
+// Compressing BMP height maps with the default heightStep of 1/16
+// loses nothing.
+//
+// Or, with maxError set, the heights are stored lossily, with a step
+// of just under 2 * maxError, so that no height comes back more than
+// maxError out. Since the steps are coarser, the differences are
+// smaller and pack tighter. Each height is checked on the way in, so
+// the limit holds whatever the rounding.
+//
+// Unpacking is done with SSE2, where it's available, 8 heights at a
+// time. The results are the same, bit for bit, as without.
+//
+// The index at the start of the file has each tile's lowest and
+// highest heights, as well as where each of its levels is.
+//
+// File layout, all little endian:
+//
+//     "TTF1", u32 version, u32 width, u32 length, u32 tileQuads,
+//     u32 numLevels, f32 heightOffset, f32 heightStep, f32 maxError
+//     (0 if lossless; version 2 on)
+//
+//     for each tile, row by row: u16 min, u16 max, and for each
+//     level: u64 offset from the start of the file, u32 size
+//
+//     the compressed levels
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <mutex>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TerrainTileFileParams
+{
+	// A power of 2.
+	int tileQuads;
+
+	float heightOffset;
+	float heightStep;
+
+	// If more than 0, heightOffset and heightStep are ignored, and
+	// picked to keep every height within maxError. Saving fails if the
+	// heights span more than 65535 steps.
+	float maxError;
+
+	// For compressing the tiles (0 means one per hardware thread).
+	unsigned maxNumThreads;
+
+	// 128 quad tiles, and heights stepped the same as
+	// HeightMapApplication's BMP height maps.
+	TerrainTileFileParams();
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Saves width*length heights, row by row. Heights outside the range
+// the steps cover are clamped.
+bool SaveTerrainTileFile(const char *pFileName, const float *pHeights, int width, int length, const TerrainTileFileParams &params);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainTileFile
+{
+public:
+	TerrainTileFile();
+	~TerrainTileFile();
+
+	// Reads the header and index, and keeps the file open for reading
+	// the tiles.
+	bool Open(const char *pFileName);
+	void Close();
+
+	int GetWidth() const;
+	int GetLength() const;
+	int GetTileQuads() const;
+	int GetNumTilesX() const;
+	int GetNumTilesZ() const;
+	int GetNumLevels() const;
+
+	// Points along a tile's side at a level.
+	int GetNumLevelPoints(int level) const;
+
+	// Points along the map's sides at a level.
+	int GetLevelWidth(int level) const;
+	int GetLevelLength(int level) const;
+
+	void GetTileBounds(int tileX, int tileZ, float *pMinHeight, float *pMaxHeight) const;
+
+	// Compressed size of a level of a tile, and of the whole file.
+	size_t GetTileNumBytes(int tileX, int tileZ, int level) const;
+	size_t GetNumBytes() const;
+
+	// The most any height can be out, if the file's lossy, otherwise 0.
+	float GetMaxError() const;
+
+	// Fills in GetNumLevelPoints(level) squared heights, row by row.
+	// Several threads can read tiles at once.
+	bool ReadTile(int tileX, int tileZ, int level, float *pHeights) const;
+
+	// Fills in the whole map at a level, GetLevelWidth(level) by
+	// GetLevelLength(level) heights, reading the tiles on up to
+	// maxNumThreads threads (0 means one per hardware thread).
+	bool ReadLevel(int level, float *pHeights, unsigned maxNumThreads) const;
+protected:
+private:
+	struct LevelEntry
+	{
+		uint64_t offset;
+		uint32_t size;
+	};
+
+	FILE *m_pFile;
+	mutable std::mutex m_fileMutex;
+
+	int m_width;
+	int m_length;
+	int m_tileQuads;
+	int m_numLevels;
+	int m_numTilesX;
+	int m_numTilesZ;
+	float m_heightOffset;
+	float m_heightStep;
+	float m_maxError;
+	size_t m_numBytes;
+
+	// Per tile, row by row.
+	std::vector<uint16_t> m_tileMins;
+	std::vector<uint16_t> m_tileMaxes;
+
+	// Per tile, numLevels each.
+	std::vector<LevelEntry> m_levelEntries;
+
+	bool ReadCompressedTile(int tileX, int tileZ, int level, std::vector<uint8_t> *pData) const;
+
+	TerrainTileFile(const TerrainTileFile &);
+	TerrainTileFile &operator=(const TerrainTileFile &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_05D0EF5F48C443DC8AA7F16EC6B7B231
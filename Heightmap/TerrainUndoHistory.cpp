@@ -0,0 +1,415 @@
+#include "TerrainUndoHistory.h"
+#include "HeightField.h"
+
+#include <assert.h>
+
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainUndoHistory::TerrainUndoHistory():
+m_pHeightField(NULL),
+m_tileSize(1),
+m_numTilesWide(0),
+m_numTilesLong(0),
+m_maxNumSteps(0),
+m_maxNumBytes(0),
+m_numDoneSteps(0),
+m_inStep(false),
+m_stepStamp(0),
+m_numBytes(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainUndoHistory::~TerrainUndoHistory()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainUndoHistory::Create(HeightField *pHeightField, int tileSize, size_t maxNumSteps, size_t maxNumBytes)
+{
+	this->Destroy();
+
+	int width = pHeightField->GetWidth();
+	int length = pHeightField->GetLength();
+
+	if (width < 2 || length < 2 || tileSize < 1 || maxNumSteps < 1)
+		return false;
+
+	m_pHeightField = pHeightField;
+	m_tileSize = tileSize;
+	m_numTilesWide = (width + tileSize - 1) / tileSize;
+	m_numTilesLong = (length + tileSize - 1) / tileSize;
+	m_maxNumSteps = maxNumSteps;
+	m_maxNumBytes = maxNumBytes;
+
+	size_t numTiles = size_t(m_numTilesWide) * m_numTilesLong;
+
+	m_latestTiles.assign(numTiles, NULL);
+	m_tileStepStamps.assign(numTiles, 0);
+	m_stepStamp = 0;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::Destroy()
+{
+	for (size_t i = 0; i < m_steps.size(); ++i)
+		this->ReleaseStep(&m_steps[i]);
+
+	this->ReleaseStep(&m_currentStep);
+
+	for (size_t i = 0; i < m_latestTiles.size(); ++i)
+		this->ReleaseTile(m_latestTiles[i]);
+
+	assert(m_numBytes == 0);
+
+	m_steps.clear();
+	m_numDoneSteps = 0;
+	m_inStep = false;
+
+	m_latestTiles.clear();
+	m_tileStepStamps.clear();
+	m_changedTiles.clear();
+
+	m_pHeightField = NULL;
+	m_numTilesWide = 0;
+	m_numTilesLong = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::BeginStep()
+{
+	if (!m_pHeightField || m_inStep)
+		return;
+
+	while (m_steps.size() > m_numDoneSteps)
+	{
+		this->ReleaseStep(&m_steps.back());
+		m_steps.pop_back();
+	}
+
+	if (++m_stepStamp == 0)
+	{
+		std::fill(m_tileStepStamps.begin(), m_tileStepStamps.end(), 0);
+		m_stepStamp = 1;
+	}
+
+	m_inStep = true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::SaveRegion(int minCol, int minRow, int maxCol, int maxRow)
+{
+	if (!m_inStep)
+		return;
+
+	minCol = std::max(minCol, 0);
+	minRow = std::max(minRow, 0);
+	maxCol = std::min(maxCol, m_pHeightField->GetWidth() - 1);
+	maxRow = std::min(maxRow, m_pHeightField->GetLength() - 1);
+
+	if (minCol > maxCol || minRow > maxRow)
+		return;
+
+	for (int tileRow = minRow / m_tileSize; tileRow <= maxRow / m_tileSize; ++tileRow)
+	{
+		for (int tileCol = minCol / m_tileSize; tileCol <= maxCol / m_tileSize; ++tileCol)
+		{
+			int tileIndex = tileRow * m_numTilesWide + tileCol;
+
+			if (m_tileStepStamps[tileIndex] == m_stepStamp)
+				continue;
+
+			m_tileStepStamps[tileIndex] = m_stepStamp;
+
+			StepTile stepTile;
+			stepTile.tileIndex = tileIndex;
+			stepTile.pAfter = NULL;
+
+			// Share the latest copy if there is one. Otherwise, this is
+			// the first time the tile has changed, so copy it now.
+			if (m_latestTiles[tileIndex])
+			{
+				stepTile.pBefore = m_latestTiles[tileIndex];
+				this->AddRefTile(stepTile.pBefore);
+			}
+			else
+			{
+				stepTile.pBefore = this->CopyTile(tileIndex);
+				this->SetLatestTile(tileIndex, stepTile.pBefore);
+			}
+
+			m_currentStep.tiles.push_back(stepTile);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::EndStep()
+{
+	if (!m_inStep)
+		return;
+
+	m_inStep = false;
+
+	if (m_currentStep.tiles.empty())
+		return;
+
+	for (size_t i = 0; i < m_currentStep.tiles.size(); ++i)
+	{
+		StepTile *pStepTile = &m_currentStep.tiles[i];
+
+		pStepTile->pAfter = this->CopyTile(pStepTile->tileIndex);
+		this->SetLatestTile(pStepTile->tileIndex, pStepTile->pAfter);
+	}
+
+	m_steps.push_back(Step());
+	m_steps.back().tiles.swap(m_currentStep.tiles);
+	m_numDoneSteps = m_steps.size();
+
+	this->ForgetOldSteps();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainUndoHistory::Undo()
+{
+	m_changedTiles.clear();
+
+	if (m_inStep || m_numDoneSteps == 0)
+		return false;
+
+	const Step *pStep = &m_steps[--m_numDoneSteps];
+
+	for (size_t i = 0; i < pStep->tiles.size(); ++i)
+	{
+		const StepTile *pStepTile = &pStep->tiles[i];
+
+		this->RestoreTile(pStepTile->tileIndex, pStepTile->pBefore);
+		m_changedTiles.push_back(pStepTile->tileIndex);
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainUndoHistory::Redo()
+{
+	m_changedTiles.clear();
+
+	if (m_inStep || m_numDoneSteps == m_steps.size())
+		return false;
+
+	const Step *pStep = &m_steps[m_numDoneSteps++];
+
+	for (size_t i = 0; i < pStep->tiles.size(); ++i)
+	{
+		const StepTile *pStepTile = &pStep->tiles[i];
+
+		this->RestoreTile(pStepTile->tileIndex, pStepTile->pAfter);
+		m_changedTiles.push_back(pStepTile->tileIndex);
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainUndoHistory::GetNumChangedRects() const
+{
+	return m_changedTiles.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::GetChangedRect(size_t i, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow) const
+{
+	assert(i < m_changedTiles.size());
+
+	this->GetTileRect(m_changedTiles[i], pMinCol, pMinRow, pMaxCol, pMaxRow);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainUndoHistory::GetNumUndoSteps() const
+{
+	return m_numDoneSteps;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainUndoHistory::GetNumRedoSteps() const
+{
+	return m_steps.size() - m_numDoneSteps;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainUndoHistory::GetNumBytes() const
+{
+	return m_numBytes;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::GetTileRect(int tileIndex, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow) const
+{
+	int tileCol = tileIndex % m_numTilesWide;
+	int tileRow = tileIndex / m_numTilesWide;
+
+	*pMinCol = tileCol * m_tileSize;
+	*pMinRow = tileRow * m_tileSize;
+	*pMaxCol = std::min(*pMinCol + m_tileSize, m_pHeightField->GetWidth()) - 1;
+	*pMaxRow = std::min(*pMinRow + m_tileSize, m_pHeightField->GetLength()) - 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainUndoHistory::Tile *TerrainUndoHistory::CopyTile(int tileIndex)
+{
+	int minCol, minRow, maxCol, maxRow;
+	this->GetTileRect(tileIndex, &minCol, &minRow, &maxCol, &maxRow);
+
+	int width = m_pHeightField->GetWidth();
+	const float *pGrid = m_pHeightField->GetGridHeights();
+
+	Tile *pTile = new Tile;
+
+	pTile->refCount = 1;
+	pTile->heights.reserve(size_t(maxCol - minCol + 1) * (maxRow - minRow + 1));
+
+	for (int row = minRow; row <= maxRow; ++row)
+	{
+		const float *pRow = &pGrid[size_t(row) * width];
+
+		pTile->heights.insert(pTile->heights.end(), pRow + minCol, pRow + maxCol + 1);
+	}
+
+	m_numBytes += sizeof *pTile + pTile->heights.size() * sizeof pTile->heights[0];
+
+	return pTile;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::RestoreTile(int tileIndex, Tile *pTile)
+{
+	int minCol, minRow, maxCol, maxRow;
+	this->GetTileRect(tileIndex, &minCol, &minRow, &maxCol, &maxRow);
+
+	m_pHeightField->SetGridHeights(minCol, minRow, maxCol, maxRow, &pTile->heights[0]);
+
+	this->SetLatestTile(tileIndex, pTile);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::SetLatestTile(int tileIndex, Tile *pTile)
+{
+	this->AddRefTile(pTile);
+	this->ReleaseTile(m_latestTiles[tileIndex]);
+
+	m_latestTiles[tileIndex] = pTile;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::AddRefTile(Tile *pTile)
+{
+	++pTile->refCount;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::ReleaseTile(Tile *&pTile)
+{
+	if (!pTile)
+		return;
+
+	assert(pTile->refCount > 0);
+
+	if (--pTile->refCount == 0)
+	{
+		m_numBytes -= sizeof *pTile + pTile->heights.size() * sizeof pTile->heights[0];
+		delete pTile;
+	}
+
+	pTile = NULL;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::ReleaseStep(Step *pStep)
+{
+	for (size_t i = 0; i < pStep->tiles.size(); ++i)
+	{
+		this->ReleaseTile(pStep->tiles[i].pBefore);
+		this->ReleaseTile(pStep->tiles[i].pAfter);
+	}
+
+	pStep->tiles.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainUndoHistory::ForgetOldSteps()
+{
+	while (m_steps.size() > m_maxNumSteps || (m_numBytes > m_maxNumBytes && m_steps.size() > 1))
+	{
+		Step *pOldest = &m_steps.front();
+
+		for (size_t i = 0; i < pOldest->tiles.size(); ++i)
+		{
+			StepTile *pStepTile = &pOldest->tiles[i];
+
+			this->ReleaseTile(pStepTile->pBefore);
+			this->ReleaseTile(pStepTile->pAfter);
+
+			// A latest copy that no step uses any more is only there in
+			// case a later step wants it, so it can go too.
+			Tile **ppLatest = &m_latestTiles[pStepTile->tileIndex];
+
+			if (*ppLatest && (*ppLatest)->refCount == 1)
+				this->ReleaseTile(*ppLatest);
+		}
+
+		m_steps.pop_front();
+		--m_numDoneSteps;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,140 @@
+#ifndef HEADER_58961A0F3FCF477B9DD584FEE83B92C7
+#define HEADER_58961A0F3FCF477B9DD584FEE83B92C7
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Undo and redo for edits to a HeightField.
+//
+// The grid is split into square tiles. Each undo step keeps copies of
+// only the tiles it changed, before and after, rather than the whole
+// grid. Tile copies are reference counted and shared: the "after" of
+// one step is the "before" of the next step to change that tile, so
+// it's only stored once, and the copies are never changed once made.
+// Undoing or redoing a step only copies its tiles back, so the time
+// it takes depends on how much the step changed, not on the size of
+// the grid.
+//
+// The history is limited to a number of steps and a number of bytes.
+// When it goes over either, the oldest steps are forgotten. (The
+// newest step is always kept, however big it is.)
+//
+// Every change to the heights must be made inside a step, with the
+// area about to change passed to SaveRegion first. A step can be
+// built up over many calls, e.g. one per frame for a brush stroke.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+class HeightField;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainUndoHistory
+{
+public:
+	TerrainUndoHistory();
+	~TerrainUndoHistory();
+
+	// The HeightField must outlast the history.
+	bool Create(HeightField *pHeightField, int tileSize, size_t maxNumSteps, size_t maxNumBytes);
+	void Destroy();
+
+	// Starting a step forgets anything that could have been redone.
+	void BeginStep();
+
+	// The grid points from (minCol, minRow) to (maxCol, maxRow)
+	// inclusive are about to change.
+	void SaveRegion(int minCol, int minRow, int maxCol, int maxRow);
+
+	// A step that didn't save anything is dropped.
+	void EndStep();
+
+	// Undo and Redo return false if there's nothing to do, or a step
+	// is in progress. Afterwards, the changed rectangles are the tiles
+	// that were put back.
+	bool Undo();
+	bool Redo();
+
+	size_t GetNumChangedRects() const;
+	void GetChangedRect(size_t i, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow) const;
+
+	size_t GetNumUndoSteps() const;
+	size_t GetNumRedoSteps() const;
+
+	// Memory used by tile copies.
+	size_t GetNumBytes() const;
+protected:
+private:
+	struct Tile
+	{
+		int refCount;
+		std::vector<float> heights;
+	};
+
+	struct StepTile
+	{
+		int tileIndex;
+		Tile *pBefore;
+		Tile *pAfter;
+	};
+
+	struct Step
+	{
+		std::vector<StepTile> tiles;
+	};
+
+	HeightField *m_pHeightField;
+	int m_tileSize;
+	int m_numTilesWide;
+	int m_numTilesLong;
+	size_t m_maxNumSteps;
+	size_t m_maxNumBytes;
+
+	// The latest copy of each tile, if there is one and it's still what
+	// the HeightField has.
+	std::vector<Tile *> m_latestTiles;
+
+	// Steps before m_numDoneSteps can be undone; the rest can be redone.
+	std::deque<Step> m_steps;
+	size_t m_numDoneSteps;
+
+	bool m_inStep;
+	Step m_currentStep;
+
+	// For spotting tiles already saved in the current step.
+	uint32_t m_stepStamp;
+	std::vector<uint32_t> m_tileStepStamps;
+
+	std::vector<int> m_changedTiles;
+	size_t m_numBytes;
+
+	void GetTileRect(int tileIndex, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow) const;
+
+	Tile *CopyTile(int tileIndex);
+	void RestoreTile(int tileIndex, Tile *pTile);
+	void SetLatestTile(int tileIndex, Tile *pTile);
+
+	void AddRefTile(Tile *pTile);
+	void ReleaseTile(Tile *&pTile);
+
+	void ReleaseStep(Step *pStep);
+	void ForgetOldSteps();
+
+	TerrainUndoHistory(const TerrainUndoHistory &);
+	TerrainUndoHistory &operator=(const TerrainUndoHistory &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_58961A0F3FCF477B9DD584FEE83B92C7
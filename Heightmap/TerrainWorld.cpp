@@ -0,0 +1,855 @@
+#include "TerrainWorld.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+#include <utility>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainWorldParams::TerrainWorldParams():
+numTilesX(1),
+numTilesZ(1),
+tileQuads(128),
+gridSize(1.f),
+stitchMargin(16),
+loadRadius(256.f),
+unloadRadius(320.f),
+maxNumBytes(64 * 1024 * 1024),
+maxLoadsPerUpdate(1)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void Cross(const float *pA, const float *pB, float *pResult)
+{
+	pResult[0] = pA[1] * pB[2] - pA[2] * pB[1];
+	pResult[1] = pA[2] * pB[0] - pA[0] * pB[2];
+	pResult[2] = pA[0] * pB[1] - pA[1] * pB[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainWorld::TerrainWorld():
+m_numLoadedTiles(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainWorld::~TerrainWorld()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainWorld::Create(const TerrainWorldParams &params, const TerrainWorldLoadFn &loadFn)
+{
+	this->Destroy();
+
+	if (params.numTilesX < 1 || params.numTilesZ < 1 || params.tileQuads < 1 || !loadFn)
+		return false;
+
+	m_params = params;
+	m_params.stitchMargin = std::max(1, std::min(params.stitchMargin, params.tileQuads / 2));
+
+	m_loadFn = loadFn;
+
+	m_tiles.resize(size_t(params.numTilesX) * params.numTilesZ);
+
+	for (size_t i = 0; i < m_tiles.size(); ++i)
+	{
+		m_tiles[i].state = TILE_STATE_UNKNOWN;
+		m_tiles[i].wanted = false;
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainWorld::Destroy()
+{
+	m_loadFn = TerrainWorldLoadFn();
+
+	std::vector<Tile>().swap(m_tiles);
+	m_numLoadedTiles = 0;
+
+	m_justLoadedTiles.clear();
+	m_justUnloadedTiles.clear();
+	m_changedTiles.clear();
+
+	std::vector<float>().swap(m_rawHeights);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const TerrainWorldParams &TerrainWorld::GetParams() const
+{
+	return m_params;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int TerrainWorld::GetNumTilePoints() const
+{
+	return m_params.tileQuads + 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainWorld::Update(float cameraCol, float cameraRow)
+{
+	m_justLoadedTiles.clear();
+	m_justUnloadedTiles.clear();
+	m_changedTiles.clear();
+
+	// Unloading further out than loading stops tiles near the edge of
+	// the radius coming and going as the camera wobbles about.
+	for (size_t i = 0; i < m_tiles.size(); ++i)
+	{
+		if (m_tiles[i].state == TILE_STATE_LOADED && this->GetTileDistance(int(i), cameraCol, cameraRow) > m_params.unloadRadius)
+			this->UnloadTile(int(i));
+	}
+
+	std::vector<std::pair<float, int> > wanted;
+
+	for (size_t i = 0; i < m_tiles.size(); ++i)
+	{
+		if (m_tiles[i].state == TILE_STATE_LOADED || m_tiles[i].state == TILE_STATE_MISSING)
+			continue;
+
+		float distance = this->GetTileDistance(int(i), cameraCol, cameraRow);
+
+		if (distance <= m_params.loadRadius)
+		{
+			wanted.push_back(std::make_pair(distance, int(i)));
+			m_tiles[i].wanted = true;
+		}
+	}
+
+	std::sort(wanted.begin(), wanted.end());
+
+	size_t tileNumBytes = this->GetTileNumBytes();
+	int numLoads = 0;
+	bool full = false;
+
+	for (size_t i = 0; i < wanted.size() && numLoads < m_params.maxLoadsPerUpdate && !full; ++i)
+	{
+		// Loading a neighbour might have found it's not there.
+		if (m_tiles[wanted[i].second].state == TILE_STATE_MISSING)
+			continue;
+
+		while (this->GetNumBytes() + tileNumBytes > m_params.maxNumBytes)
+		{
+			int furthestIndex = -1;
+			float furthestDistance = wanted[i].first;
+
+			for (size_t j = 0; j < m_tiles.size(); ++j)
+			{
+				if (m_tiles[j].state != TILE_STATE_LOADED)
+					continue;
+
+				float distance = this->GetTileDistance(int(j), cameraCol, cameraRow);
+
+				if (distance > furthestDistance)
+				{
+					furthestIndex = int(j);
+					furthestDistance = distance;
+				}
+			}
+
+			// Everything loaded is at least as near as this tile.
+			if (furthestIndex < 0)
+			{
+				full = true;
+				break;
+			}
+
+			this->UnloadTile(furthestIndex);
+		}
+
+		if (!full)
+		{
+			this->LoadTile(wanted[i].second);
+			++numLoads;
+		}
+	}
+
+	for (size_t i = 0; i < wanted.size(); ++i)
+	{
+		Tile *pTile = &m_tiles[wanted[i].second];
+
+		pTile->wanted = false;
+		std::vector<float>().swap(pTile->rawHeights);
+	}
+
+	// New tiles are wanted whole anyway, and gone ones not at all.
+	size_t numChanged = 0;
+
+	for (size_t i = 0; i < m_changedTiles.size(); ++i)
+	{
+		const ChangedTile &changed = m_changedTiles[i];
+		int tileIndex = changed.tileZ * m_params.numTilesX + changed.tileX;
+
+		if (m_tiles[tileIndex].state != TILE_STATE_LOADED)
+			continue;
+
+		if (std::find(m_justLoadedTiles.begin(), m_justLoadedTiles.end(), tileIndex) != m_justLoadedTiles.end())
+			continue;
+
+		m_changedTiles[numChanged++] = changed;
+	}
+
+	m_changedTiles.resize(numChanged);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainWorld::GetNumJustLoadedTiles() const
+{
+	return m_justLoadedTiles.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainWorld::GetJustLoadedTile(size_t i, int *pTileX, int *pTileZ) const
+{
+	assert(i < m_justLoadedTiles.size());
+
+	*pTileX = m_justLoadedTiles[i] % m_params.numTilesX;
+	*pTileZ = m_justLoadedTiles[i] / m_params.numTilesX;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainWorld::GetNumJustUnloadedTiles() const
+{
+	return m_justUnloadedTiles.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainWorld::GetJustUnloadedTile(size_t i, int *pTileX, int *pTileZ) const
+{
+	assert(i < m_justUnloadedTiles.size());
+
+	*pTileX = m_justUnloadedTiles[i] % m_params.numTilesX;
+	*pTileZ = m_justUnloadedTiles[i] / m_params.numTilesX;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainWorld::GetNumChangedTiles() const
+{
+	return m_changedTiles.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainWorld::GetChangedTile(size_t i, int *pTileX, int *pTileZ, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow) const
+{
+	assert(i < m_changedTiles.size());
+
+	const ChangedTile &changed = m_changedTiles[i];
+
+	*pTileX = changed.tileX;
+	*pTileZ = changed.tileZ;
+	*pMinCol = changed.minCol;
+	*pMinRow = changed.minRow;
+	*pMaxCol = changed.maxCol;
+	*pMaxRow = changed.maxRow;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainWorld::IsTileLoaded(int tileX, int tileZ) const
+{
+	const Tile *pTile = this->FindTile(tileX, tileZ);
+
+	return pTile && pTile->state == TILE_STATE_LOADED;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainWorld::IsTileKnown(int tileX, int tileZ) const
+{
+	const Tile *pTile = this->FindTile(tileX, tileZ);
+
+	return pTile && pTile->state != TILE_STATE_UNKNOWN;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainWorld::IsTileMissing(int tileX, int tileZ) const
+{
+	const Tile *pTile = this->FindTile(tileX, tileZ);
+
+	return pTile && pTile->state == TILE_STATE_MISSING;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const float *TerrainWorld::GetTileHeights(int tileX, int tileZ) const
+{
+	if (!this->IsTileLoaded(tileX, tileZ))
+		return NULL;
+
+	return &this->FindTile(tileX, tileZ)->heights[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const float *TerrainWorld::GetTileNormals(int tileX, int tileZ) const
+{
+	if (!this->IsTileLoaded(tileX, tileZ))
+		return NULL;
+
+	return &this->FindTile(tileX, tileZ)->normals[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainWorld::GetHeight(float col, float row, float *pHeight) const
+{
+	int numQuads = m_params.tileQuads;
+
+	if (!(col >= 0.f && col <= float(m_params.numTilesX * numQuads) && row >= 0.f && row <= float(m_params.numTilesZ * numQuads)))
+		return false;
+
+	// The far edge of the world belongs to the last tile.
+	int tileX = std::min(int(col) / numQuads, m_params.numTilesX - 1);
+	int tileZ = std::min(int(row) / numQuads, m_params.numTilesZ - 1);
+
+	const float *pHeights = this->GetTileHeights(tileX, tileZ);
+	if (!pHeights)
+		return false;
+
+	float tileCol = col - float(tileX * numQuads);
+	float tileRow = row - float(tileZ * numQuads);
+
+	int col0 = std::min(int(tileCol), numQuads - 1);
+	int row0 = std::min(int(tileRow), numQuads - 1);
+
+	float s = tileCol - float(col0);
+	float t = tileRow - float(row0);
+
+	int numPoints = numQuads + 1;
+	const float *p = &pHeights[row0 * numPoints + col0];
+
+	float top = p[0] + (p[1] - p[0]) * s;
+	float bottom = p[numPoints] + (p[numPoints + 1] - p[numPoints]) * s;
+
+	*pHeight = top + (bottom - top) * t;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainWorld::GetNumLoadedTiles() const
+{
+	return m_numLoadedTiles;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainWorld::GetNumBytes() const
+{
+	return m_numLoadedTiles * this->GetTileNumBytes();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const TerrainWorld::Tile *TerrainWorld::FindTile(int tileX, int tileZ) const
+{
+	if (tileX < 0 || tileX >= m_params.numTilesX || tileZ < 0 || tileZ >= m_params.numTilesZ)
+		return NULL;
+
+	return &m_tiles[size_t(tileZ) * m_params.numTilesX + tileX];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TerrainWorld::Tile *TerrainWorld::FindTile(int tileX, int tileZ)
+{
+	if (tileX < 0 || tileX >= m_params.numTilesX || tileZ < 0 || tileZ >= m_params.numTilesZ)
+		return NULL;
+
+	return &m_tiles[size_t(tileZ) * m_params.numTilesX + tileX];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t TerrainWorld::GetTileNumBytes() const
+{
+	size_t numPoints = size_t(this->GetNumTilePoints());
+
+	// A height and a normal per point.
+	return numPoints * numPoints * 4 * sizeof(float);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float TerrainWorld::GetTileDistance(int tileIndex, float cameraCol, float cameraRow) const
+{
+	int numQuads = m_params.tileQuads;
+
+	float minCol = float(tileIndex % m_params.numTilesX * numQuads);
+	float minRow = float(tileIndex / m_params.numTilesX * numQuads);
+
+	float dx = std::max(std::max(minCol - cameraCol, cameraCol - (minCol + numQuads)), 0.f);
+	float dz = std::max(std::max(minRow - cameraRow, cameraRow - (minRow + numQuads)), 0.f);
+
+	return sqrtf(dx * dx + dz * dz);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainWorld::LoadRawHeights(int tileX, int tileZ)
+{
+	Tile *pTile = this->FindTile(tileX, tileZ);
+	assert(pTile && pTile->state != TILE_STATE_MISSING);
+
+	int numPoints = this->GetNumTilePoints();
+
+	m_rawHeights.resize(size_t(numPoints) * numPoints);
+
+	if (!m_loadFn(tileX, tileZ, numPoints, &m_rawHeights[0]))
+	{
+		pTile->state = TILE_STATE_MISSING;
+
+		for (int i = 0; i < NUM_EDGES; ++i)
+			std::vector<float>().swap(pTile->rawEdges[i]);
+
+		return false;
+	}
+
+	if (pTile->state == TILE_STATE_UNKNOWN)
+	{
+		int last = numPoints - 1;
+
+		for (int i = 0; i < NUM_EDGES; ++i)
+			pTile->rawEdges[i].resize(numPoints);
+
+		for (int i = 0; i < numPoints; ++i)
+		{
+			pTile->rawEdges[EDGE_LEFT][i] = m_rawHeights[i * numPoints];
+			pTile->rawEdges[EDGE_RIGHT][i] = m_rawHeights[i * numPoints + last];
+			pTile->rawEdges[EDGE_TOP][i] = m_rawHeights[i];
+			pTile->rawEdges[EDGE_BOTTOM][i] = m_rawHeights[last * numPoints + i];
+		}
+
+		pTile->state = TILE_STATE_KNOWN;
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainWorld::FindRawEdges(int tileX, int tileZ)
+{
+	Tile *pTile = this->FindTile(tileX, tileZ);
+	if (!pTile || pTile->state == TILE_STATE_MISSING)
+		return false;
+
+	if (pTile->state == TILE_STATE_UNKNOWN)
+	{
+		if (!this->LoadRawHeights(tileX, tileZ))
+			return false;
+
+		if (pTile->wanted)
+			pTile->rawHeights.swap(m_rawHeights);
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The average of the raw heights of the tiles around a corner, always
+// added up in the same order, so every tile gets exactly the same.
+float TerrainWorld::GetStitchedCorner(int cornerX, int cornerZ) const
+{
+	int last = m_params.tileQuads;
+
+	struct CornerTile
+	{
+		int dx, dz;
+		Edge edge;
+		int index;
+	};
+
+	const CornerTile cornerTiles[] = {
+		{-1, -1, EDGE_BOTTOM, last},
+		{0, -1, EDGE_BOTTOM, 0},
+		{-1, 0, EDGE_TOP, last},
+		{0, 0, EDGE_TOP, 0},
+	};
+
+	float sum = 0.f;
+	int count = 0;
+
+	for (size_t i = 0; i < sizeof cornerTiles / sizeof cornerTiles[0]; ++i)
+	{
+		const Tile *pTile = this->FindTile(cornerX + cornerTiles[i].dx, cornerZ + cornerTiles[i].dz);
+
+		if (pTile && (pTile->state == TILE_STATE_KNOWN || pTile->state == TILE_STATE_LOADED))
+		{
+			sum += pTile->rawEdges[cornerTiles[i].edge][cornerTiles[i].index];
+			++count;
+		}
+	}
+
+	assert(count > 0);
+	return sum / float(count);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Shared edges are averaged with the left or top tile first, so both
+// tiles get exactly the same.
+void TerrainWorld::GetStitchedEdge(int tileX, int tileZ, Edge edge, std::vector<float> *pEdge) const
+{
+	const Tile *pTile = this->FindTile(tileX, tileZ);
+	int last = m_params.tileQuads;
+
+	const Tile *pFirst = NULL, *pSecond = NULL;
+	Edge firstEdge = edge, secondEdge = edge;
+	int corner0X = tileX, corner0Z = tileZ, corner1X = tileX, corner1Z = tileZ;
+
+	switch (edge)
+	{
+	case EDGE_LEFT:
+		pFirst = this->FindTile(tileX - 1, tileZ);
+		pSecond = pTile;
+		firstEdge = EDGE_RIGHT;
+		secondEdge = EDGE_LEFT;
+		corner1Z = tileZ + 1;
+		break;
+
+	case EDGE_RIGHT:
+		pFirst = pTile;
+		pSecond = this->FindTile(tileX + 1, tileZ);
+		firstEdge = EDGE_RIGHT;
+		secondEdge = EDGE_LEFT;
+		corner0X = corner1X = tileX + 1;
+		corner1Z = tileZ + 1;
+		break;
+
+	case EDGE_TOP:
+		pFirst = this->FindTile(tileX, tileZ - 1);
+		pSecond = pTile;
+		firstEdge = EDGE_BOTTOM;
+		secondEdge = EDGE_TOP;
+		corner1X = tileX + 1;
+		break;
+
+	default:
+		assert(edge == EDGE_BOTTOM);
+		pFirst = pTile;
+		pSecond = this->FindTile(tileX, tileZ + 1);
+		firstEdge = EDGE_BOTTOM;
+		secondEdge = EDGE_TOP;
+		corner0Z = corner1Z = tileZ + 1;
+		corner1X = tileX + 1;
+		break;
+	}
+
+	pEdge->assign(pTile->rawEdges[edge].begin(), pTile->rawEdges[edge].end());
+
+	bool haveFirst = pFirst && (pFirst->state == TILE_STATE_KNOWN || pFirst->state == TILE_STATE_LOADED);
+	bool haveSecond = pSecond && (pSecond->state == TILE_STATE_KNOWN || pSecond->state == TILE_STATE_LOADED);
+
+	if (haveFirst && haveSecond)
+	{
+		for (int i = 1; i < last; ++i)
+			(*pEdge)[i] = (pFirst->rawEdges[firstEdge][i] + pSecond->rawEdges[secondEdge][i]) * .5f;
+	}
+
+	(*pEdge)[0] = this->GetStitchedCorner(corner0X, corner0Z);
+	(*pEdge)[last] = this->GetStitchedCorner(corner1X, corner1Z);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Moves the edges to their stitched heights, and the points within
+// stitchMargin of them part of the way, fading out linearly. The
+// corrections along the 4 edges are blended as a Coons patch, so the
+// corners aren't corrected twice.
+void TerrainWorld::Stitch(int tileX, int tileZ, float *pHeights) const
+{
+	int last = m_params.tileQuads;
+	int numPoints = last + 1;
+
+	std::vector<float> edges[NUM_EDGES];
+	for (int i = 0; i < NUM_EDGES; ++i)
+		this->GetStitchedEdge(tileX, tileZ, Edge(i), &edges[i]);
+
+	std::vector<float> deltas[NUM_EDGES];
+
+	for (int i = 0; i < NUM_EDGES; ++i)
+		deltas[i].resize(numPoints);
+
+	for (int i = 0; i < numPoints; ++i)
+	{
+		deltas[EDGE_LEFT][i] = edges[EDGE_LEFT][i] - pHeights[i * numPoints];
+		deltas[EDGE_RIGHT][i] = edges[EDGE_RIGHT][i] - pHeights[i * numPoints + last];
+		deltas[EDGE_TOP][i] = edges[EDGE_TOP][i] - pHeights[i];
+		deltas[EDGE_BOTTOM][i] = edges[EDGE_BOTTOM][i] - pHeights[last * numPoints + i];
+	}
+
+	float topLeft = deltas[EDGE_LEFT][0];
+	float topRight = deltas[EDGE_RIGHT][0];
+	float bottomLeft = deltas[EDGE_LEFT][last];
+	float bottomRight = deltas[EDGE_RIGHT][last];
+
+	std::vector<float> weights(numPoints);
+	float margin = float(m_params.stitchMargin);
+
+	for (int i = 0; i < numPoints; ++i)
+		weights[i] = std::max(1.f - float(i) / margin, 0.f);
+
+	for (int row = 1; row < last; ++row)
+	{
+		float top = weights[row];
+		float bottom = weights[last - row];
+
+		for (int col = 1; col < last; ++col)
+		{
+			float left = weights[col];
+			float right = weights[last - col];
+
+			if (left == 0.f && right == 0.f && top == 0.f && bottom == 0.f)
+				continue;
+
+			float delta = left * deltas[EDGE_LEFT][row] + right * deltas[EDGE_RIGHT][row] + top * deltas[EDGE_TOP][col] + bottom * deltas[EDGE_BOTTOM][col];
+			delta -= left * top * topLeft + right * top * topRight + left * bottom * bottomLeft + right * bottom * bottomRight;
+
+			pHeights[row * numPoints + col] += delta;
+		}
+	}
+
+	// The edges exactly, so they match the neighbours' bit for bit.
+	for (int i = 0; i < numPoints; ++i)
+	{
+		pHeights[i * numPoints] = edges[EDGE_LEFT][i];
+		pHeights[i * numPoints + last] = edges[EDGE_RIGHT][i];
+		pHeights[i] = edges[EDGE_TOP][i];
+		pHeights[last * numPoints + i] = edges[EDGE_BOTTOM][i];
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TerrainWorld::LoadTile(int tileIndex)
+{
+	int tileX = tileIndex % m_params.numTilesX;
+	int tileZ = tileIndex / m_params.numTilesX;
+
+	// The neighbours' edges first, as getting them might mean loading
+	// the neighbours' raw heights.
+	for (int dz = -1; dz <= 1; ++dz)
+	{
+		for (int dx = -1; dx <= 1; ++dx)
+		{
+			if (dx != 0 || dz != 0)
+				this->FindRawEdges(tileX + dx, tileZ + dz);
+		}
+	}
+
+	Tile *pTile = &m_tiles[tileIndex];
+
+	if (!pTile->rawHeights.empty())
+		m_rawHeights.swap(pTile->rawHeights);
+	else if (!this->LoadRawHeights(tileX, tileZ))
+		return false;
+
+	pTile->heights.swap(m_rawHeights);
+	this->Stitch(tileX, tileZ, &pTile->heights[0]);
+
+	pTile->state = TILE_STATE_LOADED;
+	++m_numLoadedTiles;
+
+	int last = m_params.tileQuads;
+
+	pTile->normals.resize(pTile->heights.size() * 3);
+	this->CalculateNormals(tileX, tileZ, 0, 0, last, last);
+
+	this->UpdateNeighbourNormals(tileX, tileZ);
+
+	m_justLoadedTiles.push_back(tileIndex);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TerrainWorld::UnloadTile(int tileIndex)
+{
+	Tile *pTile = &m_tiles[tileIndex];
+	assert(pTile->state == TILE_STATE_LOADED);
+
+	std::vector<float>().swap(pTile->heights);
+	std::vector<float>().swap(pTile->normals);
+
+	pTile->state = TILE_STATE_KNOWN;
+	--m_numLoadedTiles;
+
+	this->UpdateNeighbourNormals(tileIndex % m_params.numTilesX, tileIndex / m_params.numTilesX);
+
+	m_justUnloadedTiles.push_back(tileIndex);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The same as TerrainGrid's normals, from the same triangles, but
+// with the quads that belong to other tiles included if they're
+// loaded.
+void TerrainWorld::CalculateNormals(int tileX, int tileZ, int minCol, int minRow, int maxCol, int maxRow)
+{
+	int numQuads = m_params.tileQuads;
+	int numPoints = numQuads + 1;
+	int worldQuadsWide = m_params.numTilesX * numQuads;
+	int worldQuadsLong = m_params.numTilesZ * numQuads;
+	float gridSize = m_params.gridSize;
+
+	size_t numTilePoints = size_t(numPoints) * numPoints;
+	float *pNormalsX = &this->FindTile(tileX, tileZ)->normals[0];
+	float *pNormalsY = pNormalsX + numTilePoints;
+	float *pNormalsZ = pNormalsY + numTilePoints;
+
+	for (int row = minRow; row <= maxRow; ++row)
+	{
+		for (int col = minCol; col <= maxCol; ++col)
+		{
+			int worldCol = tileX * numQuads + col;
+			int worldRow = tileZ * numQuads + row;
+
+			float sum[3] = {0.f, 0.f, 0.f};
+
+			for (int quadRow = std::max(worldRow - 1, 0); quadRow <= std::min(worldRow, worldQuadsLong - 1); ++quadRow)
+			{
+				for (int quadCol = std::max(worldCol - 1, 0); quadCol <= std::min(worldCol, worldQuadsWide - 1); ++quadCol)
+				{
+					int quadTileX = quadCol / numQuads;
+					int quadTileZ = quadRow / numQuads;
+
+					const Tile *pQuadTile = this->FindTile(quadTileX, quadTileZ);
+					if (pQuadTile->state != TILE_STATE_LOADED)
+						continue;
+
+					const float *pA = &pQuadTile->heights[(quadRow - quadTileZ * numQuads) * numPoints + quadCol - quadTileX * numQuads];
+
+					// Rows go towards -z.
+					float ab[3] = {gridSize, pA[1] - pA[0], 0.f};
+					float ad[3] = {gridSize, pA[numPoints + 1] - pA[0], -gridSize};
+					float ac[3] = {0.f, pA[numPoints] - pA[0], -gridSize};
+
+					bool isLeft = quadCol == worldCol;
+					bool isTop = quadRow == worldRow;
+
+					float cross[3];
+
+					// Corner b is only in the first triangle, c only in the second.
+					if (!isLeft || isTop)
+					{
+						Cross(ab, ad, cross);
+
+						for (int i = 0; i < 3; ++i)
+							sum[i] += cross[i];
+					}
+
+					if (isLeft || !isTop)
+					{
+						Cross(ad, ac, cross);
+
+						for (int i = 0; i < 3; ++i)
+							sum[i] += cross[i];
+					}
+				}
+			}
+
+			float length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+			int point = row * numPoints + col;
+
+			pNormalsX[point] = length > 0.f ? sum[0] / length : 0.f;
+			pNormalsY[point] = length > 0.f ? sum[1] / length : 1.f;
+			pNormalsZ[point] = length > 0.f ? sum[2] / length : 0.f;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The points of the loaded tiles around (tileX, tileZ) that touch it.
+void TerrainWorld::UpdateNeighbourNormals(int tileX, int tileZ)
+{
+	int last = m_params.tileQuads;
+
+	for (int dz = -1; dz <= 1; ++dz)
+	{
+		for (int dx = -1; dx <= 1; ++dx)
+		{
+			if (dx == 0 && dz == 0)
+				continue;
+
+			if (!this->IsTileLoaded(tileX + dx, tileZ + dz))
+				continue;
+
+			ChangedTile changed;
+
+			changed.tileX = tileX + dx;
+			changed.tileZ = tileZ + dz;
+			changed.minCol = dx < 0 ? last : 0;
+			changed.maxCol = dx > 0 ? 0 : last;
+			changed.minRow = dz < 0 ? last : 0;
+			changed.maxRow = dz > 0 ? 0 : last;
+
+			this->CalculateNormals(changed.tileX, changed.tileZ, changed.minCol, changed.minRow, changed.maxCol, changed.maxRow);
+
+			m_changedTiles.push_back(changed);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,234 @@
+#ifndef HEADER_A5E09EFB3C93433C808F78CFD0604F40
+#define HEADER_A5E09EFB3C93433C808F78CFD0604F40
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// A world made of many height map tiles on a grid, streamed in and
+// out around the camera.
+//
+// Each tile is tileQuads quads on a side, and neighbouring tiles share
+// their edge points. The heights come from a callback, which can get
+// them from anywhere (files, noise, ...) and needn't make them match
+// up. So each tile is stitched to its neighbours as it's loaded: the
+// points on a shared edge become the average of the two tiles' raw
+// heights there (and a shared corner the average of up to 4), and the
+// difference is blended away over stitchMargin points into each tile.
+//
+// A tile's stitched heights only depend on its own raw heights and
+// its neighbours' raw edges, so they're the same whatever order tiles
+// come and go in. The raw edges of every tile ever loaded are kept,
+// which is a few KB per tile; loading a tile whose neighbour has never
+// been loaded means loading that neighbour too, just for its edges.
+// If the neighbour's due to be loaded in the same Update anyway, its
+// raw heights are kept until then, rather than loaded twice.
+//
+// Normals are worked out per point from the quads around it, the same
+// way as TerrainGrid does, but using the quads of whichever
+// neighbouring tiles are loaded as well, so the normals on both sides
+// of a seam are identical. When a tile comes or goes, the edges of
+// the loaded tiles next to it get new normals, and are listed as
+// changed.
+//
+// Update streams tiles in, nearest first, within loadRadius of the
+// camera, and out again beyond unloadRadius. When a new tile would go
+// over maxNumBytes, the furthest loaded tile makes room if it's
+// further away than the new one; otherwise loading stops until the
+// camera moves.
+//
+// Grid point (col, row) of the world is point (col - tileX *
+// tileQuads, row - tileZ * tileQuads) of tile (tileX, tileZ). Position
+// x goes up with col, and z goes down with row, as in
+// HeightMapApplication's grid.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include <functional>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Fills in numPoints*numPoints raw heights for a tile, row by row.
+// Returns false if there's no tile there after all, which leaves a
+// hole in the world.
+typedef std::function<bool(int tileX, int tileZ, int numPoints, float *pHeights)> TerrainWorldLoadFn;
+
+struct TerrainWorldParams
+{
+	int numTilesX;
+	int numTilesZ;
+	int tileQuads;
+
+	// Distance between grid points, for the normals.
+	float gridSize;
+
+	// How far into each tile the stitching reaches, in grid points. At
+	// most tileQuads / 2.
+	int stitchMargin;
+
+	// In grid points, from the camera to the nearest point of a tile.
+	float loadRadius;
+	float unloadRadius;
+
+	// For the loaded tiles' heights and normals.
+	size_t maxNumBytes;
+
+	// Loading tiles is slow, so only this many are loaded per Update.
+	int maxLoadsPerUpdate;
+
+	TerrainWorldParams();
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainWorld
+{
+public:
+	TerrainWorld();
+	~TerrainWorld();
+
+	bool Create(const TerrainWorldParams &params, const TerrainWorldLoadFn &loadFn);
+	void Destroy();
+
+	const TerrainWorldParams &GetParams() const;
+
+	// Points per tile side, tileQuads + 1.
+	int GetNumTilePoints() const;
+
+	// Loads and unloads tiles for a camera at the given world grid
+	// position. The tiles loaded, unloaded and changed are listed until
+	// the next Update.
+	void Update(float cameraCol, float cameraRow);
+
+	size_t GetNumJustLoadedTiles() const;
+	void GetJustLoadedTile(size_t i, int *pTileX, int *pTileZ) const;
+
+	size_t GetNumJustUnloadedTiles() const;
+	void GetJustUnloadedTile(size_t i, int *pTileX, int *pTileZ) const;
+
+	// Tiles that were already loaded, and stay loaded, with new normals
+	// for the points from (*pMinCol, *pMinRow) to (*pMaxCol, *pMaxRow)
+	// inclusive, in the tile's own grid.
+	size_t GetNumChangedTiles() const;
+	void GetChangedTile(size_t i, int *pTileX, int *pTileZ, int *pMinCol, int *pMinRow, int *pMaxCol, int *pMaxRow) const;
+
+	bool IsTileLoaded(int tileX, int tileZ) const;
+
+	// Whether the tile's been loaded before, or found to be missing.
+	// Loading a tile next to one that isn't known means loading that
+	// one too, for its edges.
+	bool IsTileKnown(int tileX, int tileZ) const;
+	bool IsTileMissing(int tileX, int tileZ) const;
+
+	// GetNumTilePoints squared heights, row by row, or the normals as 3
+	// arrays like that, of all the x's, then the y's, then the z's.
+	// NULL if the tile isn't loaded.
+	const float *GetTileHeights(int tileX, int tileZ) const;
+	const float *GetTileNormals(int tileX, int tileZ) const;
+
+	// Bilinear height at a world grid position. Returns false if the
+	// tile there isn't loaded.
+	bool GetHeight(float col, float row, float *pHeight) const;
+
+	size_t GetNumLoadedTiles() const;
+	size_t GetNumBytes() const;
+protected:
+private:
+	enum TileState
+	{
+		TILE_STATE_UNKNOWN,
+
+		// Its raw edges are known.
+		TILE_STATE_KNOWN,
+
+		TILE_STATE_LOADED,
+
+		// There's no tile there.
+		TILE_STATE_MISSING,
+	};
+
+	enum Edge
+	{
+		EDGE_LEFT,
+		EDGE_RIGHT,
+		EDGE_TOP,
+		EDGE_BOTTOM,
+		NUM_EDGES,
+	};
+
+	struct Tile
+	{
+		TileState state;
+
+		// Raw heights along each edge, corners included.
+		std::vector<float> rawEdges[NUM_EDGES];
+
+		// When loaded.
+		std::vector<float> heights;
+		std::vector<float> normals;
+
+		// Within loadRadius, during Update.
+		bool wanted;
+
+		// Raw heights read for a neighbour's edges during Update, kept
+		// if the tile's wanted too, so they needn't be read again.
+		std::vector<float> rawHeights;
+	};
+
+	struct ChangedTile
+	{
+		int tileX;
+		int tileZ;
+		int minCol;
+		int minRow;
+		int maxCol;
+		int maxRow;
+	};
+
+	TerrainWorldParams m_params;
+	TerrainWorldLoadFn m_loadFn;
+
+	std::vector<Tile> m_tiles;
+	size_t m_numLoadedTiles;
+
+	std::vector<int> m_justLoadedTiles;
+	std::vector<int> m_justUnloadedTiles;
+	std::vector<ChangedTile> m_changedTiles;
+
+	std::vector<float> m_rawHeights;
+
+	const Tile *FindTile(int tileX, int tileZ) const;
+	Tile *FindTile(int tileX, int tileZ);
+	size_t GetTileNumBytes() const;
+	float GetTileDistance(int tileIndex, float cameraCol, float cameraRow) const;
+
+	// Loads the tile's raw heights into m_rawHeights, and keeps its
+	// edges. Returns false if it's missing.
+	bool LoadRawHeights(int tileX, int tileZ);
+	bool FindRawEdges(int tileX, int tileZ);
+
+	float GetStitchedCorner(int cornerX, int cornerZ) const;
+	void GetStitchedEdge(int tileX, int tileZ, Edge edge, std::vector<float> *pEdge) const;
+	void Stitch(int tileX, int tileZ, float *pHeights) const;
+
+	bool LoadTile(int tileIndex);
+	void UnloadTile(int tileIndex);
+
+	void CalculateNormals(int tileX, int tileZ, int minCol, int minRow, int maxCol, int maxRow);
+	void UpdateNeighbourNormals(int tileX, int tileZ);
+
+	TerrainWorld(const TerrainWorld &);
+	TerrainWorld &operator=(const TerrainWorld &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_A5E09EFB3C93433C808F78CFD0604F40
@@ -139,8 +139,23 @@ void App::StopD3D()
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
+static const size_t SCRATCH_ARENA_BLOCK_SIZE = 1024 * 1024;
+static const size_t FRAME_ARENA_BLOCK_SIZE = 1024 * 1024;
+
 bool App::Start()
 {
+	// HandleStart hasn't been called yet, so there's nothing for
+	// HandleStop to clean up.
+	if (!m_scratchArena.Create(SCRATCH_ARENA_BLOCK_SIZE) || !m_frameArena.Create(FRAME_ARENA_BLOCK_SIZE))
+	{
+		this->SetStartErrorMessage("Failed to create the scratch and frame arenas.");
+
+		m_scratchArena.Destroy();
+		m_frameArena.Destroy();
+
+		return false;
+	}
+
 	if (!this->HandleStart())
 	{
 		this->Stop();
@@ -159,6 +174,21 @@ void App::Stop()
 	this->ClearStateAndFlushDeviceContext();
 
 	this->HandleStop();
+
+	// How much went through the arenas, compared with how many times
+	// they went to the heap.
+	const LinearArenaStats &scratchStats = m_scratchArena.GetStats();
+	const LinearArenaStats &frameStats = m_frameArena.GetStats();
+
+	dprintf("%s: scratch arena: %u allocations (%u KB), %u blocks (%u KB), at most %u KB in use.\n", __FUNCTION__,
+		unsigned(scratchStats.numAllocations), unsigned(scratchStats.numBytesAllocated / 1024), unsigned(scratchStats.numBlocksAllocated),
+		unsigned(scratchStats.numBlockBytesAllocated / 1024), unsigned(scratchStats.maxNumBytesUsed / 1024));
+	dprintf("%s: frame arena: %u allocations (%u KB), %u blocks (%u KB), at most %u KB in use.\n", __FUNCTION__,
+		unsigned(frameStats.numAllocations), unsigned(frameStats.numBytesAllocated / 1024), unsigned(frameStats.numBlocksAllocated),
+		unsigned(frameStats.numBlockBytesAllocated / 1024), unsigned(frameStats.maxNumBytesUsed / 1024));
+
+	m_scratchArena.Destroy();
+	m_frameArena.Destroy();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -172,6 +202,22 @@ const char *App::GetStartErrorMessage() const
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
+LinearArena *App::GetScratchArena()
+{
+	return &m_scratchArena;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+LinearArena *App::GetFrameArena()
+{
+	return &m_frameArena;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
 void App::Render()
 {
 	if (!m_canRender)
@@ -192,6 +238,8 @@ void App::Render()
 
 	this->SetDefaultRenderTarget();
 
+	m_frameArena.Reset();
+
 	// Do the actual rendering.
 	this->HandleRender();
 
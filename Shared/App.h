@@ -15,6 +15,8 @@
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 
+#include "LinearArena.h"
+
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
@@ -53,6 +55,14 @@ public:
 
 	//
 	void Render();
+
+	// For temporary buffers while loading and building things. Free
+	// them with ResetToMarker before returning.
+	LinearArena *GetScratchArena();
+
+	// For things only needed until the end of the frame. It's reset
+	// before each HandleRender.
+	LinearArena *GetFrameArena();
 protected:
 	bool CanRender() const;
 
@@ -123,6 +133,9 @@ private:
 
 	bool m_isInFocus;
 
+	LinearArena m_scratchArena;
+	LinearArena m_frameArena;
+
 	void ReleaseRenderTargetsAndViews();
 	void RecreateRenderTargetsAndViews();
 
@@ -0,0 +1,198 @@
+#include "BufferSlotPool.h"
+
+#include <assert.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+BufferSlotPool::BufferSlotPool():
+m_pDevice(NULL),
+m_bindFlags(0),
+m_slotNumBytes(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+BufferSlotPool::~BufferSlotPool()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool BufferSlotPool::Create(ID3D11Device *pDevice, UINT bindFlags, UINT slotNumBytes, int slotsPerPage, int maxNumPages)
+{
+	this->Destroy();
+
+	if (slotNumBytes == 0 || !m_allocator.Create(slotsPerPage, maxNumPages))
+		return false;
+
+	m_pDevice = pDevice;
+	m_bindFlags = bindFlags;
+	m_slotNumBytes = slotNumBytes;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void BufferSlotPool::Destroy()
+{
+	for (size_t i = 0; i < m_pages.size(); ++i)
+		Release(m_pages[i]);
+
+	m_pages.clear();
+	m_allocator.Destroy();
+
+	m_pDevice = NULL;
+	m_bindFlags = 0;
+	m_slotNumBytes = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool BufferSlotPool::Allocate(int *pHandle)
+{
+	int handle;
+	if (!m_allocator.Allocate(&handle))
+		return false;
+
+	while (m_pages.size() < size_t(m_allocator.GetNumPages()))
+	{
+		ID3D11Buffer *pPage = CreateBuffer(m_pDevice, m_slotNumBytes * m_allocator.GetSlotsPerPage(), D3D11_USAGE_DEFAULT, m_bindFlags, 0, NULL);
+		if (!pPage)
+		{
+			m_allocator.Free(handle);
+			return false;
+		}
+
+		m_pages.push_back(pPage);
+	}
+
+	*pHandle = handle;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void BufferSlotPool::Free(int handle)
+{
+	m_allocator.Free(handle);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool BufferSlotPool::Upload(ID3D11DeviceContext *pContext, UploadRing *pUploadRing, int handle, const void *pData, UINT numBytes)
+{
+	if (numBytes > m_slotNumBytes)
+		return false;
+
+	ID3D11Buffer *pBuffer;
+	UINT offset;
+	this->GetSlot(handle, &pBuffer, &offset);
+
+	if (pUploadRing && pUploadRing->CopyToBuffer(pContext, pData, numBytes, pBuffer, offset))
+		return true;
+
+	D3D11_BOX box;
+
+	box.left = offset;
+	box.right = offset + numBytes;
+	box.top = 0;
+	box.bottom = 1;
+	box.front = 0;
+	box.back = 1;
+
+	pContext->UpdateSubresource(pBuffer, 0, &box, pData, numBytes, 0);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void BufferSlotPool::GetSlot(int handle, ID3D11Buffer **ppBuffer, UINT *pOffset) const
+{
+	int slot = m_allocator.GetSlot(handle);
+	int slotsPerPage = m_allocator.GetSlotsPerPage();
+
+	*ppBuffer = m_pages[slot / slotsPerPage];
+	*pOffset = UINT(slot % slotsPerPage) * m_slotNumBytes;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t BufferSlotPool::Defragment(ID3D11DeviceContext *pContext, size_t maxNumMoves)
+{
+	m_moves.clear();
+	m_allocator.Defragment(maxNumMoves, &m_moves);
+
+	int slotsPerPage = m_allocator.GetSlotsPerPage();
+
+	// Moves are always from one page to another, and a buffer can't be
+	// copied within itself.
+	for (size_t i = 0; i < m_moves.size(); ++i)
+	{
+		const SlotAllocatorMove *pMove = &m_moves[i];
+
+		D3D11_BOX box;
+
+		box.left = UINT(pMove->fromSlot % slotsPerPage) * m_slotNumBytes;
+		box.right = box.left + m_slotNumBytes;
+		box.top = 0;
+		box.bottom = 1;
+		box.front = 0;
+		box.back = 1;
+
+		pContext->CopySubresourceRegion(m_pages[pMove->toSlot / slotsPerPage], 0, UINT(pMove->toSlot % slotsPerPage) * m_slotNumBytes, 0, 0,
+			m_pages[pMove->fromSlot / slotsPerPage], 0, &box);
+	}
+
+	this->ReleaseEmptyPages();
+
+	return m_moves.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+UINT BufferSlotPool::GetSlotNumBytes() const
+{
+	return m_slotNumBytes;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const SlotAllocator &BufferSlotPool::GetAllocator() const
+{
+	return m_allocator;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The GPU may still be drawing from them, but D3D keeps them alive
+// until it's done.
+void BufferSlotPool::ReleaseEmptyPages()
+{
+	m_allocator.TrimEmptyPages();
+
+	while (m_pages.size() > size_t(m_allocator.GetNumPages()))
+	{
+		Release(m_pages.back());
+		m_pages.pop_back();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,83 @@
+#ifndef HEADER_DE0BCFCD72214B8AB285E02EE39946AC
+#define HEADER_DE0BCFCD72214B8AB285E02EE39946AC
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// A few big D3D11_USAGE_DEFAULT buffers, sliced into fixed size slots
+// with a SlotAllocator, for things that come and go too often to each
+// have a buffer of their own, like streamed terrain chunks.
+//
+// Each page of slots is a buffer, made when the first slot in it is
+// needed, and released when Defragment has emptied it. Defragment
+// copies the moved slots across on the GPU, and handles stay the same,
+// so all the users have to do is look their slot up again (with
+// GetSlot) when drawing.
+//
+// Draw from a slot with its buffer, and its offset: for vertices, the
+// offset divided by the stride is the base vertex, and for indices,
+// the offset divided by the index size is the first index.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include "D3DHelpers.h"
+#include "SlotAllocator.h"
+#include "UploadRing.h"
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class BufferSlotPool
+{
+public:
+	BufferSlotPool();
+	~BufferSlotPool();
+
+	// The device is kept for making pages, so must outlive the pool.
+	bool Create(ID3D11Device *pDevice, UINT bindFlags, UINT slotNumBytes, int slotsPerPage, int maxNumPages);
+	void Destroy();
+
+	bool Allocate(int *pHandle);
+	void Free(int handle);
+
+	// Copies numBytes (at most a slot's worth) to the start of the slot,
+	// through pUploadRing if it's not NULL, and has room.
+	bool Upload(ID3D11DeviceContext *pContext, UploadRing *pUploadRing, int handle, const void *pData, UINT numBytes);
+
+	void GetSlot(int handle, ID3D11Buffer **ppBuffer, UINT *pOffset) const;
+
+	// Moves up to maxNumMoves slots, to empty the last pages, and
+	// releases the pages that end up empty. Returns the number moved.
+	size_t Defragment(ID3D11DeviceContext *pContext, size_t maxNumMoves);
+
+	UINT GetSlotNumBytes() const;
+
+	// For GetOccupancy, GetFragmentation, and so on.
+	const SlotAllocator &GetAllocator() const;
+protected:
+private:
+	ID3D11Device *m_pDevice;
+	UINT m_bindFlags;
+	UINT m_slotNumBytes;
+
+	SlotAllocator m_allocator;
+
+	// One per page.
+	std::vector<ID3D11Buffer *> m_pages;
+
+	// Scratch space for Defragment.
+	std::vector<SlotAllocatorMove> m_moves;
+
+	void ReleaseEmptyPages();
+
+	BufferSlotPool(const BufferSlotPool &);
+	BufferSlotPool &operator=(const BufferSlotPool &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_DE0BCFCD72214B8AB285E02EE39946AC
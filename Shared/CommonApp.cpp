@@ -12,6 +12,9 @@
 #include <DirectXMath.h>
 using namespace DirectX;
 
+// Relative to the working folder.
+static const char SHADER_CACHE_DIRECTORY[] = "ShaderCache";
+
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 //
@@ -351,54 +354,60 @@ CommonApp::~CommonApp()
 
 bool CommonApp::HandleStart()
 {
+	// If the cache folder can't be made, everything is compiled every
+	// time, as before.
+	if (m_shaderCache.SetDirectory(SHADER_CACHE_DIRECTORY))
+		SetShaderCache(&m_shaderCache);
+
 	char maxNumLightsValue[100];
 	_snprintf_s(maxNumLightsValue, sizeof maxNumLightsValue, _TRUNCATE, "%d", MAX_NUM_LIGHTS);
 
 	// Tex NO, Lit NO
-	{
-		const D3D_SHADER_MACRO aMacros[] = {
-			{NULL},
-		};
-
-		if (!this->CompileShaderFromString(&m_shaderUntextured, g_aShader, aMacros, g_aVertexDesc_Pos3fColour4ub, g_vertexDescSize_Pos3fColour4ub))
-			return false;
-	}
+	const D3D_SHADER_MACRO aUntexturedMacros[] = {
+		{NULL},
+	};
 
 	// Tex NO, Lit YES
-	{
-		const D3D_SHADER_MACRO aMacros[] = {
-			{"MAX_NUM_LIGHTS", maxNumLightsValue},
-			{"LIT",NULL},
-			{NULL},
-		};
-
-		if (!this->CompileShaderFromString(&m_shaderUntexturedLit, g_aShader, aMacros, g_aVertexDesc_Pos3fColour4ubNormal3f, g_vertexDescSize_Pos3fColour4ubNormal3f))
-			return false;
-	}
+	const D3D_SHADER_MACRO aUntexturedLitMacros[] = {
+		{"MAX_NUM_LIGHTS", maxNumLightsValue},
+		{"LIT",NULL},
+		{NULL},
+	};
 
 	// Tex YES, Lit NO
-	{
-		const D3D_SHADER_MACRO aMacros[] = {
-			{"TEXTURED",NULL},
-			{NULL},
-		};
-
-		if (!this->CompileShaderFromString(&m_shaderTextured, g_aShader, aMacros, g_aVertexDesc_Pos3fColour4ubTex2f, g_vertexDescSize_Pos3fColour4ubTex2f))
-			return false;
-	}
+	const D3D_SHADER_MACRO aTexturedMacros[] = {
+		{"TEXTURED",NULL},
+		{NULL},
+	};
 
 	// Tex YES, Lit YES
-	{
-		const D3D_SHADER_MACRO aMacros[] = {
-			{"MAX_NUM_LIGHTS", maxNumLightsValue},
-			{"LIT",NULL},
-			{"TEXTURED",NULL},
-			{NULL},
-		};
+	const D3D_SHADER_MACRO aTexturedLitMacros[] = {
+		{"MAX_NUM_LIGHTS", maxNumLightsValue},
+		{"LIT",NULL},
+		{"TEXTURED",NULL},
+		{NULL},
+	};
 
-		if (!this->CompileShaderFromString(&m_shaderTexturedLit, g_aShader, aMacros, g_aVertexDesc_Pos3fColour4ubNormal3fTex2f, g_vertexDescSize_Pos3fColour4ubNormal3fTex2f))
-			return false;
-	}
+	const ShaderVariantDesc aVariants[] = {
+		{NULL, g_aShader, aUntexturedMacros, "VSMain", "PSMain", g_aVertexDesc_Pos3fColour4ub, g_vertexDescSize_Pos3fColour4ub},
+		{NULL, g_aShader, aUntexturedLitMacros, "VSMain", "PSMain", g_aVertexDesc_Pos3fColour4ubNormal3f, g_vertexDescSize_Pos3fColour4ubNormal3f},
+		{NULL, g_aShader, aTexturedMacros, "VSMain", "PSMain", g_aVertexDesc_Pos3fColour4ubTex2f, g_vertexDescSize_Pos3fColour4ubTex2f},
+		{NULL, g_aShader, aTexturedLitMacros, "VSMain", "PSMain", g_aVertexDesc_Pos3fColour4ubNormal3fTex2f, g_vertexDescSize_Pos3fColour4ubNormal3fTex2f},
+	};
+
+	Shader *const apShaders[] = {
+		&m_shaderUntextured,
+		&m_shaderUntexturedLit,
+		&m_shaderTextured,
+		&m_shaderTexturedLit,
+	};
+
+	static_assert(sizeof aVariants / sizeof aVariants[0] == sizeof apShaders / sizeof apShaders[0], "one Shader per variant");
+
+	if (!this->CompileShaderVariants(apShaders, aVariants, sizeof aVariants / sizeof aVariants[0]))
+		return false;
+
+	dprintf("Shader cache: %u hits, %u misses.\n", m_shaderCache.GetNumHits(), m_shaderCache.GetNumMisses());
 
 	// Blend state
 	for (int i = 0; i < NUM_BLEND_STATES; ++i)
@@ -524,6 +533,9 @@ void CommonApp::HandleStop()
 	m_shaderUntexturedLit.Reset();
 	m_shaderTextured.Reset();
 	m_shaderTexturedLit.Reset();
+
+	SetShaderCache(NULL);
+	m_shaderCache.Flush();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -644,6 +656,14 @@ void CommonApp::DrawTexturedLit(D3D11_PRIMITIVE_TOPOLOGY topology, ID3D11Buffer
 //////////////////////////////////////////////////////////////////////
 
 void CommonApp::DrawWithShader(D3D11_PRIMITIVE_TOPOLOGY topology, ID3D11Buffer *pVertexBuffer, size_t vertexStride, ID3D11Buffer *pIndexBuffer, unsigned firstItem, unsigned numItems, ID3D11ShaderResourceView *pTextureView, ID3D11SamplerState *pTextureSampler, Shader *pShader)
+{
+	this->DrawWithShader(topology, pVertexBuffer, vertexStride, pIndexBuffer, firstItem, numItems, pTextureView, pTextureSampler, pShader, 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void CommonApp::DrawWithShader(D3D11_PRIMITIVE_TOPOLOGY topology, ID3D11Buffer *pVertexBuffer, size_t vertexStride, ID3D11Buffer *pIndexBuffer, unsigned firstItem, unsigned numItems, ID3D11ShaderResourceView *pTextureView, ID3D11SamplerState *pTextureSampler, Shader *pShader, int baseVertex)
 {
 	if (pShader->pVSCBuffer || pShader->pPSCBuffer)
 	{
@@ -827,10 +847,10 @@ void CommonApp::DrawWithShader(D3D11_PRIMITIVE_TOPOLOGY topology, ID3D11Buffer *
 	{
 		m_pD3DDeviceContext->IASetIndexBuffer(pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
 
-		m_pD3DDeviceContext->DrawIndexed(numItems, firstItem, 0);
+		m_pD3DDeviceContext->DrawIndexed(numItems, firstItem, baseVertex);
 	}
 	else
-		m_pD3DDeviceContext->Draw(numItems, firstItem);
+		m_pD3DDeviceContext->Draw(numItems, firstItem + baseVertex);
 
 	if (pShader->psTexture >= 0)
 	{
@@ -1130,6 +1150,29 @@ bool CommonApp::CompileShaderFromFile(Shader *pShader, const char *pShaderFileNa
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
+bool CommonApp::CompileShaderVariants(Shader *const *ppShaders, const ShaderVariantDesc *pVariants, size_t numVariants)
+{
+	if (numVariants == 0)
+		return true;
+
+	std::vector<CompiledShaderVariant> results(numVariants);
+
+	if (!::CompileShaderVariants(m_pD3DDevice, pVariants, numVariants, &results[0]))
+		return false;
+
+	for (size_t i = 0; i < numVariants; ++i)
+	{
+		CompiledShaderVariant *pResult = &results[i];
+
+		this->CreateShaderFromCompiledShader(ppShaders[i], pResult->pVS, &pResult->vsDescription, pResult->pIL, pResult->pPS, &pResult->psDescription);
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
 static void FindShaderVars(CommonApp::ShaderVars *pShaderVars, const ShaderDescription *pDescription)
 {
 	pDescription->FindCBuffer("CommonApp", &pShaderVars->cbuffer);
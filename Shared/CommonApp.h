@@ -6,6 +6,7 @@
 
 #include "App.h"
 #include "D3DHelpers.h"
+#include "ShaderCache.h"
 #include <DirectXMath.h>
 using namespace DirectX;
 
@@ -146,6 +147,10 @@ public:
 	void SetViewMatrix(const XMMATRIX &viewMtx);
 	void SetProjectionMatrix(const XMMATRIX &projectionMtx);
 
+	// World * view * projection, as the shaders get it. Its frustum
+	// planes are in the space of whatever's being drawn.
+	XMMATRIX GetWVP() const;
+
 	// Simplified camera setup. FOV is PI/4.
 	void SetDefaultProjectionMatrix(float aspect = 1.f);
 
@@ -216,6 +221,11 @@ public:
 	class Shader;
 	void DrawWithShader(D3D11_PRIMITIVE_TOPOLOGY topology, ID3D11Buffer *pVertexBuffer, size_t vertexStride, ID3D11Buffer *pIndexBuffer, unsigned firstItem, unsigned numItems, ID3D11ShaderResourceView *pTextureView, ID3D11SamplerState *pTextureSampler, Shader *pShader);
 
+	// As above, with baseVertex added to each index, or to firstItem if
+	// there's no index buffer, so that several meshes can share a vertex
+	// buffer (see BufferSlotPool).
+	void DrawWithShader(D3D11_PRIMITIVE_TOPOLOGY topology, ID3D11Buffer *pVertexBuffer, size_t vertexStride, ID3D11Buffer *pIndexBuffer, unsigned firstItem, unsigned numItems, ID3D11ShaderResourceView *pTextureView, ID3D11SamplerState *pTextureSampler, Shader *pShader, int baseVertex);
+
 	// Set constant colour.
 	void SetConstantColour(const XMFLOAT4& constantColour);
 
@@ -327,6 +337,13 @@ public:
 	bool CompileShaderFromString(Shader *pShader, const char *pShaderCode, const D3D_SHADER_MACRO *pMacros, const D3D11_INPUT_ELEMENT_DESC *pInputElementsDescs, unsigned numInputElementsDescs);
 	bool CompileShaderFromFile(Shader *pShader, const char *pShaderFileName, const D3D_SHADER_MACRO *pMacros, const D3D11_INPUT_ELEMENT_DESC *pInputElementsDescs, unsigned numInputElementsDescs);
 
+	// Compile several shaders at once, on worker threads, and fill out
+	// ppShaders[i] from pVariants[i]. Much quicker than one at a time
+	// if there are several to do.
+	//
+	// If any fail, none of the Shaders are changed.
+	bool CompileShaderVariants(Shader *const *ppShaders, const ShaderVariantDesc *pVariants, size_t numVariants);
+
 	// Suitable if you've used CompileShadersFromFile or CompileShadersFromString.
 	//
 	// The Shader takes ownership of the D3D objects, and will Release them itself.
@@ -398,14 +415,14 @@ private:
 	Shader m_shaderTextured;
 	Shader m_shaderTexturedLit;
 
+	ShaderCache m_shaderCache;
+
 	// Current settings
 	XMFLOAT4X4 m_projectionMtx;
 	XMFLOAT4X4 m_viewMtx;
 	XMFLOAT4X4 m_worldMtx;
 	XMFLOAT4 m_constantColour;
 
-	XMMATRIX GetWVP() const;
-
 	Light *GetLight(int light);
 };
 
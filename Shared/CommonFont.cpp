@@ -1,18 +1,24 @@
-#include <d3d11.h>
-#include <dxgi.h>
-
 #define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
 #include <Windows.h>
 
+#include <d3d11.h>
+#include <dxgi.h>
+
 #include "CommonFont.h"
 
 #include "CommonApp.h"
 #include "D3DHelpers.h"
+#include "GlyphPacker.h"
+#include "UTF8.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <math.h>
+
+#include <algorithm>
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
@@ -20,6 +26,14 @@
 static const int NUM_CHARS = 100;
 static const int NUM_VTXS = NUM_CHARS * 4;
 
+static const int MAX_TEXTURE_SIZE = 4096;
+
+static const CommonFont::CharRange DEFAULT_CHAR_RANGE = {32, 126};
+
+static const uint32_t MAX_CODE_POINT = 0x10FFFF;
+static const uint32_t SURROGATE_FIRST = 0xD800;
+static const uint32_t SURROGATE_LAST = 0xDFFF;
+
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
@@ -92,68 +106,180 @@ struct CommonFont::Glyph
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
-bool CommonFont::PaintAlphabet(HDC hDC, int width, int height, Glyph *pGlyphs)
+// Code points above 0xFFFF need a surrogate pair.
+static int EncodeUTF16(uint32_t ch, WCHAR *pDest)
 {
-	SIZE size;
+	if (ch < 0x10000)
+	{
+		pDest[0] = WCHAR(ch);
+		return 1;
+	}
 
-	char ch = 'x';
-	GetTextExtentPoint32(hDC, &ch, 1, &size);
+	ch -= 0x10000;
 
-	int spacing = int(ceilf(size.cy * .3f));
+	pDest[0] = WCHAR(0xD800 + (ch >> 10));
+	pDest[1] = WCHAR(0xDC00 + (ch & 0x3FF));
+	return 2;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 
-	int x = 0;
-	int y = 0;
-	LONG lineMaxHeight = 0;//height of tallest glyph on this line
+size_t CommonFont::GetValidRanges(const CharRange *pRanges, size_t numRanges, CharRange *pValidRanges)
+{
+	size_t numValidRanges = 0;
 
-	for (int ch = 32; ch < 127; ++ch)
+	for (size_t i = 0; i < numRanges; ++i)
 	{
-		char c = (char)ch;
-		if (!GetTextExtentPoint32(hDC, &c, 1, &size))
+		uint32_t first = pRanges[i].first;
+		uint32_t last = std::min(pRanges[i].last, MAX_CODE_POINT);
+
+		// The part below the surrogates, then the part above them.
+		if (first < SURROGATE_FIRST && first <= last)
 		{
-			size.cx = 0;
-			size.cy = 0;
+			pValidRanges[numValidRanges].first = first;
+			pValidRanges[numValidRanges].last = std::min(last, SURROGATE_FIRST - 1);
+			++numValidRanges;
 		}
 
-		if (x + size.cx + spacing > width)
-		{
-			x = 0;
-			y += lineMaxHeight + 1;//tm.tmHeight + 1;
+		first = std::max(first, SURROGATE_LAST + 1);
 
-			lineMaxHeight = 0;
+		if (first <= last)
+		{
+			pValidRanges[numValidRanges].first = first;
+			pValidRanges[numValidRanges].last = last;
+			++numValidRanges;
 		}
+	}
+
+	return numValidRanges;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t CommonFont::CountGlyphs(const CharRange *pRanges, size_t numRanges)
+{
+	size_t numGlyphs = 0;
+
+	for (size_t i = 0; i < numRanges; ++i)
+	{
+		if (pRanges[i].last >= pRanges[i].first)
+			numGlyphs += pRanges[i].last - pRanges[i].first + 1;
+	}
+
+	return numGlyphs;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 
-		if (y + size.cy > height)
-			return false;
+int CommonFont::MeasureGlyphs(HDC hDC, const CharRange *pRanges, size_t numRanges, GlyphAtlasRect *pRects)
+{
+	GlyphAtlasRect *pRect = pRects;
+
+	// How far any glyph's ink sticks out to the left of where it's
+	// drawn, and past its advance to the right.
+	int maxLeftOverhang = 0, maxRightOverhang = 0;
+
+	TEXTMETRICW tm;
+	if (!GetTextMetricsW(hDC, &tm))
+		tm.tmHeight = 0;
 
-		if (size.cy > lineMaxHeight)
-			lineMaxHeight = size.cy;
+	for (size_t rangeIdx = 0; rangeIdx < numRanges; ++rangeIdx)
+	{
+		// Counted, rather than up to last, so it can't wrap.
+		uint32_t numChars = pRanges[rangeIdx].last - pRanges[rangeIdx].first + 1;
 
-		if (pGlyphs)
+		for (uint32_t i = 0; i < numChars; ++i, ++pRect)
 		{
-			ExtTextOut(hDC, x, y, ETO_OPAQUE, NULL, &c, 1, NULL);
+			uint32_t ch = pRanges[rangeIdx].first + i;
 
-			Glyph *pGlyph = &pGlyphs[ch - 32];
+			WCHAR aUTF16[2];
+			int numUTF16 = EncodeUTF16(ch, aUTF16);
 
-			pGlyph->texMini.x = x / float(width);
-			pGlyph->texMini.y = y / float(height);
+			SIZE size;
+			if (!GetTextExtentPoint32W(hDC, aUTF16, numUTF16, &size))
+			{
+				size.cx = 0;
+				size.cy = 0;
+			}
 
-			pGlyph->texMaxi.x = (x + size.cx) / float(width);
-			pGlyph->texMaxi.y = (y + size.cy) / float(height);
+			pRect->x = 0;
+			pRect->y = 0;
+			pRect->width = size.cx;
+			pRect->height = size.cy;
+
+			// A negative A or C width is ink outside the glyph's cell.
+			// Only TrueType fonts have ABC widths, and only for the
+			// BMP, so otherwise allow for a proportion of the height,
+			// as the old fixed-grid layout did.
+			ABC abc;
+			if (ch <= 0xFFFF && GetCharABCWidthsW(hDC, ch, ch, &abc))
+			{
+				maxLeftOverhang = std::max(maxLeftOverhang, -abc.abcA);
+				maxRightOverhang = std::max(maxRightOverhang, -abc.abcC);
+			}
+			else
+			{
+				int overhang = int(ceilf(tm.tmHeight * .15f));
 
-			pGlyph->size.x = float(size.cx);
-			pGlyph->size.y = float(size.cy);
+				maxLeftOverhang = std::max(maxLeftOverhang, overhang);
+				maxRightOverhang = std::max(maxRightOverhang, overhang);
+			}
 		}
-
-		x += size.cx + spacing;
 	}
 
-	return true;
+	// The gap between two glyphs has to take the right overhang of one
+	// and the left overhang of the next.
+	return maxLeftOverhang + maxRightOverhang;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void CommonFont::PaintGlyphs(HDC hDC, const CharRange *pRanges, size_t numRanges, const GlyphAtlasRect *pRects, const GlyphAtlasInfo &atlasInfo, Glyph *pGlyphs)
+{
+	const GlyphAtlasRect *pRect = pRects;
+	Glyph *pGlyph = pGlyphs;
+
+	for (size_t rangeIdx = 0; rangeIdx < numRanges; ++rangeIdx)
+	{
+		uint32_t numChars = pRanges[rangeIdx].last - pRanges[rangeIdx].first + 1;
+
+		for (uint32_t i = 0; i < numChars; ++i, ++pRect, ++pGlyph)
+		{
+			uint32_t ch = pRanges[rangeIdx].first + i;
+
+			WCHAR aUTF16[2];
+			int numUTF16 = EncodeUTF16(ch, aUTF16);
+
+			ExtTextOutW(hDC, pRect->x, pRect->y, ETO_OPAQUE, NULL, aUTF16, numUTF16, NULL);
+
+			pGlyph->texMini.x = pRect->x / float(atlasInfo.width);
+			pGlyph->texMini.y = pRect->y / float(atlasInfo.height);
+
+			pGlyph->texMaxi.x = (pRect->x + pRect->width) / float(atlasInfo.width);
+			pGlyph->texMaxi.y = (pRect->y + pRect->height) / float(atlasInfo.height);
+
+			pGlyph->size.x = float(pRect->width);
+			pGlyph->size.y = float(pRect->height);
+		}
+	}
 }
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
 CommonFont *CommonFont::CreateByName(const char *pFontName, int height, uint32_t createFlags, CommonApp *pApp)
+{
+	return CreateByName(pFontName, height, createFlags, &DEFAULT_CHAR_RANGE, 1, pApp);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+CommonFont *CommonFont::CreateByName(const char *pFontName, int height, uint32_t createFlags, const CharRange *pRanges, size_t numRanges, CommonApp *pApp)
 {
 	HRESULT hr;
 
@@ -169,6 +295,17 @@ CommonFont *CommonFont::CreateByName(const char *pFontName, int height, uint32_t
 
 	Glyph *pGlyphs = NULL;
 
+	// The ranges and glyph rects are only needed while making the font.
+	LinearArena *pScratch = pApp->GetScratchArena();
+	LinearArenaMarker scratchMarker = pScratch->GetMarker();
+
+	// Each range can be split in two by the surrogates.
+	CharRange *pValidRanges = pScratch->AllocateArray<CharRange>(numRanges * 2);
+	size_t numValidRanges = pValidRanges ? GetValidRanges(pRanges, numRanges, pValidRanges) : 0;
+
+	size_t numGlyphs = CountGlyphs(pValidRanges, numValidRanges);
+	GlyphAtlasRect *pGlyphRects = NULL;
+
 	ID3D11Texture2D *pTexture = NULL;
 	ID3D11ShaderResourceView *pTextureView = NULL;
 
@@ -183,17 +320,24 @@ CommonFont *CommonFont::CreateByName(const char *pFontName, int height, uint32_t
 
 		SelectObject(hDC, hFont);
 
-		// Decide on reasonable size for texture.
-		int texWidth = 128, texHeight = 128;
+		if (numGlyphs == 0)
+			goto done;
 
-		while (!PaintAlphabet(hDC, texWidth, texHeight, NULL))
-		{
-			texWidth *= 2;
-			texHeight *= 2;
+		// Measure every glyph, then size the texture to fit them.
+		pGlyphRects = pScratch->AllocateArray<GlyphAtlasRect>(numGlyphs);
+		if (!pGlyphRects)
+			goto done;
 
-			if (texWidth == 4096 || texHeight == 4096)
-				goto done;//font too large.
-		}
+		int overhang = MeasureGlyphs(hDC, pValidRanges, numValidRanges, pGlyphRects);
+
+		// The padding keeps overhanging glyphs from painting over their
+		// neighbours, and bilinear filtering from picking up the
+		// neighbouring glyphs.
+		GlyphAtlasInfo atlasInfo;
+		if (!PackGlyphAtlas(pGlyphRects, numGlyphs, overhang + 2, MAX_TEXTURE_SIZE, &atlasInfo))
+			goto done;//font too large.
+
+		int texWidth = atlasInfo.width, texHeight = atlasInfo.height;
 
 		// Create GDI bitmap for texture.
 		BITMAPINFO bmi;
@@ -212,9 +356,9 @@ CommonFont *CommonFont::CreateByName(const char *pFontName, int height, uint32_t
 		if (!hBitmap)
 			goto done;
 
-		// Paint font into GDI bitmap and this time store off the texture
+		// Paint font into GDI bitmap and store off the texture
 		// coordinates for each glyph.
-		pGlyphs = new Glyph[96];
+		pGlyphs = new Glyph[numGlyphs];
 
 		SelectObject(hDC, hBitmap);
 
@@ -222,7 +366,7 @@ CommonFont *CommonFont::CreateByName(const char *pFontName, int height, uint32_t
 		SetBkColor(hDC, RGB(0, 0, 0));
 		SetTextAlign(hDC, TA_TOP);
 
-		PaintAlphabet(hDC, texWidth, texHeight, pGlyphs);
+		PaintGlyphs(hDC, pValidRanges, numValidRanges, pGlyphRects, atlasInfo, pGlyphs);
 
 		// Fix up bitmap data - the font shape should be in the alpha channel,
 		// and the RGB channels should be all white.
@@ -304,6 +448,10 @@ CommonFont *CommonFont::CreateByName(const char *pFontName, int height, uint32_t
 	pFont->m_pGlyphs = pGlyphs;
 	pGlyphs = NULL;
 
+	pFont->m_pRanges = new CharRange[numValidRanges];
+	memcpy(pFont->m_pRanges, pValidRanges, numValidRanges * sizeof *pValidRanges);
+	pFont->m_numRanges = numValidRanges;
+
 	pFont->m_pTexture = pTexture;
 	pTexture = NULL;
 
@@ -345,6 +493,10 @@ done:
 	delete[] pGlyphs;
 	pGlyphs = NULL;
 
+	pGlyphRects = NULL;
+	pValidRanges = NULL;
+	pScratch->ResetToMarker(scratchMarker);
+
 	return pFont;
 }
 
@@ -354,6 +506,8 @@ done:
 CommonFont::CommonFont():
 m_pApp(NULL),
 m_pGlyphs(NULL),
+m_pRanges(NULL),
+m_numRanges(0),
 m_pTexture(NULL),
 m_pTextureView(NULL),
 m_pIB(NULL),
@@ -373,6 +527,30 @@ CommonFont::~CommonFont()
 	Release(m_pTexture);
 
 	delete[] m_pGlyphs;
+	delete[] m_pRanges;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+const CommonFont::Glyph *CommonFont::FindGlyph(uint32_t ch) const
+{
+	size_t firstGlyph = 0;
+
+	for (size_t i = 0; i < m_numRanges; ++i)
+	{
+		const CharRange *pRange = &m_pRanges[i];
+
+		if (pRange->last < pRange->first)
+			continue;
+
+		if (ch >= pRange->first && ch <= pRange->last)
+			return &m_pGlyphs[firstGlyph + (ch - pRange->first)];
+
+		firstGlyph += pRange->last - pRange->first + 1;
+	}
+
+	return NULL;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -398,15 +576,14 @@ void CommonFont::DrawString(const XMFLOAT3 &startPos, const Style *pStyle, const
 	if (!pStyle)
 		pStyle = &DEFAULT_STYLE;
 
-	for (size_t chIdx = 0; pStr[chIdx] != 0; ++chIdx)
+	while (*pStr != 0)
 	{
-		int c = pStr[chIdx];
+		uint32_t c = DecodeUTF8(&pStr);
 
-		if (c < 32 || c >= 127)
+		const Glyph *pGlyph = this->FindGlyph(c);
+		if (!pGlyph)
 			continue;//can't print this char
 
-		const Glyph *pGlyph = &m_pGlyphs[c - 32];
-
 		if (numChars >= NUM_CHARS)
 		{
 			assert(numChars == NUM_CHARS);
@@ -6,6 +6,9 @@
 
 class CommonApp;
 
+struct GlyphAtlasRect;
+struct GlyphAtlasInfo;
+
 #include <stdint.h>
 #include "D3DHelpers.h"
 
@@ -36,7 +39,20 @@ public:
 		Style(const VertexColour &colour, const XMFLOAT2 &scale);
 	};
 
+	// Inclusive range of Unicode code points. Anything above U+10FFFF,
+	// and the surrogates (U+D800-U+DFFF), are left out.
+	struct CharRange
+	{
+		uint32_t first;
+		uint32_t last;
+	};
+
+	// The first form creates a font with just the printable ASCII
+	// characters (32-126). The second puts every character from
+	// every range into the font texture, so keep the ranges to
+	// what's actually needed.
 	static CommonFont *CreateByName(const char *pFontName, int height, uint32_t createFlags, CommonApp *pApp);
+	static CommonFont *CreateByName(const char *pFontName, int height, uint32_t createFlags, const CharRange *pRanges, size_t numRanges, CommonApp *pApp);
 
 	~CommonFont();
 
@@ -52,6 +68,9 @@ public:
 	// 
 	// If drawn at a scale of (1,1), 1 pixel in the font is equivalent to 1
 	// world space unit.
+	//
+	// The string is UTF-8. Characters that aren't in the font are
+	// skipped.
 	void DrawString(const XMFLOAT3 &pos, const Style *pStyle, const char *pStr);
 	void DrawStringf(const XMFLOAT3 &pos, const Style *pStyle, const char *pFmt, ...);
 protected:
@@ -61,12 +80,29 @@ private:
 	struct Glyph;
 	Glyph *m_pGlyphs;
 
+	CharRange *m_pRanges;
+	size_t m_numRanges;
+
 	ID3D11Texture2D *m_pTexture;
 	ID3D11ShaderResourceView *m_pTextureView;
 
 	ID3D11Buffer *m_pVB, *m_pIB;
 
-	static bool PaintAlphabet(HDC hDC, int width, int height, Glyph *pGlyphs);
+	const Glyph *FindGlyph(uint32_t ch) const;
+
+	// The ranges with the code points that can't be drawn taken out,
+	// and those left empty dropped. pValidRanges has room for
+	// numRanges * 2. Returns how many there are.
+	static size_t GetValidRanges(const CharRange *pRanges, size_t numRanges, CharRange *pValidRanges);
+
+	// The ranges must be valid.
+	static size_t CountGlyphs(const CharRange *pRanges, size_t numRanges);
+
+	// Returns how much space to leave between glyphs for the ink that
+	// overhangs their cells.
+	static int MeasureGlyphs(HDC hDC, const CharRange *pRanges, size_t numRanges, GlyphAtlasRect *pRects);
+
+	static void PaintGlyphs(HDC hDC, const CharRange *pRanges, size_t numRanges, const GlyphAtlasRect *pRects, const GlyphAtlasInfo &atlasInfo, Glyph *pGlyphs);
 
 	CommonFont();
 
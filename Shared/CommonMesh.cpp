@@ -8,10 +8,20 @@
 
 #include "CommonApp.h"
 #include "CommonMesh.h"
+#include "MeshFile.h"
+#include "MeshGenerators.h"
+#include "OcclusionBuffer.h"
+#include "VertexCacheOptimiser.h"
 
 #include <assert.h>
 
 #include <algorithm>
+#include <string>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const char CommonMesh::MESH_CACHE_EXTENSION[] = ".cmesh";
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
@@ -160,13 +170,17 @@ static void CopyColour(VertexColour *pDest, const char *pSrcVertex, const D3DVER
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
-CommonMesh *CommonMesh::LoadFromXFile(CommonApp *pApp, const char *pFileName)
+static void ExtractD3DXMesh(ID3DXMesh *pMesh9, ID3DXBuffer *pMaterialsBuffer9, MeshFile *pMeshFile);
+
+static bool LoadXFile(const char *pFileName, MeshFile *pMeshFile)
 {
 	HRESULT hr;
 	IDirect3DDevice9 *pDevice9 = NULL;
 	ID3DXMesh *pMesh9 = NULL;
 	ID3DXBuffer *pMaterialsBuffer9 = NULL;
-	CommonMesh *pMesh = NULL;
+	bool good = false;
+
+	pMeshFile->Clear();
 
 	pDevice9 = CreateDevice9();
 	if (!pDevice9)
@@ -176,96 +190,93 @@ CommonMesh *CommonMesh::LoadFromXFile(CommonApp *pApp, const char *pFileName)
 	if (FAILED(hr))
 		goto done;
 
-	pMesh = ConvertFromD3DXMesh(pApp, pMesh9, pMaterialsBuffer9);
+	ExtractD3DXMesh(pMesh9, pMaterialsBuffer9, pMeshFile);
+	pMeshFile->SetSourceFile(pFileName);
+
+	good = true;
 
 done:
 	Release(pMaterialsBuffer9);
 	Release(pMesh9);
 	Release(pDevice9);
 
-	return pMesh;
-
+	return good;
 }
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
-CommonMesh *CommonMesh::NewBoxMesh(CommonApp *pApp, float width, float height, float depth)
+// The cache lives next to the .x file. It's used if it was made from
+// the .x file as it is now, or if the .x file isn't there at all;
+// otherwise the .x file is loaded the slow way and a new cache
+// written out.
+CommonMesh *CommonMesh::LoadFromXFile(CommonApp *pApp, const char *pFileName)
 {
-	HRESULT hr;
-	IDirect3DDevice9 *pDevice9 = NULL;
-	ID3DXMesh *pMesh9 = NULL;
-	CommonMesh *pMesh = NULL;
-
-	pDevice9 = CreateDevice9();
-	if (!pDevice9)
-		goto done;
+	std::string cacheFileName = std::string(pFileName) + MESH_CACHE_EXTENSION;
+	MeshFile meshFile;
 
-	hr = D3DXCreateBox(pDevice9, width, height, depth, &pMesh9, NULL);
-	if (FAILED(hr))
-		goto done;
+	if (meshFile.Load(cacheFileName.c_str()))
+	{
+		if (meshFile.IsUpToDateWith(pFileName) || GetFileAttributes(pFileName) == INVALID_FILE_ATTRIBUTES)
+			return CreateFromMeshFile(pApp, meshFile);
+	}
 
-	pMesh = ConvertFromD3DXMesh(pApp, pMesh9, NULL);
+	if (!LoadXFile(pFileName, &meshFile))
+		return NULL;
 
-done:
-	Release(pMesh9);
-	Release(pDevice9);
+	if (!meshFile.Save(cacheFileName.c_str()))
+		dprintf("%s: failed to write mesh cache \"%s\".\n", __FUNCTION__, cacheFileName.c_str());
 
-	return pMesh;
+	return CreateFromMeshFile(pApp, meshFile);
 }
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
-CommonMesh *CommonMesh::NewCylinderMesh(CommonApp *pApp, float radius1, float radius2, float length, unsigned slices, unsigned stacks)
+bool CommonMesh::ConvertXFileToMeshFile(const char *pXFileName, const char *pMeshFileName)
 {
-	HRESULT hr;
-	IDirect3DDevice9 *pDevice9 = NULL;
-	ID3DXMesh *pMesh9 = NULL;
-	CommonMesh *pMesh = NULL;
+	MeshFile meshFile;
 
-	pDevice9 = CreateDevice9();
-	if (!pDevice9)
-		goto done;
+	if (!LoadXFile(pXFileName, &meshFile))
+		return false;
 
-	hr = D3DXCreateCylinder(pDevice9, radius1, radius2, length, slices, stacks, &pMesh9, NULL);
-	if (FAILED(hr))
-		goto done;
+	return meshFile.Save(pMeshFileName);
+}
 
-	pMesh = ConvertFromD3DXMesh(pApp, pMesh9, NULL);
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 
-done:
-	Release(pMesh9);
-	Release(pDevice9);
+CommonMesh *CommonMesh::NewBoxMesh(CommonApp *pApp, float width, float height, float depth)
+{
+	GeneratedMesh generated;
+	if (!GenerateBoxMesh(width, height, depth, &generated))
+		return NULL;
 
-	return pMesh;
+	return ConvertFromGeneratedMesh(pApp, generated);
 }
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
-CommonMesh *CommonMesh::NewSphereMesh(CommonApp *pApp, float radius, unsigned slices, unsigned stacks)
+CommonMesh *CommonMesh::NewCylinderMesh(CommonApp *pApp, float radius1, float radius2, float length, unsigned slices, unsigned stacks)
 {
-	HRESULT hr;
-	IDirect3DDevice9 *pDevice9 = NULL;
-	ID3DXMesh *pMesh9 = NULL;
-	CommonMesh *pMesh = NULL;
-
-	pDevice9 = CreateDevice9();
-	if (!pDevice9)
-		goto done;
+	GeneratedMesh generated;
+	if (!GenerateCylinderMesh(radius1, radius2, length, slices, stacks, &generated))
+		return NULL;
 
-	hr = D3DXCreateSphere(pDevice9, radius, slices, stacks, &pMesh9, NULL);
-	if (FAILED(hr))
-		goto done;
+	return ConvertFromGeneratedMesh(pApp, generated);
+}
 
-	pMesh = ConvertFromD3DXMesh(pApp, pMesh9, NULL);
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 
-done:
-	Release(pMesh9);
-	Release(pDevice9);
+CommonMesh *CommonMesh::NewSphereMesh(CommonApp *pApp, float radius, unsigned slices, unsigned stacks)
+{
+	GeneratedMesh generated;
+	if (!GenerateSphereMesh(radius, slices, stacks, &generated))
+		return NULL;
 
-	return pMesh;
+	return ConvertFromGeneratedMesh(pApp, generated);
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -273,31 +284,19 @@ done:
 
 CommonMesh *CommonMesh::NewTorusMesh(CommonApp *pApp, float innerRadius, float outerRadius, unsigned sides, unsigned rings)
 {
-	HRESULT hr;
-	IDirect3DDevice9 *pDevice9 = NULL;
-	ID3DXMesh *pMesh9 = NULL;
-	CommonMesh *pMesh = NULL;
-
-	pDevice9 = CreateDevice9();
-	if (!pDevice9)
-		goto done;
-
-	hr = D3DXCreateTorus(pDevice9, innerRadius, outerRadius, sides, rings, &pMesh9, NULL);
-	if (FAILED(hr))
-		goto done;
-
-	pMesh = ConvertFromD3DXMesh(pApp, pMesh9, NULL);
-
-done:
-	Release(pMesh9);
-	Release(pDevice9);
+	GeneratedMesh generated;
+	if (!GenerateTorusMesh(innerRadius, outerRadius, sides, rings, &generated))
+		return NULL;
 
-	return pMesh;
+	return ConvertFromGeneratedMesh(pApp, generated);
 }
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
+// There's no native version of this one. The teapot is built from
+// Bezier patches, and it's not worth carrying the patch data around
+// just for this.
 CommonMesh *CommonMesh::NewTeapotMesh(CommonApp *pApp)
 {
 	HRESULT hr;
@@ -409,39 +408,46 @@ void CommonMesh::GetSubsetLocalAABB(size_t subsetIndex, XMFLOAT3 *pLocalAABBMin,
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
-void CommonMesh::SetShaderForAllSubsets(CommonApp::Shader *pShader)
+bool CommonMesh::IsOccluded(OcclusionBuffer *pOcclusionBuffer) const
 {
-	for (size_t i = 0; i < this->GetNumSubsets(); ++i)
-		this->SetSubsetShader(i, pShader);
-}
+	if (m_numSubsets == 0)
+		return false;
 
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
+	// One box around all the subsets.
+	XMFLOAT3 aabbMin = m_pSubsets[0].localAABBMin;
+	XMFLOAT3 aabbMax = m_pSubsets[0].localAABBMax;
 
-static void UpdateLocalAABB(XMFLOAT3 *pAABBMin, XMFLOAT3 *pAABBMax, DWORD i, const XMFLOAT3 &pos)
-{
-	if (i == 0)
-	{
-		*pAABBMin = pos;
-		*pAABBMax = pos;
-	}
-	else
+	for (size_t i = 1; i < m_numSubsets; ++i)
 	{
-		pAABBMin->x = std::min(pAABBMin->x, pos.x);
-		pAABBMin->y = std::min(pAABBMin->y, pos.y);
-		pAABBMin->z = std::min(pAABBMin->z, pos.z);
+		const Subset *pSubset = &m_pSubsets[i];
 
-		pAABBMax->x = std::max(pAABBMax->x, pos.x);
-		pAABBMax->y = std::max(pAABBMax->y, pos.y);
-		pAABBMax->z = std::max(pAABBMax->z, pos.z);
+		aabbMin = XMFLOAT3(std::min(aabbMin.x, pSubset->localAABBMin.x), std::min(aabbMin.y, pSubset->localAABBMin.y), std::min(aabbMin.z, pSubset->localAABBMin.z));
+		aabbMax = XMFLOAT3(std::max(aabbMax.x, pSubset->localAABBMax.x), std::max(aabbMax.y, pSubset->localAABBMax.y), std::max(aabbMax.z, pSubset->localAABBMax.z));
 	}
+
+	XMFLOAT4X4 wvp;
+	XMStoreFloat4x4(&wvp, m_pApp->GetWVP());
+
+	return pOcclusionBuffer->IsBoxOccluded(&wvp.m[0][0], &aabbMin.x, &aabbMax.x);
 }
 
-CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9, ID3DXBuffer *pMaterialsBuffer9)
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void CommonMesh::SetShaderForAllSubsets(CommonApp::Shader *pShader)
 {
-	CommonMesh *pResult = new CommonMesh;
-	pResult->m_pApp = pApp;
+	for (size_t i = 0; i < this->GetNumSubsets(); ++i)
+		this->SetSubsetShader(i, pShader);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 
+// Pull the subsets out of a D3DX mesh, in the form CommonMesh uploads
+// them. Vertex layouts other than the ones the CommonApp shaders use
+// are skipped.
+static void ExtractD3DXMesh(ID3DXMesh *pMesh9, ID3DXBuffer *pMaterialsBuffer9, MeshFile *pMeshFile)
+{
 	const D3DVERTEXELEMENT9 *pMeshPos9 = NULL;
 	const D3DVERTEXELEMENT9 *pMeshColour9 = NULL;
 	const D3DVERTEXELEMENT9 *pMeshNormal9 = NULL;
@@ -450,6 +456,13 @@ CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9,
 	D3DXATTRIBUTERANGE *pRanges9 = NULL;
 	DWORD numRanges9 = 0;
 
+	// Everything temporary comes from here, rather than a new[] (or
+	// two) per subset. This can be called without an app, so it has its
+	// own arena.
+	static const size_t SCRATCH_BLOCK_SIZE = 256 * 1024;
+	LinearArena scratch;
+	scratch.Create(SCRATCH_BLOCK_SIZE);
+
 	// Get VB layout.
 	{
 		static const D3DVERTEXELEMENT9 DECL_END = D3DDECL_END();
@@ -479,7 +492,9 @@ CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9,
 		if (numRanges9 == 0)
 		{
 			// Make one up...
-			pRanges9 = new D3DXATTRIBUTERANGE[1];
+			pRanges9 = scratch.AllocateArray<D3DXATTRIBUTERANGE>(1);
+			if (!pRanges9)
+				return;
 
 			pRanges9[0].AttribId = 0;
 			pRanges9[0].FaceStart = 0;
@@ -491,34 +506,36 @@ CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9,
 		}
 		else
 		{
-			pRanges9 = new D3DXATTRIBUTERANGE[numRanges9];
+			pRanges9 = scratch.AllocateArray<D3DXATTRIBUTERANGE>(numRanges9);
+			if (!pRanges9)
+				return;
+
 			pMesh9->GetAttributeTable(pRanges9, &numRanges9);
 		}
 	}
 
 	// Convert subsets.
 	{
-		pResult->m_pSubsets = new Subset[numRanges9];
-		pResult->m_numSubsets = 0;
-
 		const D3DXMATERIAL *pMaterials9 = NULL;
 		if (pMaterialsBuffer9)
 			pMaterials9 = static_cast<D3DXMATERIAL *>(pMaterialsBuffer9->GetBufferPointer());
 
+		// Each subset's vertices and indices are only needed until
+		// they're in the mesh file.
+		LinearArenaMarker subsetsMarker = scratch.GetMarker();
+
 		for (DWORD subsetIdx = 0; subsetIdx < numRanges9; ++subsetIdx)
 		{
+			scratch.ResetToMarker(subsetsMarker);
+
 			const D3DXATTRIBUTERANGE *pRange9 = &pRanges9[subsetIdx];
 			const D3DXMATERIAL *pMaterial9 = NULL;
 			if (pMaterials9)
 				pMaterial9 = &pMaterials9[subsetIdx];
 
-			//pSubset->firstItem = pRange9->FaceStart * 3;
-			//pSubset->numItems = pRange9->FaceCount * 3;
-
-			// Load material texture, if any.
-			ID3D11Texture2D *pTexture = NULL;
-			ID3D11ShaderResourceView *pTextureView = NULL;
-			ID3D11SamplerState *pSamplerState = NULL;
+			// Material texture, if any.
+			const char *pTextureFileName = NULL;
+			float diffuse[4] = {1.f, 1.f, 1.f, 1.f};
 
 			bool needsTexCoords = false;
 
@@ -526,9 +543,14 @@ CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9,
 			{
 				if (pMaterial9->pTextureFilename && strlen(pMaterial9->pTextureFilename) > 0)
 				{
-					LoadTextureFromFile(pResult->m_pApp->GetDevice(), pMaterial9->pTextureFilename, &pTexture, &pTextureView, &pSamplerState);
+					pTextureFileName = pMaterial9->pTextureFilename;
 					needsTexCoords = true;
 				}
+
+				diffuse[0] = pMaterial9->MatD3D.Diffuse.r;
+				diffuse[1] = pMaterial9->MatD3D.Diffuse.g;
+				diffuse[2] = pMaterial9->MatD3D.Diffuse.b;
+				diffuse[3] = pMaterial9->MatD3D.Diffuse.a;
 			}
 
 			if (!needsTexCoords)
@@ -543,11 +565,8 @@ CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9,
 			const D3DVERTEXELEMENT9 *pTexCoord9 = pMeshTexCoord9;
 
 			// Copy appropriate part of vertex buffer.
-			ID3D11Buffer *pVertexBuffer = NULL;
-			size_t vtxStride11 = 0;
-			CommonApp::Shader *pShader = NULL;
-			XMFLOAT3 localAABBMin(0.f, 0.f, 0.f);
-			XMFLOAT3 localAABBMax(0.f, 0.f, 0.f);
+			void *pVtxData = NULL;
+			MeshFileVertexType vertexType = NUM_MESH_FILE_VERTEX_TYPES;
 
 			{
 				IDirect3DVertexBuffer9 *pMeshVB9;
@@ -559,35 +578,30 @@ CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9,
 				pMeshVB9->Lock(0, 0, (void **)&pSrc, D3DLOCK_READONLY);
 				pSrc += pRange9->VertexStart * vtxStride9;
 
-				void *pInitData11 = NULL;
-
 				if (pPos9 && !pNormal9 && !pTexCoord9)
 				{
 					Vertex_Pos3fColour4ub *pDest; 
 
-					pInitData11 = pDest = static_cast<Vertex_Pos3fColour4ub *>(calloc(pRange9->VertexCount, sizeof *pDest));
+					pVtxData = pDest = scratch.AllocateArray<Vertex_Pos3fColour4ub>(pRange9->VertexCount);
 
 					for (DWORD i = 0; i < pRange9->VertexCount; ++i, ++pDest, pSrc += vtxStride9)
 					{
 						pDest->pos = *reinterpret_cast<XMFLOAT3 *>(pSrc + pPos9->Offset);
-						UpdateLocalAABB(&localAABBMin, &localAABBMax, i, pDest->pos);
 
 						CopyColour(&pDest->colour, pSrc, pColour9, pMaterial9);
 					}
 
-					vtxStride11 = sizeof *pDest;
-					pShader = pApp->GetUntexturedShader();
+					vertexType = MESH_FILE_VERTEX_POS3F_COLOUR4UB;
 				}
 				else if (pPos9 && pNormal9 && !pTexCoord9)
 				{
 					Vertex_Pos3fColour4ubNormal3f *pDest; 
 
-					pInitData11 = pDest = static_cast<Vertex_Pos3fColour4ubNormal3f *>(calloc(pRange9->VertexCount, sizeof *pDest));
+					pVtxData = pDest = scratch.AllocateArray<Vertex_Pos3fColour4ubNormal3f>(pRange9->VertexCount);
 
 					for (DWORD i = 0; i < pRange9->VertexCount; ++i, ++pDest, pSrc += vtxStride9)
 					{
 						pDest->pos = *reinterpret_cast<XMFLOAT3 *>(pSrc + pPos9->Offset);
-						UpdateLocalAABB(&localAABBMin, &localAABBMax, i, pDest->pos);
 
 						CopyColour(&pDest->colour, pSrc, pColour9, pMaterial9);
 
@@ -595,38 +609,34 @@ CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9,
 						XMStoreFloat3(&pDest->normal, XMVector3Normalize(vNormal));
 					}
 
-					vtxStride11 = sizeof *pDest;
-					pShader = pApp->GetUntexturedLitShader();
+					vertexType = MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F;
 				}
 				else if (pPos9 && !pNormal9 && pTexCoord9)
 				{
 					Vertex_Pos3fColour4ubTex2f *pDest; 
 
-					pInitData11 = pDest = static_cast<Vertex_Pos3fColour4ubTex2f *>(calloc(pRange9->VertexCount, sizeof *pDest));
+					pVtxData = pDest = scratch.AllocateArray<Vertex_Pos3fColour4ubTex2f>(pRange9->VertexCount);
 
 					for (DWORD i = 0; i < pRange9->VertexCount; ++i, ++pDest, pSrc += vtxStride9)
 					{
 						pDest->pos = *reinterpret_cast<XMFLOAT3 *>(pSrc + pPos9->Offset);
-						UpdateLocalAABB(&localAABBMin, &localAABBMax, i, pDest->pos);
 
 						CopyColour(&pDest->colour, pSrc, pColour9, pMaterial9);
 
 						pDest->tex = *reinterpret_cast<XMFLOAT2 *>(pSrc + pTexCoord9->Offset);
 					}
 
-					vtxStride11 = sizeof *pDest;
-					pShader = pApp->GetTexturedShader();
+					vertexType = MESH_FILE_VERTEX_POS3F_COLOUR4UB_TEX2F;
 				}
 				else if (pPos9 && pNormal9 && pTexCoord9)
 				{
 					Vertex_Pos3fColour4ubNormal3fTex2f *pDest; 
 
-					pInitData11 = pDest = static_cast<Vertex_Pos3fColour4ubNormal3fTex2f *>(calloc(pRange9->VertexCount, sizeof *pDest));
+					pVtxData = pDest = scratch.AllocateArray<Vertex_Pos3fColour4ubNormal3fTex2f>(pRange9->VertexCount);
 
 					for (DWORD i = 0; i < pRange9->VertexCount; ++i, ++pDest, pSrc += vtxStride9)
 					{
 						pDest->pos = *reinterpret_cast<XMFLOAT3 *>(pSrc + pPos9->Offset);
-						UpdateLocalAABB(&localAABBMin, &localAABBMax, i, pDest->pos);
 
 						CopyColour(&pDest->colour, pSrc, pColour9, pMaterial9);
 
@@ -636,8 +646,7 @@ CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9,
 						pDest->tex = *reinterpret_cast<XMFLOAT2 *>(pSrc + pTexCoord9->Offset);
 					}
 
-					vtxStride11 = sizeof *pDest;
-					pShader = pApp->GetTexturedLitShader();
+					vertexType = MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F_TEX2F;
 				}
 				else
 				{
@@ -648,27 +657,24 @@ CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9,
 
 				pMeshVB9->Unlock();
 				Release(pMeshVB9);
-
-				if (pInitData11)
-				{
-					pVertexBuffer = CreateImmutableVertexBuffer(pResult->m_pApp->GetDevice(), pRange9->VertexCount * vtxStride11, pInitData11);
-
-					free(pInitData11);
-					pInitData11 = NULL;
-				}
 			}
 
-			// Copy appropriate part of index buffer.
-			ID3D11Buffer *pIndexBuffer = NULL;
+			if (!pVtxData)
+				continue;
+
+			// Copy appropriate part of index buffer, rebased to the
+			// start of this subset's vertices.
 			{
+				uint16_t *pNewIBData = scratch.AllocateArray<uint16_t>(pRange9->FaceCount * 3);
+				if (!pNewIBData)
+					continue;
+
 				IDirect3DIndexBuffer9 *pMeshIB9;
 				pMesh9->GetIndexBuffer(&pMeshIB9);
 
 				uint16_t *pIBData;
 				pMeshIB9->Lock(0, 0, (void **)&pIBData, D3DLOCK_READONLY);
 
-				uint16_t *pNewIBData = new uint16_t[pRange9->FaceCount * 3];
-
 				for (DWORD idxIdx = 0; idxIdx < pRange9->FaceCount * 3; ++idxIdx)
 				{
 					uint16_t srcIdx = pIBData[pRange9->FaceStart * 3 + idxIdx];
@@ -677,54 +683,173 @@ CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9,
 					pNewIBData[idxIdx] = uint16_t(srcIdx - pRange9->VertexStart);
 				}
 
-				pIndexBuffer = CreateImmutableIndexBuffer(pResult->m_pApp->GetDevice(), pRange9->FaceCount* 3 * sizeof(uint16_t), pNewIBData);
-
 				pMeshIB9->Unlock();
 				Release(pMeshIB9);
 
-				delete[] pNewIBData;
+				// D3DX keeps the faces in file order, which is usually
+				// poor for the vertex cache.
+				OptimiseVertexCache(pNewIBData, pRange9->FaceCount * 3, pRange9->VertexCount);
+				OptimiseVertexFetch(pVtxData, pRange9->VertexCount, GetMeshFileVertexStride(vertexType), pNewIBData, pRange9->FaceCount * 3);
+
+				pMeshFile->AddSubset(vertexType, pVtxData, pRange9->VertexCount, pNewIBData, pRange9->FaceCount * 3, diffuse, pTextureFileName);
 			}
+		}
+	}
+}
 
-			// Looks good?
-			if (pVertexBuffer && pIndexBuffer && pShader)
-			{
-				Subset *pSubset = &pResult->m_pSubsets[pResult->m_numSubsets++];
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+CommonMesh *CommonMesh::ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9, ID3DXBuffer *pMaterialsBuffer9)
+{
+	MeshFile meshFile;
+	ExtractD3DXMesh(pMesh9, pMaterialsBuffer9, &meshFile);
 
-				pSubset->pShader = pShader;
+	return CreateFromMeshFile(pApp, meshFile);
+}
 
-				pSubset->firstItem = pRange9->FaceStart * 3;
-				pSubset->numItems = pRange9->FaceCount * 3;
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 
-				pSubset->pVertexBuffer = pVertexBuffer;
-				pVertexBuffer = NULL;
+// The D3DX shapes come out as position+normal, no colour, which
+// ConvertFromD3DXMesh turns into white UntexturedLit vertices. This
+// does the same.
+CommonMesh *CommonMesh::ConvertFromGeneratedMesh(CommonApp *pApp, const GeneratedMesh &generated)
+{
+	size_t numVtxs = generated.vertices.size();
+	size_t numIndices = generated.indices.size();
 
-				pSubset->vtxStride = vtxStride11;
+	if (numVtxs == 0 || numIndices == 0)
+		return NULL;
 
-				pSubset->pIndexBuffer = pIndexBuffer;
-				pIndexBuffer = NULL;
+	static const VertexColour WHITE(255, 255, 255, 255);
 
-				pSubset->pTexture = pTexture;
-				pTexture = NULL;
+	LinearArena *pScratch = pApp->GetScratchArena();
+	LinearArenaMarker scratchMarker = pScratch->GetMarker();
 
-				pSubset->pTextureView = pTextureView;
-				pTextureView = NULL;
+	Vertex_Pos3fColour4ubNormal3f *pVtxs = pScratch->AllocateArray<Vertex_Pos3fColour4ubNormal3f>(numVtxs);
+	if (!pVtxs)
+		return NULL;
 
-				pSubset->pSamplerState = pSamplerState;
-				pSamplerState = NULL;
+	for (size_t i = 0; i < numVtxs; ++i)
+	{
+		const GeneratedMeshVertex *pSrc = &generated.vertices[i];
 
-				pSubset->localAABBMin = localAABBMin;
-				pSubset->localAABBMax = localAABBMax;
-			}
+		XMFLOAT3 pos(pSrc->pos[0], pSrc->pos[1], pSrc->pos[2]);
+		XMFLOAT3 normal(pSrc->normal[0], pSrc->normal[1], pSrc->normal[2]);
 
-			Release(pVertexBuffer);
-			Release(pIndexBuffer);
-			Release(pTexture);
-			Release(pTextureView);
-			Release(pSamplerState);
-		}
+		pVtxs[i] = Vertex_Pos3fColour4ubNormal3f(pos, WHITE, normal);
 	}
 
-	delete[] pRanges9;
+	std::vector<uint16_t> indices(generated.indices);
+
+	OptimiseVertexCache(&indices[0], numIndices, numVtxs);
+	OptimiseVertexFetch(pVtxs, numVtxs, sizeof *pVtxs, &indices[0], numIndices);
+
+	MeshFile meshFile;
+	meshFile.AddSubset(MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F, pVtxs, uint32_t(numVtxs), &indices[0], uint32_t(numIndices), NULL, NULL);
+
+	pVtxs = NULL;
+	pScratch->ResetToMarker(scratchMarker);
+
+	return CreateFromMeshFile(pApp, meshFile);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+CommonMesh *CommonMesh::CreateFromMeshFile(CommonApp *pApp, const MeshFile &meshFile)
+{
+	CommonMesh *pResult = new CommonMesh;
+	pResult->m_pApp = pApp;
+
+	pResult->m_pSubsets = new Subset[meshFile.GetNumSubsets()];
+	pResult->m_numSubsets = 0;
+
+	for (size_t subsetIdx = 0; subsetIdx < meshFile.GetNumSubsets(); ++subsetIdx)
+	{
+		const MeshFile::Subset *pSrc = meshFile.GetSubset(subsetIdx);
+
+		size_t vtxStride11 = 0;
+		CommonApp::Shader *pShader = NULL;
+
+		switch (pSrc->vertexType)
+		{
+		case MESH_FILE_VERTEX_POS3F_COLOUR4UB:
+			vtxStride11 = sizeof(Vertex_Pos3fColour4ub);
+			pShader = pApp->GetUntexturedShader();
+			break;
+
+		case MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F:
+			vtxStride11 = sizeof(Vertex_Pos3fColour4ubNormal3f);
+			pShader = pApp->GetUntexturedLitShader();
+			break;
+
+		case MESH_FILE_VERTEX_POS3F_COLOUR4UB_TEX2F:
+			vtxStride11 = sizeof(Vertex_Pos3fColour4ubTex2f);
+			pShader = pApp->GetTexturedShader();
+			break;
+
+		case MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F_TEX2F:
+			vtxStride11 = sizeof(Vertex_Pos3fColour4ubNormal3fTex2f);
+			pShader = pApp->GetTexturedLitShader();
+			break;
+		}
+
+		assert(vtxStride11 == GetMeshFileVertexStride(pSrc->vertexType));
+
+		if (!pShader || pSrc->numVertices == 0 || pSrc->numIndices == 0)
+			continue;
+
+		ID3D11Buffer *pVertexBuffer = CreateImmutableVertexBuffer(pApp->GetDevice(), UINT(pSrc->numVertices * vtxStride11), pSrc->pVertices);
+		ID3D11Buffer *pIndexBuffer = CreateImmutableIndexBuffer(pApp->GetDevice(), UINT(pSrc->numIndices * sizeof(uint16_t)), pSrc->pIndices);
+
+		// Load material texture, if any.
+		ID3D11Texture2D *pTexture = NULL;
+		ID3D11ShaderResourceView *pTextureView = NULL;
+		ID3D11SamplerState *pSamplerState = NULL;
+
+		if (pSrc->pTextureFileName[0] != 0)
+			LoadTextureFromFile(pApp->GetDevice(), pSrc->pTextureFileName, &pTexture, &pTextureView, &pSamplerState);
+
+		// Looks good?
+		if (pVertexBuffer && pIndexBuffer)
+		{
+			Subset *pSubset = &pResult->m_pSubsets[pResult->m_numSubsets++];
+
+			pSubset->pShader = pShader;
+
+			// Each subset has its own index buffer, starting at 0.
+			pSubset->firstItem = 0;
+			pSubset->numItems = pSrc->numIndices;
+
+			pSubset->pVertexBuffer = pVertexBuffer;
+			pVertexBuffer = NULL;
+
+			pSubset->vtxStride = vtxStride11;
+
+			pSubset->pIndexBuffer = pIndexBuffer;
+			pIndexBuffer = NULL;
+
+			pSubset->pTexture = pTexture;
+			pTexture = NULL;
+
+			pSubset->pTextureView = pTextureView;
+			pTextureView = NULL;
+
+			pSubset->pSamplerState = pSamplerState;
+			pSamplerState = NULL;
+
+			pSubset->localAABBMin = XMFLOAT3(pSrc->aabbMin);
+			pSubset->localAABBMax = XMFLOAT3(pSrc->aabbMax);
+		}
+
+		Release(pVertexBuffer);
+		Release(pIndexBuffer);
+		Release(pTexture);
+		Release(pTextureView);
+		Release(pSamplerState);
+	}
 
 	return pResult;
 }
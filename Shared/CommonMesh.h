@@ -6,6 +6,9 @@
 
 struct ID3DXMesh;
 struct ID3DXBuffer;
+struct GeneratedMesh;
+class MeshFile;
+class OcclusionBuffer;
 
 #include "CommonApp.h"
 
@@ -15,12 +18,20 @@ struct ID3DXBuffer;
 class CommonMesh
 {
 public:
+	// Loads via a binary cache, pFileName + MESH_CACHE_EXTENSION, which
+	// is written out the first time the .x file is loaded.
 	static CommonMesh *LoadFromXFile(CommonApp *pApp, const char *pFileName);
 	static CommonMesh *NewBoxMesh(CommonApp *pApp, float width, float height, float depth);
 	static CommonMesh *NewCylinderMesh(CommonApp *pApp, float radius1, float radius2, float length, unsigned slices, unsigned stacks);
 	static CommonMesh *NewSphereMesh(CommonApp *pApp, float radius1, unsigned slices, unsigned stacks);
 	static CommonMesh *NewTorusMesh(CommonApp *pApp, float innerRadius, float outerRadius, unsigned sides, unsigned rings);
 	static CommonMesh *NewTeapotMesh(CommonApp *pApp);
+
+	// Offline converter: write the binary cache for an .x file without
+	// needing a D3D11 device.
+	static bool ConvertXFileToMeshFile(const char *pXFileName, const char *pMeshFileName);
+
+	static const char MESH_CACHE_EXTENSION[];
 		
 	~CommonMesh();
 
@@ -36,6 +47,12 @@ public:
 	void DrawSubset(size_t subsetIndex);
 	void GetSubsetLocalAABB(size_t subsetIndex, XMFLOAT3 *pLocalAABBMin, XMFLOAT3 *pLocalAABBMax) const;
 
+	// True if the whole mesh, with the app's current world, view and
+	// projection matrices, is hidden behind pOcclusionBuffer's
+	// occluders, rasterized with the same view and projection. Then
+	// there's no need to draw it.
+	bool IsOccluded(OcclusionBuffer *pOcclusionBuffer) const;
+
 	// Many meshes have only one subset.
 	void SetShaderForAllSubsets(CommonApp::Shader *pShader);
 protected:
@@ -50,6 +67,8 @@ private:
 	CommonApp *m_pApp;
 
 	static CommonMesh *ConvertFromD3DXMesh(CommonApp *pApp, ID3DXMesh *pMesh9, ID3DXBuffer *pMaterialsBuffer9);
+	static CommonMesh *ConvertFromGeneratedMesh(CommonApp *pApp, const GeneratedMesh &generated);
+	static CommonMesh *CreateFromMeshFile(CommonApp *pApp, const MeshFile &meshFile);
 
 	CommonMesh(const CommonMesh &);
 	CommonMesh &operator=(const CommonMesh &);
@@ -7,9 +7,15 @@
 #include <DxErr.h>
 
 #include "D3DHelpers.h"
+#include "ShaderDescription.h"
+#include "ShaderCache.h"
+#include "ParallelJobs.h"
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+
+#include <string>
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
@@ -530,23 +536,13 @@ void SetShaderProfiles(const char *pVSProfile, const char *pPSProfile)
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
-enum ThingType
+const char *ShaderDescription::GetThingTypeName(int thingType)
 {
-	TT_NONE,
-	TT_TEXTURE2D,
-	TT_SAMPLER_STATE,
-	TT_FLOAT,
-	TT_FLOAT2,
-	TT_FLOAT3,
-	TT_FLOAT4,
-	TT_FLOAT4x4,
-	TT_INT,
-};
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
+	switch (thingType)
+	{
+	default:
+		return "?ThingType?";
 
-BEGIN_NAMES(ThingType)
 	NAME(TT_NONE)
 	NAME(TT_TEXTURE2D)
 	NAME(TT_SAMPLER_STATE)
@@ -556,86 +552,8 @@ BEGIN_NAMES(ThingType)
 	NAME(TT_FLOAT4)
 	NAME(TT_FLOAT4x4)
 	NAME(TT_INT)
-END_NAMES()
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-struct ShaderDescription::ThingDescription
-{
-	// name, as per HLSL
-	char *pName;
-
-	// type of "thing"
-	ThingType type;
-
-	// slot/packoffset (according to type)
-	int slot;
-
-	ThingDescription *pNext;
-
-	ThingDescription();
-};
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-ShaderDescription::ThingDescription::ThingDescription():
-pName(NULL),
-pNext(NULL)
-{
-}
-
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-struct ShaderDescription::CBufferDescription
-{
-	// name, as per HLSL.
-	char *pName;
-
-	// size of buffer, in bytes
-	size_t sizeBytes;
-
-	// Constants.
-	ThingDescription *pConstants;
-
-	CBufferDescription();
-};
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-ShaderDescription::CBufferDescription::CBufferDescription():
-pName(NULL),
-sizeBytes(0),
-pConstants(NULL)
-{
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-// This value is fixed by D3D.
-static const int NUM_CBUFFER_SLOTS = 16;
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-ShaderDescription::ShaderDescription():
-m_pCBuffers(NULL),
-m_pTextures(NULL),
-m_pSamplerStates(NULL)
-{
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-ShaderDescription::~ShaderDescription()
-{
-	this->Destruct();
+	NAME(TT_CBUFFER)
+	}
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -643,7 +561,7 @@ ShaderDescription::~ShaderDescription()
 
 bool ShaderDescription::SetFromShaderBlob(ID3D10Blob *pD3DShaderBlob)
 {
-	this->Destruct();
+	this->Clear();
 
 	ID3D11ShaderReflection *pRShader;
 	if (FAILED(D3DReflect(pD3DShaderBlob->GetBufferPointer(), pD3DShaderBlob->GetBufferSize(), IID_ID3D11ShaderReflection, (void **)&pRShader)))
@@ -654,8 +572,6 @@ bool ShaderDescription::SetFromShaderBlob(ID3D10Blob *pD3DShaderBlob)
 
 	// Add variables from constant buffers.
 
-	m_pCBuffers = new CBufferDescription[NUM_CBUFFER_SLOTS];
-
 	for (UINT bufferIdx = 0; bufferIdx < shaderDesc.ConstantBuffers; ++bufferIdx)
 	{
 		ID3D11ShaderReflectionConstantBuffer *pRBuffer = pRShader->GetConstantBufferByIndex(bufferIdx);
@@ -674,18 +590,16 @@ bool ShaderDescription::SetFromShaderBlob(ID3D10Blob *pD3DShaderBlob)
 			continue;
 		}
 
-		CBufferDescription *pCBuffer = &m_pCBuffers[bufferBindDesc.BindPoint];
+		int cbufferSlot = int(bufferBindDesc.BindPoint);
 
-		if (pCBuffer->pName)
+		if (m_cbufferSizes[cbufferSlot] > 0)
 		{
 			// 2 cbuffers bound to the same slot - shouldn't happen!
 			continue;
 		}
 
-		pCBuffer->pName = _strdup(bufferDesc.Name);
-		pCBuffer->sizeBytes = bufferDesc.Size;
-
-		ThingDescription **ppNextThing = &pCBuffer->pConstants;
+		this->AddThing(SCOPE_CBUFFERS, bufferDesc.Name, TT_CBUFFER, cbufferSlot);
+		m_cbufferSizes[cbufferSlot] = bufferDesc.Size;
 
 		for (UINT varIdx = 0; varIdx < bufferDesc.Variables; ++varIdx)
 		{
@@ -721,47 +635,17 @@ bool ShaderDescription::SetFromShaderBlob(ID3D10Blob *pD3DShaderBlob)
 				thingType = TT_INT;
 
 			if (thingType != TT_NONE)
-			{
-				ThingDescription *pNewThing = new ThingDescription;
-
-				pNewThing->pName = _strdup(varDesc.Name);
-				pNewThing->type = thingType;
-				pNewThing->slot = varDesc.StartOffset;
-
-				*ppNextThing = pNewThing;
-				ppNextThing = &pNewThing->pNext;
-			}
+				this->AddThing(cbufferSlot, varDesc.Name, thingType, varDesc.StartOffset);
 		}
 	}
 
 	// Add shader inputs.
-	m_pTextures = this->GetResourceThingList(pRShader, D3D_SIT_TEXTURE, TT_TEXTURE2D);
-	m_pSamplerStates = this->GetResourceThingList(pRShader, D3D_SIT_SAMPLER, TT_SAMPLER_STATE);
+	this->AddResourceThings(pRShader, D3D_SIT_TEXTURE, SCOPE_TEXTURES, TT_TEXTURE2D);
+	this->AddResourceThings(pRShader, D3D_SIT_SAMPLER, SCOPE_SAMPLER_STATES, TT_SAMPLER_STATE);
 
 	Release(pRShader);
 
-	{
-		dprintf("---8<--- BEGIN DUMP\n");
-		dprintf("CBuffers:\n");
-		for(int i = 0; i < NUM_CBUFFER_SLOTS; ++i)
-		{
-			dprintf("%d: ", i);
-			if (!m_pCBuffers[i].pName)
-				dprintf("(empty)\n");
-			else
-			{
-				dprintf("\"%s\", %u bytes\n", m_pCBuffers[i].pName, m_pCBuffers[i].sizeBytes);
-				this->DumpThingList(m_pCBuffers[i].pConstants, "    ");
-			}
-		}
-
-		dprintf("Textures:\n");
-		this->DumpThingList(m_pTextures,"    ");
-
-		dprintf("Sampler States:\n");
-		this->DumpThingList(m_pSamplerStates,"    ");
-		dprintf("---8<--- END DUMP\n");
-	}
+	this->BuildHashTable();
 
 	return true;
 }
@@ -769,203 +653,61 @@ bool ShaderDescription::SetFromShaderBlob(ID3D10Blob *pD3DShaderBlob)
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
-void ShaderDescription::DumpThingList(const ThingDescription *pThings, const char *pPrefix) const
+void ShaderDescription::Dump() const
 {
-	int i = 0;
-
-	for (const ThingDescription *pThing = pThings; pThing; pThing = pThing->pNext, ++i)
-		dprintf("%s%d. \"%s\", %s, slot=%d\n", pPrefix, i, pThing->pName, GetNameThingType(pThing->type), pThing->slot);
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-size_t ShaderDescription::GetCBufferSizeBytes(int cbufferSlot) const
-{
-	if (cbufferSlot < 0 || cbufferSlot >= NUM_CBUFFER_SLOTS)
-		return 0;
-
-	const CBufferDescription *pCBuffer = &m_pCBuffers[cbufferSlot];
-
-	if (!pCBuffer->pName)
-		return 0;
-
-	return pCBuffer->sizeBytes;
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-bool ShaderDescription::FindCBuffer(const char *pName,int *pSlot) const
-{
-	for (int i = 0; i < NUM_CBUFFER_SLOTS; ++i)
+	dprintf("---8<--- BEGIN DUMP\n");
+	dprintf("CBuffers:\n");
+	for(int i = 0; i < NUM_CBUFFER_SLOTS; ++i)
 	{
-		if (m_pCBuffers[i].pName)
+		dprintf("%d: ", i);
+		if (m_cbufferSizes[i] == 0)
+			dprintf("(empty)\n");
+		else
 		{
-			if (strcmp(m_pCBuffers[i].pName, pName) == 0)
+			const char *pName = "?";
+			for (size_t thingIdx = 0; thingIdx < m_things.size(); ++thingIdx)
 			{
-				*pSlot = i;
-				return true;
+				if (m_things[thingIdx].scope == SCOPE_CBUFFERS && m_things[thingIdx].slot == i)
+					pName = &m_names[m_things[thingIdx].nameOffset];
 			}
-		}
-	}
-
-	*pSlot = -1;
-	return false;
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-bool ShaderDescription::FindFloat4x4(int cbufferSlot, const char *pName, int *pPackOffset) const
-{
-	return this->FindCBufferThing(cbufferSlot, pName, TT_FLOAT4x4, pPackOffset);
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
 
-bool ShaderDescription::FindFloat4(int cbufferSlot, const char *pName, int *pPackOffset) const
-{
-	return this->FindCBufferThing(cbufferSlot, pName, TT_FLOAT4, pPackOffset);
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-bool ShaderDescription::FindFloat3(int cbufferSlot, const char *pName, int *pPackOffset) const
-{
-	return this->FindCBufferThing(cbufferSlot, pName, TT_FLOAT3, pPackOffset);
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-bool ShaderDescription::FindFloat2(int cbufferSlot, const char *pName, int *pPackOffset) const
-{
-	return this->FindCBufferThing(cbufferSlot, pName, TT_FLOAT2, pPackOffset);
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-bool ShaderDescription::FindFloat(int cbufferSlot, const char *pName, int *pPackOffset) const
-{
-	return this->FindCBufferThing(cbufferSlot, pName, TT_FLOAT, pPackOffset);
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-bool ShaderDescription::FindInt(int cbufferSlot, const char *pName, int *pPackOffset) const
-{
-	return this->FindCBufferThing(cbufferSlot, pName, TT_INT, pPackOffset);
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-bool ShaderDescription::FindTexture(const char *pName, int *pSlot) const
-{
-	return this->FindThing(m_pTextures, pName, TT_TEXTURE2D, pSlot);
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-bool ShaderDescription::FindSamplerState(const char *pName, int *pSlot) const
-{
-	return this->FindThing(m_pSamplerStates, pName, TT_SAMPLER_STATE, pSlot);
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-bool ShaderDescription::FindThing(const ThingDescription *pThings, const char *pName, int thingType, int *pSlot) const
-{
-	for (const ThingDescription *pThing = pThings; pThing; pThing = pThing->pNext)
-	{
-		if (strcmp(pThing->pName, pName) == 0)
-		{
-			if (pThing->type == thingType)
-			{
-				*pSlot = pThing->slot;
-				return true;
-			}
+			dprintf("\"%s\", %u bytes\n", pName, m_cbufferSizes[i]);
+			this->DumpThings(i, "    ");
 		}
 	}
 
-	*pSlot = -1;
-	return false;
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-
-bool ShaderDescription::FindCBufferThing(int cbufferSlot, const char *pName, int thingType, int *pPackOffset) const
-{
-	if (cbufferSlot < 0 || cbufferSlot >= NUM_CBUFFER_SLOTS)
-	{
-		*pPackOffset = -1;
-		return false;
-	}
-
-	if (!this->FindThing(m_pCBuffers[cbufferSlot].pConstants, pName, thingType, pPackOffset))
-		return false;
+	dprintf("Textures:\n");
+	this->DumpThings(SCOPE_TEXTURES, "    ");
 
-	return true;
+	dprintf("Sampler States:\n");
+	this->DumpThings(SCOPE_SAMPLER_STATES, "    ");
+	dprintf("---8<--- END DUMP\n");
 }
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
-void ShaderDescription::DeleteThings(ThingDescription *pThings)
+void ShaderDescription::DumpThings(int scope, const char *pPrefix) const
 {
-	ThingDescription *pThing = pThings;
+	int i = 0;
 
-	while (pThing)
+	for (size_t thingIdx = 0; thingIdx < m_things.size(); ++thingIdx)
 	{
-		ThingDescription *pNext = pThing->pNext;
-
-		free(pThing->pName);
-
-		delete pThing;
-
-		pThing = pNext;
-	}
-}
-
-//////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
+		const Thing *pThing = &m_things[thingIdx];
 
-void ShaderDescription::Destruct()
-{
-	if (m_pCBuffers)
-	{
-		for (int i = 0; i < NUM_CBUFFER_SLOTS; ++i)
-			this->DeleteThings(m_pCBuffers[i].pConstants);
+		if (pThing->scope == scope)
+			dprintf("%s%d. \"%s\", %s, slot=%d\n", pPrefix, i++, &m_names[pThing->nameOffset], GetThingTypeName(pThing->type), pThing->slot);
 	}
-
-	delete[] m_pCBuffers;
-	m_pCBuffers = NULL;
-
-	this->DeleteThings(m_pTextures);
-	m_pTextures = NULL;
-
-	this->DeleteThings(m_pSamplerStates);
-	m_pSamplerStates = NULL;
 }
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
-ShaderDescription::ThingDescription *ShaderDescription::GetResourceThingList(ID3D11ShaderReflection *pRShader, int d3dShaderInputType, int thingType)
+void ShaderDescription::AddResourceThings(ID3D11ShaderReflection *pRShader, int d3dShaderInputType, int scope, int thingType)
 {
 	D3D11_SHADER_DESC shaderDesc;
 	if (FAILED(pRShader->GetDesc(&shaderDesc)))
-		return NULL;
-
-	ThingDescription *pFirstThing = NULL, **ppNextThing = &pFirstThing;
+		return;
 
 	for (UINT resIdx = 0; resIdx < shaderDesc.BoundResources; ++resIdx)
 	{
@@ -974,19 +716,8 @@ ShaderDescription::ThingDescription *ShaderDescription::GetResourceThingList(ID3
 			continue;
 
 		if (inputBindDesc.Type == d3dShaderInputType)
-		{
-			ThingDescription *pNewThing = new ThingDescription;
-
-			pNewThing->pName = _strdup(inputBindDesc.Name);
-			pNewThing->type = ThingType(thingType);
-			pNewThing->slot = inputBindDesc.BindPoint;
-
-			*ppNextThing = pNewThing;
-			ppNextThing = &pNewThing->pNext;
-		}
+			this->AddThing(scope, inputBindDesc.Name, thingType, inputBindDesc.BindPoint);
 	}
-
-	return pFirstThing;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -1126,7 +857,41 @@ void SetCBufferArrayInt(const D3D11_MAPPED_SUBRESOURCE &mapping, int packOffset,
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
-static ID3D10Blob *CompileShader(const char *pFileName, const char *pShaderSource, const D3D_SHADER_MACRO *pMacros, const char *pEntryPoint, const char *pProfileName, ShaderDescription *pDescription)
+static ShaderCache *g_pShaderCache = NULL;
+
+void SetShaderCache(ShaderCache *pShaderCache)
+{
+	g_pShaderCache = pShaderCache;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Like sprintf, but appends to a std::string.
+static void AppendF(std::string *pStr, const char *pFmt, ...)
+{
+	char buf[8192];
+	va_list v;
+
+	va_start(v, pFmt);
+
+	_vsnprintf(buf, sizeof buf, pFmt, v);
+	buf[sizeof buf - 1] = 0;
+
+	va_end(v);
+
+	*pStr += buf;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Compile one shader. Rather than being printed, the compiler output
+// goes in *pMessages, so this is safe to call from a worker thread.
+//
+// Only shaders compiled from a string go through the cache. A file
+// might #include others, and there's no way to tell when they change.
+static bool CompileShaderQuietly(const char *pFileName, const char *pShaderSource, const D3D_SHADER_MACRO *pMacros, const char *pEntryPoint, const char *pProfileName, std::vector<char> *pBytecode, ShaderDescription *pDescription, std::string *pMessages)
 {
 	HRESULT hr;
 
@@ -1136,6 +901,23 @@ static ID3D10Blob *CompileShader(const char *pFileName, const char *pShaderSourc
 	flags |= D3D10_SHADER_SKIP_OPTIMIZATION;//don't optimize
 	flags |= D3D10_SHADER_PACK_MATRIX_COLUMN_MAJOR;//more efficient matrix layout
 
+	uint64_t cacheKey = 0;
+	bool useCache = g_pShaderCache && !pFileName;
+
+	if (useCache)
+	{
+		// The output is down to the d3dcompiler DLL D3DX uses, not
+		// D3DX itself.
+		cacheKey = GetShaderCacheKey(D3D_COMPILER_VERSION, flags, pShaderSource, pMacros, pEntryPoint, pProfileName);
+
+		std::vector<char> reflection;
+		if (g_pShaderCache->Find(cacheKey, pBytecode, &reflection) && !pBytecode->empty())
+		{
+			if (pDescription->Deserialise(&reflection[0], reflection.size()))
+				return true;
+		}
+	}
+
 	ID3D10Blob *pD3DShaderBlob, *pErrorsBlob;
 
 	if (pFileName)
@@ -1151,17 +933,18 @@ static ID3D10Blob *CompileShader(const char *pFileName, const char *pShaderSourc
 		// as printf. You can double-click them in the output window
 		// and be taken to the offending line immediately.
 
-		const char *pErrors = static_cast<const char *>(pErrorsBlob->GetBufferPointer());
+		AppendF(pMessages, "\"%s\": %s (%s)\n", pFileName, DXGetErrorDescription(hr), DXGetErrorString(hr));
+		*pMessages += "---8<--- Error output begins:\n";
+		AppendF(pMessages, "Entry Point: \"%s\"\n", pEntryPoint);
+		AppendF(pMessages, "Profile Name: \"%s\"\n", pProfileName);
 
-		//size_t errorsSize = pErrorsBlob->GetBufferSize();
-		//TASSERT(errorsSize == 0 || pErrors[errorsSize - 1] == 0);
+		if (pErrorsBlob)
+		{
+			const char *pErrors = static_cast<const char *>(pErrorsBlob->GetBufferPointer());
+			*pMessages += std::string(pErrors, strnlen(pErrors, pErrorsBlob->GetBufferSize()));
+		}
 
-		dprintf("\"%s\": %s\n", pFileName, DXGetErrorDescription(hr), DXGetErrorString(hr));
-		dprintf("---8<--- Error output begins:\n");
-		dprintf("Entry Point: \"%s\"\n", pEntryPoint);
-		dprintf("Profile Name: \"%s\"\n", pProfileName);
-		dprintf("%s", pErrors);
-		dprintf("---8<--- Error output ends.\n");
+		*pMessages += "---8<--- Error output ends.\n";
 
 		Release(pD3DShaderBlob);//will probably be NULL anyway though.
 	}
@@ -1172,21 +955,57 @@ static ID3D10Blob *CompileShader(const char *pFileName, const char *pShaderSourc
 			D3D_DISASM_ENABLE_DEFAULT_VALUE_PRINTS | D3D_DISASM_ENABLE_INSTRUCTION_NUMBERING, NULL, &pDisassembly);
 		if (FAILED(hr))
 		{
-			dprintf("Shader disassembly failed.\n");
+			*pMessages += "Shader disassembly failed.\n";
 		}
 		else
 		{
-			dputs(static_cast<const char *>(pDisassembly->GetBufferPointer()));
+			*pMessages += static_cast<const char *>(pDisassembly->GetBufferPointer());
 			Release(pDisassembly);
 		}
 
-		if (pDescription)
-			pDescription->SetFromShaderBlob(pD3DShaderBlob);
+		const char *pBytes = static_cast<const char *>(pD3DShaderBlob->GetBufferPointer());
+		pBytecode->assign(pBytes, pBytes + pD3DShaderBlob->GetBufferSize());
+
+		pDescription->SetFromShaderBlob(pD3DShaderBlob);
+
+		if (useCache)
+		{
+			std::vector<char> reflection;
+			pDescription->Serialise(&reflection);
+
+			g_pShaderCache->Store(cacheKey, &(*pBytecode)[0], pBytecode->size(), &reflection[0], reflection.size());
+		}
 	}
 
 	Release(pErrorsBlob);
 
-	return pD3DShaderBlob;
+	bool good = pD3DShaderBlob != NULL;
+
+	Release(pD3DShaderBlob);
+
+	return good;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool CompileShader(const char *pFileName, const char *pShaderSource, const D3D_SHADER_MACRO *pMacros, const char *pEntryPoint, const char *pProfileName, std::vector<char> *pBytecode, ShaderDescription *pDescription)
+{
+	// The description is needed for the cache even if the caller
+	// isn't interested.
+	ShaderDescription tmpDescription;
+	if (!pDescription)
+		pDescription = &tmpDescription;
+
+	std::string messages;
+	bool good = CompileShaderQuietly(pFileName, pShaderSource, pMacros, pEntryPoint, pProfileName, pBytecode, pDescription, &messages);
+
+	dputs(messages.c_str());
+
+	if (good)
+		pDescription->Dump();
+
+	return good;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -1203,34 +1022,28 @@ bool CompileShaders(
 	Release(*ppD3DInputLayout);
 	Release(*ppD3DPixelShader);
 
-	ID3D10Blob *pBlob;
+	std::vector<char> bytecode;
 
 	// VS & input layout
-	pBlob = CompileShader(pFileName, pShaderSource, pMacros, pVSEntryPoint, g_aVSProfile, pVSDescription);
-	if (!pBlob)
+	if (!CompileShader(pFileName, pShaderSource, pMacros, pVSEntryPoint, g_aVSProfile, &bytecode, pVSDescription))
 		goto bad;
 
-	if (FAILED(pD3DDevice->CreateVertexShader(pBlob->GetBufferPointer(), pBlob->GetBufferSize(), NULL, ppD3DVertexShader)))
+	if (FAILED(pD3DDevice->CreateVertexShader(&bytecode[0], bytecode.size(), NULL, ppD3DVertexShader)))
 		goto bad;
 
 	if (ppD3DInputLayout)
 	{
-		if (FAILED(pD3DDevice->CreateInputLayout(pInputElementDescs, numInputElementDescs, pBlob->GetBufferPointer(), pBlob->GetBufferSize(), ppD3DInputLayout)))
+		if (FAILED(pD3DDevice->CreateInputLayout(pInputElementDescs, numInputElementDescs, &bytecode[0], bytecode.size(), ppD3DInputLayout)))
 			goto bad;
 	}
 
-	Release(pBlob);
-
 	// PS
-	pBlob = CompileShader(pFileName, pShaderSource, pMacros, pPSEntryPoint, g_aPSProfile, pPSDescription);
-	if (!pBlob)
+	if (!CompileShader(pFileName, pShaderSource, pMacros, pPSEntryPoint, g_aPSProfile, &bytecode, pPSDescription))
 		goto bad;
 
-	if (FAILED(pD3DDevice->CreatePixelShader(pBlob->GetBufferPointer(), pBlob->GetBufferSize(), NULL, ppD3DPixelShader)))
+	if (FAILED(pD3DDevice->CreatePixelShader(&bytecode[0], bytecode.size(), NULL, ppD3DPixelShader)))
 		goto bad;
 
-	Release(pBlob);
-
 	// That seemed to work.
 	SetD3DObjectDebugName(*ppD3DVertexShader, "%s:%s", pFileName, pVSEntryPoint);
 
@@ -1240,7 +1053,6 @@ bool CompileShaders(
 	
 bad:
 	// Some kind of error...
-	Release(pBlob);
 	Release(*ppD3DVertexShader);
 	Release(*ppD3DInputLayout);
 	Release(*ppD3DPixelShader);
@@ -1285,6 +1097,108 @@ bool CompileShadersFromString(
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
+CompiledShaderVariant::CompiledShaderVariant():
+pVS(NULL),
+pIL(NULL),
+pPS(NULL)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool CompileShaderVariants(ID3D11Device *pD3DDevice, const ShaderVariantDesc *pVariants, size_t numVariants, CompiledShaderVariant *pResults)
+{
+	for (size_t i = 0; i < numVariants; ++i)
+	{
+		Release(pResults[i].pVS);
+		Release(pResults[i].pIL);
+		Release(pResults[i].pPS);
+	}
+
+	// Each variant is 2 jobs: job 2*i compiles variant i's VS, and job
+	// 2*i+1 its PS.
+	size_t numJobs = numVariants * 2;
+	std::vector<std::vector<char> > bytecodes(numJobs);
+	std::vector<std::string> messages;
+
+	size_t numFailed = RunParallelJobs(numJobs, 0,
+		[&](size_t jobIndex, std::string *pMessages)
+		{
+			const ShaderVariantDesc *pVariant = &pVariants[jobIndex / 2];
+			CompiledShaderVariant *pResult = &pResults[jobIndex / 2];
+
+			if (jobIndex % 2 == 0)
+				return CompileShaderQuietly(pVariant->pFileName, pVariant->pShaderSource, pVariant->pMacros, pVariant->pVSEntryPoint, g_aVSProfile, &bytecodes[jobIndex], &pResult->vsDescription, pMessages);
+			else
+				return CompileShaderQuietly(pVariant->pFileName, pVariant->pShaderSource, pVariant->pMacros, pVariant->pPSEntryPoint, g_aPSProfile, &bytecodes[jobIndex], &pResult->psDescription, pMessages);
+		},
+		&messages);
+
+	// Print everything in order, as if it had been compiled one shader
+	// at a time.
+	for (size_t i = 0; i < numJobs; ++i)
+	{
+		dputs(messages[i].c_str());
+
+		if (!bytecodes[i].empty())
+		{
+			if (i % 2 == 0)
+				pResults[i / 2].vsDescription.Dump();
+			else
+				pResults[i / 2].psDescription.Dump();
+		}
+	}
+
+	if (numFailed > 0)
+	{
+		dprintf("%s: %u of %u shaders failed to compile.\n", __FUNCTION__, unsigned(numFailed), unsigned(numJobs));
+		return false;
+	}
+
+	// The compiling was the slow part. Creating the D3D objects is
+	// quick enough to do here.
+	for (size_t i = 0; i < numVariants; ++i)
+	{
+		const ShaderVariantDesc *pVariant = &pVariants[i];
+		CompiledShaderVariant *pResult = &pResults[i];
+
+		const std::vector<char> &vs = bytecodes[i * 2 + 0];
+		const std::vector<char> &ps = bytecodes[i * 2 + 1];
+
+		if (FAILED(pD3DDevice->CreateVertexShader(&vs[0], vs.size(), NULL, &pResult->pVS)))
+			goto bad;
+
+		if (pVariant->pInputElementDescs)
+		{
+			if (FAILED(pD3DDevice->CreateInputLayout(pVariant->pInputElementDescs, pVariant->numInputElementDescs, &vs[0], vs.size(), &pResult->pIL)))
+				goto bad;
+		}
+
+		if (FAILED(pD3DDevice->CreatePixelShader(&ps[0], ps.size(), NULL, &pResult->pPS)))
+			goto bad;
+
+		SetD3DObjectDebugName(pResult->pVS, "%s:%s", pVariant->pFileName, pVariant->pVSEntryPoint);
+
+		SetD3DObjectDebugName(pResult->pPS, "%s:%s", pVariant->pFileName, pVariant->pPSEntryPoint);
+	}
+
+	return true;
+
+bad:
+	for (size_t i = 0; i < numVariants; ++i)
+	{
+		Release(pResults[i].pVS);
+		Release(pResults[i].pIL);
+		Release(pResults[i].pPS);
+	}
+
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
 ID3D11Buffer *CreateBuffer(ID3D11Device *pDevice, UINT sizeBytes, D3D11_USAGE usage, UINT bindFlags, UINT cpuAccessFlags, const void *pInitialData)
 {
 	if (sizeBytes == 0)
@@ -11,13 +11,15 @@
 #include <stdint.h>
 #include <vector>
 
-struct ID3D11ShaderReflection;
+#include "ShaderDescription.h"
 
 #include <DirectXMath.h>
 using namespace DirectX;
 
 struct _D3D_SHADER_MACRO;
 
+class ShaderCache;
+
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
@@ -111,66 +113,19 @@ ID3D11ShaderResourceView* CreateTexture2DArraySRV(ID3D11Device* device, ID3D11De
 
 void SetShaderProfiles(const char *pVSProfile, const char *pPSProfile);
 
+// Set the cache for compiled shaders, or NULL for none (the default).
+//
+// Shaders compiled from strings are looked up in the cache first, and
+// added to it if they're not there. The cache isn't owned, and must
+// outlast any compiling done with it set.
+
+void SetShaderCache(ShaderCache *pShaderCache);
+
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
 extern const int INVALID_PACK_OFFSET;
 
-class ShaderDescription
-{
-public:
-	ShaderDescription();
-	~ShaderDescription();
-
-	bool SetFromShaderBlob(ID3D10Blob *pD3DShaderBlob);
-
-	// All the FindXXX functions return false if not found, and
-	// set the slot/pack offset to less than zero. This gives later
-	// code the option of working around missing constants.
-	//
-	// Finding something is not guaranteed to be very efficient.
-	// The idea is to find indexes of everything of interest when
-	// the shader is first loaded.
-	//
-	// (Alternatively, specify slots and packoffsets manually in
-	// the shader.)
-
-	// Any globals that are outside a cbuffer get assigned to
-	// a special cbuffer called "$Globals"; this is built-in
-	// DirectX behaviour.
-	bool FindCBuffer(const char *pName,int *pSlot) const;
-
-	size_t GetCBufferSizeBytes(int cbufferSlot) const;
-
-	bool FindFloat4x4(int cbufferSlot, const char *pName, int *pPackOffset) const;
-	bool FindFloat4(int cbufferSlot, const char *pName, int *pPackOffset) const;
-	bool FindFloat3(int cbufferSlot, const char *pName, int *pPackOffset) const;
-	bool FindFloat2(int cbufferSlot, const char *pName, int *pPackOffset) const;
-	bool FindFloat(int cbufferSlot, const char *pName, int *pPackOffset) const;
-	bool FindInt(int cbufferSlot, const char *pName, int *pPackOffset) const;
-
-	bool FindTexture(const char *pName, int *pSlot) const;
-	bool FindSamplerState(const char *pName, int *pSlot) const;
-protected:
-private:
-	struct ThingDescription;
-	struct CBufferDescription;
-
-	CBufferDescription *m_pCBuffers;
-	ThingDescription *m_pTextures;
-	ThingDescription *m_pSamplerStates;
-
-	bool FindThing(const ThingDescription *pThings, const char *pName, int thingType, int *pSlot) const;
-	bool FindCBufferThing(int cbufferSlot, const char *pName, int thingType, int *pPackOffset) const;
-	void DeleteThings(ThingDescription *pThings);
-	void Destruct();
-	ThingDescription *GetResourceThingList(ID3D11ShaderReflection *pRShader, int d3dShaderInputType, int thingType);
-	void DumpThingList(const ThingDescription *pThings, const char *pPrefix) const;
-
-	ShaderDescription(const ShaderDescription &);
-	ShaderDescription &operator=(const ShaderDescription &);
-};
-
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
@@ -236,6 +191,50 @@ bool CompileShadersFromString(
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
 
+// Compile several VS/PS pairs at once, on worker threads.
+//
+// Set one of pFileName and pShaderSource. pInputElementDescs may be
+// NULL, if no input layout is wanted.
+
+struct ShaderVariantDesc
+{
+	const char *pFileName;
+	const char *pShaderSource;
+	const _D3D_SHADER_MACRO *pMacros;
+
+	const char *pVSEntryPoint;
+	const char *pPSEntryPoint;
+
+	const D3D11_INPUT_ELEMENT_DESC *pInputElementDescs;
+	unsigned numInputElementDescs;
+};
+
+// The D3D objects belong to the caller.
+
+struct CompiledShaderVariant
+{
+	ID3D11VertexShader *pVS;
+	ID3D11InputLayout *pIL;
+	ID3D11PixelShader *pPS;
+
+	ShaderDescription vsDescription;
+	ShaderDescription psDescription;
+
+	CompiledShaderVariant();
+};
+
+// pResults[i] gets the shaders for pVariants[i]. The compiler output
+// is printed afterwards in the same order, so it doesn't get mixed
+// up.
+//
+// If anything fails, the errors for all the variants are printed, and
+// all the results are left NULL.
+
+bool CompileShaderVariants(ID3D11Device *pD3DDevice, const ShaderVariantDesc *pVariants, size_t numVariants, CompiledShaderVariant *pResults);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
 ID3D11Buffer *CreateBuffer(ID3D11Device *pDevice, UINT sizeBytes, D3D11_USAGE usage, UINT bindFlags, UINT cpuAccessFlags, const void *pInitialData);
 
 //////////////////////////////////////////////////////////////////////
@@ -0,0 +1,246 @@
+#include "GlyphPacker.h"
+
+#include <math.h>
+#include <assert.h>
+
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+SkylinePacker::SkylinePacker():
+m_width(0),
+m_usedHeight(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SkylinePacker::Reset(int width)
+{
+	m_width = width;
+	m_usedHeight = 0;
+
+	m_skyline.clear();
+
+	Segment segment;
+	segment.x = 0;
+	segment.y = 0;
+	segment.width = width;
+	m_skyline.push_back(segment);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool SkylinePacker::Insert(int width, int height, int *pX, int *pY)
+{
+	size_t bestIdx = m_skyline.size();
+	int bestBottom = 0, bestWidth = 0, bestY = 0;
+
+	for (size_t i = 0; i < m_skyline.size(); ++i)
+	{
+		int y;
+		if (!this->FindPosition(i, width, &y))
+			continue;
+
+		int bottom = y + height;
+
+		if (bestIdx == m_skyline.size() || bottom < bestBottom || (bottom == bestBottom && m_skyline[i].width < bestWidth))
+		{
+			bestIdx = i;
+			bestBottom = bottom;
+			bestWidth = m_skyline[i].width;
+			bestY = y;
+		}
+	}
+
+	if (bestIdx == m_skyline.size())
+		return false;
+
+	*pX = m_skyline[bestIdx].x;
+	*pY = bestY;
+
+	this->AddSegment(bestIdx, *pX, bestY, width, height);
+
+	if (bestBottom > m_usedHeight)
+		m_usedHeight = bestBottom;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int SkylinePacker::GetWidth() const
+{
+	return m_width;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int SkylinePacker::GetUsedHeight() const
+{
+	return m_usedHeight;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// A rectangle whose left edge is at the start of segment `segmentIdx'
+// has to sit on top of the highest segment underneath it.
+bool SkylinePacker::FindPosition(size_t segmentIdx, int width, int *pY) const
+{
+	int x = m_skyline[segmentIdx].x;
+	if (x + width > m_width)
+		return false;
+
+	int y = 0;
+	int widthLeft = width;
+
+	for (size_t i = segmentIdx; widthLeft > 0; ++i)
+	{
+		assert(i < m_skyline.size());
+
+		y = std::max(y, m_skyline[i].y);
+		widthLeft -= m_skyline[i].width;
+	}
+
+	*pY = y;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SkylinePacker::AddSegment(size_t segmentIdx, int x, int y, int width, int height)
+{
+	Segment newSegment;
+	newSegment.x = x;
+	newSegment.y = y + height;
+	newSegment.width = width;
+
+	m_skyline.insert(m_skyline.begin() + segmentIdx, newSegment);
+
+	// Shrink or remove the segments now covered by the new one.
+	for (size_t i = segmentIdx + 1; i < m_skyline.size();)
+	{
+		Segment *pPrev = &m_skyline[i - 1];
+		Segment *pSegment = &m_skyline[i];
+
+		int prevRight = pPrev->x + pPrev->width;
+		if (pSegment->x >= prevRight)
+			break;
+
+		int shrink = prevRight - pSegment->x;
+
+		pSegment->x += shrink;
+		pSegment->width -= shrink;
+
+		if (pSegment->width > 0)
+			break;
+
+		m_skyline.erase(m_skyline.begin() + i);
+	}
+
+	// Merge neighbouring segments at the same height.
+	for (size_t i = 0; i + 1 < m_skyline.size();)
+	{
+		if (m_skyline[i].y == m_skyline[i + 1].y)
+		{
+			m_skyline[i].width += m_skyline[i + 1].width;
+			m_skyline.erase(m_skyline.begin() + i + 1);
+		}
+		else
+			++i;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static int NextPowerOf2(int x)
+{
+	int p = 1;
+
+	while (p < x)
+		p *= 2;
+
+	return p;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool PackGlyphAtlas(GlyphAtlasRect *pRects, size_t numRects, int padding, int maxSize, GlyphAtlasInfo *pInfo)
+{
+	// Tallest first gives the skyline the fewest steps to fill in.
+	std::vector<size_t> order(numRects);
+
+	double paddedArea = 0.0, glyphArea = 0.0;
+	int widestPadded = 1;
+
+	for (size_t i = 0; i < numRects; ++i)
+	{
+		order[i] = i;
+
+		int paddedWidth = pRects[i].width + padding;
+		int paddedHeight = pRects[i].height + padding;
+
+		paddedArea += double(paddedWidth) * paddedHeight;
+		glyphArea += double(pRects[i].width) * pRects[i].height;
+
+		widestPadded = std::max(widestPadded, paddedWidth);
+	}
+
+	std::sort(order.begin(), order.end(), [pRects](size_t a, size_t b) {
+		if (pRects[a].height != pRects[b].height)
+			return pRects[a].height > pRects[b].height;
+
+		return pRects[a].width > pRects[b].width;
+	});
+
+	// Aim for a roughly square atlas. The skyline wastes a bit of
+	// space, so the height usually comes out slightly above the
+	// width; the width is only doubled if that overflows maxSize.
+	int width = NextPowerOf2(std::max(widestPadded, int(ceil(sqrt(paddedArea)))));
+
+	SkylinePacker packer;
+
+	for (;;)
+	{
+		if (width > maxSize)
+			return false;
+
+		packer.Reset(width);
+
+		bool fitted = true;
+
+		for (size_t i = 0; i < numRects && fitted; ++i)
+		{
+			GlyphAtlasRect *pRect = &pRects[order[i]];
+
+			fitted = packer.Insert(pRect->width + padding, pRect->height + padding, &pRect->x, &pRect->y);
+		}
+
+		if (fitted && packer.GetUsedHeight() <= maxSize)
+			break;
+
+		width *= 2;
+	}
+
+	pInfo->width = width;
+	pInfo->height = std::max(4, (packer.GetUsedHeight() + 3) & ~3);
+
+	if (pInfo->height > maxSize)
+		return false;
+
+	pInfo->efficiency = float(glyphArea / (double(pInfo->width) * pInfo->height));
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
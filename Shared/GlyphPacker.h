@@ -0,0 +1,89 @@
+#ifndef HEADER_C76B5646A3BE4CEDBEE9276564C1018E
+#define HEADER_C76B5646A3BE4CEDBEE9276564C1018E
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Skyline rectangle packer, used to lay out font glyphs in a texture
+// atlas.
+//
+// The skyline is the silhouette of everything packed so far, stored
+// as a list of horizontal segments. Each new rectangle goes at the
+// position that leaves it lowest (ties broken by least width), which
+// packs mixed glyph sizes a lot more tightly than fixed-height rows.
+//
+// There's nothing platform-specific in here, so it can be used by
+// tools as well as the font code.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class SkylinePacker
+{
+public:
+	SkylinePacker();
+
+	// Start again with an empty bin of the given width. The bin has
+	// no fixed height; GetUsedHeight says how much has been used.
+	void Reset(int width);
+
+	// Returns false if the rectangle is wider than the bin.
+	bool Insert(int width, int height, int *pX, int *pY);
+
+	int GetWidth() const;
+	int GetUsedHeight() const;
+protected:
+private:
+	struct Segment
+	{
+		int x, y, width;
+	};
+
+	std::vector<Segment> m_skyline;
+	int m_width;
+	int m_usedHeight;
+
+	bool FindPosition(size_t segmentIdx, int width, int *pY) const;
+	void AddSegment(size_t segmentIdx, int x, int y, int width, int height);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct GlyphAtlasRect
+{
+	int x, y;
+	int width, height;
+};
+
+struct GlyphAtlasInfo
+{
+	int width, height;
+
+	// Glyph area divided by atlas area, 0-1.
+	float efficiency;
+};
+
+// Pack rectangles of the given sizes into an atlas, choosing the
+// atlas size from the total glyph area rather than by trial and
+// error. pRects[i].width/height must be filled in on entry; x and y
+// are filled in on exit. `padding' pixels are left between each
+// rectangle, and between rectangles and the right/bottom edges.
+//
+// The atlas width is a power of two. The height is rounded up to a
+// multiple of 4.
+//
+// Returns false if the result would exceed maxSize in either
+// dimension.
+bool PackGlyphAtlas(GlyphAtlasRect *pRects, size_t numRects, int padding, int maxSize, GlyphAtlasInfo *pInfo);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_C76B5646A3BE4CEDBEE9276564C1018E
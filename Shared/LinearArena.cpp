@@ -0,0 +1,204 @@
+#include "LinearArena.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <new>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+LinearArenaStats::LinearArenaStats():
+numAllocations(0),
+numBytesAllocated(0),
+numBlocksAllocated(0),
+numBlockBytesAllocated(0),
+maxNumBytesUsed(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+LinearArena::LinearArena():
+m_blockSize(0),
+m_blockIndex(0),
+m_offset(0),
+m_numBytesBeforeBlock(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+LinearArena::~LinearArena()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool LinearArena::Create(size_t blockSize)
+{
+	this->Destroy();
+
+	if (blockSize == 0)
+		return false;
+
+	m_blockSize = blockSize;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void LinearArena::Destroy()
+{
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+		delete[] m_blocks[i].pMemory;
+
+	m_blocks.clear();
+
+	m_blockSize = 0;
+	m_blockIndex = 0;
+	m_offset = 0;
+	m_numBytesBeforeBlock = 0;
+
+	m_stats = LinearArenaStats();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void *LinearArena::Allocate(size_t numBytes, size_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	if (m_blockSize == 0 || numBytes > size_t(-1) - alignment)
+		return NULL;
+
+	// Until there's room in the current block, move on to the next,
+	// making one if there isn't a big enough one.
+	for (;;)
+	{
+		if (m_blockIndex < m_blocks.size())
+		{
+			const Block *pBlock = &m_blocks[m_blockIndex];
+
+			uintptr_t base = uintptr_t(pBlock->pMemory);
+			uintptr_t aligned = (base + m_offset + alignment - 1) & ~uintptr_t(alignment - 1);
+			size_t start = size_t(aligned - base);
+
+			if (start <= pBlock->size && numBytes <= pBlock->size - start)
+			{
+				m_offset = start + numBytes;
+
+				++m_stats.numAllocations;
+				m_stats.numBytesAllocated += numBytes;
+				m_stats.maxNumBytesUsed = std::max(m_stats.maxNumBytesUsed, this->GetNumBytesUsed());
+
+				return pBlock->pMemory + start;
+			}
+		}
+
+		if (!this->NextBlock(numBytes + alignment - 1))
+			return NULL;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+LinearArenaMarker LinearArena::GetMarker() const
+{
+	LinearArenaMarker marker;
+
+	marker.blockIndex = m_blockIndex;
+	marker.offset = m_offset;
+
+	return marker;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// New blocks only ever go in after the current one, so markers from
+// earlier still point at the same place.
+void LinearArena::ResetToMarker(const LinearArenaMarker &marker)
+{
+	assert(marker.blockIndex < m_blockIndex || (marker.blockIndex == m_blockIndex && marker.offset <= m_offset));
+
+	m_blockIndex = marker.blockIndex;
+	m_offset = marker.offset;
+
+	m_numBytesBeforeBlock = 0;
+
+	for (size_t i = 0; i < m_blockIndex; ++i)
+		m_numBytesBeforeBlock += m_blocks[i].size;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void LinearArena::Reset()
+{
+	m_blockIndex = 0;
+	m_offset = 0;
+	m_numBytesBeforeBlock = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t LinearArena::GetNumBytesUsed() const
+{
+	return m_numBytesBeforeBlock + m_offset;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const LinearArenaStats &LinearArena::GetStats() const
+{
+	return m_stats;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Moves on to a block of at least minSize bytes, after the current one.
+// A block that's there already but too small is left for later.
+bool LinearArena::NextBlock(size_t minSize)
+{
+	if (m_blockIndex < m_blocks.size())
+	{
+		m_numBytesBeforeBlock += m_blocks[m_blockIndex].size;
+		++m_blockIndex;
+	}
+
+	m_offset = 0;
+
+	if (m_blockIndex < m_blocks.size() && m_blocks[m_blockIndex].size >= minSize)
+		return true;
+
+	Block block;
+
+	block.size = std::max(m_blockSize, minSize);
+	block.pMemory = new (std::nothrow) char[block.size];
+
+	if (!block.pMemory)
+		return false;
+
+	m_blocks.insert(m_blocks.begin() + m_blockIndex, block);
+
+	++m_stats.numBlocksAllocated;
+	m_stats.numBlockBytesAllocated += block.size;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
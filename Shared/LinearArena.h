@@ -0,0 +1,137 @@
+#ifndef HEADER_EBE7639CFC884843A021BDC030FB57DB
+#define HEADER_EBE7639CFC884843A021BDC030FB57DB
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Hands out memory by bumping a pointer through a list of big blocks,
+// for temporary buffers that would otherwise each be a new[] and a
+// delete[].
+//
+// Nothing is freed on its own. GetMarker remembers how much is in use,
+// and ResetToMarker gives back everything allocated since, so a
+// function can use the arena as a stack of scratch space and leave it
+// as it found it. Reset gives back everything. Blocks are kept once
+// they've been allocated, so after the first few uses an arena stops
+// going to the heap at all.
+//
+// An allocation bigger than the block size gets a block of its own.
+//
+// The App has two of these: a scratch arena for loading and building
+// things (use it stack fashion, as above), and a frame arena that's
+// reset before each HandleRender, for data only needed until the end
+// of the frame. Neither is safe to use from other threads.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct LinearArenaStats
+{
+	size_t numAllocations;
+	size_t numBytesAllocated;
+
+	// Blocks allocated from the heap.
+	size_t numBlocksAllocated;
+	size_t numBlockBytesAllocated;
+
+	// The most the arena has had in use at once, including any
+	// alignment padding and space left at the ends of blocks.
+	size_t maxNumBytesUsed;
+
+	LinearArenaStats();
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct LinearArenaMarker
+{
+	size_t blockIndex;
+	size_t offset;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class LinearArena
+{
+public:
+	LinearArena();
+	~LinearArena();
+
+	// No blocks are allocated until they're needed.
+	bool Create(size_t blockSize);
+	void Destroy();
+
+	// Returns numBytes at a multiple of alignment (a power of 2), or
+	// NULL if there's no memory left.
+	void *Allocate(size_t numBytes, size_t alignment);
+
+	// numItems uninitialised Ts; only for types that don't need
+	// constructing or destructing.
+	template<class T>
+	T *AllocateArray(size_t numItems);
+
+	LinearArenaMarker GetMarker() const;
+
+	// Frees everything allocated since the marker was got.
+	void ResetToMarker(const LinearArenaMarker &marker);
+
+	// Frees everything, keeping the blocks.
+	void Reset();
+
+	size_t GetNumBytesUsed() const;
+
+	const LinearArenaStats &GetStats() const;
+protected:
+private:
+	struct Block
+	{
+		char *pMemory;
+		size_t size;
+	};
+
+	size_t m_blockSize;
+
+	std::vector<Block> m_blocks;
+
+	// The block being allocated from, and how far through it.
+	size_t m_blockIndex;
+	size_t m_offset;
+
+	// Total size of the blocks before m_blockIndex.
+	size_t m_numBytesBeforeBlock;
+
+	LinearArenaStats m_stats;
+
+	bool NextBlock(size_t minSize);
+
+	LinearArena(const LinearArena &);
+	LinearArena &operator=(const LinearArena &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+template<class T>
+T *LinearArena::AllocateArray(size_t numItems)
+{
+	if (numItems > size_t(-1) / sizeof(T))
+		return NULL;
+
+	return static_cast<T *>(this->Allocate(numItems * sizeof(T), alignof(T)));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_EBE7639CFC884843A021BDC030FB57DB
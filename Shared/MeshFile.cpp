@@ -0,0 +1,542 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "MeshFile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static const char MAGIC[4] = {'C', 'M', 'S', 'H'};
+
+// Bump this whenever the layout, or the processing applied to the
+// data, changes. Old caches then fail to load and get rebuilt.
+//
+// 2 - subsets are vertex cache optimised
+static const uint32_t VERSION = 2;
+
+static const size_t BLOB_ALIGNMENT = 16;
+
+struct FileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t numSubsets;
+	uint32_t reserved;
+	uint64_t sourceSize;
+	uint64_t sourceModifiedTime;
+};
+
+struct SubsetRecord
+{
+	uint32_t vertexType;
+	uint32_t numVertices;
+	uint32_t numIndices;
+	uint32_t textureNameOffset;
+	uint32_t vertexOffset;
+	uint32_t indexOffset;
+	float aabbMin[3];
+	float aabbMax[3];
+	float diffuse[4];
+};
+
+static_assert(sizeof(FileHeader) == 32, "FileHeader layout");
+static_assert(sizeof(SubsetRecord) == 64, "SubsetRecord layout");
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t GetMeshFileVertexStride(MeshFileVertexType type)
+{
+	switch (type)
+	{
+	case MESH_FILE_VERTEX_POS3F_COLOUR4UB:
+		return 16;
+
+	case MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F:
+		return 28;
+
+	case MESH_FILE_VERTEX_POS3F_COLOUR4UB_TEX2F:
+		return 24;
+
+	case MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F_TEX2F:
+		return 36;
+
+	default:
+		return 0;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static size_t AlignUp(size_t x, size_t alignment)
+{
+	return (x + alignment - 1) / alignment * alignment;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+MeshFile::MeshFile():
+m_pMapping(NULL),
+m_mappingSize(0)
+#ifdef _WIN32
+,m_hFile(INVALID_HANDLE_VALUE),
+m_hMapping(NULL)
+#endif
+{
+	m_sourceStamp.size = 0;
+	m_sourceStamp.modifiedTime = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+MeshFile::~MeshFile()
+{
+	this->Clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void MeshFile::Clear()
+{
+	m_subsets.clear();
+
+	for (size_t i = 0; i < m_ownedBlobs.size(); ++i)
+		delete[] m_ownedBlobs[i];
+
+	m_ownedBlobs.clear();
+
+	this->UnmapFile();
+
+	m_sourceStamp.size = 0;
+	m_sourceStamp.modifiedTime = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool MeshFile::Load(const char *pFileName)
+{
+	this->Clear();
+
+	if (!this->MapFile(pFileName))
+		return false;
+
+	if (!this->ParseMapping())
+	{
+		this->Clear();
+		return false;
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool MeshFile::Save(const char *pFileName) const
+{
+	// Work out where everything goes.
+	std::vector<SubsetRecord> records(m_subsets.size());
+
+	size_t offset = sizeof(FileHeader) + m_subsets.size() * sizeof(SubsetRecord);
+
+	for (size_t i = 0; i < m_subsets.size(); ++i)
+	{
+		records[i].textureNameOffset = uint32_t(offset);
+		offset += strlen(m_subsets[i].pTextureFileName) + 1;
+	}
+
+	for (size_t i = 0; i < m_subsets.size(); ++i)
+	{
+		const Subset *pSubset = &m_subsets[i];
+		SubsetRecord *pRecord = &records[i];
+
+		pRecord->vertexType = pSubset->vertexType;
+		pRecord->numVertices = pSubset->numVertices;
+		pRecord->numIndices = pSubset->numIndices;
+
+		offset = AlignUp(offset, BLOB_ALIGNMENT);
+		pRecord->vertexOffset = uint32_t(offset);
+		offset += pSubset->numVertices * GetMeshFileVertexStride(pSubset->vertexType);
+
+		offset = AlignUp(offset, BLOB_ALIGNMENT);
+		pRecord->indexOffset = uint32_t(offset);
+		offset += pSubset->numIndices * sizeof(uint16_t);
+
+		memcpy(pRecord->aabbMin, pSubset->aabbMin, sizeof pRecord->aabbMin);
+		memcpy(pRecord->aabbMax, pSubset->aabbMax, sizeof pRecord->aabbMax);
+		memcpy(pRecord->diffuse, pSubset->diffuse, sizeof pRecord->diffuse);
+	}
+
+	if (offset > UINT32_MAX)
+		return false;
+
+	// Build it in memory and write it in one go.
+	std::vector<char> data(offset, 0);
+
+	FileHeader *pHeader = reinterpret_cast<FileHeader *>(&data[0]);
+
+	memcpy(pHeader->magic, MAGIC, sizeof MAGIC);
+	pHeader->version = VERSION;
+	pHeader->numSubsets = uint32_t(m_subsets.size());
+	pHeader->reserved = 0;
+	pHeader->sourceSize = m_sourceStamp.size;
+	pHeader->sourceModifiedTime = m_sourceStamp.modifiedTime;
+
+	if (!records.empty())
+		memcpy(&data[sizeof(FileHeader)], &records[0], records.size() * sizeof(SubsetRecord));
+
+	for (size_t i = 0; i < m_subsets.size(); ++i)
+	{
+		const Subset *pSubset = &m_subsets[i];
+		const SubsetRecord *pRecord = &records[i];
+
+		strcpy(&data[pRecord->textureNameOffset], pSubset->pTextureFileName);
+
+		memcpy(&data[pRecord->vertexOffset], pSubset->pVertices, pSubset->numVertices * GetMeshFileVertexStride(pSubset->vertexType));
+		memcpy(&data[pRecord->indexOffset], pSubset->pIndices, pSubset->numIndices * sizeof(uint16_t));
+	}
+
+	// Write to a temp file and rename, so a crash halfway through
+	// doesn't leave a truncated cache behind.
+	std::string tmpFileName = std::string(pFileName) + ".tmp";
+
+	FILE *pFile = fopen(tmpFileName.c_str(), "wb");
+	if (!pFile)
+		return false;
+
+	bool good = fwrite(&data[0], 1, data.size(), pFile) == data.size();
+
+	if (fclose(pFile) != 0)
+		good = false;
+
+	if (good)
+	{
+		remove(pFileName);
+		good = rename(tmpFileName.c_str(), pFileName) == 0;
+	}
+
+	if (!good)
+		remove(tmpFileName.c_str());
+
+	return good;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void MeshFile::AddSubset(MeshFileVertexType vertexType, const void *pVertices, uint32_t numVertices,
+	const uint16_t *pIndices, uint32_t numIndices, const float *pDiffuse, const char *pTextureFileName)
+{
+	assert(!m_pMapping);
+	assert(vertexType < NUM_MESH_FILE_VERTEX_TYPES);
+
+	if (!pTextureFileName)
+		pTextureFileName = "";
+
+	size_t stride = GetMeshFileVertexStride(vertexType);
+	size_t vertexBytes = numVertices * stride;
+	size_t indexBytes = numIndices * sizeof(uint16_t);
+	size_t nameBytes = strlen(pTextureFileName) + 1;
+
+	// One block for the lot. Indices first, so they're aligned.
+	char *pBlob = new char[indexBytes + vertexBytes + nameBytes];
+	m_ownedBlobs.push_back(pBlob);
+
+	Subset subset;
+
+	subset.vertexType = vertexType;
+
+	subset.pIndices = reinterpret_cast<uint16_t *>(pBlob);
+	subset.numIndices = numIndices;
+	memcpy(pBlob, pIndices, indexBytes);
+
+	subset.pVertices = pBlob + indexBytes;
+	subset.numVertices = numVertices;
+	memcpy(pBlob + indexBytes, pVertices, vertexBytes);
+
+	subset.pTextureFileName = pBlob + indexBytes + vertexBytes;
+	memcpy(pBlob + indexBytes + vertexBytes, pTextureFileName, nameBytes);
+
+	for (int i = 0; i < 4; ++i)
+		subset.diffuse[i] = pDiffuse ? pDiffuse[i] : 1.f;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		subset.aabbMin[i] = 0.f;
+		subset.aabbMax[i] = 0.f;
+	}
+
+	// Every layout starts with a float3 position.
+	const char *pVertex = static_cast<const char *>(pVertices);
+
+	for (uint32_t vtxIdx = 0; vtxIdx < numVertices; ++vtxIdx, pVertex += stride)
+	{
+		float pos[3];
+		memcpy(pos, pVertex, sizeof pos);
+
+		for (int i = 0; i < 3; ++i)
+		{
+			if (vtxIdx == 0)
+			{
+				subset.aabbMin[i] = pos[i];
+				subset.aabbMax[i] = pos[i];
+			}
+			else
+			{
+				subset.aabbMin[i] = std::min(subset.aabbMin[i], pos[i]);
+				subset.aabbMax[i] = std::max(subset.aabbMax[i], pos[i]);
+			}
+		}
+	}
+
+	m_subsets.push_back(subset);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t MeshFile::GetNumSubsets() const
+{
+	return m_subsets.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const MeshFile::Subset *MeshFile::GetSubset(size_t subsetIndex) const
+{
+	if (subsetIndex >= m_subsets.size())
+		return NULL;
+
+	return &m_subsets[subsetIndex];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool MeshFile::SetSourceFile(const char *pSourceFileName)
+{
+	return GetFileStamp(pSourceFileName, &m_sourceStamp);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool MeshFile::IsUpToDateWith(const char *pSourceFileName) const
+{
+	FileStamp stamp;
+	if (!GetFileStamp(pSourceFileName, &stamp))
+		return false;
+
+	return stamp.size == m_sourceStamp.size && stamp.modifiedTime == m_sourceStamp.modifiedTime;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool MeshFile::MapFile(const char *pFileName)
+{
+	assert(!m_pMapping);
+
+#ifdef _WIN32
+
+	HANDLE hFile = CreateFile(pFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0 || size.QuadPart > UINT32_MAX)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+
+	HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!hMapping)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+
+	void *pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!pView)
+	{
+		CloseHandle(hMapping);
+		CloseHandle(hFile);
+		return false;
+	}
+
+	m_hFile = hFile;
+	m_hMapping = hMapping;
+	m_pMapping = static_cast<const char *>(pView);
+	m_mappingSize = size_t(size.QuadPart);
+
+#else
+
+	int fd = open(pFileName, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0 || uint64_t(st.st_size) > UINT32_MAX)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *pView = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// The mapping keeps the file alive.
+	close(fd);
+
+	if (pView == MAP_FAILED)
+		return false;
+
+	m_pMapping = static_cast<const char *>(pView);
+	m_mappingSize = size_t(st.st_size);
+
+#endif
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void MeshFile::UnmapFile()
+{
+#ifdef _WIN32
+
+	if (m_pMapping)
+		UnmapViewOfFile(m_pMapping);
+
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+
+#else
+
+	if (m_pMapping)
+		munmap(const_cast<char *>(m_pMapping), m_mappingSize);
+
+#endif
+
+	m_pMapping = NULL;
+	m_mappingSize = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Everything in the file is checked against the file size, so a
+// truncated or corrupt cache is rejected rather than read off the end.
+bool MeshFile::ParseMapping()
+{
+	if (m_mappingSize < sizeof(FileHeader))
+		return false;
+
+	const FileHeader *pHeader = reinterpret_cast<const FileHeader *>(m_pMapping);
+
+	if (memcmp(pHeader->magic, MAGIC, sizeof MAGIC) != 0 || pHeader->version != VERSION)
+		return false;
+
+	if (pHeader->numSubsets > (m_mappingSize - sizeof(FileHeader)) / sizeof(SubsetRecord))
+		return false;
+
+	m_sourceStamp.size = pHeader->sourceSize;
+	m_sourceStamp.modifiedTime = pHeader->sourceModifiedTime;
+
+	const SubsetRecord *pRecords = reinterpret_cast<const SubsetRecord *>(m_pMapping + sizeof(FileHeader));
+
+	m_subsets.resize(pHeader->numSubsets);
+
+	for (uint32_t i = 0; i < pHeader->numSubsets; ++i)
+	{
+		const SubsetRecord *pRecord = &pRecords[i];
+		Subset *pSubset = &m_subsets[i];
+
+		if (pRecord->vertexType >= NUM_MESH_FILE_VERTEX_TYPES)
+			return false;
+
+		size_t vertexBytes = size_t(pRecord->numVertices) * GetMeshFileVertexStride(MeshFileVertexType(pRecord->vertexType));
+		size_t indexBytes = size_t(pRecord->numIndices) * sizeof(uint16_t);
+
+		if (pRecord->vertexOffset % BLOB_ALIGNMENT != 0 || pRecord->vertexOffset > m_mappingSize || vertexBytes > m_mappingSize - pRecord->vertexOffset)
+			return false;
+
+		if (pRecord->indexOffset % BLOB_ALIGNMENT != 0 || pRecord->indexOffset > m_mappingSize || indexBytes > m_mappingSize - pRecord->indexOffset)
+			return false;
+
+		if (pRecord->textureNameOffset >= m_mappingSize)
+			return false;
+
+		const char *pName = m_pMapping + pRecord->textureNameOffset;
+		if (!memchr(pName, 0, m_mappingSize - pRecord->textureNameOffset))
+			return false;
+
+		pSubset->vertexType = MeshFileVertexType(pRecord->vertexType);
+		pSubset->pVertices = m_pMapping + pRecord->vertexOffset;
+		pSubset->numVertices = pRecord->numVertices;
+		pSubset->pIndices = reinterpret_cast<const uint16_t *>(m_pMapping + pRecord->indexOffset);
+		pSubset->numIndices = pRecord->numIndices;
+		pSubset->pTextureFileName = pName;
+
+		memcpy(pSubset->aabbMin, pRecord->aabbMin, sizeof pSubset->aabbMin);
+		memcpy(pSubset->aabbMax, pRecord->aabbMax, sizeof pSubset->aabbMax);
+		memcpy(pSubset->diffuse, pRecord->diffuse, sizeof pSubset->diffuse);
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool MeshFile::GetFileStamp(const char *pFileName, FileStamp *pStamp)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(pFileName, &st) != 0)
+		return false;
+#else
+	struct stat st;
+	if (stat(pFileName, &st) != 0)
+		return false;
+#endif
+
+	pStamp->size = uint64_t(st.st_size);
+	pStamp->modifiedTime = uint64_t(st.st_mtime);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
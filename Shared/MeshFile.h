@@ -0,0 +1,145 @@
+#ifndef HEADER_2F0F21F4676A4020A8E3AEB220803F56
+#define HEADER_2F0F21F4676A4020A8E3AEB220803F56
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Binary mesh cache file.
+//
+// This holds a mesh in the form CommonMesh uploads it: per subset, a
+// vertex blob in one of the CommonApp vertex layouts, a 16-bit index
+// blob, the AABB, the material colour and the texture file name.
+// Loading is just a matter of mapping the file and checking the
+// header; the subset data points straight into the mapping, so it can
+// go to the GPU without being copied.
+//
+// The file also records the size and modification time of the file it
+// was made from, so a stale cache can be spotted and rebuilt.
+//
+// There's no D3D in here. Data is stored little-endian, and the
+// vertex layouts are described by MeshFileVertexType rather than
+// the D3D vertex structs.
+//
+// Layout (all offsets from the start of the file, blobs 16-byte
+// aligned):
+//
+//     Header
+//     SubsetRecord[numSubsets]
+//     texture names (0-terminated)
+//     vertex and index blobs
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// These match the CommonApp vertex structs, which all start with a
+// float3 position and a 4-byte colour.
+enum MeshFileVertexType
+{
+	MESH_FILE_VERTEX_POS3F_COLOUR4UB,
+	MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F,
+	MESH_FILE_VERTEX_POS3F_COLOUR4UB_TEX2F,
+	MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F_TEX2F,
+
+	NUM_MESH_FILE_VERTEX_TYPES,
+};
+
+size_t GetMeshFileVertexStride(MeshFileVertexType type);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class MeshFile
+{
+public:
+	struct Subset
+	{
+		MeshFileVertexType vertexType;
+
+		const void *pVertices;
+		uint32_t numVertices;
+
+		const uint16_t *pIndices;
+		uint32_t numIndices;
+
+		float aabbMin[3];
+		float aabbMax[3];
+
+		// RGBA, 0-1. This is already multiplied into the vertex
+		// colours.
+		float diffuse[4];
+
+		// Empty string if none.
+		const char *pTextureFileName;
+	};
+
+	MeshFile();
+	~MeshFile();
+
+	// Discard everything, whether loaded or added.
+	void Clear();
+
+	// Map an existing file. Returns false if it doesn't exist or
+	// isn't valid; the MeshFile is then empty.
+	bool Load(const char *pFileName);
+
+	// Write out whatever's there.
+	bool Save(const char *pFileName) const;
+
+	// Copy in a subset. The AABB is worked out from the vertex
+	// positions. Can't be used on a loaded file.
+	void AddSubset(MeshFileVertexType vertexType, const void *pVertices, uint32_t numVertices,
+		const uint16_t *pIndices, uint32_t numIndices, const float *pDiffuse, const char *pTextureFileName);
+
+	size_t GetNumSubsets() const;
+	const Subset *GetSubset(size_t subsetIndex) const;
+
+	// Record the size and modification time of the file this mesh
+	// was made from.
+	bool SetSourceFile(const char *pSourceFileName);
+
+	// True if the file this mesh was made from still has the recorded
+	// size and modification time.
+	bool IsUpToDateWith(const char *pSourceFileName) const;
+protected:
+private:
+	struct FileStamp
+	{
+		uint64_t size;
+		uint64_t modifiedTime;
+	};
+
+	std::vector<Subset> m_subsets;
+	FileStamp m_sourceStamp;
+
+	// Added subsets own their data.
+	std::vector<char *> m_ownedBlobs;
+
+	// Loaded subsets point into the mapping.
+	const char *m_pMapping;
+	size_t m_mappingSize;
+#ifdef _WIN32
+	void *m_hFile;
+	void *m_hMapping;
+#endif
+
+	bool MapFile(const char *pFileName);
+	void UnmapFile();
+	bool ParseMapping();
+
+	static bool GetFileStamp(const char *pFileName, FileStamp *pStamp);
+
+	MeshFile(const MeshFile &);
+	MeshFile &operator=(const MeshFile &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_2F0F21F4676A4020A8E3AEB220803F56
@@ -0,0 +1,325 @@
+#include "MeshGenerators.h"
+
+#include <math.h>
+#include <assert.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static const float PI = 3.14159265359f;
+
+static const size_t MAX_NUM_VERTICES = 65536;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void AddVertex(GeneratedMesh *pMesh, float x, float y, float z, float nx, float ny, float nz)
+{
+	GeneratedMeshVertex v;
+
+	v.pos[0] = x;
+	v.pos[1] = y;
+	v.pos[2] = z;
+
+	v.normal[0] = nx;
+	v.normal[1] = ny;
+	v.normal[2] = nz;
+
+	pMesh->vertices.push_back(v);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void AddFace(GeneratedMesh *pMesh, size_t a, size_t b, size_t c)
+{
+	assert(a < MAX_NUM_VERTICES && b < MAX_NUM_VERTICES && c < MAX_NUM_VERTICES);
+
+	pMesh->indices.push_back(uint16_t(a));
+	pMesh->indices.push_back(uint16_t(b));
+	pMesh->indices.push_back(uint16_t(c));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void Reset(GeneratedMesh *pMesh, size_t numVertices, size_t numFaces)
+{
+	pMesh->vertices.clear();
+	pMesh->vertices.reserve(numVertices);
+
+	pMesh->indices.clear();
+	pMesh->indices.reserve(numFaces * 3);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The round shapes all go clockwise around the Z axis (looking down
+// it), starting at +Y.
+static void GetAngleTable(unsigned n, std::vector<float> *pSin, std::vector<float> *pCos)
+{
+	pSin->resize(n);
+	pCos->resize(n);
+
+	float step = -2.f * PI / n;
+
+	for (unsigned i = 0; i < n; ++i)
+	{
+		float angle = PI / 2.f + i * step;
+
+		(*pSin)[i] = sinf(angle);
+		(*pCos)[i] = cosf(angle);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool GenerateBoxMesh(float width, float height, float depth, GeneratedMesh *pMesh)
+{
+	if (width < 0.f || height < 0.f || depth < 0.f)
+		return false;
+
+	// Unit cube, 4 vertices per side so each side gets its own normal.
+	static const float UNIT_POSITIONS[24][3] = {
+		{-.5f, -.5f, -.5f}, {-.5f, -.5f, .5f}, {-.5f, .5f, .5f}, {-.5f, .5f, -.5f},
+		{-.5f, .5f, -.5f}, {-.5f, .5f, .5f}, {.5f, .5f, .5f}, {.5f, .5f, -.5f},
+		{.5f, .5f, -.5f}, {.5f, .5f, .5f}, {.5f, -.5f, .5f}, {.5f, -.5f, -.5f},
+		{-.5f, -.5f, .5f}, {-.5f, -.5f, -.5f}, {.5f, -.5f, -.5f}, {.5f, -.5f, .5f},
+		{-.5f, -.5f, .5f}, {.5f, -.5f, .5f}, {.5f, .5f, .5f}, {-.5f, .5f, .5f},
+		{-.5f, -.5f, -.5f}, {-.5f, .5f, -.5f}, {.5f, .5f, -.5f}, {.5f, -.5f, -.5f},
+	};
+
+	static const float SIDE_NORMALS[6][3] = {
+		{-1.f, 0.f, 0.f},
+		{0.f, 1.f, 0.f},
+		{1.f, 0.f, 0.f},
+		{0.f, -1.f, 0.f},
+		{0.f, 0.f, 1.f},
+		{0.f, 0.f, -1.f},
+	};
+
+	Reset(pMesh, 24, 12);
+
+	for (size_t i = 0; i < 24; ++i)
+	{
+		const float *pNormal = SIDE_NORMALS[i / 4];
+
+		AddVertex(pMesh,
+			UNIT_POSITIONS[i][0] * width, UNIT_POSITIONS[i][1] * height, UNIT_POSITIONS[i][2] * depth,
+			pNormal[0], pNormal[1], pNormal[2]);
+	}
+
+	for (size_t side = 0; side < 6; ++side)
+	{
+		AddFace(pMesh, side * 4 + 0, side * 4 + 1, side * 4 + 2);
+		AddFace(pMesh, side * 4 + 2, side * 4 + 3, side * 4 + 0);
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool GenerateCylinderMesh(float radius1, float radius2, float length, unsigned slices, unsigned stacks, GeneratedMesh *pMesh)
+{
+	if (radius1 < 0.f || radius2 < 0.f || length < 0.f || slices < 2 || stacks < 1)
+		return false;
+
+	size_t numVertices = 2 + size_t(slices) * (stacks + 3);
+	if (numVertices > MAX_NUM_VERTICES)
+		return false;
+
+	Reset(pMesh, numVertices, size_t(slices) * (stacks + 1) * 2);
+
+	std::vector<float> sinTheta, cosTheta;
+	GetAngleTable(slices, &sinTheta, &cosTheta);
+
+	float z = -length * .5f;
+
+	// Bottom cap: centre, then the rim.
+	size_t bottomCentre = pMesh->vertices.size();
+
+	AddVertex(pMesh, 0.f, 0.f, z, 0.f, 0.f, -1.f);
+
+	for (unsigned slice = 0; slice < slices; ++slice)
+		AddVertex(pMesh, radius1 * cosTheta[slice], radius1 * sinTheta[slice], z, 0.f, 0.f, -1.f);
+
+	for (unsigned slice = 0; slice < slices; ++slice)
+		AddFace(pMesh, bottomCentre, bottomCentre + 1 + slice, bottomCentre + 1 + (slice + 1) % slices);
+
+	// Sides: stacks + 1 rings, bottom to top. The normals lean
+	// towards the narrow end.
+	size_t firstSide = pMesh->vertices.size();
+
+	float zNormal = length > 0.f ? (radius1 - radius2) / length : 0.f;
+	float normalScale = 1.f / sqrtf(1.f + zNormal * zNormal);
+
+	for (unsigned stack = 0; stack <= stacks; ++stack)
+	{
+		float t = stack / float(stacks);
+		float radius = radius1 + (radius2 - radius1) * t;
+
+		for (unsigned slice = 0; slice < slices; ++slice)
+		{
+			AddVertex(pMesh,
+				radius * cosTheta[slice], radius * sinTheta[slice], z + length * t,
+				cosTheta[slice] * normalScale, sinTheta[slice] * normalScale, zNormal * normalScale);
+		}
+	}
+
+	for (unsigned stack = 1; stack <= stacks; ++stack)
+	{
+		size_t below = firstSide + (stack - 1) * slices;
+		size_t above = firstSide + stack * slices;
+
+		for (unsigned slice = 0; slice < slices; ++slice)
+		{
+			unsigned next = (slice + 1) % slices;
+
+			AddFace(pMesh, below + slice, above + slice, below + next);
+			AddFace(pMesh, above + slice, above + next, below + next);
+		}
+	}
+
+	// Top cap: the rim, then the centre.
+	size_t topRim = pMesh->vertices.size();
+
+	z = length * .5f;
+
+	for (unsigned slice = 0; slice < slices; ++slice)
+		AddVertex(pMesh, radius2 * cosTheta[slice], radius2 * sinTheta[slice], z, 0.f, 0.f, 1.f);
+
+	size_t topCentre = pMesh->vertices.size();
+
+	AddVertex(pMesh, 0.f, 0.f, z, 0.f, 0.f, 1.f);
+
+	for (unsigned slice = 0; slice < slices; ++slice)
+		AddFace(pMesh, topCentre, topRim + (slice + 1) % slices, topRim + slice);
+
+	assert(pMesh->vertices.size() == numVertices);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool GenerateSphereMesh(float radius, unsigned slices, unsigned stacks, GeneratedMesh *pMesh)
+{
+	if (radius < 0.f || slices < 2 || stacks < 2)
+		return false;
+
+	size_t numVertices = 2 + size_t(slices) * (stacks - 1);
+	if (numVertices > MAX_NUM_VERTICES)
+		return false;
+
+	Reset(pMesh, numVertices, size_t(slices) * (stacks - 1) * 2);
+
+	std::vector<float> sinTheta, cosTheta;
+	GetAngleTable(slices, &sinTheta, &cosTheta);
+
+	// North pole, stacks - 1 rings going south, then the south pole.
+	AddVertex(pMesh, 0.f, 0.f, radius, 0.f, 0.f, 1.f);
+
+	for (unsigned ring = 0; ring < stacks - 1; ++ring)
+	{
+		float phi = (ring + 1) * PI / stacks;
+		float sinPhi = sinf(phi), cosPhi = cosf(phi);
+
+		for (unsigned slice = 0; slice < slices; ++slice)
+		{
+			float nx = sinPhi * cosTheta[slice];
+			float ny = sinPhi * sinTheta[slice];
+			float nz = cosPhi;
+
+			AddVertex(pMesh, nx * radius, ny * radius, nz * radius, nx, ny, nz);
+		}
+	}
+
+	size_t southPole = pMesh->vertices.size();
+
+	AddVertex(pMesh, 0.f, 0.f, -radius, 0.f, 0.f, -1.f);
+
+	// Fan around the north pole.
+	for (unsigned slice = 0; slice < slices; ++slice)
+		AddFace(pMesh, 0, 1 + (slice + 1) % slices, 1 + slice);
+
+	for (unsigned ring = 1; ring < stacks - 1; ++ring)
+	{
+		size_t above = 1 + (ring - 1) * slices;
+		size_t below = 1 + ring * slices;
+
+		for (unsigned slice = 0; slice < slices; ++slice)
+		{
+			unsigned next = (slice + 1) % slices;
+
+			AddFace(pMesh, above + slice, above + next, below + slice);
+			AddFace(pMesh, above + next, below + next, below + slice);
+		}
+	}
+
+	// Fan around the south pole.
+	size_t lastRing = 1 + (stacks - 2) * slices;
+
+	for (unsigned slice = 0; slice < slices; ++slice)
+		AddFace(pMesh, lastRing + slice, lastRing + (slice + 1) % slices, southPole);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool GenerateTorusMesh(float innerRadius, float outerRadius, unsigned sides, unsigned rings, GeneratedMesh *pMesh)
+{
+	if (innerRadius < 0.f || outerRadius < 0.f || sides < 3 || rings < 3)
+		return false;
+
+	size_t numVertices = size_t(sides) * rings;
+	if (numVertices > MAX_NUM_VERTICES)
+		return false;
+
+	Reset(pMesh, numVertices, numVertices * 2);
+
+	std::vector<float> sinPhi, cosPhi;
+	GetAngleTable(sides, &sinPhi, &cosPhi);
+
+	// Each ring is a cross-section of the tube. The rings go
+	// anticlockwise around the Z axis, starting at +X.
+	for (unsigned ring = 0; ring < rings; ++ring)
+	{
+		float theta = ring * 2.f * PI / rings;
+		float sinTheta = sinf(theta), cosTheta = cosf(theta);
+
+		for (unsigned side = 0; side < sides; ++side)
+		{
+			float r = innerRadius * cosPhi[side] + outerRadius;
+
+			AddVertex(pMesh,
+				r * cosTheta, r * sinTheta, innerRadius * sinPhi[side],
+				cosPhi[side] * cosTheta, cosPhi[side] * sinTheta, sinPhi[side]);
+		}
+	}
+
+	for (unsigned ring = 0; ring < rings; ++ring)
+	{
+		size_t current = size_t(ring) * sides;
+		size_t next = size_t((ring + 1) % rings) * sides;
+
+		for (unsigned side = 0; side < sides; ++side)
+		{
+			unsigned prevSide = (side + sides - 1) % sides;
+
+			AddFace(pMesh, current + side, next + side, current + prevSide);
+			AddFace(pMesh, current + prevSide, next + side, next + prevSide);
+		}
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,60 @@
+#ifndef HEADER_ADA265F7E3574686BD3BC7F916C93F3D
+#define HEADER_ADA265F7E3574686BD3BC7F916C93F3D
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Procedural mesh generators.
+//
+// These produce the same shapes as the D3DXCreateXXX functions -
+// same vertex counts, same vertex and face order, same winding, same
+// orientation - without needing a D3D9 device. Vertices have a
+// position and a normal, and the faces are an indexed triangle list
+// with 16-bit indices.
+//
+// Each returns false if the parameters are ones D3DX would reject, or
+// if the mesh would need more than 65536 vertices.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct GeneratedMeshVertex
+{
+	float pos[3];
+	float normal[3];
+};
+
+struct GeneratedMesh
+{
+	std::vector<GeneratedMeshVertex> vertices;
+	std::vector<uint16_t> indices;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Box centred on the origin.
+bool GenerateBoxMesh(float width, float height, float depth, GeneratedMesh *pMesh);
+
+// Cylinder along the Z axis, centred on the origin, with radius1 at
+// -Z and radius2 at +Z. Both ends are capped.
+bool GenerateCylinderMesh(float radius1, float radius2, float length, unsigned slices, unsigned stacks, GeneratedMesh *pMesh);
+
+// Sphere centred on the origin, with the poles on the Z axis.
+bool GenerateSphereMesh(float radius, unsigned slices, unsigned stacks, GeneratedMesh *pMesh);
+
+// Torus around the Z axis, centred on the origin. innerRadius is the
+// radius of the tube; outerRadius is the distance from the origin to
+// the middle of the tube.
+bool GenerateTorusMesh(float innerRadius, float outerRadius, unsigned sides, unsigned rings, GeneratedMesh *pMesh);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_ADA265F7E3574686BD3BC7F916C93F3D
@@ -0,0 +1,753 @@
+#include "OcclusionBuffer.h"
+
+#include "ParallelJobs.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_BUFFER_SSE2 1
+#include <emmintrin.h>
+#else
+#define OCCLUSION_BUFFER_SSE2 0
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Occluders are only clipped at the sides if they stick out more than
+// this many times the size of the screen, as SoftwareRasterizer does.
+static const float GUARD_BAND = 4.f;
+
+// Screen positions are snapped to 1/256th of a pixel.
+static const float SUBPIXELS = 256.f;
+
+// The near plane, then the guard band's left, right, bottom and top.
+// Depths beyond the far plane come out as 1, so it's only for culling.
+static const int NUM_CLIP_PLANES = 5;
+
+// Beyond those, the far plane, and outside the screen's left, right,
+// bottom and top; these are only for throwing triangles away without
+// setting them up.
+static const int NUM_CULL_PLANES = 10;
+static const unsigned CLIP_PLANES_MASK = (1u << NUM_CLIP_PLANES) - 1;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static double GetSecondsSince(const std::chrono::steady_clock::time_point &start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void TransformPoint(const float *pPos, const float *pMtx, float *pResult)
+{
+	for (int i = 0; i < 4; ++i)
+		pResult[i] = pPos[0] * pMtx[i] + pPos[1] * pMtx[4 + i] + pPos[2] * pMtx[8 + i] + pMtx[12 + i];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float GetClipDistance(const float *pPos, int plane)
+{
+	switch (plane)
+	{
+	case 0:
+		return pPos[2];
+
+	case 1:
+		return GUARD_BAND * pPos[3] + pPos[0];
+
+	case 2:
+		return GUARD_BAND * pPos[3] - pPos[0];
+
+	case 3:
+		return GUARD_BAND * pPos[3] + pPos[1];
+
+	case 4:
+		return GUARD_BAND * pPos[3] - pPos[1];
+
+	case 5:
+		return pPos[3] - pPos[2];
+
+	case 6:
+		return pPos[3] + pPos[0];
+
+	case 7:
+		return pPos[3] - pPos[0];
+
+	case 8:
+		return pPos[3] + pPos[1];
+
+	default:
+		return pPos[3] - pPos[1];
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Bit i is set if the point is outside plane i.
+static unsigned GetClipCodes(const float *pPos)
+{
+	unsigned codes = 0;
+
+	for (int i = 0; i < NUM_CULL_PLANES; ++i)
+	{
+		if (GetClipDistance(pPos, i) < 0.f)
+			codes |= 1u << i;
+	}
+
+	return codes;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+OcclusionBufferStats::OcclusionBufferStats():
+numFrames(0),
+numOccludersSubmitted(0),
+numOccludersDrawn(0),
+numBoxesTested(0),
+numBoxesOccluded(0),
+setupSeconds(0.),
+rasterSeconds(0.),
+testSeconds(0.)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+OcclusionBuffer::OcclusionBuffer():
+m_width(0),
+m_height(0),
+m_pitch(0),
+m_maxNumThreads(0),
+m_numTilesX(0),
+m_numTilesY(0)
+{
+	for (int i = 0; i < 16; ++i)
+		m_viewProj[i] = i % 5 == 0 ? 1.f : 0.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+OcclusionBuffer::~OcclusionBuffer()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool OcclusionBuffer::Create(int width, int height, unsigned maxNumThreads)
+{
+	this->Destroy();
+
+	if (width <= 0 || height <= 0)
+		return false;
+
+	m_width = width;
+	m_height = height;
+	m_pitch = (size_t(width) + 3) & ~size_t(3);
+	m_maxNumThreads = maxNumThreads;
+
+	m_depths.resize(m_pitch * height, 1.f);
+
+	m_numTilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	m_numTilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	m_bins.resize(size_t(m_numTilesX) * m_numTilesY);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void OcclusionBuffer::Destroy()
+{
+	m_width = 0;
+	m_height = 0;
+	m_pitch = 0;
+
+	m_depths.clear();
+
+	m_numTilesX = 0;
+	m_numTilesY = 0;
+	m_bins.clear();
+	m_triangles.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int OcclusionBuffer::GetWidth() const
+{
+	return m_width;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int OcclusionBuffer::GetHeight() const
+{
+	return m_height;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void OcclusionBuffer::Begin(const float *pViewProj)
+{
+	++m_stats.numFrames;
+
+	memcpy(m_viewProj, pViewProj, sizeof m_viewProj);
+
+	std::fill(m_depths.begin(), m_depths.end(), 1.f);
+
+	// In case the last lot were never drawn.
+	for (size_t i = 0; i < m_bins.size(); ++i)
+		m_bins[i].clear();
+
+	m_triangles.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void OcclusionBuffer::AddOccluders(const float *pPositions, size_t numVertices, const uint32_t *pIndices, size_t numTriangles)
+{
+	if (m_width <= 0 || numTriangles == 0)
+		return;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Each vertex is transformed once, however many triangles it's in.
+	m_clipVertices.resize(numVertices);
+
+	for (size_t i = 0; i < numVertices; ++i)
+	{
+		ClipVertex *pClipVertex = &m_clipVertices[i];
+
+		TransformPoint(pPositions + i * 3, m_viewProj, pClipVertex->pos);
+		pClipVertex->clipCodes = GetClipCodes(pClipVertex->pos);
+	}
+
+	for (size_t i = 0; i < numTriangles; ++i)
+	{
+		const uint32_t *pTriangle = pIndices + i * 3;
+		assert(pTriangle[0] < numVertices && pTriangle[1] < numVertices && pTriangle[2] < numVertices);
+
+		const ClipVertex *pV0 = &m_clipVertices[pTriangle[0]];
+		const ClipVertex *pV1 = &m_clipVertices[pTriangle[1]];
+		const ClipVertex *pV2 = &m_clipVertices[pTriangle[2]];
+
+		// All outside the same plane.
+		if (pV0->clipCodes & pV1->clipCodes & pV2->clipCodes)
+			continue;
+
+		unsigned clipCodes = (pV0->clipCodes | pV1->clipCodes | pV2->clipCodes) & CLIP_PLANES_MASK;
+
+		if (clipCodes == 0)
+		{
+			this->SetUpTriangle(pV0, pV1, pV2);
+		}
+		else
+		{
+			ClipVertex vertices[3] = {*pV0, *pV1, *pV2};
+			this->ClipTriangle(vertices, clipCodes);
+		}
+	}
+
+	m_stats.numOccludersSubmitted += numTriangles;
+	m_stats.setupSeconds += GetSecondsSince(start);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void OcclusionBuffer::Rasterize()
+{
+	if (m_triangles.empty())
+		return;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	m_busyTiles.clear();
+
+	for (size_t i = 0; i < m_bins.size(); ++i)
+	{
+		if (!m_bins[i].empty())
+			m_busyTiles.push_back(i);
+	}
+
+	// Tiles don't share any pixels, so there's nothing to lock.
+	RunParallelJobs(m_busyTiles.size(), m_maxNumThreads, [this](size_t i, std::string *) -> bool {
+		this->DrawTile(m_busyTiles[i]);
+		return true;
+	}, NULL);
+
+	for (size_t i = 0; i < m_busyTiles.size(); ++i)
+		m_bins[m_busyTiles[i]].clear();
+
+	m_triangles.clear();
+
+	m_stats.rasterSeconds += GetSecondsSince(start);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool OcclusionBuffer::IsBoxOccluded(const float *pToClip, const float *pMin, const float *pMax)
+{
+	if (m_width <= 0)
+		return false;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	++m_stats.numBoxesTested;
+
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float minDepth = FLT_MAX;
+	bool throughNearPlane = false;
+
+	for (int i = 0; i < 8 && !throughNearPlane; ++i)
+	{
+		float corner[3] = {
+			(i & 1) ? pMax[0] : pMin[0],
+			(i & 2) ? pMax[1] : pMin[1],
+			(i & 4) ? pMax[2] : pMin[2],
+		};
+
+		float pos[4];
+		TransformPoint(corner, pToClip, pos);
+
+		// A corner nearer than the near plane (or behind the camera).
+		if (!(pos[2] >= 0.f && pos[3] > 0.f))
+		{
+			throughNearPlane = true;
+			break;
+		}
+
+		float invW = 1.f / pos[3];
+
+		float x = (pos[0] * invW * .5f + .5f) * m_width;
+		float y = (.5f - pos[1] * invW * .5f) * m_height;
+
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+
+		// The box's nearest point is one of its corners.
+		minDepth = std::min(minDepth, pos[2] * invW);
+	}
+
+	bool occluded = false;
+
+	// Off the screen isn't hidden; that's for frustum culling.
+	if (!throughNearPlane && maxX >= 0.f && minX < float(m_width) && maxY >= 0.f && minY < float(m_height))
+	{
+		// Every pixel the box touches at all.
+		int rectMinX = int(std::max(minX, 0.f));
+		int rectMaxX = int(std::min(maxX, float(m_width - 1)));
+		int rectMinY = int(std::max(minY, 0.f));
+		int rectMaxY = int(std::min(maxY, float(m_height - 1)));
+
+		occluded = this->IsRectBehind(rectMinX, rectMinY, rectMaxX, rectMaxY, std::min(minDepth, 1.f));
+	}
+
+	if (occluded)
+		++m_stats.numBoxesOccluded;
+
+	m_stats.testSeconds += GetSecondsSince(start);
+
+	return occluded;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const float *OcclusionBuffer::GetDepths() const
+{
+	return m_depths.empty() ? NULL : &m_depths[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t OcclusionBuffer::GetPitch() const
+{
+	return m_pitch;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const OcclusionBufferStats &OcclusionBuffer::GetStats() const
+{
+	return m_stats;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void OcclusionBuffer::ResetStats()
+{
+	m_stats = OcclusionBufferStats();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void OcclusionBuffer::ClipTriangle(const ClipVertex *pVertices, unsigned clipCodes)
+{
+	// Each plane can add at most one vertex.
+	ClipVertex polygons[2][3 + NUM_CLIP_PLANES];
+	int numVertices = 3;
+	int current = 0;
+
+	for (int i = 0; i < 3; ++i)
+		polygons[current][i] = pVertices[i];
+
+	for (int plane = 0; plane < NUM_CLIP_PLANES; ++plane)
+	{
+		if (!(clipCodes & (1u << plane)))
+			continue;
+
+		const ClipVertex *pIn = polygons[current];
+		ClipVertex *pOut = polygons[current ^ 1];
+		int numOut = 0;
+
+		for (int i = 0; i < numVertices; ++i)
+		{
+			const ClipVertex *pA = &pIn[i];
+			const ClipVertex *pB = &pIn[(i + 1) % numVertices];
+
+			float distanceA = GetClipDistance(pA->pos, plane);
+			float distanceB = GetClipDistance(pB->pos, plane);
+
+			if (distanceA >= 0.f)
+				pOut[numOut++] = *pA;
+
+			if ((distanceA >= 0.f) != (distanceB >= 0.f))
+			{
+				// Always from the inside end, so an edge shared with
+				// another triangle is cut at exactly the same point.
+				const ClipVertex *pInside = distanceA >= 0.f ? pA : pB;
+				const ClipVertex *pOutside = distanceA >= 0.f ? pB : pA;
+				float distanceInside = distanceA >= 0.f ? distanceA : distanceB;
+				float distanceOutside = distanceA >= 0.f ? distanceB : distanceA;
+
+				float t = distanceInside / (distanceInside - distanceOutside);
+
+				ClipVertex *pNew = &pOut[numOut++];
+				pNew->clipCodes = 0;
+
+				for (int j = 0; j < 4; ++j)
+					pNew->pos[j] = pInside->pos[j] + t * (pOutside->pos[j] - pInside->pos[j]);
+			}
+		}
+
+		numVertices = numOut;
+		current ^= 1;
+
+		if (numVertices < 3)
+			return;
+	}
+
+	// A convex polygon, the same way round as the triangle was.
+	const ClipVertex *pPolygon = polygons[current];
+
+	for (int i = 1; i + 1 < numVertices; ++i)
+		this->SetUpTriangle(&pPolygon[0], &pPolygon[i], &pPolygon[i + 1]);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void OcclusionBuffer::SetUpTriangle(const ClipVertex *pV0, const ClipVertex *pV1, const ClipVertex *pV2)
+{
+	const ClipVertex *apVertices[3] = {pV0, pV1, pV2};
+
+	float xs[3], ys[3], depths[3];
+
+	for (int i = 0; i < 3; ++i)
+	{
+		const ClipVertex *pVertex = apVertices[i];
+
+		if (!(pVertex->pos[3] > 0.f))
+			return;
+
+		float invW = 1.f / pVertex->pos[3];
+
+		float x = (pVertex->pos[0] * invW * .5f + .5f) * m_width;
+		float y = (.5f - pVertex->pos[1] * invW * .5f) * m_height;
+
+		xs[i] = floorf(x * SUBPIXELS + .5f) / SUBPIXELS;
+		ys[i] = floorf(y * SUBPIXELS + .5f) / SUBPIXELS;
+
+		depths[i] = pVertex->pos[2] * invW;
+	}
+
+	// Positive if clockwise on the screen (y goes down), which is the
+	// front. Exact, as for SoftwareRasterizer.
+	double doubleArea = (double(xs[1]) - xs[0]) * (double(ys[2]) - ys[0]) - (double(xs[2]) - xs[0]) * (double(ys[1]) - ys[0]);
+
+	if (!(doubleArea > 0.))
+		return;
+
+	// Pixel (x, y)'s centre is at (x + .5, y + .5).
+	float minX = std::min(xs[0], std::min(xs[1], xs[2]));
+	float maxX = std::max(xs[0], std::max(xs[1], xs[2]));
+	float minY = std::min(ys[0], std::min(ys[1], ys[2]));
+	float maxY = std::max(ys[0], std::max(ys[1], ys[2]));
+
+	Triangle triangle;
+	triangle.minX = std::max(0, int(ceilf(minX - .5f)));
+	triangle.maxX = std::min(m_width - 1, int(floorf(maxX - .5f)));
+	triangle.minY = std::max(0, int(ceilf(minY - .5f)));
+	triangle.maxY = std::min(m_height - 1, int(floorf(maxY - .5f)));
+
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		int a = (i + 1) % 3;
+		int b = (i + 2) % 3;
+
+		// Worked out from the same end whichever triangle it's for, so
+		// neighbouring occluders leave no gaps between them.
+		if (xs[b] < xs[a] || (xs[b] == xs[a] && ys[b] < ys[a]))
+			std::swap(a, b);
+
+		double edgeA = double(ys[b]) - ys[a];
+		double edgeB = double(xs[a]) - xs[b];
+
+		if (edgeA * (double(xs[i]) - xs[a]) + edgeB * (double(ys[i]) - ys[a]) < 0.)
+		{
+			edgeA = -edgeA;
+			edgeB = -edgeB;
+		}
+
+		triangle.edgeA[i] = float(edgeA);
+		triangle.edgeB[i] = float(edgeB);
+		triangle.edgeX[i] = xs[a];
+		triangle.edgeY[i] = ys[a];
+
+		bool topLeft = edgeA > 0. || (edgeA == 0. && edgeB > 0.);
+		triangle.edgeBias[i] = topLeft ? -FLT_MIN : 0.f;
+	}
+
+	// The depth's a plane on the screen. Its furthest in a pixel is
+	// half a pixel's worth of each slope on from the centre.
+	double dx1 = double(xs[1]) - xs[0], dy1 = double(ys[1]) - ys[0], dDepth1 = double(depths[1]) - depths[0];
+	double dx2 = double(xs[2]) - xs[0], dy2 = double(ys[2]) - ys[0], dDepth2 = double(depths[2]) - depths[0];
+
+	double depthDX = (dDepth1 * dy2 - dDepth2 * dy1) / doubleArea;
+	double depthDY = (dx1 * dDepth2 - dx2 * dDepth1) / doubleArea;
+
+	triangle.depthAtOrigin = depths[0] + depthDX * (.5 - xs[0]) + depthDY * (.5 - ys[0]) + .5 * (fabs(depthDX) + fabs(depthDY));
+	triangle.depthDX = float(depthDX);
+	triangle.depthDY = float(depthDY);
+
+	uint32_t triangleIndex = uint32_t(m_triangles.size());
+	m_triangles.push_back(triangle);
+
+	++m_stats.numOccludersDrawn;
+
+	for (int tileY = triangle.minY / TILE_SIZE; tileY <= triangle.maxY / TILE_SIZE; ++tileY)
+	{
+		for (int tileX = triangle.minX / TILE_SIZE; tileX <= triangle.maxX / TILE_SIZE; ++tileX)
+			m_bins[size_t(tileY) * m_numTilesX + tileX].push_back(triangleIndex);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void OcclusionBuffer::DrawTile(size_t tileIndex)
+{
+	int tileX = int(tileIndex % m_numTilesX) * TILE_SIZE;
+	int tileY = int(tileIndex / m_numTilesX) * TILE_SIZE;
+
+	const std::vector<uint32_t> &bin = m_bins[tileIndex];
+
+	for (size_t i = 0; i < bin.size(); ++i)
+		this->DrawTriangleInTile(&m_triangles[bin[i]], tileX, tileY);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The SSE2 and plain versions do exactly the same sums, in the same
+// order, so they give exactly the same depths.
+void OcclusionBuffer::DrawTriangleInTile(const Triangle *pTriangle, int tileX, int tileY)
+{
+	int minX = std::max(pTriangle->minX, tileX);
+	int maxX = std::min(pTriangle->maxX, tileX + TILE_SIZE - 1);
+	int minY = std::max(pTriangle->minY, tileY);
+	int maxY = std::min(pTriangle->maxY, tileY + TILE_SIZE - 1);
+
+	// Relative to the tile's top left corner, as SoftwareRasterizer
+	// does.
+	float edgeCs[3];
+
+	for (int i = 0; i < 3; ++i)
+		edgeCs[i] = float(double(pTriangle->edgeA[i]) * (double(tileX) - pTriangle->edgeX[i]) + double(pTriangle->edgeB[i]) * (double(tileY) - pTriangle->edgeY[i]));
+
+	float depthC = float(pTriangle->depthAtOrigin + double(pTriangle->depthDX) * tileX + double(pTriangle->depthDY) * tileY);
+
+#if OCCLUSION_BUFFER_SSE2
+
+	__m128 edgeAs[3], edgeBiases[3];
+
+	for (int i = 0; i < 3; ++i)
+	{
+		edgeAs[i] = _mm_set1_ps(pTriangle->edgeA[i]);
+		edgeBiases[i] = _mm_set1_ps(pTriangle->edgeBias[i]);
+	}
+
+	const __m128 depthDX = _mm_set1_ps(pTriangle->depthDX);
+	const __m128 centres = _mm_setr_ps(.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 offsets = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i firstXs = _mm_set1_epi32(minX - 1);
+	const __m128i lastXs = _mm_set1_epi32(maxX + 1);
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		float v = float(y - tileY) + .5f;
+
+		__m128 rowEdges[3];
+
+		for (int i = 0; i < 3; ++i)
+			rowEdges[i] = _mm_set1_ps(pTriangle->edgeB[i] * v + edgeCs[i]);
+
+		__m128 rowDepth = _mm_set1_ps(pTriangle->depthDY * float(y - tileY) + depthC);
+
+		float *pDepths = &m_depths[y * m_pitch];
+
+		// The pitch is a multiple of 4, so there's always a whole 4.
+		for (int x = minX & ~3; x <= maxX; x += 4)
+		{
+			__m128 column = _mm_set1_ps(float(x - tileX));
+			__m128 u = _mm_add_ps(column, centres);
+
+			__m128 mask = _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(edgeAs[0], u), rowEdges[0]), edgeBiases[0]);
+			mask = _mm_and_ps(mask, _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(edgeAs[1], u), rowEdges[1]), edgeBiases[1]));
+			mask = _mm_and_ps(mask, _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(edgeAs[2], u), rowEdges[2]), edgeBiases[2]));
+
+			__m128i xs = _mm_add_epi32(_mm_set1_epi32(x), lanes);
+			__m128i inside = _mm_and_si128(_mm_cmpgt_epi32(xs, firstXs), _mm_cmplt_epi32(xs, lastXs));
+			mask = _mm_and_ps(mask, _mm_castsi128_ps(inside));
+
+			if (_mm_movemask_ps(mask) == 0)
+				continue;
+
+			__m128 depth = _mm_max_ps(_mm_add_ps(_mm_mul_ps(depthDX, _mm_add_ps(column, offsets)), rowDepth), zero);
+
+			__m128 oldDepths = _mm_loadu_ps(pDepths + x);
+			__m128 newDepths = _mm_min_ps(oldDepths, depth);
+			_mm_storeu_ps(pDepths + x, _mm_or_ps(_mm_and_ps(mask, newDepths), _mm_andnot_ps(mask, oldDepths)));
+		}
+	}
+
+#else
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		float v = float(y - tileY) + .5f;
+
+		float rowEdges[3];
+
+		for (int i = 0; i < 3; ++i)
+			rowEdges[i] = pTriangle->edgeB[i] * v + edgeCs[i];
+
+		float rowDepth = pTriangle->depthDY * float(y - tileY) + depthC;
+
+		float *pDepths = &m_depths[y * m_pitch];
+
+		for (int x = minX; x <= maxX; ++x)
+		{
+			float u = float(x - tileX) + .5f;
+
+			if (!(pTriangle->edgeA[0] * u + rowEdges[0] > pTriangle->edgeBias[0] &&
+				pTriangle->edgeA[1] * u + rowEdges[1] > pTriangle->edgeBias[1] &&
+				pTriangle->edgeA[2] * u + rowEdges[2] > pTriangle->edgeBias[2]))
+			{
+				continue;
+			}
+
+			float depth = std::max(pTriangle->depthDX * float(x - tileX) + rowDepth, 0.f);
+
+			pDepths[x] = std::min(pDepths[x], depth);
+		}
+	}
+
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// True if every depth in the rectangle (inclusive) is nearer than
+// depth.
+bool OcclusionBuffer::IsRectBehind(int minX, int minY, int maxX, int maxY, float depth) const
+{
+#if OCCLUSION_BUFFER_SSE2
+
+	const __m128 depths = _mm_set1_ps(depth);
+	const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i firstXs = _mm_set1_epi32(minX - 1);
+	const __m128i lastXs = _mm_set1_epi32(maxX + 1);
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		const float *pDepths = &m_depths[y * m_pitch];
+
+		for (int x = minX & ~3; x <= maxX; x += 4)
+		{
+			__m128 notNearer = _mm_cmpge_ps(_mm_loadu_ps(pDepths + x), depths);
+
+			__m128i xs = _mm_add_epi32(_mm_set1_epi32(x), lanes);
+			__m128i inside = _mm_and_si128(_mm_cmpgt_epi32(xs, firstXs), _mm_cmplt_epi32(xs, lastXs));
+
+			if (_mm_movemask_ps(_mm_and_ps(notNearer, _mm_castsi128_ps(inside))) != 0)
+				return false;
+		}
+	}
+
+#else
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		const float *pDepths = &m_depths[y * m_pitch];
+
+		for (int x = minX; x <= maxX; ++x)
+		{
+			if (!(pDepths[x] < depth))
+				return false;
+		}
+	}
+
+#endif
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,175 @@
+#ifndef HEADER_361AC406BA6D4771AFB31C55D9829477
+#define HEADER_361AC406BA6D4771AFB31C55D9829477
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// A small depth buffer, drawn on the CPU, for finding out what's
+// hidden before drawing it.
+//
+// Each frame, Begin with the view * projection matrix, add the
+// occluders - triangles that are solid, such as a simplified version
+// of the terrain that's everywhere below the real thing - Rasterize
+// them, then ask whether each thing's bounding box is hidden behind
+// them. Anything that is needn't be drawn.
+//
+// It only ever says a box is hidden if it is. Each pixel keeps the
+// furthest depth its occluders have anywhere in it, not just at the
+// centre, and a box is only hidden if its nearest corner is behind
+// every pixel it touches. Boxes that go through the near plane are
+// never hidden. (Which pixels an occluder covers is still decided by
+// their centres, as usual, so its outline can be half a pixel out;
+// occluders made a little smaller than the real thing, as they should
+// be anyway, make up for that.)
+//
+// Occluders are one sided: only those clockwise on the screen, which
+// is CommonApp's front, are drawn. Rasterizing is split into
+// TILE_SIZE pixel square tiles, one tile per job on worker threads
+// (see RunParallelJobs), 4 pixels at a time with SSE2, where it's
+// available. Box tests are done 4 pixels at a time too, on the calling
+// thread, and stop at the first pixel the box isn't behind.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct OcclusionBufferStats
+{
+	size_t numFrames;
+
+	// Triangles passed to AddOccluders, and those that survived culling
+	// and clipping (a clipped triangle may become several).
+	size_t numOccludersSubmitted;
+	size_t numOccludersDrawn;
+
+	size_t numBoxesTested;
+	size_t numBoxesOccluded;
+
+	// Time spent in AddOccluders, Rasterize and IsBoxOccluded.
+	double setupSeconds;
+	double rasterSeconds;
+	double testSeconds;
+
+	OcclusionBufferStats();
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class OcclusionBuffer
+{
+public:
+	static const int TILE_SIZE = 32;
+
+	OcclusionBuffer();
+	~OcclusionBuffer();
+
+	// maxNumThreads is as for RunParallelJobs; 0 is one per core.
+	bool Create(int width, int height, unsigned maxNumThreads);
+	void Destroy();
+
+	int GetWidth() const;
+	int GetHeight() const;
+
+	// Clears the depths to 1, and forgets the occluders. pViewProj is
+	// 16 floats, row by row, for row vectors (as XMFLOAT4X4), and
+	// places the occluders.
+	void Begin(const float *pViewProj);
+
+	// Triangles of world space positions, 3 floats each; each set of 3
+	// indices is a triangle.
+	void AddOccluders(const float *pPositions, size_t numVertices, const uint32_t *pIndices, size_t numTriangles);
+
+	// Draws the occluders added since Begin.
+	void Rasterize();
+
+	// True if the box from pMin to pMax (3 floats each) is entirely
+	// behind the occluders. pToClip takes the box's corners to clip
+	// space: the view * projection matrix for a box in world space, or
+	// the world * view * projection matrix for one in a mesh's space.
+	bool IsBoxOccluded(const float *pToClip, const float *pMin, const float *pMax);
+
+	// Row by row, GetPitch depths apart; for looking at what's there.
+	const float *GetDepths() const;
+	size_t GetPitch() const;
+
+	const OcclusionBufferStats &GetStats() const;
+	void ResetStats();
+protected:
+private:
+	// A vertex in clip space, and which planes it's outside.
+	struct ClipVertex
+	{
+		float pos[4];
+		unsigned clipCodes;
+	};
+
+	// A triangle ready to draw.
+	struct Triangle
+	{
+		// Pixels whose centres are in its bounding box, inclusive.
+		int minX, minY, maxX, maxY;
+
+		// Edge i is edgeA*(x - edgeX) + edgeB*(y - edgeY), which is > 0
+		// inside, or >= 0 for a top or left edge: > edgeBias, as for
+		// SoftwareRasterizer.
+		float edgeA[3];
+		float edgeB[3];
+		float edgeX[3];
+		float edgeY[3];
+		float edgeBias[3];
+
+		// The depth is depthAtOrigin + depthDX * x + depthDY * y, the
+		// furthest it gets in the pixel around (x, y).
+		double depthAtOrigin;
+		float depthDX;
+		float depthDY;
+	};
+
+	int m_width;
+	int m_height;
+	size_t m_pitch;
+	unsigned m_maxNumThreads;
+
+	std::vector<float> m_depths;
+
+	int m_numTilesX;
+	int m_numTilesY;
+
+	// Indexes into m_triangles, one list per tile.
+	std::vector<std::vector<uint32_t> > m_bins;
+	std::vector<Triangle> m_triangles;
+
+	// Scratch space for AddOccluders and Rasterize.
+	std::vector<ClipVertex> m_clipVertices;
+	std::vector<size_t> m_busyTiles;
+
+	float m_viewProj[16];
+
+	OcclusionBufferStats m_stats;
+
+	void ClipTriangle(const ClipVertex *pVertices, unsigned clipCodes);
+	void SetUpTriangle(const ClipVertex *pV0, const ClipVertex *pV1, const ClipVertex *pV2);
+
+	void DrawTile(size_t tileIndex);
+	void DrawTriangleInTile(const Triangle *pTriangle, int tileX, int tileY);
+
+	bool IsRectBehind(int minX, int minY, int maxX, int maxY, float depth) const;
+
+	OcclusionBuffer(const OcclusionBuffer &);
+	OcclusionBuffer &operator=(const OcclusionBuffer &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_361AC406BA6D4771AFB31C55D9829477
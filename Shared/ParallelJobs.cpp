@@ -0,0 +1,65 @@
+#include "ParallelJobs.h"
+
+#include <atomic>
+#include <thread>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void RunJobsFromCounter(std::atomic<size_t> *pNextJob, std::atomic<size_t> *pNumFailed, size_t numJobs, const ParallelJobFn &job, std::string *pMessages)
+{
+	for (;;)
+	{
+		size_t jobIndex = pNextJob->fetch_add(1);
+		if (jobIndex >= numJobs)
+			break;
+
+		if (!job(jobIndex, &pMessages[jobIndex]))
+			pNumFailed->fetch_add(1);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t RunParallelJobs(size_t numJobs, unsigned maxNumThreads, const ParallelJobFn &job, std::vector<std::string> *pMessages)
+{
+	std::vector<std::string> localMessages;
+	if (!pMessages)
+		pMessages = &localMessages;
+
+	pMessages->clear();
+	pMessages->resize(numJobs);
+
+	if (numJobs == 0)
+		return 0;
+
+	if (maxNumThreads == 0)
+	{
+		maxNumThreads = std::thread::hardware_concurrency();
+
+		if (maxNumThreads == 0)
+			maxNumThreads = 1;// unknown
+	}
+
+	size_t numThreads = maxNumThreads < numJobs ? maxNumThreads : numJobs;
+
+	std::atomic<size_t> nextJob(0);
+	std::atomic<size_t> numFailed(0);
+
+	// The calling thread is one of the workers.
+	std::vector<std::thread> threads;
+
+	for (size_t i = 1; i < numThreads; ++i)
+		threads.push_back(std::thread(RunJobsFromCounter, &nextJob, &numFailed, numJobs, std::cref(job), &(*pMessages)[0]));
+
+	RunJobsFromCounter(&nextJob, &numFailed, numJobs, job, &(*pMessages)[0]);
+
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+
+	return numFailed;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,45 @@
+#ifndef HEADER_D655E5321FE540DD9CBE0488676C5F99
+#define HEADER_D655E5321FE540DD9CBE0488676C5F99
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Run a batch of independent jobs on worker threads.
+//
+// Jobs are handed out in order from a shared counter, so a slow job
+// doesn't hold up the others. Each job has its own message slot and
+// writes its own results, so everything comes back in job order
+// however the jobs happened to finish.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Returns true on success. Anything worth printing goes in
+// *pMessages; the job must not print it itself, or the output from
+// different jobs gets mixed up.
+typedef std::function<bool(size_t jobIndex, std::string *pMessages)> ParallelJobFn;
+
+// Runs job(i) for each i in [0, numJobs), on up to maxNumThreads
+// threads (0 means one per hardware thread), including the calling
+// thread. Returns when every job has finished.
+//
+// (*pMessages)[i] gets job i's messages. pMessages may be NULL.
+//
+// Returns the number of jobs that failed.
+size_t RunParallelJobs(size_t numJobs, unsigned maxNumThreads, const ParallelJobFn &job, std::vector<std::string> *pMessages);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_D655E5321FE540DD9CBE0488676C5F99
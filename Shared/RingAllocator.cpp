@@ -0,0 +1,218 @@
+#include "RingAllocator.h"
+
+#include <assert.h>
+
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+RingAllocatorStats::RingAllocatorStats():
+numAllocations(0),
+numBytesAllocated(0),
+numFailed(0),
+numBytesWasted(0),
+maxNumBytesUsed(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+RingAllocator::RingAllocator():
+m_size(0),
+m_head(0),
+m_tail(0),
+m_numBytesUsed(0),
+m_frameNumBytes(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+RingAllocator::~RingAllocator()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool RingAllocator::Create(size_t size)
+{
+	this->Destroy();
+
+	if (size == 0)
+		return false;
+
+	m_size = size;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void RingAllocator::Destroy()
+{
+	m_size = 0;
+	m_head = 0;
+	m_tail = 0;
+	m_numBytesUsed = 0;
+	m_frameNumBytes = 0;
+
+	m_frames.clear();
+
+	m_stats = RingAllocatorStats();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool RingAllocator::Allocate(size_t numBytes, size_t alignment, size_t *pOffset)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	// Nothing's in use, so start again from the start, rather than
+	// wrapping round part way through.
+	if (m_numBytesUsed == 0)
+	{
+		m_head = 0;
+		m_tail = 0;
+	}
+
+	size_t offset = (m_head + alignment - 1) & ~(alignment - 1);
+	size_t end = offset + numBytes;
+	bool wrapsRound = false;
+
+	// Free space runs from the head to the end of the ring, then from
+	// the start to the tail, or, if the head's caught up with the
+	// tail, from the head to the tail.
+	bool isWrapped = m_head < m_tail || (m_numBytesUsed > 0 && m_head == m_tail);
+
+	if (numBytes == 0 || numBytes > m_size)
+		offset = m_size;
+	else if (isWrapped)
+	{
+		if (end > m_tail)
+			offset = m_size;
+	}
+	else if (end > m_size)
+	{
+		// Skip the rest of the ring, and go from the start.
+		offset = 0;
+		end = numBytes;
+		wrapsRound = true;
+
+		if (end > m_tail)
+			offset = m_size;
+	}
+
+	if (offset == m_size)
+	{
+		++m_stats.numFailed;
+		return false;
+	}
+
+	// Measured round from the head, so it includes anything skipped.
+	size_t numBytesUsed = wrapsRound ? m_size - m_head + end : end - m_head;
+
+	m_head = end == m_size ? 0 : end;
+	m_numBytesUsed += numBytesUsed;
+	m_frameNumBytes += numBytesUsed;
+
+	assert(m_numBytesUsed <= m_size);
+
+	++m_stats.numAllocations;
+	m_stats.numBytesAllocated += numBytes;
+	m_stats.numBytesWasted += numBytesUsed - numBytes;
+	m_stats.maxNumBytesUsed = std::max(m_stats.maxNumBytesUsed, m_numBytesUsed);
+
+	*pOffset = offset;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void RingAllocator::EndFrame(uint64_t fence)
+{
+	assert(m_frames.empty() || fence > m_frames.back().fence);
+
+	Frame frame;
+
+	frame.fence = fence;
+	frame.end = m_head;
+	frame.numBytes = m_frameNumBytes;
+
+	m_frames.push_back(frame);
+
+	m_frameNumBytes = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void RingAllocator::Retire(uint64_t completedFence)
+{
+	while (!m_frames.empty() && m_frames.front().fence <= completedFence)
+	{
+		const Frame &frame = m_frames.front();
+
+		// A frame that allocated nothing may have ended before the ring
+		// started again from the start, so its end means nothing.
+		if (frame.numBytes > 0)
+			m_tail = frame.end;
+
+		m_numBytesUsed -= frame.numBytes;
+
+		m_frames.pop_front();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t RingAllocator::GetSize() const
+{
+	return m_size;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t RingAllocator::GetNumBytesUsed() const
+{
+	return m_numBytesUsed;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t RingAllocator::GetNumFramesInFlight() const
+{
+	return m_frames.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+uint64_t RingAllocator::GetOldestFence() const
+{
+	assert(!m_frames.empty());
+
+	return m_frames.front().fence;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const RingAllocatorStats &RingAllocator::GetStats() const
+{
+	return m_stats;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,127 @@
+#ifndef HEADER_4B6F03EE4A624E02A9B68865DF08EB52
+#define HEADER_4B6F03EE4A624E02A9B68865DF08EB52
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Keeps track of which parts of a fixed size ring of bytes are in use,
+// for handing out space that's only needed until the GPU's done with
+// it (see UploadRing).
+//
+// Space is handed out from the head of the ring, wrapping round to the
+// start when it gets to the end. Everything handed out between one
+// EndFrame and the next belongs to that frame, which is tagged with a
+// fence value. Once that fence has passed, Retire gives the frame's
+// space back, so space is freed in the order it was handed out and
+// the free part of the ring is always in one piece.
+//
+// Fence values are whatever the caller wants, as long as each frame's
+// is bigger than the last.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct RingAllocatorStats
+{
+	size_t numAllocations;
+	size_t numBytesAllocated;
+
+	// Allocations that didn't fit.
+	size_t numFailed;
+
+	// Space skipped to align allocations, or left at the end of the
+	// ring when wrapping round.
+	size_t numBytesWasted;
+
+	// The most the ring has had in use at once.
+	size_t maxNumBytesUsed;
+
+	RingAllocatorStats();
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class RingAllocator
+{
+public:
+	RingAllocator();
+	~RingAllocator();
+
+	bool Create(size_t size);
+	void Destroy();
+
+	// Finds numBytes, at a multiple of alignment (a power of 2) from the
+	// start of the ring. Returns false if there isn't room until older
+	// frames are retired.
+	bool Allocate(size_t numBytes, size_t alignment, size_t *pOffset);
+
+	// Everything allocated since the last EndFrame is in use until
+	// fence has passed.
+	void EndFrame(uint64_t fence);
+
+	// Frees the space of every frame whose fence is at most
+	// completedFence.
+	void Retire(uint64_t completedFence);
+
+	size_t GetSize() const;
+
+	// Including anything wasted.
+	size_t GetNumBytesUsed() const;
+
+	// Frames ended but not retired. GetOldestFence is only valid if
+	// there are any.
+	size_t GetNumFramesInFlight() const;
+	uint64_t GetOldestFence() const;
+
+	const RingAllocatorStats &GetStats() const;
+protected:
+private:
+	struct Frame
+	{
+		uint64_t fence;
+
+		// The head of the ring when the frame ended, which is where the
+		// next frame's space starts.
+		size_t end;
+
+		// Including anything wasted.
+		size_t numBytes;
+	};
+
+	size_t m_size;
+
+	// Where the next allocation goes from, and where the oldest space
+	// in use starts. They're the same when the ring is empty, and when
+	// it's full.
+	size_t m_head;
+	size_t m_tail;
+
+	size_t m_numBytesUsed;
+
+	// Used by the frame that's not ended yet.
+	size_t m_frameNumBytes;
+
+	// Oldest first.
+	std::deque<Frame> m_frames;
+
+	RingAllocatorStats m_stats;
+
+	RingAllocator(const RingAllocator &);
+	RingAllocator &operator=(const RingAllocator &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_4B6F03EE4A624E02A9B68865DF08EB52
@@ -0,0 +1,433 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#include "ShaderCache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static const char MAGIC[4] = {'C', 'S', 'H', 'D'};
+
+// Bump this if the entry layout changes.
+static const uint32_t VERSION = 1;
+
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+static const uint64_t FNV_PRIME = 1099511628211ull;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct EntryHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t bytecodeSize;
+	uint32_t reflectionSize;
+
+	// FNV-1a of everything after the header, to catch damaged files.
+	uint64_t checksum;
+};
+
+static_assert(sizeof(EntryHeader) == 32, "EntryHeader layout");
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static uint64_t HashBytes(uint64_t hash, const void *pData, size_t sizeBytes)
+{
+	const uint8_t *p = static_cast<const uint8_t *>(pData);
+
+	for (size_t i = 0; i < sizeBytes; ++i)
+	{
+		hash ^= p[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+ShaderCacheKey::ShaderCacheKey():
+m_hash(FNV_OFFSET_BASIS)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void ShaderCacheKey::AddData(const void *pData, size_t sizeBytes)
+{
+	uint64_t size64 = sizeBytes;
+
+	this->AddBytes(&size64, sizeof size64);
+	this->AddBytes(pData, sizeBytes);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void ShaderCacheKey::AddString(const char *pStr)
+{
+	if (pStr)
+	{
+		this->AddData(pStr, strlen(pStr));
+	}
+	else
+	{
+		// No string has this length.
+		uint64_t size64 = ~uint64_t(0);
+		this->AddBytes(&size64, sizeof size64);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void ShaderCacheKey::AddUInt32(uint32_t value)
+{
+	this->AddBytes(&value, sizeof value);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+uint64_t ShaderCacheKey::GetKey() const
+{
+	return m_hash;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void ShaderCacheKey::AddBytes(const void *pData, size_t sizeBytes)
+{
+	m_hash = HashBytes(m_hash, pData, sizeBytes);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+ShaderCache::ShaderCache():
+m_quit(false),
+m_numHits(0),
+m_numMisses(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+ShaderCache::~ShaderCache()
+{
+	if (m_writerThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+
+		m_workCV.notify_one();
+		m_writerThread.join();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderCache::SetDirectory(const char *pDirectory)
+{
+	this->Flush();
+
+#ifdef _WIN32
+	int result = _mkdir(pDirectory);
+#else
+	int result = mkdir(pDirectory, 0777);
+#endif
+
+	if (result != 0 && errno != EEXIST)
+	{
+		m_directory.clear();
+		return false;
+	}
+
+	m_directory = pDirectory;
+
+	if (!m_directory.empty() && m_directory[m_directory.size() - 1] != '/' && m_directory[m_directory.size() - 1] != '\\')
+		m_directory += '/';
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderCache::Find(uint64_t key, std::vector<char> *pBytecode, std::vector<char> *pReflection)
+{
+	if (m_directory.empty())
+		return false;
+
+	bool found = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (size_t i = 0; i < m_pending.size(); ++i)
+		{
+			if (m_pending[i].key == key)
+			{
+				found = ParseEntry(m_pending[i].data, key, pBytecode, pReflection);
+				break;
+			}
+		}
+	}
+
+	if (!found)
+	{
+		std::vector<char> data;
+
+		if (FILE *pFile = fopen(this->GetEntryFileName(key).c_str(), "rb"))
+		{
+			if (fseek(pFile, 0, SEEK_END) == 0)
+			{
+				long size = ftell(pFile);
+
+				if (size > 0 && fseek(pFile, 0, SEEK_SET) == 0)
+				{
+					data.resize(size_t(size));
+
+					if (fread(&data[0], 1, data.size(), pFile) != data.size())
+						data.clear();
+				}
+			}
+
+			fclose(pFile);
+		}
+
+		found = ParseEntry(data, key, pBytecode, pReflection);
+	}
+
+	if (found)
+		++m_numHits;
+	else
+		++m_numMisses;
+
+	return found;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void ShaderCache::Store(uint64_t key, const void *pBytecode, size_t bytecodeSize, const void *pReflection, size_t reflectionSize)
+{
+	if (m_directory.empty())
+		return;
+
+	if (bytecodeSize > UINT32_MAX || reflectionSize > UINT32_MAX)
+		return;
+
+	std::vector<char> data;
+	BuildEntry(&data, key, pBytecode, bytecodeSize, pReflection, reflectionSize);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_pending.push_back(PendingEntry());
+		m_pending.back().key = key;
+		m_pending.back().data.swap(data);
+
+		// Started on demand, so a cache that's all hits never needs
+		// a thread.
+		if (!m_writerThread.joinable())
+			m_writerThread = std::thread(&ShaderCache::WriterThreadMain, this);
+	}
+
+	m_workCV.notify_one();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void ShaderCache::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (!m_pending.empty())
+		m_idleCV.wait(lock);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+unsigned ShaderCache::GetNumHits() const
+{
+	return m_numHits;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+unsigned ShaderCache::GetNumMisses() const
+{
+	return m_numMisses;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+std::string ShaderCache::GetEntryFileName(uint64_t key) const
+{
+	char name[100];
+	snprintf(name, sizeof name, "%08x%08x.cso", unsigned(key >> 32), unsigned(key));
+
+	return m_directory + name;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void ShaderCache::WriterThreadMain()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for (;;)
+	{
+		while (m_pending.empty() && !m_quit)
+			m_workCV.wait(lock);
+
+		// Anything still pending on quit gets written first, so
+		// nothing stored is lost.
+		if (m_pending.empty())
+			break;
+
+		std::string fileName = this->GetEntryFileName(m_pending.front().key);
+
+		// Nothing else touches the front entry's data, so it's safe to
+		// write it out unlocked.
+		const std::vector<char> *pData = &m_pending.front().data;
+
+		lock.unlock();
+
+		if (!WriteFile(fileName, *pData))
+		{
+			// Not fatal. It'll be compiled again next time.
+		}
+
+		lock.lock();
+
+		m_pending.pop_front();
+
+		if (m_pending.empty())
+			m_idleCV.notify_all();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void ShaderCache::BuildEntry(std::vector<char> *pData, uint64_t key, const void *pBytecode, size_t bytecodeSize, const void *pReflection, size_t reflectionSize)
+{
+	pData->resize(sizeof(EntryHeader) + bytecodeSize + reflectionSize);
+
+	char *pPayload = &(*pData)[sizeof(EntryHeader)];
+
+	if (bytecodeSize > 0)
+		memcpy(pPayload, pBytecode, bytecodeSize);
+
+	if (reflectionSize > 0)
+		memcpy(pPayload + bytecodeSize, pReflection, reflectionSize);
+
+	EntryHeader header;
+
+	memcpy(header.magic, MAGIC, sizeof MAGIC);
+	header.version = VERSION;
+	header.key = key;
+	header.bytecodeSize = uint32_t(bytecodeSize);
+	header.reflectionSize = uint32_t(reflectionSize);
+	header.checksum = HashBytes(FNV_OFFSET_BASIS, pPayload, bytecodeSize + reflectionSize);
+
+	memcpy(&(*pData)[0], &header, sizeof header);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderCache::ParseEntry(const std::vector<char> &data, uint64_t key, std::vector<char> *pBytecode, std::vector<char> *pReflection)
+{
+	if (data.size() < sizeof(EntryHeader))
+		return false;
+
+	EntryHeader header;
+	memcpy(&header, &data[0], sizeof header);
+
+	if (memcmp(header.magic, MAGIC, sizeof MAGIC) != 0)
+		return false;
+
+	if (header.version != VERSION)
+		return false;
+
+	// The file name comes from the key, so this only fails if the file
+	// was renamed or damaged.
+	if (header.key != key)
+		return false;
+
+	size_t payloadSize = size_t(header.bytecodeSize) + header.reflectionSize;
+
+	if (data.size() - sizeof(EntryHeader) != payloadSize)
+		return false;
+
+	const char *pPayload = &data[0] + sizeof(EntryHeader);
+
+	if (HashBytes(FNV_OFFSET_BASIS, pPayload, payloadSize) != header.checksum)
+		return false;
+
+	pBytecode->assign(pPayload, pPayload + header.bytecodeSize);
+	pReflection->assign(pPayload + header.bytecodeSize, pPayload + payloadSize);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderCache::WriteFile(const std::string &fileName, const std::vector<char> &data)
+{
+	// Write to a temp file and rename, so a crash halfway through
+	// doesn't leave a truncated entry behind.
+	std::string tmpFileName = fileName + ".tmp";
+
+	FILE *pFile = fopen(tmpFileName.c_str(), "wb");
+	if (!pFile)
+		return false;
+
+	bool good = fwrite(&data[0], 1, data.size(), pFile) == data.size();
+
+	if (fclose(pFile) != 0)
+		good = false;
+
+	if (good)
+	{
+		remove(fileName.c_str());
+		good = rename(tmpFileName.c_str(), fileName.c_str()) == 0;
+	}
+
+	if (!good)
+		remove(tmpFileName.c_str());
+
+	return good;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,163 @@
+#ifndef HEADER_D998E4AB061E4B83B49C0A277A058574
+#define HEADER_D998E4AB061E4B83B49C0A277A058574
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// On-disk cache of compiled shaders.
+//
+// Each entry is the compiled bytecode plus the serialised reflection
+// data (see ShaderDescription::Serialise), stored in its own file
+// named after a 64-bit key. The key is a hash of everything that
+// affects the compiler output - source, macros, entry point, profile,
+// flags - built up with ShaderCacheKey. Change any of it and the key
+// changes, so stale entries are never found; they just sit there
+// until the cache directory is deleted.
+//
+// Entries are written on a background thread, so a cache miss costs
+// no more than the compile itself. Find also checks the entries still
+// waiting to be written.
+//
+// There's no D3D in here.
+//
+// Entry layout:
+//
+//     Header
+//     bytecode
+//     reflection data
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// 64-bit FNV-1a. Each item is hashed along with its length, so
+// ("ab", "c") and ("a", "bc") give different keys.
+class ShaderCacheKey
+{
+public:
+	ShaderCacheKey();
+
+	void AddData(const void *pData, size_t sizeBytes);
+
+	// NULL is distinct from "".
+	void AddString(const char *pStr);
+
+	void AddUInt32(uint32_t value);
+
+	uint64_t GetKey() const;
+protected:
+private:
+	uint64_t m_hash;
+
+	void AddBytes(const void *pData, size_t sizeBytes);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The key for a shader compile. pMacros is terminated by one with a
+// NULL Name, like D3D_SHADER_MACRO, which is what MacroType is
+// expected to be. The compiler version goes in too, so a new compiler
+// doesn't pick up the old one's output.
+template<class MacroType>
+uint64_t GetShaderCacheKey(uint32_t compilerVersion, uint32_t flags, const char *pShaderSource, const MacroType *pMacros, const char *pEntryPoint, const char *pProfileName)
+{
+	ShaderCacheKey key;
+
+	key.AddUInt32(compilerVersion);
+	key.AddUInt32(flags);
+
+	key.AddString(pShaderSource);
+
+	for (const MacroType *pMacro = pMacros; pMacro && pMacro->Name; ++pMacro)
+	{
+		key.AddString(pMacro->Name);
+		key.AddString(pMacro->Definition);
+	}
+
+	// Marks the end of the macros.
+	key.AddString(NULL);
+
+	key.AddString(pEntryPoint);
+	key.AddString(pProfileName);
+
+	return key.GetKey();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class ShaderCache
+{
+public:
+	ShaderCache();
+	~ShaderCache();
+
+	// Creates the directory if it doesn't exist. Until this succeeds,
+	// Find finds nothing and Store does nothing.
+	bool SetDirectory(const char *pDirectory);
+
+	// Returns false if there's no entry, or if it's damaged.
+	bool Find(uint64_t key, std::vector<char> *pBytecode, std::vector<char> *pReflection);
+
+	// The data is copied, and written out later.
+	void Store(uint64_t key, const void *pBytecode, size_t bytecodeSize, const void *pReflection, size_t reflectionSize);
+
+	// Wait for all stored entries to be written.
+	void Flush();
+
+	unsigned GetNumHits() const;
+	unsigned GetNumMisses() const;
+protected:
+private:
+	struct PendingEntry
+	{
+		uint64_t key;
+		std::vector<char> data;
+	};
+
+	std::string m_directory;
+
+	std::mutex m_mutex;
+	std::condition_variable m_workCV;
+	std::condition_variable m_idleCV;
+
+	// Guarded by m_mutex. The front entry stays in the queue while
+	// it's being written, so Find can still see it.
+	std::deque<PendingEntry> m_pending;
+	bool m_quit;
+
+	std::thread m_writerThread;
+
+	// Atomic, so the getters don't need the lock.
+	std::atomic<unsigned> m_numHits;
+	std::atomic<unsigned> m_numMisses;
+
+	std::string GetEntryFileName(uint64_t key) const;
+	void WriterThreadMain();
+
+	static void BuildEntry(std::vector<char> *pData, uint64_t key, const void *pBytecode, size_t bytecodeSize, const void *pReflection, size_t reflectionSize);
+	static bool ParseEntry(const std::vector<char> &data, uint64_t key, std::vector<char> *pBytecode, std::vector<char> *pReflection);
+	static bool WriteFile(const std::string &fileName, const std::vector<char> &data);
+
+	ShaderCache(const ShaderCache &);
+	ShaderCache &operator=(const ShaderCache &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_D998E4AB061E4B83B49C0A277A058574
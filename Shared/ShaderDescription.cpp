@@ -0,0 +1,330 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "ShaderDescription.h"
+
+#include <string.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static const char SHADER_DESCRIPTION_MAGIC[4] = {'S', 'D', 'S', 'C'};
+static const uint32_t SHADER_DESCRIPTION_VERSION = 1;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// FNV-1a over the name, with the scope folded in at the end.
+static uint32_t HashThingName(int scope, const char *pName)
+{
+	uint32_t hash = 2166136261u;
+
+	for (const char *p = pName; *p; ++p)
+	{
+		hash ^= uint8_t(*p);
+		hash *= 16777619u;
+	}
+
+	hash ^= uint32_t(scope);
+	hash *= 16777619u;
+
+	return hash;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+ShaderDescription::ShaderDescription()
+{
+	this->Clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+ShaderDescription::~ShaderDescription()
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Layout:
+//
+//     char magic[4]
+//     uint32_t version
+//     uint32_t numThings
+//     uint32_t namesSize
+//     uint32_t cbufferSizes[NUM_CBUFFER_SLOTS]
+//     Thing things[numThings]
+//     char names[namesSize]
+void ShaderDescription::Serialise(std::vector<char> *pData) const
+{
+	uint32_t header[3];
+	header[0] = SHADER_DESCRIPTION_VERSION;
+	header[1] = uint32_t(m_things.size());
+	header[2] = uint32_t(m_names.size());
+
+	size_t thingsSize = m_things.size() * sizeof(Thing);
+	size_t cbufferSizesSize = NUM_CBUFFER_SLOTS * sizeof(uint32_t);
+
+	pData->resize(sizeof SHADER_DESCRIPTION_MAGIC + sizeof header + cbufferSizesSize + thingsSize + m_names.size());
+
+	char *pDest = &(*pData)[0];
+
+	memcpy(pDest, SHADER_DESCRIPTION_MAGIC, sizeof SHADER_DESCRIPTION_MAGIC);
+	pDest += sizeof SHADER_DESCRIPTION_MAGIC;
+
+	memcpy(pDest, header, sizeof header);
+	pDest += sizeof header;
+
+	memcpy(pDest, &m_cbufferSizes[0], cbufferSizesSize);
+	pDest += cbufferSizesSize;
+
+	if (thingsSize > 0)
+		memcpy(pDest, &m_things[0], thingsSize);
+	pDest += thingsSize;
+
+	if (!m_names.empty())
+		memcpy(pDest, &m_names[0], m_names.size());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderDescription::Deserialise(const void *pData, size_t sizeBytes)
+{
+	this->Clear();
+
+	const char *pSrc = static_cast<const char *>(pData);
+	const char *pEnd = pSrc + sizeBytes;
+
+	uint32_t header[3];
+	size_t cbufferSizesSize = NUM_CBUFFER_SLOTS * sizeof(uint32_t);
+
+	if (sizeBytes < sizeof SHADER_DESCRIPTION_MAGIC + sizeof header + cbufferSizesSize)
+		return false;
+
+	if (memcmp(pSrc, SHADER_DESCRIPTION_MAGIC, sizeof SHADER_DESCRIPTION_MAGIC) != 0)
+		return false;
+	pSrc += sizeof SHADER_DESCRIPTION_MAGIC;
+
+	memcpy(header, pSrc, sizeof header);
+	pSrc += sizeof header;
+
+	if (header[0] != SHADER_DESCRIPTION_VERSION)
+		return false;
+
+	uint32_t numThings = header[1];
+	uint32_t namesSize = header[2];
+
+	size_t sizeLeft = size_t(pEnd - pSrc) - cbufferSizesSize;
+
+	if (numThings > sizeLeft / sizeof(Thing) || namesSize > sizeLeft - numThings * sizeof(Thing))
+		return false;
+
+	memcpy(&m_cbufferSizes[0], pSrc, cbufferSizesSize);
+	pSrc += cbufferSizesSize;
+
+	m_things.resize(numThings);
+	if (numThings > 0)
+		memcpy(&m_things[0], pSrc, numThings * sizeof(Thing));
+	pSrc += numThings * sizeof(Thing);
+
+	m_names.assign(pSrc, pSrc + namesSize);
+
+	// Don't trust anything in there.
+	bool good = namesSize == 0 || m_names.back() == 0;
+
+	for (size_t i = 0; i < m_things.size() && good; ++i)
+	{
+		const Thing *pThing = &m_things[i];
+
+		if (pThing->nameOffset >= namesSize || pThing->scope < 0 || pThing->scope >= NUM_SCOPES)
+			good = false;
+		else if (pThing->hash != HashThingName(pThing->scope, &m_names[pThing->nameOffset]))
+			good = false;
+	}
+
+	if (!good)
+	{
+		this->Clear();
+		return false;
+	}
+
+	this->BuildHashTable();
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t ShaderDescription::GetCBufferSizeBytes(int cbufferSlot) const
+{
+	if (cbufferSlot < 0 || cbufferSlot >= NUM_CBUFFER_SLOTS)
+		return 0;
+
+	return m_cbufferSizes[cbufferSlot];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderDescription::FindCBuffer(const char *pName,int *pSlot) const
+{
+	return this->FindThing(SCOPE_CBUFFERS, pName, TT_CBUFFER, pSlot);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderDescription::FindFloat4x4(int cbufferSlot, const char *pName, int *pPackOffset) const
+{
+	return this->FindThing(cbufferSlot, pName, TT_FLOAT4x4, pPackOffset);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderDescription::FindFloat4(int cbufferSlot, const char *pName, int *pPackOffset) const
+{
+	return this->FindThing(cbufferSlot, pName, TT_FLOAT4, pPackOffset);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderDescription::FindFloat3(int cbufferSlot, const char *pName, int *pPackOffset) const
+{
+	return this->FindThing(cbufferSlot, pName, TT_FLOAT3, pPackOffset);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderDescription::FindFloat2(int cbufferSlot, const char *pName, int *pPackOffset) const
+{
+	return this->FindThing(cbufferSlot, pName, TT_FLOAT2, pPackOffset);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderDescription::FindFloat(int cbufferSlot, const char *pName, int *pPackOffset) const
+{
+	return this->FindThing(cbufferSlot, pName, TT_FLOAT, pPackOffset);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderDescription::FindInt(int cbufferSlot, const char *pName, int *pPackOffset) const
+{
+	return this->FindThing(cbufferSlot, pName, TT_INT, pPackOffset);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderDescription::FindTexture(const char *pName, int *pSlot) const
+{
+	return this->FindThing(SCOPE_TEXTURES, pName, TT_TEXTURE2D, pSlot);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderDescription::FindSamplerState(const char *pName, int *pSlot) const
+{
+	return this->FindThing(SCOPE_SAMPLER_STATES, pName, TT_SAMPLER_STATE, pSlot);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderDescription::FindThing(int scope, const char *pName, int thingType, int *pSlot) const
+{
+	*pSlot = -1;
+
+	// Covers cbufferSlot<0, from a cbuffer that wasn't found.
+	if (scope < 0 || scope >= NUM_SCOPES || m_hashTable.empty())
+		return false;
+
+	uint32_t hash = HashThingName(scope, pName);
+	size_t mask = m_hashTable.size() - 1;
+
+	for (size_t i = hash & mask;; i = (i + 1) & mask)
+	{
+		int32_t thingIdx = m_hashTable[i];
+		if (thingIdx < 0)
+			return false;
+
+		const Thing *pThing = &m_things[thingIdx];
+
+		if (pThing->hash == hash && pThing->scope == scope && strcmp(&m_names[pThing->nameOffset], pName) == 0)
+		{
+			if (pThing->type != thingType)
+				return false;
+
+			*pSlot = pThing->slot;
+			return true;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void ShaderDescription::Clear()
+{
+	m_things.clear();
+	m_names.clear();
+	m_hashTable.clear();
+	m_cbufferSizes.assign(NUM_CBUFFER_SLOTS, 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void ShaderDescription::AddThing(int scope, const char *pName, int thingType, int slot)
+{
+	Thing thing;
+
+	thing.hash = HashThingName(scope, pName);
+	thing.scope = scope;
+	thing.type = thingType;
+	thing.slot = slot;
+	thing.nameOffset = uint32_t(m_names.size());
+
+	m_names.insert(m_names.end(), pName, pName + strlen(pName) + 1);
+
+	m_things.push_back(thing);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void ShaderDescription::BuildHashTable()
+{
+	// At most half full, so probe sequences stay short.
+	size_t size = 16;
+	while (size < m_things.size() * 2)
+		size *= 2;
+
+	m_hashTable.assign(size, -1);
+
+	size_t mask = size - 1;
+
+	for (size_t thingIdx = 0; thingIdx < m_things.size(); ++thingIdx)
+	{
+		size_t i = m_things[thingIdx].hash & mask;
+
+		while (m_hashTable[i] >= 0)
+			i = (i + 1) & mask;
+
+		m_hashTable[i] = int32_t(thingIdx);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,144 @@
+#ifndef HEADER_D03ADB15D0E54A0C8DB870E9BFD78A85
+#define HEADER_D03ADB15D0E54A0C8DB870E9BFD78A85
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// The cbuffers, constants, textures and sampler states a compiled
+// shader uses, and where they are.
+//
+// Only SetFromShaderBlob and Dump need D3D, so they're in
+// D3DHelpers.cpp. There's no D3D in the rest.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+struct ID3D10Blob;
+struct ID3D11ShaderReflection;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class ShaderDescription
+{
+public:
+	ShaderDescription();
+	~ShaderDescription();
+
+	bool SetFromShaderBlob(ID3D10Blob *pD3DShaderBlob);
+
+	// Print everything with dprintf.
+	void Dump() const;
+
+	// The description can be saved alongside the compiled shader, and
+	// restored later without having to reflect the shader again.
+	//
+	// Deserialise returns false, leaving the description empty, if the
+	// data is truncated or from a different version.
+	void Serialise(std::vector<char> *pData) const;
+	bool Deserialise(const void *pData, size_t sizeBytes);
+
+	// All the FindXXX functions return false if not found, and
+	// set the slot/pack offset to less than zero. This gives later
+	// code the option of working around missing constants.
+	//
+	// Everything is in one hash table, so finding things is fairly
+	// quick - but the idea is still to find indexes of everything of
+	// interest when the shader is first loaded.
+	//
+	// (Alternatively, specify slots and packoffsets manually in
+	// the shader.)
+
+	// Any globals that are outside a cbuffer get assigned to
+	// a special cbuffer called "$Globals"; this is built-in
+	// DirectX behaviour.
+	bool FindCBuffer(const char *pName,int *pSlot) const;
+
+	size_t GetCBufferSizeBytes(int cbufferSlot) const;
+
+	bool FindFloat4x4(int cbufferSlot, const char *pName, int *pPackOffset) const;
+	bool FindFloat4(int cbufferSlot, const char *pName, int *pPackOffset) const;
+	bool FindFloat3(int cbufferSlot, const char *pName, int *pPackOffset) const;
+	bool FindFloat2(int cbufferSlot, const char *pName, int *pPackOffset) const;
+	bool FindFloat(int cbufferSlot, const char *pName, int *pPackOffset) const;
+	bool FindInt(int cbufferSlot, const char *pName, int *pPackOffset) const;
+
+	bool FindTexture(const char *pName, int *pSlot) const;
+	bool FindSamplerState(const char *pName, int *pSlot) const;
+protected:
+private:
+	// Each "thing" lives in a scope: a cbuffer slot for cbuffer
+	// constants, or one of the special scopes for cbuffers
+	// themselves, textures and sampler states.
+	//
+	// All 32-bit values, so the array can be serialised as is.
+	struct Thing
+	{
+		uint32_t hash;
+		int32_t scope;
+		int32_t type;
+		int32_t slot;
+		uint32_t nameOffset;
+	};
+
+	enum ThingType
+	{
+		TT_NONE,
+		TT_TEXTURE2D,
+		TT_SAMPLER_STATE,
+		TT_FLOAT,
+		TT_FLOAT2,
+		TT_FLOAT3,
+		TT_FLOAT4,
+		TT_FLOAT4x4,
+		TT_INT,
+		TT_CBUFFER,
+	};
+
+	enum
+	{
+		// This value is fixed by D3D.
+		NUM_CBUFFER_SLOTS = 16,
+
+		// Scopes for things that aren't cbuffer constants. Constants
+		// use their cbuffer's slot as the scope.
+		SCOPE_CBUFFERS = NUM_CBUFFER_SLOTS,
+		SCOPE_TEXTURES,
+		SCOPE_SAMPLER_STATES,
+
+		NUM_SCOPES,
+	};
+
+	std::vector<Thing> m_things;
+
+	// Names of all the things, 0-terminated, end to end.
+	std::vector<char> m_names;
+
+	// Open addressing, linear probing. Each entry is an index into
+	// m_things, or <0 if empty. Size is a power of 2.
+	std::vector<int32_t> m_hashTable;
+
+	std::vector<uint32_t> m_cbufferSizes;
+
+	void Clear();
+	void AddThing(int scope, const char *pName, int thingType, int slot);
+	void BuildHashTable();
+	bool FindThing(int scope, const char *pName, int thingType, int *pSlot) const;
+	void AddResourceThings(ID3D11ShaderReflection *pRShader, int d3dShaderInputType, int scope, int thingType);
+	void DumpThings(int scope, const char *pPrefix) const;
+
+	static const char *GetThingTypeName(int thingType);
+
+	ShaderDescription(const ShaderDescription &);
+	ShaderDescription &operator=(const ShaderDescription &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_D03ADB15D0E54A0C8DB870E9BFD78A85
@@ -0,0 +1,285 @@
+#include "SlotAllocator.h"
+
+#include <assert.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+SlotAllocator::SlotAllocator():
+m_slotsPerPage(0),
+m_maxNumPages(0),
+m_numUsedSlots(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+SlotAllocator::~SlotAllocator()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool SlotAllocator::Create(int slotsPerPage, int maxNumPages)
+{
+	this->Destroy();
+
+	if (slotsPerPage < 1 || maxNumPages < 1)
+		return false;
+
+	m_slotsPerPage = slotsPerPage;
+	m_maxNumPages = maxNumPages;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SlotAllocator::Destroy()
+{
+	m_slotsPerPage = 0;
+	m_maxNumPages = 0;
+	m_numUsedSlots = 0;
+
+	m_pages.clear();
+	m_slotHandles.clear();
+	m_handleSlots.clear();
+	m_freeHandles.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool SlotAllocator::Allocate(int *pHandle)
+{
+	size_t pageIndex = 0;
+
+	while (pageIndex < m_pages.size() && m_pages[pageIndex].numUsed == m_slotsPerPage)
+		++pageIndex;
+
+	if (pageIndex == m_pages.size())
+	{
+		if (int(m_pages.size()) >= m_maxNumPages)
+			return false;
+
+		Page page;
+
+		page.numUsed = 0;
+
+		// Backwards, so the first slots are used first.
+		for (int i = m_slotsPerPage - 1; i >= 0; --i)
+			page.freeSlots.push_back(i);
+
+		m_pages.push_back(page);
+		m_slotHandles.resize(m_pages.size() * m_slotsPerPage, -1);
+	}
+
+	int handle;
+
+	if (m_freeHandles.empty())
+	{
+		handle = int(m_handleSlots.size());
+		m_handleSlots.push_back(-1);
+	}
+	else
+	{
+		handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+	}
+
+	m_handleSlots[handle] = this->TakeFreeSlot(int(pageIndex), handle);
+	++m_numUsedSlots;
+
+	*pHandle = handle;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SlotAllocator::Free(int handle)
+{
+	assert(handle >= 0 && size_t(handle) < m_handleSlots.size() && m_handleSlots[handle] >= 0);
+
+	int slot = m_handleSlots[handle];
+	Page *pPage = &m_pages[slot / m_slotsPerPage];
+
+	pPage->freeSlots.push_back(slot % m_slotsPerPage);
+	--pPage->numUsed;
+
+	m_slotHandles[slot] = -1;
+	m_handleSlots[handle] = -1;
+	m_freeHandles.push_back(handle);
+
+	--m_numUsedSlots;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int SlotAllocator::GetSlot(int handle) const
+{
+	assert(handle >= 0 && size_t(handle) < m_handleSlots.size() && m_handleSlots[handle] >= 0);
+
+	return m_handleSlots[handle];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int SlotAllocator::GetSlotsPerPage() const
+{
+	return m_slotsPerPage;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int SlotAllocator::GetNumPages() const
+{
+	return int(m_pages.size());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int SlotAllocator::GetNumSlots() const
+{
+	return int(m_slotHandles.size());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int SlotAllocator::GetNumUsedSlots() const
+{
+	return m_numUsedSlots;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float SlotAllocator::GetOccupancy() const
+{
+	if (m_slotHandles.empty())
+		return 0.f;
+
+	return float(m_numUsedSlots) / float(m_slotHandles.size());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float SlotAllocator::GetFragmentation() const
+{
+	int numPagesInUse = this->GetNumPagesInUse();
+	if (numPagesInUse == 0)
+		return 0.f;
+
+	int minNumPages = (m_numUsedSlots + m_slotsPerPage - 1) / m_slotsPerPage;
+
+	return float(numPagesInUse - minNumPages) / float(numPagesInUse);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t SlotAllocator::Defragment(size_t maxNumMoves, std::vector<SlotAllocatorMove> *pMoves)
+{
+	size_t numMoves = 0;
+
+	// Each move takes the last allocation in the last page with any,
+	// and puts it in a free slot in the first page with room. Moves
+	// that wouldn't end up emptying the last page aren't worth doing.
+	int fromPage = int(m_pages.size()) - 1;
+	int toPage = 0;
+
+	while (numMoves < maxNumMoves && this->GetNumPagesInUse() > (m_numUsedSlots + m_slotsPerPage - 1) / m_slotsPerPage)
+	{
+		while (m_pages[fromPage].numUsed == 0)
+			--fromPage;
+
+		while (m_pages[toPage].numUsed == m_slotsPerPage)
+			++toPage;
+
+		// If the allocations could be packed into fewer pages, there
+		// must be a page with room before the last one in use.
+		assert(toPage < fromPage);
+
+		int fromSlot = (fromPage + 1) * m_slotsPerPage - 1;
+
+		while (m_slotHandles[fromSlot] < 0)
+			--fromSlot;
+
+		int handle = m_slotHandles[fromSlot];
+
+		SlotAllocatorMove move;
+
+		move.fromSlot = fromSlot;
+		move.toSlot = this->TakeFreeSlot(toPage, handle);
+
+		m_pages[fromPage].freeSlots.push_back(fromSlot % m_slotsPerPage);
+		--m_pages[fromPage].numUsed;
+		m_slotHandles[fromSlot] = -1;
+
+		m_handleSlots[handle] = move.toSlot;
+
+		pMoves->push_back(move);
+		++numMoves;
+	}
+
+	return numMoves;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SlotAllocator::TrimEmptyPages()
+{
+	while (!m_pages.empty() && m_pages.back().numUsed == 0)
+		m_pages.pop_back();
+
+	m_slotHandles.resize(m_pages.size() * m_slotsPerPage);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Up to and including the last page with anything in it.
+int SlotAllocator::GetNumPagesInUse() const
+{
+	int numPagesInUse = int(m_pages.size());
+
+	while (numPagesInUse > 0 && m_pages[numPagesInUse - 1].numUsed == 0)
+		--numPagesInUse;
+
+	return numPagesInUse;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Gives a free slot in the page to handle, and returns it.
+int SlotAllocator::TakeFreeSlot(int pageIndex, int handle)
+{
+	Page *pPage = &m_pages[pageIndex];
+
+	assert(!pPage->freeSlots.empty());
+
+	int slot = pageIndex * m_slotsPerPage + pPage->freeSlots.back();
+
+	pPage->freeSlots.pop_back();
+	++pPage->numUsed;
+
+	m_slotHandles[slot] = handle;
+
+	return slot;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,117 @@
+#ifndef HEADER_294953EA6FD24C4EB2E02A60EE3C7878
+#define HEADER_294953EA6FD24C4EB2E02A60EE3C7878
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Hands out fixed size slots, from pages of slotsPerPage slots each,
+// for slicing a few big buffers up between lots of small users (see
+// BufferSlotPool).
+//
+// Slots are numbered page by page, so slot s is slot s % slotsPerPage
+// of page s / slotsPerPage. Pages are added, at the end, as they're
+// needed, and each page keeps a list of its free slots. New slots
+// come from the first page with room, so the later pages are the
+// first to empty.
+//
+// Each allocation gets a handle, which stays the same when Defragment
+// moves the allocation to another slot, so users don't need to be
+// told. Defragment moves allocations from the last pages into the
+// holes in the earlier ones, for as long as the allocations could fit
+// in fewer pages, then TrimEmptyPages can drop the empty pages off the
+// end.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Always from one page to another, earlier, page.
+struct SlotAllocatorMove
+{
+	int fromSlot;
+	int toSlot;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class SlotAllocator
+{
+public:
+	SlotAllocator();
+	~SlotAllocator();
+
+	bool Create(int slotsPerPage, int maxNumPages);
+	void Destroy();
+
+	// Returns false if every page is full and there can't be any more.
+	bool Allocate(int *pHandle);
+	void Free(int handle);
+
+	int GetSlot(int handle) const;
+
+	int GetSlotsPerPage() const;
+
+	// Including empty pages, until they're trimmed.
+	int GetNumPages() const;
+
+	int GetNumSlots() const;
+	int GetNumUsedSlots() const;
+
+	// Used slots over slots in all the pages.
+	float GetOccupancy() const;
+
+	// The fraction of the pages, up to the last one with anything in
+	// it, that would be empty if the allocations were packed into as
+	// few pages as possible. 0 means there's nothing for Defragment to
+	// do.
+	float GetFragmentation() const;
+
+	// Moves up to maxNumMoves allocations, adding each move to *pMoves
+	// (which isn't cleared first). Returns the number moved. The caller
+	// must copy each slot's contents across.
+	size_t Defragment(size_t maxNumMoves, std::vector<SlotAllocatorMove> *pMoves);
+
+	void TrimEmptyPages();
+protected:
+private:
+	struct Page
+	{
+		int numUsed;
+
+		// Within the page.
+		std::vector<int> freeSlots;
+	};
+
+	int m_slotsPerPage;
+	int m_maxNumPages;
+	int m_numUsedSlots;
+
+	std::vector<Page> m_pages;
+
+	// Per slot, its handle, or -1 if it's free.
+	std::vector<int> m_slotHandles;
+
+	// Per handle, its slot, or -1 if it's free.
+	std::vector<int> m_handleSlots;
+	std::vector<int> m_freeHandles;
+
+	int GetNumPagesInUse() const;
+	int TakeFreeSlot(int pageIndex, int handle);
+
+	SlotAllocator(const SlotAllocator &);
+	SlotAllocator &operator=(const SlotAllocator &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_294953EA6FD24C4EB2E02A60EE3C7878
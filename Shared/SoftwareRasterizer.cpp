@@ -0,0 +1,1433 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "SoftwareRasterizer.h"
+
+#include "ParallelJobs.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_RASTERIZER_SSE2 1
+#include <emmintrin.h>
+#else
+#define SOFTWARE_RASTERIZER_SSE2 0
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Triangles are only clipped at the sides if they stick out more than
+// this many times the size of the screen, which isn't often. That
+// keeps screen positions small enough for the edge functions to be
+// accurate. The pixels off the screen are skipped anyway.
+static const float GUARD_BAND = 4.f;
+
+// Screen positions are snapped to 1/256th of a pixel, as D3D does.
+static const float SUBPIXELS = 256.f;
+
+// The near and far planes, then the guard band's left, right, bottom
+// and top.
+static const int NUM_CLIP_PLANES = 6;
+
+// Beyond those, outside the screen's left, right, bottom and top;
+// these are only for throwing triangles away without setting them up.
+static const int NUM_CULL_PLANES = 10;
+static const unsigned CLIP_PLANES_MASK = (1u << NUM_CLIP_PLANES) - 1;
+
+static const size_t UNLIT_VERTEX_STRIDE = 16;// Vertex_Pos3fColour4ub
+static const size_t LIT_VERTEX_STRIDE = 28;// Vertex_Pos3fColour4ubNormal3f
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static double GetSecondsSince(const std::chrono::steady_clock::time_point &start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void SetIdentity(float *pMtx)
+{
+	for (int i = 0; i < 16; ++i)
+		pMtx[i] = i % 5 == 0 ? 1.f : 0.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void MultiplyMatrices(const float *pA, const float *pB, float *pResult)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			float sum = 0.f;
+
+			for (int k = 0; k < 4; ++k)
+				sum += pA[i * 4 + k] * pB[k * 4 + j];
+
+			pResult[i * 4 + j] = sum;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The top left 3x3 of the inverse of the transpose, which is all that
+// normals need (world matrices don't project). That's the cofactors
+// over the determinant.
+static void GetInverseTranspose3x3(const float *pMtx, float *pResult)
+{
+	float m00 = pMtx[0], m01 = pMtx[1], m02 = pMtx[2];
+	float m10 = pMtx[4], m11 = pMtx[5], m12 = pMtx[6];
+	float m20 = pMtx[8], m21 = pMtx[9], m22 = pMtx[10];
+
+	pResult[0] = m11 * m22 - m12 * m21;
+	pResult[1] = m12 * m20 - m10 * m22;
+	pResult[2] = m10 * m21 - m11 * m20;
+	pResult[3] = m02 * m21 - m01 * m22;
+	pResult[4] = m00 * m22 - m02 * m20;
+	pResult[5] = m01 * m20 - m00 * m21;
+	pResult[6] = m01 * m12 - m02 * m11;
+	pResult[7] = m02 * m10 - m00 * m12;
+	pResult[8] = m00 * m11 - m01 * m10;
+
+	float det = m00 * pResult[0] + m01 * pResult[1] + m02 * pResult[2];
+
+	if (det != 0.f)
+	{
+		for (int i = 0; i < 9; ++i)
+			pResult[i] /= det;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float GetClipDistance(const float *pPos, int plane)
+{
+	switch (plane)
+	{
+	case 0:
+		return pPos[2];
+
+	case 1:
+		return pPos[3] - pPos[2];
+
+	case 2:
+		return GUARD_BAND * pPos[3] + pPos[0];
+
+	case 3:
+		return GUARD_BAND * pPos[3] - pPos[0];
+
+	case 4:
+		return GUARD_BAND * pPos[3] + pPos[1];
+
+	case 5:
+		return GUARD_BAND * pPos[3] - pPos[1];
+
+	case 6:
+		return pPos[3] + pPos[0];
+
+	case 7:
+		return pPos[3] - pPos[0];
+
+	case 8:
+		return pPos[3] + pPos[1];
+
+	default:
+		return pPos[3] - pPos[1];
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Bit i is set if the point is outside plane i.
+static unsigned GetClipCodes(const float *pPos)
+{
+	unsigned codes = 0;
+
+	for (int i = 0; i < NUM_CULL_PLANES; ++i)
+	{
+		if (GetClipDistance(pPos, i) < 0.f)
+			codes |= 1u << i;
+	}
+
+	return codes;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float Saturate(float f)
+{
+	return f < 0.f ? 0.f : f > 1.f ? 1.f : f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float Dot3(const float *pA, const float *pB)
+{
+	return pA[0] * pB[0] + pA[1] * pB[1] + pA[2] * pB[2];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// No range, and no falloff with distance.
+static void SetDefaultAttenuations(float *pAttenuations)
+{
+	pAttenuations[0] = 1.f;
+	pAttenuations[1] = 0.f;
+	pAttenuations[2] = 0.f;
+	pAttenuations[3] = FLT_MAX;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static uint32_t PackColour(const float *pColour)
+{
+	uint32_t packed = 0;
+
+	for (int i = 0; i < 4; ++i)
+		packed |= uint32_t(lrintf(Saturate(pColour[i]) * 255.f)) << (i * 8);
+
+	return packed;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void AppendU32BE(std::vector<uint8_t> *pData, uint32_t value)
+{
+	for (int i = 3; i >= 0; --i)
+		pData->push_back(uint8_t(value >> (i * 8)));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void AppendPNGChunk(std::vector<uint8_t> *pPNG, const char *pType, const std::vector<uint8_t> &data)
+{
+	uint32_t crcTable[256];
+
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		uint32_t c = i;
+
+		for (int j = 0; j < 8; ++j)
+			c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+
+		crcTable[i] = c;
+	}
+
+	AppendU32BE(pPNG, uint32_t(data.size()));
+
+	size_t typeOffset = pPNG->size();
+	pPNG->insert(pPNG->end(), pType, pType + 4);
+	pPNG->insert(pPNG->end(), data.begin(), data.end());
+
+	// Over the type and the data.
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (size_t i = typeOffset; i < pPNG->size(); ++i)
+		crc = crcTable[(crc ^ (*pPNG)[i]) & 0xFF] ^ (crc >> 8);
+
+	AppendU32BE(pPNG, crc ^ 0xFFFFFFFF);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool WriteBytesToFile(const char *pFileName, const std::vector<uint8_t> &data)
+{
+	FILE *pFile = fopen(pFileName, "wb");
+	if (!pFile)
+		return false;
+
+	bool good = fwrite(&data[0], 1, data.size(), pFile) == data.size();
+
+	if (fclose(pFile) != 0)
+		good = false;
+
+	return good;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+SoftwareRasterizerStats::SoftwareRasterizerStats():
+numDraws(0),
+numTrianglesSubmitted(0),
+numTrianglesDrawn(0),
+numTrianglesBinned(0),
+numPixelsWritten(0),
+setupSeconds(0.),
+rasterSeconds(0.)
+{
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+SoftwareRasterizer::Light::Light():
+enabled(false)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		this->direction[i] = 0.f;
+		this->position[i] = 0.f;
+		this->attenuations[i] = 0.f;
+		this->spots[i] = 0.f;
+	}
+
+	for (int i = 0; i < 3; ++i)
+		this->colour[i] = 0.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+SoftwareRasterizer::SoftwareRasterizer():
+m_width(0),
+m_height(0),
+m_pitch(0),
+m_maxNumThreads(0),
+m_numTilesX(0),
+m_numTilesY(0),
+m_flags(FLAG_DEPTH_TEST | FLAG_DEPTH_WRITE | FLAG_BLEND),
+m_backFaceCull(false)
+{
+	SetIdentity(m_worldMtx);
+	SetIdentity(m_viewMtx);
+	SetIdentity(m_projectionMtx);
+
+	for (int i = 0; i < 4; ++i)
+		m_constantColour[i] = 1.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+SoftwareRasterizer::~SoftwareRasterizer()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool SoftwareRasterizer::Create(int width, int height, unsigned maxNumThreads)
+{
+	this->Destroy();
+
+	if (width <= 0 || height <= 0)
+		return false;
+
+	m_width = width;
+	m_height = height;
+	m_pitch = (size_t(width) + 3) & ~size_t(3);
+	m_maxNumThreads = maxNumThreads;
+
+	m_colours.resize(m_pitch * height, 0);
+	m_depths.resize(m_pitch * height, 1.f);
+
+	m_numTilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	m_numTilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	m_bins.resize(size_t(m_numTilesX) * m_numTilesY);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::Destroy()
+{
+	m_width = 0;
+	m_height = 0;
+	m_pitch = 0;
+
+	m_colours.clear();
+	m_depths.clear();
+
+	m_numTilesX = 0;
+	m_numTilesY = 0;
+	m_bins.clear();
+	m_triangles.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int SoftwareRasterizer::GetWidth() const
+{
+	return m_width;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int SoftwareRasterizer::GetHeight() const
+{
+	return m_height;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::SetWorldMatrix(const float *pWorldMtx)
+{
+	memcpy(m_worldMtx, pWorldMtx, sizeof m_worldMtx);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::SetViewMatrix(const float *pViewMtx)
+{
+	memcpy(m_viewMtx, pViewMtx, sizeof m_viewMtx);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::SetProjectionMatrix(const float *pProjectionMtx)
+{
+	memcpy(m_projectionMtx, pProjectionMtx, sizeof m_projectionMtx);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::SetConstantColour(const float *pConstantColour)
+{
+	memcpy(m_constantColour, pConstantColour, sizeof m_constantColour);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::DisableLight(int light)
+{
+	if (light >= 0 && light < MAX_NUM_LIGHTS)
+		m_lights[light].enabled = false;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::EnableDirectionalLight(int light, const float *pWorldDirection, const float *pDiffuseColour)
+{
+	if (light < 0 || light >= MAX_NUM_LIGHTS)
+		return;
+
+	Light *pLight = &m_lights[light];
+
+	pLight->enabled = true;
+
+	// Towards the light.
+	float length = sqrtf(Dot3(pWorldDirection, pWorldDirection));
+
+	for (int i = 0; i < 3; ++i)
+	{
+		pLight->direction[i] = length > 0.f ? -pWorldDirection[i] / length : 0.f;
+		pLight->position[i] = 0.f;
+		pLight->colour[i] = pDiffuseColour[i];
+	}
+
+	pLight->direction[3] = 1.f;
+	pLight->position[3] = 0.f;
+
+	SetDefaultAttenuations(pLight->attenuations);
+
+	pLight->spots[0] = 0.f;
+	pLight->spots[1] = -1.f;
+	pLight->spots[2] = 0.f;
+	pLight->spots[3] = 0.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::EnablePointLight(int light, const float *pWorldPosition, const float *pDiffuseColour)
+{
+	if (light < 0 || light >= MAX_NUM_LIGHTS)
+		return;
+
+	Light *pLight = &m_lights[light];
+
+	pLight->enabled = true;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		pLight->direction[i] = 0.f;
+		pLight->position[i] = pWorldPosition[i];
+		pLight->colour[i] = pDiffuseColour[i];
+	}
+
+	pLight->direction[3] = 0.f;
+	pLight->position[3] = 1.f;
+
+	SetDefaultAttenuations(pLight->attenuations);
+
+	pLight->spots[0] = 0.f;
+	pLight->spots[1] = -1.f;
+	pLight->spots[2] = 0.f;
+	pLight->spots[3] = 0.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::EnableSpotLight(int light, const float *pWorldPosition, const float *pWorldDirection, float theta, float phi, float falloff, const float *pDiffuseColour)
+{
+	if (light < 0 || light >= MAX_NUM_LIGHTS)
+		return;
+
+	Light *pLight = &m_lights[light];
+
+	pLight->enabled = true;
+
+	float length = sqrtf(Dot3(pWorldDirection, pWorldDirection));
+
+	for (int i = 0; i < 3; ++i)
+	{
+		pLight->direction[i] = length > 0.f ? -pWorldDirection[i] / length : 0.f;
+		pLight->position[i] = pWorldPosition[i];
+		pLight->colour[i] = pDiffuseColour[i];
+	}
+
+	pLight->direction[3] = 1.f;
+	pLight->position[3] = 1.f;
+
+	SetDefaultAttenuations(pLight->attenuations);
+
+	float cosHalfTheta = cosf(theta * .5f);
+	float cosHalfPhi = cosf(phi * .5f);
+
+	pLight->spots[0] = cosHalfPhi;
+	pLight->spots[1] = cosHalfTheta;
+	pLight->spots[2] = cosHalfPhi != cosHalfTheta ? 1.f / (cosHalfTheta - cosHalfPhi) : 0.f;
+	pLight->spots[3] = falloff;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::SetLightAttenuation(int light, float range, float a0, float a1, float a2)
+{
+	if (light < 0 || light >= MAX_NUM_LIGHTS)
+		return;
+
+	Light *pLight = &m_lights[light];
+
+	pLight->attenuations[0] = a0;
+	pLight->attenuations[1] = a1;
+	pLight->attenuations[2] = a2;
+	pLight->attenuations[3] = range * range;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::SetBlendState(bool blendEnable)
+{
+	m_flags &= ~FLAG_BLEND;
+
+	if (blendEnable)
+		m_flags |= FLAG_BLEND;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::SetDepthStencilState(bool depthTest, bool depthWrite)
+{
+	m_flags &= ~(FLAG_DEPTH_TEST | FLAG_DEPTH_WRITE);
+
+	// As in D3D, turning the test off turns the writes off too.
+	if (depthTest)
+	{
+		m_flags |= FLAG_DEPTH_TEST;
+
+		if (depthWrite)
+			m_flags |= FLAG_DEPTH_WRITE;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::SetRasterizerState(bool backFaceCull)
+{
+	m_backFaceCull = backFaceCull;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::Clear(const float *pClearColour)
+{
+	this->Flush();
+
+	std::fill(m_colours.begin(), m_colours.end(), PackColour(pClearColour));
+	std::fill(m_depths.begin(), m_depths.end(), 1.f);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::DrawUntextured(Topology topology, const void *pVertices, const uint16_t *pIndices, unsigned numItems)
+{
+	this->DrawWithShader(topology, pVertices, UNLIT_VERTEX_STRIDE, false, pIndices, 0, numItems, 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::DrawUntexturedLit(Topology topology, const void *pVertices, const uint16_t *pIndices, unsigned numItems)
+{
+	this->DrawWithShader(topology, pVertices, LIT_VERTEX_STRIDE, true, pIndices, 0, numItems, 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::DrawWithShader(Topology topology, const void *pVertices, size_t vertexStride, bool lit, const uint16_t *pIndices, unsigned firstItem, unsigned numItems, int baseVertex)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	++m_stats.numDraws;
+
+	unsigned numTriangles = 0;
+
+	if (topology == Topology_TriangleList)
+		numTriangles = numItems / 3;
+	else if (numItems >= 3)
+		numTriangles = numItems - 2;
+
+	if (numTriangles > 0 && m_width > 0)
+	{
+		// Each vertex is transformed and lit once, however many
+		// triangles it's in.
+		unsigned minVertex = firstItem;
+		unsigned maxVertex = firstItem + numItems - 1;
+
+		if (pIndices)
+		{
+			minVertex = pIndices[firstItem];
+			maxVertex = pIndices[firstItem];
+
+			for (unsigned i = 1; i < numItems; ++i)
+			{
+				minVertex = std::min<unsigned>(minVertex, pIndices[firstItem + i]);
+				maxVertex = std::max<unsigned>(maxVertex, pIndices[firstItem + i]);
+			}
+		}
+
+		assert(int(minVertex) + baseVertex >= 0);
+
+		this->TransformVertices(pVertices, vertexStride, lit, minVertex + baseVertex, maxVertex - minVertex + 1);
+
+		for (unsigned i = 0; i < numTriangles; ++i)
+		{
+			unsigned items[3];
+
+			if (topology == Topology_TriangleList)
+			{
+				items[0] = firstItem + i * 3;
+				items[1] = items[0] + 1;
+				items[2] = items[0] + 2;
+			}
+			else
+			{
+				// Every other triangle of a strip is the other way
+				// round; swap it back.
+				items[0] = firstItem + i + (i & 1);
+				items[1] = firstItem + i + 1 - (i & 1);
+				items[2] = firstItem + i + 2;
+			}
+
+			unsigned clipVertices[3];
+
+			for (int j = 0; j < 3; ++j)
+				clipVertices[j] = (pIndices ? pIndices[items[j]] : items[j]) - minVertex;
+
+			this->AddTriangle(clipVertices);
+		}
+
+		m_stats.numTrianglesSubmitted += numTriangles;
+	}
+
+	m_stats.setupSeconds += GetSecondsSince(start);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::Flush()
+{
+	if (m_triangles.empty())
+		return;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	m_busyTiles.clear();
+
+	for (size_t i = 0; i < m_bins.size(); ++i)
+	{
+		if (!m_bins[i].empty())
+			m_busyTiles.push_back(i);
+	}
+
+	m_numTilePixelsWritten.clear();
+	m_numTilePixelsWritten.resize(m_busyTiles.size(), 0);
+
+	// Tiles don't share any pixels, so there's nothing to lock.
+	RunParallelJobs(m_busyTiles.size(), m_maxNumThreads, [this](size_t i, std::string *) -> bool {
+		m_numTilePixelsWritten[i] = this->DrawTile(m_busyTiles[i]);
+		return true;
+	}, NULL);
+
+	for (size_t i = 0; i < m_busyTiles.size(); ++i)
+	{
+		m_stats.numPixelsWritten += m_numTilePixelsWritten[i];
+		m_bins[m_busyTiles[i]].clear();
+	}
+
+	m_triangles.clear();
+
+	m_stats.rasterSeconds += GetSecondsSince(start);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const uint32_t *SoftwareRasterizer::GetColours() const
+{
+	return m_colours.empty() ? NULL : &m_colours[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t SoftwareRasterizer::GetPitch() const
+{
+	return m_pitch;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool SoftwareRasterizer::WritePPM(const char *pFileName) const
+{
+	if (m_width <= 0)
+		return false;
+
+	char header[50];
+	int headerSize = sprintf(header, "P6\n%d %d\n255\n", m_width, m_height);
+
+	std::vector<uint8_t> data(header, header + headerSize);
+	data.reserve(headerSize + size_t(m_width) * m_height * 3);
+
+	for (int y = 0; y < m_height; ++y)
+	{
+		const uint32_t *pRow = &m_colours[y * m_pitch];
+
+		for (int x = 0; x < m_width; ++x)
+		{
+			for (int i = 0; i < 3; ++i)
+				data.push_back(uint8_t(pRow[x] >> (i * 8)));
+		}
+	}
+
+	return WriteBytesToFile(pFileName, data);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The image data is deflate stored blocks, which any PNG reader can
+// read without this having to compress anything.
+bool SoftwareRasterizer::WritePNG(const char *pFileName) const
+{
+	if (m_width <= 0)
+		return false;
+
+	static const uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	std::vector<uint8_t> png(SIGNATURE, SIGNATURE + 8);
+
+	std::vector<uint8_t> ihdr;
+	AppendU32BE(&ihdr, uint32_t(m_width));
+	AppendU32BE(&ihdr, uint32_t(m_height));
+	ihdr.push_back(8);// bits per channel
+	ihdr.push_back(2);// RGB
+	ihdr.push_back(0);// deflate
+	ihdr.push_back(0);// filters
+	ihdr.push_back(0);// not interlaced
+	AppendPNGChunk(&png, "IHDR", ihdr);
+
+	// Each row is its filter type (none), then its pixels.
+	std::vector<uint8_t> raw;
+	raw.reserve(size_t(m_height) * (1 + size_t(m_width) * 3));
+
+	for (int y = 0; y < m_height; ++y)
+	{
+		const uint32_t *pRow = &m_colours[y * m_pitch];
+
+		raw.push_back(0);
+
+		for (int x = 0; x < m_width; ++x)
+		{
+			for (int i = 0; i < 3; ++i)
+				raw.push_back(uint8_t(pRow[x] >> (i * 8)));
+		}
+	}
+
+	std::vector<uint8_t> idat;
+	idat.push_back(0x78);// zlib, 32K window
+	idat.push_back(0x01);
+
+	for (size_t offset = 0; offset < raw.size(); offset += 65535)
+	{
+		size_t size = std::min<size_t>(raw.size() - offset, 65535);
+
+		idat.push_back(offset + size == raw.size() ? 1 : 0);// final block?
+		idat.push_back(uint8_t(size));
+		idat.push_back(uint8_t(size >> 8));
+		idat.push_back(uint8_t(~size));
+		idat.push_back(uint8_t(~size >> 8));
+		idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + size);
+	}
+
+	uint32_t a = 1, b = 0;
+
+	for (size_t i = 0; i < raw.size(); ++i)
+	{
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	AppendU32BE(&idat, (b << 16) | a);
+	AppendPNGChunk(&png, "IDAT", idat);
+
+	AppendPNGChunk(&png, "IEND", std::vector<uint8_t>());
+
+	return WriteBytesToFile(pFileName, png);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const SoftwareRasterizerStats &SoftwareRasterizer::GetStats() const
+{
+	return m_stats;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::ResetStats()
+{
+	m_stats = SoftwareRasterizerStats();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// VSMain.
+void SoftwareRasterizer::TransformVertices(const void *pVertices, size_t vertexStride, bool lit, unsigned firstVertex, unsigned numVertices)
+{
+	float viewProj[16], wvp[16], invXposeW[9];
+	MultiplyMatrices(m_worldMtx, m_viewMtx, viewProj);
+	MultiplyMatrices(viewProj, m_projectionMtx, wvp);
+	GetInverseTranspose3x3(m_worldMtx, invXposeW);
+
+	m_clipVertices.resize(numVertices);
+
+	const uint8_t *pVertex = static_cast<const uint8_t *>(pVertices) + firstVertex * vertexStride;
+
+	for (unsigned i = 0; i < numVertices; ++i, pVertex += vertexStride)
+	{
+		ClipVertex *pClipVertex = &m_clipVertices[i];
+
+		float pos[3];
+		memcpy(pos, pVertex, sizeof pos);
+
+		for (int j = 0; j < 4; ++j)
+			pClipVertex->pos[j] = pos[0] * wvp[j] + pos[1] * wvp[4 + j] + pos[2] * wvp[8 + j] + wvp[12 + j];
+
+		pClipVertex->clipCodes = GetClipCodes(pClipVertex->pos);
+
+		const uint8_t *pColour = pVertex + 12;
+
+		for (int j = 0; j < 4; ++j)
+			pClipVertex->colour[j] = m_constantColour[j] * (pColour[j] / 255.f);
+
+		if (lit)
+		{
+			float normal[3];
+			memcpy(normal, pVertex + 16, sizeof normal);
+
+			float N[3];
+
+			for (int j = 0; j < 3; ++j)
+				N[j] = normal[0] * invXposeW[j] + normal[1] * invXposeW[3 + j] + normal[2] * invXposeW[6 + j];
+
+			float length = sqrtf(Dot3(N, N));
+
+			if (length > 0.f)
+			{
+				for (int j = 0; j < 3; ++j)
+					N[j] /= length;
+			}
+
+			float worldPos[3];
+
+			for (int j = 0; j < 3; ++j)
+				worldPos[j] = pos[0] * m_worldMtx[j] + pos[1] * m_worldMtx[4 + j] + pos[2] * m_worldMtx[8 + j] + m_worldMtx[12 + j];
+
+			float lighting[3];
+			this->GetLightingColour(worldPos, N, lighting);
+
+			for (int j = 0; j < 3; ++j)
+				pClipVertex->colour[j] *= lighting[j];
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// g_aShader's GetLightingColour, line for line. The alpha is 1.
+void SoftwareRasterizer::GetLightingColour(const float *pWorldPos, const float *pN, float *pColour) const
+{
+	for (int i = 0; i < 3; ++i)
+		pColour[i] = 0.f;
+
+	for (int i = 0; i < MAX_NUM_LIGHTS; ++i)
+	{
+		const Light *pLight = &m_lights[i];
+
+		if (!pLight->enabled)
+			continue;
+
+		float D[3];
+
+		for (int j = 0; j < 3; ++j)
+			D[j] = pLight->position[3] * (pLight->position[j] - pWorldPos[j]);
+
+		float dotDD = Dot3(D, D);
+
+		if (dotDD > pLight->attenuations[3])
+			continue;
+
+		float atten = 1.f / (pLight->attenuations[0] + pLight->attenuations[1] * sqrtf(dotDD) + pLight->attenuations[2] * dotDD);
+
+		const float *L = pLight->direction;
+		float dotNL = pLight->direction[3] * Saturate(Dot3(pN, L));
+
+		// D normalised. The shader's is undefined when D is 0; here
+		// it's 0.
+		float normalD[3] = {0.f, 0.f, 0.f};
+
+		if (dotDD > 0.f)
+		{
+			float lengthD = sqrtf(dotDD);
+
+			for (int j = 0; j < 3; ++j)
+				normalD[j] = D[j] / lengthD;
+		}
+
+		float rho = 0.f;
+		if (dotDD > 0.f)
+			rho = Dot3(L, normalD);//rho will be zero for point lights
+
+		float spot;
+		if (rho > pLight->spots[1])
+			spot = 1.f;
+		else if (rho < pLight->spots[0])
+			spot = 0.f;
+		else
+			spot = powf((rho - pLight->spots[0]) * pLight->spots[2], pLight->spots[3]);
+
+		float scale = atten * spot;
+
+		if (pLight->direction[3] > 0.f)
+			scale *= dotNL;
+		else
+			scale *= Saturate(Dot3(pN, normalD));
+
+		for (int j = 0; j < 3; ++j)
+			pColour[j] += scale * pLight->colour[j];
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::AddTriangle(const unsigned *pClipVertices)
+{
+	const ClipVertex *pV0 = &m_clipVertices[pClipVertices[0]];
+	const ClipVertex *pV1 = &m_clipVertices[pClipVertices[1]];
+	const ClipVertex *pV2 = &m_clipVertices[pClipVertices[2]];
+
+	// All outside the same plane.
+	if (pV0->clipCodes & pV1->clipCodes & pV2->clipCodes)
+		return;
+
+	unsigned clipCodes = (pV0->clipCodes | pV1->clipCodes | pV2->clipCodes) & CLIP_PLANES_MASK;
+
+	if (clipCodes == 0)
+	{
+		this->SetUpTriangle(pV0, pV1, pV2);
+	}
+	else
+	{
+		ClipVertex vertices[3] = {*pV0, *pV1, *pV2};
+		this->ClipTriangle(vertices, clipCodes);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::ClipTriangle(const ClipVertex *pVertices, unsigned clipCodes)
+{
+	// Each plane can add at most one vertex.
+	ClipVertex polygons[2][3 + NUM_CLIP_PLANES];
+	int numVertices = 3;
+	int current = 0;
+
+	for (int i = 0; i < 3; ++i)
+		polygons[current][i] = pVertices[i];
+
+	for (int plane = 0; plane < NUM_CLIP_PLANES; ++plane)
+	{
+		if (!(clipCodes & (1u << plane)))
+			continue;
+
+		const ClipVertex *pIn = polygons[current];
+		ClipVertex *pOut = polygons[current ^ 1];
+		int numOut = 0;
+
+		for (int i = 0; i < numVertices; ++i)
+		{
+			const ClipVertex *pA = &pIn[i];
+			const ClipVertex *pB = &pIn[(i + 1) % numVertices];
+
+			float distanceA = GetClipDistance(pA->pos, plane);
+			float distanceB = GetClipDistance(pB->pos, plane);
+
+			if (distanceA >= 0.f)
+				pOut[numOut++] = *pA;
+
+			if ((distanceA >= 0.f) != (distanceB >= 0.f))
+			{
+				// Always from the inside end, so an edge shared with
+				// another triangle is cut at exactly the same point.
+				const ClipVertex *pInside = distanceA >= 0.f ? pA : pB;
+				const ClipVertex *pOutside = distanceA >= 0.f ? pB : pA;
+				float distanceInside = distanceA >= 0.f ? distanceA : distanceB;
+				float distanceOutside = distanceA >= 0.f ? distanceB : distanceA;
+
+				float t = distanceInside / (distanceInside - distanceOutside);
+
+				ClipVertex *pNew = &pOut[numOut++];
+				pNew->clipCodes = 0;
+
+				for (int j = 0; j < 4; ++j)
+				{
+					pNew->pos[j] = pInside->pos[j] + t * (pOutside->pos[j] - pInside->pos[j]);
+					pNew->colour[j] = pInside->colour[j] + t * (pOutside->colour[j] - pInside->colour[j]);
+				}
+			}
+		}
+
+		numVertices = numOut;
+		current ^= 1;
+
+		if (numVertices < 3)
+			return;
+	}
+
+	// A convex polygon, the same way round as the triangle was.
+	const ClipVertex *pPolygon = polygons[current];
+
+	for (int i = 1; i + 1 < numVertices; ++i)
+		this->SetUpTriangle(&pPolygon[0], &pPolygon[i], &pPolygon[i + 1]);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void SoftwareRasterizer::SetUpTriangle(const ClipVertex *pV0, const ClipVertex *pV1, const ClipVertex *pV2)
+{
+	const ClipVertex *apVertices[3] = {pV0, pV1, pV2};
+
+	float xs[3], ys[3];
+	float values[NUM_VALUES][3];
+
+	for (int i = 0; i < 3; ++i)
+	{
+		const ClipVertex *pVertex = apVertices[i];
+
+		if (!(pVertex->pos[3] > 0.f))
+			return;
+
+		float invW = 1.f / pVertex->pos[3];
+
+		float x = (pVertex->pos[0] * invW * .5f + .5f) * m_width;
+		float y = (.5f - pVertex->pos[1] * invW * .5f) * m_height;
+
+		xs[i] = floorf(x * SUBPIXELS + .5f) / SUBPIXELS;
+		ys[i] = floorf(y * SUBPIXELS + .5f) / SUBPIXELS;
+
+		values[VALUE_Z][i] = pVertex->pos[2] * invW;
+		values[VALUE_INV_W][i] = invW;
+
+		for (int j = 0; j < 4; ++j)
+			values[VALUE_R + j][i] = pVertex->colour[j] * invW;
+	}
+
+	// Positive if clockwise on the screen (y goes down), which is front
+	// facing. The snapped positions are few enough bits that this is
+	// exact.
+	double doubleArea = (double(xs[1]) - xs[0]) * (double(ys[2]) - ys[0]) - (double(xs[2]) - xs[0]) * (double(ys[1]) - ys[0]);
+
+	if (doubleArea == 0. || (m_backFaceCull && doubleArea < 0.))
+		return;
+
+	// Pixel (x, y)'s centre is at (x + .5, y + .5).
+	float minX = std::min(xs[0], std::min(xs[1], xs[2]));
+	float maxX = std::max(xs[0], std::max(xs[1], xs[2]));
+	float minY = std::min(ys[0], std::min(ys[1], ys[2]));
+	float maxY = std::max(ys[0], std::max(ys[1], ys[2]));
+
+	Triangle triangle;
+	triangle.minX = std::max(0, int(ceilf(minX - .5f)));
+	triangle.maxX = std::min(m_width - 1, int(floorf(maxX - .5f)));
+	triangle.minY = std::max(0, int(ceilf(minY - .5f)));
+	triangle.maxY = std::min(m_height - 1, int(floorf(maxY - .5f)));
+
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		int a = (i + 1) % 3;
+		int b = (i + 2) % 3;
+
+		// The triangle on the other side of this edge has it the other
+		// way round. Work it out from the same end either way, so the
+		// two edge functions are exact negatives of each other, and
+		// every pixel centre is inside one or the other.
+		if (xs[b] < xs[a] || (xs[b] == xs[a] && ys[b] < ys[a]))
+			std::swap(a, b);
+
+		double edgeA = double(ys[b]) - ys[a];
+		double edgeB = double(xs[a]) - xs[b];
+
+		if (edgeA * (double(xs[i]) - xs[a]) + edgeB * (double(ys[i]) - ys[a]) < 0.)
+		{
+			edgeA = -edgeA;
+			edgeB = -edgeB;
+		}
+
+		triangle.edgeA[i] = float(edgeA);
+		triangle.edgeB[i] = float(edgeB);
+		triangle.edgeX[i] = xs[a];
+		triangle.edgeY[i] = ys[a];
+
+		// Pointing in and to the right, or straight down: a left edge,
+		// or a top edge. Points on those are in, so the test is >= 0
+		// for them, and > 0 otherwise. Only one of the two triangles
+		// sharing an edge can have it as a top or left edge.
+		bool topLeft = edgeA > 0. || (edgeA == 0. && edgeB > 0.);
+		triangle.edgeBias[i] = topLeft ? -FLT_MIN : 0.f;
+	}
+
+	triangle.invDoubleArea = float(1. / fabs(doubleArea));
+
+	for (int i = 0; i < NUM_VALUES; ++i)
+	{
+		triangle.values[i][0] = values[i][0];
+		triangle.values[i][1] = values[i][1] - values[i][0];
+		triangle.values[i][2] = values[i][2] - values[i][0];
+	}
+
+	triangle.flags = m_flags;
+
+	uint32_t triangleIndex = uint32_t(m_triangles.size());
+	m_triangles.push_back(triangle);
+
+	++m_stats.numTrianglesDrawn;
+
+	for (int tileY = triangle.minY / TILE_SIZE; tileY <= triangle.maxY / TILE_SIZE; ++tileY)
+	{
+		for (int tileX = triangle.minX / TILE_SIZE; tileX <= triangle.maxX / TILE_SIZE; ++tileX)
+		{
+			m_bins[size_t(tileY) * m_numTilesX + tileX].push_back(triangleIndex);
+			++m_stats.numTrianglesBinned;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t SoftwareRasterizer::DrawTile(size_t tileIndex)
+{
+	int tileX = int(tileIndex % m_numTilesX) * TILE_SIZE;
+	int tileY = int(tileIndex / m_numTilesX) * TILE_SIZE;
+
+	const std::vector<uint32_t> &bin = m_bins[tileIndex];
+	size_t numPixelsWritten = 0;
+
+	for (size_t i = 0; i < bin.size(); ++i)
+		numPixelsWritten += this->DrawTriangleInTile(&m_triangles[bin[i]], tileX, tileY);
+
+	return numPixelsWritten;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The SSE2 and plain versions do exactly the same sums, in the same
+// order, so they draw exactly the same pixels.
+size_t SoftwareRasterizer::DrawTriangleInTile(const Triangle *pTriangle, int tileX, int tileY)
+{
+	int minX = std::max(pTriangle->minX, tileX);
+	int maxX = std::min(pTriangle->maxX, tileX + TILE_SIZE - 1);
+	int minY = std::max(pTriangle->minY, tileY);
+	int maxY = std::min(pTriangle->maxY, tileY + TILE_SIZE - 1);
+
+	// The edge functions relative to the tile's top left corner, so
+	// what's left to add per pixel is small. These are in double, so
+	// both triangles sharing an edge get exact negatives.
+	float edgeCs[3];
+
+	for (int i = 0; i < 3; ++i)
+		edgeCs[i] = float(double(pTriangle->edgeA[i]) * (double(tileX) - pTriangle->edgeX[i]) + double(pTriangle->edgeB[i]) * (double(tileY) - pTriangle->edgeY[i]));
+
+	bool depthTest = (pTriangle->flags & FLAG_DEPTH_TEST) != 0;
+	bool depthWrite = (pTriangle->flags & FLAG_DEPTH_WRITE) != 0;
+	bool blend = (pTriangle->flags & FLAG_BLEND) != 0;
+
+	const float (*pValues)[3] = pTriangle->values;
+
+	size_t numPixelsWritten = 0;
+
+#if SOFTWARE_RASTERIZER_SSE2
+
+	__m128 edgeAs[3], edgeBiases[3];
+
+	for (int i = 0; i < 3; ++i)
+	{
+		edgeAs[i] = _mm_set1_ps(pTriangle->edgeA[i]);
+		edgeBiases[i] = _mm_set1_ps(pTriangle->edgeBias[i]);
+	}
+
+	__m128 values[NUM_VALUES][3];
+
+	for (int i = 0; i < NUM_VALUES; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+			values[i][j] = _mm_set1_ps(pValues[i][j]);
+	}
+
+	const __m128 invDoubleArea = _mm_set1_ps(pTriangle->invDoubleArea);
+	const __m128 centres = _mm_setr_ps(.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 scale = _mm_set1_ps(255.f);
+	const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i firstXs = _mm_set1_epi32(minX - 1);
+	const __m128i lastXs = _mm_set1_epi32(maxX + 1);
+	const __m128i byteMask = _mm_set1_epi32(0xFF);
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		float v = float(y - tileY) + .5f;
+
+		__m128 rowEdges[3];
+
+		for (int i = 0; i < 3; ++i)
+			rowEdges[i] = _mm_set1_ps(pTriangle->edgeB[i] * v + edgeCs[i]);
+
+		float *pDepths = &m_depths[y * m_pitch];
+		uint32_t *pColours = &m_colours[y * m_pitch];
+
+		// The pitch is a multiple of 4, so there's always a whole 4.
+		for (int x = minX & ~3; x <= maxX; x += 4)
+		{
+			__m128 u = _mm_add_ps(_mm_set1_ps(float(x - tileX)), centres);
+
+			__m128 edges[3];
+
+			for (int i = 0; i < 3; ++i)
+				edges[i] = _mm_add_ps(_mm_mul_ps(edgeAs[i], u), rowEdges[i]);
+
+			__m128 mask = _mm_cmpgt_ps(edges[0], edgeBiases[0]);
+			mask = _mm_and_ps(mask, _mm_cmpgt_ps(edges[1], edgeBiases[1]));
+			mask = _mm_and_ps(mask, _mm_cmpgt_ps(edges[2], edgeBiases[2]));
+
+			__m128i xs = _mm_add_epi32(_mm_set1_epi32(x), lanes);
+			__m128i inside = _mm_and_si128(_mm_cmpgt_epi32(xs, firstXs), _mm_cmplt_epi32(xs, lastXs));
+			mask = _mm_and_ps(mask, _mm_castsi128_ps(inside));
+
+			if (_mm_movemask_ps(mask) == 0)
+				continue;
+
+			__m128 weight1 = _mm_mul_ps(edges[1], invDoubleArea);
+			__m128 weight2 = _mm_mul_ps(edges[2], invDoubleArea);
+
+			__m128 interpolated[NUM_VALUES];
+
+			for (int i = 0; i < NUM_VALUES; ++i)
+				interpolated[i] = _mm_add_ps(_mm_add_ps(values[i][0], _mm_mul_ps(weight1, values[i][1])), _mm_mul_ps(weight2, values[i][2]));
+
+			__m128 z = _mm_min_ps(_mm_max_ps(interpolated[VALUE_Z], zero), one);
+
+			if (depthTest)
+			{
+				__m128 depths = _mm_loadu_ps(pDepths + x);
+				mask = _mm_and_ps(mask, _mm_cmplt_ps(z, depths));
+
+				if (_mm_movemask_ps(mask) == 0)
+					continue;
+
+				if (depthWrite)
+					_mm_storeu_ps(pDepths + x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, depths)));
+			}
+
+			__m128 w = _mm_div_ps(one, interpolated[VALUE_INV_W]);
+
+			__m128 colour[4];
+
+			for (int i = 0; i < 4; ++i)
+				colour[i] = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_mul_ps(interpolated[VALUE_R + i], w), zero), one), scale);
+
+			__m128i oldColours = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pColours + x));
+
+			if (blend)
+			{
+				// SRC_ALPHA, INV_SRC_ALPHA for the colour; the alpha is
+				// the source's.
+				__m128 alpha = _mm_mul_ps(colour[3], _mm_set1_ps(1.f / 255.f));
+				__m128 invAlpha = _mm_sub_ps(one, alpha);
+
+				for (int i = 0; i < 3; ++i)
+				{
+					__m128 old = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(oldColours, i * 8), byteMask));
+					colour[i] = _mm_add_ps(_mm_mul_ps(colour[i], alpha), _mm_mul_ps(old, invAlpha));
+				}
+			}
+
+			__m128i newColours = _mm_cvtps_epi32(colour[0]);
+			newColours = _mm_or_si128(newColours, _mm_slli_epi32(_mm_cvtps_epi32(colour[1]), 8));
+			newColours = _mm_or_si128(newColours, _mm_slli_epi32(_mm_cvtps_epi32(colour[2]), 16));
+			newColours = _mm_or_si128(newColours, _mm_slli_epi32(_mm_cvtps_epi32(colour[3]), 24));
+
+			__m128i colourMask = _mm_castps_si128(mask);
+			newColours = _mm_or_si128(_mm_and_si128(colourMask, newColours), _mm_andnot_si128(colourMask, oldColours));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pColours + x), newColours);
+
+			static const int NUM_BITS_SET[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+			numPixelsWritten += NUM_BITS_SET[_mm_movemask_ps(mask)];
+		}
+	}
+
+#else
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		float v = float(y - tileY) + .5f;
+
+		float rowEdges[3];
+
+		for (int i = 0; i < 3; ++i)
+			rowEdges[i] = pTriangle->edgeB[i] * v + edgeCs[i];
+
+		float *pDepths = &m_depths[y * m_pitch];
+		uint32_t *pColours = &m_colours[y * m_pitch];
+
+		for (int x = minX; x <= maxX; ++x)
+		{
+			float u = float(x - tileX) + .5f;
+
+			float edges[3];
+
+			for (int i = 0; i < 3; ++i)
+				edges[i] = pTriangle->edgeA[i] * u + rowEdges[i];
+
+			if (!(edges[0] > pTriangle->edgeBias[0] && edges[1] > pTriangle->edgeBias[1] && edges[2] > pTriangle->edgeBias[2]))
+				continue;
+
+			float weight1 = edges[1] * pTriangle->invDoubleArea;
+			float weight2 = edges[2] * pTriangle->invDoubleArea;
+
+			float interpolated[NUM_VALUES];
+
+			for (int i = 0; i < NUM_VALUES; ++i)
+				interpolated[i] = (pValues[i][0] + weight1 * pValues[i][1]) + weight2 * pValues[i][2];
+
+			float z = Saturate(interpolated[VALUE_Z]);
+
+			if (depthTest)
+			{
+				if (!(z < pDepths[x]))
+					continue;
+
+				if (depthWrite)
+					pDepths[x] = z;
+			}
+
+			float w = 1.f / interpolated[VALUE_INV_W];
+
+			float colour[4];
+
+			for (int i = 0; i < 4; ++i)
+				colour[i] = Saturate(interpolated[VALUE_R + i] * w) * 255.f;
+
+			if (blend)
+			{
+				float alpha = colour[3] * (1.f / 255.f);
+				float invAlpha = 1.f - alpha;
+
+				for (int i = 0; i < 3; ++i)
+					colour[i] = colour[i] * alpha + float((pColours[x] >> (i * 8)) & 0xFF) * invAlpha;
+			}
+
+			uint32_t newColour = 0;
+
+			for (int i = 0; i < 4; ++i)
+				newColour |= uint32_t(lrintf(colour[i])) << (i * 8);
+
+			pColours[x] = newColour;
+
+			++numPixelsWritten;
+		}
+	}
+
+#endif
+
+	return numPixelsWritten;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,249 @@
+#ifndef HEADER_4F084968641E4642A141BC31ADFFA959
+#define HEADER_4F084968641E4642A141BC31ADFFA959
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Draws triangles into an image in memory, on the CPU, the same way
+// CommonApp's DrawUntextured/DrawUntexturedLit do on the GPU - the
+// same matrices, constant colour, lights (lit per vertex, as
+// g_aShader's GetLightingColour does), render states and
+// topologies - so things can be rendered where there's no D3D: on a
+// server, or under Linux, for thumbnails or for comparing against
+// reference images.
+//
+// The state functions mirror CommonApp's, taking arrays of floats
+// rather than XMFLOATs. The vertices are laid out as
+// Vertex_Pos3fColour4ub and Vertex_Pos3fColour4ubNormal3f are, and
+// there's no index or vertex buffer: the Draw functions take
+// pointers, and are finished with them when they return.
+//
+// Draw only transforms, lights, clips and sets up the triangles, and
+// sorts them into the 64x64 pixel tiles they touch. Flush does the
+// rest, one tile per job on worker threads (see RunParallelJobs). Each
+// tile draws its triangles in the order they were submitted and
+// touches only its own pixels, so the image is the same however many
+// threads there are. Each pixel is tested against the triangle's
+// edges 4 at a time with SSE2, where it's available.
+//
+// Pixels are lit if their centres are inside the triangle, with D3D's
+// top-left rule for centres exactly on an edge, and the edges are
+// worked out the same way for both triangles that share them, so
+// meshes have no gaps or doubly drawn pixels.
+//
+// There's no D3D in here.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct SoftwareRasterizerStats
+{
+	size_t numDraws;
+
+	// Triangles passed to the Draw functions; those that survived
+	// culling and clipping (a clipped triangle may become several);
+	// and the total number of tiles they were sorted into.
+	size_t numTrianglesSubmitted;
+	size_t numTrianglesDrawn;
+	size_t numTrianglesBinned;
+
+	size_t numPixelsWritten;
+
+	// Time spent in the Draw functions, and in Flush.
+	double setupSeconds;
+	double rasterSeconds;
+
+	SoftwareRasterizerStats();
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class SoftwareRasterizer
+{
+public:
+	static const int MAX_NUM_LIGHTS = 4;
+	static const int TILE_SIZE = 64;
+
+	enum Topology
+	{
+		Topology_TriangleList,
+		Topology_TriangleStrip,
+	};
+
+	SoftwareRasterizer();
+	~SoftwareRasterizer();
+
+	// maxNumThreads is as for RunParallelJobs; 0 is one per core.
+	bool Create(int width, int height, unsigned maxNumThreads);
+	void Destroy();
+
+	int GetWidth() const;
+	int GetHeight() const;
+
+	// Matrices are 16 floats, row by row, for row vectors (as XMFLOAT4X4).
+	void SetWorldMatrix(const float *pWorldMtx);
+	void SetViewMatrix(const float *pViewMtx);
+	void SetProjectionMatrix(const float *pProjectionMtx);
+
+	void SetConstantColour(const float *pConstantColour);
+
+	void DisableLight(int light);
+	void EnableDirectionalLight(int light, const float *pWorldDirection, const float *pDiffuseColour);
+	void EnablePointLight(int light, const float *pWorldPosition, const float *pDiffuseColour);
+	void EnableSpotLight(int light, const float *pWorldPosition, const float *pWorldDirection, float theta, float phi, float falloff, const float *pDiffuseColour);
+	void SetLightAttenuation(int light, float range, float a0, float a1, float a2);
+
+	// Defaults as CommonApp's: blending on, depth test and write on, no
+	// back face culling. Front faces are clockwise.
+	void SetBlendState(bool blendEnable);
+	void SetDepthStencilState(bool depthTest, bool depthWrite);
+	void SetRasterizerState(bool backFaceCull);
+
+	// Clears the colours, and sets the depths to 1. Draws anything
+	// waiting first.
+	void Clear(const float *pClearColour);
+
+	// pIndices may be NULL, for vertices in order.
+	void DrawUntextured(Topology topology, const void *pVertices, const uint16_t *pIndices, unsigned numItems);
+	void DrawUntexturedLit(Topology topology, const void *pVertices, const uint16_t *pIndices, unsigned numItems);
+
+	// As CommonApp::DrawWithShader, with lit choosing between the two
+	// vertex layouts (and shaders).
+	void DrawWithShader(Topology topology, const void *pVertices, size_t vertexStride, bool lit, const uint16_t *pIndices, unsigned firstItem, unsigned numItems, int baseVertex);
+
+	// Draws the triangles submitted since the last Flush.
+	void Flush();
+
+	// Flush first. Row by row, GetPitch pixels apart; each pixel is
+	// 4 bytes, r, g, b, a.
+	const uint32_t *GetColours() const;
+	size_t GetPitch() const;
+
+	// Binary PPM, and uncompressed PNG. The alpha is dropped.
+	bool WritePPM(const char *pFileName) const;
+	bool WritePNG(const char *pFileName) const;
+
+	const SoftwareRasterizerStats &GetStats() const;
+	void ResetStats();
+protected:
+private:
+	// Packed as DrawWithShader packs CommonApp's lights for the shader.
+	struct Light
+	{
+		bool enabled;
+		float direction[4];
+		float position[4];
+		float colour[3];
+		float attenuations[4];
+		float spots[4];
+
+		Light();
+	};
+
+	// A vertex after the vertex shader, and which planes it's outside.
+	struct ClipVertex
+	{
+		float pos[4];
+		float colour[4];
+		unsigned clipCodes;
+	};
+
+	enum
+	{
+		VALUE_Z,
+		VALUE_INV_W,
+		VALUE_R,// divided by w, as are g, b and a
+		VALUE_G,
+		VALUE_B,
+		VALUE_A,
+		NUM_VALUES,
+	};
+
+	static const uint8_t FLAG_DEPTH_TEST = 1 << 0;
+	static const uint8_t FLAG_DEPTH_WRITE = 1 << 1;
+	static const uint8_t FLAG_BLEND = 1 << 2;
+
+	// A triangle ready to draw.
+	struct Triangle
+	{
+		// Pixels whose centres are in its bounding box, inclusive.
+		int minX, minY, maxX, maxY;
+
+		// Edge i is opposite vertex i. It's
+		// edgeA*(x - edgeX) + edgeB*(y - edgeY), which is positive
+		// inside, or 0 for points on the edge, which are inside if
+		// it's a top or left edge. It's > edgeBias inside.
+		float edgeA[3];
+		float edgeB[3];
+		float edgeX[3];
+		float edgeY[3];
+		float edgeBias[3];
+
+		// Edge i over twice the area is the weight of vertex i.
+		float invDoubleArea;
+
+		// Each value at vertex 0, and vertex 1's and 2's minus vertex 0's.
+		float values[NUM_VALUES][3];
+
+		uint8_t flags;
+	};
+
+	int m_width;
+	int m_height;
+	size_t m_pitch;
+	unsigned m_maxNumThreads;
+
+	std::vector<uint32_t> m_colours;
+	std::vector<float> m_depths;
+
+	int m_numTilesX;
+	int m_numTilesY;
+
+	// Indexes into m_triangles, one list per tile.
+	std::vector<std::vector<uint32_t> > m_bins;
+	std::vector<Triangle> m_triangles;
+
+	// Scratch space for DrawWithShader and Flush.
+	std::vector<ClipVertex> m_clipVertices;
+	std::vector<size_t> m_busyTiles;
+	std::vector<size_t> m_numTilePixelsWritten;
+
+	// Current settings
+	float m_worldMtx[16];
+	float m_viewMtx[16];
+	float m_projectionMtx[16];
+	float m_constantColour[4];
+	Light m_lights[MAX_NUM_LIGHTS];
+	uint8_t m_flags;
+	bool m_backFaceCull;
+
+	SoftwareRasterizerStats m_stats;
+
+	void TransformVertices(const void *pVertices, size_t vertexStride, bool lit, unsigned firstVertex, unsigned numVertices);
+	void GetLightingColour(const float *pWorldPos, const float *pN, float *pColour) const;
+
+	// pClipVertices are indexes into m_clipVertices.
+	void AddTriangle(const unsigned *pClipVertices);
+	void ClipTriangle(const ClipVertex *pVertices, unsigned clipCodes);
+	void SetUpTriangle(const ClipVertex *pV0, const ClipVertex *pV1, const ClipVertex *pV2);
+
+	size_t DrawTile(size_t tileIndex);
+	size_t DrawTriangleInTile(const Triangle *pTriangle, int tileX, int tileY);
+
+	SoftwareRasterizer(const SoftwareRasterizer &);
+	SoftwareRasterizer &operator=(const SoftwareRasterizer &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_4F084968641E4642A141BC31ADFFA959
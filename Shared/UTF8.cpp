@@ -0,0 +1,69 @@
+#include "UTF8.h"
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+uint32_t DecodeUTF8(const char **ppStr)
+{
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(*ppStr);
+
+	uint32_t ch;
+	int numTrailing;
+
+	// The smallest code point that needs this many bytes; anything
+	// below it could have been written shorter.
+	uint32_t minCh;
+
+	if (p[0] < 0x80)
+	{
+		++*ppStr;
+		return p[0];
+	}
+	else if ((p[0] & 0xE0) == 0xC0)
+	{
+		ch = p[0] & 0x1F;
+		numTrailing = 1;
+		minCh = 0x80;
+	}
+	else if ((p[0] & 0xF0) == 0xE0)
+	{
+		ch = p[0] & 0x0F;
+		numTrailing = 2;
+		minCh = 0x800;
+	}
+	else if ((p[0] & 0xF8) == 0xF0)
+	{
+		ch = p[0] & 0x07;
+		numTrailing = 3;
+		minCh = 0x10000;
+	}
+	else
+	{
+		++*ppStr;
+		return UTF8_REPLACEMENT_CHAR;
+	}
+
+	// Stops at the terminating 0, as that's not a trailing byte.
+	for (int i = 1; i <= numTrailing; ++i)
+	{
+		if ((p[i] & 0xC0) != 0x80)
+		{
+			++*ppStr;
+			return UTF8_REPLACEMENT_CHAR;
+		}
+
+		ch = (ch << 6) | (p[i] & 0x3F);
+	}
+
+	if (ch < minCh || (ch >= 0xD800 && ch <= 0xDFFF) || ch > 0x10FFFF)
+	{
+		++*ppStr;
+		return UTF8_REPLACEMENT_CHAR;
+	}
+
+	*ppStr += 1 + numTrailing;
+	return ch;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,31 @@
+#ifndef HEADER_08A8EAAF8A334BCA916D4C5FA471062D
+#define HEADER_08A8EAAF8A334BCA916D4C5FA471062D
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Reading Unicode code points out of UTF-8 strings, for the font code.
+//
+// There's no D3D in here, and no Windows either.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static const uint32_t UTF8_REPLACEMENT_CHAR = 0xFFFD;
+
+// Returns the next code point and advances *ppStr past it. Anything
+// that isn't valid UTF-8 comes out as UTF8_REPLACEMENT_CHAR, one byte
+// at a time: bad lead or trailing bytes, overlong encodings,
+// surrogates (U+D800-U+DFFF) and anything above U+10FFFF. The string
+// mustn't be at its terminating 0.
+uint32_t DecodeUTF8(const char **ppStr);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_08A8EAAF8A334BCA916D4C5FA471062D
@@ -0,0 +1,237 @@
+#include "UploadRing.h"
+
+#include <assert.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+UploadRing::UploadRing():
+m_pBuffer(NULL),
+m_fence(0),
+m_completedFence(0),
+m_discard(false),
+m_numWaits(0)
+{
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		m_apQueries[i] = NULL;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+UploadRing::~UploadRing()
+{
+	this->Destroy();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool UploadRing::Create(ID3D11Device *pDevice, UINT size, UINT bindFlags)
+{
+	this->Destroy();
+
+	if (!m_allocator.Create(size))
+		return false;
+
+	m_pBuffer = CreateBuffer(pDevice, size, D3D11_USAGE_DYNAMIC, bindFlags, D3D11_CPU_ACCESS_WRITE, NULL);
+	if (!m_pBuffer)
+	{
+		this->Destroy();
+		return false;
+	}
+
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	{
+		D3D11_QUERY_DESC desc;
+
+		desc.Query = D3D11_QUERY_EVENT;
+		desc.MiscFlags = 0;
+
+		if (FAILED(pDevice->CreateQuery(&desc, &m_apQueries[i])))
+		{
+			m_apQueries[i] = NULL;
+
+			this->Destroy();
+			return false;
+		}
+	}
+
+	// Fence 0 counts as done, so there's nothing to wait for to start
+	// with.
+	m_fence = 1;
+	m_completedFence = 0;
+	m_discard = true;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void UploadRing::Destroy()
+{
+	Release(m_pBuffer);
+
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		Release(m_apQueries[i]);
+
+	m_allocator.Destroy();
+
+	m_fence = 0;
+	m_completedFence = 0;
+	m_discard = false;
+	m_numWaits = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void UploadRing::BeginFrame(ID3D11DeviceContext *pContext)
+{
+	this->PollFrames(pContext, false);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void UploadRing::EndFrame(ID3D11DeviceContext *pContext)
+{
+	if (!m_pBuffer)
+		return;
+
+	// This frame's query is the one from MAX_FRAMES_IN_FLIGHT frames
+	// ago, so that frame has to be done first.
+	while (m_completedFence + MAX_FRAMES_IN_FLIGHT < m_fence)
+		this->PollFrames(pContext, true);
+
+	pContext->End(m_apQueries[m_fence % MAX_FRAMES_IN_FLIGHT]);
+
+	m_allocator.EndFrame(m_fence);
+	++m_fence;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool UploadRing::Upload(ID3D11DeviceContext *pContext, const void *pData, UINT numBytes, UINT alignment, UINT *pOffset)
+{
+	if (!m_pBuffer)
+		return false;
+
+	size_t offset;
+	while (!m_allocator.Allocate(numBytes, alignment, &offset))
+	{
+		// Once there's nothing left to wait for, it's never going to
+		// fit.
+		if (!this->PollFrames(pContext, true))
+			return false;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE ms;
+	if (FAILED(pContext->Map(m_pBuffer, 0, m_discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &ms)))
+		return false;
+
+	memcpy(static_cast<uint8_t *>(ms.pData) + offset, pData, numBytes);
+
+	pContext->Unmap(m_pBuffer, 0);
+
+	m_discard = false;
+
+	*pOffset = UINT(offset);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool UploadRing::CopyToBuffer(ID3D11DeviceContext *pContext, const void *pData, UINT numBytes, ID3D11Buffer *pDestBuffer, UINT destOffset)
+{
+	// Buffer copies can go from anywhere, but 16 keeps the memcpy in
+	// Upload lined up.
+	UINT offset;
+	if (!this->Upload(pContext, pData, numBytes, 16, &offset))
+		return false;
+
+	D3D11_BOX box;
+
+	box.left = offset;
+	box.right = offset + numBytes;
+	box.top = 0;
+	box.bottom = 1;
+	box.front = 0;
+	box.back = 1;
+
+	pContext->CopySubresourceRegion(pDestBuffer, 0, destOffset, 0, 0, m_pBuffer, 0, &box);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+ID3D11Buffer *UploadRing::GetBuffer() const
+{
+	return m_pBuffer;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+const RingAllocatorStats &UploadRing::GetStats() const
+{
+	return m_allocator.GetStats();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+size_t UploadRing::GetNumWaits() const
+{
+	return m_numWaits;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Retires the frames the GPU's finished, oldest first. If wait is set
+// and none have finished, waits for the oldest. Returns true if any
+// were retired.
+bool UploadRing::PollFrames(ID3D11DeviceContext *pContext, bool wait)
+{
+	bool anyRetired = false;
+
+	while (m_completedFence + 1 < m_fence)
+	{
+		ID3D11Query *pQuery = m_apQueries[(m_completedFence + 1) % MAX_FRAMES_IN_FLIGHT];
+
+		HRESULT hr = pContext->GetData(pQuery, NULL, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH);
+		if (hr == S_FALSE)
+		{
+			if (!wait || anyRetired)
+				break;
+
+			++m_numWaits;
+
+			// Without DONOTFLUSH, so the commands are sure to get to the
+			// GPU.
+			do
+				hr = pContext->GetData(pQuery, NULL, 0, 0);
+			while (hr == S_FALSE);
+		}
+
+		// Anything other than S_FALSE (including the device going away)
+		// means there's no point waiting any more.
+		++m_completedFence;
+		m_allocator.Retire(m_completedFence);
+
+		anyRetired = true;
+	}
+
+	return anyRetired;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,98 @@
+#ifndef HEADER_EADC5AF8D3D74CBEB19F026DF23397C1
+#define HEADER_EADC5AF8D3D74CBEB19F026DF23397C1
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// A big dynamic buffer that data on its way to the GPU is copied
+// into, a bit at a time, instead of each lot of data having a buffer
+// of its own.
+//
+// Each Upload finds room with a RingAllocator, and maps the buffer
+// with D3D11_MAP_WRITE_NO_OVERWRITE, which promises the driver that
+// nothing the GPU might still be reading is touched, so it doesn't
+// have to wait, or make a new copy of the buffer. That promise is
+// kept by putting an event query in at the end of each frame, and only
+// reusing a frame's part of the ring once its query says the GPU's
+// got past it.
+//
+// Up to MAX_FRAMES_IN_FLIGHT frames can be waiting for the GPU. Any
+// more, or an Upload that doesn't fit until an older frame's done, and
+// the CPU waits. An Upload that doesn't fit even then (because the
+// current frame has filled the ring) fails, and the caller should do
+// it some other way.
+//
+// What's uploaded can be drawn from the ring's buffer directly (if it
+// was created with the right bind flags) or copied on to somewhere
+// that lasts, with CopyToBuffer.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include "D3DHelpers.h"
+#include "RingAllocator.h"
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class UploadRing
+{
+public:
+	static const int MAX_FRAMES_IN_FLIGHT = 3;
+
+	UploadRing();
+	~UploadRing();
+
+	// bindFlags are for the ring's buffer. (A dynamic buffer has to be
+	// bound as something, even if it's only copied from.)
+	bool Create(ID3D11Device *pDevice, UINT size, UINT bindFlags);
+	void Destroy();
+
+	// Call at the start and end of each frame's rendering. BeginFrame
+	// frees the space of frames the GPU has finished with.
+	void BeginFrame(ID3D11DeviceContext *pContext);
+	void EndFrame(ID3D11DeviceContext *pContext);
+
+	// Copies numBytes into the ring, at *pOffset bytes into GetBuffer.
+	// alignment is a power of 2.
+	bool Upload(ID3D11DeviceContext *pContext, const void *pData, UINT numBytes, UINT alignment, UINT *pOffset);
+
+	// Uploads numBytes, then has the GPU copy them to pDestBuffer, at
+	// destOffset bytes in. pDestBuffer must be D3D11_USAGE_DEFAULT.
+	bool CopyToBuffer(ID3D11DeviceContext *pContext, const void *pData, UINT numBytes, ID3D11Buffer *pDestBuffer, UINT destOffset);
+
+	ID3D11Buffer *GetBuffer() const;
+
+	const RingAllocatorStats &GetStats() const;
+
+	// Times the CPU's had to wait for the GPU, to finish with a frame
+	// or to make room.
+	size_t GetNumWaits() const;
+protected:
+private:
+	ID3D11Buffer *m_pBuffer;
+	RingAllocator m_allocator;
+
+	// Frame fence's query is m_apQueries[fence % MAX_FRAMES_IN_FLIGHT].
+	ID3D11Query *m_apQueries[MAX_FRAMES_IN_FLIGHT];
+
+	// The fence of the frame being rendered, and of the last one the
+	// GPU finished.
+	uint64_t m_fence;
+	uint64_t m_completedFence;
+
+	// The first Map after creating the buffer has to be a discard.
+	bool m_discard;
+
+	size_t m_numWaits;
+
+	bool PollFrames(ID3D11DeviceContext *pContext, bool wait);
+
+	UploadRing(const UploadRing &);
+	UploadRing &operator=(const UploadRing &);
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_EADC5AF8D3D74CBEB19F026DF23397C1
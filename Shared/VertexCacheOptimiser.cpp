@@ -0,0 +1,331 @@
+#include "VertexCacheOptimiser.h"
+
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Size of the simulated LRU cache used for scoring. This is a bit
+// larger than any real cache, which Forsyth found works better than
+// matching it exactly.
+static const size_t SCORING_CACHE_SIZE = 32;
+
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRI_SCORE = .75f;
+static const float VALENCE_BOOST_SCALE = 2.f;
+static const float VALENCE_BOOST_POWER = .5f;
+
+// Valences above this all score the same.
+static const size_t MAX_SCORED_VALENCE = 32;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	struct ScoreTables
+	{
+		float cache[SCORING_CACHE_SIZE];
+		float valence[MAX_SCORED_VALENCE + 1];
+
+		ScoreTables()
+		{
+			for (size_t i = 0; i < SCORING_CACHE_SIZE; ++i)
+			{
+				if (i < 3)
+				{
+					// The vertices of the last triangle were just used,
+					// so they get a fixed score; otherwise the
+					// optimiser would be too keen on long thin strips.
+					this->cache[i] = LAST_TRI_SCORE;
+				}
+				else
+				{
+					float scaler = 1.f / (SCORING_CACHE_SIZE - 3);
+					this->cache[i] = powf(1.f - (i - 3) * scaler, CACHE_DECAY_POWER);
+				}
+			}
+
+			this->valence[0] = 0.f;
+
+			for (size_t i = 1; i <= MAX_SCORED_VALENCE; ++i)
+				this->valence[i] = VALENCE_BOOST_SCALE * powf(float(i), -VALENCE_BOOST_POWER);
+		}
+	};
+
+	struct OptVertex
+	{
+		int cachePos;
+		float score;
+
+		// Range in the triangle list, and how much of it is still to
+		// be added. The triangles still to go are at the start.
+		size_t firstTri;
+		size_t numActiveTris;
+	};
+}
+
+static const ScoreTables g_scoreTables;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float GetVertexScore(const OptVertex *pVertex)
+{
+	if (pVertex->numActiveTris == 0)
+		return -1.f;// nothing left to draw with it
+
+	float score = 0.f;
+
+	if (pVertex->cachePos >= 0)
+		score += g_scoreTables.cache[pVertex->cachePos];
+
+	if (pVertex->numActiveTris <= MAX_SCORED_VALENCE)
+		score += g_scoreTables.valence[pVertex->numActiveTris];
+	else
+		score += g_scoreTables.valence[MAX_SCORED_VALENCE];
+
+	return score;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void OptimiseVertexCache(uint16_t *pIndices, size_t numIndices, size_t numVertices)
+{
+	size_t numTris = numIndices / 3;
+	if (numTris == 0 || numVertices == 0)
+		return;
+
+	std::vector<OptVertex> vertices(numVertices);
+	std::vector<float> triScores(numTris, 0.f);
+	std::vector<bool> triAdded(numTris, false);
+
+	// Build the vertex->triangle lists.
+	for (size_t i = 0; i < numVertices; ++i)
+	{
+		vertices[i].cachePos = -1;
+		vertices[i].score = 0.f;
+		vertices[i].firstTri = 0;
+		vertices[i].numActiveTris = 0;
+	}
+
+	for (size_t i = 0; i < numTris * 3; ++i)
+	{
+		assert(pIndices[i] < numVertices);
+		++vertices[pIndices[i]].numActiveTris;
+	}
+
+	size_t offset = 0;
+
+	for (size_t i = 0; i < numVertices; ++i)
+	{
+		vertices[i].firstTri = offset;
+		offset += vertices[i].numActiveTris;
+		vertices[i].numActiveTris = 0;
+	}
+
+	std::vector<uint32_t> vertexTris(offset);
+
+	for (size_t tri = 0; tri < numTris; ++tri)
+	{
+		for (size_t corner = 0; corner < 3; ++corner)
+		{
+			OptVertex *pVertex = &vertices[pIndices[tri * 3 + corner]];
+			vertexTris[pVertex->firstTri + pVertex->numActiveTris++] = uint32_t(tri);
+		}
+	}
+
+	for (size_t i = 0; i < numVertices; ++i)
+		vertices[i].score = GetVertexScore(&vertices[i]);
+
+	for (size_t tri = 0; tri < numTris; ++tri)
+	{
+		for (size_t corner = 0; corner < 3; ++corner)
+			triScores[tri] += vertices[pIndices[tri * 3 + corner]].score;
+	}
+
+	// The cache holds up to 3 extra entries while a triangle is being
+	// added.
+	std::vector<uint16_t> newIndices(numTris * 3);
+
+	uint16_t cache[SCORING_CACHE_SIZE + 3];
+	size_t cacheSize = 0;
+
+	uint16_t newCache[SCORING_CACHE_SIZE + 3];
+
+	size_t bestTri = numTris;
+	float bestScore = -1.f;
+
+	// If nothing in the cache is usable, the next triangle is found by
+	// scanning forward from here. Everything before it has been added.
+	size_t scanTri = 0;
+
+	for (size_t numAdded = 0; numAdded < numTris; ++numAdded)
+	{
+		if (bestTri == numTris)
+		{
+			// Nothing in the cache. Ideally this would pick the best
+			// scoring triangle overall, but that's O(n) per pick,
+			// and the first one left is nearly as good.
+			while (triAdded[scanTri])
+				++scanTri;
+
+			bestTri = scanTri;
+		}
+
+		const uint16_t *pTri = &pIndices[bestTri * 3];
+
+		newIndices[numAdded * 3 + 0] = pTri[0];
+		newIndices[numAdded * 3 + 1] = pTri[1];
+		newIndices[numAdded * 3 + 2] = pTri[2];
+
+		triAdded[bestTri] = true;
+
+		// Take the triangle out of its vertices' active lists.
+		for (size_t corner = 0; corner < 3; ++corner)
+		{
+			OptVertex *pVertex = &vertices[pTri[corner]];
+			uint32_t *pTris = &vertexTris[pVertex->firstTri];
+
+			for (size_t i = 0; i < pVertex->numActiveTris; ++i)
+			{
+				if (pTris[i] == bestTri)
+				{
+					pTris[i] = pTris[pVertex->numActiveTris - 1];
+					pTris[pVertex->numActiveTris - 1] = uint32_t(bestTri);
+					--pVertex->numActiveTris;
+					break;
+				}
+			}
+		}
+
+		// The triangle's vertices go to the front of the cache; the
+		// old entries follow in order, minus duplicates.
+		size_t newCacheSize = 0;
+
+		for (size_t corner = 0; corner < 3; ++corner)
+			newCache[newCacheSize++] = pTri[corner];
+
+		for (size_t i = 0; i < cacheSize; ++i)
+		{
+			uint16_t idx = cache[i];
+
+			if (idx != pTri[0] && idx != pTri[1] && idx != pTri[2])
+				newCache[newCacheSize++] = idx;
+		}
+
+		// Rescore everything that was in the cache. Entries that have
+		// fallen off the end lose their cache bonus.
+		bestTri = numTris;
+		bestScore = -1.f;
+
+		for (size_t i = 0; i < newCacheSize; ++i)
+		{
+			OptVertex *pVertex = &vertices[newCache[i]];
+
+			pVertex->cachePos = i < SCORING_CACHE_SIZE ? int(i) : -1;
+
+			float oldScore = pVertex->score;
+			pVertex->score = GetVertexScore(pVertex);
+
+			float delta = pVertex->score - oldScore;
+
+			const uint32_t *pTris = &vertexTris[pVertex->firstTri];
+
+			for (size_t j = 0; j < pVertex->numActiveTris; ++j)
+			{
+				uint32_t tri = pTris[j];
+
+				triScores[tri] += delta;
+
+				if (triScores[tri] > bestScore)
+				{
+					bestScore = triScores[tri];
+					bestTri = tri;
+				}
+			}
+		}
+
+		cacheSize = newCacheSize < SCORING_CACHE_SIZE ? newCacheSize : SCORING_CACHE_SIZE;
+		memcpy(cache, newCache, cacheSize * sizeof cache[0]);
+	}
+
+	memcpy(pIndices, &newIndices[0], numTris * 3 * sizeof(uint16_t));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void OptimiseVertexFetch(void *pVertices, size_t numVertices, size_t vertexStride, uint16_t *pIndices, size_t numIndices)
+{
+	static const uint32_t UNUSED = ~uint32_t(0);
+
+	std::vector<uint32_t> remap(numVertices, UNUSED);
+	uint32_t numUsed = 0;
+
+	for (size_t i = 0; i < numIndices; ++i)
+	{
+		uint16_t idx = pIndices[i];
+		assert(idx < numVertices);
+
+		if (remap[idx] == UNUSED)
+			remap[idx] = numUsed++;
+
+		pIndices[i] = uint16_t(remap[idx]);
+	}
+
+	for (size_t i = 0; i < numVertices; ++i)
+	{
+		if (remap[i] == UNUSED)
+			remap[i] = numUsed++;
+	}
+
+	const char *pSrc = static_cast<const char *>(pVertices);
+	std::vector<char> newVertices(numVertices * vertexStride);
+
+	for (size_t i = 0; i < numVertices; ++i)
+		memcpy(&newVertices[remap[i] * vertexStride], pSrc + i * vertexStride, vertexStride);
+
+	if (!newVertices.empty())
+		memcpy(pVertices, &newVertices[0], newVertices.size());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void AnalyseVertexCache(const uint16_t *pIndices, size_t numIndices, size_t numVertices, size_t cacheSize, VertexCacheStats *pStats)
+{
+	// FIFO: each vertex records when it was put in the cache. It's
+	// still there if fewer than cacheSize vertices have gone in since.
+	std::vector<size_t> insertTime(numVertices, 0);
+	size_t time = 0;
+
+	pStats->numTransformed = 0;
+
+	for (size_t i = 0; i < numIndices; ++i)
+	{
+		size_t idx = pIndices[i];
+		assert(idx < numVertices);
+
+		if (insertTime[idx] == 0 || time - insertTime[idx] >= cacheSize)
+		{
+			++time;
+			insertTime[idx] = time;
+
+			++pStats->numTransformed;
+		}
+	}
+
+	size_t numTris = numIndices / 3;
+
+	pStats->acmr = numTris > 0 ? float(pStats->numTransformed) / numTris : 0.f;
+	pStats->atvr = numVertices > 0 ? float(pStats->numTransformed) / numVertices : 0.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,64 @@
+#ifndef HEADER_B936BE73274549A08C119AE374614698
+#define HEADER_B936BE73274549A08C119AE374614698
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Index and vertex reordering for indexed triangle lists.
+//
+// OptimiseVertexCache reorders the triangles so that vertices are
+// reused while they're still in the GPU's post-transform cache. It's
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": each
+// vertex gets a score from its position in a simulated LRU cache and
+// from how many triangles still use it, and the triangle with the
+// best total goes next.
+//
+// OptimiseVertexFetch then reorders the vertices into the order the
+// triangles first use them, so the vertex fetches walk through memory
+// roughly sequentially too.
+//
+// AnalyseVertexCache measures the result with a FIFO cache model:
+//
+//     ACMR - vertices transformed per triangle (best 0.5, worst 3)
+//     ATVR - vertices transformed per vertex (best 1)
+//
+// Nothing here is D3D-specific.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Reorder the triangles in pIndices. Every index must be less than
+// numVertices.
+void OptimiseVertexCache(uint16_t *pIndices, size_t numIndices, size_t numVertices);
+
+// Reorder the vertices in pVertices and update pIndices to match.
+// Vertices no triangle uses end up at the end, in their original
+// order.
+void OptimiseVertexFetch(void *pVertices, size_t numVertices, size_t vertexStride, uint16_t *pIndices, size_t numIndices);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct VertexCacheStats
+{
+	size_t numTransformed;
+
+	float acmr;
+	float atvr;
+};
+
+// 16 entries is a reasonable stand-in for typical hardware.
+static const size_t DEFAULT_VERTEX_CACHE_SIZE = 16;
+
+void AnalyseVertexCache(const uint16_t *pIndices, size_t numIndices, size_t numVertices, size_t cacheSize, VertexCacheStats *pStats);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_B936BE73274549A08C119AE374614698
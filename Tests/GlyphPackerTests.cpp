@@ -0,0 +1,137 @@
+#include "Test.h"
+
+#include "GlyphPacker.h"
+
+#include <stdio.h>
+
+#include <random>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool Overlap(const GlyphAtlasRect &a, const GlyphAtlasRect &b, int padding)
+{
+	return a.x < b.x + b.width + padding && b.x < a.x + a.width + padding &&
+		a.y < b.y + b.height + padding && b.y < a.y + a.height + padding;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(SkylinePackerFillsRowsBottomUp)
+{
+	SkylinePacker packer;
+	packer.Reset(100);
+
+	int x, y;
+
+	REQUIRE(packer.Insert(60, 10, &x, &y));
+	CHECK(x == 0 && y == 0);
+
+	// Goes alongside, as that's lowest.
+	REQUIRE(packer.Insert(40, 20, &x, &y));
+	CHECK(x == 60 && y == 0);
+
+	// Sits on the lower of the two.
+	REQUIRE(packer.Insert(50, 5, &x, &y));
+	CHECK(x == 0 && y == 10);
+
+	CHECK(packer.GetUsedHeight() == 20);
+	CHECK(packer.GetWidth() == 100);
+
+	CHECK(!packer.Insert(101, 1, &x, &y));
+
+	// Exactly as wide as the bin fits, on top of everything.
+	REQUIRE(packer.Insert(100, 1, &x, &y));
+	CHECK(x == 0 && y == 20);
+	CHECK(packer.GetUsedHeight() == 21);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(PackGlyphAtlasLeavesPaddingBetweenGlyphs)
+{
+	std::mt19937 random(1);
+
+	static const int HEIGHTS[] = {8, 12, 24, 48, 96};
+	static const int PADDINGS[] = {0, 2, 7};
+
+	for (int height : HEIGHTS)
+	{
+		for (int padding : PADDINGS)
+		{
+			std::vector<GlyphAtlasRect> rects(300);
+			double glyphArea = 0., paddedArea = 0.;
+
+			for (size_t i = 0; i < rects.size(); ++i)
+			{
+				rects[i].width = height / 4 + int(random() % unsigned(height));
+				rects[i].height = height + int(random() % unsigned(height / 4 + 1));
+				glyphArea += double(rects[i].width) * rects[i].height;
+				paddedArea += double(rects[i].width + padding) * (rects[i].height + padding);
+			}
+
+			GlyphAtlasInfo info;
+			REQUIRE(PackGlyphAtlas(&rects[0], rects.size(), padding, 4096, &info));
+
+			CHECK((info.width & (info.width - 1)) == 0);
+			CHECK(info.height % 4 == 0);
+			CHECK(info.height <= 4096);
+			CHECK_CLOSE(info.efficiency, glyphArea / (double(info.width) * info.height), 1e-5);
+
+			// The skyline doesn't waste much, padding aside.
+			CHECK(paddedArea / (double(info.width) * info.height) > .75);
+
+			printf("    %dpx, padding %d: %dx%d, %.1f%% glyphs, %.1f%% with padding\n",
+				height, padding, info.width, info.height, info.efficiency * 100., paddedArea / (double(info.width) * info.height) * 100.);
+
+			for (size_t i = 0; i < rects.size(); ++i)
+			{
+				const GlyphAtlasRect &a = rects[i];
+
+				CHECK(a.x >= 0 && a.y >= 0);
+				CHECK(a.x + a.width + padding <= info.width);
+				CHECK(a.y + a.height + padding <= info.height);
+
+				for (size_t j = i + 1; j < rects.size(); ++j)
+				{
+					if (Overlap(a, rects[j], padding))
+					{
+						CHECK(!"padded glyphs overlap");
+						return;
+					}
+				}
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(PackGlyphAtlasFailsPastMaxSize)
+{
+	std::vector<GlyphAtlasRect> rects(64);
+
+	for (size_t i = 0; i < rects.size(); ++i)
+	{
+		rects[i].width = 30;
+		rects[i].height = 30;
+	}
+
+	// 64 32x32 padded glyphs is 256x256 exactly.
+	GlyphAtlasInfo info;
+	CHECK(PackGlyphAtlas(&rects[0], rects.size(), 2, 256, &info));
+	CHECK(info.width == 256 && info.height == 256);
+
+	CHECK(!PackGlyphAtlas(&rects[0], rects.size(), 3, 256, &info));
+
+	// One glyph wider than the limit.
+	GlyphAtlasRect wide = {0, 0, 300, 10};
+	CHECK(!PackGlyphAtlas(&wide, 1, 0, 256, &info));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
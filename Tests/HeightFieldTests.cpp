@@ -0,0 +1,401 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "HeightField.h"
+#include "ParallelJobs.h"
+#include "TerrainGrid.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float GetPlaneHeight(float x, float z)
+{
+	return 3.f + .25f * x - .5f * z;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float GetRandomFloat(float minValue, float maxValue)
+{
+	return minValue + (maxValue - minValue) * (rand() / float(RAND_MAX));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(HeightFieldHitsGridPoints)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 33, 20, 2.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	CHECK(heightField.GetWidth() == 33);
+	CHECK(heightField.GetLength() == 20);
+	CHECK(heightField.GetColumnStepX() == 2.f);
+	CHECK(heightField.GetRowStepZ() == -2.f);
+
+	for (int row = 0; row < grid.GetLength(); ++row)
+	{
+		for (int col = 0; col < grid.GetWidth(); ++col)
+		{
+			float x = grid.GetOriginX() + col * grid.GetColumnStepX();
+			float z = grid.GetOriginZ() + row * grid.GetRowStepZ();
+			float height = grid.GetHeights()[row * grid.GetPitch() + col];
+
+			CHECK_CLOSE(heightField.GetHeight(x, z, HEIGHT_FIELD_FILTER_BILINEAR), height, 1e-4);
+			CHECK_CLOSE(heightField.GetHeight(x, z, HEIGHT_FIELD_FILTER_BICUBIC), height, 1e-4);
+			CHECK(heightField.GetGridHeights()[row * grid.GetWidth() + col] == height);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(HeightFieldBilinearIsAPatchPerQuad)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 16, 16, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	srand(1);
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		int col = rand() % 15;
+		int row = rand() % 15;
+		float s = GetRandomFloat(0.f, 1.f);
+		float t = GetRandomFloat(0.f, 1.f);
+
+		const float *p = grid.GetHeights() + row * grid.GetPitch() + col;
+
+		float top = p[0] + (p[1] - p[0]) * s;
+		float bottom = p[grid.GetPitch()] + (p[grid.GetPitch() + 1] - p[grid.GetPitch()]) * s;
+		float expected = top + (bottom - top) * t;
+
+		float x = grid.GetOriginX() + (col + s) * grid.GetColumnStepX();
+		float z = grid.GetOriginZ() + (row + t) * grid.GetRowStepZ();
+
+		if (!CHECK_CLOSE(heightField.GetHeight(x, z, HEIGHT_FIELD_FILTER_BILINEAR), expected, 1e-4))
+			break;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Both filters reproduce a plane exactly, away from the edges where
+// bicubic uses clamped points.
+TEST(HeightFieldReproducesAPlane)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 20, 20, 1.5f, &GetPlaneHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	float length = sqrtf(.25f * .25f + 1.f + .5f * .5f);
+	float expectedNormal[3] = {-.25f / length, 1.f / length, .5f / length};
+
+	srand(2);
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		float x = GetRandomFloat(-12.f, 12.f);
+		float z = GetRandomFloat(-12.f, 12.f);
+
+		CHECK_CLOSE(heightField.GetHeight(x, z, HEIGHT_FIELD_FILTER_BILINEAR), GetPlaneHeight(x, z), 1e-4);
+		CHECK_CLOSE(heightField.GetHeight(x, z, HEIGHT_FIELD_FILTER_BICUBIC), GetPlaneHeight(x, z), 1e-4);
+
+		for (int filter = 0; filter < 2; ++filter)
+		{
+			float normal[3];
+			heightField.GetNormal(x, z, HeightFieldFilter(filter), normal);
+
+			for (int j = 0; j < 3; ++j)
+				CHECK_CLOSE(normal[j], expectedNormal[j], 1e-4);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The normals are the slopes of the heights.
+TEST(HeightFieldNormalsMatchSlopes)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 40, 40, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	srand(3);
+
+	const float e = 1e-2f;
+
+	for (int i = 0; i < 200; ++i)
+	{
+		float x = GetRandomFloat(-18.f, 18.f);
+		float z = GetRandomFloat(-18.f, 18.f);
+
+		for (int filter = 0; filter < 2; ++filter)
+		{
+			// Bilinear slopes jump at grid lines, so stay off them.
+			if (filter == HEIGHT_FIELD_FILTER_BILINEAR && (fabsf(x - floorf(x + .5f)) < 2.f * e || fabsf(z - floorf(z + .5f)) < 2.f * e))
+				continue;
+
+			HeightFieldFilter f = HeightFieldFilter(filter);
+
+			float dhdx = (heightField.GetHeight(x + e, z, f) - heightField.GetHeight(x - e, z, f)) / (2.f * e);
+			float dhdz = (heightField.GetHeight(x, z + e, f) - heightField.GetHeight(x, z - e, f)) / (2.f * e);
+
+			float normal[3];
+			heightField.GetNormal(x, z, f, normal);
+
+			CHECK_CLOSE(sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]), 1.f, 1e-4);
+			CHECK(normal[1] > 0.f);
+			CHECK_CLOSE(-normal[0] / normal[1], dhdx, 1e-2);
+			CHECK_CLOSE(-normal[2] / normal[1], dhdz, 1e-2);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Bicubic slopes don't jump from one quad to the next.
+TEST(HeightFieldBicubicIsSmoothAcrossGridLines)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 20, 20, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	const float e = 1e-3f;
+
+	for (float x = -6.f; x <= 6.f; x += 1.f)
+	{
+		float z = .37f;
+
+		float before[3], after[3];
+		heightField.GetNormal(x - e, z, HEIGHT_FIELD_FILTER_BICUBIC, before);
+		heightField.GetNormal(x + e, z, HEIGHT_FIELD_FILTER_BICUBIC, after);
+
+		for (int j = 0; j < 3; ++j)
+			CHECK_CLOSE(before[j], after[j], 1e-2);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(HeightFieldClampsToTheEdges)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 10, 12, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	float minX = grid.GetOriginX();
+	float maxX = minX + 9.f;
+	float maxZ = grid.GetOriginZ();
+	float minZ = maxZ - 11.f;
+
+	for (int filter = 0; filter < 2; ++filter)
+	{
+		HeightFieldFilter f = HeightFieldFilter(filter);
+
+		CHECK(heightField.GetHeight(minX - 100.f, maxZ + 100.f, f) == heightField.GetHeight(minX, maxZ, f));
+		CHECK(heightField.GetHeight(maxX + 100.f, minZ - 100.f, f) == heightField.GetHeight(maxX, minZ, f));
+		CHECK(heightField.GetHeight(minX - 5.f, -1.3f, f) == heightField.GetHeight(minX, -1.3f, f));
+		CHECK(heightField.GetHeight(2.6f, minZ - 5.f, f) == heightField.GetHeight(2.6f, minZ, f));
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(HeightFieldGetHeightsMatchesGetHeight)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 65, 33, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	srand(4);
+
+	// Not a multiple of 4, and some off the grid.
+	const size_t NUM_POSITIONS = 1003;
+
+	std::vector<float> xs(NUM_POSITIONS), zs(NUM_POSITIONS), heights(NUM_POSITIONS);
+
+	for (size_t i = 0; i < NUM_POSITIONS; ++i)
+	{
+		xs[i] = GetRandomFloat(-40.f, 40.f);
+		zs[i] = GetRandomFloat(-20.f, 20.f);
+	}
+
+	// The far edges exactly.
+	xs[0] = 32.f;
+	zs[0] = -16.f;
+
+	heightField.GetHeights(&xs[0], &zs[0], NUM_POSITIONS, &heights[0]);
+
+	for (size_t i = 0; i < NUM_POSITIONS; ++i)
+	{
+		if (!CHECK_CLOSE(heights[i], heightField.GetHeight(xs[i], zs[i], HEIGHT_FIELD_FILTER_BILINEAR), 1e-4))
+			break;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(HeightFieldSetGridHeights)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 10, 10, 1.f, &GetTestFlatHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	const float *pGridHeights = heightField.GetGridHeights();
+
+	float heights[2 * 3] = {1.f, 2.f, 3.f, 4.f, 5.f, 6.f};
+	heightField.SetGridHeights(4, 6, 6, 7, heights);
+
+	CHECK(heightField.GetGridHeights() == pGridHeights);
+
+	float x = grid.GetOriginX();
+	float z = grid.GetOriginZ();
+
+	CHECK(heightField.GetHeight(x + 4.f, z - 6.f, HEIGHT_FIELD_FILTER_BILINEAR) == 1.f);
+	CHECK(heightField.GetHeight(x + 6.f, z - 6.f, HEIGHT_FIELD_FILTER_BILINEAR) == 3.f);
+	CHECK(heightField.GetHeight(x + 5.f, z - 7.f, HEIGHT_FIELD_FILTER_BILINEAR) == 5.f);
+	CHECK(heightField.GetHeight(x + 3.f, z - 6.f, HEIGHT_FIELD_FILTER_BILINEAR) == 0.f);
+	CHECK(heightField.GetHeight(x + 5.f, z - 8.f, HEIGHT_FIELD_FILTER_BILINEAR) == 0.f);
+	CHECK_CLOSE(heightField.GetHeight(x + 4.5f, z - 6.5f, HEIGHT_FIELD_FILTER_BILINEAR), 3.f, 1e-5);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(HeightFieldEmpty)
+{
+	HeightField heightField;
+
+	// Not big enough for a quad.
+	TerrainGrid grid;
+	CHECK(!heightField.Create(&grid));
+
+	CHECK(heightField.GetHeight(1.f, 2.f, HEIGHT_FIELD_FILTER_BICUBIC) == 0.f);
+	CHECK(heightField.GetGridHeights() == NULL);
+
+	float normal[3];
+	heightField.GetNormal(1.f, 2.f, HEIGHT_FIELD_FILTER_BILINEAR, normal);
+	CHECK(normal[0] == 0.f && normal[1] == 1.f && normal[2] == 0.f);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// Bilinear queries over a 1025x1025 grid, one at a time with GetHeight
+// and in arrays with GetHeights, on one thread and then on every
+// hardware thread.
+TEST(HeightFieldBenchmark)
+{
+	const size_t NUM_POSITIONS = 1 << 20, JOB_SIZE = 1 << 14;
+
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 1025, 1025, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	srand(33);
+
+	std::vector<float> xs(NUM_POSITIONS), zs(NUM_POSITIONS);
+
+	for (size_t i = 0; i < NUM_POSITIONS; ++i)
+	{
+		xs[i] = GetRandomFloat(-512.f, 512.f);
+		zs[i] = GetRandomFloat(-512.f, 512.f);
+	}
+
+	std::vector<float> scalarHeights(NUM_POSITIONS), batchHeights(NUM_POSITIONS);
+
+	// Each job does JOB_SIZE positions.
+	ParallelJobFn scalarJob = [&](size_t jobIndex, std::string *) {
+		for (size_t i = jobIndex * JOB_SIZE; i < (jobIndex + 1) * JOB_SIZE; ++i)
+			scalarHeights[i] = heightField.GetHeight(xs[i], zs[i], HEIGHT_FIELD_FILTER_BILINEAR);
+
+		return true;
+	};
+
+	ParallelJobFn batchJob = [&](size_t jobIndex, std::string *) {
+		size_t i = jobIndex * JOB_SIZE;
+		heightField.GetHeights(&xs[i], &zs[i], JOB_SIZE, &batchHeights[i]);
+
+		return true;
+	};
+
+	// Only the once, if there's only the one hardware thread.
+	unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	const unsigned threadCounts[] = {1, numThreads};
+
+	std::vector<float> singleThreadHeights;
+
+	for (int i = 0; i < (numThreads > 1 ? 2 : 1); ++i)
+	{
+		double scalarSeconds = DBL_MAX, batchSeconds = DBL_MAX;
+
+		for (int j = 0; j < 3; ++j)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			RunParallelJobs(NUM_POSITIONS / JOB_SIZE, threadCounts[i], scalarJob, NULL);
+			scalarSeconds = std::min(scalarSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+			start = std::chrono::steady_clock::now();
+			RunParallelJobs(NUM_POSITIONS / JOB_SIZE, threadCounts[i], batchJob, NULL);
+			batchSeconds = std::min(batchSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+
+		printf("    %u thread%s: GetHeight %.1fM queries/s (%.1fM a core), GetHeights %.1fM queries/s (%.1fM a core), %.2fx\n",
+			threadCounts[i], threadCounts[i] == 1 ? "" : "s", NUM_POSITIONS / scalarSeconds * 1e-6, NUM_POSITIONS / scalarSeconds * 1e-6 / threadCounts[i],
+			NUM_POSITIONS / batchSeconds * 1e-6, NUM_POSITIONS / batchSeconds * 1e-6 / threadCounts[i], scalarSeconds / batchSeconds);
+
+		// The same answers however they're got.
+		if (i == 0)
+			singleThreadHeights = batchHeights;
+		else
+			CHECK(batchHeights == singleThreadHeights);
+
+		size_t numDifferent = 0;
+
+		for (size_t j = 0; j < NUM_POSITIONS; ++j)
+			numDifferent += fabsf(scalarHeights[j] - batchHeights[j]) > 1e-4f ? 1 : 0;
+
+		CHECK(numDifferent == 0);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,318 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "HeightField.h"
+#include "LineOfSight.h"
+#include "TerrainGrid.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float GetRandomFloat(float minValue, float maxValue)
+{
+	return minValue + (maxValue - minValue) * (rand() / float(RAND_MAX));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool GetBit(const std::vector<uint32_t> &bits, size_t i)
+{
+	return ((bits[i / 32] >> (i % 32)) & 1) != 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// How far the terrain rises above the line from pFrom to pTo, at its
+// worst, marching along it in steps of stepSize world units. Positive
+// means blocked.
+static float MarchSightLine(const TerrainGrid *pGrid, const float *pFrom, const float *pTo, float stepSize)
+{
+	float minX = pGrid->GetOriginX();
+	float maxX = minX + (pGrid->GetWidth() - 1) * pGrid->GetColumnStepX();
+	float maxZ = pGrid->GetOriginZ();
+	float minZ = maxZ + (pGrid->GetLength() - 1) * pGrid->GetRowStepZ();
+
+	float dx = pTo[0] - pFrom[0];
+	float dz = pTo[2] - pFrom[2];
+
+	int numSteps = std::max(int(ceilf(sqrtf(dx * dx + dz * dz) / stepSize)), 1);
+
+	float worst = -1e30f;
+
+	for (int i = 0; i <= numSteps; ++i)
+	{
+		float u = numSteps > 0 ? float(i) / numSteps : 0.f;
+
+		float x = pFrom[0] + dx * u;
+		float z = pFrom[2] + dz * u;
+
+		if (x < minX || x > maxX || z < minZ || z > maxZ)
+			continue;
+
+		float y = pFrom[1] + (pTo[1] - pFrom[1]) * u;
+
+		worst = fmaxf(worst, GetTestTriangleHeight(pGrid, x, z) - y);
+	}
+
+	return worst;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Pairs of points a little above the hills.
+static void MakeRandomPairs(const HeightField &heightField, size_t numPairs, float halfWidth, float halfLength, std::vector<float> *pFroms, std::vector<float> *pTos)
+{
+	pFroms->resize(numPairs * 3);
+	pTos->resize(numPairs * 3);
+
+	for (size_t i = 0; i < numPairs; ++i)
+	{
+		float *pFrom = &(*pFroms)[i * 3];
+		float *pTo = &(*pTos)[i * 3];
+
+		pFrom[0] = GetRandomFloat(-halfWidth, halfWidth);
+		pFrom[2] = GetRandomFloat(-halfLength, halfLength);
+
+		// Some along the grid lines' directions, and some straight up.
+		pTo[0] = i % 9 == 0 ? pFrom[0] : GetRandomFloat(-halfWidth, halfWidth);
+		pTo[2] = i % 10 == 0 ? pFrom[2] : GetRandomFloat(-halfLength, halfLength);
+
+		pFrom[1] = heightField.GetHeight(pFrom[0], pFrom[2], HEIGHT_FIELD_FILTER_BILINEAR) + GetRandomFloat(.1f, 4.f);
+		pTo[1] = heightField.GetHeight(pTo[0], pTo[2], HEIGHT_FIELD_FILTER_BILINEAR) + GetRandomFloat(.1f, 4.f);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(LineOfSightMatchesRayMarch)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 64, 48, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	LineOfSight lineOfSight;
+	REQUIRE(lineOfSight.Create(&heightField));
+
+	srand(7);
+
+	std::vector<float> froms, tos;
+	MakeRandomPairs(heightField, 2000, 31.f, 23.f, &froms, &tos);
+
+	// The march can step over the tip of a hill that only just pokes
+	// through the line, so only clear-cut cases are compared.
+	static const float MARGIN = 1e-2f;
+
+	size_t numVisible = 0, numBlocked = 0;
+
+	for (size_t i = 0; i < froms.size() / 3; ++i)
+	{
+		bool canSee = lineOfSight.CanSee(&froms[i * 3], &tos[i * 3]);
+		float worst = MarchSightLine(&grid, &froms[i * 3], &tos[i * 3], .01f);
+
+		if (canSee)
+		{
+			++numVisible;
+
+			if (!CHECK(worst < MARGIN))
+				break;
+		}
+		else
+		{
+			++numBlocked;
+
+			if (!CHECK(worst > -MARGIN))
+				break;
+		}
+
+		// Either way round.
+		if (!CHECK(lineOfSight.CanSee(&tos[i * 3], &froms[i * 3]) == canSee))
+			break;
+	}
+
+	// Enough of each for the comparison to mean something.
+	CHECK(numVisible > 200);
+	CHECK(numBlocked > 200);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(LineOfSightSimpleCases)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 32, 32, 1.f, &GetTestFlatHeight));
+
+	HeightField heightField;
+
+	// A wall 5 high along x = 0.
+	std::vector<float> heights(32 * 32, 0.f);
+	for (int row = 0; row < 32; ++row)
+		heights[row * 32 + 16] = 5.f;
+
+	grid.SetHeights(0, 0, 31, 31, &heights[0], 32);
+	REQUIRE(heightField.Create(&grid));
+
+	LineOfSight lineOfSight;
+	REQUIRE(lineOfSight.Create(&heightField));
+
+	float left[3] = {-8.f, 1.f, 0.f};
+	float right[3] = {8.f, 1.f, 0.f};
+	float leftHigh[3] = {-8.f, 6.f, 0.f};
+	float rightHigh[3] = {8.f, 6.f, 0.f};
+	float leftNear[3] = {-4.f, 1.f, 3.f};
+
+	CHECK(!lineOfSight.CanSee(left, right));
+	CHECK(!lineOfSight.CanSee(left, rightHigh));
+	CHECK(lineOfSight.CanSee(leftHigh, rightHigh));
+	CHECK(lineOfSight.CanSee(left, leftNear));
+
+	// Over the top exactly: the wall's only touching the line.
+	float leftTop[3] = {-8.f, 5.f, 0.f};
+	float rightTop[3] = {8.f, 5.f, 0.f};
+	CHECK(lineOfSight.CanSee(leftTop, rightTop));
+
+	// Standing on the ground.
+	float groundA[3] = {-8.f, 0.f, -5.f};
+	float groundB[3] = {-2.f, 0.f, 7.f};
+	CHECK(lineOfSight.CanSee(groundA, groundB));
+
+	// Off the grid altogether is clear.
+	float offA[3] = {-100.f, 0.f, 0.f};
+	float offB[3] = {-100.f, 0.f, 50.f};
+	CHECK(lineOfSight.CanSee(offA, offB));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(LineOfSightBatchMatchesSingle)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 64, 64, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	LineOfSight lineOfSight;
+	REQUIRE(lineOfSight.Create(&heightField));
+
+	srand(8);
+
+	// Not a multiple of 32.
+	std::vector<float> froms, tos;
+	MakeRandomPairs(heightField, 3001, 31.f, 31.f, &froms, &tos);
+
+	std::vector<uint32_t> visibleBits;
+	size_t numVisible = lineOfSight.CanSeeBatch(&froms[0], &tos[0], 3001, &visibleBits, 4);
+
+	REQUIRE(visibleBits.size() == (3001 + 31) / 32);
+
+	size_t numCounted = 0;
+
+	for (size_t i = 0; i < 3001; ++i)
+	{
+		bool canSee = lineOfSight.CanSee(&froms[i * 3], &tos[i * 3]);
+
+		if (!CHECK(GetBit(visibleBits, i) == canSee))
+			break;
+
+		if (canSee)
+			++numCounted;
+	}
+
+	CHECK(numVisible == numCounted);
+
+	// The slow reference agrees too, bar the odd one it steps over.
+	size_t numDisagreements = 0;
+
+	for (size_t i = 0; i < 500; ++i)
+	{
+		if (lineOfSight.CanSeeReference(&froms[i * 3], &tos[i * 3], .01f) != GetBit(visibleBits, i))
+			++numDisagreements;
+	}
+
+	CHECK(numDisagreements <= 5);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(LineOfSightViewshed)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 64, 48, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	LineOfSight lineOfSight;
+	REQUIRE(lineOfSight.Create(&heightField));
+
+	const int observerCol = 20, observerRow = 30;
+	const float eyeHeight = 2.f, targetHeight = 1.f;
+
+	std::vector<uint32_t> visibleBits;
+	lineOfSight.ComputeViewshed(observerCol, observerRow, eyeHeight, targetHeight, &visibleBits);
+
+	REQUIRE(visibleBits.size() == (64 * 48 + 31) / 32);
+
+	const float *pHeights = heightField.GetGridHeights();
+
+	float eye[3] = {grid.GetOriginX() + observerCol, pHeights[observerRow * 64 + observerCol] + eyeHeight, grid.GetOriginZ() - observerRow};
+
+	CHECK(GetBit(visibleBits, observerRow * 64 + observerCol));
+
+	// XDraw is an approximation, so it only has to mostly agree with
+	// the exact answer.
+	size_t numAgree = 0, numVisible = 0;
+
+	for (int row = 0; row < 48; ++row)
+	{
+		for (int col = 0; col < 64; ++col)
+		{
+			size_t index = size_t(row) * 64 + col;
+			float target[3] = {grid.GetOriginX() + col, pHeights[index] + targetHeight, grid.GetOriginZ() - row};
+
+			bool visible = GetBit(visibleBits, index);
+
+			if (visible == lineOfSight.CanSee(eye, target))
+				++numAgree;
+
+			if (visible)
+				++numVisible;
+		}
+	}
+
+	CHECK(numAgree > 64 * 48 * 95 / 100);
+	CHECK(numVisible > 64 * 48 / 10 && numVisible < 64 * 48 * 9 / 10);
+
+	// On the flat, everything's visible.
+	TerrainGrid flatGrid;
+	REQUIRE(MakeTestGrid(&flatGrid, 20, 20, 1.f, &GetTestFlatHeight));
+
+	HeightField flatHeightField;
+	REQUIRE(flatHeightField.Create(&flatGrid));
+
+	LineOfSight flatLineOfSight;
+	REQUIRE(flatLineOfSight.Create(&flatHeightField));
+
+	flatLineOfSight.ComputeViewshed(3, 17, 1.f, 0.f, &visibleBits);
+
+	for (size_t i = 0; i < 20 * 20; ++i)
+		CHECK(GetBit(visibleBits, i));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
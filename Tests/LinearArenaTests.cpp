@@ -0,0 +1,375 @@
+#include "Test.h"
+
+#include "LinearArena.h"
+
+#include <float.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TestArenaAllocation
+{
+	unsigned char *pMemory;
+	size_t numBytes;
+	unsigned char fill;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool IsAligned(const void *p, size_t alignment)
+{
+	return uintptr_t(p) % alignment == 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Checks nothing's written over anything still in use.
+static bool CheckAllocations(const std::vector<TestArenaAllocation> &allocations)
+{
+	for (size_t i = 0; i < allocations.size(); ++i)
+	{
+		for (size_t j = 0; j < allocations[i].numBytes; ++j)
+		{
+			if (!CHECK(allocations[i].pMemory[j] == allocations[i].fill))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(LinearArenaBasics)
+{
+	LinearArena arena;
+	CHECK(!arena.Create(0));
+	CHECK(arena.Allocate(16, 1) == NULL);
+
+	REQUIRE(arena.Create(1024));
+
+	// No blocks until they're needed.
+	CHECK(arena.GetStats().numBlocksAllocated == 0 && arena.GetNumBytesUsed() == 0);
+
+	// One after the other in the block, aligned.
+	char *pA = static_cast<char *>(arena.Allocate(10, 1));
+	char *pB = static_cast<char *>(arena.Allocate(10, 1));
+	REQUIRE(pA && pB);
+	CHECK(pB == pA + 10);
+	CHECK(arena.GetNumBytesUsed() == 20);
+
+	for (size_t alignment = 1; alignment <= 256; alignment *= 2)
+	{
+		void *p = arena.Allocate(3, alignment);
+		REQUIRE(p);
+		CHECK(IsAligned(p, alignment));
+	}
+
+	double *pDoubles = arena.AllocateArray<double>(5);
+	REQUIRE(pDoubles);
+	CHECK(IsAligned(pDoubles, alignof(double)));
+	CHECK(arena.GetStats().numBlocksAllocated == 1);
+
+	// Too much to count.
+	CHECK(arena.AllocateArray<double>(size_t(-1) / 4) == NULL);
+	CHECK(arena.Allocate(size_t(-1), 16) == NULL);
+
+	// A new block when this one's full, and one of its own for anything
+	// bigger than a block.
+	size_t numBytesUsed = arena.GetNumBytesUsed();
+	REQUIRE(arena.Allocate(1024 - numBytesUsed + 1, 1));
+	CHECK(arena.GetStats().numBlocksAllocated == 2);
+
+	REQUIRE(arena.Allocate(5000, 1));
+	CHECK(arena.GetStats().numBlocksAllocated == 3);
+	CHECK(arena.GetStats().numBlockBytesAllocated == 1024 + 1024 + 5000);
+
+	// Space left at the end of a block counts as used.
+	CHECK(arena.GetNumBytesUsed() >= 1024 + 1024 - numBytesUsed + 1 + 5000);
+
+	// Reset keeps the blocks, so going round again needs no more.
+	size_t maxNumBytesUsed = arena.GetStats().maxNumBytesUsed;
+	CHECK(maxNumBytesUsed == arena.GetNumBytesUsed());
+
+	arena.Reset();
+	CHECK(arena.GetNumBytesUsed() == 0);
+
+	CHECK(arena.Allocate(10, 1) == pA);
+	REQUIRE(arena.Allocate(1024, 1));
+	REQUIRE(arena.Allocate(5000, 1));
+	CHECK(arena.GetStats().numBlocksAllocated == 3);
+	CHECK(arena.GetStats().maxNumBytesUsed == maxNumBytesUsed);
+
+	CHECK(arena.GetStats().numAllocations == 17);
+
+	arena.Destroy();
+	CHECK(arena.Allocate(16, 1) == NULL);
+	CHECK(arena.GetStats().numBlocksAllocated == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(LinearArenaMarkers)
+{
+	LinearArena arena;
+	REQUIRE(arena.Create(256));
+
+	int *pKept = arena.AllocateArray<int>(8);
+	REQUIRE(pKept);
+
+	// Used stack fashion, the same memory comes back each time.
+	LinearArenaMarker marker = arena.GetMarker();
+	size_t numBytesUsed = arena.GetNumBytesUsed();
+
+	void *pFirst = arena.Allocate(100, 16);
+	REQUIRE(pFirst);
+
+	// Through several blocks, one of them big.
+	REQUIRE(arena.Allocate(200, 1) && arena.Allocate(1000, 1) && arena.Allocate(50, 1));
+	size_t numBlocks = arena.GetStats().numBlocksAllocated;
+	CHECK(numBlocks == 4);
+
+	for (int i = 0; i < 10; ++i)
+	{
+		arena.ResetToMarker(marker);
+		CHECK(arena.GetNumBytesUsed() == numBytesUsed);
+
+		CHECK(arena.Allocate(100, 16) == pFirst);
+		REQUIRE(arena.Allocate(200, 1) && arena.Allocate(1000, 1) && arena.Allocate(50, 1));
+	}
+
+	CHECK(arena.GetStats().numBlocksAllocated == numBlocks);
+
+	// The big block is reused for smaller things too, once the ones
+	// before it are full.
+	arena.ResetToMarker(marker);
+	REQUIRE(arena.Allocate(100, 1) && arena.Allocate(200, 1) && arena.Allocate(600, 1));
+	CHECK(arena.GetStats().numBlocksAllocated == numBlocks);
+
+	// Something bigger than any block so far goes in before the blocks
+	// that are too small, and the marker still works.
+	arena.ResetToMarker(marker);
+	REQUIRE(arena.Allocate(200, 1) && arena.Allocate(3000, 1));
+	CHECK(arena.GetStats().numBlocksAllocated == numBlocks + 1);
+
+	arena.ResetToMarker(marker);
+	CHECK(arena.Allocate(100, 16) == pFirst);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(LinearArenaNeverOverlaps)
+{
+	LinearArena arena;
+	REQUIRE(arena.Create(4096));
+
+	srand(47);
+
+	std::vector<TestArenaAllocation> allocations;
+
+	// Markers, and how many allocations there were when each was got.
+	std::vector<LinearArenaMarker> markers;
+	std::vector<size_t> markerNumAllocations;
+
+	unsigned char fill = 0;
+
+	for (int i = 0; i < 5000; ++i)
+	{
+		int action = rand() % 10;
+
+		if (action < 6)
+		{
+			TestArenaAllocation allocation;
+
+			// Now and then, bigger than a block.
+			allocation.numBytes = rand() % 50 == 0 ? 4096 + rand() % 5000 : 1 + rand() % 600;
+			allocation.fill = ++fill;
+
+			size_t alignment = size_t(1) << (rand() % 8);
+
+			allocation.pMemory = static_cast<unsigned char *>(arena.Allocate(allocation.numBytes, alignment));
+			REQUIRE(allocation.pMemory);
+
+			if (!CHECK(IsAligned(allocation.pMemory, alignment)))
+				return;
+
+			memset(allocation.pMemory, allocation.fill, allocation.numBytes);
+			allocations.push_back(allocation);
+		}
+		else if (action < 8)
+		{
+			markers.push_back(arena.GetMarker());
+			markerNumAllocations.push_back(allocations.size());
+		}
+		else if (!markers.empty())
+		{
+			arena.ResetToMarker(markers.back());
+			allocations.resize(markerNumAllocations.back());
+
+			markers.pop_back();
+			markerNumAllocations.pop_back();
+		}
+		else
+		{
+			arena.Reset();
+			allocations.clear();
+		}
+
+		if (i % 50 == 0 && !CheckAllocations(allocations))
+			return;
+	}
+
+	CheckAllocations(allocations);
+
+	// Blocks get reused, rather than one per allocation.
+	CHECK(arena.GetStats().numBlocksAllocated < arena.GetStats().numAllocations / 20);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Where the per frame scratch space comes from in the benchmark.
+enum TestScratchSource
+{
+	TEST_SCRATCH_SOURCE_ARENA,
+	TEST_SCRATCH_SOURCE_MALLOC,
+	TEST_SCRATCH_SOURCE_VECTOR,
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Runs the frames, allocating the sizes given for each frame, writing
+// to each allocation, then freeing the lot at the end of the frame.
+// Returns the seconds taken.
+static double RunTestScratchFrames(TestScratchSource source, const std::vector<size_t> &sizes, size_t numPerFrame, LinearArena *pArena)
+{
+	std::vector<void *> pointers(numPerFrame);
+	std::vector<std::vector<unsigned char> > vectors(numPerFrame);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (size_t frameStart = 0; frameStart < sizes.size(); frameStart += numPerFrame)
+	{
+		for (size_t i = 0; i < numPerFrame; ++i)
+		{
+			size_t numBytes = sizes[frameStart + i];
+			unsigned char *pMemory;
+
+			switch (source)
+			{
+			case TEST_SCRATCH_SOURCE_ARENA:
+				pMemory = static_cast<unsigned char *>(pArena->Allocate(numBytes, 16));
+				break;
+
+			case TEST_SCRATCH_SOURCE_MALLOC:
+				pMemory = static_cast<unsigned char *>(malloc(numBytes));
+				pointers[i] = pMemory;
+				break;
+
+			default:
+				// reserve, not resize, so it isn't timed filling the
+				// memory with 0s.
+				vectors[i].reserve(numBytes);
+				pMemory = vectors[i].data();
+				break;
+			}
+
+			// Something written at each end, as the vertex and index
+			// arrays would be filled in.
+			pMemory[0] = 1;
+			pMemory[numBytes - 1] = 2;
+		}
+
+		switch (source)
+		{
+		case TEST_SCRATCH_SOURCE_ARENA:
+			pArena->Reset();
+			break;
+
+		case TEST_SCRATCH_SOURCE_MALLOC:
+			for (size_t i = 0; i < numPerFrame; ++i)
+				free(pointers[i]);
+			break;
+
+		default:
+			for (size_t i = 0; i < numPerFrame; ++i)
+				std::vector<unsigned char>().swap(vectors[i]);
+			break;
+		}
+	}
+
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The frame arena's pattern: a few hundred allocations a frame, mostly
+// small, with some the size of a terrain chunk's vertices, all gone at
+// the end of the frame. Prints the time per allocation from the arena,
+// from malloc and as std::vectors, and how often each went to the
+// heap.
+TEST(LinearArenaBenchmark)
+{
+	const size_t NUM_FRAMES = 1000, NUM_PER_FRAME = 200;
+	const int NUM_RUNS = 3;
+
+	srand(470);
+
+	// 1 in 20 is a 65x65 chunk's worth of 32 byte vertices, or about.
+	std::vector<size_t> sizes(NUM_FRAMES * NUM_PER_FRAME);
+	size_t numBytes = 0;
+
+	for (size_t i = 0; i < sizes.size(); ++i)
+	{
+		sizes[i] = rand() % 20 == 0 ? 65 * 65 * 32 + rand() % 4096 : 16 + rand() % 2048;
+		numBytes += sizes[i];
+	}
+
+	const char *const names[] = {"arena", "malloc", "std::vector"};
+	double seconds[3];
+
+	LinearArena arena;
+	REQUIRE(arena.Create(1024 * 1024));
+
+	for (int source = 0; source < 3; ++source)
+	{
+		seconds[source] = DBL_MAX;
+
+		for (int run = 0; run < NUM_RUNS; ++run)
+			seconds[source] = std::min(seconds[source], RunTestScratchFrames(TestScratchSource(source), sizes, NUM_PER_FRAME, &arena));
+	}
+
+	const LinearArenaStats &stats = arena.GetStats();
+
+	printf("    %zu frames of %zu allocations, %.0f KB a frame:", NUM_FRAMES, NUM_PER_FRAME, numBytes / 1024. / NUM_FRAMES);
+
+	for (int source = 0; source < 3; ++source)
+		printf(" %s %.1fns", names[source], seconds[source] * 1e9 / sizes.size());
+
+	printf(" an allocation\n");
+	printf("    arena went to the heap %zu times (%.1f MB in blocks), malloc and std::vector %zu times a run\n", stats.numBlocksAllocated,
+		stats.numBlockBytesAllocated / (1024. * 1024.), sizes.size());
+
+	// Once it has the blocks for the biggest frame, the arena doesn't
+	// need any more: a handful, against one per allocation.
+	CHECK(stats.numAllocations == NUM_RUNS * sizes.size());
+	CHECK(stats.numBlocksAllocated * 10 < NUM_PER_FRAME);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,191 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "Test.h"
+
+#include "MeshFile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Position, colour, normal.
+struct TestVertex
+{
+	float pos[3];
+	uint8_t colour[4];
+	float normal[3];
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void MakeTestMesh(MeshFile *pMeshFile, std::vector<TestVertex> *pVertices, std::vector<uint16_t> *pIndices)
+{
+	pVertices->clear();
+	pIndices->clear();
+
+	for (int i = 0; i < 10; ++i)
+	{
+		TestVertex v = {{float(i), float(-i * 2), float(i % 3)}, {uint8_t(i), 2, 3, 255}, {0.f, 1.f, 0.f}};
+		pVertices->push_back(v);
+	}
+
+	for (uint16_t i = 0; i + 2 < 10; ++i)
+	{
+		pIndices->push_back(i);
+		pIndices->push_back(uint16_t(i + 1));
+		pIndices->push_back(uint16_t(i + 2));
+	}
+
+	static const float DIFFUSE[4] = {.25f, .5f, .75f, 1.f};
+	static const uint8_t COLOURED_VERTEX[16] = {0};
+
+	pMeshFile->AddSubset(MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F, &(*pVertices)[0], uint32_t(pVertices->size()), &(*pIndices)[0], uint32_t(pIndices->size()), DIFFUSE, "Texture.png");
+	pMeshFile->AddSubset(MESH_FILE_VERTEX_POS3F_COLOUR4UB, COLOURED_VERTEX, 1, &(*pIndices)[0], 1, NULL, NULL);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(MeshFileSavesAndLoads)
+{
+	std::string sourceFileName = GetTestTempFileName("MeshFileSource.x");
+	std::string fileName = GetTestTempFileName("MeshFile.cmesh");
+
+	REQUIRE(WriteTestFile(sourceFileName, std::vector<char>(100, 'x')));
+
+	std::vector<TestVertex> vertices;
+	std::vector<uint16_t> indices;
+
+	MeshFile saved;
+	MakeTestMesh(&saved, &vertices, &indices);
+	REQUIRE(saved.SetSourceFile(sourceFileName.c_str()));
+	REQUIRE(saved.Save(fileName.c_str()));
+
+	MeshFile loaded;
+	REQUIRE(loaded.Load(fileName.c_str()));
+	REQUIRE(loaded.GetNumSubsets() == 2);
+
+	const MeshFile::Subset *pSubset = loaded.GetSubset(0);
+	CHECK(pSubset->vertexType == MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F);
+	CHECK(pSubset->numVertices == vertices.size());
+	CHECK(pSubset->numIndices == indices.size());
+	CHECK(memcmp(pSubset->pVertices, &vertices[0], vertices.size() * sizeof vertices[0]) == 0);
+	CHECK(memcmp(pSubset->pIndices, &indices[0], indices.size() * sizeof indices[0]) == 0);
+	CHECK(strcmp(pSubset->pTextureFileName, "Texture.png") == 0);
+	CHECK(pSubset->diffuse[0] == .25f && pSubset->diffuse[1] == .5f && pSubset->diffuse[2] == .75f && pSubset->diffuse[3] == 1.f);
+
+	// The AABB is worked out from the positions.
+	CHECK(pSubset->aabbMin[0] == 0.f && pSubset->aabbMin[1] == -18.f && pSubset->aabbMin[2] == 0.f);
+	CHECK(pSubset->aabbMax[0] == 9.f && pSubset->aabbMax[1] == 0.f && pSubset->aabbMax[2] == 2.f);
+
+	// Blobs are aligned in the file, so they're aligned in the mapping.
+	CHECK(reinterpret_cast<uintptr_t>(pSubset->pVertices) % 16 == 0);
+	CHECK(reinterpret_cast<uintptr_t>(pSubset->pIndices) % 16 == 0);
+
+	pSubset = loaded.GetSubset(1);
+	CHECK(pSubset->vertexType == MESH_FILE_VERTEX_POS3F_COLOUR4UB);
+	CHECK(pSubset->numVertices == 1 && pSubset->numIndices == 1);
+	CHECK(strcmp(pSubset->pTextureFileName, "") == 0);
+
+	CHECK(GetMeshFileVertexStride(MESH_FILE_VERTEX_POS3F_COLOUR4UB) == 16);
+	CHECK(GetMeshFileVertexStride(MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F) == sizeof(TestVertex));
+	CHECK(GetMeshFileVertexStride(MESH_FILE_VERTEX_POS3F_COLOUR4UB_TEX2F) == 24);
+	CHECK(GetMeshFileVertexStride(MESH_FILE_VERTEX_POS3F_COLOUR4UB_NORMAL3F_TEX2F) == 36);
+
+	// A cache made from a file that's since changed is out of date.
+	CHECK(loaded.IsUpToDateWith(sourceFileName.c_str()));
+	REQUIRE(WriteTestFile(sourceFileName, std::vector<char>(101, 'x')));
+	CHECK(!loaded.IsUpToDateWith(sourceFileName.c_str()));
+	CHECK(!loaded.IsUpToDateWith(GetTestTempFileName("MeshFileMissing.x").c_str()));
+
+	loaded.Clear();
+	remove(fileName.c_str());
+	remove(sourceFileName.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(MeshFileRejectsDamagedFiles)
+{
+	std::string fileName = GetTestTempFileName("MeshFileGood.cmesh");
+	std::string damagedFileName = GetTestTempFileName("MeshFileDamaged.cmesh");
+
+	std::vector<TestVertex> vertices;
+	std::vector<uint16_t> indices;
+
+	MeshFile saved;
+	MakeTestMesh(&saved, &vertices, &indices);
+	REQUIRE(saved.Save(fileName.c_str()));
+
+	std::vector<char> good;
+	REQUIRE(ReadTestFile(fileName, &good));
+	REQUIRE(good.size() > 64);
+
+	MeshFile loaded;
+	CHECK(!loaded.Load(GetTestTempFileName("MeshFileMissing.cmesh").c_str()));
+	CHECK(loaded.GetNumSubsets() == 0);
+
+	// Cut short anywhere, it mustn't load (or read past the end).
+	for (size_t size = 0; size < good.size(); size += 7)
+	{
+		REQUIRE(WriteTestFile(damagedFileName, std::vector<char>(good.begin(), good.begin() + size)));
+		CHECK(!loaded.Load(damagedFileName.c_str()));
+		CHECK(loaded.GetNumSubsets() == 0);
+	}
+
+	// The magic number, then the version.
+	for (size_t i = 0; i < 8; i += 4)
+	{
+		std::vector<char> damaged = good;
+		damaged[i] ^= 1;
+
+		REQUIRE(WriteTestFile(damagedFileName, damaged));
+		CHECK(!loaded.Load(damagedFileName.c_str()));
+	}
+
+	// Any byte of the header or the subset records set to 0xFF gives
+	// either a file that loads with everything inside the mapping, or
+	// one that doesn't load. (The sanitizer builds catch reads outside
+	// it.)
+	for (size_t i = 0; i < 160 && i < good.size(); ++i)
+	{
+		std::vector<char> damaged = good;
+		damaged[i] = char(0xFF);
+
+		REQUIRE(WriteTestFile(damagedFileName, damaged));
+
+		if (!loaded.Load(damagedFileName.c_str()))
+			continue;
+
+		for (size_t j = 0; j < loaded.GetNumSubsets(); ++j)
+		{
+			const MeshFile::Subset *pSubset = loaded.GetSubset(j);
+
+			size_t numVertexBytes = pSubset->numVertices * GetMeshFileVertexStride(pSubset->vertexType);
+			size_t numIndexBytes = pSubset->numIndices * sizeof(uint16_t);
+
+			volatile uint8_t sum = 0;
+
+			if (numVertexBytes > 0)
+				sum = sum + static_cast<const uint8_t *>(pSubset->pVertices)[numVertexBytes - 1];
+
+			if (numIndexBytes > 0)
+				sum = sum + uint8_t(pSubset->pIndices[pSubset->numIndices - 1]);
+
+			sum = sum + uint8_t(strlen(pSubset->pTextureFileName));
+		}
+	}
+
+	loaded.Clear();
+	remove(fileName.c_str());
+	remove(damagedFileName.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
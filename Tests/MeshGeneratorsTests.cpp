@@ -0,0 +1,240 @@
+#include "Test.h"
+
+#include "MeshGenerators.h"
+
+#include <float.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static const double PI = 3.14159265358979;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void Cross(const double *a, const double *b, double *pResult)
+{
+	pResult[0] = a[1] * b[2] - a[2] * b[1];
+	pResult[1] = a[2] * b[0] - a[0] * b[2];
+	pResult[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Checks what's true of every generated mesh: the indices are in
+// range, the normals are unit length, and every triangle faces the way
+// its normals do. Returns the volume the triangles enclose, which is
+// only positive if they all face outwards.
+static double CheckMesh(const GeneratedMesh &mesh, size_t numVertices, size_t numFaces)
+{
+	CHECK(mesh.vertices.size() == numVertices);
+	CHECK(mesh.indices.size() == numFaces * 3);
+
+	for (size_t i = 0; i < mesh.vertices.size(); ++i)
+	{
+		const float *n = mesh.vertices[i].normal;
+		CHECK_CLOSE(n[0] * n[0] + n[1] * n[1] + n[2] * n[2], 1., 1e-4);
+	}
+
+	double volume = 0.;
+	size_t numBackwards = 0;
+
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		if (!CHECK(mesh.indices[i] < numVertices && mesh.indices[i + 1] < numVertices && mesh.indices[i + 2] < numVertices))
+			return 0.;
+
+		const GeneratedMeshVertex *pV[3] = {&mesh.vertices[mesh.indices[i]], &mesh.vertices[mesh.indices[i + 1]], &mesh.vertices[mesh.indices[i + 2]]};
+
+		double a[3], ab[3], ac[3], normal[3];
+		for (int j = 0; j < 3; ++j)
+		{
+			a[j] = pV[0]->pos[j];
+			ab[j] = pV[1]->pos[j] - a[j];
+			ac[j] = pV[2]->pos[j] - a[j];
+		}
+
+		Cross(ab, ac, normal);
+
+		double facing = 0., area2 = 0.;
+		for (int j = 0; j < 3; ++j)
+		{
+			facing += normal[j] * (pV[0]->normal[j] + pV[1]->normal[j] + pV[2]->normal[j]);
+			area2 += normal[j] * normal[j];
+		}
+
+		// Triangles at the poles can have no area.
+		if (area2 > 1e-12 && facing <= 0.)
+			++numBackwards;
+
+		volume += (a[0] * normal[0] + a[1] * normal[1] + a[2] * normal[2]) / 6.;
+	}
+
+	CHECK(numBackwards == 0);
+
+	return volume;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(GenerateBoxMesh)
+{
+	GeneratedMesh mesh;
+	REQUIRE(GenerateBoxMesh(1.f, 2.f, 3.f, &mesh));
+
+	CHECK_CLOSE(CheckMesh(mesh, 24, 12), 6., 1e-5);
+
+	for (size_t i = 0; i < mesh.vertices.size(); ++i)
+	{
+		const float *p = mesh.vertices[i].pos;
+		CHECK(fabsf(p[0]) == .5f && fabsf(p[1]) == 1.f && fabsf(p[2]) == 1.5f);
+	}
+
+	CHECK(!GenerateBoxMesh(-1.f, 1.f, 1.f, &mesh));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(GenerateSphereMesh)
+{
+	GeneratedMesh mesh;
+	REQUIRE(GenerateSphereMesh(2.f, 10, 8, &mesh));
+
+	CheckMesh(mesh, 2 + 10 * 7, 10 * 7 * 2);
+
+	for (size_t i = 0; i < mesh.vertices.size(); ++i)
+	{
+		const float *p = mesh.vertices[i].pos;
+		const float *n = mesh.vertices[i].normal;
+
+		CHECK_CLOSE(sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]), 2., 1e-5);
+
+		// The normals point straight out.
+		CHECK_CLOSE(p[0] * n[0] + p[1] * n[1] + p[2] * n[2], 2., 1e-5);
+	}
+
+	// Finely enough divided, the volume comes close to a sphere's.
+	REQUIRE(GenerateSphereMesh(1.f, 128, 64, &mesh));
+	CHECK_CLOSE(CheckMesh(mesh, 2 + 128 * 63, 128 * 63 * 2), 4. / 3. * PI, .01);
+
+	CHECK(!GenerateSphereMesh(1.f, 1, 8, &mesh));
+	CHECK(!GenerateSphereMesh(1.f, 8, 1, &mesh));
+	CHECK(!GenerateSphereMesh(1.f, 1000, 1000, &mesh));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(GenerateCylinderMesh)
+{
+	GeneratedMesh mesh;
+	REQUIRE(GenerateCylinderMesh(1.f, .5f, 2.f, 10, 3, &mesh));
+
+	CheckMesh(mesh, 2 + 10 * (3 + 3), 10 * (3 + 1) * 2);
+
+	// Radius1 at -Z, radius2 at +Z, and in between on the way.
+	for (size_t i = 0; i < mesh.vertices.size(); ++i)
+	{
+		const float *p = mesh.vertices[i].pos;
+		double r = sqrt(p[0] * p[0] + p[1] * p[1]);
+
+		CHECK(fabsf(p[2]) <= 1.f + 1e-6f);
+
+		// The centres of the caps are at r = 0.
+		if (r > 1e-6)
+			CHECK_CLOSE(r, 1. - .25 * (p[2] + 1.), 1e-5);
+	}
+
+	// A cone with its top cut off.
+	REQUIRE(GenerateCylinderMesh(1.f, .5f, 2.f, 256, 2, &mesh));
+	CHECK_CLOSE(CheckMesh(mesh, 2 + 256 * 5, 256 * 3 * 2), PI * 2. * (1. + .5 + .25) / 3., .01);
+
+	CHECK(!GenerateCylinderMesh(1.f, 1.f, 1.f, 1, 1, &mesh));
+	CHECK(!GenerateCylinderMesh(1.f, 1.f, 1.f, 8, 0, &mesh));
+	CHECK(!GenerateCylinderMesh(1.f, 1.f, -1.f, 8, 1, &mesh));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(GenerateTorusMesh)
+{
+	GeneratedMesh mesh;
+	REQUIRE(GenerateTorusMesh(.25f, 1.f, 8, 12, &mesh));
+
+	CheckMesh(mesh, 8 * 12, 8 * 12 * 2);
+
+	// Every point is innerRadius from the circle through the tube.
+	for (size_t i = 0; i < mesh.vertices.size(); ++i)
+	{
+		const float *p = mesh.vertices[i].pos;
+		double r = sqrt(p[0] * p[0] + p[1] * p[1]);
+
+		CHECK_CLOSE(sqrt((r - 1.) * (r - 1.) + p[2] * p[2]), .25, 1e-5);
+	}
+
+	REQUIRE(GenerateTorusMesh(.25f, 1.f, 64, 128, &mesh));
+	CHECK_CLOSE(CheckMesh(mesh, 64 * 128, 64 * 128 * 2), 2. * PI * PI * 1. * .25 * .25, .01);
+
+	CHECK(!GenerateTorusMesh(.25f, 1.f, 2, 12, &mesh));
+	CHECK(!GenerateTorusMesh(.25f, 1.f, 300, 300, &mesh));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// Makes each mesh numMeshes times, into a new GeneratedMesh each time
+// as CommonMesh does, and prints the best of 5 goes.
+template<class GenerateFn>
+static void TimeMeshGenerator(const char *pName, int numMeshes, GenerateFn generate)
+{
+	double seconds = DBL_MAX;
+	size_t numVertices = 0, numTriangles = 0;
+
+	for (int i = 0; i < 5; ++i)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		for (int j = 0; j < numMeshes; ++j)
+		{
+			GeneratedMesh mesh;
+			if (!CHECK(generate(&mesh)))
+				return;
+
+			numVertices = mesh.vertices.size();
+			numTriangles = mesh.indices.size() / 3;
+		}
+
+		seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	printf("    %s: %zu vertices, %zu triangles, %.4fms a mesh\n", pName, numVertices, numTriangles, seconds * 1000. / numMeshes);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// How long each shape takes, small and at tens of thousands of
+// vertices.
+TEST(MeshGeneratorsBenchmark)
+{
+	TimeMeshGenerator("box", 10000, [](GeneratedMesh *pMesh) { return GenerateBoxMesh(1.f, 2.f, 3.f, pMesh); });
+
+	TimeMeshGenerator("cylinder 20x4", 1000, [](GeneratedMesh *pMesh) { return GenerateCylinderMesh(1.f, 1.f, 2.f, 20, 4, pMesh); });
+	TimeMeshGenerator("cylinder 256x48", 20, [](GeneratedMesh *pMesh) { return GenerateCylinderMesh(1.f, 1.f, 2.f, 256, 48, pMesh); });
+
+	TimeMeshGenerator("sphere 20x20", 1000, [](GeneratedMesh *pMesh) { return GenerateSphereMesh(1.f, 20, 20, pMesh); });
+	TimeMeshGenerator("sphere 256x240", 20, [](GeneratedMesh *pMesh) { return GenerateSphereMesh(1.f, 256, 240, pMesh); });
+
+	TimeMeshGenerator("torus 16x32", 1000, [](GeneratedMesh *pMesh) { return GenerateTorusMesh(.25f, 1.f, 16, 32, pMesh); });
+	TimeMeshGenerator("torus 128x256", 20, [](GeneratedMesh *pMesh) { return GenerateTorusMesh(.25f, 1.f, 128, 256, pMesh); });
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
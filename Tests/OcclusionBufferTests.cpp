@@ -0,0 +1,407 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "CameraPathFile.h"
+#include "HeightMapFile.h"
+#include "OcclusionBuffer.h"
+#include "SoftwareRasterizer.h"
+#include "TerrainBounds.h"
+#include "TerrainChunks.h"
+#include "TerrainGrid.h"
+#include "TerrainOccluders.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Laid out as Vertex_Pos3fColour4ub, for SoftwareRasterizer.
+struct TestColourVertex
+{
+	float pos[3];
+	uint8_t colour[4];
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static const float IDENTITY[16] = {
+	1.f, 0.f, 0.f, 0.f,
+	0.f, 1.f, 0.f, 0.f,
+	0.f, 0.f, 1.f, 0.f,
+	0.f, 0.f, 0.f, 1.f,
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool IsTestBoxOccluded(OcclusionBuffer *pBuffer, const float *pViewProj, float minX, float minY, float minZ, float maxX, float maxY, float maxZ)
+{
+	const float boxMin[3] = {minX, minY, minZ};
+	const float boxMax[3] = {maxX, maxY, maxZ};
+
+	return pBuffer->IsBoxOccluded(pViewProj, boxMin, boxMax);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The usual hills, ringed by a ridge 40 units out from the middle,
+// which hides most of what's inside from anywhere outside.
+static float GetRidgeHeight(float x, float z)
+{
+	float distance = sqrtf(x * x + z * z) - 40.f;
+
+	return GetTestHillsHeight(x, z) + 30.f * expf(-distance * distance / 400.f);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(OcclusionBufferBoxes)
+{
+	// Looking along z from the origin at a 10x10 wall at z = 10.
+	const float eye[3] = {0.f, 0.f, 0.f};
+	const float at[3] = {0.f, 0.f, 1.f};
+
+	float viewProj[16];
+	MakeTestViewProj(eye, at, 1.5f, 1.f, 1.f, 1000.f, viewProj);
+
+	const float wall[] = {
+		-5.f, 5.f, 10.f,
+		5.f, 5.f, 10.f,
+		5.f, -5.f, 10.f,
+		-5.f, -5.f, 10.f,
+	};
+
+	// Clockwise on the screen, and the other way round.
+	const uint32_t frontIndices[] = {0, 1, 2, 0, 2, 3};
+	const uint32_t backIndices[] = {0, 2, 1, 0, 3, 2};
+
+	OcclusionBuffer buffer;
+	CHECK(!buffer.Create(0, 64, 1));
+
+	// Nothing's hidden before it's created.
+	CHECK(!IsTestBoxOccluded(&buffer, viewProj, -1.f, -1.f, 20.f, 1.f, 1.f, 22.f));
+
+	REQUIRE(buffer.Create(64, 64, 1));
+	CHECK(buffer.GetWidth() == 64 && buffer.GetHeight() == 64 && buffer.GetPitch() >= 64);
+
+	buffer.Begin(viewProj);
+	buffer.AddOccluders(wall, 4, frontIndices, 2);
+	buffer.Rasterize();
+
+	CHECK(buffer.GetStats().numOccludersSubmitted == 2 && buffer.GetStats().numOccludersDrawn == 2);
+
+	// Right behind it.
+	CHECK(IsTestBoxOccluded(&buffer, viewProj, -1.f, -1.f, 20.f, 1.f, 1.f, 22.f));
+
+	// In front of it.
+	CHECK(!IsTestBoxOccluded(&buffer, viewProj, -1.f, -1.f, 5.f, 1.f, 1.f, 6.f));
+
+	// Going through it.
+	CHECK(!IsTestBoxOccluded(&buffer, viewProj, -1.f, -1.f, 9.f, 1.f, 1.f, 22.f));
+
+	// Behind it, but poking out the side.
+	CHECK(!IsTestBoxOccluded(&buffer, viewProj, 4.f, -1.f, 20.f, 30.f, 1.f, 22.f));
+
+	// Through the near plane, and behind the camera.
+	CHECK(!IsTestBoxOccluded(&buffer, viewProj, -1.f, -1.f, -5.f, 1.f, 1.f, 22.f));
+	CHECK(!IsTestBoxOccluded(&buffer, viewProj, -1.f, -1.f, -22.f, 1.f, 1.f, -20.f));
+
+	const OcclusionBufferStats &stats = buffer.GetStats();
+	CHECK(stats.numFrames == 1 && stats.numBoxesTested == 6 && stats.numBoxesOccluded == 1);
+
+	// Seen from behind, the wall isn't drawn, and hides nothing.
+	buffer.Begin(viewProj);
+	buffer.AddOccluders(wall, 4, backIndices, 2);
+	buffer.Rasterize();
+
+	CHECK(buffer.GetStats().numOccludersSubmitted == 4 && buffer.GetStats().numOccludersDrawn == 2);
+	CHECK(!IsTestBoxOccluded(&buffer, viewProj, -1.f, -1.f, 20.f, 1.f, 1.f, 22.f));
+
+	// A slope going through the near plane is clipped, and the rest of
+	// it still hides what's behind.
+	const float slope[] = {
+		-50.f, 50.f, -1.f,
+		50.f, 50.f, -1.f,
+		50.f, -50.f, 30.f,
+		-50.f, -50.f, 30.f,
+	};
+
+	buffer.Begin(viewProj);
+	buffer.AddOccluders(slope, 4, frontIndices, 2);
+	buffer.Rasterize();
+
+	// One triangle's left a triangle, the other a quad.
+	CHECK(buffer.GetStats().numOccludersDrawn >= 2 + 3);
+	CHECK(IsTestBoxOccluded(&buffer, viewProj, -1.f, -15.f, 40.f, 1.f, -14.f, 41.f));
+	CHECK(!IsTestBoxOccluded(&buffer, viewProj, -1.f, -15.f, 5.f, 1.f, -14.f, 6.f));
+
+	buffer.ResetStats();
+	CHECK(buffer.GetStats().numFrames == 0 && buffer.GetStats().numBoxesTested == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(OcclusionBufferThreads)
+{
+	// Lots of triangles, all over the screen and overlapping, in clip
+	// space.
+	srand(50);
+
+	std::vector<float> positions(3 * 3 * 500);
+	std::vector<uint32_t> indices(3 * 500);
+
+	for (size_t i = 0; i < positions.size(); i += 3)
+	{
+		positions[i + 0] = rand() / float(RAND_MAX) * 2.4f - 1.2f;
+		positions[i + 1] = rand() / float(RAND_MAX) * 2.4f - 1.2f;
+		positions[i + 2] = rand() / float(RAND_MAX) * 1.2f - .1f;
+	}
+
+	// Both ways round, so half of each pair is drawn.
+	for (size_t i = 0; i < indices.size(); i += 6)
+	{
+		uint32_t first = uint32_t(i / 2);
+		uint32_t triangle[6] = {first, first + 1, first + 2, first, first + 2, first + 1};
+
+		std::copy(triangle, triangle + 6, indices.begin() + i);
+	}
+
+	// The same depths, however many threads there are.
+	std::vector<float> depths[2];
+	const unsigned numThreads[2] = {1, 4};
+
+	for (int i = 0; i < 2; ++i)
+	{
+		OcclusionBuffer buffer;
+		REQUIRE(buffer.Create(150, 100, numThreads[i]));
+
+		buffer.Begin(IDENTITY);
+		buffer.AddOccluders(&positions[0], positions.size() / 3, &indices[0], indices.size() / 3);
+		buffer.Rasterize();
+
+		for (int y = 0; y < 100; ++y)
+			depths[i].insert(depths[i].end(), buffer.GetDepths() + y * buffer.GetPitch(), buffer.GetDepths() + y * buffer.GetPitch() + 150);
+	}
+
+	CHECK(depths[0] == depths[1]);
+
+	// Between the near and far planes, and some of it covered.
+	CHECK(*std::min_element(depths[0].begin(), depths[0].end()) >= 0.f);
+	CHECK(*std::max_element(depths[0].begin(), depths[0].end()) == 1.f);
+	CHECK(std::count(depths[0].begin(), depths[0].end(), 1.f) < int(depths[0].size()));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// A camera going round a ridge, near the ground. Each frame,
+// the chunks are culled as RunOcclusionBatch and TerrainMesh do, then
+// the terrain is drawn with SoftwareRasterizer, each chunk its own
+// colour, and none of the chunks said to be hidden may show up in the
+// picture. It reports how many were hidden, and what that cost.
+// Flies the camera along the path, culling the chunks against the
+// frustum and then the occlusion buffer, and checks against a real
+// render of every chunk, each its own colour, that nothing that shows
+// was culled. Prints how much was hidden, and what that cost a frame.
+static bool ReplayOcclusionPath(const char *pName, const TerrainGrid *pGrid, const std::vector<CameraPathFrame> &frames, size_t *pNumHidden)
+{
+	const int CHUNK_QUADS = 32;
+	const int WIDTH = 192, HEIGHT = 108;
+
+	std::vector<TerrainChunk> chunks;
+	GetTerrainChunks(pGrid->GetWidth(), pGrid->GetLength(), CHUNK_QUADS, &chunks);
+
+	// Chunk colours are 1 to 255.
+	if (!CHECK(chunks.size() < 256))
+		return false;
+
+	TerrainBounds chunkBounds;
+	GetTerrainChunkBounds(pGrid, chunks, &chunkBounds);
+
+	if (!CHECK(chunkBounds.GetNumBoxes() == chunks.size()))
+		return false;
+
+	TerrainOccluders occluders;
+	OcclusionBuffer buffer;
+	SoftwareRasterizer rasterizer;
+
+	if (!CHECK(occluders.Create(pGrid) && buffer.Create(WIDTH, HEIGHT, 0) && rasterizer.Create(WIDTH, HEIGHT, 0)))
+		return false;
+
+	rasterizer.SetBlendState(false);
+	rasterizer.SetViewMatrix(IDENTITY);
+
+	// Each chunk's triangles, coloured with its index.
+	std::vector<std::vector<TestColourVertex> > chunkVtxs(chunks.size());
+	std::vector<std::vector<uint16_t> > chunkIndices(chunks.size());
+
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		const TerrainChunk &chunk = chunks[i];
+
+		for (int row = chunk.row0; row < chunk.row0 + chunk.length; ++row)
+		{
+			for (int col = chunk.col0; col < chunk.col0 + chunk.width; ++col)
+			{
+				TestColourVertex vertex = {
+					{pGrid->GetOriginX() + col * pGrid->GetColumnStepX(), pGrid->GetHeights()[row * pGrid->GetPitch() + col], pGrid->GetOriginZ() + row * pGrid->GetRowStepZ()},
+					{uint8_t(i + 1), 0, 0, 255},
+				};
+
+				chunkVtxs[i].push_back(vertex);
+			}
+		}
+
+		chunkIndices[i].resize(size_t(chunk.width - 1) * (chunk.length - 1) * 6);
+		BuildTerrainChunkIndices(chunk.width, chunk.length, &chunkIndices[i][0]);
+	}
+
+	size_t numInFrustum = 0, numHidden = 0;
+	std::vector<uint8_t> chunkVisible(chunks.size());
+
+	for (size_t frame = 0; frame < frames.size(); ++frame)
+	{
+		float viewProj[16];
+		MakeTestViewProj(frames[frame].camera, frames[frame].lookat, 3.14159265f / 4.f, float(WIDTH) / HEIGHT, .5f, 5000.f, viewProj);
+
+		float planes[6][4];
+		GetFrustumPlanes(viewProj, planes);
+
+		size_t numChunksInFrustum = chunkBounds.CullPlanes(planes, 6, &chunkVisible[0]);
+		std::vector<uint8_t> chunkInFrustum = chunkVisible;
+
+		buffer.Begin(viewProj);
+		occluders.AddTo(&buffer);
+		buffer.Rasterize();
+
+		size_t numChunksLeft = chunkBounds.CullOccluded(&buffer, viewProj, &chunkVisible[0]);
+
+		numInFrustum += numChunksInFrustum;
+		numHidden += numChunksInFrustum - numChunksLeft;
+
+		// Everything, as it really looks.
+		const float clearColour[4] = {0.f, 0.f, 0.f, 1.f};
+
+		rasterizer.SetProjectionMatrix(viewProj);
+		rasterizer.Clear(clearColour);
+
+		for (size_t i = 0; i < chunks.size(); ++i)
+			rasterizer.DrawUntextured(SoftwareRasterizer::Topology_TriangleList, &chunkVtxs[i][0], &chunkIndices[i][0], unsigned(chunkIndices[i].size()));
+
+		rasterizer.Flush();
+
+		std::vector<bool> chunkSeen(chunks.size(), false);
+
+		for (int y = 0; y < HEIGHT; ++y)
+		{
+			for (int x = 0; x < WIDTH; ++x)
+			{
+				unsigned chunkID = rasterizer.GetColours()[y * rasterizer.GetPitch() + x] & 0xff;
+
+				if (chunkID > 0)
+					chunkSeen[chunkID - 1] = true;
+			}
+		}
+
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			if (chunkSeen[i] && !CHECK(chunkVisible[i]))
+			{
+				printf("    (%s: chunk %zu in frame %zu, %s)\n", pName, i, frame, chunkInFrustum[i] ? "hidden" : "outside the frustum");
+				return false;
+			}
+		}
+	}
+
+	const OcclusionBufferStats &stats = buffer.GetStats();
+	double numFrames = double(std::max(frames.size(), size_t(1)));
+
+	printf("    %s, %zu frames: %.1f chunks a frame in the frustum, %.1f hidden: %.3f ms a frame (%.3f setting up, %.3f rasterizing, %.3f testing)\n",
+		pName, frames.size(), numInFrustum / numFrames, numHidden / numFrames, (stats.setupSeconds + stats.rasterSeconds + stats.testSeconds) * 1000. / numFrames,
+		stats.setupSeconds * 1000. / numFrames, stats.rasterSeconds * 1000. / numFrames, stats.testSeconds * 1000. / numFrames);
+
+	*pNumHidden = numHidden;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// An orbit round the ridge, replayed from a camera path file as -occlusion
+// replays one recorded in the app. A CameraPath.txt recorded in the app
+// is replayed as well, over Heightmap.bmp, if there's one with the maps.
+TEST(OcclusionBufferTerrain)
+{
+	const int SIZE = 257, NUM_FRAMES = 24;
+
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, SIZE, SIZE, 1.f, &GetRidgeHeight));
+
+	std::vector<CameraPathFrame> orbit;
+
+	for (int frame = 0; frame < NUM_FRAMES; ++frame)
+	{
+		float angle = frame * 2.f * 3.14159265f / NUM_FRAMES;
+
+		// Outside the ridge, where the ground's gentle enough that none
+		// of it's nearer than the near plane: what that clips off would
+		// show what's behind it, though the occluders still hide it.
+		CameraPathFrame pathFrame;
+		pathFrame.camera[0] = sinf(angle) * 80.f;
+		pathFrame.camera[2] = cosf(angle) * 80.f;
+		pathFrame.camera[1] = GetRidgeHeight(pathFrame.camera[0], pathFrame.camera[2]) + 3.f;
+
+		pathFrame.lookat[0] = -pathFrame.camera[0];
+		pathFrame.lookat[1] = pathFrame.camera[1] - 4.f;
+		pathFrame.lookat[2] = -pathFrame.camera[2];
+
+		orbit.push_back(pathFrame);
+	}
+
+	std::string fileName = GetTestTempFileName("OcclusionPath.txt");
+	std::vector<CameraPathFrame> frames;
+
+	REQUIRE(SaveCameraPath(fileName.c_str(), orbit));
+	REQUIRE(LoadCameraPath(fileName.c_str(), &frames));
+	REQUIRE(frames.size() == orbit.size());
+
+	remove(fileName.c_str());
+
+	size_t numHidden;
+	REQUIRE(ReplayOcclusionPath("orbit", &grid, frames, &numHidden));
+
+	// The ridge hides something.
+	CHECK(numHidden > 0);
+
+	// Laid out as LoadHeightMap does.
+	std::vector<uint8_t> values;
+	int width, length;
+
+	if (LoadCameraPath(GetTestDataFileName("CameraPath.txt").c_str(), &frames) && !frames.empty() &&
+		LoadHeightMapBMP(GetTestDataFileName("Heightmap.bmp").c_str(), &values, &width, &length))
+	{
+		std::vector<float> heights(values.size());
+		for (size_t i = 0; i < values.size(); ++i)
+			heights[i] = values[i] / 16.f;
+
+		TerrainGrid mapGrid;
+		REQUIRE(mapGrid.Create(width, length, (float)(-(width / 2)), (float)(length / 2), 1.f, -1.f));
+		mapGrid.SetHeights(0, 0, width - 1, length - 1, &heights[0], width);
+
+		ReplayOcclusionPath("CameraPath.txt", &mapGrid, frames, &numHidden);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,117 @@
+#include "Test.h"
+
+#include "ParallelJobs.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(RunParallelJobsRunsEachJobOnce)
+{
+	const size_t NUM_JOBS = 200;
+
+	std::vector<std::atomic<int> > numRuns(NUM_JOBS);
+	for (size_t i = 0; i < NUM_JOBS; ++i)
+		numRuns[i] = 0;
+
+	std::mutex mutex;
+	std::set<std::thread::id> threadIDs;
+
+	std::vector<std::string> messages;
+
+	// Every third job fails. The delays vary, so jobs finish out of
+	// order.
+	size_t numFailed = RunParallelJobs(NUM_JOBS, 4, [&](size_t jobIndex, std::string *pMessages) {
+		++numRuns[jobIndex];
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			threadIDs.insert(std::this_thread::get_id());
+		}
+
+		std::this_thread::sleep_for(std::chrono::microseconds((jobIndex * 7919) % 500));
+
+		char message[100];
+		snprintf(message, sizeof message, "job %zu\n", jobIndex);
+		*pMessages += message;
+
+		return jobIndex % 3 != 0;
+	}, &messages);
+
+	CHECK(numFailed == (NUM_JOBS + 2) / 3);
+	CHECK(threadIDs.size() <= 4);
+
+	REQUIRE(messages.size() == NUM_JOBS);
+
+	for (size_t i = 0; i < NUM_JOBS; ++i)
+	{
+		char message[100];
+		snprintf(message, sizeof message, "job %zu\n", i);
+
+		if (!CHECK(numRuns[i] == 1 && messages[i] == message))
+			break;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(RunParallelJobsEdgeCases)
+{
+	std::vector<std::string> messages(3, "old");
+
+	size_t numCalls = 0;
+
+	// No jobs.
+	CHECK(RunParallelJobs(0, 0, [&](size_t, std::string *) {
+		++numCalls;
+		return true;
+	}, &messages) == 0);
+
+	CHECK(numCalls == 0);
+	CHECK(messages.empty());
+
+	// One thread means the calling thread, in order.
+	std::vector<size_t> order;
+	std::thread::id callingThreadID = std::this_thread::get_id();
+	bool allOnCallingThread = true;
+
+	CHECK(RunParallelJobs(10, 1, [&](size_t jobIndex, std::string *) {
+		order.push_back(jobIndex);
+		allOnCallingThread = allOnCallingThread && std::this_thread::get_id() == callingThreadID;
+		return false;
+	}, NULL) == 10);
+
+	CHECK(allOnCallingThread);
+	REQUIRE(order.size() == 10);
+
+	for (size_t i = 0; i < order.size(); ++i)
+		CHECK(order[i] == i);
+
+	// More threads than jobs, and one thread per core.
+	std::atomic<size_t> numRun(0);
+
+	CHECK(RunParallelJobs(3, 64, [&](size_t, std::string *) {
+		++numRun;
+		return true;
+	}, NULL) == 0);
+
+	CHECK(RunParallelJobs(50, 0, [&](size_t, std::string *) {
+		++numRun;
+		return true;
+	}, NULL) == 0);
+
+	CHECK(numRun == 53);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,19 @@
+// Heightmap's -render batch mode, for Linux, where there's no exe to
+// run it from:
+//
+//     RenderTerrain <in.bmp> <out.ppm|out.png> [width] [height] [frames] [threads]
+//
+// See TerrainRenderBatch.
+
+#include "TerrainRenderBatch.h"
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+	return RunTerrainRenderBatch(argc, argv);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,214 @@
+#include "Test.h"
+
+#include "RingAllocator.h"
+
+#include <stdlib.h>
+
+#include <deque>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TestAllocation
+{
+	size_t offset;
+	size_t numBytes;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool Overlaps(const TestAllocation &a, const TestAllocation &b)
+{
+	return a.offset < b.offset + b.numBytes && b.offset < a.offset + a.numBytes;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(RingAllocatorBasics)
+{
+	RingAllocator ring;
+	CHECK(!ring.Create(0));
+	REQUIRE(ring.Create(100));
+	CHECK(ring.GetSize() == 100 && ring.GetNumBytesUsed() == 0 && ring.GetNumFramesInFlight() == 0);
+
+	size_t offset;
+
+	// Nothing, or more than the whole ring, never fits.
+	CHECK(!ring.Allocate(0, 1, &offset));
+	CHECK(!ring.Allocate(101, 1, &offset));
+	CHECK(ring.GetStats().numFailed == 2);
+
+	// One after the other, aligned.
+	REQUIRE(ring.Allocate(10, 1, &offset));
+	CHECK(offset == 0);
+	REQUIRE(ring.Allocate(10, 16, &offset));
+	CHECK(offset == 16);
+	CHECK(ring.GetNumBytesUsed() == 26 && ring.GetStats().numBytesWasted == 6);
+
+	ring.EndFrame(1);
+
+	REQUIRE(ring.Allocate(40, 4, &offset));
+	CHECK(offset == 28);
+	ring.EndFrame(2);
+
+	REQUIRE(ring.Allocate(30, 1, &offset));
+	CHECK(offset == 68);
+	ring.EndFrame(3);
+
+	CHECK(ring.GetNumFramesInFlight() == 3 && ring.GetOldestFence() == 1);
+	CHECK(ring.GetNumBytesUsed() == 98);
+
+	// The 2 left at the end aren't enough, and the start's still in use.
+	CHECK(!ring.Allocate(5, 1, &offset));
+
+	// Once frame 1's done, it wraps round, skipping the end.
+	ring.Retire(1);
+	CHECK(ring.GetNumFramesInFlight() == 2 && ring.GetOldestFence() == 2);
+	CHECK(ring.GetNumBytesUsed() == 72);
+
+	REQUIRE(ring.Allocate(20, 1, &offset));
+	CHECK(offset == 0);
+	CHECK(ring.GetNumBytesUsed() == 94);
+
+	// Up to the tail exactly, which fills the ring.
+	CHECK(!ring.Allocate(7, 1, &offset));
+	REQUIRE(ring.Allocate(6, 1, &offset));
+	CHECK(offset == 20 && ring.GetNumBytesUsed() == 100);
+	CHECK(!ring.Allocate(1, 1, &offset));
+
+	ring.EndFrame(4);
+
+	// Frames that allocate nothing come and go too.
+	ring.EndFrame(5);
+
+	ring.Retire(4);
+	CHECK(ring.GetNumFramesInFlight() == 1 && ring.GetNumBytesUsed() == 0);
+
+	ring.Retire(5);
+	CHECK(ring.GetNumFramesInFlight() == 0);
+
+	// With nothing in use, the whole ring's free again.
+	REQUIRE(ring.Allocate(100, 1, &offset));
+	CHECK(offset == 0);
+
+	const RingAllocatorStats &stats = ring.GetStats();
+	CHECK(stats.numAllocations == 7 && stats.numFailed == 5);
+	CHECK(stats.numBytesAllocated == 216);
+	CHECK(stats.maxNumBytesUsed == 100);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(RingAllocatorNeverOverlaps)
+{
+	const size_t SIZE = 4096;
+
+	RingAllocator ring;
+	REQUIRE(ring.Create(SIZE));
+
+	srand(45);
+
+	// What each frame in flight has, oldest first, and the frame that
+	// hasn't ended yet.
+	std::deque<std::vector<TestAllocation> > frames;
+	std::vector<TestAllocation> frame;
+
+	uint64_t fence = 0, completedFence = 0;
+	size_t numAllocations = 0, numBytesAllocated = 0, numFailed = 0;
+
+	for (int i = 0; i < 3000; ++i)
+	{
+		int numFrameAllocations = rand() % 6;
+
+		for (int j = 0; j < numFrameAllocations; ++j)
+		{
+			TestAllocation allocation;
+			allocation.numBytes = 1 + rand() % 700;
+
+			size_t alignment = size_t(1) << (rand() % 9);
+
+			if (!ring.Allocate(allocation.numBytes, alignment, &allocation.offset))
+			{
+				++numFailed;
+				continue;
+			}
+
+			++numAllocations;
+			numBytesAllocated += allocation.numBytes;
+
+			if (!CHECK(allocation.offset % alignment == 0 && allocation.offset + allocation.numBytes <= SIZE))
+				return;
+
+			// Clear of everything that's still in use.
+			for (size_t k = 0; k < frames.size(); ++k)
+			{
+				for (size_t m = 0; m < frames[k].size(); ++m)
+				{
+					if (!CHECK(!Overlaps(allocation, frames[k][m])))
+						return;
+				}
+			}
+
+			for (size_t k = 0; k < frame.size(); ++k)
+			{
+				if (!CHECK(!Overlaps(allocation, frame[k])))
+					return;
+			}
+
+			frame.push_back(allocation);
+		}
+
+		ring.EndFrame(++fence);
+		frames.push_back(frame);
+		frame.clear();
+
+		// The GPU's up to 3 frames behind.
+		uint64_t lag = uint64_t(rand() % 4);
+
+		if (fence > lag && fence - lag > completedFence)
+		{
+			completedFence = fence - lag;
+			ring.Retire(completedFence);
+
+			while (frames.size() > lag)
+				frames.pop_front();
+		}
+
+		if (!CHECK(ring.GetNumFramesInFlight() == frames.size()))
+			return;
+
+		size_t numBytesInUse = 0;
+
+		for (size_t k = 0; k < frames.size(); ++k)
+		{
+			for (size_t m = 0; m < frames[k].size(); ++m)
+				numBytesInUse += frames[k][m].numBytes;
+		}
+
+		if (!CHECK(ring.GetNumBytesUsed() >= numBytesInUse && ring.GetNumBytesUsed() <= SIZE))
+			return;
+	}
+
+	// Some didn't fit, but most did.
+	CHECK(numFailed > 0 && numAllocations > numFailed * 4);
+
+	const RingAllocatorStats &stats = ring.GetStats();
+	CHECK(stats.numAllocations == numAllocations);
+	CHECK(stats.numBytesAllocated == numBytesAllocated);
+	CHECK(stats.numFailed == numFailed);
+	CHECK(stats.maxNumBytesUsed <= SIZE);
+
+	// Once the GPU catches up, it's all free.
+	ring.Retire(fence);
+	CHECK(ring.GetNumFramesInFlight() == 0 && ring.GetNumBytesUsed() == 0);
+
+	size_t offset;
+	CHECK(ring.Allocate(SIZE, 1, &offset) && offset == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
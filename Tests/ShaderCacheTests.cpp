@@ -0,0 +1,321 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "Test.h"
+
+#include "ShaderCache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Laid out like D3D_SHADER_MACRO.
+struct TestMacro
+{
+	const char *Name;
+	const char *Definition;
+};
+
+static const char SOURCE[] = "float4 main() : SV_Target { return 1; }";
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static std::string GetEntryFileName(const std::string &directory, uint64_t key)
+{
+	char name[100];
+	snprintf(name, sizeof name, "/%08x%08x.cso", unsigned(key >> 32), unsigned(key));
+
+	return directory + name;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The cache's own directory, emptied of the entries the tests use.
+static std::string GetCacheDirectory(const char *pName, const uint64_t *pKeys, size_t numKeys)
+{
+	std::string directory = GetTestTempFileName(pName);
+
+	for (size_t i = 0; i < numKeys; ++i)
+	{
+		std::string fileName = GetEntryFileName(directory, pKeys[i]);
+
+		remove(fileName.c_str());
+		remove((fileName + ".tmp").c_str());
+	}
+
+	return directory;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(ShaderCacheKeyItems)
+{
+	ShaderCacheKey ab_c;
+	ab_c.AddString("ab");
+	ab_c.AddString("c");
+
+	ShaderCacheKey a_bc;
+	a_bc.AddString("a");
+	a_bc.AddString("bc");
+
+	CHECK(ab_c.GetKey() != a_bc.GetKey());
+
+	ShaderCacheKey null;
+	null.AddString(NULL);
+
+	ShaderCacheKey empty;
+	empty.AddString("");
+
+	CHECK(null.GetKey() != empty.GetKey());
+	CHECK(null.GetKey() != ShaderCacheKey().GetKey());
+
+	ShaderCacheKey again;
+	again.AddString("ab");
+	again.AddString("c");
+
+	CHECK(again.GetKey() == ab_c.GetKey());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(ShaderCacheKeyInputs)
+{
+	TestMacro macros[] = {{"SHADOWS", "1"}, {"FOG", NULL}, {NULL, NULL}};
+	TestMacro otherDefinition[] = {{"SHADOWS", "0"}, {"FOG", NULL}, {NULL, NULL}};
+	TestMacro otherName[] = {{"SHADOW", "1"}, {"FOG", NULL}, {NULL, NULL}};
+	TestMacro emptyDefinition[] = {{"SHADOWS", "1"}, {"FOG", ""}, {NULL, NULL}};
+	TestMacro fewer[] = {{"SHADOWS", "1"}, {NULL, NULL}};
+	TestMacro reordered[] = {{"FOG", NULL}, {"SHADOWS", "1"}, {NULL, NULL}};
+
+	uint64_t key = GetShaderCacheKey(1, 0, SOURCE, macros, "main", "ps_5_0");
+
+	CHECK(GetShaderCacheKey(1, 0, SOURCE, macros, "main", "ps_5_0") == key);
+
+	CHECK(GetShaderCacheKey(2, 0, SOURCE, macros, "main", "ps_5_0") != key);
+	CHECK(GetShaderCacheKey(1, 1, SOURCE, macros, "main", "ps_5_0") != key);
+	CHECK(GetShaderCacheKey(1, 0, "float4 main() : SV_Target { return 0; }", macros, "main", "ps_5_0") != key);
+	CHECK(GetShaderCacheKey(1, 0, SOURCE, otherDefinition, "main", "ps_5_0") != key);
+	CHECK(GetShaderCacheKey(1, 0, SOURCE, otherName, "main", "ps_5_0") != key);
+	CHECK(GetShaderCacheKey(1, 0, SOURCE, emptyDefinition, "main", "ps_5_0") != key);
+	CHECK(GetShaderCacheKey(1, 0, SOURCE, fewer, "main", "ps_5_0") != key);
+	CHECK(GetShaderCacheKey(1, 0, SOURCE, reordered, "main", "ps_5_0") != key);
+	CHECK(GetShaderCacheKey(1, 0, SOURCE, macros, "PSMain", "ps_5_0") != key);
+	CHECK(GetShaderCacheKey(1, 0, SOURCE, macros, "main", "ps_4_0") != key);
+
+	// No macros at all is the same whether it's NULL or an empty list.
+	TestMacro none[] = {{NULL, NULL}};
+
+	CHECK(GetShaderCacheKey(1, 0, SOURCE, none, "main", "ps_5_0") == GetShaderCacheKey(1, 0, SOURCE, static_cast<const TestMacro *>(NULL), "main", "ps_5_0"));
+	CHECK(GetShaderCacheKey(1, 0, SOURCE, none, "main", "ps_5_0") != GetShaderCacheKey(1, 0, SOURCE, fewer, "main", "ps_5_0"));
+
+	// The macro list is delimited, so moving text between it and the
+	// entry point changes the key.
+	TestMacro entryAsMacro[] = {{"main", NULL}, {NULL, NULL}};
+
+	CHECK(GetShaderCacheKey(1, 0, SOURCE, entryAsMacro, NULL, "ps_5_0") != GetShaderCacheKey(1, 0, SOURCE, none, "main", "ps_5_0"));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(ShaderCacheRoundTrip)
+{
+	const uint64_t keys[] = {0x0123456789abcdefull, 0xfedcba9876543210ull};
+	std::string directory = GetCacheDirectory("ShaderCacheRoundTrip", keys, 2);
+
+	const char bytecode[] = "DXBC pretend bytecode";
+	const char reflection[] = "reflection";
+
+	{
+		ShaderCache cache;
+
+		std::vector<char> foundBytecode, foundReflection;
+
+		// Nothing until there's a directory.
+		cache.Store(keys[0], bytecode, sizeof bytecode, reflection, sizeof reflection);
+		CHECK(!cache.Find(keys[0], &foundBytecode, &foundReflection));
+
+		REQUIRE(cache.SetDirectory(directory.c_str()));
+
+		CHECK(!cache.Find(keys[0], &foundBytecode, &foundReflection));
+		CHECK(cache.GetNumMisses() == 1);
+
+		cache.Store(keys[0], bytecode, sizeof bytecode, reflection, sizeof reflection);
+		cache.Store(keys[1], bytecode, 5, NULL, 0);
+		cache.Flush();
+
+		REQUIRE(cache.Find(keys[0], &foundBytecode, &foundReflection));
+		CHECK(foundBytecode == std::vector<char>(bytecode, bytecode + sizeof bytecode));
+		CHECK(foundReflection == std::vector<char>(reflection, reflection + sizeof reflection));
+
+		REQUIRE(cache.Find(keys[1], &foundBytecode, &foundReflection));
+		CHECK(foundBytecode == std::vector<char>(bytecode, bytecode + 5));
+		CHECK(foundReflection.empty());
+
+		CHECK(cache.GetNumHits() == 2);
+		CHECK(cache.GetNumMisses() == 1);
+	}
+
+	// And it's still there for the next run.
+	{
+		ShaderCache cache;
+		REQUIRE(cache.SetDirectory(directory.c_str()));
+
+		std::vector<char> foundBytecode, foundReflection;
+
+		REQUIRE(cache.Find(keys[0], &foundBytecode, &foundReflection));
+		CHECK(foundBytecode == std::vector<char>(bytecode, bytecode + sizeof bytecode));
+		CHECK(foundReflection == std::vector<char>(reflection, reflection + sizeof reflection));
+
+		CHECK(cache.GetNumHits() == 1);
+		CHECK(cache.GetNumMisses() == 0);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+
+// A FIFO in place of the writer's temp file holds the writer up until
+// it's read from, so the entry is certainly still pending when Find
+// looks for it.
+TEST(ShaderCachePendingHit)
+{
+	const uint64_t key = 0x1111222233334444ull;
+	std::string directory = GetCacheDirectory("ShaderCachePending", &key, 1);
+
+	const char bytecode[] = "pending bytecode";
+	const char reflection[] = "pending reflection";
+
+	ShaderCache cache;
+	REQUIRE(cache.SetDirectory(directory.c_str()));
+
+	std::string fileName = GetEntryFileName(directory, key);
+	REQUIRE(mkfifo((fileName + ".tmp").c_str(), 0666) == 0);
+
+	cache.Store(key, bytecode, sizeof bytecode, reflection, sizeof reflection);
+
+	std::vector<char> foundBytecode, foundReflection;
+
+	CHECK(cache.Find(key, &foundBytecode, &foundReflection));
+	CHECK(foundBytecode == std::vector<char>(bytecode, bytecode + sizeof bytecode));
+	CHECK(foundReflection == std::vector<char>(reflection, reflection + sizeof reflection));
+	CHECK(cache.GetNumHits() == 1);
+
+	// Let the writer go.
+	std::vector<char> written;
+	CHECK(ReadTestFile(fileName + ".tmp", &written));
+
+	cache.Flush();
+
+	// The FIFO has been renamed to the entry; don't leave it there for
+	// something to block on.
+	remove(fileName.c_str());
+	remove((fileName + ".tmp").c_str());
+
+	CHECK(written.size() > sizeof bytecode + sizeof reflection);
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(ShaderCacheDamagedEntries)
+{
+	const uint64_t key = 0x5555666677778888ull;
+	const uint64_t otherKey = 0x9999aaaabbbbccccull;
+	const uint64_t keys[] = {key, otherKey};
+	std::string directory = GetCacheDirectory("ShaderCacheDamaged", keys, 2);
+
+	const char bytecode[] = "damaged bytecode";
+	const char reflection[] = "damaged reflection";
+
+	std::vector<char> good;
+
+	{
+		ShaderCache cache;
+		REQUIRE(cache.SetDirectory(directory.c_str()));
+
+		cache.Store(key, bytecode, sizeof bytecode, reflection, sizeof reflection);
+		cache.Flush();
+
+		REQUIRE(ReadTestFile(GetEntryFileName(directory, key), &good));
+	}
+
+	// 32-byte header: magic, version, key, sizes, checksum.
+	REQUIRE(good.size() == 32 + sizeof bytecode + sizeof reflection);
+
+	std::vector<std::vector<char> > damaged;
+
+	// Truncated in the header, and in the payload.
+	damaged.push_back(std::vector<char>(good.begin(), good.begin() + 20));
+	damaged.push_back(std::vector<char>(good.begin(), good.end() - 1));
+
+	// Trailing junk.
+	damaged.push_back(good);
+	damaged.back().push_back(0);
+
+	// Magic.
+	damaged.push_back(good);
+	damaged.back()[0] ^= 1;
+
+	// Version.
+	damaged.push_back(good);
+	damaged.back()[4] ^= 1;
+
+	// Bytecode size.
+	damaged.push_back(good);
+	damaged.back()[16] ^= 1;
+
+	// Checksum, and a payload byte the checksum no longer matches.
+	damaged.push_back(good);
+	damaged.back()[24] ^= 1;
+
+	damaged.push_back(good);
+	damaged.back()[40] ^= 1;
+
+	// Empty.
+	damaged.push_back(std::vector<char>());
+
+	ShaderCache cache;
+	REQUIRE(cache.SetDirectory(directory.c_str()));
+
+	std::vector<char> foundBytecode, foundReflection;
+
+	for (size_t i = 0; i < damaged.size(); ++i)
+	{
+		REQUIRE(WriteTestFile(GetEntryFileName(directory, key), damaged[i]));
+
+		if (!CHECK(!cache.Find(key, &foundBytecode, &foundReflection)))
+			printf("    (damaged entry %zu)\n", i);
+	}
+
+	CHECK(cache.GetNumMisses() == damaged.size());
+
+	// A good entry under the wrong name.
+	REQUIRE(WriteTestFile(GetEntryFileName(directory, otherKey), good));
+	CHECK(!cache.Find(otherKey, &foundBytecode, &foundReflection));
+
+	// And the good one is still good.
+	REQUIRE(WriteTestFile(GetEntryFileName(directory, key), good));
+	CHECK(cache.Find(key, &foundBytecode, &foundReflection));
+	CHECK(cache.GetNumHits() == 1);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,294 @@
+#include "Test.h"
+
+#include "ShaderDescription.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Without D3D to reflect a shader, descriptions are built in the
+// serialised layout by hand. These match the private values in
+// ShaderDescription.
+
+enum
+{
+	TT_TEXTURE2D = 1,
+	TT_SAMPLER_STATE = 2,
+	TT_FLOAT = 3,
+	TT_FLOAT4 = 6,
+	TT_FLOAT4x4 = 7,
+	TT_INT = 8,
+	TT_CBUFFER = 9,
+};
+
+static const int NUM_CBUFFER_SLOTS = 16;
+static const int SCOPE_CBUFFERS = 16;
+static const int SCOPE_TEXTURES = 17;
+static const int SCOPE_SAMPLER_STATES = 18;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TestThing
+{
+	uint32_t hash;
+	int32_t scope;
+	int32_t type;
+	int32_t slot;
+	uint32_t nameOffset;
+};
+
+struct TestDescription
+{
+	uint32_t cbufferSizes[NUM_CBUFFER_SLOTS];
+	std::vector<TestThing> things;
+	std::vector<char> names;
+
+	TestDescription()
+	{
+		memset(cbufferSizes, 0, sizeof cbufferSizes);
+	}
+
+	void Add(int scope, const char *pName, int type, int slot)
+	{
+		TestThing thing;
+
+		thing.hash = 2166136261u;
+
+		for (const char *p = pName; *p; ++p)
+		{
+			thing.hash ^= uint8_t(*p);
+			thing.hash *= 16777619u;
+		}
+
+		thing.hash ^= uint32_t(scope);
+		thing.hash *= 16777619u;
+
+		thing.scope = scope;
+		thing.type = type;
+		thing.slot = slot;
+		thing.nameOffset = uint32_t(names.size());
+
+		names.insert(names.end(), pName, pName + strlen(pName) + 1);
+		things.push_back(thing);
+	}
+
+	std::vector<char> Serialise() const
+	{
+		std::vector<char> data(4 + 3 * sizeof(uint32_t) + sizeof cbufferSizes + things.size() * sizeof(TestThing) + names.size());
+		char *pDest = &data[0];
+
+		memcpy(pDest, "SDSC", 4);
+		pDest += 4;
+
+		uint32_t header[3] = {1, uint32_t(things.size()), uint32_t(names.size())};
+		memcpy(pDest, header, sizeof header);
+		pDest += sizeof header;
+
+		memcpy(pDest, cbufferSizes, sizeof cbufferSizes);
+		pDest += sizeof cbufferSizes;
+
+		if (!things.empty())
+			memcpy(pDest, &things[0], things.size() * sizeof(TestThing));
+		pDest += things.size() * sizeof(TestThing);
+
+		if (!names.empty())
+			memcpy(pDest, &names[0], names.size());
+
+		return data;
+	}
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void MakeTestDescription(TestDescription *pDescription)
+{
+	pDescription->cbufferSizes[0] = 64;
+	pDescription->cbufferSizes[3] = 96;
+
+	pDescription->Add(SCOPE_CBUFFERS, "$Globals", TT_CBUFFER, 0);
+	pDescription->Add(0, "g_WVP", TT_FLOAT4x4, 0);
+
+	pDescription->Add(SCOPE_CBUFFERS, "Lights", TT_CBUFFER, 3);
+	pDescription->Add(3, "g_lightDir", TT_FLOAT4, 0);
+	pDescription->Add(3, "g_numLights", TT_INT, 16);
+	pDescription->Add(3, "g_time", TT_FLOAT, 20);
+
+	// Same name, different scopes.
+	pDescription->Add(0, "g_time", TT_FLOAT, 48);
+
+	pDescription->Add(SCOPE_TEXTURES, "g_texture", TT_TEXTURE2D, 2);
+	pDescription->Add(SCOPE_SAMPLER_STATES, "g_sampler", TT_SAMPLER_STATE, 1);
+
+	// Enough to need more than one hash table size.
+	for (int i = 0; i < 40; ++i)
+	{
+		char name[100];
+		snprintf(name, sizeof name, "g_float%d", i);
+
+		pDescription->Add(3, name, TT_FLOAT, 24 + i * 4);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(ShaderDescriptionDeserialisesAndFinds)
+{
+	TestDescription testDescription;
+	MakeTestDescription(&testDescription);
+
+	std::vector<char> data = testDescription.Serialise();
+
+	ShaderDescription description;
+	REQUIRE(description.Deserialise(&data[0], data.size()));
+
+	int globalsSlot, lightsSlot, offset, slot;
+
+	REQUIRE(description.FindCBuffer("$Globals", &globalsSlot));
+	CHECK(globalsSlot == 0);
+	REQUIRE(description.FindCBuffer("Lights", &lightsSlot));
+	CHECK(lightsSlot == 3);
+
+	CHECK(description.GetCBufferSizeBytes(0) == 64);
+	CHECK(description.GetCBufferSizeBytes(3) == 96);
+	CHECK(description.GetCBufferSizeBytes(1) == 0);
+	CHECK(description.GetCBufferSizeBytes(-1) == 0);
+	CHECK(description.GetCBufferSizeBytes(NUM_CBUFFER_SLOTS) == 0);
+
+	CHECK(description.FindFloat4x4(globalsSlot, "g_WVP", &offset) && offset == 0);
+	CHECK(description.FindFloat4(lightsSlot, "g_lightDir", &offset) && offset == 0);
+	CHECK(description.FindInt(lightsSlot, "g_numLights", &offset) && offset == 16);
+	CHECK(description.FindFloat(lightsSlot, "g_time", &offset) && offset == 20);
+	CHECK(description.FindFloat(globalsSlot, "g_time", &offset) && offset == 48);
+	CHECK(description.FindTexture("g_texture", &slot) && slot == 2);
+	CHECK(description.FindSamplerState("g_sampler", &slot) && slot == 1);
+
+	for (int i = 0; i < 40; ++i)
+	{
+		char name[100];
+		snprintf(name, sizeof name, "g_float%d", i);
+
+		if (!CHECK(description.FindFloat(lightsSlot, name, &offset) && offset == 24 + i * 4))
+			break;
+	}
+
+	// Wrong type, wrong scope, not there at all, and from a cbuffer
+	// that wasn't found.
+	CHECK(!description.FindFloat4(lightsSlot, "g_time", &offset) && offset < 0);
+	CHECK(!description.FindFloat4x4(lightsSlot, "g_WVP", &offset) && offset < 0);
+	CHECK(!description.FindFloat(lightsSlot, "g_missing", &offset) && offset < 0);
+	CHECK(!description.FindTexture("g_sampler", &slot) && slot < 0);
+	CHECK(!description.FindCBuffer("g_texture", &slot) && slot < 0);
+	CHECK(!description.FindFloat(-1, "g_time", &offset) && offset < 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(ShaderDescriptionRoundTrips)
+{
+	TestDescription testDescription;
+	MakeTestDescription(&testDescription);
+
+	std::vector<char> data = testDescription.Serialise();
+
+	ShaderDescription description;
+	REQUIRE(description.Deserialise(&data[0], data.size()));
+
+	std::vector<char> reserialised;
+	description.Serialise(&reserialised);
+
+	CHECK(reserialised == data);
+
+	ShaderDescription copy;
+	REQUIRE(copy.Deserialise(&reserialised[0], reserialised.size()));
+
+	int slot, offset;
+	CHECK(copy.FindCBuffer("Lights", &slot) && slot == 3);
+	CHECK(copy.FindInt(slot, "g_numLights", &offset) && offset == 16);
+
+	// An empty description round trips too, and finds nothing.
+	ShaderDescription empty;
+
+	std::vector<char> emptyData;
+	empty.Serialise(&emptyData);
+
+	CHECK(emptyData == TestDescription().Serialise());
+	REQUIRE(copy.Deserialise(&emptyData[0], emptyData.size()));
+	CHECK(!copy.FindCBuffer("Lights", &slot));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(ShaderDescriptionRejectsDamagedData)
+{
+	TestDescription testDescription;
+	MakeTestDescription(&testDescription);
+
+	std::vector<char> good = testDescription.Serialise();
+
+	std::vector<std::vector<char> > damaged;
+
+	// Truncated, in the header and later.
+	damaged.push_back(std::vector<char>(good.begin(), good.begin() + 10));
+	damaged.push_back(std::vector<char>(good.begin(), good.end() - 1));
+
+	// Magic and version.
+	damaged.push_back(good);
+	damaged.back()[0] ^= 1;
+
+	damaged.push_back(good);
+	damaged.back()[4] ^= 1;
+
+	// Absurd counts.
+	damaged.push_back(good);
+	damaged.back()[8] = char(0xff);
+
+	damaged.push_back(good);
+	damaged.back()[15] = char(0x7f);
+
+	// Names not 0-terminated.
+	damaged.push_back(good);
+	damaged.back().back() = 'x';
+
+	// A changed name no longer matches its hash.
+	damaged.push_back(good);
+	damaged.back()[good.size() - 2] ^= 1;
+
+	// Bad scope, and a name offset past the end.
+	{
+		TestDescription badScope = testDescription;
+		badScope.things[1].scope = 19;
+		damaged.push_back(badScope.Serialise());
+
+		TestDescription badNameOffset = testDescription;
+		badNameOffset.things[1].nameOffset = uint32_t(badNameOffset.names.size());
+		damaged.push_back(badNameOffset.Serialise());
+	}
+
+	for (size_t i = 0; i < damaged.size(); ++i)
+	{
+		ShaderDescription description;
+		REQUIRE(description.Deserialise(&good[0], good.size()));
+
+		bool rejected = !description.Deserialise(&damaged[i][0], damaged[i].size());
+
+		// And it's left empty, not half-loaded.
+		int slot;
+		bool empty = !description.FindCBuffer("Lights", &slot) && description.GetCBufferSizeBytes(0) == 0;
+
+		if (!CHECK(rejected && empty))
+			printf("    (damaged description %zu)\n", i);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
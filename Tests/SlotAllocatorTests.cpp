@@ -0,0 +1,281 @@
+#include "Test.h"
+
+#include "SlotAllocator.h"
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Checks every handle's slot is its own, and holds what was put there,
+// as if the slots were a buffer that Defragment's moves were copied
+// around in.
+static bool CheckSlots(const SlotAllocator &allocator, const std::vector<int> &handles, const std::vector<int> &contents)
+{
+	std::vector<bool> used(size_t(allocator.GetNumSlots()), false);
+
+	for (size_t i = 0; i < handles.size(); ++i)
+	{
+		int slot = allocator.GetSlot(handles[i]);
+
+		if (!CHECK(slot >= 0 && slot < allocator.GetNumSlots() && !used[slot]))
+			return false;
+
+		used[slot] = true;
+
+		if (!CHECK(contents[slot] == handles[i]))
+			return false;
+	}
+
+	return CHECK(allocator.GetNumUsedSlots() == int(handles.size()));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(SlotAllocatorBasics)
+{
+	SlotAllocator allocator;
+	CHECK(!allocator.Create(0, 4));
+	CHECK(!allocator.Create(8, 0));
+	REQUIRE(allocator.Create(4, 2));
+
+	CHECK(allocator.GetNumPages() == 0 && allocator.GetOccupancy() == 0.f && allocator.GetFragmentation() == 0.f);
+
+	// The first slots of the first page first, and pages as needed, up
+	// to the limit.
+	int handles[8];
+
+	for (int i = 0; i < 8; ++i)
+	{
+		REQUIRE(allocator.Allocate(&handles[i]));
+		CHECK(allocator.GetSlot(handles[i]) == i);
+		CHECK(allocator.GetNumPages() == 1 + i / 4);
+	}
+
+	int handle;
+	CHECK(!allocator.Allocate(&handle));
+	CHECK(allocator.GetOccupancy() == 1.f);
+
+	// Freeing makes room, in the page it was in.
+	allocator.Free(handles[1]);
+	allocator.Free(handles[2]);
+	allocator.Free(handles[6]);
+	CHECK(allocator.GetNumUsedSlots() == 5 && allocator.GetOccupancy() == 5.f / 8.f);
+
+	// 5 allocations need both pages anyway.
+	CHECK(allocator.GetFragmentation() == 0.f);
+
+	allocator.Free(handles[7]);
+	allocator.Free(handles[5]);
+
+	// 3 would fit in 1 page of the 2.
+	CHECK(allocator.GetFragmentation() == .5f);
+
+	// Slot 4 moves down into one of the holes in page 0.
+	std::vector<SlotAllocatorMove> moves;
+	CHECK(allocator.Defragment(10, &moves) == 1);
+	REQUIRE(moves.size() == 1);
+	CHECK(moves[0].fromSlot == 4 && (moves[0].toSlot == 1 || moves[0].toSlot == 2));
+	CHECK(allocator.GetSlot(handles[4]) == moves[0].toSlot);
+	CHECK(allocator.GetFragmentation() == 0.f);
+
+	// Nothing more to do.
+	CHECK(allocator.Defragment(10, &moves) == 0 && moves.size() == 1);
+
+	CHECK(allocator.GetNumPages() == 2);
+	allocator.TrimEmptyPages();
+	CHECK(allocator.GetNumPages() == 1 && allocator.GetNumSlots() == 4);
+	CHECK(allocator.GetOccupancy() == .75f);
+
+	allocator.Destroy();
+	CHECK(allocator.GetNumPages() == 0 && allocator.GetNumUsedSlots() == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(SlotAllocatorDefragmentKeepsContents)
+{
+	const int SLOTS_PER_PAGE = 16, MAX_NUM_PAGES = 32;
+
+	SlotAllocator allocator;
+	REQUIRE(allocator.Create(SLOTS_PER_PAGE, MAX_NUM_PAGES));
+
+	srand(46);
+
+	std::vector<int> handles;
+
+	// Per slot, the handle it was given to.
+	std::vector<int> contents;
+
+	for (int round = 0; round < 60; ++round)
+	{
+		// Mostly allocating to start with, then mostly freeing, so pages
+		// fill up and then empty out in patches.
+		int allocatePercent = round < 30 ? 70 : 35;
+
+		for (int i = 0; i < 50; ++i)
+		{
+			if (rand() % 100 < allocatePercent)
+			{
+				int handle;
+
+				if (!allocator.Allocate(&handle))
+				{
+					CHECK(allocator.GetNumUsedSlots() == SLOTS_PER_PAGE * MAX_NUM_PAGES);
+					continue;
+				}
+
+				handles.push_back(handle);
+
+				contents.resize(size_t(allocator.GetNumSlots()), -1);
+				contents[allocator.GetSlot(handle)] = handle;
+			}
+			else if (!handles.empty())
+			{
+				size_t index = size_t(rand()) % handles.size();
+
+				contents[allocator.GetSlot(handles[index])] = -1;
+				allocator.Free(handles[index]);
+
+				handles[index] = handles.back();
+				handles.pop_back();
+			}
+		}
+
+		if (!CheckSlots(allocator, handles, contents))
+			return;
+
+		// A few moves at a time, some rounds.
+		if (round % 3 == 0)
+		{
+			float fragmentation = allocator.GetFragmentation();
+
+			std::vector<SlotAllocatorMove> moves;
+			size_t numMoves = allocator.Defragment(size_t(1 + rand() % 8), &moves);
+
+			if (!CHECK(moves.size() == numMoves))
+				return;
+
+			for (size_t i = 0; i < moves.size(); ++i)
+			{
+				// Always to an earlier page.
+				if (!CHECK(moves[i].toSlot / SLOTS_PER_PAGE < moves[i].fromSlot / SLOTS_PER_PAGE))
+					return;
+
+				if (!CHECK(contents[moves[i].toSlot] == -1))
+					return;
+
+				contents[moves[i].toSlot] = contents[moves[i].fromSlot];
+				contents[moves[i].fromSlot] = -1;
+			}
+
+			if (!CheckSlots(allocator, handles, contents))
+				return;
+
+			CHECK(allocator.GetFragmentation() <= fragmentation);
+		}
+	}
+
+	// All the way, then the empty pages go.
+	std::vector<SlotAllocatorMove> moves;
+	allocator.Defragment(size_t(SLOTS_PER_PAGE * MAX_NUM_PAGES), &moves);
+
+	for (size_t i = 0; i < moves.size(); ++i)
+	{
+		contents[moves[i].toSlot] = contents[moves[i].fromSlot];
+		contents[moves[i].fromSlot] = -1;
+	}
+
+	CHECK(allocator.GetFragmentation() == 0.f);
+
+	allocator.TrimEmptyPages();
+	CHECK(allocator.GetNumPages() == (int(handles.size()) + SLOTS_PER_PAGE - 1) / SLOTS_PER_PAGE);
+
+	contents.resize(size_t(allocator.GetNumSlots()));
+	CheckSlots(allocator, handles, contents);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Allocate/free churn, as TerrainMeshPool sees it with the world's
+// chunks streaming in and out: 32 slot pages, room for 4096 chunks,
+// about 3000 of them live. Then half of them go, as when the camera
+// jumps, and Defragment packs the rest down. Prints ops/s, and the
+// occupancy and fragmentation either side of defragmenting.
+TEST(SlotAllocatorBenchmark)
+{
+	const int SLOTS_PER_PAGE = 32, MAX_NUM_PAGES = 128, NUM_LIVE = 3000;
+	const int NUM_OPS = 1000000, NUM_RUNS = 3;
+
+	srand(46);
+
+	// Which allocation each free is, picked ahead of time so rand isn't
+	// timed.
+	std::vector<size_t> freeIndices(NUM_OPS / 2);
+	for (size_t i = 0; i < freeIndices.size(); ++i)
+		freeIndices[i] = size_t(rand()) % NUM_LIVE;
+
+	SlotAllocator allocator;
+	std::vector<int> handles;
+	double bestSeconds = DBL_MAX;
+
+	for (int run = 0; run < NUM_RUNS; ++run)
+	{
+		REQUIRE(allocator.Create(SLOTS_PER_PAGE, MAX_NUM_PAGES));
+
+		handles.resize(NUM_LIVE);
+		for (int i = 0; i < NUM_LIVE; ++i)
+			REQUIRE(allocator.Allocate(&handles[i]));
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		// A free, then an allocate, so the number live stays the same.
+		for (size_t i = 0; i < freeIndices.size(); ++i)
+		{
+			int *pHandle = &handles[freeIndices[i]];
+
+			allocator.Free(*pHandle);
+			allocator.Allocate(pHandle);
+		}
+
+		bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+		REQUIRE(allocator.GetNumUsedSlots() == NUM_LIVE);
+	}
+
+	printf("    %d slot pages, %d live: %.1fM allocates and frees a second\n", SLOTS_PER_PAGE, NUM_LIVE, NUM_OPS / bestSeconds * 1e-6);
+	printf("    after churn: %d pages, occupancy %.1f%%, fragmentation %.1f%%\n", allocator.GetNumPages(), allocator.GetOccupancy() * 100., allocator.GetFragmentation() * 100.);
+
+	// Every other one goes, scattered over every page.
+	for (size_t i = 0; i < handles.size(); i += 2)
+		allocator.Free(handles[i]);
+
+	float fragmentation = allocator.GetFragmentation();
+	printf("    half freed: %d pages, occupancy %.1f%%, fragmentation %.1f%%\n", allocator.GetNumPages(), allocator.GetOccupancy() * 100., fragmentation * 100.);
+
+	std::vector<SlotAllocatorMove> moves;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	allocator.Defragment(size_t(NUM_LIVE), &moves);
+	allocator.TrimEmptyPages();
+	double defragmentSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("    defragmented: %d pages, occupancy %.1f%%, fragmentation %.1f%%, %zu moves in %.3fms\n", allocator.GetNumPages(), allocator.GetOccupancy() * 100.,
+		allocator.GetFragmentation() * 100., moves.size(), defragmentSeconds * 1000.);
+
+	CHECK(fragmentation > 0.f);
+	CHECK(allocator.GetFragmentation() == 0.f);
+	CHECK(allocator.GetNumPages() == (NUM_LIVE / 2 + SLOTS_PER_PAGE - 1) / SLOTS_PER_PAGE);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,307 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "HeightMapFile.h"
+#include "SoftwareRasterizer.h"
+#include "TerrainGrid.h"
+#include "TerrainRenderBatch.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Laid out as Vertex_Pos3fColour4ub, for DrawUntextured.
+struct TestRasterVertex
+{
+	float pos[3];
+	uint8_t colour[4];
+};
+
+static_assert(sizeof(TestRasterVertex) == 16, "SoftwareRasterizer expects this layout");
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// From pixels to the -1 to 1 of the screen, y going up. With the
+// matrices left as they are, that's where the vertex ends up.
+static float PixelToScreenX(float x, int width)
+{
+	return x / width * 2.f - 1.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float PixelToScreenY(float y, int height)
+{
+	return 1.f - y / height * 2.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Kinds of mesh for the coverage test.
+enum TestMeshKind
+{
+	// Points moved about in their cells.
+	TEST_MESH_JITTERED,
+
+	// The same, but on the half pixels, so plenty of pixel centres are
+	// on the vertices and edges.
+	TEST_MESH_SNAPPED,
+
+	// Not moved, with every row and column of points through pixel
+	// centres, so the edges run along rows and columns of centres.
+	TEST_MESH_REGULAR,
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// A grid of triangles, numCells on a side, reaching past the edges of
+// a width by height image, with the quads split either way and the
+// triangles wound either way. *pVtxs gets 3 vertices per triangle.
+static void MakeTestCoverMesh(TestMeshKind kind, int width, int height, int numCells, std::vector<TestRasterVertex> *pVtxs)
+{
+	int numPoints = numCells + 1;
+
+	// From 8 pixels off one edge to 8 pixels off the other, in pixels.
+	float cellWidth = (width + 16.f) / numCells;
+	float cellHeight = (height + 16.f) / numCells;
+
+	std::vector<float> xs(size_t(numPoints) * numPoints), ys(xs.size());
+
+	for (int row = 0; row < numPoints; ++row)
+	{
+		for (int col = 0; col < numPoints; ++col)
+		{
+			float x = col * cellWidth - 8.f, y = row * cellHeight - 8.f;
+			bool inside = row > 0 && col > 0 && row < numCells && col < numCells;
+
+			if (kind == TEST_MESH_REGULAR)
+			{
+				x = floorf(x) + .5f;
+				y = floorf(y) + .5f;
+			}
+			else if (inside)
+			{
+				// Not so far that a quad stops being convex, which
+				// would make its triangles overlap.
+				x += (rand() / float(RAND_MAX) - .5f) * cellWidth * .4f;
+				y += (rand() / float(RAND_MAX) - .5f) * cellHeight * .4f;
+
+				if (kind == TEST_MESH_SNAPPED)
+				{
+					x = floorf(x * 2.f + .5f) * .5f;
+					y = floorf(y * 2.f + .5f) * .5f;
+				}
+			}
+
+			xs[size_t(row) * numPoints + col] = x;
+			ys[size_t(row) * numPoints + col] = y;
+		}
+	}
+
+	pVtxs->clear();
+
+	for (int row = 0; row < numCells; ++row)
+	{
+		for (int col = 0; col < numCells; ++col)
+		{
+			size_t a = size_t(row) * numPoints + col, b = a + 1, c = a + numPoints, d = c + 1;
+			size_t corners[2][3] = {{a, b, d}, {a, d, c}};
+
+			if (rand() % 2)
+			{
+				corners[0][2] = c;
+				corners[1][0] = b;
+			}
+
+			for (int i = 0; i < 2; ++i)
+			{
+				if (rand() % 2)
+					std::swap(corners[i][1], corners[i][2]);
+
+				for (int j = 0; j < 3; ++j)
+				{
+					TestRasterVertex vtx = {{PixelToScreenX(xs[corners[i][j]], width), PixelToScreenY(ys[corners[i][j]], height), .5f}, {255, 255, 255, 128}};
+					pVtxs->push_back(vtx);
+				}
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// A mesh that covers the screen has every pixel drawn exactly once: it's
+// drawn half see through over black, without a depth test, so a pixel
+// that's skipped stays black, and one drawn twice comes out brighter.
+TEST(SoftwareRasterizerSharedEdges)
+{
+	// Not a whole number of tiles, or of 4 pixels.
+	const int WIDTH = 203, HEIGHT = 141;
+
+	srand(49);
+
+	SoftwareRasterizer rasterizer;
+	REQUIRE(rasterizer.Create(WIDTH, HEIGHT, 1));
+
+	rasterizer.SetDepthStencilState(false, false);
+
+	const float black[4] = {0.f, 0.f, 0.f, 0.f};
+	const TestMeshKind kinds[] = {TEST_MESH_JITTERED, TEST_MESH_SNAPPED, TEST_MESH_REGULAR};
+	const char *const names[] = {"jittered", "snapped", "regular"};
+
+	for (int i = 0; i < 3; ++i)
+	{
+		std::vector<TestRasterVertex> vtxs;
+		MakeTestCoverMesh(kinds[i], WIDTH, HEIGHT, 12, &vtxs);
+
+		rasterizer.Clear(black);
+		rasterizer.ResetStats();
+		rasterizer.DrawUntextured(SoftwareRasterizer::Topology_TriangleList, &vtxs[0], NULL, unsigned(vtxs.size()));
+		rasterizer.Flush();
+
+		size_t numSkipped = 0, numDoubled = 0;
+
+		for (int y = 0; y < HEIGHT; ++y)
+		{
+			const uint32_t *pRow = rasterizer.GetColours() + y * rasterizer.GetPitch();
+
+			for (int x = 0; x < WIDTH; ++x)
+			{
+				uint32_t red = pRow[x] & 0xFF;
+
+				if (red == 0)
+					++numSkipped;
+				else if (red > 130)
+					++numDoubled;
+			}
+		}
+
+		if (!CHECK(numSkipped == 0 && numDoubled == 0))
+			printf("    (%s: %zu pixels skipped, %zu drawn twice)\n", names[i], numSkipped, numDoubled);
+
+		CHECK(rasterizer.GetStats().numPixelsWritten == size_t(WIDTH) * HEIGHT);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The terrain as -render draws it, then see through triangles on top,
+// in an order that matters, come out the same on any number of threads.
+TEST(SoftwareRasterizerSameOnAnyThreads)
+{
+	const int WIDTH = 301, HEIGHT = 170;
+	const unsigned numThreads[] = {1, 2, 3, 8, 0};
+
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 129, 129, 1.f, &GetTestHillsHeight));
+
+	std::vector<TerrainRenderChunk> chunks;
+	BuildTerrainRenderChunks(&grid, 64, &chunks);
+	CHECK(chunks.size() == 4);
+
+	srand(490);
+
+	std::vector<TestRasterVertex> overlays(3 * 40);
+
+	for (size_t i = 0; i < overlays.size(); ++i)
+	{
+		TestRasterVertex vtx = {{rand() / float(RAND_MAX) * 2.4f - 1.2f, rand() / float(RAND_MAX) * 2.4f - 1.2f, .1f},
+			{uint8_t(rand()), uint8_t(rand()), uint8_t(rand()), uint8_t(64 + rand() % 128)}};
+		overlays[i] = vtx;
+	}
+
+	std::vector<uint32_t> images[sizeof numThreads / sizeof numThreads[0]];
+
+	for (size_t i = 0; i < sizeof numThreads / sizeof numThreads[0]; ++i)
+	{
+		SoftwareRasterizer rasterizer;
+		REQUIRE(rasterizer.Create(WIDTH, HEIGHT, numThreads[i]));
+
+		RenderTerrainImage(&grid, chunks, 1, &rasterizer);
+
+		// Straight onto the screen, over everything.
+		const float identity[16] = {1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f};
+		rasterizer.SetViewMatrix(identity);
+		rasterizer.SetProjectionMatrix(identity);
+		rasterizer.SetDepthStencilState(false, false);
+		rasterizer.DrawUntextured(SoftwareRasterizer::Topology_TriangleList, &overlays[0], NULL, unsigned(overlays.size()));
+		rasterizer.Flush();
+
+		images[i].assign(rasterizer.GetColours(), rasterizer.GetColours() + rasterizer.GetPitch() * HEIGHT);
+
+		if (i > 0 && !CHECK(images[i] == images[0]))
+			printf("    (%u threads)\n", numThreads[i]);
+	}
+
+	// The terrain's there: not everything's the clear colour.
+	uint32_t clearColour = 51 | 51 << 8 | 153 << 16 | 255u << 24;
+	CHECK(size_t(std::count(images[0].begin(), images[0].end(), clearColour)) < images[0].size() / 2);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Triangles a second drawing Heightmap.bmp at 1280x640, as -render
+// does, on one thread and on every hardware thread.
+TEST(SoftwareRasterizerBenchmark)
+{
+	const int WIDTH = 1280, HEIGHT = 640, NUM_FRAMES = 3;
+
+	std::vector<uint8_t> values;
+	int width, length;
+	REQUIRE(LoadHeightMapBMP(GetTestDataFileName("Heightmap.bmp").c_str(), &values, &width, &length));
+
+	std::vector<float> heights(values.size());
+	for (size_t i = 0; i < values.size(); ++i)
+		heights[i] = values[i] / 16.f;
+
+	TerrainGrid grid;
+	REQUIRE(grid.Create(width, length, (float)(-(width / 2)), (float)(length / 2), 1.f, -1.f));
+
+	grid.SetHeights(0, 0, width - 1, length - 1, &heights[0], width);
+	grid.CalculateNormals(0, 0, width - 1, length - 1);
+
+	std::vector<TerrainRenderChunk> chunks;
+	BuildTerrainRenderChunks(&grid, 64, &chunks);
+
+	unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	const unsigned threadCounts[] = {1, numThreads};
+
+	for (int i = 0; i < (numThreads > 1 ? 2 : 1); ++i)
+	{
+		SoftwareRasterizer rasterizer;
+		REQUIRE(rasterizer.Create(WIDTH, HEIGHT, threadCounts[i]));
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		RenderTerrainImage(&grid, chunks, NUM_FRAMES, &rasterizer);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		const SoftwareRasterizerStats &stats = rasterizer.GetStats();
+
+		printf("    %dx%d, %u thread%s: %.1fM triangles/s, %u triangles (%u on screen), %.2fms setup, %.2fms drawing a frame\n", WIDTH, HEIGHT,
+			threadCounts[i], threadCounts[i] == 1 ? "" : "s", stats.numTrianglesSubmitted / seconds * 1e-6, unsigned(stats.numTrianglesSubmitted / NUM_FRAMES),
+			unsigned(stats.numTrianglesDrawn / NUM_FRAMES), stats.setupSeconds * 1000. / NUM_FRAMES, stats.rasterSeconds * 1000. / NUM_FRAMES);
+
+		CHECK(stats.numTrianglesSubmitted == size_t(NUM_FRAMES) * (width - 1) * (length - 1) * 2);
+		CHECK(stats.numTrianglesDrawn > 0);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,350 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "TerrainBounds.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TestBox
+{
+	float min[3];
+	float max[3];
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float GetRandom(float minValue, float maxValue)
+{
+	return minValue + rand() / float(RAND_MAX) * (maxValue - minValue);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static TestBox MakeRandomBox(float range, float maxSize)
+{
+	TestBox box;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		box.min[i] = GetRandom(-range, range);
+		box.max[i] = box.min[i] + GetRandom(0.f, maxSize);
+	}
+
+	return box;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Whether any of the box's 8 corners is inside every plane, with the
+// sums done in the same order as TerrainBounds does them.
+static bool IsTestBoxVisible(const TestBox &box, const float (*pPlanes)[4], int numPlanes)
+{
+	for (int i = 0; i < numPlanes; ++i)
+	{
+		bool inside = false;
+
+		for (int corner = 0; corner < 8 && !inside; ++corner)
+		{
+			float x = corner & 1 ? box.max[0] : box.min[0];
+			float y = corner & 2 ? box.max[1] : box.min[1];
+			float z = corner & 4 ? box.max[2] : box.min[2];
+
+			inside = x * pPlanes[i][0] + y * pPlanes[i][1] + z * pPlanes[i][2] + pPlanes[i][3] >= 0.f;
+		}
+
+		if (!inside)
+			return false;
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void SetTestBoxes(TerrainBounds *pBounds, const std::vector<TestBox> &boxes)
+{
+	pBounds->Resize(boxes.size());
+
+	for (size_t i = 0; i < boxes.size(); ++i)
+		pBounds->SetBox(i, boxes[i].min, boxes[i].max);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainBoundsBasics)
+{
+	// Above y = 0.
+	const float planes[1][4] = {{0.f, 1.f, 0.f, 0.f}};
+
+	TerrainBounds bounds;
+	CHECK(bounds.CullPlanes(planes, 1, NULL) == 0);
+
+	// New boxes are empty, so never visible.
+	bounds.Resize(5);
+	CHECK(bounds.GetNumBoxes() == 5);
+
+	uint8_t visible[8];
+	std::fill(visible, visible + 8, uint8_t(7));
+
+	CHECK(bounds.CullPlanes(planes, 1, visible) == 0);
+
+	for (int i = 0; i < 5; ++i)
+		CHECK(visible[i] == 0);
+
+	// Only the boxes there are are written.
+	CHECK(visible[5] == 7);
+
+	const float boxMin[3] = {1.f, -2.f, 3.f};
+	const float boxMax[3] = {4.f, 5.f, 6.f};
+	bounds.SetBox(3, boxMin, boxMax);
+
+	float min[3], max[3];
+	bounds.GetBox(3, min, max);
+	CHECK(std::equal(min, min + 3, boxMin) && std::equal(max, max + 3, boxMax));
+
+	CHECK(bounds.CullPlanes(planes, 1, visible) == 1);
+	CHECK(visible[3] == 1 && visible[4] == 0);
+
+	// Below y = -3, it isn't.
+	const float belowPlanes[2][4] = {{0.f, 1.f, 0.f, 0.f}, {0.f, -1.f, 0.f, -3.f}};
+	CHECK(bounds.CullPlanes(belowPlanes, 2, visible) == 0);
+
+	// Shrinking, then growing again, the box is forgotten.
+	bounds.Resize(3);
+	bounds.Resize(5);
+	CHECK(bounds.CullPlanes(planes, 1, visible) == 0);
+
+	bounds.Clear();
+	CHECK(bounds.GetNumBoxes() == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainBoundsMatchesCorners)
+{
+	srand(248);
+
+	TerrainBounds bounds;
+
+	for (int round = 0; round < 100; ++round)
+	{
+		// Never a whole number of 4 boxes, sometimes.
+		std::vector<TestBox> boxes(size_t(1 + rand() % 103));
+
+		for (size_t i = 0; i < boxes.size(); ++i)
+			boxes[i] = MakeRandomBox(10.f, 5.f);
+
+		SetTestBoxes(&bounds, boxes);
+
+		float planes[TerrainBounds::MAX_PLANES][4];
+		int numPlanes = 1 + rand() % TerrainBounds::MAX_PLANES;
+
+		for (int i = 0; i < numPlanes; ++i)
+		{
+			for (int j = 0; j < 3; ++j)
+				planes[i][j] = GetRandom(-1.f, 1.f);
+
+			planes[i][3] = GetRandom(-5.f, 15.f);
+		}
+
+		std::vector<uint8_t> visible(boxes.size());
+		size_t numVisible = bounds.CullPlanes(planes, numPlanes, &visible[0]);
+
+		size_t expectedNumVisible = 0;
+
+		for (size_t i = 0; i < boxes.size(); ++i)
+		{
+			bool expected = IsTestBoxVisible(boxes[i], planes, numPlanes);
+			expectedNumVisible += expected ? 1 : 0;
+
+			if (!CHECK(visible[i] == (expected ? 1 : 0)))
+				return;
+		}
+
+		CHECK(numVisible == expectedNumVisible);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainBoundsFrustum)
+{
+	const float eye[3] = {3.f, 20.f, -40.f};
+	const float at[3] = {-5.f, 0.f, 10.f};
+
+	float viewProj[16];
+	MakeTestViewProj(eye, at, 1.f, 1.5f, 1.f, 200.f, viewProj);
+
+	float planes[6][4];
+	GetFrustumPlanes(viewProj, planes);
+
+	srand(348);
+
+	// A point's inside every plane if it's inside the clip volume.
+	int numInside = 0;
+
+	for (int i = 0; i < 2000; ++i)
+	{
+		float p[3] = {GetRandom(-100.f, 100.f), GetRandom(-100.f, 100.f), GetRandom(-100.f, 200.f)};
+
+		float clip[4];
+		TransformTestPoint(viewProj, p, clip);
+
+		// Too close to an edge to say.
+		float margin = 1e-3f * fabsf(clip[3]);
+		float edges[6] = {clip[3] + clip[0], clip[3] - clip[0], clip[3] + clip[1], clip[3] - clip[1], clip[2], clip[3] - clip[2]};
+
+		bool isClose = false;
+		bool inClipVolume = true;
+
+		for (int j = 0; j < 6; ++j)
+		{
+			isClose = isClose || fabsf(edges[j]) < margin;
+			inClipVolume = inClipVolume && edges[j] >= 0.f;
+		}
+
+		if (isClose)
+			continue;
+
+		bool inPlanes = true;
+
+		for (int j = 0; j < 6; ++j)
+			inPlanes = inPlanes && p[0] * planes[j][0] + p[1] * planes[j][1] + p[2] * planes[j][2] + planes[j][3] >= 0.f;
+
+		if (!CHECK(inPlanes == inClipVolume))
+			return;
+
+		numInside += inClipVolume ? 1 : 0;
+	}
+
+	CHECK(numInside > 100);
+
+	// Boxes right in front of the camera, behind it, and past the far
+	// plane.
+	std::vector<TestBox> boxes(3);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		const float distances[] = {20.f, -20.f, 300.f};
+		float centre[3];
+
+		for (int j = 0; j < 3; ++j)
+			centre[j] = eye[j] + (at[j] - eye[j]) / sqrtf(8.f * 8.f + 20.f * 20.f + 50.f * 50.f) * distances[i];
+
+		for (int j = 0; j < 3; ++j)
+		{
+			boxes[i].min[j] = centre[j] - 1.f;
+			boxes[i].max[j] = centre[j] + 1.f;
+		}
+	}
+
+	TerrainBounds bounds;
+	SetTestBoxes(&bounds, boxes);
+
+	uint8_t visible[3];
+	CHECK(bounds.CullPlanes(planes, 6, visible) == 1);
+	CHECK(visible[0] == 1 && visible[1] == 0 && visible[2] == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Culling a 256x256 grid of chunks against a frustum, as the arrays
+// TerrainBounds keeps and as an array of boxes.
+TEST(TerrainBoundsBenchmark)
+{
+	const int NUM_CHUNKS = 256;
+
+	std::vector<TestBox> boxes(NUM_CHUNKS * NUM_CHUNKS);
+
+	srand(448);
+
+	for (int z = 0; z < NUM_CHUNKS; ++z)
+	{
+		for (int x = 0; x < NUM_CHUNKS; ++x)
+		{
+			TestBox *pBox = &boxes[size_t(z) * NUM_CHUNKS + x];
+
+			pBox->min[0] = float(x - NUM_CHUNKS / 2) * 64.f;
+			pBox->min[1] = GetRandom(0.f, 50.f);
+			pBox->min[2] = float(z - NUM_CHUNKS / 2) * 64.f;
+
+			pBox->max[0] = pBox->min[0] + 64.f;
+			pBox->max[1] = pBox->min[1] + GetRandom(0.f, 50.f);
+			pBox->max[2] = pBox->min[2] + 64.f;
+		}
+	}
+
+	TerrainBounds bounds;
+	SetTestBoxes(&bounds, boxes);
+
+	const float eye[3] = {0.f, 100.f, 0.f};
+	const float at[3] = {100.f, 50.f, 300.f};
+
+	float viewProj[16];
+	MakeTestViewProj(eye, at, 1.f, 16.f / 9.f, 1.f, 5000.f, viewProj);
+
+	float planes[6][4];
+	GetFrustumPlanes(viewProj, planes);
+
+	std::vector<uint8_t> visible(boxes.size()), testVisible(boxes.size());
+	size_t numVisible = 0, testNumVisible = 0;
+
+	double seconds = DBL_MAX, testSeconds = DBL_MAX;
+
+	for (int i = 0; i < 5; ++i)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		numVisible = bounds.CullPlanes(planes, 6, &visible[0]);
+		seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+		start = std::chrono::steady_clock::now();
+		testNumVisible = 0;
+
+		for (size_t j = 0; j < boxes.size(); ++j)
+		{
+			bool inside = true;
+
+			for (int k = 0; k < 6 && inside; ++k)
+			{
+				float distance = 0.f;
+
+				for (int m = 0; m < 3; ++m)
+					distance += planes[k][m] * (planes[k][m] >= 0.f ? boxes[j].max[m] : boxes[j].min[m]);
+
+				inside = distance + planes[k][3] >= 0.f;
+			}
+
+			testVisible[j] = inside ? 1 : 0;
+			testNumVisible += testVisible[j];
+		}
+
+		testSeconds = std::min(testSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	printf("    %zu of %zu chunks visible: %.3fms (array of boxes %.3fms)\n", numVisible, boxes.size(), seconds * 1000., testSeconds * 1000.);
+
+	CHECK(numVisible > 100 && numVisible < boxes.size() / 2);
+	CHECK(numVisible == testNumVisible && visible == testVisible);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
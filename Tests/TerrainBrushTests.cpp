@@ -0,0 +1,232 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "HeightField.h"
+#include "TerrainBrush.h"
+#include "TerrainGrid.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static TerrainBrush MakeBrush(TerrainBrushMode mode, float radius, float strength, float targetHeight)
+{
+	TerrainBrush brush = {mode, radius, strength, targetHeight};
+	return brush;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// (1 - d^2/r^2)^2, as the header describes, worked out in world units.
+static float GetTestFalloff(const HeightField &heightField, int col, int row, float x, float z, float radius)
+{
+	float dx = heightField.GetOriginX() + col * heightField.GetColumnStepX() - x;
+	float dz = heightField.GetOriginZ() + row * heightField.GetRowStepZ() - z;
+
+	float falloff = std::max(1.f - (dx * dx + dz * dz) / (radius * radius), 0.f);
+	return falloff * falloff;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Checks every grid point against what the brush should have done,
+// given the heights before. Points outside the returned rectangle
+// mustn't change.
+static bool CheckBrush(const HeightField &heightField, const std::vector<float> &before, const TerrainBrush &brush, float x, float z, int minCol, int minRow, int maxCol, int maxRow)
+{
+	int width = heightField.GetWidth();
+	int length = heightField.GetLength();
+	const float *pAfter = heightField.GetGridHeights();
+
+	for (int row = 0; row < length; ++row)
+	{
+		for (int col = 0; col < width; ++col)
+		{
+			size_t index = size_t(row) * width + col;
+
+			float falloff = GetTestFalloff(heightField, col, row, x, z, brush.radius);
+			float expected = before[index];
+
+			if (col < minCol || col > maxCol || row < minRow || row > maxRow)
+			{
+				// Nothing outside the rectangle's within the radius.
+				if (!CHECK(pAfter[index] == before[index] && falloff == 0.f))
+					return false;
+
+				continue;
+			}
+
+			switch (brush.mode)
+			{
+			case TERRAIN_BRUSH_RAISE:
+				expected += brush.strength * falloff;
+				break;
+
+			case TERRAIN_BRUSH_LOWER:
+				expected -= brush.strength * falloff;
+				break;
+
+			case TERRAIN_BRUSH_SMOOTH:
+				{
+					float sum = 0.f;
+					int numPoints = 0;
+
+					for (int j = std::max(row - 1, 0); j <= std::min(row + 1, length - 1); ++j)
+					{
+						for (int i = std::max(col - 1, 0); i <= std::min(col + 1, width - 1); ++i)
+						{
+							sum += before[size_t(j) * width + i];
+							++numPoints;
+						}
+					}
+
+					expected += (sum / numPoints - expected) * brush.strength * falloff;
+				}
+				break;
+
+			case TERRAIN_BRUSH_FLATTEN:
+				expected += (brush.targetHeight - expected) * brush.strength * falloff;
+				break;
+			}
+
+			if (!CHECK_CLOSE(pAfter[index], expected, 1e-4))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainBrushModes)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 50, 40, 1.f, &GetTestHillsHeight));
+
+	const TerrainBrush brushes[] = {
+		MakeBrush(TERRAIN_BRUSH_RAISE, 5.5f, 2.f, 0.f),
+		MakeBrush(TERRAIN_BRUSH_LOWER, 3.f, .5f, 0.f),
+		MakeBrush(TERRAIN_BRUSH_SMOOTH, 7.f, .75f, 0.f),
+		MakeBrush(TERRAIN_BRUSH_FLATTEN, 4.25f, 1.f, 3.f),
+	};
+
+	for (size_t i = 0; i < sizeof brushes / sizeof brushes[0]; ++i)
+	{
+		HeightField heightField;
+		REQUIRE(heightField.Create(&grid));
+
+		std::vector<float> before(heightField.GetGridHeights(), heightField.GetGridHeights() + 50 * 40);
+
+		// Off the grid points.
+		float x = 2.3f, z = -1.6f;
+
+		int regionMinCol, regionMinRow, regionMaxCol, regionMaxRow;
+		REQUIRE(GetTerrainBrushRegion(heightField, brushes[i], x, z, &regionMinCol, &regionMinRow, &regionMaxCol, &regionMaxRow));
+
+		int minCol, minRow, maxCol, maxRow;
+		REQUIRE(ApplyTerrainBrush(&heightField, brushes[i], x, z, &minCol, &minRow, &maxCol, &maxRow));
+
+		// The region is what's saved for undo, so it has to match.
+		CHECK(minCol == regionMinCol && minRow == regionMinRow && maxCol == regionMaxCol && maxRow == regionMaxRow);
+
+		// Just the points within the radius.
+		float centreCol = x - heightField.GetOriginX();
+		float centreRow = heightField.GetOriginZ() - z;
+		CHECK(minCol == int(ceilf(centreCol - brushes[i].radius)) && maxCol == int(floorf(centreCol + brushes[i].radius)));
+		CHECK(minRow == int(ceilf(centreRow - brushes[i].radius)) && maxRow == int(floorf(centreRow + brushes[i].radius)));
+
+		CheckBrush(heightField, before, brushes[i], x, z, minCol, minRow, maxCol, maxRow);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainBrushEffects)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 30, 30, 2.f, &GetTestFlatHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	// Grid points are 2 apart, so a radius of 6 covers 3 each way.
+	int minCol, minRow, maxCol, maxRow;
+	REQUIRE(ApplyTerrainBrush(&heightField, MakeBrush(TERRAIN_BRUSH_RAISE, 6.f, 2.f, 0.f), 0.f, 0.f, &minCol, &minRow, &maxCol, &maxRow));
+	CHECK(minCol == 12 && maxCol == 18 && minRow == 12 && maxRow == 18);
+
+	const float *pHeights = heightField.GetGridHeights();
+
+	// Full strength in the middle, none at the edge, and round.
+	CHECK_CLOSE(pHeights[15 * 30 + 15], 2., 1e-6);
+	CHECK(pHeights[15 * 30 + 12] == 0.f && pHeights[12 * 30 + 15] == 0.f);
+	CHECK(pHeights[15 * 30 + 14] == pHeights[14 * 30 + 15] && pHeights[15 * 30 + 14] == pHeights[16 * 30 + 15]);
+	CHECK(pHeights[15 * 30 + 14] > pHeights[15 * 30 + 13] && pHeights[15 * 30 + 13] > 0.f);
+
+	// Flattening at full strength levels the middle.
+	REQUIRE(ApplyTerrainBrush(&heightField, MakeBrush(TERRAIN_BRUSH_FLATTEN, 6.f, 1.f, .5f), 0.f, 0.f, &minCol, &minRow, &maxCol, &maxRow));
+	CHECK_CLOSE(pHeights[15 * 30 + 15], .5, 1e-6);
+
+	// Smoothing takes the bump down, and leaves flat ground alone.
+	float peak = pHeights[15 * 30 + 14];
+	REQUIRE(ApplyTerrainBrush(&heightField, MakeBrush(TERRAIN_BRUSH_SMOOTH, 10.f, 1.f, 0.f), 0.f, 0.f, &minCol, &minRow, &maxCol, &maxRow));
+	CHECK(pHeights[15 * 30 + 14] < peak);
+	CHECK(pHeights[2 * 30 + 2] == 0.f);
+
+	// Strength is clamped for smoothing and flattening.
+	std::vector<float> before(pHeights, pHeights + 30 * 30);
+	REQUIRE(ApplyTerrainBrush(&heightField, MakeBrush(TERRAIN_BRUSH_FLATTEN, 6.f, 5.f, -1.f), 0.f, 0.f, &minCol, &minRow, &maxCol, &maxRow));
+	CHECK_CLOSE(pHeights[15 * 30 + 15], -1., 1e-6);
+	CHECK(pHeights[15 * 30 + 14] >= -1.f && pHeights[15 * 30 + 14] <= before[15 * 30 + 14]);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainBrushEdges)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 20, 16, 1.f, &GetTestFlatHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	TerrainBrush brush = MakeBrush(TERRAIN_BRUSH_RAISE, 4.f, 1.f, 0.f);
+
+	int minCol, minRow, maxCol, maxRow;
+
+	// Over the corner, the region's clipped to the grid.
+	float cornerX = heightField.GetOriginX();
+	float cornerZ = heightField.GetOriginZ();
+
+	std::vector<float> before(heightField.GetGridHeights(), heightField.GetGridHeights() + 20 * 16);
+
+	REQUIRE(ApplyTerrainBrush(&heightField, brush, cornerX - 1.f, cornerZ + 1.f, &minCol, &minRow, &maxCol, &maxRow));
+	CHECK(minCol == 0 && minRow == 0 && maxCol == 3 && maxRow == 3);
+	CheckBrush(heightField, before, brush, cornerX - 1.f, cornerZ + 1.f, minCol, minRow, maxCol, maxRow);
+
+	// Missing the grid, or no brush at all, does nothing.
+	before.assign(heightField.GetGridHeights(), heightField.GetGridHeights() + 20 * 16);
+
+	CHECK(!GetTerrainBrushRegion(heightField, brush, cornerX - 5.f, cornerZ, &minCol, &minRow, &maxCol, &maxRow));
+	CHECK(!ApplyTerrainBrush(&heightField, brush, cornerX - 5.f, cornerZ, &minCol, &minRow, &maxCol, &maxRow));
+	CHECK(!ApplyTerrainBrush(&heightField, brush, 1e30f, -1e30f, &minCol, &minRow, &maxCol, &maxRow));
+	CHECK(!ApplyTerrainBrush(&heightField, MakeBrush(TERRAIN_BRUSH_RAISE, 0.f, 1.f, 0.f), 0.f, 0.f, &minCol, &minRow, &maxCol, &maxRow));
+	CHECK(!ApplyTerrainBrush(&heightField, MakeBrush(TERRAIN_BRUSH_RAISE, -2.f, 1.f, 0.f), 0.f, 0.f, &minCol, &minRow, &maxCol, &maxRow));
+
+	CHECK(std::equal(before.begin(), before.end(), heightField.GetGridHeights()));
+
+	// Between grid points, with a radius too small to reach any.
+	CHECK(!ApplyTerrainBrush(&heightField, MakeBrush(TERRAIN_BRUSH_RAISE, .2f, 1.f, 0.f), .5f, .5f, &minCol, &minRow, &maxCol, &maxRow));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
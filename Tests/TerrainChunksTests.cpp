@@ -0,0 +1,175 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "TerrainChunks.h"
+#include "TerrainGrid.h"
+
+#include <float.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainChunksLayout)
+{
+	const int CHUNK_QUADS = 16;
+	const int sizes[][2] = {{2, 2}, {17, 17}, {18, 17}, {50, 33}, {16, 70}};
+
+	for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; ++i)
+	{
+		int width = sizes[i][0], length = sizes[i][1];
+
+		std::vector<TerrainChunk> chunks;
+		GetTerrainChunks(width, length, CHUNK_QUADS, &chunks);
+
+		int numChunksWide = (width - 2) / CHUNK_QUADS + 1;
+		int numChunksLong = (length - 2) / CHUNK_QUADS + 1;
+		CHECK(chunks.size() == size_t(numChunksWide) * numChunksLong);
+
+		// Every quad's in exactly one chunk.
+		std::vector<int> numTimesCovered(size_t(width - 1) * (length - 1), 0);
+
+		for (size_t j = 0; j < chunks.size(); ++j)
+		{
+			const TerrainChunk &chunk = chunks[j];
+
+			// Row by row, with only the last of each smaller.
+			CHECK(chunk.col0 == int(j % numChunksWide) * CHUNK_QUADS && chunk.row0 == int(j / numChunksWide) * CHUNK_QUADS);
+			CHECK(chunk.width == std::min(CHUNK_QUADS, width - 1 - chunk.col0) + 1);
+			CHECK(chunk.length == std::min(CHUNK_QUADS, length - 1 - chunk.row0) + 1);
+
+			for (int row = chunk.row0; row < chunk.row0 + chunk.length - 1; ++row)
+			{
+				for (int col = chunk.col0; col < chunk.col0 + chunk.width - 1; ++col)
+					++numTimesCovered[size_t(row) * (width - 1) + col];
+			}
+		}
+
+		if (!CHECK(std::count(numTimesCovered.begin(), numTimesCovered.end(), 1) == int(numTimesCovered.size())))
+		{
+			printf("    (%dx%d grid)\n", width, length);
+			return;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainChunksTriangles)
+{
+	// Corners a b over c d, split from a to d.
+	uint16_t indices[2 * 1 * 6];
+	BuildTerrainChunkIndices(3, 2, indices);
+
+	const uint16_t expected[] = {0, 1, 4, 0, 4, 3, 1, 2, 5, 1, 5, 4};
+	CHECK(std::equal(indices, indices + 12, expected));
+
+	// The triangles are where GetTestTriangleHeight has them, and all
+	// face up, on a grid the way Heightmap lays them out.
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 9, 7, 2.f, &GetTestHillsHeight));
+
+	TerrainChunk chunk;
+	chunk.col0 = 3;
+	chunk.row0 = 2;
+	chunk.width = 5;
+	chunk.length = 4;
+
+	std::vector<uint16_t> chunkIndices(size_t(chunk.width - 1) * (chunk.length - 1) * 6);
+	BuildTerrainChunkIndices(chunk.width, chunk.length, &chunkIndices[0]);
+
+	for (size_t i = 0; i < chunkIndices.size(); i += 3)
+	{
+		float pos[3][3];
+
+		for (int j = 0; j < 3; ++j)
+		{
+			int col = chunk.col0 + chunkIndices[i + j] % chunk.width;
+			int row = chunk.row0 + chunkIndices[i + j] / chunk.width;
+
+			pos[j][0] = grid.GetOriginX() + col * grid.GetColumnStepX();
+			pos[j][1] = grid.GetHeights()[row * grid.GetPitch() + col];
+			pos[j][2] = grid.GetOriginZ() + row * grid.GetRowStepZ();
+		}
+
+		float e1[3] = {pos[1][0] - pos[0][0], pos[1][1] - pos[0][1], pos[1][2] - pos[0][2]};
+		float e2[3] = {pos[2][0] - pos[0][0], pos[2][1] - pos[0][1], pos[2][2] - pos[0][2]};
+
+		if (!CHECK(e1[2] * e2[0] - e1[0] * e2[2] > 0.f))
+			return;
+
+		// The middle of the triangle is on the surface.
+		float x = (pos[0][0] + pos[1][0] + pos[2][0]) / 3.f;
+		float y = (pos[0][1] + pos[1][1] + pos[2][1]) / 3.f;
+		float z = (pos[0][2] + pos[1][2] + pos[2][2]) / 3.f;
+
+		if (!CHECK_CLOSE(GetTestTriangleHeight(&grid, x, z), y, 1e-4))
+			return;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainChunksBoxes)
+{
+	// Steps either way round.
+	const float steps[][2] = {{1.f, -1.f}, {-2.f, .5f}};
+
+	for (int i = 0; i < 2; ++i)
+	{
+		TerrainGrid grid;
+		REQUIRE(grid.Create(40, 27, 5.f, -3.f, steps[i][0], steps[i][1]));
+
+		std::vector<float> heights(40 * 27);
+
+		for (int row = 0; row < 27; ++row)
+		{
+			for (int col = 0; col < 40; ++col)
+				heights[size_t(row) * 40 + col] = GetTestHillsHeight(float(col), float(row));
+		}
+
+		grid.SetHeights(0, 0, 39, 26, &heights[0], 40);
+
+		std::vector<TerrainChunk> chunks;
+		GetTerrainChunks(40, 27, 16, &chunks);
+
+		for (size_t j = 0; j < chunks.size(); ++j)
+		{
+			float boxMin[3], boxMax[3];
+			GetTerrainChunkBox(&grid, chunks[j], boxMin, boxMax);
+
+			// Just big enough for every point.
+			float expectedMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+			float expectedMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+			for (int row = chunks[j].row0; row < chunks[j].row0 + chunks[j].length; ++row)
+			{
+				for (int col = chunks[j].col0; col < chunks[j].col0 + chunks[j].width; ++col)
+				{
+					float pos[3] = {
+						grid.GetOriginX() + col * grid.GetColumnStepX(),
+						heights[size_t(row) * 40 + col],
+						grid.GetOriginZ() + row * grid.GetRowStepZ(),
+					};
+
+					for (int k = 0; k < 3; ++k)
+					{
+						expectedMin[k] = std::min(expectedMin[k], pos[k]);
+						expectedMax[k] = std::max(expectedMax[k], pos[k]);
+					}
+				}
+			}
+
+			if (!CHECK(std::equal(boxMin, boxMin + 3, expectedMin) && std::equal(boxMax, boxMax + 3, expectedMax)))
+				return;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,199 @@
+#include "Test.h"
+
+#include "TerrainDirtyRegions.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TestRect
+{
+	int minCol, minRow, maxCol, maxRow;
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static TestRect GetDirtyRect(const TerrainDirtyRegions &regions, size_t i, size_t *pChunkIndex)
+{
+	TestRect rect;
+	regions.GetDirtyChunk(i, pChunkIndex, &rect.minCol, &rect.minRow, &rect.maxCol, &rect.maxRow);
+	return rect;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool IsRect(const TestRect &rect, int minCol, int minRow, int maxCol, int maxRow)
+{
+	return rect.minCol == minCol && rect.minRow == minRow && rect.maxCol == maxCol && rect.maxRow == maxRow;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainDirtyRegionsChunks)
+{
+	TerrainDirtyRegions regions;
+
+	CHECK(!regions.Create(1, 10, 8));
+	CHECK(!regions.Create(10, 10, 0));
+
+	// 129 quads wide and 69 long: 3x2 chunks of 64, the last ones
+	// short.
+	REQUIRE(regions.Create(130, 70, 64));
+	CHECK(regions.GetNumChunksWide() == 3);
+	CHECK(regions.GetNumChunksLong() == 2);
+	CHECK(regions.GetNumDirtyChunks() == 0);
+
+	size_t chunkIndex;
+
+	// Inside one chunk.
+	regions.Add(70, 10, 80, 20);
+	REQUIRE(regions.GetNumDirtyChunks() == 1);
+	CHECK(IsRect(GetDirtyRect(regions, 0, &chunkIndex), 70, 10, 80, 20) && chunkIndex == 1);
+
+	// More in the same chunk grows its rectangle.
+	regions.Add(100, 5, 101, 6);
+	REQUIRE(regions.GetNumDirtyChunks() == 1);
+	CHECK(IsRect(GetDirtyRect(regions, 0, &chunkIndex), 70, 5, 101, 20));
+
+	// An edge point is in both chunks, in the order they were dirtied.
+	regions.Clear();
+	CHECK(regions.GetNumDirtyChunks() == 0);
+
+	regions.Add(64, 30, 64, 64);
+	REQUIRE(regions.GetNumDirtyChunks() == 4);
+	CHECK(IsRect(GetDirtyRect(regions, 0, &chunkIndex), 64, 30, 64, 64) && chunkIndex == 0);
+	CHECK(IsRect(GetDirtyRect(regions, 1, &chunkIndex), 64, 30, 64, 64) && chunkIndex == 1);
+	CHECK(IsRect(GetDirtyRect(regions, 2, &chunkIndex), 64, 64, 64, 64) && chunkIndex == 3);
+	CHECK(IsRect(GetDirtyRect(regions, 3, &chunkIndex), 64, 64, 64, 64) && chunkIndex == 4);
+
+	// Everything, clipped to the grid and then to each chunk.
+	regions.Clear();
+	regions.Add(-50, -50, 1000, 1000);
+	REQUIRE(regions.GetNumDirtyChunks() == 6);
+
+	for (size_t i = 0; i < 6; ++i)
+	{
+		TestRect rect = GetDirtyRect(regions, i, &chunkIndex);
+
+		int chunkCol = int(chunkIndex % 3);
+		int chunkRow = int(chunkIndex / 3);
+
+		CHECK(IsRect(rect, chunkCol * 64, chunkRow * 64, std::min(chunkCol * 64 + 64, 129), std::min(chunkRow * 64 + 64, 69)));
+	}
+
+	// Off the grid, or back to front, does nothing.
+	regions.Clear();
+	regions.Add(-10, 0, -1, 5);
+	regions.Add(130, 0, 140, 5);
+	regions.Add(10, 10, 5, 20);
+	CHECK(regions.GetNumDirtyChunks() == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainDirtyRegionsMatchBruteForce)
+{
+	const int WIDTH = 100, LENGTH = 75, CHUNK_QUADS = 16;
+
+	TerrainDirtyRegions regions;
+	REQUIRE(regions.Create(WIDTH, LENGTH, CHUNK_QUADS));
+
+	int numChunksWide = regions.GetNumChunksWide();
+	int numChunksLong = regions.GetNumChunksLong();
+	CHECK(numChunksWide == 7 && numChunksLong == 5);
+
+	srand(12);
+
+	for (int round = 0; round < 20; ++round)
+	{
+		std::vector<TestRect> rects(1 + rand() % 6);
+
+		for (size_t i = 0; i < rects.size(); ++i)
+		{
+			rects[i].minCol = rand() % (WIDTH + 20) - 10;
+			rects[i].minRow = rand() % (LENGTH + 20) - 10;
+			rects[i].maxCol = rects[i].minCol + rand() % 30;
+			rects[i].maxRow = rects[i].minRow + rand() % 30;
+
+			regions.Add(rects[i].minCol, rects[i].minRow, rects[i].maxCol, rects[i].maxRow);
+		}
+
+		std::vector<int> dirtyIndices(size_t(numChunksWide) * numChunksLong, -1);
+
+		for (size_t i = 0; i < regions.GetNumDirtyChunks(); ++i)
+		{
+			size_t chunkIndex;
+			GetDirtyRect(regions, i, &chunkIndex);
+
+			REQUIRE(chunkIndex < dirtyIndices.size());
+			CHECK(dirtyIndices[chunkIndex] < 0);
+
+			dirtyIndices[chunkIndex] = int(i);
+		}
+
+		// Each chunk's rectangle should bound the parts of the added
+		// rectangles that overlap it, edges included.
+		for (int chunkRow = 0; chunkRow < numChunksLong; ++chunkRow)
+		{
+			for (int chunkCol = 0; chunkCol < numChunksWide; ++chunkCol)
+			{
+				TestRect chunk = {
+					chunkCol * CHUNK_QUADS,
+					chunkRow * CHUNK_QUADS,
+					std::min(chunkCol * CHUNK_QUADS + CHUNK_QUADS, WIDTH - 1),
+					std::min(chunkRow * CHUNK_QUADS + CHUNK_QUADS, LENGTH - 1),
+				};
+
+				TestRect expected = {WIDTH, LENGTH, -1, -1};
+
+				for (size_t i = 0; i < rects.size(); ++i)
+				{
+					TestRect overlap = {
+						std::max(rects[i].minCol, chunk.minCol),
+						std::max(rects[i].minRow, chunk.minRow),
+						std::min(rects[i].maxCol, chunk.maxCol),
+						std::min(rects[i].maxRow, chunk.maxRow),
+					};
+
+					if (overlap.minCol > overlap.maxCol || overlap.minRow > overlap.maxRow)
+						continue;
+
+					expected.minCol = std::min(expected.minCol, overlap.minCol);
+					expected.minRow = std::min(expected.minRow, overlap.minRow);
+					expected.maxCol = std::max(expected.maxCol, overlap.maxCol);
+					expected.maxRow = std::max(expected.maxRow, overlap.maxRow);
+				}
+
+				int dirtyIndex = dirtyIndices[size_t(chunkRow) * numChunksWide + chunkCol];
+
+				if (expected.maxCol < 0)
+				{
+					CHECK(dirtyIndex < 0);
+					continue;
+				}
+
+				REQUIRE(dirtyIndex >= 0);
+
+				size_t chunkIndex;
+				TestRect rect = GetDirtyRect(regions, size_t(dirtyIndex), &chunkIndex);
+
+				if (!CHECK(IsRect(rect, expected.minCol, expected.minRow, expected.maxCol, expected.maxRow)))
+					break;
+			}
+		}
+
+		regions.Clear();
+		CHECK(regions.GetNumDirtyChunks() == 0);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
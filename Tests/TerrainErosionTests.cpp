@@ -0,0 +1,280 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "TerrainErosion.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Hills, up to about 15 high, like a BMP height map's.
+static std::vector<float> MakeErosionHeights(int width, int length)
+{
+	std::vector<float> heights(size_t(width) * length);
+
+	for (int row = 0; row < length; ++row)
+	{
+		for (int col = 0; col < width; ++col)
+			heights[size_t(row) * width + col] = 1.5f * GetTestHillsHeight(float(col), float(row));
+	}
+
+	return heights;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The ground, and the sediment the water's carrying.
+static double GetTotalMaterial(const TerrainErosion &erosion)
+{
+	size_t numCells = size_t(erosion.GetWidth()) * erosion.GetLength();
+	double total = 0.;
+
+	for (size_t i = 0; i < numCells; ++i)
+		total += double(erosion.GetHeights()[i]) + erosion.GetSediment()[i];
+
+	return total;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool IsSameErosion(const TerrainErosion &a, const TerrainErosion &b)
+{
+	size_t numCells = size_t(a.GetWidth()) * a.GetLength();
+
+	return std::equal(a.GetHeights(), a.GetHeights() + numCells, b.GetHeights()) &&
+		std::equal(a.GetWaterDepths(), a.GetWaterDepths() + numCells, b.GetWaterDepths()) &&
+		std::equal(a.GetSediment(), a.GetSediment() + numCells, b.GetSediment());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainErosionBasics)
+{
+	std::vector<float> heights = MakeErosionHeights(10, 10);
+
+	TerrainErosion erosion;
+	CHECK(erosion.GetHeights() == NULL);
+
+	// Nothing to do, but nothing goes wrong.
+	erosion.Run(10, 1);
+
+	CHECK(!erosion.Create(&heights[0], 1, 10, TerrainErosionParams()));
+	CHECK(!erosion.Create(&heights[0], 10, 1, TerrainErosionParams()));
+
+	REQUIRE(erosion.Create(&heights[0], 10, 10, TerrainErosionParams()));
+	CHECK(erosion.GetWidth() == 10 && erosion.GetLength() == 10);
+	CHECK(std::equal(heights.begin(), heights.end(), erosion.GetHeights()));
+
+	// Dry, to start with.
+	CHECK(std::count(erosion.GetWaterDepths(), erosion.GetWaterDepths() + 100, 0.f) == 100);
+	CHECK(std::count(erosion.GetSediment(), erosion.GetSediment() + 100, 0.f) == 100);
+
+	erosion.Run(0, 1);
+	CHECK(std::equal(heights.begin(), heights.end(), erosion.GetHeights()));
+
+	erosion.Destroy();
+	CHECK(erosion.GetWidth() == 0 && erosion.GetHeights() == NULL);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainErosionSameOnAnyThreads)
+{
+	// Not a whole number of 4 columns, and more threads than rows.
+	const int WIDTH = 67, LENGTH = 23;
+	const unsigned numThreads[] = {1, 2, 3, 8, 40};
+
+	std::vector<float> heights = MakeErosionHeights(WIDTH, LENGTH);
+
+	TerrainErosion erosions[sizeof numThreads / sizeof numThreads[0]];
+
+	for (size_t i = 0; i < sizeof numThreads / sizeof numThreads[0]; ++i)
+	{
+		REQUIRE(erosions[i].Create(&heights[0], WIDTH, LENGTH, TerrainErosionParams()));
+
+		// Run in two goes, which is no different to one.
+		erosions[i].Run(20, numThreads[i]);
+		erosions[i].Run(30, numThreads[i]);
+
+		if (i > 0 && !CHECK(IsSameErosion(erosions[0], erosions[i])))
+			printf("    (%u threads)\n", numThreads[i]);
+	}
+
+	// It did something.
+	CHECK(!std::equal(heights.begin(), heights.end(), erosions[0].GetHeights()));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainErosionSSE2MatchesScalar)
+{
+	const int WIDTH = 53, LENGTH = 41;
+
+	std::vector<float> heights = MakeErosionHeights(WIDTH, LENGTH);
+
+	TerrainErosion erosion, scalarErosion;
+	REQUIRE(erosion.Create(&heights[0], WIDTH, LENGTH, TerrainErosionParams()));
+	REQUIRE(scalarErosion.Create(&heights[0], WIDTH, LENGTH, TerrainErosionParams()));
+
+	scalarErosion.SetUseSSE2(false);
+
+	erosion.Run(200, 2);
+	scalarErosion.Run(200, 2);
+
+	// The sums are done in the same order both ways, but allow for a
+	// compiler that contracts the scalar ones into fused multiply-adds.
+	const float *pValues[3][2] = {
+		{erosion.GetHeights(), scalarErosion.GetHeights()},
+		{erosion.GetWaterDepths(), scalarErosion.GetWaterDepths()},
+		{erosion.GetSediment(), scalarErosion.GetSediment()},
+	};
+
+	float maxDifference = 0.f;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		for (size_t j = 0; j < heights.size(); ++j)
+			maxDifference = std::max(maxDifference, fabsf(pValues[i][0][j] - pValues[i][1][j]) / std::max(1.f, fabsf(pValues[i][1][j])));
+	}
+
+	printf("    largest difference %g\n", maxDifference);
+
+	CHECK(maxDifference <= 1e-4f);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainErosionConservesMaterial)
+{
+	const int WIDTH = 64, LENGTH = 48;
+
+	std::vector<float> heights = MakeErosionHeights(WIDTH, LENGTH);
+
+	TerrainErosion erosion;
+	REQUIRE(erosion.Create(&heights[0], WIDTH, LENGTH, TerrainErosionParams()));
+
+	double startMaterial = GetTotalMaterial(erosion);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		erosion.Run(100, 0);
+
+		// Water moves ground about, and carries some of it, but none
+		// is made or lost, even at the edges.
+		double material = GetTotalMaterial(erosion);
+
+		if (!CHECK_CLOSE(material, startMaterial, 1e-5 * startMaterial))
+			return;
+	}
+
+	float maxChange = 0.f;
+	bool allValid = true;
+
+	for (size_t i = 0; i < heights.size(); ++i)
+	{
+		maxChange = std::max(maxChange, fabsf(erosion.GetHeights()[i] - heights[i]));
+		allValid = allValid && erosion.GetWaterDepths()[i] >= 0.f && erosion.GetSediment()[i] >= 0.f && !isnan(erosion.GetHeights()[i]);
+	}
+
+	CHECK(allValid);
+	CHECK(maxChange > .01f);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainErosionThermal)
+{
+	const int SIZE = 21;
+
+	// A spike on flat ground, with no rain, so only thermal erosion
+	// does anything.
+	std::vector<float> heights(SIZE * SIZE, 0.f);
+	heights[10 * SIZE + 10] = 10.f;
+
+	TerrainErosionParams params;
+	params.rainRate = 0.f;
+
+	TerrainErosion erosion;
+	REQUIRE(erosion.Create(&heights[0], SIZE, SIZE, params));
+
+	erosion.Run(1000, 1);
+
+	// It slumps into a cone no steeper than the talus slope, keeping
+	// its material.
+	const float *pHeights = erosion.GetHeights();
+	float maxSlope = 0.f;
+
+	for (int row = 0; row < SIZE; ++row)
+	{
+		for (int col = 0; col + 1 < SIZE; ++col)
+		{
+			maxSlope = std::max(maxSlope, fabsf(pHeights[row * SIZE + col + 1] - pHeights[row * SIZE + col]));
+			maxSlope = std::max(maxSlope, fabsf(pHeights[col * SIZE + row + SIZE] - pHeights[col * SIZE + row]));
+		}
+	}
+
+	CHECK(pHeights[10 * SIZE + 10] < 5.f);
+	CHECK(maxSlope < params.talusSlope + .05f);
+	CHECK_CLOSE(GetTotalMaterial(erosion), 10., 1e-4);
+
+	// Symmetrical, as the neighbours all get their share at once.
+	CHECK_CLOSE(pHeights[10 * SIZE + 9], pHeights[10 * SIZE + 11], 1e-5);
+	CHECK_CLOSE(pHeights[9 * SIZE + 10], pHeights[11 * SIZE + 10], 1e-5);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Iterations a second on a 513x513 grid, like -erode on a big BMP, with
+// and without SSE2, on one thread and on every hardware thread.
+TEST(TerrainErosionBenchmark)
+{
+	const int SIZE = 513, NUM_ITERATIONS = 10;
+
+	std::vector<float> heights = MakeErosionHeights(SIZE, SIZE);
+
+	unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	const unsigned threadCounts[] = {1, numThreads};
+
+	for (int i = 0; i < (numThreads > 1 ? 2 : 1); ++i)
+	{
+		double seconds[2];
+
+		for (int useSSE2 = 0; useSSE2 < 2; ++useSSE2)
+		{
+			TerrainErosion erosion;
+			REQUIRE(erosion.Create(&heights[0], SIZE, SIZE, TerrainErosionParams()));
+
+			erosion.SetUseSSE2(useSSE2 != 0);
+
+			// Wet it first, so it's doing what it does in a long run.
+			erosion.Run(NUM_ITERATIONS, threadCounts[i]);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			erosion.Run(NUM_ITERATIONS, threadCounts[i]);
+			seconds[useSSE2] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		printf("    %dx%d, %u thread%s: %.1f iterations/s (%.1fM cells/s), scalar %.1f iterations/s, %.2fx\n",
+			SIZE, SIZE, threadCounts[i], threadCounts[i] == 1 ? "" : "s", NUM_ITERATIONS / seconds[1], NUM_ITERATIONS * double(SIZE) * SIZE / seconds[1] * 1e-6,
+			NUM_ITERATIONS / seconds[0], seconds[0] / seconds[1]);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,419 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "TerrainGrid.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// A grid point the way TerrainMesh used to keep them, position and
+// normal together.
+struct TestGridVertex
+{
+	float pos[3];
+	float normal[3];
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static double GetSeconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void FillRandomHeights(TerrainGrid *pGrid)
+{
+	int width = pGrid->GetWidth();
+	int length = pGrid->GetLength();
+
+	std::vector<float> heights(size_t(width) * length);
+
+	for (size_t i = 0; i < heights.size(); ++i)
+		heights[i] = rand() / float(RAND_MAX) * 10.f;
+
+	pGrid->SetHeights(0, 0, width - 1, length - 1, &heights[0], size_t(width));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The normals the slow way: the positions and normals in one array,
+// each quad's triangles (a, b, d) and (a, d, c) added to the normals
+// of their corners, then all of them normalised.
+static void CalculateTestNormals(const TerrainGrid &grid, std::vector<TestGridVertex> *pVertices)
+{
+	int width = grid.GetWidth();
+	int length = grid.GetLength();
+
+	pVertices->resize(size_t(width) * length);
+
+	for (int row = 0; row < length; ++row)
+	{
+		for (int col = 0; col < width; ++col)
+		{
+			TestGridVertex *pVertex = &(*pVertices)[size_t(row) * width + col];
+
+			pVertex->pos[0] = grid.GetOriginX() + col * grid.GetColumnStepX();
+			pVertex->pos[1] = grid.GetHeights()[row * grid.GetPitch() + col];
+			pVertex->pos[2] = grid.GetOriginZ() + row * grid.GetRowStepZ();
+
+			pVertex->normal[0] = pVertex->normal[1] = pVertex->normal[2] = 0.f;
+		}
+	}
+
+	for (int row = 0; row < length - 1; ++row)
+	{
+		for (int col = 0; col < width - 1; ++col)
+		{
+			TestGridVertex *pA = &(*pVertices)[size_t(row) * width + col];
+			TestGridVertex *pB = pA + 1;
+			TestGridVertex *pC = pA + width;
+			TestGridVertex *pD = pC + 1;
+
+			TestGridVertex *triangles[2][3] = {{pA, pB, pD}, {pA, pD, pC}};
+
+			for (int i = 0; i < 2; ++i)
+			{
+				const float *p0 = triangles[i][0]->pos;
+				const float *p1 = triangles[i][1]->pos;
+				const float *p2 = triangles[i][2]->pos;
+
+				float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+				float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+				float normal[3] = {
+					e1[1] * e2[2] - e1[2] * e2[1],
+					e1[2] * e2[0] - e1[0] * e2[2],
+					e1[0] * e2[1] - e1[1] * e2[0],
+				};
+
+				for (int j = 0; j < 3; ++j)
+				{
+					for (int k = 0; k < 3; ++k)
+						triangles[i][j]->normal[k] += normal[k];
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < pVertices->size(); ++i)
+	{
+		float *pNormal = (*pVertices)[i].normal;
+		float length = sqrtf(pNormal[0] * pNormal[0] + pNormal[1] * pNormal[1] + pNormal[2] * pNormal[2]);
+
+		for (int k = 0; k < 3; ++k)
+			pNormal[k] /= length;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool CheckNormals(const TerrainGrid &grid, const std::vector<TestGridVertex> &vertices)
+{
+	for (int row = 0; row < grid.GetLength(); ++row)
+	{
+		for (int col = 0; col < grid.GetWidth(); ++col)
+		{
+			size_t point = row * grid.GetPitch() + col;
+			const float *pExpected = vertices[size_t(row) * grid.GetWidth() + col].normal;
+
+			if (!CHECK_CLOSE(grid.GetNormalsX()[point], pExpected[0], 1e-5))
+				return false;
+
+			if (!CHECK_CLOSE(grid.GetNormalsY()[point], pExpected[1], 1e-5))
+				return false;
+
+			if (!CHECK_CLOSE(grid.GetNormalsZ()[point], pExpected[2], 1e-5))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainGridLayout)
+{
+	TerrainGrid grid;
+	CHECK(!grid.Create(1, 10, 0.f, 0.f, 1.f, 1.f));
+	CHECK(!grid.Create(10, 10, 0.f, 0.f, 0.f, 1.f));
+
+	for (int width = 2; width <= 9; ++width)
+	{
+		REQUIRE(grid.Create(width, 3, 1.f, 2.f, 3.f, -4.f));
+		CHECK(grid.GetWidth() == width && grid.GetLength() == 3);
+		CHECK(grid.GetOriginX() == 1.f && grid.GetOriginZ() == 2.f);
+		CHECK(grid.GetColumnStepX() == 3.f && grid.GetRowStepZ() == -4.f);
+
+		// Whole SSE registers per row, every row on a 16 byte boundary.
+		size_t pitch = grid.GetPitch();
+		CHECK(pitch >= size_t(width) && pitch % 4 == 0 && pitch < size_t(width) + 4);
+
+		const float *arrays[] = {grid.GetHeights(), grid.GetNormalsX(), grid.GetNormalsY(), grid.GetNormalsZ()};
+
+		for (int i = 0; i < 4; ++i)
+			CHECK(uintptr_t(arrays[i]) % 16 == 0);
+
+		// Flat, facing up.
+		for (int row = 0; row < 3; ++row)
+		{
+			for (int col = 0; col < width; ++col)
+			{
+				size_t point = row * pitch + col;
+				CHECK(grid.GetHeights()[point] == 0.f);
+				CHECK(grid.GetNormalsX()[point] == 0.f && grid.GetNormalsY()[point] == 1.f && grid.GetNormalsZ()[point] == 0.f);
+			}
+		}
+	}
+
+	// Setting a rectangle from a bigger source leaves the rest alone.
+	REQUIRE(grid.Create(6, 5, 0.f, 0.f, 1.f, 1.f));
+
+	const float source[] = {
+		1.f, 2.f, 3.f, -1.f,
+		4.f, 5.f, 6.f, -1.f,
+	};
+
+	grid.SetHeights(2, 1, 4, 2, source, 4);
+
+	for (int row = 0; row < 5; ++row)
+	{
+		for (int col = 0; col < 6; ++col)
+		{
+			bool inside = col >= 2 && col <= 4 && row >= 1 && row <= 2;
+			float expected = inside ? source[(row - 1) * 4 + col - 2] : 0.f;
+
+			CHECK(grid.GetHeights()[row * grid.GetPitch() + col] == expected);
+		}
+	}
+
+	const float ys[] = {.5f, .25f};
+	const float xzs[] = {.1f, .2f};
+	grid.SetNormals(5, 3, 5, 4, xzs, ys, xzs, 1);
+
+	CHECK(grid.GetNormalsX()[3 * grid.GetPitch() + 5] == .1f && grid.GetNormalsY()[4 * grid.GetPitch() + 5] == .25f);
+	CHECK(grid.GetNormalsY()[3 * grid.GetPitch() + 4] == 1.f);
+
+	float minHeight, maxHeight;
+	grid.GetHeightRange(0, 0, 5, 4, &minHeight, &maxHeight);
+	CHECK(minHeight == 0.f && maxHeight == 6.f);
+
+	grid.GetHeightRange(2, 1, 3, 2, &minHeight, &maxHeight);
+	CHECK(minHeight == 1.f && maxHeight == 5.f);
+
+	grid.Destroy();
+	CHECK(grid.GetWidth() == 0 && grid.GetHeights() == NULL);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainGridNormals)
+{
+	srand(48);
+
+	// Widths either side of a multiple of 4, so there's something either
+	// side of the 4 at a time part; steps either way round.
+	const int sizes[][2] = {{2, 2}, {3, 7}, {13, 5}, {37, 29}, {64, 33}};
+	const float steps[][2] = {{1.f, -1.f}, {2.f, -.5f}, {-1.5f, 3.f}};
+
+	for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; ++i)
+	{
+		for (size_t j = 0; j < sizeof steps / sizeof steps[0]; ++j)
+		{
+			TerrainGrid grid;
+			REQUIRE(grid.Create(sizes[i][0], sizes[i][1], -10.f, 10.f, steps[j][0], steps[j][1]));
+
+			FillRandomHeights(&grid);
+			grid.CalculateNormals(0, 0, grid.GetWidth() - 1, grid.GetLength() - 1);
+
+			std::vector<TestGridVertex> vertices;
+			CalculateTestNormals(grid, &vertices);
+
+			if (!CheckNormals(grid, vertices))
+			{
+				printf("    (%dx%d grid, steps %g, %g)\n", sizes[i][0], sizes[i][1], steps[j][0], steps[j][1]);
+				return;
+			}
+		}
+	}
+
+	// Changing a patch of heights then recalculating just that patch
+	// gets the same as doing the lot, and doesn't touch anything
+	// further away.
+	TerrainGrid grid;
+	REQUIRE(grid.Create(45, 38, 0.f, 0.f, 1.f, -1.f));
+
+	FillRandomHeights(&grid);
+	grid.CalculateNormals(0, 0, 44, 37);
+
+	for (int i = 0; i < 50; ++i)
+	{
+		int minCol = rand() % 45;
+		int minRow = rand() % 38;
+		int maxCol = std::min(minCol + rand() % 10, 44);
+		int maxRow = std::min(minRow + rand() % 10, 37);
+
+		std::vector<float> heights(size_t(maxCol - minCol + 1) * (maxRow - minRow + 1));
+
+		for (size_t j = 0; j < heights.size(); ++j)
+			heights[j] = rand() / float(RAND_MAX) * 10.f;
+
+		std::vector<float> oldNormalsY(grid.GetNormalsY(), grid.GetNormalsY() + grid.GetPitch() * 38);
+
+		grid.SetHeights(minCol, minRow, maxCol, maxRow, &heights[0], size_t(maxCol - minCol + 1));
+		grid.CalculateNormals(minCol, minRow, maxCol, maxRow);
+
+		std::vector<TestGridVertex> vertices;
+		CalculateTestNormals(grid, &vertices);
+
+		if (!CheckNormals(grid, vertices))
+			return;
+
+		for (int row = 0; row < 38; ++row)
+		{
+			for (int col = 0; col < 45; ++col)
+			{
+				bool near = col >= minCol - 1 && col <= maxCol + 1 && row >= minRow - 1 && row <= maxRow + 1;
+				size_t point = row * grid.GetPitch() + col;
+
+				if (!near && !CHECK(grid.GetNormalsY()[point] == oldNormalsY[point]))
+					return;
+			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainGridHeightRange)
+{
+	TerrainGrid grid;
+	REQUIRE(grid.Create(41, 23, 0.f, 0.f, 1.f, -1.f));
+
+	srand(148);
+	FillRandomHeights(&grid);
+
+	for (int i = 0; i < 200; ++i)
+	{
+		int minCol = rand() % 41;
+		int minRow = rand() % 23;
+		int maxCol = minCol + rand() % (41 - minCol);
+		int maxRow = minRow + rand() % (23 - minRow);
+
+		float minHeight, maxHeight;
+		grid.GetHeightRange(minCol, minRow, maxCol, maxRow, &minHeight, &maxHeight);
+
+		float expectedMin = FLT_MAX, expectedMax = -FLT_MAX;
+
+		for (int row = minRow; row <= maxRow; ++row)
+		{
+			for (int col = minCol; col <= maxCol; ++col)
+			{
+				expectedMin = std::min(expectedMin, grid.GetHeights()[row * grid.GetPitch() + col]);
+				expectedMax = std::max(expectedMax, grid.GetHeights()[row * grid.GetPitch() + col]);
+			}
+		}
+
+		if (!CHECK(minHeight == expectedMin && maxHeight == expectedMax))
+			return;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The normals and the chunks' height ranges of a 1025x1025 grid, as
+// the arrays TerrainGrid keeps and as the array of vertices it
+// replaced.
+TEST(TerrainGridBenchmark)
+{
+	const int SIZE = 1025, CHUNK_QUADS = 64;
+
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, SIZE, SIZE, 1.f, &GetTestHillsHeight));
+
+	double seconds = DBL_MAX, testSeconds = DBL_MAX;
+	std::vector<TestGridVertex> vertices;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		grid.CalculateNormals(0, 0, SIZE - 1, SIZE - 1);
+		seconds = std::min(seconds, GetSeconds(start));
+
+		start = std::chrono::steady_clock::now();
+		CalculateTestNormals(grid, &vertices);
+		testSeconds = std::min(testSeconds, GetSeconds(start));
+	}
+
+	printf("    normals: %.2fms (array of vertices %.2fms)\n", seconds * 1000., testSeconds * 1000.);
+
+	if (!CheckNormals(grid, vertices))
+		return;
+
+	float heightSum = 0.f, testHeightSum = 0.f;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int row = 0; row < SIZE - 1; row += CHUNK_QUADS)
+	{
+		for (int col = 0; col < SIZE - 1; col += CHUNK_QUADS)
+		{
+			float minHeight, maxHeight;
+			grid.GetHeightRange(col, row, col + CHUNK_QUADS, row + CHUNK_QUADS, &minHeight, &maxHeight);
+			heightSum += maxHeight - minHeight;
+		}
+	}
+
+	seconds = GetSeconds(start);
+	start = std::chrono::steady_clock::now();
+
+	for (int row = 0; row < SIZE - 1; row += CHUNK_QUADS)
+	{
+		for (int col = 0; col < SIZE - 1; col += CHUNK_QUADS)
+		{
+			float minHeight = FLT_MAX, maxHeight = -FLT_MAX;
+
+			for (int chunkRow = row; chunkRow <= row + CHUNK_QUADS; ++chunkRow)
+			{
+				const TestGridVertex *pRow = &vertices[size_t(chunkRow) * SIZE];
+
+				for (int chunkCol = col; chunkCol <= col + CHUNK_QUADS; ++chunkCol)
+				{
+					minHeight = std::min(minHeight, pRow[chunkCol].pos[1]);
+					maxHeight = std::max(maxHeight, pRow[chunkCol].pos[1]);
+				}
+			}
+
+			testHeightSum += maxHeight - minHeight;
+		}
+	}
+
+	testSeconds = GetSeconds(start);
+
+	printf("    chunk height ranges: %.2fms (array of vertices %.2fms)\n", seconds * 1000., testSeconds * 1000.);
+
+	CHECK(heightSum == testHeightSum);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
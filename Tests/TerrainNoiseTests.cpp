@@ -0,0 +1,222 @@
+#include "Test.h"
+
+#include "TerrainNoise.h"
+
+#include <float.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// fBm and ridged, each with and without warping.
+static TerrainNoiseParams GetTestNoiseParams(int index)
+{
+	TerrainNoiseParams params;
+
+	params.type = index & 1 ? TERRAIN_NOISE_RIDGED : TERRAIN_NOISE_FBM;
+	params.seed = 12345u + uint32_t(index);
+	params.frequency = 1.f / 37.f;
+
+	if (index & 2)
+		params.warpDistance = 20.f;
+
+	return params;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static const int NUM_TEST_NOISE_PARAMS = 4;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainNoiseSSE2MatchesScalar)
+{
+	// Not a whole number of 4 columns, either side of 0.
+	const int WIDTH = 61, LENGTH = 19, MIN_COL = -29, MIN_ROW = -7;
+
+	for (int i = 0; i < NUM_TEST_NOISE_PARAMS; ++i)
+	{
+		TerrainNoiseParams params = GetTestNoiseParams(i);
+
+		std::vector<float> heights(size_t(WIDTH) * LENGTH);
+		GenerateTerrainNoise(params, MIN_COL, MIN_ROW, WIDTH, LENGTH, &heights[0], 1);
+
+		size_t numDifferent = 0;
+		float minHeight = FLT_MAX, maxHeight = -FLT_MAX;
+
+		for (int row = 0; row < LENGTH; ++row)
+		{
+			for (int col = 0; col < WIDTH; ++col)
+			{
+				float height = heights[size_t(row) * WIDTH + col];
+
+				// Bit for bit, as the header says.
+				if (height != SampleTerrainNoise(params, MIN_COL + col, MIN_ROW + row))
+					++numDifferent;
+
+				minHeight = std::min(minHeight, height);
+				maxHeight = std::max(maxHeight, height);
+			}
+		}
+
+		if (!CHECK(numDifferent == 0))
+			printf("    (%zu different, params %d)\n", numDifferent, i);
+
+		// Somewhere around baseHeight +/- amplitude, and not flat.
+		CHECK(minHeight > params.baseHeight - 1.5f * params.amplitude && maxHeight < params.baseHeight + 1.5f * params.amplitude);
+		CHECK(maxHeight - minHeight > .2f * params.amplitude);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainNoiseTilesJoinUp)
+{
+	const int WIDTH = 150, LENGTH = 90;
+
+	// Near the origin, and a long way from it.
+	const int origins[][2] = {{-70, -40}, {1 << 20, -(1 << 19)}};
+
+	for (int i = 0; i < NUM_TEST_NOISE_PARAMS; ++i)
+	{
+		TerrainNoiseParams params = GetTestNoiseParams(i);
+
+		for (int j = 0; j < 2; ++j)
+		{
+			int minCol = origins[j][0], minRow = origins[j][1];
+
+			std::vector<float> heights(size_t(WIDTH) * LENGTH);
+			GenerateTerrainNoise(params, minCol, minRow, WIDTH, LENGTH, &heights[0], 1);
+
+			// The same area in odd sized tiles, last first, sharing their
+			// edge rows and columns, as TerrainWorld's tiles do.
+			const int TILE_WIDTH = 33, TILE_LENGTH = 21;
+			size_t numDifferent = 0;
+
+			for (int tileRow = LENGTH - 1; tileRow >= 0; tileRow -= TILE_LENGTH - 1)
+			{
+				for (int tileCol = WIDTH - 1; tileCol >= 0; tileCol -= TILE_WIDTH - 1)
+				{
+					int col0 = std::max(tileCol - (TILE_WIDTH - 1), 0);
+					int row0 = std::max(tileRow - (TILE_LENGTH - 1), 0);
+					int tileWidth = tileCol - col0 + 1, tileLength = tileRow - row0 + 1;
+
+					std::vector<float> tile(size_t(tileWidth) * tileLength);
+					GenerateTerrainNoise(params, minCol + col0, minRow + row0, tileWidth, tileLength, &tile[0], 1);
+
+					for (int row = 0; row < tileLength; ++row)
+					{
+						const float *pRow = &heights[size_t(row0 + row) * WIDTH + col0];
+
+						if (!std::equal(pRow, pRow + tileWidth, &tile[size_t(row) * tileWidth]))
+							++numDifferent;
+					}
+				}
+			}
+
+			if (!CHECK(numDifferent == 0))
+				printf("    (%zu rows different, params %d, origin %d)\n", numDifferent, i, j);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainNoiseSameOnAnyThreads)
+{
+	// More rows than one job does, but not a whole number of jobs.
+	const int WIDTH = 45, LENGTH = 101;
+	const unsigned numThreads[] = {1, 2, 3, 8, 0};
+
+	for (int i = 0; i < NUM_TEST_NOISE_PARAMS; ++i)
+	{
+		TerrainNoiseParams params = GetTestNoiseParams(i);
+		std::vector<float> heights[sizeof numThreads / sizeof numThreads[0]];
+
+		for (size_t j = 0; j < sizeof numThreads / sizeof numThreads[0]; ++j)
+		{
+			heights[j].resize(size_t(WIDTH) * LENGTH);
+			GenerateTerrainNoise(params, 5, 6, WIDTH, LENGTH, &heights[j][0], numThreads[j]);
+
+			if (j > 0 && !CHECK(heights[j] == heights[0]))
+				printf("    (%u threads, params %d)\n", numThreads[j], i);
+		}
+	}
+
+	// A different seed is different noise.
+	TerrainNoiseParams params = GetTestNoiseParams(0);
+	float height = SampleTerrainNoise(params, 10, 20);
+
+	params.seed += 1;
+	CHECK(SampleTerrainNoise(params, 10, 20) != height);
+
+	// Nothing to do.
+	GenerateTerrainNoise(params, 0, 0, 0, 10, NULL, 1);
+	GenerateTerrainNoise(params, 0, 0, 10, 0, NULL, 1);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Samples a second for a 1024x1024 grid at -noise's frequency, fBm and
+// warped ridged noise, one at a time with SampleTerrainNoise, then with
+// GenerateTerrainNoise on one thread and on every hardware thread.
+TEST(TerrainNoiseBenchmark)
+{
+	const int SIZE = 1024;
+
+	unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<float> heights(size_t(SIZE) * SIZE);
+
+	for (int i = 0; i < 4; i += 3)
+	{
+		// Without warping, then with.
+		TerrainNoiseParams params = GetTestNoiseParams(i);
+		params.frequency = TerrainNoiseParams().frequency;
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		for (int row = 0; row < SIZE; ++row)
+		{
+			for (int col = 0; col < SIZE; ++col)
+				heights[size_t(row) * SIZE + col] = SampleTerrainNoise(params, col, row);
+		}
+
+		double scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::vector<float> scalarHeights = heights;
+
+		start = std::chrono::steady_clock::now();
+		GenerateTerrainNoise(params, 0, 0, SIZE, SIZE, &heights[0], 1);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		CHECK(heights == scalarHeights);
+
+		printf("    %s%s: SampleTerrainNoise %.1fM samples/s, GenerateTerrainNoise %.1fM samples/s, %.2fx",
+			params.type == TERRAIN_NOISE_RIDGED ? "ridged" : "fBm", params.warpDistance > 0.f ? ", warped" : "",
+			heights.size() / scalarSeconds * 1e-6, heights.size() / seconds * 1e-6, scalarSeconds / seconds);
+
+		if (numThreads > 1)
+		{
+			start = std::chrono::steady_clock::now();
+			GenerateTerrainNoise(params, 0, 0, SIZE, SIZE, &heights[0], numThreads);
+			double threadedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			printf(", %.1fM samples/s on %u threads", heights.size() / threadedSeconds * 1e-6, numThreads);
+		}
+
+		printf("\n");
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,404 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "HeightField.h"
+#include "TerrainGrid.h"
+#include "TerrainPathfinder.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static const TerrainPathCosts TEST_PATH_COSTS = {1.5f, 4.f};
+
+// HPA* paths have to go through the crossing points on the cluster
+// borders, so one path can cost a lot more than the best. On average
+// it's much closer.
+static const float MAX_COST_RATIO = 2.f;
+
+// The test hills, made steep enough in places that the slope limit
+// makes for detours.
+static float GetSteepHillsHeight(float x, float z)
+{
+	return GetTestHillsHeight(x, z) * 3.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Cost of one move, as the pathfinder's header describes it, or
+// negative if it can't be made.
+static float GetTestMoveCost(const HeightField &heightField, int fromIndex, int toIndex)
+{
+	int width = heightField.GetWidth();
+
+	int cols = abs(toIndex % width - fromIndex % width);
+	int rows = abs(toIndex / width - fromIndex / width);
+
+	if (cols > 1 || rows > 1 || cols + rows == 0)
+		return -1.f;
+
+	float length = sqrtf(float(cols * cols + rows * rows));
+	float rise = fabsf(heightField.GetGridHeights()[toIndex] - heightField.GetGridHeights()[fromIndex]);
+
+	if (rise > length * TEST_PATH_COSTS.maxSlope)
+		return -1.f;
+
+	return length + rise * TEST_PATH_COSTS.climbPenalty;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Plain A* over every grid point, written out from scratch. Returns a
+// negative cost if there's no way through.
+static float FindTestPathCost(const HeightField &heightField, int startIndex, int goalIndex)
+{
+	int width = heightField.GetWidth();
+	int length = heightField.GetLength();
+
+	int goalCol = goalIndex % width;
+	int goalRow = goalIndex / width;
+
+	std::vector<float> costs(size_t(width) * length, -1.f);
+	std::vector<bool> done(costs.size(), false);
+
+	typedef std::pair<float, int> OpenEntry;
+	std::vector<OpenEntry> open;
+
+	costs[startIndex] = 0.f;
+	open.push_back(OpenEntry(0.f, startIndex));
+
+	while (!open.empty())
+	{
+		std::pop_heap(open.begin(), open.end(), std::greater<OpenEntry>());
+		int index = open.back().second;
+		open.pop_back();
+
+		if (done[index])
+			continue;
+
+		if (index == goalIndex)
+			return costs[index];
+
+		done[index] = true;
+
+		int col = index % width;
+		int row = index / width;
+
+		for (int dRow = -1; dRow <= 1; ++dRow)
+		{
+			for (int dCol = -1; dCol <= 1; ++dCol)
+			{
+				int nextCol = col + dCol;
+				int nextRow = row + dRow;
+
+				if (nextCol < 0 || nextCol >= width || nextRow < 0 || nextRow >= length)
+					continue;
+
+				int nextIndex = nextRow * width + nextCol;
+
+				float moveCost = GetTestMoveCost(heightField, index, nextIndex);
+				if (moveCost < 0.f || done[nextIndex])
+					continue;
+
+				float cost = costs[index] + moveCost;
+				if (costs[nextIndex] >= 0.f && costs[nextIndex] <= cost)
+					continue;
+
+				costs[nextIndex] = cost;
+
+				// Octile distance.
+				int cols = abs(goalCol - nextCol);
+				int rows = abs(goalRow - nextRow);
+				float heuristic = float(std::max(cols, rows) - std::min(cols, rows)) + float(std::min(cols, rows)) * sqrtf(2.f);
+
+				open.push_back(OpenEntry(cost + heuristic, nextIndex));
+				std::push_heap(open.begin(), open.end(), std::greater<OpenEntry>());
+			}
+		}
+	}
+
+	return -1.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Checks the path goes from start to goal by moves that can be made,
+// and costs what FindPath said.
+static bool IsGoodPath(const HeightField &heightField, const std::vector<int> &path, int startIndex, int goalIndex, float cost)
+{
+	if (path.empty() || path.front() != startIndex || path.back() != goalIndex)
+		return false;
+
+	float pathCost = 0.f;
+
+	for (size_t i = 1; i < path.size(); ++i)
+	{
+		float moveCost = GetTestMoveCost(heightField, path[i - 1], path[i]);
+		if (moveCost < 0.f)
+			return false;
+
+		pathCost += moveCost;
+	}
+
+	return fabsf(pathCost - cost) <= 1e-3f * std::max(cost, 1.f);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void MakeRandomEnds(int width, int length, size_t numPaths, std::vector<int> *pStarts, std::vector<int> *pGoals)
+{
+	pStarts->resize(numPaths);
+	pGoals->resize(numPaths);
+
+	for (size_t i = 0; i < numPaths; ++i)
+	{
+		(*pStarts)[i] = rand() % (width * length);
+
+		// Some close together, where the pathfinder searches the grid
+		// directly.
+		if (i % 4 == 0)
+		{
+			int col = std::min((*pStarts)[i] % width + rand() % 10, width - 1);
+			int row = std::min((*pStarts)[i] / width + rand() % 10, length - 1);
+			(*pGoals)[i] = row * width + col;
+		}
+		else
+		{
+			(*pGoals)[i] = rand() % (width * length);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainPathfinderMatchesAStar)
+{
+	const int WIDTH = 96, LENGTH = 80;
+
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, WIDTH, LENGTH, 1.f, &GetSteepHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	TerrainPathfinder pathfinder;
+	REQUIRE(pathfinder.Create(&heightField, TEST_PATH_COSTS, 16, 4));
+	CHECK(pathfinder.GetNumNodes() > 0);
+
+	srand(9);
+
+	std::vector<int> starts, goals;
+	MakeRandomEnds(WIDTH, LENGTH, 300, &starts, &goals);
+
+	TerrainPathSearch search;
+	std::vector<int> path;
+
+	size_t numFound = 0;
+	double sumRatios = 0.;
+
+	for (size_t i = 0; i < starts.size(); ++i)
+	{
+		float testCost = FindTestPathCost(heightField, starts[i], goals[i]);
+
+		float cost, referenceCost;
+		bool found = pathfinder.FindPath(starts[i], goals[i], &search, &path, &cost);
+
+		if (!CHECK(found == (testCost >= 0.f)))
+		{
+			printf("    (%d to %d)\n", starts[i], goals[i]);
+			break;
+		}
+
+		if (!found)
+			continue;
+
+		++numFound;
+
+		if (!CHECK(IsGoodPath(heightField, path, starts[i], goals[i], cost)))
+			break;
+
+		// Never better than the best.
+		if (!CHECK(cost >= testCost * (1.f - 1e-4f) - 1e-4f && cost <= testCost * MAX_COST_RATIO + 1e-3f))
+		{
+			printf("    (%d to %d: %f, best %f)\n", starts[i], goals[i], cost, testCost);
+			break;
+		}
+
+		sumRatios += testCost > 0.f ? cost / testCost : 1.;
+
+		// The pathfinder's own A* finds the best too.
+		REQUIRE(pathfinder.FindPathReference(starts[i], goals[i], &search, &path, &referenceCost));
+		CHECK(IsGoodPath(heightField, path, starts[i], goals[i], referenceCost));
+		CHECK_CLOSE(referenceCost, testCost, 1e-3 * fmax(testCost, 1.));
+	}
+
+	// Typically only a few percent over.
+	REQUIRE(numFound > starts.size() / 2);
+	CHECK(sumRatios / numFound < 1.1);
+
+	// Start and goal the same.
+	float cost;
+	REQUIRE(pathfinder.FindPath(starts[1], starts[1], &search, &path, &cost));
+	CHECK(path.size() == 1 && path[0] == starts[1] && cost == 0.f);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainPathfinderUpdateRegion)
+{
+	const int WIDTH = 80, LENGTH = 64;
+
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, WIDTH, LENGTH, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	TerrainPathfinder pathfinder;
+	REQUIRE(pathfinder.Create(&heightField, TEST_PATH_COSTS, 16, 1));
+
+	// A wall right across, with one gap, after the pathfinder was
+	// built.
+	const int WALL_ROW = 30, GAP_COL = 57;
+
+	std::vector<float> wall(WIDTH * 2);
+	for (int col = 0; col < WIDTH; ++col)
+	{
+		const float *pHeights = heightField.GetGridHeights();
+
+		for (int row = 0; row < 2; ++row)
+		{
+			float height = pHeights[(WALL_ROW + row) * WIDTH + col];
+			wall[row * WIDTH + col] = col == GAP_COL ? height : height + 50.f;
+		}
+	}
+
+	heightField.SetGridHeights(0, WALL_ROW, WIDTH - 1, WALL_ROW + 1, &wall[0]);
+	pathfinder.UpdateRegion(0, WALL_ROW, WIDTH - 1, WALL_ROW + 1, 1);
+
+	TerrainPathfinder rebuilt;
+	REQUIRE(rebuilt.Create(&heightField, TEST_PATH_COSTS, 16, 1));
+
+	srand(10);
+
+	TerrainPathSearch search;
+	std::vector<int> path;
+
+	size_t numCrossing = 0;
+
+	for (int i = 0; i < 100; ++i)
+	{
+		// One end each side of the wall.
+		int start = (rand() % WALL_ROW) * WIDTH + rand() % WIDTH;
+		int goal = (WALL_ROW + 2 + rand() % (LENGTH - WALL_ROW - 2)) * WIDTH + rand() % WIDTH;
+
+		float testCost = FindTestPathCost(heightField, start, goal);
+
+		float cost, rebuiltCost;
+		bool found = pathfinder.FindPath(start, goal, &search, &path, &cost);
+
+		if (!CHECK(found == (testCost >= 0.f)))
+			break;
+
+		if (!found)
+			continue;
+
+		if (!CHECK(IsGoodPath(heightField, path, start, goal, cost)))
+			break;
+
+		if (!CHECK(std::find(path.begin(), path.end(), WALL_ROW * WIDTH + GAP_COL) != path.end()))
+			break;
+
+		++numCrossing;
+
+		CHECK(cost >= testCost * (1.f - 1e-4f) - 1e-4f && cost <= testCost * MAX_COST_RATIO + 1e-3f);
+
+		// Updating gives the same answers as starting again.
+		REQUIRE(rebuilt.FindPath(start, goal, &search, &path, &rebuiltCost));
+		CHECK_CLOSE(cost, rebuiltCost, 1e-4 * fmax(cost, 1.));
+	}
+
+	CHECK(numCrossing > 50);
+	CHECK(pathfinder.GetNumNodes() == rebuilt.GetNumNodes());
+
+	// Close the gap, and there's no way across.
+	std::vector<float> gap(2);
+	gap[0] = wall[GAP_COL] + 50.f;
+	gap[1] = wall[WIDTH + GAP_COL] + 50.f;
+
+	heightField.SetGridHeights(GAP_COL, WALL_ROW, GAP_COL, WALL_ROW + 1, &gap[0]);
+	pathfinder.UpdateRegion(GAP_COL, WALL_ROW, GAP_COL, WALL_ROW + 1, 1);
+
+	float cost;
+	CHECK(!pathfinder.FindPath(5 * WIDTH + 5, (LENGTH - 5) * WIDTH + 5, &search, &path, &cost));
+	CHECK(!pathfinder.FindPathReference(5 * WIDTH + 5, (LENGTH - 5) * WIDTH + 5, &search, &path, &cost));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainPathfinderFindPaths)
+{
+	const int WIDTH = 64, LENGTH = 64;
+
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, WIDTH, LENGTH, 1.f, &GetSteepHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	TerrainPathfinder pathfinder;
+	REQUIRE(pathfinder.Create(&heightField, TEST_PATH_COSTS, 16, 0));
+
+	srand(11);
+
+	std::vector<int> starts, goals;
+	MakeRandomEnds(WIDTH, LENGTH, 200, &starts, &goals);
+
+	std::vector<std::vector<int> > paths(starts.size());
+	std::vector<float> costs(starts.size());
+	std::unique_ptr<bool[]> found(new bool[starts.size()]);
+
+	size_t numFound = pathfinder.FindPaths(&starts[0], &goals[0], starts.size(), &paths[0], &costs[0], found.get(), 4);
+
+	TerrainPathSearch search;
+	std::vector<int> path;
+
+	size_t numCounted = 0;
+
+	for (size_t i = 0; i < starts.size(); ++i)
+	{
+		float cost;
+
+		if (!CHECK(pathfinder.FindPath(starts[i], goals[i], &search, &path, &cost) == found[i]))
+			break;
+
+		if (!found[i])
+			continue;
+
+		++numCounted;
+
+		if (!CHECK(paths[i] == path && costs[i] == cost))
+			break;
+	}
+
+	CHECK(numFound == numCounted);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,497 @@
+#include "Test.h"
+
+#include "CameraPathFile.h"
+#include "TerrainPrefetcher.h"
+#include "TerrainWorld.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Different for every point of every tile, so any mix-up shows.
+static void FillTestTile(int tileX, int tileZ, int numPoints, float *pHeights)
+{
+	for (int i = 0; i < numPoints * numPoints; ++i)
+		pHeights[i] = float(tileX * 100 + tileZ * 10) + float(i) * .001f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static bool IsTestTile(int tileX, int tileZ, int numPoints, const float *pHeights)
+{
+	std::vector<float> expected(size_t(numPoints) * numPoints);
+	FillTestTile(tileX, tileZ, numPoints, &expected[0]);
+
+	return std::equal(expected.begin(), expected.end(), pHeights);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Gives the worker thread up to a second to get through its queue.
+static bool WaitForReads(const TerrainPrefetcher &prefetcher)
+{
+	for (int i = 0; i < 1000; ++i)
+	{
+		if (prefetcher.GetNumPendingReads() == 0)
+			return true;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static TerrainWorldParams MakeParams(int numTilesX, int numTilesZ, int tileQuads, float loadRadius, float unloadRadius)
+{
+	TerrainWorldParams params;
+
+	params.numTilesX = numTilesX;
+	params.numTilesZ = numTilesZ;
+	params.tileQuads = tileQuads;
+	params.stitchMargin = 2;
+	params.loadRadius = loadRadius;
+	params.unloadRadius = unloadRadius;
+	params.maxLoadsPerUpdate = numTilesX * numTilesZ;
+
+	return params;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainPrefetcherMatchesDirectLoads)
+{
+	const int TILE_QUADS = 8, NUM_POINTS = TILE_QUADS + 1;
+
+	TerrainWorldParams worldParams = MakeParams(20, 3, TILE_QUADS, 6.f, 12.f);
+
+	std::atomic<int> numLoads(0);
+
+	TerrainWorldLoadFn loadFn = [&numLoads](int tileX, int tileZ, int numPoints, float *pHeights) {
+		++numLoads;
+		FillTestTile(tileX, tileZ, numPoints, pHeights);
+		return true;
+	};
+
+	TerrainPrefetcherParams params;
+	params.lookAheadTime = 1.f;
+
+	TerrainPrefetcher prefetcher;
+	CHECK(!prefetcher.Create(worldParams, params, TerrainWorldLoadFn()));
+	REQUIRE(prefetcher.Create(worldParams, params, loadFn));
+
+	int numWorldLoads = 0;
+
+	TerrainWorld world;
+	REQUIRE(world.Create(worldParams, [&](int tileX, int tileZ, int numPoints, float *pHeights) {
+		++numWorldLoads;
+		return prefetcher.LoadTile(tileX, tileZ, numPoints, pHeights);
+	}));
+
+	// The same world, loading for itself.
+	TerrainWorld directWorld;
+	REQUIRE(directWorld.Create(worldParams, [](int tileX, int tileZ, int numPoints, float *pHeights) {
+		FillTestTile(tileX, tileZ, numPoints, pHeights);
+		return true;
+	}));
+
+	// Along the middle row, 2 tiles a second.
+	const float VELOCITY = 16.f;
+	float col = 4.f, row = 12.f;
+
+	for (int step = 0; step < 90; ++step, col += VELOCITY * .1f)
+	{
+		prefetcher.Update(world, col, row, VELOCITY, 0.f);
+
+		// Reading's quicker than the camera moves, so everything comes in
+		// ahead of time.
+		REQUIRE(WaitForReads(prefetcher));
+
+		world.Update(col, row);
+		directWorld.Update(col, row);
+
+		REQUIRE(world.GetNumLoadedTiles() == directWorld.GetNumLoadedTiles());
+
+		for (size_t i = 0; i < world.GetNumJustLoadedTiles(); ++i)
+		{
+			int tileX, tileZ;
+			world.GetJustLoadedTile(i, &tileX, &tileZ);
+
+			const float *pHeights = world.GetTileHeights(tileX, tileZ);
+			const float *pDirectHeights = directWorld.GetTileHeights(tileX, tileZ);
+			REQUIRE(pHeights && pDirectHeights);
+
+			if (!CHECK(std::equal(pHeights, pHeights + NUM_POINTS * NUM_POINTS, pDirectHeights)))
+				return;
+		}
+	}
+
+	TerrainPrefetcherStats stats = prefetcher.GetStats();
+
+	// Every tile the world wanted, the neighbours it loads for their
+	// edges included, was read already.
+	CHECK(numWorldLoads > 20);
+	CHECK(stats.numHits == size_t(numWorldLoads));
+	CHECK(stats.numMisses == 0 && stats.numWaits == 0);
+
+	CHECK(stats.numRead >= stats.numHits);
+	CHECK(stats.numRead == size_t(numLoads));
+	CHECK(stats.numBytesRead == stats.numRead * NUM_POINTS * NUM_POINTS * sizeof(float));
+	CHECK(stats.numRequested >= stats.numRead);
+	CHECK(prefetcher.GetNumPendingReads() == 0);
+
+	// Whatever's read but not taken is wasted.
+	prefetcher.Destroy();
+
+	stats = prefetcher.GetStats();
+	CHECK(stats.numWasted == stats.numRead - stats.numHits);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainPrefetcherCancelsAndWaits)
+{
+	const int NUM_TILES_X = 16, TILE_QUADS = 8, NUM_POINTS = TILE_QUADS + 1;
+
+	TerrainWorldParams worldParams = MakeParams(NUM_TILES_X, 2, TILE_QUADS, 4.f, 8.f);
+
+	// The worker thread's reads wait until the gate's opened, so that
+	// the test can see what's queued, and what's being read.
+	std::mutex gateMutex;
+	std::condition_variable gateCondition;
+	bool gateOpen = false;
+
+	std::atomic<int> readingTile(-1);
+	std::thread::id mainThreadID = std::this_thread::get_id();
+
+	TerrainWorldLoadFn loadFn = [&](int tileX, int tileZ, int numPoints, float *pHeights) {
+		if (std::this_thread::get_id() != mainThreadID)
+		{
+			readingTile = tileZ * NUM_TILES_X + tileX;
+
+			std::unique_lock<std::mutex> lock(gateMutex);
+
+			while (!gateOpen)
+				gateCondition.wait(lock);
+		}
+
+		FillTestTile(tileX, tileZ, numPoints, pHeights);
+		return true;
+	};
+
+	TerrainPrefetcherParams params;
+	params.lookAheadTime = 2.f;
+
+	TerrainPrefetcher prefetcher;
+	REQUIRE(prefetcher.Create(worldParams, params, loadFn));
+
+	// Never updated; it's only there to say what's loaded, which is
+	// nothing.
+	TerrainWorld world;
+	REQUIRE(world.Create(worldParams, loadFn));
+
+	// Heading along the top row, which wants the first few tiles of
+	// both rows.
+	prefetcher.Update(world, 4.f, 4.f, 16.f, 0.f);
+
+	for (int i = 0; i < 1000 && readingTile < 0; ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	// The first read is the tile the camera's on.
+	REQUIRE(readingTile == 0);
+
+	TerrainPrefetcherStats stats = prefetcher.GetStats();
+	CHECK(stats.numRequested > 8);
+	CHECK(prefetcher.GetNumPendingReads() == stats.numRequested);
+
+	// A tile that's still queued is read there and then.
+	std::vector<float> heights(NUM_POINTS * NUM_POINTS);
+
+	REQUIRE(prefetcher.LoadTile(4, 0, NUM_POINTS, &heights[0]));
+	CHECK(IsTestTile(4, 0, NUM_POINTS, &heights[0]));
+
+	stats = prefetcher.GetStats();
+	CHECK(stats.numMisses == 1);
+	CHECK(prefetcher.GetNumPendingReads() == stats.numRequested - 1);
+
+	size_t numRequested = stats.numRequested;
+
+	// Jumping to the far end cancels everything still queued, but not
+	// the read under way.
+	prefetcher.Update(world, 124.f, 4.f, 0.f, 0.f);
+
+	stats = prefetcher.GetStats();
+	CHECK(stats.numCancelled == numRequested - 2);
+
+	// Tiles 14 and 15, and their neighbours, in both rows.
+	CHECK(stats.numRequested == numRequested + 6);
+	CHECK(prefetcher.GetNumPendingReads() == 7);
+
+	// Loading the tile that's being read waits for it.
+	std::thread opener([&]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+		std::lock_guard<std::mutex> lock(gateMutex);
+		gateOpen = true;
+		gateCondition.notify_all();
+	});
+
+	bool loaded = prefetcher.LoadTile(0, 0, NUM_POINTS, &heights[0]);
+	opener.join();
+
+	REQUIRE(loaded);
+	CHECK(IsTestTile(0, 0, NUM_POINTS, &heights[0]));
+
+	stats = prefetcher.GetStats();
+	CHECK(stats.numWaits == 1 && stats.numHits == 0);
+
+	// The rest are read, and then thrown away unused.
+	REQUIRE(WaitForReads(prefetcher));
+	prefetcher.Destroy();
+
+	stats = prefetcher.GetStats();
+	CHECK(stats.numRead == 7);
+	CHECK(stats.numWasted == 6);
+	CHECK(stats.numBytesWasted == 6 * NUM_POINTS * NUM_POINTS * sizeof(float));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The app's world camera: 60 updates a second, moving up to 2 units an
+// update, looking down at a point in front of it.
+static const float REPLAY_UPDATES_PER_SECOND = 60.f;
+static const float REPLAY_MOVE_SPEED = 2.f;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Adds a frame with the camera at world position (x, z), as
+// HeightMapApplication::HandleUpdate puts it.
+static void AddReplayFrame(float x, float z, std::vector<CameraPathFrame> *pFrames)
+{
+	CameraPathFrame frame;
+
+	frame.lookat[0] = x;
+	frame.lookat[1] = 0.f;
+	frame.lookat[2] = z - 100.f;
+	frame.camera[0] = x;
+	frame.camera[1] = 50.f;
+	frame.camera[2] = z;
+
+	pFrames->push_back(frame);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The paths are for a world halfSize wide either side of the origin,
+// and keep 400 units inside its edges.
+static void MakeStraightReplayPath(float halfSize, std::vector<CameraPathFrame> *pFrames)
+{
+	for (float x = 400.f - halfSize; x < halfSize - 400.f; x += REPLAY_MOVE_SPEED)
+		AddReplayFrame(x, 0.f, pFrames);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Diagonally across the world, turning 90 degrees every 5 seconds.
+static void MakeZigzagReplayPath(float halfSize, std::vector<CameraPathFrame> *pFrames)
+{
+	const int FRAMES_PER_LEG = int(5.f * REPLAY_UPDATES_PER_SECOND);
+	float step = REPLAY_MOVE_SPEED / sqrtf(2.f);
+	float x = 400.f - halfSize, z = 0.f;
+
+	for (int i = 0; x < halfSize - 400.f; ++i)
+	{
+		x += step;
+		z += (i / FRAMES_PER_LEG) % 2 ? -step : step;
+
+		AddReplayFrame(x, z, pFrames);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Wandering about, heading somewhere new every half a second to 2
+// seconds, and stopping now and then.
+static void MakeRandomReplayPath(float halfSize, int numFrames, std::vector<CameraPathFrame> *pFrames)
+{
+	float x = 0.f, z = 0.f, dx = 0.f, dz = 0.f;
+	int framesLeft = 0;
+
+	for (int i = 0; i < numFrames; ++i)
+	{
+		if (framesLeft-- == 0)
+		{
+			float angle = float(rand()) / RAND_MAX * 6.2831853f;
+			float speed = rand() % 4 == 0 ? 0.f : REPLAY_MOVE_SPEED;
+
+			dx = cosf(angle) * speed;
+			dz = sinf(angle) * speed;
+			framesLeft = int(REPLAY_UPDATES_PER_SECOND / 2) + rand() % int(REPLAY_UPDATES_PER_SECOND * 3 / 2);
+		}
+
+		// Bounce off the edges.
+		if (fabsf(x + dx) > halfSize - 400.f)
+			dx = -dx;
+
+		if (fabsf(z + dz) > halfSize - 400.f)
+			dz = -dz;
+
+		x += dx;
+		z += dz;
+
+		AddReplayFrame(x, z, pFrames);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Flies the camera along the path, as RenderWorld does, with tiles
+// that take no time to read, so what's measured is how well the
+// prefetcher guesses what's coming. Prints how many of the tiles the
+// world loaded had been read ahead, and how much reading was wasted.
+static bool ReplayPrefetcher(const char *pName, const std::vector<CameraPathFrame> &frames, const TerrainWorldParams &worldParams, TerrainPrefetcherStats *pStats)
+{
+	TerrainPrefetcher prefetcher;
+	if (!CHECK(prefetcher.Create(worldParams, TerrainPrefetcherParams(), [](int tileX, int tileZ, int numPoints, float *pHeights) {
+		FillTestTile(tileX, tileZ, numPoints, pHeights);
+		return true;
+	})))
+	{
+		return false;
+	}
+
+	size_t numWorldLoads = 0;
+
+	TerrainWorld world;
+	if (!CHECK(world.Create(worldParams, [&](int tileX, int tileZ, int numPoints, float *pHeights) {
+		++numWorldLoads;
+		return prefetcher.LoadTile(tileX, tileZ, numPoints, pHeights);
+	})))
+	{
+		return false;
+	}
+
+	float halfWorldWide = worldParams.numTilesX * worldParams.tileQuads * .5f;
+	float halfWorldLong = worldParams.numTilesZ * worldParams.tileQuads * .5f;
+
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		const float *pCamera = frames[i].camera;
+		const float *pLastCamera = frames[i > 0 ? i - 1 : 0].camera;
+
+		float cameraCol = pCamera[0] / worldParams.gridSize + halfWorldWide;
+		float cameraRow = halfWorldLong - pCamera[2] / worldParams.gridSize;
+		float velocityCol = (pCamera[0] - pLastCamera[0]) * REPLAY_UPDATES_PER_SECOND / worldParams.gridSize;
+		float velocityRow = -(pCamera[2] - pLastCamera[2]) * REPLAY_UPDATES_PER_SECOND / worldParams.gridSize;
+
+		prefetcher.Update(world, cameraCol, cameraRow, velocityCol, velocityRow);
+
+		if (!CHECK(WaitForReads(prefetcher)))
+			return false;
+
+		world.Update(cameraCol, cameraRow);
+	}
+
+	// Whatever's read but not taken by now is wasted.
+	prefetcher.Destroy();
+
+	*pStats = prefetcher.GetStats();
+
+	CHECK(pStats->numHits + pStats->numWaits + pStats->numMisses == numWorldLoads);
+
+	size_t tileNumBytes = size_t(world.GetNumTilePoints()) * world.GetNumTilePoints() * sizeof(float);
+
+	printf("    %s, %zu frames: world loaded %zu tiles, %zu read ahead (%.1f%%), %zu read itself; read %zu tiles (%zu cancelled), %zu wasted, %.1f MB (%.1f%%)\n",
+		pName, frames.size(), numWorldLoads, pStats->numHits + pStats->numWaits, (pStats->numHits + pStats->numWaits) * 100. / std::max(numWorldLoads, size_t(1)),
+		pStats->numMisses, pStats->numRead, pStats->numCancelled, pStats->numWasted, pStats->numBytesWasted / (1024. * 1024.),
+		pStats->numBytesWasted * 100. / std::max(pStats->numRead * tileNumBytes, size_t(1)));
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Replays straight, zigzag and random camera paths, through a camera
+// path file as if they'd been recorded in the app, over a world big
+// enough to cross. A CameraPath.txt recorded in the app's world mode
+// is replayed as well, if there's one with the maps.
+TEST(TerrainPrefetcherReplay)
+{
+	srand(42);
+
+	// The app's world params, but more tiles.
+	TerrainWorldParams worldParams;
+	worldParams.numTilesX = 32;
+	worldParams.numTilesZ = 32;
+	worldParams.loadRadius = 300.f;
+	worldParams.unloadRadius = 380.f;
+	worldParams.maxNumBytes = 8 * 1024 * 1024;
+
+	float halfSize = worldParams.numTilesX * worldParams.tileQuads * .5f;
+
+	std::vector<CameraPathFrame> paths[3];
+	MakeStraightReplayPath(halfSize, &paths[0]);
+	MakeZigzagReplayPath(halfSize, &paths[1]);
+	MakeRandomReplayPath(halfSize, 3600, &paths[2]);
+
+	const char *const names[] = {"straight", "zigzag", "random"};
+	std::string fileName = GetTestTempFileName("TerrainPrefetcherReplay.txt");
+
+	for (int i = 0; i < 3; ++i)
+	{
+		std::vector<CameraPathFrame> frames;
+		REQUIRE(SaveCameraPath(fileName.c_str(), paths[i]));
+		REQUIRE(LoadCameraPath(fileName.c_str(), &frames));
+		REQUIRE(frames.size() == paths[i].size());
+
+		TerrainPrefetcherStats stats;
+		REQUIRE(ReplayPrefetcher(names[i], frames, worldParams, &stats));
+
+		// Reads take no time here, so anything the world loads that
+		// wasn't asked for was a bad guess. Going straight, there are
+		// none.
+		if (i == 0)
+			CHECK(stats.numMisses == 0 && stats.numWaits == 0);
+	}
+
+	remove(fileName.c_str());
+
+	// The app's own world, 8x8 tiles.
+	std::vector<CameraPathFrame> recordedFrames;
+
+	if (LoadCameraPath(GetTestDataFileName("CameraPath.txt").c_str(), &recordedFrames) && !recordedFrames.empty())
+	{
+		worldParams.numTilesX = 8;
+		worldParams.numTilesZ = 8;
+
+		TerrainPrefetcherStats stats;
+		ReplayPrefetcher("CameraPath.txt", recordedFrames, worldParams, &stats);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
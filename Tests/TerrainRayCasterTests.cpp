@@ -0,0 +1,312 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "HeightField.h"
+#include "TerrainGrid.h"
+#include "TerrainRayCaster.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static float GetRandomFloat(float minValue, float maxValue)
+{
+	return minValue + (maxValue - minValue) * (rand() / float(RAND_MAX));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static TerrainRay MakeRay(float x, float y, float z, float dx, float dy, float dz, float maxT)
+{
+	TerrainRay ray = {{x, y, z}, {dx, dy, dz}, maxT};
+	return ray;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Random rays over and through the grid, some parallel to the axes.
+static void MakeRandomRays(std::vector<TerrainRay> *pRays, size_t numRays, float halfWidth, float halfLength)
+{
+	pRays->resize(numRays);
+
+	for (size_t i = 0; i < numRays; ++i)
+	{
+		TerrainRay *pRay = &(*pRays)[i];
+
+		*pRay = MakeRay(GetRandomFloat(-halfWidth * 1.2f, halfWidth * 1.2f), GetRandomFloat(-2.f, 25.f), GetRandomFloat(-halfLength * 1.2f, halfLength * 1.2f), GetRandomFloat(-1.f, 1.f), GetRandomFloat(-.6f, .2f), GetRandomFloat(-1.f, 1.f), 200.f);
+
+		if (i % 7 == 0)
+			pRay->dir[0] = 0.f;
+
+		if (i % 11 == 0)
+			pRay->dir[1] = 0.f;
+
+		if (i % 13 == 0)
+			pRay->dir[2] = 0.f;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainRayCasterHitsTheTriangles)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 40, 30, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	TerrainRayCaster rayCaster;
+	REQUIRE(rayCaster.Create(&heightField));
+
+	srand(5);
+
+	// Straight down, and straight up from underneath.
+	for (int i = 0; i < 500; ++i)
+	{
+		float x = GetRandomFloat(-19.f, 19.f);
+		float z = GetRandomFloat(-13.f, 13.f);
+		float height = GetTestTriangleHeight(&grid, x, z);
+
+		TerrainRayHit hit;
+
+		REQUIRE(rayCaster.CastRay(MakeRay(x, 50.f, z, 0.f, -2.f, 0.f, 100.f), &hit));
+		CHECK_CLOSE(hit.pos[1], height, 1e-3);
+		CHECK_CLOSE(hit.t, (50.f - height) / 2.f, 1e-3);
+		CHECK(hit.col == int(floorf(x - grid.GetOriginX())));
+		CHECK(hit.row == int(floorf(grid.GetOriginZ() - z)));
+
+		REQUIRE(rayCaster.CastRay(MakeRay(x, -10.f, z, 0.f, 1.f, 0.f, 100.f), &hit));
+		CHECK_CLOSE(hit.pos[1], height, 1e-3);
+	}
+
+	// Slanted rays end up on the surface.
+	std::vector<TerrainRay> rays;
+	MakeRandomRays(&rays, 2000, 20.f, 15.f);
+
+	size_t numHits = 0;
+
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		TerrainRayHit hit;
+
+		if (rayCaster.CastRay(rays[i], &hit))
+		{
+			++numHits;
+
+			CHECK(hit.t >= 0.f && hit.t <= rays[i].maxT);
+
+			if (!CHECK_CLOSE(hit.pos[1], GetTestTriangleHeight(&grid, hit.pos[0], hit.pos[2]), 1e-3))
+				break;
+		}
+	}
+
+	CHECK(numHits > rays.size() / 10);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainRayCasterMisses)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 40, 30, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	TerrainRayCaster rayCaster;
+	REQUIRE(rayCaster.Create(&heightField));
+
+	TerrainRayHit hit;
+
+	// Up, away, too short, level above everything, and past the side.
+	CHECK(!rayCaster.CastRay(MakeRay(0.f, 20.f, 0.f, 0.f, 1.f, 0.f, 100.f), &hit));
+	CHECK(!rayCaster.CastRay(MakeRay(0.f, 20.f, 0.f, .3f, .1f, -.2f, 100.f), &hit));
+	CHECK(!rayCaster.CastRay(MakeRay(0.f, 20.f, 0.f, 0.f, -1.f, 0.f, 5.f), &hit));
+	CHECK(!rayCaster.CastRay(MakeRay(-30.f, 11.f, 3.f, 1.f, 0.f, 0.f, 100.f), &hit));
+	CHECK(!rayCaster.CastRay(MakeRay(-30.f, 5.f, 40.f, 1.f, 0.f, 0.f, 100.f), &hit));
+
+	// Just long enough.
+	float height = GetTestTriangleHeight(&grid, 0.f, 0.f);
+	CHECK(rayCaster.CastRay(MakeRay(0.f, 20.f, 0.f, 0.f, -1.f, 0.f, 20.f - height + 1e-3f), &hit));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainRayCasterMatchesDDA)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 97, 45, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	TerrainRayCaster rayCaster;
+	REQUIRE(rayCaster.Create(&heightField));
+
+	srand(6);
+
+	std::vector<TerrainRay> rays;
+	MakeRandomRays(&rays, 5000, 48.f, 22.f);
+
+	size_t numHits = 0;
+
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		TerrainRayHit hit, ddaHit;
+
+		bool didHit = rayCaster.CastRay(rays[i], &hit);
+		bool ddaDidHit = rayCaster.CastRayDDA(rays[i], &ddaHit);
+
+		if (!CHECK(didHit == ddaDidHit))
+			break;
+
+		if (didHit)
+		{
+			++numHits;
+
+			if (!CHECK_CLOSE(hit.t, ddaHit.t, 1e-3 * fmax(1., hit.t)))
+				break;
+		}
+	}
+
+	CHECK(numHits > 0 && numHits < rays.size());
+
+	// And the threaded version matches too.
+	std::vector<TerrainRayHit> hits(rays.size());
+	std::unique_ptr<bool[]> didHits(new bool[rays.size()]);
+
+	bool *pDidHits = didHits.get();
+
+	CHECK(rayCaster.CastRays(&rays[0], rays.size(), &hits[0], pDidHits, 4) == numHits);
+
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		TerrainRayHit hit;
+
+		if (!CHECK(rayCaster.CastRay(rays[i], &hit) == pDidHits[i]))
+			break;
+
+		if (pDidHits[i] && !CHECK(hits[i].t == hit.t))
+			break;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainRayCasterUpdateRegion)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 70, 70, 1.f, &GetTestFlatHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	TerrainRayCaster rayCaster;
+	REQUIRE(rayCaster.Create(&heightField));
+
+	// A wall across the middle, after the pyramid was built.
+	std::vector<float> wall(3 * 70, 20.f);
+	heightField.SetGridHeights(0, 40, 69, 42, &wall[0]);
+	rayCaster.UpdateRegion(0, 40, 69, 42);
+
+	float wallZ = grid.GetOriginZ() - 40.f;
+
+	// A level ray along z towards the wall, from far enough away that
+	// only the upper levels of the pyramid cover it.
+	TerrainRayHit hit, ddaHit;
+	TerrainRay ray = MakeRay(5.f, 10.f, 30.f, 0.f, 0.f, -1.f, 100.f);
+
+	REQUIRE(rayCaster.CastRay(ray, &hit));
+	REQUIRE(rayCaster.CastRayDDA(ray, &ddaHit));
+	CHECK_CLOSE(hit.t, ddaHit.t, 1e-3);
+	CHECK(hit.pos[2] < wallZ + 1.f && hit.pos[2] > wallZ - 1e-3f);
+
+	// Flatten it again.
+	std::vector<float> flat(3 * 70, 0.f);
+	heightField.SetGridHeights(0, 40, 69, 42, &flat[0]);
+	rayCaster.UpdateRegion(0, 40, 69, 42);
+
+	CHECK(!rayCaster.CastRay(ray, &hit));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+// Long, shallow rays over a 1025x1025 grid, the kind that cross a lot
+// of it before they hit, cast through the pyramid and by DDA.
+TEST(TerrainRayCasterBenchmark)
+{
+	const size_t NUM_RAYS = 20000;
+
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 1025, 1025, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	TerrainRayCaster rayCaster;
+	REQUIRE(rayCaster.Create(&heightField));
+
+	srand(34);
+
+	std::vector<TerrainRay> rays(NUM_RAYS);
+
+	for (size_t i = 0; i < NUM_RAYS; ++i)
+		rays[i] = MakeRay(GetRandomFloat(-500.f, 500.f), GetRandomFloat(15.f, 40.f), GetRandomFloat(-500.f, 500.f), GetRandomFloat(-1.f, 1.f), GetRandomFloat(-.1f, .01f), GetRandomFloat(-1.f, 1.f), 2000.f);
+
+	std::vector<TerrainRayHit> hits(NUM_RAYS), ddaHits(NUM_RAYS);
+	std::unique_ptr<bool[]> didHits(new bool[NUM_RAYS]), ddaDidHits(new bool[NUM_RAYS]);
+
+	double seconds = DBL_MAX, ddaSeconds = DBL_MAX;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		for (size_t j = 0; j < NUM_RAYS; ++j)
+			didHits[j] = rayCaster.CastRay(rays[j], &hits[j]);
+
+		seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+		start = std::chrono::steady_clock::now();
+
+		for (size_t j = 0; j < NUM_RAYS; ++j)
+			ddaDidHits[j] = rayCaster.CastRayDDA(rays[j], &ddaHits[j]);
+
+		ddaSeconds = std::min(ddaSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	size_t numHits = 0, numDifferent = 0;
+
+	for (size_t i = 0; i < NUM_RAYS; ++i)
+	{
+		numHits += didHits[i] ? 1 : 0;
+
+		if (didHits[i] != ddaDidHits[i] || (didHits[i] && fabsf(hits[i].t - ddaHits[i].t) > 1e-3f * std::max(1.f, hits[i].t)))
+			++numDifferent;
+	}
+
+	printf("    %zu rays, %zu hits: pyramid %.2fM rays/s, DDA %.2fM rays/s, %.1fx\n",
+		NUM_RAYS, numHits, NUM_RAYS / seconds * 1e-6, NUM_RAYS / ddaSeconds * 1e-6, ddaSeconds / seconds);
+
+	CHECK(numHits > NUM_RAYS / 10 && numHits < NUM_RAYS);
+	CHECK(numDifferent == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
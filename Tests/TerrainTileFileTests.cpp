@@ -0,0 +1,423 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "HeightMapFile.h"
+#include "TerrainTileFile.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Hills, in 1/16 steps the way BMP height maps come out, so the
+// default params keep them exactly.
+static std::vector<float> MakeSteppedHeights(int width, int length)
+{
+	std::vector<float> heights(size_t(width) * length);
+
+	for (int row = 0; row < length; ++row)
+	{
+		for (int col = 0; col < width; ++col)
+			heights[size_t(row) * width + col] = floorf(GetTestHillsHeight(float(col), float(-row)) * 16.f) / 16.f;
+	}
+
+	return heights;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The height the file should have at (col, row) of a level, with the
+// edge repeated past the end of the map.
+static float GetLevelHeight(const std::vector<float> &heights, int width, int length, int level, int col, int row)
+{
+	int mapCol = std::min(col << level, width - 1);
+	int mapRow = std::min(row << level, length - 1);
+
+	return heights[size_t(mapRow) * width + mapCol];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The furthest any height is from what it should be, at any level.
+// Returns -1 if the file can't be read.
+static float GetWorstLevelError(const TerrainTileFile &file, const std::vector<float> &heights, int width, int length)
+{
+	float worstError = 0.f;
+
+	for (int level = 0; level < file.GetNumLevels(); ++level)
+	{
+		int levelWidth = file.GetLevelWidth(level);
+		int levelLength = file.GetLevelLength(level);
+
+		std::vector<float> levelHeights(size_t(levelWidth) * levelLength);
+		if (!file.ReadLevel(level, &levelHeights[0], 0))
+			return -1.f;
+
+		for (int row = 0; row < levelLength; ++row)
+		{
+			for (int col = 0; col < levelWidth; ++col)
+			{
+				float error = fabsf(levelHeights[size_t(row) * levelWidth + col] - GetLevelHeight(heights, width, length, level, col, row));
+				worstError = std::max(worstError, error);
+			}
+		}
+	}
+
+	return worstError;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainTileFileLossless)
+{
+	// Not a whole number of tiles either way.
+	const int WIDTH = 70, LENGTH = 45, TILE_QUADS = 16;
+
+	std::vector<float> heights = MakeSteppedHeights(WIDTH, LENGTH);
+	std::string fileName = GetTestTempFileName("Lossless.ttf");
+
+	TerrainTileFileParams params;
+	params.tileQuads = TILE_QUADS;
+
+	REQUIRE(SaveTerrainTileFile(fileName.c_str(), &heights[0], WIDTH, LENGTH, params));
+
+	TerrainTileFile file;
+	REQUIRE(file.Open(fileName.c_str()));
+
+	CHECK(file.GetWidth() == WIDTH && file.GetLength() == LENGTH);
+	CHECK(file.GetTileQuads() == TILE_QUADS);
+	CHECK(file.GetNumTilesX() == 5 && file.GetNumTilesZ() == 3);
+	CHECK(file.GetNumLevels() == 5);
+	CHECK(file.GetMaxError() == 0.f);
+
+	// Smaller than the raw 16-bit heights, even with the index.
+	CHECK(file.GetNumBytes() < size_t(WIDTH) * LENGTH * 2);
+
+	for (int level = 0; level < file.GetNumLevels(); ++level)
+	{
+		int numPoints = file.GetNumLevelPoints(level);
+		CHECK(numPoints == (TILE_QUADS >> level) + 1);
+
+		std::vector<float> tileHeights(size_t(numPoints) * numPoints);
+
+		for (int tileZ = 0; tileZ < file.GetNumTilesZ(); ++tileZ)
+		{
+			for (int tileX = 0; tileX < file.GetNumTilesX(); ++tileX)
+			{
+				REQUIRE(file.ReadTile(tileX, tileZ, level, &tileHeights[0]));
+				CHECK(file.GetTileNumBytes(tileX, tileZ, level) > 0);
+
+				int levelTileQuads = numPoints - 1;
+
+				for (int row = 0; row < numPoints; ++row)
+				{
+					for (int col = 0; col < numPoints; ++col)
+					{
+						float expected = GetLevelHeight(heights, WIDTH, LENGTH, level, tileX * levelTileQuads + col, tileZ * levelTileQuads + row);
+
+						if (!CHECK(tileHeights[size_t(row) * numPoints + col] == expected))
+							return;
+					}
+				}
+
+				// The bounds are those of the whole tile, at level 0.
+				if (level == 0)
+				{
+					float minHeight, maxHeight;
+					file.GetTileBounds(tileX, tileZ, &minHeight, &maxHeight);
+
+					CHECK(minHeight == *std::min_element(tileHeights.begin(), tileHeights.end()));
+					CHECK(maxHeight == *std::max_element(tileHeights.begin(), tileHeights.end()));
+				}
+			}
+		}
+
+		// The whole level, on 1 thread or several, is the same as reading
+		// the tiles.
+		int levelWidth = file.GetLevelWidth(level);
+		int levelLength = file.GetLevelLength(level);
+		CHECK(levelWidth == ((WIDTH - 1) >> level) + 1 && levelLength == ((LENGTH - 1) >> level) + 1);
+
+		std::vector<float> levelHeights(size_t(levelWidth) * levelLength, -1.f);
+		std::vector<float> threadedLevelHeights(levelHeights.size(), -1.f);
+
+		REQUIRE(file.ReadLevel(level, &levelHeights[0], 1));
+		REQUIRE(file.ReadLevel(level, &threadedLevelHeights[0], 4));
+		CHECK(levelHeights == threadedLevelHeights);
+
+		for (int row = 0; row < levelLength; ++row)
+		{
+			for (int col = 0; col < levelWidth; ++col)
+			{
+				if (!CHECK(levelHeights[size_t(row) * levelWidth + col] == GetLevelHeight(heights, WIDTH, LENGTH, level, col, row)))
+					return;
+			}
+		}
+	}
+
+	// Off the map, or past the last level.
+	std::vector<float> tileHeights((TILE_QUADS + 1) * (TILE_QUADS + 1));
+	CHECK(!file.ReadTile(5, 0, 0, &tileHeights[0]));
+	CHECK(!file.ReadTile(0, -1, 0, &tileHeights[0]));
+	CHECK(!file.ReadTile(0, 0, 5, &tileHeights[0]));
+
+	file.Close();
+	remove(fileName.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainTileFileLossy)
+{
+	const int WIDTH = 129, LENGTH = 97, TILE_QUADS = 32;
+
+	// Hills with a bit of noise, nowhere near the steps.
+	std::vector<float> heights(size_t(WIDTH) * LENGTH);
+
+	srand(21);
+
+	for (int row = 0; row < LENGTH; ++row)
+	{
+		for (int col = 0; col < WIDTH; ++col)
+			heights[size_t(row) * WIDTH + col] = 100.f + 20.f * GetTestHillsHeight(float(col), float(-row)) + rand() / float(RAND_MAX) * .3f;
+	}
+
+	std::string fileName = GetTestTempFileName("Lossy.ttf");
+	std::string finerFileName = GetTestTempFileName("LossyFiner.ttf");
+
+	TerrainTileFileParams params;
+	params.tileQuads = TILE_QUADS;
+
+	const float maxErrors[] = {.25f, .01f};
+	size_t numBytes[2];
+
+	for (int i = 0; i < 2; ++i)
+	{
+		params.maxError = maxErrors[i];
+
+		const std::string &name = i == 0 ? fileName : finerFileName;
+		REQUIRE(SaveTerrainTileFile(name.c_str(), &heights[0], WIDTH, LENGTH, params));
+
+		TerrainTileFile file;
+		REQUIRE(file.Open(name.c_str()));
+		CHECK(file.GetMaxError() == maxErrors[i]);
+
+		// Within the limit at every level, but using most of it.
+		float worstError = GetWorstLevelError(file, heights, WIDTH, LENGTH);
+		REQUIRE(worstError >= 0.f);
+
+		CHECK(worstError <= maxErrors[i]);
+		CHECK(worstError > maxErrors[i] * .5f);
+
+		numBytes[i] = file.GetNumBytes();
+	}
+
+	// Coarser steps pack smaller.
+	CHECK(numBytes[0] < numBytes[1]);
+
+	// Too fine a step for the heights' range doesn't fit in 16 bits.
+	params.maxError = 1e-4f;
+	CHECK(!SaveTerrainTileFile(fileName.c_str(), &heights[0], WIDTH, LENGTH, params));
+
+	remove(fileName.c_str());
+	remove(finerFileName.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Every sample map, with its heights as HeightMapApplication has them,
+// packed losslessly, then to within 5cm and to within a quarter. Each
+// is checked at every level, and their sizes printed.
+TEST(TerrainTileFileLossySampleMaps)
+{
+	const char *const fileNames[] = {"Heightmap.bmp", "Heightmap2.bmp", "hMapTiny.bmp", "HillMap.bmp"};
+	const float maxErrors[] = {.05f, .25f};
+
+	std::string tileFileName = GetTestTempFileName("SampleMap.ttf");
+	int numMaps = 0;
+
+	for (size_t i = 0; i < sizeof fileNames / sizeof fileNames[0]; ++i)
+	{
+		std::vector<uint8_t> values;
+		int width, length;
+
+		// Not every map is a BMP, whatever its name says.
+		if (!LoadHeightMapBMP(GetTestDataFileName(fileNames[i]).c_str(), &values, &width, &length))
+		{
+			printf("    %s: skipped, it isn't a BMP height map\n", fileNames[i]);
+			continue;
+		}
+
+		++numMaps;
+
+		std::vector<float> heights(values.size());
+		for (size_t j = 0; j < values.size(); ++j)
+			heights[j] = values[j] / 16.f;
+
+		TerrainTileFileParams params;
+		params.tileQuads = 32;
+
+		REQUIRE(SaveTerrainTileFile(tileFileName.c_str(), &heights[0], width, length, params));
+
+		TerrainTileFile file;
+		REQUIRE(file.Open(tileFileName.c_str()));
+		CHECK(GetWorstLevelError(file, heights, width, length) == 0.f);
+
+		size_t losslessNumBytes = file.GetNumBytes();
+		file.Close();
+
+		printf("    %s, %dx%d: lossless %zu bytes", fileNames[i], width, length, losslessNumBytes);
+
+		for (size_t j = 0; j < sizeof maxErrors / sizeof maxErrors[0]; ++j)
+		{
+			params.maxError = maxErrors[j];
+			REQUIRE(SaveTerrainTileFile(tileFileName.c_str(), &heights[0], width, length, params));
+			REQUIRE(file.Open(tileFileName.c_str()));
+
+			float worstError = GetWorstLevelError(file, heights, width, length);
+			REQUIRE(worstError >= 0.f);
+
+			if (!CHECK(worstError <= maxErrors[j]))
+				printf("    (%s is %g out, at most %g)\n", fileNames[i], worstError, maxErrors[j]);
+
+			// The 1/16 steps are finer than either limit needs.
+			CHECK(file.GetNumBytes() <= losslessNumBytes);
+
+			printf(", within %g %zu bytes (%.2fx)", maxErrors[j], file.GetNumBytes(), double(losslessNumBytes) / file.GetNumBytes());
+			file.Close();
+		}
+
+		printf("\n");
+	}
+
+	CHECK(numMaps >= 3);
+
+	remove(tileFileName.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainTileFileBadFiles)
+{
+	std::vector<float> heights = MakeSteppedHeights(40, 40);
+	std::string fileName = GetTestTempFileName("Good.ttf");
+	std::string damagedFileName = GetTestTempFileName("Damaged.ttf");
+
+	TerrainTileFileParams params;
+
+	// Tiles have to be a power of 2.
+	params.tileQuads = 24;
+	CHECK(!SaveTerrainTileFile(fileName.c_str(), &heights[0], 40, 40, params));
+
+	params.tileQuads = 16;
+	REQUIRE(SaveTerrainTileFile(fileName.c_str(), &heights[0], 40, 40, params));
+
+	TerrainTileFile file;
+	CHECK(!file.Open(GetTestTempFileName("Missing.ttf").c_str()));
+
+	std::vector<char> good;
+	REQUIRE(ReadTestFile(fileName, &good));
+
+	// Cut short anywhere in the header or index, it won't open.
+	for (size_t size = 0; size < 36 + 9 * (4 + 5 * 12); size += 7)
+	{
+		REQUIRE(WriteTestFile(damagedFileName, std::vector<char>(good.begin(), good.begin() + size)));
+
+		if (!CHECK(!file.Open(damagedFileName.c_str())))
+			break;
+	}
+
+	// Nor with the wrong magic.
+	std::vector<char> damaged = good;
+	damaged[0] = 'X';
+	REQUIRE(WriteTestFile(damagedFileName, damaged));
+	CHECK(!file.Open(damagedFileName.c_str()));
+
+	// Cut short in the tiles, the index points past the end.
+	REQUIRE(WriteTestFile(damagedFileName, std::vector<char>(good.begin(), good.end() - 1)));
+	CHECK(!file.Open(damagedFileName.c_str()));
+
+	// With a bad group width at the start of the first tile, that tile
+	// can't be read, but the rest can.
+	damaged = good;
+	damaged[36 + 9 * (4 + 5 * 12)] = char(0x7f);
+	REQUIRE(WriteTestFile(damagedFileName, damaged));
+	REQUIRE(file.Open(damagedFileName.c_str()));
+
+	std::vector<float> tileHeights(17 * 17);
+	CHECK(!file.ReadTile(0, 0, 0, &tileHeights[0]));
+	CHECK(file.ReadTile(0, 0, 1, &tileHeights[0]));
+	CHECK(file.ReadTile(1, 0, 0, &tileHeights[0]));
+
+	std::vector<float> levelHeights(40 * 40);
+	CHECK(!file.ReadLevel(0, &levelHeights[0], 2));
+
+	file.Close();
+	remove(fileName.c_str());
+	remove(damagedFileName.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Decoded GB a second for the whole of a 2049x2049 map, the size of a
+// 16x16 tile world, read with ReadLevel on one thread and on every
+// hardware thread. The file's just been written, so it's in the OS's
+// cache, and this is mostly unpacking.
+TEST(TerrainTileFileBenchmark)
+{
+	const int SIZE = 2049, NUM_RUNS = 3;
+
+	std::vector<float> heights = MakeSteppedHeights(SIZE, SIZE);
+	std::string fileName = GetTestTempFileName("Benchmark.ttf");
+
+	REQUIRE(SaveTerrainTileFile(fileName.c_str(), &heights[0], SIZE, SIZE, TerrainTileFileParams()));
+
+	TerrainTileFile file;
+	REQUIRE(file.Open(fileName.c_str()));
+
+	unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	const unsigned threadCounts[] = {1, numThreads};
+
+	std::vector<float> readHeights(heights.size());
+	double numDecodedBytes = double(heights.size()) * sizeof(float);
+
+	printf("    %dx%d, %.1f MB packed, %.2f bits a height\n", SIZE, SIZE, file.GetNumBytes() / (1024. * 1024.), file.GetNumBytes() * 8. / heights.size());
+
+	for (int i = 0; i < (numThreads > 1 ? 2 : 1); ++i)
+	{
+		double bestSeconds = DBL_MAX;
+
+		for (int run = 0; run < NUM_RUNS; ++run)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			REQUIRE(file.ReadLevel(0, &readHeights[0], threadCounts[i]));
+			bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+
+		CHECK(readHeights == heights);
+
+		printf("    %u thread%s: %.2f GB/s of heights (%.2fms, %.0f MB/s packed)\n", threadCounts[i], threadCounts[i] == 1 ? "" : "s",
+			numDecodedBytes / bestSeconds * 1e-9, bestSeconds * 1000., file.GetNumBytes() / bestSeconds / (1024. * 1024.));
+	}
+
+	file.Close();
+	remove(fileName.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
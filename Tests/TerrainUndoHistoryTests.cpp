@@ -0,0 +1,309 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "HeightField.h"
+#include "TerrainGrid.h"
+#include "TerrainUndoHistory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static std::vector<float> GetHeights(const HeightField &heightField)
+{
+	const float *pHeights = heightField.GetGridHeights();
+	return std::vector<float>(pHeights, pHeights + size_t(heightField.GetWidth()) * heightField.GetLength());
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Saves the rectangle, then fills it with one height.
+static void EditRect(HeightField *pHeightField, TerrainUndoHistory *pHistory, int minCol, int minRow, int maxCol, int maxRow, float height)
+{
+	pHistory->SaveRegion(minCol, minRow, maxCol, maxRow);
+
+	std::vector<float> heights(size_t(maxCol - minCol + 1) * (maxRow - minRow + 1), height);
+	pHeightField->SetGridHeights(minCol, minRow, maxCol, maxRow, &heights[0]);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Checks that the changed rectangles are whole tiles, and cover
+// everything that's different between before and after.
+static bool CheckChangedRects(const TerrainUndoHistory &history, const std::vector<float> &before, const std::vector<float> &after, int width, int length, int tileSize)
+{
+	std::vector<bool> covered(before.size(), false);
+
+	for (size_t i = 0; i < history.GetNumChangedRects(); ++i)
+	{
+		int minCol, minRow, maxCol, maxRow;
+		history.GetChangedRect(i, &minCol, &minRow, &maxCol, &maxRow);
+
+		if (!CHECK(minCol % tileSize == 0 && minRow % tileSize == 0))
+			return false;
+
+		if (!CHECK(maxCol == std::min(minCol + tileSize, width) - 1 && maxRow == std::min(minRow + tileSize, length) - 1))
+			return false;
+
+		for (int row = minRow; row <= maxRow; ++row)
+		{
+			for (int col = minCol; col <= maxCol; ++col)
+				covered[size_t(row) * width + col] = true;
+		}
+	}
+
+	for (size_t i = 0; i < before.size(); ++i)
+	{
+		if (before[i] != after[i] && !CHECK(covered[i]))
+			return false;
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainUndoHistoryMatchesSnapshots)
+{
+	// Not a whole number of tiles either way.
+	const int WIDTH = 50, LENGTH = 37, TILE_SIZE = 8;
+
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, WIDTH, LENGTH, 1.f, &GetTestHillsHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	TerrainUndoHistory history;
+	REQUIRE(history.Create(&heightField, TILE_SIZE, 1000, 64 * 1024 * 1024));
+
+	srand(13);
+
+	// snapshots[i] is the heights after i steps.
+	std::vector<std::vector<float> > snapshots(1, GetHeights(heightField));
+	size_t numDone = 0;
+
+	for (int i = 0; i < 400; ++i)
+	{
+		int action = rand() % 4;
+
+		if (action < 2)
+		{
+			// A step of a few edits, like a brush stroke.
+			history.BeginStep();
+
+			int numEdits = 1 + rand() % 4;
+
+			for (int j = 0; j < numEdits; ++j)
+			{
+				int minCol = rand() % WIDTH;
+				int minRow = rand() % LENGTH;
+				int maxCol = std::min(minCol + rand() % 12, WIDTH - 1);
+				int maxRow = std::min(minRow + rand() % 12, LENGTH - 1);
+
+				EditRect(&heightField, &history, minCol, minRow, maxCol, maxRow, float(rand() % 100));
+			}
+
+			history.EndStep();
+
+			// Anything that could have been redone is gone.
+			snapshots.resize(++numDone);
+			snapshots.push_back(GetHeights(heightField));
+
+			CHECK(history.GetNumRedoSteps() == 0);
+		}
+		else if (action == 2)
+		{
+			std::vector<float> before = GetHeights(heightField);
+
+			if (!CHECK(history.Undo() == (numDone > 0)))
+				break;
+
+			if (numDone > 0)
+			{
+				--numDone;
+
+				if (!CheckChangedRects(history, before, snapshots[numDone], WIDTH, LENGTH, TILE_SIZE))
+					break;
+			}
+		}
+		else
+		{
+			std::vector<float> before = GetHeights(heightField);
+
+			if (!CHECK(history.Redo() == (numDone + 1 < snapshots.size())))
+				break;
+
+			if (numDone + 1 < snapshots.size())
+			{
+				++numDone;
+
+				if (!CheckChangedRects(history, before, snapshots[numDone], WIDTH, LENGTH, TILE_SIZE))
+					break;
+			}
+		}
+
+		if (!CHECK(GetHeights(heightField) == snapshots[numDone]))
+		{
+			printf("    (after action %d)\n", i);
+			break;
+		}
+
+		if (!CHECK(history.GetNumUndoSteps() == numDone && history.GetNumRedoSteps() == snapshots.size() - 1 - numDone))
+			break;
+	}
+
+	// All the way back to the start, and forward again.
+	while (history.Undo())
+		;
+
+	CHECK(GetHeights(heightField) == snapshots[0]);
+
+	while (history.Redo())
+		;
+
+	CHECK(GetHeights(heightField) == snapshots.back());
+
+	history.Destroy();
+	CHECK(history.GetNumBytes() == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainUndoHistorySteps)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 32, 32, 1.f, &GetTestFlatHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	TerrainUndoHistory history;
+	CHECK(!history.Create(&heightField, 0, 10, 1000));
+	CHECK(!history.Create(&heightField, 8, 0, 1000));
+	REQUIRE(history.Create(&heightField, 8, 10, 1024 * 1024));
+
+	// Nothing to undo yet, and edits outside a step aren't saved.
+	CHECK(!history.Undo() && !history.Redo());
+	history.SaveRegion(0, 0, 5, 5);
+	CHECK(history.GetNumBytes() == 0);
+
+	// A step that saves nothing is dropped.
+	history.BeginStep();
+	history.EndStep();
+	CHECK(history.GetNumUndoSteps() == 0);
+
+	// Saving the same tile twice in a step only copies it once, and
+	// off the grid is clipped.
+	history.BeginStep();
+	EditRect(&heightField, &history, 1, 1, 3, 3, 1.f);
+	EditRect(&heightField, &history, 4, 4, 6, 6, 2.f);
+	history.SaveRegion(-10, -10, 2, 2);
+	history.SaveRegion(40, 40, 50, 50);
+
+	// No undoing in the middle of a step.
+	CHECK(!history.Undo());
+
+	history.EndStep();
+	REQUIRE(history.GetNumUndoSteps() == 1);
+
+	// A before and an after of one 8x8 tile.
+	size_t oneTileBytes = history.GetNumBytes() / 2;
+	CHECK(history.GetNumBytes() == oneTileBytes * 2);
+	CHECK(oneTileBytes >= 64 * sizeof(float) && oneTileBytes < 64 * sizeof(float) + 256);
+
+	// Changing it again shares the copy in between.
+	history.BeginStep();
+	EditRect(&heightField, &history, 0, 0, 0, 0, 3.f);
+	history.EndStep();
+	CHECK(history.GetNumBytes() == oneTileBytes * 3);
+
+	// Undo puts back the one tile.
+	REQUIRE(history.Undo());
+	REQUIRE(history.GetNumChangedRects() == 1);
+
+	int minCol, minRow, maxCol, maxRow;
+	history.GetChangedRect(0, &minCol, &minRow, &maxCol, &maxRow);
+	CHECK(minCol == 0 && minRow == 0 && maxCol == 7 && maxRow == 7);
+
+	const float *pHeights = heightField.GetGridHeights();
+	CHECK(pHeights[0] == 0.f && pHeights[32 + 1] == 1.f && pHeights[5 * 32 + 5] == 2.f);
+
+	// A new step forgets the redo, and the copy only it used.
+	history.BeginStep();
+	EditRect(&heightField, &history, 20, 20, 20, 20, 4.f);
+	history.EndStep();
+	CHECK(history.GetNumRedoSteps() == 0);
+	CHECK(history.GetNumBytes() == oneTileBytes * 4);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainUndoHistoryLimits)
+{
+	TerrainGrid grid;
+	REQUIRE(MakeTestGrid(&grid, 32, 32, 1.f, &GetTestFlatHeight));
+
+	HeightField heightField;
+	REQUIRE(heightField.Create(&grid));
+
+	// At most 3 steps.
+	TerrainUndoHistory history;
+	REQUIRE(history.Create(&heightField, 8, 3, 1024 * 1024));
+
+	for (int i = 0; i < 5; ++i)
+	{
+		history.BeginStep();
+		EditRect(&heightField, &history, i * 6, 0, i * 6, 0, float(i + 1));
+		history.EndStep();
+	}
+
+	CHECK(history.GetNumUndoSteps() == 3);
+
+	const float *pHeights = heightField.GetGridHeights();
+
+	for (int i = 0; i < 3; ++i)
+		CHECK(history.Undo());
+
+	CHECK(!history.Undo());
+
+	// The first 2 edits stay.
+	CHECK(pHeights[0] == 1.f && pHeights[6] == 2.f && pHeights[12] == 0.f && pHeights[18] == 0.f && pHeights[24] == 0.f);
+
+	// Too little memory for more than the newest step, which is kept
+	// anyway.
+	REQUIRE(history.Create(&heightField, 8, 100, 1));
+
+	for (int i = 0; i < 3; ++i)
+	{
+		history.BeginStep();
+		EditRect(&heightField, &history, 0, 0, 31, 31, float(10 + i));
+		history.EndStep();
+
+		CHECK(history.GetNumUndoSteps() == 1);
+	}
+
+	// 16 tiles, before and after.
+	size_t numBytes = history.GetNumBytes();
+	CHECK(numBytes >= 2 * 32 * 32 * sizeof(float) && numBytes < 2 * (32 * 32 * sizeof(float) + 16 * 256));
+
+	REQUIRE(history.Undo());
+	CHECK(pHeights[0] == 11.f && pHeights[32 * 32 - 1] == 11.f);
+	CHECK(!history.Undo());
+
+	REQUIRE(history.Redo());
+	CHECK(pHeights[0] == 12.f);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
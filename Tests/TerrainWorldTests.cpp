@@ -0,0 +1,426 @@
+#include "Test.h"
+#include "TestTerrain.h"
+
+#include "TerrainGrid.h"
+#include "TerrainWorld.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Hills that run on from tile to tile, but with each tile raised by
+// a different amount, so none of the edges match until they're
+// stitched.
+static float GetRawHeight(int tileX, int tileZ, int tileQuads, int col, int row)
+{
+	float worldCol = float(tileX * tileQuads + col);
+	float worldRow = float(tileZ * tileQuads + row);
+
+	return GetTestHillsHeight(worldCol, -worldRow) + tileX * 1.5f - tileZ * .75f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TestWorldSource
+{
+	int tileQuads;
+
+	// -1 if every tile's there.
+	int missingTileX;
+	int missingTileZ;
+
+	int numLoads;
+
+	bool Load(int tileX, int tileZ, int numPoints, float *pHeights)
+	{
+		++numLoads;
+
+		if (tileX == missingTileX && tileZ == missingTileZ)
+			return false;
+
+		for (int row = 0; row < numPoints; ++row)
+		{
+			for (int col = 0; col < numPoints; ++col)
+				pHeights[row * numPoints + col] = GetRawHeight(tileX, tileZ, tileQuads, col, row);
+		}
+
+		return true;
+	}
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static TestWorldSource MakeSource(int tileQuads, int missingTileX, int missingTileZ)
+{
+	TestWorldSource source = {tileQuads, missingTileX, missingTileZ, 0};
+	return source;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static TerrainWorldLoadFn MakeLoadFn(TestWorldSource *pSource)
+{
+	return [pSource](int tileX, int tileZ, int numPoints, float *pHeights) {
+		return pSource->Load(tileX, tileZ, numPoints, pHeights);
+	};
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static TerrainWorldParams MakeParams(int numTilesX, int numTilesZ, int tileQuads, float loadRadius, float unloadRadius)
+{
+	TerrainWorldParams params;
+
+	params.numTilesX = numTilesX;
+	params.numTilesZ = numTilesZ;
+	params.tileQuads = tileQuads;
+	params.stitchMargin = 4;
+	params.loadRadius = loadRadius;
+	params.unloadRadius = unloadRadius;
+	params.maxLoadsPerUpdate = numTilesX * numTilesZ;
+
+	return params;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Whether the tile's within radius of the camera, as TerrainWorld
+// works it out.
+static bool IsTileInRadius(int tileX, int tileZ, int tileQuads, float cameraCol, float cameraRow, float radius)
+{
+	float minCol = float(tileX * tileQuads);
+	float minRow = float(tileZ * tileQuads);
+
+	float dx = std::max(std::max(minCol - cameraCol, cameraCol - (minCol + tileQuads)), 0.f);
+	float dz = std::max(std::max(minRow - cameraRow, cameraRow - (minRow + tileQuads)), 0.f);
+
+	return sqrtf(dx * dx + dz * dz) <= radius;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainWorldStitching)
+{
+	const int NUM_TILES_X = 4, NUM_TILES_Z = 3, TILE_QUADS = 16, NUM_POINTS = TILE_QUADS + 1;
+
+	TestWorldSource source = MakeSource(TILE_QUADS, -1, -1);
+
+	TerrainWorld world;
+	REQUIRE(world.Create(MakeParams(NUM_TILES_X, NUM_TILES_Z, TILE_QUADS, 1000.f, 1000.f), MakeLoadFn(&source)));
+	CHECK(world.GetNumTilePoints() == NUM_POINTS);
+
+	world.Update(32.f, 24.f);
+	REQUIRE(world.GetNumLoadedTiles() == NUM_TILES_X * NUM_TILES_Z);
+	CHECK(world.GetNumJustLoadedTiles() == NUM_TILES_X * NUM_TILES_Z);
+	CHECK(world.GetNumBytes() == NUM_TILES_X * NUM_TILES_Z * NUM_POINTS * NUM_POINTS * 4 * sizeof(float));
+
+	// Each tile's loaded once, neighbours' edges and all.
+	CHECK(source.numLoads == NUM_TILES_X * NUM_TILES_Z);
+
+	// The whole world in one grid, for the normals to be worked out the
+	// usual way.
+	const int WORLD_WIDTH = NUM_TILES_X * TILE_QUADS + 1, WORLD_LENGTH = NUM_TILES_Z * TILE_QUADS + 1;
+	std::vector<float> worldHeights(size_t(WORLD_WIDTH) * WORLD_LENGTH);
+
+	for (int tileZ = 0; tileZ < NUM_TILES_Z; ++tileZ)
+	{
+		for (int tileX = 0; tileX < NUM_TILES_X; ++tileX)
+		{
+			const float *pHeights = world.GetTileHeights(tileX, tileZ);
+			REQUIRE(pHeights);
+
+			for (int row = 0; row < NUM_POINTS; ++row)
+			{
+				for (int col = 0; col < NUM_POINTS; ++col)
+				{
+					float height = pHeights[row * NUM_POINTS + col];
+					float rawHeight = GetRawHeight(tileX, tileZ, TILE_QUADS, col, row);
+
+					size_t worldIndex = size_t(tileZ * TILE_QUADS + row) * WORLD_WIDTH + tileX * TILE_QUADS + col;
+
+					// Shared points come out the same, bit for bit, whichever
+					// tile they're from.
+					if ((tileX > 0 && col == 0) || (tileZ > 0 && row == 0))
+					{
+						if (!CHECK(height == worldHeights[worldIndex]))
+							return;
+					}
+
+					worldHeights[worldIndex] = height;
+
+					int edgeDistance = std::min(std::min(col, TILE_QUADS - col), std::min(row, TILE_QUADS - row));
+
+					// Past the margin, the raw heights are left alone.
+					if (edgeDistance >= 4 && !CHECK(height == rawHeight))
+						return;
+				}
+			}
+
+			// A shared edge, away from the corners, is the average of the 2
+			// tiles' raw heights.
+			if (tileX > 0)
+			{
+				float expected = (GetRawHeight(tileX - 1, tileZ, TILE_QUADS, TILE_QUADS, 5) + GetRawHeight(tileX, tileZ, TILE_QUADS, 0, 5)) * .5f;
+				CHECK(pHeights[5 * NUM_POINTS] == expected);
+			}
+
+			// A corner 4 tiles share is the average of all 4.
+			if (tileX > 0 && tileZ > 0)
+			{
+				float expected = (GetRawHeight(tileX - 1, tileZ - 1, TILE_QUADS, TILE_QUADS, TILE_QUADS) + GetRawHeight(tileX, tileZ - 1, TILE_QUADS, 0, TILE_QUADS) + GetRawHeight(tileX - 1, tileZ, TILE_QUADS, TILE_QUADS, 0) + GetRawHeight(tileX, tileZ, TILE_QUADS, 0, 0)) * .25f;
+				CHECK_CLOSE(pHeights[0], expected, 1e-5);
+			}
+		}
+	}
+
+	TerrainGrid grid;
+	REQUIRE(grid.Create(WORLD_WIDTH, WORLD_LENGTH, 0.f, 0.f, 1.f, -1.f));
+	grid.SetHeights(0, 0, WORLD_WIDTH - 1, WORLD_LENGTH - 1, &worldHeights[0], WORLD_WIDTH);
+	grid.CalculateNormals(0, 0, WORLD_WIDTH - 1, WORLD_LENGTH - 1);
+
+	// Every tile's normals, seams included, are the same as the whole
+	// world's.
+	for (int tileZ = 0; tileZ < NUM_TILES_Z; ++tileZ)
+	{
+		for (int tileX = 0; tileX < NUM_TILES_X; ++tileX)
+		{
+			const float *pNormals = world.GetTileNormals(tileX, tileZ);
+			REQUIRE(pNormals);
+
+			for (int row = 0; row < NUM_POINTS; ++row)
+			{
+				for (int col = 0; col < NUM_POINTS; ++col)
+				{
+					size_t point = size_t(row) * NUM_POINTS + col;
+					size_t gridPoint = size_t(tileZ * TILE_QUADS + row) * grid.GetPitch() + tileX * TILE_QUADS + col;
+
+					if (!CHECK_CLOSE(pNormals[point], grid.GetNormalsX()[gridPoint], 1e-5))
+						return;
+
+					if (!CHECK_CLOSE(pNormals[NUM_POINTS * NUM_POINTS + point], grid.GetNormalsY()[gridPoint], 1e-5))
+						return;
+
+					if (!CHECK_CLOSE(pNormals[NUM_POINTS * NUM_POINTS * 2 + point], grid.GetNormalsZ()[gridPoint], 1e-5))
+						return;
+				}
+			}
+		}
+	}
+
+	// GetHeight is bilinear between grid points, and the far edge of the
+	// world belongs to the last tile.
+	float height;
+	REQUIRE(world.GetHeight(20.f, 7.f, &height));
+	CHECK(height == worldHeights[7 * WORLD_WIDTH + 20]);
+
+	REQUIRE(world.GetHeight(20.5f, 7.25f, &height));
+	float top = (worldHeights[7 * WORLD_WIDTH + 20] + worldHeights[7 * WORLD_WIDTH + 21]) * .5f;
+	float bottom = (worldHeights[8 * WORLD_WIDTH + 20] + worldHeights[8 * WORLD_WIDTH + 21]) * .5f;
+	CHECK_CLOSE(height, top + (bottom - top) * .25f, 1e-5);
+
+	REQUIRE(world.GetHeight(float(WORLD_WIDTH - 1), float(WORLD_LENGTH - 1), &height));
+	CHECK(height == worldHeights.back());
+
+	CHECK(!world.GetHeight(-.5f, 3.f, &height));
+	CHECK(!world.GetHeight(3.f, float(WORLD_LENGTH), &height));
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainWorldOrderDoesntMatter)
+{
+	const int NUM_TILES_X = 6, NUM_TILES_Z = 5, TILE_QUADS = 8, NUM_POINTS = TILE_QUADS + 1;
+
+	TestWorldSource allSource = MakeSource(TILE_QUADS, -1, -1);
+
+	TerrainWorld allWorld;
+	REQUIRE(allWorld.Create(MakeParams(NUM_TILES_X, NUM_TILES_Z, TILE_QUADS, 1000.f, 1000.f), MakeLoadFn(&allSource)));
+	allWorld.Update(0.f, 0.f);
+	REQUIRE(allWorld.GetNumLoadedTiles() == NUM_TILES_X * NUM_TILES_Z);
+
+	// A camera wandering about, loading a tile at a time and unloading
+	// them behind it.
+	TerrainWorldParams params = MakeParams(NUM_TILES_X, NUM_TILES_Z, TILE_QUADS, 6.f, 10.f);
+	params.maxLoadsPerUpdate = 1;
+
+	TestWorldSource source = MakeSource(TILE_QUADS, -1, -1);
+
+	TerrainWorld world;
+	REQUIRE(world.Create(params, MakeLoadFn(&source)));
+
+	const float path[][2] = {{44.f, 36.f}, {4.f, 36.f}, {4.f, 4.f}, {44.f, 4.f}, {24.f, 20.f}};
+
+	float col = 24.f, row = 20.f;
+	size_t numLoaded = 0, numUnloaded = 0;
+
+	for (size_t i = 0; i < sizeof path / sizeof path[0]; ++i)
+	{
+		for (int step = 0; step < 40; ++step)
+		{
+			col += (path[i][0] - col) * .1f;
+			row += (path[i][1] - row) * .1f;
+
+			world.Update(col, row);
+
+			for (size_t j = 0; j < world.GetNumJustLoadedTiles(); ++j)
+			{
+				int tileX, tileZ;
+				world.GetJustLoadedTile(j, &tileX, &tileZ);
+
+				const float *pHeights = world.GetTileHeights(tileX, tileZ);
+				const float *pAllHeights = allWorld.GetTileHeights(tileX, tileZ);
+				REQUIRE(pHeights && pAllHeights);
+
+				// Stitched the same, bit for bit, whatever's loaded around it.
+				if (!CHECK(std::equal(pHeights, pHeights + NUM_POINTS * NUM_POINTS, pAllHeights)))
+					return;
+
+				++numLoaded;
+			}
+
+			numUnloaded += world.GetNumJustUnloadedTiles();
+
+			for (size_t j = 0; j < world.GetNumJustUnloadedTiles(); ++j)
+			{
+				int tileX, tileZ;
+				world.GetJustUnloadedTile(j, &tileX, &tileZ);
+
+				CHECK(!world.IsTileLoaded(tileX, tileZ) && world.IsTileKnown(tileX, tileZ));
+				CHECK(world.GetTileHeights(tileX, tileZ) == NULL);
+				CHECK(!IsTileInRadius(tileX, tileZ, TILE_QUADS, col, row, params.unloadRadius));
+			}
+
+			// Nothing's left loaded beyond the unload radius.
+			for (int tileZ = 0; tileZ < NUM_TILES_Z; ++tileZ)
+			{
+				for (int tileX = 0; tileX < NUM_TILES_X; ++tileX)
+				{
+					if (world.IsTileLoaded(tileX, tileZ) && !CHECK(IsTileInRadius(tileX, tileZ, TILE_QUADS, col, row, params.unloadRadius)))
+						return;
+				}
+			}
+		}
+	}
+
+	CHECK(numLoaded > size_t(NUM_TILES_X * NUM_TILES_Z));
+	CHECK(numUnloaded > 0);
+	CHECK(world.GetNumLoadedTiles() == numLoaded - numUnloaded);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(TerrainWorldStreaming)
+{
+	const int TILE_QUADS = 8, NUM_POINTS = TILE_QUADS + 1;
+	const size_t TILE_NUM_BYTES = NUM_POINTS * NUM_POINTS * 4 * sizeof(float);
+
+	TestWorldSource source = MakeSource(TILE_QUADS, 2, 1);
+
+	TerrainWorld world;
+	CHECK(!world.Create(MakeParams(0, 3, TILE_QUADS, 4.f, 6.f), MakeLoadFn(&source)));
+	CHECK(!world.Create(MakeParams(4, 3, TILE_QUADS, 4.f, 6.f), TerrainWorldLoadFn()));
+
+	// Just the tile the camera's on, and the 4 around it.
+	REQUIRE(world.Create(MakeParams(4, 3, TILE_QUADS, 4.f, 6.f), MakeLoadFn(&source)));
+
+	world.Update(12.f, 12.f);
+	CHECK(world.GetNumLoadedTiles() == 4);
+	CHECK(world.IsTileLoaded(1, 1) && world.IsTileLoaded(0, 1) && world.IsTileLoaded(1, 0) && world.IsTileLoaded(1, 2));
+
+	// The one to the right isn't there, so there's a hole.
+	CHECK(world.IsTileMissing(2, 1) && world.IsTileKnown(2, 1) && !world.IsTileLoaded(2, 1));
+	CHECK(world.GetTileHeights(2, 1) == NULL && world.GetTileNormals(2, 1) == NULL);
+
+	float height;
+	CHECK(!world.GetHeight(20.f, 12.f, &height));
+	CHECK(world.GetHeight(12.f, 12.f, &height));
+
+	// Missing tiles aren't asked for again.
+	int numLoads = source.numLoads;
+	world.Update(12.5f, 12.f);
+	CHECK(world.GetNumJustLoadedTiles() == 0 && source.numLoads == numLoads);
+
+	// Off the grid isn't a tile at all.
+	CHECK(!world.IsTileKnown(-1, 0) && !world.IsTileMissing(4, 0));
+
+	// Moving up and left, so that (0, 0) comes in: (1, 0)'s left edge,
+	// and (0, 1)'s top, get new normals. (1, 2) is between the radii,
+	// so it stays.
+	world.Update(7.f, 11.f);
+
+	CHECK(world.GetNumJustUnloadedTiles() == 0);
+	REQUIRE(world.GetNumJustLoadedTiles() == 1);
+
+	int tileX, tileZ;
+	world.GetJustLoadedTile(0, &tileX, &tileZ);
+	CHECK(tileX == 0 && tileZ == 0);
+
+	bool foundRight = false, foundBelow = false;
+
+	for (size_t i = 0; i < world.GetNumChangedTiles(); ++i)
+	{
+		int minCol, minRow, maxCol, maxRow;
+		world.GetChangedTile(i, &tileX, &tileZ, &minCol, &minRow, &maxCol, &maxRow);
+
+		CHECK(world.IsTileLoaded(tileX, tileZ));
+
+		if (tileX == 1 && tileZ == 0)
+		{
+			CHECK(minCol == 0 && maxCol == 0 && minRow == 0 && maxRow == TILE_QUADS);
+			foundRight = true;
+		}
+		else if (tileX == 0 && tileZ == 1)
+		{
+			CHECK(minCol == 0 && maxCol == TILE_QUADS && minRow == 0 && maxRow == 0);
+			foundBelow = true;
+		}
+		else
+		{
+			// (1, 1) only touches it at a corner.
+			CHECK(tileX == 1 && tileZ == 1 && minCol == 0 && maxCol == 0 && minRow == 0 && maxRow == 0);
+		}
+	}
+
+	CHECK(foundRight && foundBelow);
+
+	// Far enough away that everything goes.
+	world.Update(31.f, 23.f);
+	CHECK(world.GetNumJustUnloadedTiles() >= 4);
+	CHECK(!world.IsTileLoaded(0, 0) && !world.IsTileLoaded(1, 1));
+
+	// With room for just 3 tiles, the nearest 3 are loaded, and moving
+	// swaps the furthest for nearer ones.
+	TerrainWorldParams params = MakeParams(4, 3, TILE_QUADS, 100.f, 100.f);
+	params.maxNumBytes = TILE_NUM_BYTES * 3;
+
+	TestWorldSource fullSource = MakeSource(TILE_QUADS, -1, -1);
+
+	REQUIRE(world.Create(params, MakeLoadFn(&fullSource)));
+
+	world.Update(1.f, 1.f);
+	CHECK(world.GetNumLoadedTiles() == 3 && world.GetNumBytes() == TILE_NUM_BYTES * 3);
+	CHECK(world.IsTileLoaded(0, 0) && world.IsTileLoaded(1, 0) && world.IsTileLoaded(0, 1));
+
+	world.Update(31.f, 23.f);
+	CHECK(world.GetNumLoadedTiles() == 3);
+	CHECK(world.IsTileLoaded(3, 2) && world.IsTileLoaded(2, 2) && world.IsTileLoaded(3, 1));
+	CHECK(world.GetNumJustUnloadedTiles() == 3);
+
+	world.Destroy();
+	CHECK(world.GetNumLoadedTiles() == 0 && world.GetNumBytes() == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,64 @@
+#ifndef HEADER_8AE1C62E156046ACA920C1E59284C003
+#define HEADER_8AE1C62E156046ACA920C1E59284C003
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Just enough of a test framework for the headless tests of the code
+// that doesn't need D3D.
+//
+// TEST(Name) { ... } defines a test, which runs when RunTests does.
+// CHECK(x) fails the test, and carries on, if x is false, and
+// REQUIRE(x) returns from the test as well; CHECK_CLOSE does the same
+// as CHECK for floats that only need to be near enough.
+//
+// There's no D3D in here, and no Windows either.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+typedef void (*TestFunction)();
+
+struct TestRegistration
+{
+	TestRegistration(const char *pName, TestFunction pFunction);
+};
+
+// Returns false, having printed where, so REQUIRE can give up.
+bool TestFailed(const char *pFileName, int line, const char *pExpression);
+
+// Where the test data (the height maps) are, from the Tests folder.
+std::string GetTestDataFileName(const char *pFileName);
+
+// Somewhere to write files the test reads back, in the temp folder.
+std::string GetTestTempFileName(const char *pFileName);
+
+bool ReadTestFile(const std::string &fileName, std::vector<char> *pData);
+bool WriteTestFile(const std::string &fileName, const std::vector<char> &data);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#define TEST(NAME)\
+	static void Test##NAME();\
+	static TestRegistration g_test##NAME##Registration(#NAME, &Test##NAME);\
+	static void Test##NAME()
+
+#define CHECK(X) ((X) ? true : TestFailed(__FILE__, __LINE__, #X))
+
+#define REQUIRE(X) do { if (!CHECK(X)) return; } while (0)
+
+#define CHECK_CLOSE(A, B, TOLERANCE) CHECK(fabs(double(A) - double(B)) <= (TOLERANCE))
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_8AE1C62E156046ACA920C1E59284C003
@@ -0,0 +1,186 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "Test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct Test
+{
+	const char *pName;
+	TestFunction pFunction;
+};
+
+// Made on first use, as the registrations are static objects in other
+// files, and there's no telling which are made first.
+static std::vector<Test> &GetTests()
+{
+	static std::vector<Test> s_tests;
+	return s_tests;
+}
+
+static int g_numFailures = 0;
+
+static std::string g_dataPath = "../Heightmap/";
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TestRegistration::TestRegistration(const char *pName, TestFunction pFunction)
+{
+	Test test = {pName, pFunction};
+	GetTests().push_back(test);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool TestFailed(const char *pFileName, int line, const char *pExpression)
+{
+	printf("%s(%d): CHECK(%s) failed\n", pFileName, line, pExpression);
+	++g_numFailures;
+
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+std::string GetTestDataFileName(const char *pFileName)
+{
+	return g_dataPath + pFileName;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+std::string GetTestTempFileName(const char *pFileName)
+{
+	const char *pTempPath = getenv("TMPDIR");
+
+	if (!pTempPath)
+		pTempPath = getenv("TEMP");
+
+	if (!pTempPath)
+	{
+#ifdef _WIN32
+		pTempPath = ".";
+#else
+		pTempPath = "/tmp";
+#endif
+	}
+
+	return std::string(pTempPath) + "/HeightmapTests_" + pFileName;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool ReadTestFile(const std::string &fileName, std::vector<char> *pData)
+{
+	pData->clear();
+
+	FILE *pFile = fopen(fileName.c_str(), "rb");
+	if (!pFile)
+		return false;
+
+	char buffer[4096];
+	size_t n;
+
+	while ((n = fread(buffer, 1, sizeof buffer, pFile)) > 0)
+		pData->insert(pData->end(), buffer, buffer + n);
+
+	fclose(pFile);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool WriteTestFile(const std::string &fileName, const std::vector<char> &data)
+{
+	FILE *pFile = fopen(fileName.c_str(), "wb");
+	if (!pFile)
+		return false;
+
+	bool good = data.empty() || fwrite(&data[0], 1, data.size(), pFile) == data.size();
+
+	if (fclose(pFile) != 0)
+		good = false;
+
+	return good;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// RunTests [-data <folder>] [name ...]
+//
+// Runs the tests whose names have any of the given names in them, or
+// all of them. The height maps are looked for in ../Heightmap unless
+// -data says otherwise.
+int main(int argc, char **argv)
+{
+	std::vector<const char *> filters;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-data") == 0 && i + 1 < argc)
+		{
+			g_dataPath = argv[++i];
+
+			if (!g_dataPath.empty() && g_dataPath.back() != '/' && g_dataPath.back() != '\\')
+				g_dataPath += '/';
+		}
+		else
+		{
+			filters.push_back(argv[i]);
+		}
+	}
+
+	const std::vector<Test> &tests = GetTests();
+	int numRun = 0, numFailed = 0;
+
+	for (size_t i = 0; i < tests.size(); ++i)
+	{
+		bool wanted = filters.empty();
+
+		for (size_t j = 0; j < filters.size() && !wanted; ++j)
+			wanted = strstr(tests[i].pName, filters[j]) != NULL;
+
+		if (!wanted)
+			continue;
+
+		int numFailuresBefore = g_numFailures;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		tests[i].pFunction();
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		bool passed = g_numFailures == numFailuresBefore;
+
+		printf("%-48s %s (%.3fs)\n", tests[i].pName, passed ? "ok" : "FAILED", seconds);
+		fflush(stdout);
+
+		++numRun;
+
+		if (!passed)
+			++numFailed;
+	}
+
+	printf("%d of %d tests passed\n", numRun - numFailed, numRun);
+
+	return numFailed == 0 && numRun > 0 ? 0 : 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
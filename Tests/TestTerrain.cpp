@@ -0,0 +1,170 @@
+#include "TestTerrain.h"
+
+#include "TerrainGrid.h"
+
+#include <math.h>
+
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+bool MakeTestGrid(TerrainGrid *pGrid, int width, int length, float gridSize, TestHeightFn heightFn)
+{
+	if (!pGrid->Create(width, length, float(-(width / 2)) * gridSize, float(length / 2) * gridSize, gridSize, -gridSize))
+		return false;
+
+	std::vector<float> heights(size_t(width) * length);
+
+	for (int row = 0; row < length; ++row)
+	{
+		for (int col = 0; col < width; ++col)
+		{
+			float x = pGrid->GetOriginX() + col * pGrid->GetColumnStepX();
+			float z = pGrid->GetOriginZ() + row * pGrid->GetRowStepZ();
+
+			heights[size_t(row) * width + col] = heightFn(x, z);
+		}
+	}
+
+	pGrid->SetHeights(0, 0, width - 1, length - 1, &heights[0], size_t(width));
+	pGrid->CalculateNormals(0, 0, width - 1, length - 1);
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float GetTestHillsHeight(float x, float z)
+{
+	return 5.f + 3.f * sinf(x * .21f) * cosf(z * .17f) + 2.f * sinf((x + z) * .09f);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float GetTestFlatHeight(float, float)
+{
+	return 0.f;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+float GetTestTriangleHeight(const TerrainGrid *pGrid, float x, float z)
+{
+	float col = (x - pGrid->GetOriginX()) / pGrid->GetColumnStepX();
+	float row = (z - pGrid->GetOriginZ()) / pGrid->GetRowStepZ();
+
+	int quadCol = int(floorf(col));
+	int quadRow = int(floorf(row));
+
+	if (quadCol > pGrid->GetWidth() - 2)
+		quadCol = pGrid->GetWidth() - 2;
+
+	if (quadRow > pGrid->GetLength() - 2)
+		quadRow = pGrid->GetLength() - 2;
+
+	float s = col - quadCol;
+	float t = row - quadRow;
+
+	const float *pA = pGrid->GetHeights() + quadRow * pGrid->GetPitch() + quadCol;
+	float a = pA[0];
+	float b = pA[1];
+	float c = pA[pGrid->GetPitch()];
+	float d = pA[pGrid->GetPitch() + 1];
+
+	// a b
+	// c d
+	if (s >= t)
+		return a + (b - a) * s + (d - b) * t;
+	else
+		return a + (d - c) * s + (c - a) * t;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void Normalise(float *v)
+{
+	float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+	for (int i = 0; i < 3; ++i)
+		v[i] /= length;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static void Cross(const float *a, const float *b, float *pResult)
+{
+	pResult[0] = a[1] * b[2] - a[2] * b[1];
+	pResult[1] = a[2] * b[0] - a[0] * b[2];
+	pResult[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void MakeTestViewProj(const float *pEye, const float *pAt, float fovY, float aspect, float nearZ, float farZ, float *pViewProj)
+{
+	const float up[3] = {0.f, 1.f, 0.f};
+
+	float zAxis[3] = {pAt[0] - pEye[0], pAt[1] - pEye[1], pAt[2] - pEye[2]};
+	Normalise(zAxis);
+
+	float xAxis[3];
+	Cross(up, zAxis, xAxis);
+	Normalise(xAxis);
+
+	float yAxis[3];
+	Cross(zAxis, xAxis, yAxis);
+
+	float view[16] = {};
+	const float *axes[3] = {xAxis, yAxis, zAxis};
+
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+			view[j * 4 + i] = axes[i][j];
+
+		view[12 + i] = -(axes[i][0] * pEye[0] + axes[i][1] * pEye[1] + axes[i][2] * pEye[2]);
+	}
+
+	view[15] = 1.f;
+
+	float height = 1.f / tanf(fovY * .5f);
+
+	float proj[16] = {};
+	proj[0] = height / aspect;
+	proj[5] = height;
+	proj[10] = farZ / (farZ - nearZ);
+	proj[11] = 1.f;
+	proj[14] = -nearZ * farZ / (farZ - nearZ);
+
+	for (int row = 0; row < 4; ++row)
+	{
+		for (int col = 0; col < 4; ++col)
+		{
+			float sum = 0.f;
+
+			for (int i = 0; i < 4; ++i)
+				sum += view[row * 4 + i] * proj[i * 4 + col];
+
+			pViewProj[row * 4 + col] = sum;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+void TransformTestPoint(const float *pMatrix, const float *p, float *pClip)
+{
+	for (int i = 0; i < 4; ++i)
+		pClip[i] = p[0] * pMatrix[i] + p[1] * pMatrix[4 + i] + p[2] * pMatrix[8 + i] + pMatrix[12 + i];
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,48 @@
+#ifndef HEADER_6E0702A642884F9B8209BED5F9361542
+#define HEADER_6E0702A642884F9B8209BED5F9361542
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+//
+// Terrain for the tests to work on.
+//
+// Grids are laid out the way Heightmap lays out its own: centred on
+// the origin, with x going up along each row and z going down from
+// one row to the next.
+//
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+class TerrainGrid;
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+typedef float (*TestHeightFn)(float x, float z);
+
+// Heights come from heightFn, and the normals are calculated.
+bool MakeTestGrid(TerrainGrid *pGrid, int width, int length, float gridSize, TestHeightFn heightFn);
+
+// Rolling hills, up to about 10 units high, with several hills across
+// a 64x64 grid.
+float GetTestHillsHeight(float x, float z);
+
+float GetTestFlatHeight(float x, float z);
+
+// The height at (x, z) of the triangles TerrainMesh draws, each quad
+// split from its top left corner to its bottom right, worked out the
+// slow way. (x, z) must be on the grid.
+float GetTestTriangleHeight(const TerrainGrid *pGrid, float x, float z);
+
+// A camera at pEye looking at pAt, with y up, as the view * projection
+// matrix XMMatrixLookAtLH and XMMatrixPerspectiveFovLH would make:
+// 16 floats, row by row, for row vectors.
+void MakeTestViewProj(const float *pEye, const float *pAt, float fovY, float aspect, float nearZ, float farZ, float *pViewProj);
+
+// p (x, y, z, 1) times the matrix, as above.
+void TransformTestPoint(const float *pMatrix, const float *p, float *pClip);
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+#endif//HEADER_6E0702A642884F9B8209BED5F9361542
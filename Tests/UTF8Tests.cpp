@@ -0,0 +1,116 @@
+#include "Test.h"
+
+#include "UTF8.h"
+
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+static std::vector<uint32_t> DecodeAll(const char *pStr)
+{
+	std::vector<uint32_t> chs;
+
+	while (*pStr != 0)
+		chs.push_back(DecodeUTF8(&pStr));
+
+	return chs;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(DecodeUTF8ReadsEachLength)
+{
+	std::vector<uint32_t> chs = DecodeAll("A\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80");
+
+	REQUIRE(chs.size() == 4);
+	CHECK(chs[0] == 'A');
+	CHECK(chs[1] == 0xE9);
+	CHECK(chs[2] == 0x20AC);
+	CHECK(chs[3] == 0x1F600);
+
+	// The ends of each range.
+	chs = DecodeAll("\x7F\xC2\x80\xDF\xBF\xE0\xA0\x80\xEF\xBF\xBF\xF0\x90\x80\x80\xF4\x8F\xBF\xBF");
+
+	REQUIRE(chs.size() == 7);
+	CHECK(chs[0] == 0x7F);
+	CHECK(chs[1] == 0x80);
+	CHECK(chs[2] == 0x7FF);
+	CHECK(chs[3] == 0x800);
+	CHECK(chs[4] == 0xFFFF);
+	CHECK(chs[5] == 0x10000);
+	CHECK(chs[6] == 0x10FFFF);
+
+	// Either side of the surrogates.
+	chs = DecodeAll("\xED\x9F\xBF\xEE\x80\x80");
+
+	REQUIRE(chs.size() == 2);
+	CHECK(chs[0] == 0xD7FF);
+	CHECK(chs[1] == 0xE000);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(DecodeUTF8RejectsMalformedSequences)
+{
+	// Each bad sequence comes out as one replacement per byte, and
+	// the next character is still read properly.
+	static const struct
+	{
+		const char *pStr;
+		size_t numBytes;
+	}
+	BAD[] = {
+		{"\x80", 1},				// trailing byte on its own
+		{"\xBF", 1},
+		{"\xFE", 1},				// never valid
+		{"\xF8\x88\x80\x80\x80", 5},	// 5 byte form
+		{"\xC3", 1},				// cut short
+		{"\xE2\x82", 2},
+		{"\xC0\x80", 2},			// overlong 0
+		{"\xC1\xBF", 2},			// overlong 0x7F
+		{"\xE0\x80\xAF", 3},		// overlong '/'
+		{"\xE0\x9F\xBF", 3},		// overlong 0x7FF
+		{"\xF0\x8F\xBF\xBF", 4},	// overlong 0xFFFF
+		{"\xED\xA0\x80", 3},		// U+D800
+		{"\xED\xBF\xBF", 3},		// U+DFFF
+		{"\xF4\x90\x80\x80", 4},	// U+110000
+		{"\xF7\xBF\xBF\xBF", 4},
+	};
+
+	for (size_t i = 0; i < sizeof BAD / sizeof BAD[0]; ++i)
+	{
+		std::string str = std::string(BAD[i].pStr) + "z";
+		std::vector<uint32_t> chs = DecodeAll(str.c_str());
+
+		REQUIRE(chs.size() == BAD[i].numBytes + 1);
+
+		for (size_t j = 0; j < BAD[i].numBytes; ++j)
+			CHECK(chs[j] == UTF8_REPLACEMENT_CHAR);
+
+		CHECK(chs.back() == 'z');
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(DecodeUTF8StopsAtTheEnd)
+{
+	// A sequence cut short by the end of the string doesn't read past
+	// it.
+	const char str[] = "\xF0\x9F";
+	const char *p = str;
+
+	CHECK(DecodeUTF8(&p) == UTF8_REPLACEMENT_CHAR);
+	CHECK(p == str + 1);
+	CHECK(DecodeUTF8(&p) == UTF8_REPLACEMENT_CHAR);
+	CHECK(p == str + 2);
+	CHECK(*p == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
@@ -0,0 +1,195 @@
+#include "Test.h"
+
+#include "VertexCacheOptimiser.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+struct TestTriangle
+{
+	uint16_t v[3];
+
+	bool operator<(const TestTriangle &other) const
+	{
+		return std::lexicographical_compare(v, v + 3, other.v, other.v + 3);
+	}
+
+	bool operator==(const TestTriangle &other) const
+	{
+		return std::equal(v, v + 3, other.v);
+	}
+};
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// The triangles, each turned round (not flipped) to start at its
+// smallest index, then sorted. Two lists with the same result have
+// the same triangles, facing the same way.
+static std::vector<TestTriangle> GetTriangleSet(const std::vector<uint16_t> &indices, const std::vector<uint16_t> &vertexIDs)
+{
+	std::vector<TestTriangle> triangles(indices.size() / 3);
+
+	for (size_t i = 0; i < triangles.size(); ++i)
+	{
+		uint16_t *v = triangles[i].v;
+
+		for (int j = 0; j < 3; ++j)
+			v[j] = vertexIDs[indices[i * 3 + j]];
+
+		std::rotate(v, std::min_element(v, v + 3), v + 3);
+	}
+
+	std::sort(triangles.begin(), triangles.end());
+
+	return triangles;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Split as TerrainMesh does.
+static std::vector<uint16_t> MakeGridIndices(int width, int length)
+{
+	std::vector<uint16_t> indices;
+
+	for (int row = 0; row + 1 < length; ++row)
+	{
+		for (int col = 0; col + 1 < width; ++col)
+		{
+			uint16_t a = uint16_t(row * width + col);
+			uint16_t b = uint16_t(a + 1);
+			uint16_t c = uint16_t(a + width);
+			uint16_t d = uint16_t(c + 1);
+
+			uint16_t quad[6] = {a, b, d, a, d, c};
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+
+	return indices;
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+// Optimises the indices and vertices, each vertex being its original
+// number, and checks the triangles come out the same. Returns the
+// stats before and after.
+static void OptimiseAndCheck(std::vector<uint16_t> *pIndices, size_t numVertices, VertexCacheStats *pBefore, VertexCacheStats *pAfter)
+{
+	std::vector<uint16_t> vertexIDs(numVertices);
+	for (size_t i = 0; i < numVertices; ++i)
+		vertexIDs[i] = uint16_t(i);
+
+	std::vector<TestTriangle> original = GetTriangleSet(*pIndices, vertexIDs);
+
+	AnalyseVertexCache(&(*pIndices)[0], pIndices->size(), numVertices, DEFAULT_VERTEX_CACHE_SIZE, pBefore);
+
+	OptimiseVertexCache(&(*pIndices)[0], pIndices->size(), numVertices);
+	CHECK(GetTriangleSet(*pIndices, vertexIDs) == original);
+
+	OptimiseVertexFetch(&vertexIDs[0], numVertices, sizeof vertexIDs[0], &(*pIndices)[0], pIndices->size());
+	CHECK(GetTriangleSet(*pIndices, vertexIDs) == original);
+
+	AnalyseVertexCache(&(*pIndices)[0], pIndices->size(), numVertices, DEFAULT_VERTEX_CACHE_SIZE, pAfter);
+
+	// The vertices are in the order the triangles first use them, then
+	// the unused ones in their old order.
+	std::vector<bool> used(numVertices, false);
+	uint16_t next = 0;
+
+	for (size_t i = 0; i < pIndices->size(); ++i)
+	{
+		uint16_t index = (*pIndices)[i];
+
+		if (!used[index])
+		{
+			CHECK(index == next);
+
+			used[index] = true;
+			++next;
+		}
+	}
+
+	for (size_t i = next; i + 1 < numVertices; ++i)
+		CHECK(vertexIDs[i] < vertexIDs[i + 1]);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(VertexCacheOptimiserImprovesTerrainChunks)
+{
+	// A full TerrainMesh chunk, and an odd one from the edge of a map.
+	static const int SIZES[][2] = {{65, 65}, {65, 12}, {2, 2}};
+
+	for (size_t i = 0; i < sizeof SIZES / sizeof SIZES[0]; ++i)
+	{
+		int width = SIZES[i][0], length = SIZES[i][1];
+		size_t numVertices = size_t(width) * length;
+
+		std::vector<uint16_t> indices = MakeGridIndices(width, length);
+
+		VertexCacheStats before, after;
+		OptimiseAndCheck(&indices, numVertices, &before, &after);
+
+		size_t numTriangles = indices.size() / 3;
+
+		CHECK_CLOSE(before.acmr, double(before.numTransformed) / numTriangles, 1e-6);
+		CHECK_CLOSE(after.atvr, double(after.numTransformed) / numVertices, 1e-6);
+
+		CHECK(after.numTransformed <= before.numTransformed);
+		CHECK(after.acmr >= .5f && after.atvr >= 1.f);
+
+		printf("    %dx%d grid: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", width, length, before.acmr, after.acmr, before.atvr, after.atvr);
+
+		// Row by row, each row of vertices has fallen out of a 16
+		// entry cache by the time the next row wants it.
+		if (width == 65 && length == 65)
+		{
+			CHECK(before.acmr > 1.f);
+			CHECK(after.acmr < .75f);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
+
+TEST(VertexCacheOptimiserKeepsTriangles)
+{
+	std::mt19937 random(2);
+
+	// Random triangles (some sharing vertices, some vertices unused),
+	// which are only kept the same, not necessarily improved.
+	for (int i = 0; i < 20; ++i)
+	{
+		size_t numVertices = 3 + random() % 500;
+		size_t numTriangles = 1 + random() % 1000;
+
+		std::vector<uint16_t> indices(numTriangles * 3);
+		for (size_t j = 0; j < indices.size(); ++j)
+			indices[j] = uint16_t(random() % numVertices);
+
+		VertexCacheStats before, after;
+		OptimiseAndCheck(&indices, numVertices, &before, &after);
+
+		// Never more than one transform per index.
+		CHECK(after.numTransformed <= indices.size());
+	}
+
+	// An empty mesh does nothing.
+	VertexCacheStats stats;
+	AnalyseVertexCache(NULL, 0, 0, DEFAULT_VERTEX_CACHE_SIZE, &stats);
+	CHECK(stats.numTransformed == 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////